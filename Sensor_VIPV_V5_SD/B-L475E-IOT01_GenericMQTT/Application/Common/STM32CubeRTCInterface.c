@@ -47,6 +47,7 @@
 #include "timingSystem.h"
 #include "main.h"
 #include <time.h>
+#include <string.h>
 
 #define CONVERSION_EPOCHFACTOR  2208988800ul
 
@@ -163,6 +164,92 @@ time_t 	TimingSystemGetSystemTime(void)
   return returnTime;
 }
 
+/**
+ * @brief  Get RTC time with the sub-second part
+ * @param  uint32_t *ms : milliseconds elapsed in the current second
+ * @retval time_t : time retrieved from RTC, 0 on failure
+ */
+time_t TimingSystemGetSystemTimeMs(uint32_t *ms)
+{
+  struct tm calendar;
+  RTC_DateTypeDef sdatestructure;
+  RTC_TimeTypeDef stimestructure;
+  uint32_t ticks;
+  time_t returnTime;
+
+  /* The date must be read after the time to unlock the shadow registers. */
+  if((HAL_RTC_GetTime(&hrtc,&stimestructure,FORMAT_BIN)!=HAL_OK) ||
+     (HAL_RTC_GetDate(&hrtc,&sdatestructure,FORMAT_BIN)!=HAL_OK)) {
+    return 0;
+  }
+
+  memset(&calendar, 0, sizeof(calendar));
+  calendar.tm_year = sdatestructure.Year + 100;
+  calendar.tm_mon  = sdatestructure.Month - 1;
+  calendar.tm_mday = sdatestructure.Date;
+  calendar.tm_hour = stimestructure.Hours;
+  calendar.tm_min  = stimestructure.Minutes;
+  calendar.tm_sec  = stimestructure.Seconds;
+  returnTime = mktime(&calendar);
+
+  /* The sub-second counter counts down from SecondFraction. It is above it only
+   * after a shift operation, while the calendar is still one second ahead. */
+  if (stimestructure.SubSeconds > stimestructure.SecondFraction) {
+    ticks = 2 * stimestructure.SecondFraction + 1 - stimestructure.SubSeconds;
+    returnTime--;
+  } else {
+    ticks = stimestructure.SecondFraction - stimestructure.SubSeconds;
+  }
+  if (ms != NULL) {
+    *ms = (ticks * 1000U) / (stimestructure.SecondFraction + 1);
+  }
+  return returnTime;
+}
+
+/**
+ * @brief  Shift the RTC time by a signed offset
+ * @note   Below one second the calendar is not stopped: the synchronous
+ *         prescaler is shifted, with a resolution of 1/(SynchPrediv+1) s.
+ *         Above, the calendar is set and the fraction applied as a shift.
+ * @param  int64_t offset_ms : correction, positive when the RTC is late
+ * @retval int value for success(1)/failure(0)
+ */
+int TimingSystemAdjustSystemTimeMs(int64_t offset_ms)
+{
+  uint32_t fraction = hrtc.Init.SynchPrediv + 1;
+  uint32_t ms;
+  int64_t target;
+  time_t now;
+
+  if ((offset_ms > -1000) && (offset_ms < 1000)) {
+    if (offset_ms > 0) {
+      /* Add one second and delay by its complement. */
+      return (HAL_RTCEx_SetSynchroShift(&hrtc, RTC_SHIFTADD1S_SET,
+                (uint32_t)((1000 - offset_ms) * fraction / 1000)) == HAL_OK) ? 1 : 0;
+    } else if (offset_ms < 0) {
+      return (HAL_RTCEx_SetSynchroShift(&hrtc, RTC_SHIFTADD1S_RESET,
+                (uint32_t)(-offset_ms * fraction / 1000)) == HAL_OK) ? 1 : 0;
+    }
+    return 1;
+  }
+
+  now = TimingSystemGetSystemTimeMs(&ms);
+  target = (int64_t)now * 1000 + ms + offset_ms;
+  if ((now == 0) || (target < 0)) {
+    return 0;
+  }
+  /* Setting the calendar restarts the prescaler at the beginning of a second. */
+  if (TimingSystemSetSystemTime((time_t)(target / 1000)) == 0) {
+    return 0;
+  }
+  ms = (uint32_t)(target % 1000);
+  if (ms > 0) {
+    return (HAL_RTCEx_SetSynchroShift(&hrtc, RTC_SHIFTADD1S_SET,
+              (1000 - ms) * fraction / 1000) == HAL_OK) ? 1 : 0;
+  }
+  return 1;
+}
+
 /**
  * @brief  Convert NTP time to epoch time
  * @param  uint8_t* pBufferTimingAnswer : pointer to buffer containing the NTP date
@@ -51,6 +51,7 @@
 #include "main.h"
 #include "net.h"
 #include "timedate.h"
+#include "sntp.h"
 #include "heap.h"
 #include "rfu.h"
 #include "cloud.h"
@@ -167,13 +168,37 @@ void CLOUD_Error_Handler(int errorCode)
 
 const firmware_version_t version = { FW_VERSION_NAME, FW_VERSION_MAJOR, FW_VERSION_MINOR, FW_VERSION_PATCH, FW_VERSION_DATE};
 
+/**
+  * @brief  Plataforma completa: parte local y red, en secuencia y bloqueante.
+  *         La aplicacion del sensor usa por separado platform_init_local() al arrancar
+  *         y levanta la red en segundo plano.
+  */
 int platform_init(void)
 {
-  net_ipaddr_t ipAddr;
-  net_macaddr_t macAddr;
+  int ret = platform_init_local();
+
+  if (ret == 0)
+  {
+    ret = platform_init_network();
+  }
+  return ret;
+}
+
+
+/**
+  * @brief  Parte de la inicializacion que no necesita la red: semilla de rand(), cabecera y
+  *         aprovisionamiento de credenciales WiFi, IoT y TLS en la flash. Solo pide datos por la
+  *         consola si faltan, es decir, en el primer arranque; en otro caso no espera a nada.
+  * @retval 0
+  */
+int platform_init_local(void)
+{
   const firmware_version_t  *fw_version=&version;;
   unsigned int random_number = 0;
   bool skip_reconf = false;
+  const char *ssid = NULL;
+  const char *psk = NULL;
+  uint8_t security_mode = 0;
   
 #ifdef HEAP_DEBUG
   stack_measure_prologue();
@@ -193,7 +218,57 @@ int platform_init(void)
            fw_version->major, fw_version->minor, fw_version->patch, fw_version->packaged_date);
   printf("\n");
 
+  if (checkWiFiCredentials(&ssid, &psk, &security_mode) != HAL_OK)
+  {
+    printf("Debe introducir la configuracion de su red WiFi para continuar.\n");
+    do
+    {
+      updateWiFiCredentials();
+    } while (checkWiFiCredentials(&ssid, &psk, &security_mode) != HAL_OK);
+  }
+
+  /* Security and cloud parameters definition */
+  /* Define, or allow to update if the user button is pushed. */
   
+  
+  skip_reconf = (checkTLSRootCA() == 0)
+    && ( (checkTLSDeviceConfig() == 0) || !app_needs_device_keypair() )
+    && (checkIoTDeviceConfig() == 0);
+  
+  
+  if (skip_reconf == false)
+  {
+    if (dialog_ask("Desea actualizar la lista de redes WiFi conocidas? (y/n)\n"))
+    {
+      updateKnownWiFiNetworks();
+    }
+    if ((checkIoTDeviceConfig() != 0) || dialog_ask("Desea actualizar los parametros de su dispositivo IoT? (y/n)\n"))
+    {
+      if (cloud_device_enter_credentials() != 0)
+      {
+        msg_error("Fallo al configurar el dispositivo IoT.\n");
+      }
+    }
+#if defined(USE_MBED_TLS) || (!defined(USE_CLEAR_TIMEDATE))
+    updateTLSCredentials();
+#endif
+  }
+  /* End of security and cloud parameters definition */
+
+  return 0;
+}
+
+
+/**
+  * @brief  Parte de red: conexion al AP (hasta 17 intentos en net_if_init()), direccion IP y RTC
+  *         desde la hora de la red. Bloquea mientras no haya cobertura.
+  * @retval 0 si todo es correcto, -1 en caso contrario
+  */
+int platform_init_network(void)
+{
+  net_ipaddr_t ipAddr;
+  net_macaddr_t macAddr;
+
   printf("\n\t--- Personalizacion de la placa B-L475E-IOT01A ---\n\n");
   /* Network initialization */
   if (net_init(&hnet, NET_IF, (net_if_init)) != NET_OK)
@@ -242,36 +317,14 @@ int platform_init(void)
     }
   }
   /* End of network initialisation */
-
-  /* Security and cloud parameters definition */
-  /* Define, or allow to update if the user button is pushed. */
-  
-  
-  skip_reconf = (checkTLSRootCA() == 0)
-    && ( (checkTLSDeviceConfig() == 0) || !app_needs_device_keypair() )
-    && (checkIoTDeviceConfig() == 0);
-  
-  
-  if (skip_reconf == false)
-  {
-    if ((checkIoTDeviceConfig() != 0) || dialog_ask("Desea actualizar los parametros de su dispositivo IoT? (y/n)\n"))
-    {
-      if (cloud_device_enter_credentials() != 0)
-      {
-        msg_error("Fallo al configurar el dispositivo IoT.\n");
-      }
-    }
-#if defined(USE_MBED_TLS) || (!defined(USE_CLEAR_TIMEDATE))
-    updateTLSCredentials();
-#endif
-  }
-  /* End of security and cloud parameters definition */
   
   msg_info("\nEstableciendo el RTC desde la hora de la red...\n");
+  /* SNTP first: one UDP exchange, no TLS certificate to check against a clock not yet set. */
 #ifdef CLOUD_TIMEDATE_TLS_VERIFICATION_IGNORE
-  if (setRTCTimeDateFromNetwork(true) != TD_OK)
+  if ( (SNTP_SyncRTC(NULL, NULL) != SNTP_OK) && (setRTCTimeDateFromNetwork(true) != TD_OK) )
 #else   /* CLOUD_TIMEDATE_TLS_VERIFICATION_IGNORE */
-    if ( (setRTCTimeDateFromNetwork(false) != TD_OK) && (setRTCTimeDateFromNetwork(true) != TD_OK) )
+    if ( (SNTP_SyncRTC(NULL, NULL) != SNTP_OK)
+        && (setRTCTimeDateFromNetwork(false) != TD_OK) && (setRTCTimeDateFromNetwork(true) != TD_OK) )
 #endif  /* CLOUD_TIMEDATE_TLS_VERIFICATION_IGNORE */
   
   {
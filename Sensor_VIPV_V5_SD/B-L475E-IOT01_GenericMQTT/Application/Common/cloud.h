@@ -53,6 +53,8 @@ extern "C" {
 
 /** Provided interface */  
 int platform_init(void);
+int platform_init_local(void);
+int platform_init_network(void);
 void platform_deinit(void);
 bool dialog_ask(char *s);
 
@@ -61,6 +61,7 @@ int FLASH_update(uint32_t dst_addr, const void *data, uint32_t size);
 #if defined (STM32L475xx) || defined (STM32L496xx)
 uint32_t FLASH_Write(uint32_t uDestination, uint32_t *pSource, uint32_t uLength);
 uint32_t FLASH_Erase_Size(uint32_t uStart, uint32_t uLength);
+int FLASH_set_boot_bank(uint32_t bank);
 #else
 int FLASH_write_at(uint32_t address, uint32_t *pData, uint32_t len_bytes);
 uint32_t GetSectorMap(void);
@@ -491,5 +491,43 @@ uint32_t FLASH_Write(uint32_t uDestination, uint32_t *pSource, uint32_t uLength)
   }
   return e_ret_status;
 }
+
+
+/**
+  * @brief  Select the FLASH bank to boot from, through the BFB2 option bit, and reload the option bytes.
+  * @note   With BFB2 set, the system bootloader boots from bank 2 if it holds a valid initial stack pointer, and
+  *         from bank 1 otherwise. The selected bank is then mapped at FLASH_BASE (SYSCFG_MEMRMP_FB_MODE).
+  * @note   The option bytes reload resets the device.
+  * @param  In: bank   FLASH_BANK_1 or FLASH_BANK_2 (physical banks),
+  *                    or FLASH_BANK_BOTH for the bank which is not running.
+  * @retval Does not return on success.
+  *         -1: Failure.
+  */
+int FLASH_set_boot_bank(uint32_t bank)
+{
+  FLASH_OBProgramInitTypeDef OBInit;
+
+  if (bank == FLASH_BANK_BOTH)
+  {
+    bank = (READ_BIT(SYSCFG->MEMRMP, SYSCFG_MEMRMP_FB_MODE) == 0) ? FLASH_BANK_2 : FLASH_BANK_1;
+  }
+
+  memset(&OBInit, 0, sizeof(OBInit));
+  OBInit.OptionType = OPTIONBYTE_USER;
+  OBInit.USERType   = OB_USER_BFB2;
+  OBInit.USERConfig = (bank == FLASH_BANK_2) ? OB_BFB2_ENABLE : OB_BFB2_DISABLE;
+
+  HAL_FLASH_Unlock();
+  __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+  HAL_FLASH_OB_Unlock();
+  if (HAL_FLASHEx_OBProgram(&OBInit) == HAL_OK)
+  {
+    HAL_FLASH_OB_Launch();
+  }
+  printf("ERROR: Unable to program the BFB2 option bit\n");
+  HAL_FLASH_OB_Lock();
+  HAL_FLASH_Lock();
+  return -1;
+}
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
 
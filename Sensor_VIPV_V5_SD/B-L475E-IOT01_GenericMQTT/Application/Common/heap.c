@@ -45,6 +45,7 @@
 
 #include "heap.h"
 #include "stdlib.h"
+#include "malloc.h"   /* malloc_usable_size() */
 #include "msg.h"
 
 #ifndef CODE_UNDER_FIREWALL
@@ -113,6 +114,170 @@ void heap_stat(uint32_t *heap_max,uint32_t *heap_current,uint32_t *stack_size)
   *stack_size = stack_max_size;
 }
 
+
+static heap_class_stat_t heap_classes[HEAP_CLASS_COUNT];
+
+/**
+  * @brief  calloc() accounted to an allocation class. Never blocks nor aborts: a refused
+  *         allocation is counted and returns NULL, for the caller to handle.
+  * @param  cls   Allocation class.
+  * @param  a     Number of elements.
+  * @param  b     Size of each element.
+  * @retval Zeroed block, or NULL.
+  */
+void *heap_class_alloc(heap_class_t cls, size_t a, size_t b)
+{
+  heap_class_stat_t *c = &heap_classes[cls];
+  void *p = calloc(a, b);
+
+  if (p == NULL)
+  {
+    c->failures++;
+    return NULL;
+  }
+
+  size_t n = malloc_usable_size(p);
+  c->allocs++;
+  c->current += n;
+  if (c->current > c->peak) c->peak = c->current;
+  if (n > c->largest) c->largest = n;
+  return p;
+}
+
+/**
+  * @brief  free() of a block obtained from heap_class_alloc() with the same class.
+  */
+void heap_class_free(heap_class_t cls, void *p)
+{
+  if (p == NULL) return;
+
+  size_t n = malloc_usable_size(p);
+  heap_classes[cls].current -= (n < heap_classes[cls].current) ? n : heap_classes[cls].current;
+  free(p);
+}
+
+/**
+  * @brief  Copy of the accounting of all the classes.
+  */
+void heap_class_stat(heap_class_stat_t stat[HEAP_CLASS_COUNT])
+{
+  memcpy(stat, heap_classes, sizeof(heap_classes));
+}
+
+#if defined(USE_MBED_TLS) && !defined(HEAP_DEBUG)
+#include "mbedtls/platform.h"
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_C)
+#include "mbedtls/memory_buffer_alloc.h"
+
+/* mbedTLS arena in RAM2 (NOLOAD, .ram2 in the linker script): the record buffers and the handshake
+ * temporaries never fragment the newlib heap, and the peak of every connection is bounded by the
+ * pool size instead of by whatever the heap has left at that moment. */
+static unsigned char heap_tls_pool[HEAP_TLS_POOL_SIZE] __attribute__((section(".ram2"), aligned(8)));
+static void *(*pool_calloc)(size_t, size_t) = NULL;
+static void (*pool_free)(void *) = NULL;
+
+/* mbedtls_memory_buffer_alloc_cur_get()/max_get() report the payload of the blocks (rounded up to
+ * MBEDTLS_MEMORY_ALIGN_MULTIPLE) but not the memory_header in front of each one. Its size is private
+ * to memory_buffer_alloc.c: seven size_t/pointer fields plus magic2 without MBEDTLS_MEMORY_BACKTRACE. */
+#if defined(MBEDTLS_MEMORY_BACKTRACE)
+#error "HEAP_TLS_HEADER_SIZE assumes the memory_header without MBEDTLS_MEMORY_BACKTRACE"
+#endif
+#define HEAP_TLS_HEADER_SIZE  (8 * sizeof(size_t))
+
+/* Bytes of the pool taken by 'used' payload bytes in 'blocks' blocks, as mbedTLS itself adds them up
+ * in mbedtls_memory_buffer_alloc_status(). */
+#define HEAP_TLS_FOOTPRINT(used, blocks)  ((used) + (blocks) * HEAP_TLS_HEADER_SIZE)
+
+/**
+  * @brief  calloc() of the pool, accounted as HEAP_CLASS_TLS. The current and peak values are the
+  *         bytes of the pool in use, headers included, so they can be compared with HEAP_TLS_POOL_SIZE.
+  */
+static void *heap_tls_calloc(size_t a, size_t b)
+{
+  heap_class_stat_t *c = &heap_classes[HEAP_CLASS_TLS];
+  size_t used, blocks;
+  void *p = pool_calloc(a, b);
+
+  if (p == NULL)
+  {
+    c->failures++;
+    return NULL;
+  }
+
+  c->allocs++;
+  if (a * b > c->largest) c->largest = a * b;
+  mbedtls_memory_buffer_alloc_cur_get(&used, &blocks);
+  c->current = HEAP_TLS_FOOTPRINT(used, blocks);
+  mbedtls_memory_buffer_alloc_max_get(&used, &blocks);
+  c->peak = HEAP_TLS_FOOTPRINT(used, blocks);
+  return p;
+}
+
+static void heap_tls_free(void *p)
+{
+  size_t used, blocks;
+
+  pool_free(p);
+  mbedtls_memory_buffer_alloc_cur_get(&used, &blocks);
+  heap_classes[HEAP_CLASS_TLS].current = HEAP_TLS_FOOTPRINT(used, blocks);
+}
+
+/**
+  * @brief  Routes the mbedTLS allocations to the RAM2 pool. Only the first call formats the pool,
+  *         so that it may be called before every connection: the cached credentials and session
+  *         live in the pool across connections.
+  */
+void heap_tls_pool_init(void)
+{
+  if (pool_calloc != NULL) return;
+
+  mbedtls_memory_buffer_alloc_init(heap_tls_pool, sizeof(heap_tls_pool));
+  pool_calloc = mbedtls_calloc;   /* Set by the line above. */
+  pool_free = mbedtls_free;
+  mbedtls_platform_set_calloc_free(heap_tls_calloc, heap_tls_free);
+}
+
+/**
+  * @brief  Size of the pool and number of blocks in it: the allocated ones and the free fragments
+  *         between them, each with its header.
+  */
+void heap_tls_pool_stat(uint32_t *size, uint32_t *blocks)
+{
+  size_t used = 0, n = 0;
+
+  if (pool_calloc != NULL) mbedtls_memory_buffer_alloc_cur_get(&used, &n);
+  *size = sizeof(heap_tls_pool);
+  *blocks = n;
+}
+
+#else /* MBEDTLS_MEMORY_BUFFER_ALLOC_C */
+
+static void *heap_tls_calloc(size_t a, size_t b)
+{
+  return heap_class_alloc(HEAP_CLASS_TLS, a, b);
+}
+
+static void heap_tls_free(void *p)
+{
+  heap_class_free(HEAP_CLASS_TLS, p);
+}
+
+/**
+  * @brief  Without the buffer allocator, mbedTLS takes its memory from the heap, accounted as HEAP_CLASS_TLS.
+  */
+void heap_tls_pool_init(void)
+{
+  mbedtls_platform_set_calloc_free(heap_tls_calloc, heap_tls_free);
+}
+
+void heap_tls_pool_stat(uint32_t *size, uint32_t *blocks)
+{
+  *size = 0;
+  *blocks = 0;
+}
+#endif /* MBEDTLS_MEMORY_BUFFER_ALLOC_C */
+#endif /* USE_MBED_TLS && !HEAP_DEBUG */
+
 #ifdef HEAP_DEBUG
 static  void heap_abort(void)
 {
@@ -65,6 +65,42 @@ void heap_free(void  *p);
 
 void heap_stat(uint32_t *heap_max,uint32_t *heap_current, uint32_t *stacksize)  ;
 
+/* Per-class accounting of the dynamic allocations, always enabled.
+ * Each class counts the bytes really taken from the heap (malloc_usable_size()), so that the
+ * current and peak values of all classes add up with what the allocator reports. */
+typedef enum
+{
+  HEAP_CLASS_TLS = 0,     /**< mbedTLS, through heap_tls_pool_init(). */
+  HEAP_CLASS_FIFO,        /**< Nodes of the recovery FIFO (FIFO.h). */
+  HEAP_CLASS_NMEA,        /**< Segmentation buffer of the NMEA decoder. */
+  HEAP_CLASS_NET,         /**< Network and socket contexts (net_malloc()). */
+  HEAP_CLASS_COUNT
+} heap_class_t;
+
+typedef struct
+{
+  uint32_t current;       /**< Bytes in use. */
+  uint32_t peak;          /**< High-water mark of current. */
+  uint32_t allocs;        /**< Successful allocations. */
+  uint32_t failures;      /**< Allocations refused by the heap. */
+  uint32_t largest;       /**< Largest single allocation, in bytes. */
+} heap_class_stat_t;
+
+void *heap_class_alloc(heap_class_t cls, size_t a, size_t b);
+void heap_class_free(heap_class_t cls, void *p);
+void heap_class_stat(heap_class_stat_t stat[HEAP_CLASS_COUNT]);
+
+/* Fixed arena of mbedTLS (MBEDTLS_MEMORY_BUFFER_ALLOC_C), in RAM2. With it, HEAP_CLASS_TLS reports
+ * the use of the pool instead of the heap: current and peak count the bytes of the pool in use, the
+ * header of the mbedTLS allocator in front of each block included. Without HEAP_DEBUG only.
+ * The host tests may set another size: their headers and pointers are twice as large. */
+#ifndef HEAP_TLS_POOL_SIZE
+#define HEAP_TLS_POOL_SIZE  (32 * 1024)   /* All of RAM2. */
+#endif
+
+void heap_tls_pool_init(void);
+void heap_tls_pool_stat(uint32_t *size, uint32_t *blocks);
+
 #endif  /* __HEAP_H__ */
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -111,17 +111,17 @@ int http_req_create(char ** const req_buf , const char * const query, const char
   if (post_buf_size == 0)
   {
     /* HTTP GET request */
-    req_buf_len  += (offset + 1) / 10 + (offset + size) / 10     /* Variable length of the Range header */
+    req_buf_len  += 2 * 10                                    /* Variable length of the Range header: two 32-bit numbers. */
         + 47;                                               /* Overall fixed-size length of the request string .*/
   }
   else
   { 
     /* HTTP POST request */
-    req_buf_len += 48 + post_buf_size/10;                   /* Overall fixed-size length of the request string .*/
+    req_buf_len += 48 + 10;                                 /* Overall fixed-size length of the request string .*/
   }
   
   *req_buf = malloc(req_buf_len);
-  if (req_buf == NULL)
+  if (*req_buf == NULL)
   {
     rc = HTTP_ERR;
   }
@@ -134,7 +134,8 @@ int http_req_create(char ** const req_buf , const char * const query, const char
           "GET /%s HTTP/1.1\r\n"
           "Host: %s\r\n"
           "Range: bytes=%d-%d\r\n"
-          "%s\r\n\r\n",
+          "%s\r\n",   /* The extra header lines end with \r\n: a single empty line ends the header, so that the
+                         keep-alive connection is not left with a stray line before the next request. */
           query, hostname, offset, offset + size - 1, (extra_headers == NULL) ? "" : extra_headers);
     }
     else
@@ -460,6 +461,7 @@ int http_read(uint8_t * const readbuffer, http_range_status_t * const status, co
         if ( (ret < 0) && (rc == HTTP_OK) )
         {
           rc = HTTP_ERR_HTTP;
+          pCtx->connection_is_open = false;   /* The rest of the response would be read as the next one. */
         }
       } 
     }
@@ -95,6 +95,7 @@ const  user_config_t	*lUserConfigPtr = &__uninited_region_start__;
 const char mi_ssid[] = MI_SSID_WIFI;
 const char mi_psk[] = MI_PSWRD_WIFI;
 const WIFI_Ecn_t mi_security_mode = MI_SCRTYLVL;
+const wifi_network_t mis_redes[] = MIS_REDES_WIFI;
 const uint64_t mi_magico = USER_CONF_MAGIC;
 
 const char mi_deviceIoT_name[]= CREDENCIALES_SERV_IOT;
@@ -365,6 +366,92 @@ int updateWiFiCredentials(void)
   printf("\n");
   return ret;
 }
+
+
+/**
+  * @brief  Get the known networks table used for roaming. If it was never written, it is seeded
+  *         with MIS_REDES_WIFI, as checkWiFiCredentials() does with the single network.
+  * @param  Out:  networks          Known networks, the first one is joined at boot. May be NULL.
+  * @retval  Number of known networks (>0).
+  *          -1 if the table is empty.
+  */
+int checkKnownWiFiNetworks(const wifi_network_t ** const networks)
+{
+  if (lUserConfigPtr->wifi_known_config.magic != USER_CONF_MAGIC)
+  {
+    size_t count = sizeof(mis_redes) / sizeof(mis_redes[0]);
+
+    __inited_region_start__.wifi_known_config.count = (count < USER_CONF_WIFI_KNOWN_MAX) ? count : USER_CONF_WIFI_KNOWN_MAX;
+    memcpy(__inited_region_start__.wifi_known_config.network, mis_redes,
+           __inited_region_start__.wifi_known_config.count * sizeof(wifi_network_t));
+    __inited_region_start__.wifi_known_config.magic = mi_magico;
+  }
+
+  if (networks != NULL)
+  {
+    *networks = lUserConfigPtr->wifi_known_config.network;
+  }
+  return (lUserConfigPtr->wifi_known_config.count > 0) ? lUserConfigPtr->wifi_known_config.count : -1;
+}
+
+
+/**
+  * @brief  Write the known networks table to the Flash memory, from the console.
+  * @retval Error code
+  *             0    Success
+  *             <0   Unrecoverable error
+  */
+int updateKnownWiFiNetworks(void)
+{
+  static wifi_known_config_t known_config;    /* ~600 bytes, kept off the stack */
+  int ret = 0;
+  char c;
+
+  memset(&known_config, 0, sizeof(wifi_known_config_t));
+
+  do
+  {
+    printf("\rEnter the number of known networks (1 - %d): \b", USER_CONF_WIFI_KNOWN_MAX);
+    c = getchar();
+  }
+  while ( (c < '1') || (c > '0' + USER_CONF_WIFI_KNOWN_MAX));
+  known_config.count = c - '0';
+
+  for (uint8_t i = 0; i < known_config.count; i++)
+  {
+    wifi_network_t *network = &known_config.network[i];
+
+    printf("\nNetwork %d, enter SSID: ", i + 1);
+    getInputString(network->ssid, USER_CONF_WIFI_SSID_MAX_LENGTH);
+    msg_info("You have entered %s as the ssid.\n", network->ssid);
+
+    do
+    {
+      printf("\rEnter Security Mode (0 - Open, 1 - WEP, 2 - WPA, 3 - WPA2): \b");
+      c = getchar();
+    }
+    while ( (c < '0')  || (c > '3'));
+    network->security_mode = c - '0';
+
+    if (network->security_mode != 0)
+    {
+      printf("\nEnter password: ");
+      getInputString(network->psk, sizeof(network->psk));
+    }
+  }
+
+  known_config.magic = USER_CONF_MAGIC;
+
+  ret = FLASH_update((uint32_t)&lUserConfigPtr->wifi_known_config, &known_config, sizeof(wifi_known_config_t));
+
+  if (ret < 0)
+  {
+    msg_error("Failed updating the known networks in Flash.\n");
+  }
+
+  printf("\n");
+  return ret;
+}
 #endif /* USE_WIFI */
 
 
@@ -726,19 +813,27 @@ int updateFirmwareVersion()
     switch (ret)
     {
       case RFU_OK:
-        printf("\nProgramming done. Now you can reset the board.\n\n");
+        printf("\nProgramming done. Booting the new firmware from the alternate bank...\n\n");
+        ret = rfu_swap_banks();
+        printf("\nError: Could not select the boot bank (%d).\n\n", ret);
         break;
       case RFU_ERR_HTTP:
         printf("\nError: Programming failed. Reason: HTTP error - check your network connection, "
                "and that the HTTP server supports HTTP/1.1 and the progressive download.\n\n");
         break;
       case RFU_ERR_FF:
-        printf("\nError: Programming failed. Reason: Invalid firmware fileformat - check that the IAR simple-code format is used.\n\n");
+        printf("\nError: Programming failed. Reason: Invalid firmware fileformat - check that it is a raw binary image linked at 0x08000000.\n\n");
         break;
       case RFU_ERR_FLASH:
         printf("\nError: Programming failed. Reason: Flash memory erase/write - check that the firmware file matches the SoC Flash memory mapping"
                "and write protection settings. Double check that there is no illegal write to the Flash address range.\n\n");
         break;
+      case RFU_ERR_CRC:
+        printf("\nError: Programming failed. Reason: the programmed image does not match the downloaded data.\n\n");
+        break;
+      case RFU_ERR_SIZE:
+        printf("\nError: Programming failed. Reason: the firmware image, or the running one, does not fit in a Flash bank.\n\n");
+        break;
       default:
         printf("\nError: Programming failed. Unknown reason.\n\n");
     }
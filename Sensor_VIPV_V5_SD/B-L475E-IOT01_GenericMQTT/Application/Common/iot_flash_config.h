@@ -61,6 +61,7 @@
 
 #define USER_CONF_WIFI_SSID_MAX_LENGTH  32
 #define USER_CONF_WIFI_PSK_MAX_LENGTH   64
+#define USER_CONF_WIFI_KNOWN_MAX        6     /**< Known networks for roaming: depot, office, home... */
 
 #define USER_CONF_DEVICE_NAME_LENGTH    300   /**< Must be large enough to hold a complete connection string */
 #define USER_CONF_SERVER_NAME_LENGTH    128
@@ -83,6 +84,18 @@ typedef struct {
   uint8_t security_mode;                              /**< Wifi network security mode. See @ref wifi_network_security_t definition. */
 } wifi_config_t;
 
+typedef struct {
+  char ssid[USER_CONF_WIFI_SSID_MAX_LENGTH];          /**< Wifi network SSID. */
+  char psk[USER_CONF_WIFI_PSK_MAX_LENGTH];            /**< Wifi network PSK. */
+  uint8_t security_mode;                              /**< Wifi network security mode. See @ref wifi_network_security_t definition. */
+} wifi_network_t;
+
+typedef struct {
+  uint64_t magic;                                     /**< The USER_CONF_MAGIC magic word signals that the structure was once written to FLASH. */
+  uint8_t count;                                      /**< Valid entries in network[]. */
+  wifi_network_t network[USER_CONF_WIFI_KNOWN_MAX];   /**< Known networks, the first one is joined at boot before any scan. */
+} wifi_known_config_t;
+
 /* Bluemix key words */
 #define QUICK_START_REG_NAME "QuickStart"
 #define SIMPLE_REG_NAME      "SimpleReg"
@@ -121,6 +134,9 @@ typedef struct {
                                     (tls_root_ca_cert) are present in Flash. */
   uint64_t device_tls_magic;    /**< The USER_CONF_MAGIC magic word signals that the TLS device certificate and key
                                     (tls_device_cert and tls_device_key) are present in Flash. */
+#ifdef USE_WIFI
+  wifi_known_config_t wifi_known_config;  /**< Appended last so that the offsets above do not move. */
+#endif
 } user_config_t;
 
 int enterPemString(char * read_buffer, size_t max_len);
@@ -130,6 +146,8 @@ int checkC2cCredentials(const char ** const oper_ap_code, const char ** const us
 int updateC2cCredentials(void);
 int checkWiFiCredentials(const char ** const ssid, const char ** const psk, uint8_t * const security_mode);
 int updateWiFiCredentials(void);
+int checkKnownWiFiNetworks(const wifi_network_t ** const networks);
+int updateKnownWiFiNetworks(void);
 
 int updateTLSCredentials(void);
 int checkTLSRootCA(void);
@@ -49,6 +49,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #ifdef   ENABLE_IOT_INFO
 #define MSG_INFO
@@ -66,6 +67,27 @@
 #endif
 
 
+/**
+ * @brief Console levels and API.
+ *
+ * Messages and printf() output go to the non-blocking USART1 console implemented
+ * in Core/Inc/Consola_DMA.h (compiled once, in main.c). Levels below CONSOLA_WARN
+ * are dropped first when the console ring is full.
+ */
+#define CONSOLA_DEBUG   0
+#define CONSOLA_TEXTO   1   /* printf() output, through _write() */
+#define CONSOLA_INFO    2
+#define CONSOLA_WARN    3
+#define CONSOLA_ERROR   4
+
+int consola_Escribe(uint8_t nivel, const char* datos, int len);
+int consola_Log(uint8_t nivel, const char* funcion, int linea, const char* formato, ...);
+uint32_t consola_Libre(void);
+void pasa_ConsolaBloqueante(void);
+void imprime_EstadisticasConsola(void);
+int consola_LeeCaracter(void);
+
+
 /**
  * @brief Debug level logging macro.
  *
@@ -74,8 +96,7 @@
 #ifdef MSG_DEBUG
 #define msg_debug(...)    \
 	{\
-	printf("DEBUG:   %s L#%d ", __func__, __LINE__);  \
-	printf(__VA_ARGS__); \
+	consola_Log(CONSOLA_DEBUG, __func__, __LINE__, __VA_ARGS__);  \
 	}
 #else
 #define msg_debug(...)
@@ -90,7 +111,7 @@
 #ifdef MSG_INFO
 #define msg_info(...)    \
 	{\
-	printf(__VA_ARGS__); \
+	consola_Log(CONSOLA_INFO, NULL, 0, __VA_ARGS__); \
 	}
 #else
 #define msg_info(...)
@@ -104,8 +125,7 @@
 #ifdef MSG_WARNING
 #define msg_warning(...)   \
 	{ \
-	printf("WARN:  %s L#%d ", __func__, __LINE__);  \
-	printf(__VA_ARGS__); \
+	consola_Log(CONSOLA_WARN, __func__, __LINE__, __VA_ARGS__);  \
 	}
 #else
 #define msg_warning(...)
@@ -119,8 +139,7 @@
 #ifdef MSG_ERROR
 #define msg_error(...)  \
 	{ \
-	printf("ERROR: %s L#%d ", __func__, __LINE__); \
-	printf(__VA_ARGS__); \
+	consola_Log(CONSOLA_ERROR, __func__, __LINE__, __VA_ARGS__); \
 	}
 #else
 #define msg_error(...)
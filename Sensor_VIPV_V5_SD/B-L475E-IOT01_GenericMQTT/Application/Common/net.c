@@ -392,14 +392,13 @@ int net_get_hostaddress(net_hnd_t nethnd, net_ipaddr_t * ipAddress, const char *
       case NET_IF_WLAN:
       {
         uint8_t addr[4];
-        /* WIFI_GetIP_Address() returns IPv4 addresses in binary format, network byte order. */
-        WIFI_Status_t ret = WIFI_GetHostAddress(host, addr);
-        if (ret == WIFI_STATUS_OK)
+        /* net_dns_resolve() returns IPv4 addresses in binary format, network byte order. */
+        rc = net_dns_resolve(host, addr);
+        if (rc == NET_OK)
         {
           ipAddress->ipv = NET_IP_V4;
           memset(ipAddress->ip, 0xFF, sizeof(ipAddress->ip));
           memcpy(&ipAddress->ip[12], addr, 4);
-          rc = NET_OK;
         }
         break;
       }
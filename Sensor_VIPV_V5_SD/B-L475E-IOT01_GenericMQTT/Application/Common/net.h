@@ -124,6 +124,16 @@ typedef struct {
   uint8_t ip[16];         /**< Binary format. Network byte order. IPv4 mapped IPv6 format. E.g. 10.2.3.4 is  ::ffff:a02:304 or 0xFFFF0A020304*/
 } net_ipaddr_t;
 
+/** Host name resolution cache counters, since boot. */
+typedef struct {
+  uint32_t hits;          /**< Lookups answered from the cache, without DNS query. */
+  uint32_t queries;       /**< DNS queries sent to the network interface. */
+  uint32_t fallbacks;     /**< Failed or rejected queries answered with the last known good address. */
+  uint32_t rejected;      /**< Local addresses returned for a name known with a public address. */
+  uint32_t failures;      /**< Names which could not be resolved at all. */
+  uint32_t restored;      /**< Entries reloaded from the backup registers at boot. */
+} net_dns_stats_t;
+
 
 /**
  * @brief   Callback type: initialize the network interface and connect to the LAN.
@@ -216,6 +226,28 @@ int net_get_mac_address(net_hnd_t nethnd, net_macaddr_t * macAddress);
  */
 int net_get_hostaddress(net_hnd_t nethnd, net_ipaddr_t * ipAddress, const char * host);
 
+/**
+ * @brief   Resolve a host name through the address cache, with fallback to the last known good address.
+ * @param   In:   host  Host name, or IPv4 address in dotted decimal notation.
+ * @param   Out:  ip    IPv4 address. Binary format. Network byte order.
+ * @retval  Status
+ *            NET_OK        Success.
+ *            NET_PARAM     Invalid parameter.
+ *            NET_NOT_FOUND The remote host name could not be resolved.
+ */
+int net_dns_resolve(const char * host, uint8_t * ip);
+
+/**
+ * @brief   Force the next lookups to query the DNS again. The cached addresses remain as fallback.
+ */
+void net_dns_expire(void);
+
+/**
+ * @brief   Get the counters of the address cache.
+ * @param   Out:  stats   Allocated by the caller.
+ */
+void net_dns_get_stats(net_dns_stats_t * stats);
+
 /**
  * @brief   Create a socket and attach it to a network interface.
  * @param   In:   nethnd    Network interface.
@@ -0,0 +1,389 @@
+/**
+  ******************************************************************************
+  * @file    net_dns_cache.c
+  * @author  MCD Application Team
+  * @brief   Host name resolution cache of the network abstraction, on ST WiFi
+  *          connectivity API.
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright (c) 2017 STMicroelectronics International N.V. 
+  * All rights reserved.</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without 
+  * modification, are permitted, provided that the following conditions are met:
+  *
+  * 1. Redistribution of source code must retain the above copyright notice, 
+  *    this list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  * 3. Neither the name of STMicroelectronics nor the names of other 
+  *    contributors to this software may be used to endorse or promote products 
+  *    derived from this software without specific written permission.
+  * 4. This software, including modifications and/or derivative works of this 
+  *    software, must execute solely and exclusively on microcontroller or
+  *    microprocessor devices manufactured by or for STMicroelectronics.
+  * 5. Redistribution and use of this software other than as permitted under 
+  *    this license is void and will automatically terminate your rights under 
+  *    this license. 
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS" 
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT 
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW. IN NO EVENT 
+  * SHALL STMICROELECTRONICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+  * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "net_internal.h"
+
+#ifdef USE_WIFI
+
+/* Private defines -----------------------------------------------------------*/
+#define NET_DNS_CACHE_SIZE    4                     /**< Number of host names remembered. */
+#define NET_DNS_TTL_MS        (60U * 60U * 1000U)   /**< The ISM43362 does not report the record TTL: a fixed one is applied. */
+#define NET_DNS_RETRY_MS      (60U * 1000U)         /**< Hold-off before querying again a name which failed to resolve. */
+
+/* The cache survives the resets in the RTC backup registers: a header and
+ * 2 registers per entry, from BKP_PRIMERO_DNS (see the register map in main.h). */
+#define NET_DNS_BKP_FIRST     BKP_PRIMERO_DNS
+#define NET_DNS_BKP_MAGIC     0xD45C0000U
+#define NET_DNS_BKP_MAGIC_MSK 0xFFFF0000U
+#if (NET_DNS_BKP_FIRST + 2 * NET_DNS_CACHE_SIZE) >= BKP_PRIMERO_RFU
+#error "The DNS cache overlaps the backup registers of rfu.c: update the register map in main.h."
+#endif
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  uint32_t hash;        /**< FNV-1a hash of the host name. 0 for a free slot. */
+  uint8_t  ip[4];       /**< Last known good IPv4 address, network byte order. */
+  uint32_t stamp;       /**< HAL_GetTick() at the last query attempt. */
+  uint32_t ttl;         /**< Validity of the entry from stamp, in ms. 0 once the entry must be refreshed. */
+  uint32_t last_use;    /**< HAL_GetTick() at the last lookup, for LRU replacement. */
+} net_dns_entry_t;
+
+/* Private variables ---------------------------------------------------------*/
+static net_dns_entry_t net_dns_cache[NET_DNS_CACHE_SIZE];
+static bool net_dns_restored = false;
+static net_dns_stats_t net_dns_stats;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t net_dns_hash(const char * host);
+static bool net_dns_parse_ipv4(const char * host, uint8_t * ip);
+static bool net_dns_is_local(const uint8_t * ip);
+static net_dns_entry_t * net_dns_find(uint32_t hash);
+static net_dns_entry_t * net_dns_slot(void);
+static uint32_t net_dns_bkp_checksum(void);
+static void net_dns_save(void);
+static void net_dns_restore(void);
+
+/* Functions Definition ------------------------------------------------------*/
+
+/**
+  * @brief  Resolve a host name, through the address cache.
+  * @note   A valid cache entry saves the D0 round trip to the module. When the
+  *         query fails, or when it returns a local address while a public one is
+  *         known for the same name (captive portal answering every request), the
+  *         last known good address is returned instead.
+  * @param  In:   host  Host name, or IPv4 address in dotted decimal notation.
+  * @param  Out:  ip    IPv4 address, network byte order.
+  * @retval NET_OK        Success.
+  *         NET_PARAM     Invalid parameter.
+  *         NET_NOT_FOUND The host name could not be resolved and it is not cached.
+  */
+int net_dns_resolve(const char * host, uint8_t * ip)
+{
+  uint8_t addr[4];
+  uint32_t now = HAL_GetTick();
+  uint32_t hash;
+  net_dns_entry_t *entry;
+  bool resolved;
+
+  if ((host == NULL) || (ip == NULL) || (host[0] == '\0'))
+  {
+    return NET_PARAM;
+  }
+
+  if (net_dns_parse_ipv4(host, ip) == true)
+  {
+    return NET_OK;
+  }
+
+  if (net_dns_restored == false)
+  {
+    net_dns_restore();
+    net_dns_restored = true;
+  }
+
+  hash = net_dns_hash(host);
+  entry = net_dns_find(hash);
+
+  if (entry != NULL)
+  {
+    entry->last_use = now;
+    if ((now - entry->stamp) < entry->ttl)
+    {
+      memcpy(ip, entry->ip, 4);
+      net_dns_stats.hits++;
+      return NET_OK;
+    }
+  }
+
+  net_dns_stats.queries++;
+  resolved = (WIFI_GetHostAddress(host, addr) == WIFI_STATUS_OK);
+
+  if ((resolved == true) && (entry != NULL)
+      && (net_dns_is_local(addr) == true) && (net_dns_is_local(entry->ip) == false))
+  {
+    msg_warning("%s resolved to a local address, keeping %d.%d.%d.%d.\n",
+                host, entry->ip[0], entry->ip[1], entry->ip[2], entry->ip[3]);
+    net_dns_stats.rejected++;
+    resolved = false;
+  }
+
+  if (resolved == true)
+  {
+    if (entry == NULL)
+    {
+      entry = net_dns_slot();
+      entry->hash = hash;
+      memset(entry->ip, 0, 4);
+    }
+    if (memcmp(entry->ip, addr, 4) != 0)
+    {
+      memcpy(entry->ip, addr, 4);
+      net_dns_save();
+    }
+    entry->stamp = now;
+    entry->ttl = NET_DNS_TTL_MS;
+    entry->last_use = now;
+    memcpy(ip, addr, 4);
+    return NET_OK;
+  }
+
+  if (entry != NULL)
+  {
+    /* Keep serving the last known good address; do not query again for a while. */
+    msg_info("The address of %s could not be refreshed, using %d.%d.%d.%d.\n",
+             host, entry->ip[0], entry->ip[1], entry->ip[2], entry->ip[3]);
+    entry->stamp = now;
+    entry->ttl = NET_DNS_RETRY_MS;
+    memcpy(ip, entry->ip, 4);
+    net_dns_stats.fallbacks++;
+    return NET_OK;
+  }
+
+  net_dns_stats.failures++;
+  return NET_NOT_FOUND;
+}
+
+
+/**
+  * @brief  Force the next lookup of every cached name to query the DNS again.
+  * @note   The addresses are kept as fallback. Called when the current address
+  *         is suspected, e.g. after the connection to it failed.
+  */
+void net_dns_expire(void)
+{
+  for (int i = 0; i < NET_DNS_CACHE_SIZE; i++)
+  {
+    net_dns_cache[i].ttl = 0;
+  }
+}
+
+
+/**
+  * @brief  Get the address cache counters.
+  * @param  Out:  stats   Counters since boot.
+  */
+void net_dns_get_stats(net_dns_stats_t * stats)
+{
+  if (stats != NULL)
+  {
+    *stats = net_dns_stats;
+  }
+}
+
+
+/**
+  * @brief  FNV-1a hash of a host name, case insensitive. Never 0.
+  */
+static uint32_t net_dns_hash(const char * host)
+{
+  uint32_t hash = 2166136261U;
+
+  for (; *host != '\0'; host++)
+  {
+    char c = *host;
+    if ((c >= 'A') && (c <= 'Z'))
+    {
+      c += 'a' - 'A';
+    }
+    hash ^= (uint8_t) c;
+    hash *= 16777619U;
+  }
+  return (hash == 0) ? 1 : hash;
+}
+
+
+/**
+  * @brief  Parse an IPv4 address in dotted decimal notation.
+  * @retval true if the whole string is an address.
+  */
+static bool net_dns_parse_ipv4(const char * host, uint8_t * ip)
+{
+  uint8_t addr[4];
+  int digits;
+
+  for (int i = 0; i < 4; i++)
+  {
+    uint32_t val = 0;
+    for (digits = 0; (*host >= '0') && (*host <= '9'); host++, digits++)
+    {
+      val = val * 10 + (uint32_t)(*host - '0');
+      if ((digits == 3) || (val > 255))
+      {
+        return false;
+      }
+    }
+    if (digits == 0)
+    {
+      return false;
+    }
+    addr[i] = (uint8_t) val;
+    if (*host != ((i < 3) ? '.' : '\0'))
+    {
+      return false;
+    }
+    host++;
+  }
+  memcpy(ip, addr, 4);
+  return true;
+}
+
+
+/**
+  * @brief  Tell whether an address is not routable on the Internet
+  *         (RFC 1918 private, loopback, link-local, "this" network).
+  */
+static bool net_dns_is_local(const uint8_t * ip)
+{
+  return (ip[0] == 0) || (ip[0] == 10) || (ip[0] == 127)
+      || ((ip[0] == 169) && (ip[1] == 254))
+      || ((ip[0] == 172) && ((ip[1] & 0xF0) == 16))
+      || ((ip[0] == 192) && (ip[1] == 168));
+}
+
+
+static net_dns_entry_t * net_dns_find(uint32_t hash)
+{
+  for (int i = 0; i < NET_DNS_CACHE_SIZE; i++)
+  {
+    if (net_dns_cache[i].hash == hash)
+    {
+      return &net_dns_cache[i];
+    }
+  }
+  return NULL;
+}
+
+
+/**
+  * @brief  Return a free slot, or the least recently used one.
+  */
+static net_dns_entry_t * net_dns_slot(void)
+{
+  net_dns_entry_t *lru = &net_dns_cache[0];
+  uint32_t now = HAL_GetTick();
+
+  for (int i = 0; i < NET_DNS_CACHE_SIZE; i++)
+  {
+    if (net_dns_cache[i].hash == 0)
+    {
+      return &net_dns_cache[i];
+    }
+    if ((now - net_dns_cache[i].last_use) > (now - lru->last_use))
+    {
+      lru = &net_dns_cache[i];
+    }
+  }
+  return lru;
+}
+
+
+/**
+  * @brief  Checksum of the cache image held in the backup registers.
+  */
+static uint32_t net_dns_bkp_checksum(void)
+{
+  uint32_t sum = 2166136261U;
+
+  for (uint32_t i = 1; i <= 2 * NET_DNS_CACHE_SIZE; i++)
+  {
+    sum = (sum ^ HAL_RTCEx_BKUPRead(&hrtc, NET_DNS_BKP_FIRST + i)) * 16777619U;
+  }
+  return (sum ^ (sum >> 16)) & ~NET_DNS_BKP_MAGIC_MSK;
+}
+
+
+/**
+  * @brief  Copy the names and addresses to the backup registers: one word for
+  *         the hash and one for the address per entry, after a header word
+  *         made of a magic number and a checksum.
+  */
+static void net_dns_save(void)
+{
+  for (uint32_t i = 0; i < NET_DNS_CACHE_SIZE; i++)
+  {
+    const uint8_t *ip = net_dns_cache[i].ip;
+    HAL_RTCEx_BKUPWrite(&hrtc, NET_DNS_BKP_FIRST + 1 + 2 * i, net_dns_cache[i].hash);
+    HAL_RTCEx_BKUPWrite(&hrtc, NET_DNS_BKP_FIRST + 2 + 2 * i,
+                        ((uint32_t) ip[0] << 24) | ((uint32_t) ip[1] << 16) | ((uint32_t) ip[2] << 8) | ip[3]);
+  }
+  HAL_RTCEx_BKUPWrite(&hrtc, NET_DNS_BKP_FIRST, NET_DNS_BKP_MAGIC | net_dns_bkp_checksum());
+}
+
+
+/**
+  * @brief  Reload the cache saved before the last reset.
+  * @note   The time base restarts at each boot, so the restored entries are
+  *         expired: they are refreshed at first use and serve as fallback.
+  */
+static void net_dns_restore(void)
+{
+  uint32_t header = HAL_RTCEx_BKUPRead(&hrtc, NET_DNS_BKP_FIRST);
+
+  memset(net_dns_cache, 0, sizeof(net_dns_cache));
+  if (header != (NET_DNS_BKP_MAGIC | net_dns_bkp_checksum()))
+  {
+    return;
+  }
+
+  for (uint32_t i = 0; i < NET_DNS_CACHE_SIZE; i++)
+  {
+    uint32_t addr = HAL_RTCEx_BKUPRead(&hrtc, NET_DNS_BKP_FIRST + 2 + 2 * i);
+    net_dns_cache[i].hash = HAL_RTCEx_BKUPRead(&hrtc, NET_DNS_BKP_FIRST + 1 + 2 * i);
+    net_dns_cache[i].ip[0] = (uint8_t)(addr >> 24);
+    net_dns_cache[i].ip[1] = (uint8_t)(addr >> 16);
+    net_dns_cache[i].ip[2] = (uint8_t)(addr >> 8);
+    net_dns_cache[i].ip[3] = (uint8_t) addr;
+    if (net_dns_cache[i].hash != 0)
+    {
+      net_dns_stats.restored++;
+    }
+  }
+}
+
+#endif /* USE_WIFI */
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
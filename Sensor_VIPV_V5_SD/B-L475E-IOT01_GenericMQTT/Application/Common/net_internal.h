@@ -51,6 +51,7 @@
 #include "main.h"
 #include "msg.h"
 #include "net.h"
+#include "heap.h"     /* heap_class_alloc() */
 
 #ifdef USE_MBED_TLS
 
@@ -132,10 +133,8 @@ typedef struct {
 	mbedtls_ssl_context ssl;
 	mbedtls_ssl_config conf;
 	uint32_t flags;
-	mbedtls_x509_crt cacert;
 	mbedtls_x509_crl cacrl;               /** Optional certificate revocation list */
-	mbedtls_x509_crt clicert;
-	mbedtls_pk_context pkey;
+	/* The parsed CA chain, device certificate and key are shared by all sockets: see net_tls_cache_t. */
 } net_tls_data_t;
 #endif /* USE_MBED_TLS */
 
@@ -169,8 +168,8 @@ struct net_ctxt_s {
 #define MIN(a,b)  ((a) < (b) ? (a) : (b))
 #define MAX(a,b)  ((a) < (b) ? (b) : (a))
 
-#define net_malloc(a) malloc((a))
-#define net_free(a)   free((a))
+#define net_malloc(a) heap_class_alloc(HEAP_CLASS_NET, 1, (a))
+#define net_free(a)   heap_class_free(HEAP_CLASS_NET, (a))
 
 int32_t net_timeout_left_ms(uint32_t init, uint32_t now, uint32_t timeout);
 #ifdef USE_MBED_TLS
@@ -106,7 +106,7 @@ int net_sock_create_wifi(net_hnd_t nethnd, net_sockhnd_t * sockhnd, net_proto_t
         sock->methods.sendto    = (net_sock_sendto_udp_wifi);
         break;
       default:
-        free(sock);
+        net_free(sock);
         return NET_PARAM;
     }
     sock->methods.close     = (net_sock_close_tcp_wifi);
@@ -169,10 +169,9 @@ int net_sock_open_wifi(net_sockhnd_t sockhnd, const char * hostname, int remotep
         }
         else
         {
-          if (WIFI_GetHostAddress((char *)hostname, ip_addr) != WIFI_STATUS_OK)
+          /* The cache skips the blocking D0 query of the module on most reconnections. */
+          if (net_dns_resolve(hostname, ip_addr) != NET_OK)
           {
-            // TODO: Defect report on WIFI_GetHostAddress() which return code is not informative.
-            // NB: This blocking call may take several seconds before returning. An asynchronous interface should be added.
             msg_info("The address of %s could not be resolved.\n", hostname);
           }
           else
@@ -200,6 +199,8 @@ int net_sock_open_wifi(net_sockhnd_t sockhnd, const char * hostname, int remotep
       {
         msg_error("Failed opening the underlying Wifi socket %d.\n", (int) sock->underlying_sock_ctxt);
         sock->underlying_sock_ctxt = (net_sockhnd_t) -1;
+        /* The cached address may be outdated: ask the DNS at the next attempt. */
+        net_dns_expire();
         rc = NET_ERR;
       }
     }
@@ -47,8 +47,46 @@
 #include "net_internal.h"
 
 /* Private defines -----------------------------------------------------------*/
+#define NET_TLS_CACHE_HOST_SIZE   64
+/* Largest maximum_fragment_length code whose records fit the I/O buffers. */
+#if (MBEDTLS_SSL_MAX_CONTENT_LEN >= 4096)
+#define NET_TLS_MAX_FRAG_LEN      MBEDTLS_SSL_MAX_FRAG_LEN_4096
+#elif (MBEDTLS_SSL_MAX_CONTENT_LEN >= 2048)
+#define NET_TLS_MAX_FRAG_LEN      MBEDTLS_SSL_MAX_FRAG_LEN_2048
+#elif (MBEDTLS_SSL_MAX_CONTENT_LEN >= 1024)
+#define NET_TLS_MAX_FRAG_LEN      MBEDTLS_SSL_MAX_FRAG_LEN_1024
+#else
+#define NET_TLS_MAX_FRAG_LEN      MBEDTLS_SSL_MAX_FRAG_LEN_512
+#endif
+
 /* Private typedef -----------------------------------------------------------*/
+/** Credentials and session kept across sockets.
+ *  Every reconnection used to re-parse the PEM certificates and key, and to run a full handshake (ECDHE + X.509 chain
+ *  verification). The parsed objects are now reused as long as the socket options point to the same PEM buffers, and
+ *  the last negotiated session (session ID and/or RFC 5077 ticket) is offered to the same host:port. */
+typedef struct {
+  bool crt_valid;
+  const unsigned char * ca_pem;         /**< PEM buffers the parsed objects come from (they live in the flash config). */
+  const unsigned char * dev_cert_pem;
+  const unsigned char * dev_key_pem;
+  mbedtls_x509_crt cacert;
+  mbedtls_x509_crt clicert;
+  mbedtls_pk_context pkey;
+
+  bool session_valid;
+  char session_host[NET_TLS_CACHE_HOST_SIZE];
+  int session_port;
+  mbedtls_ssl_session session;
+
+  uint32_t full_handshakes;
+  uint32_t resumed_handshakes;
+} net_tls_cache_t;
+
 /* Private variables ---------------------------------------------------------*/
+static net_tls_cache_t tls_cache;
+static uint32_t tls_bytes_sent = 0;     /**< Transport bytes, to measure the handshake cost. */
+static uint32_t tls_bytes_recv = 0;
+
 /* Private function prototypes -----------------------------------------------*/
 int net_sock_create_mbedtls(net_hnd_t nethnd, net_sockhnd_t * sockhnd, net_proto_t proto);
 int net_sock_open_mbedtls(net_sockhnd_t sockhnd, const char * hostname, int dstport, int localport);
@@ -59,6 +97,11 @@ int net_sock_destroy_mbedtls(net_sockhnd_t sockhnd);
 
 static void my_debug( void *ctx, int level, const char *file, int line, const char *str );
 static void internal_close(net_sock_ctxt_t * sock);
+static int tls_cache_credentials(net_tls_data_t * tlsData);
+static void tls_cache_drop_credentials(void);
+static int tls_bio_send(void *ctx, const unsigned char *buf, size_t len);
+static int tls_bio_recv(void *ctx, unsigned char *buf, size_t len);
+static int tls_bio_recv_blocking(void *ctx, unsigned char *buf, size_t len, uint32_t timeout);
 
 /* Functions Definition ------------------------------------------------------*/
 
@@ -127,19 +170,15 @@ int net_sock_open_mbedtls(net_sockhnd_t sockhnd, const char * hostname, int dstp
 #endif
 #endif // 0
 
+#ifdef HEAP_DEBUG
   mbedtls_platform_set_calloc_free(heap_alloc, heap_free);  /* Common to all sockets. */
+#else
+  heap_tls_pool_init();                                     /* Common to all sockets: RAM2 pool, accounted as HEAP_CLASS_TLS. */
+#endif
   mbedtls_ssl_config_init(&tlsData->conf);
   mbedtls_ssl_conf_dbg(&tlsData->conf, my_debug, stdout);
   mbedtls_ctr_drbg_init(&tlsData->ctr_drbg);
-  mbedtls_x509_crt_init(&tlsData->cacert);
-  if (tlsData->tls_dev_cert != NULL)
-  {
-    mbedtls_x509_crt_init(&tlsData->clicert);
-  }
-  if (tlsData->tls_dev_key != NULL)
-  {
-    mbedtls_pk_init(&tlsData->pkey);
-  }
+  mbedtls_x509_crl_init(&tlsData->cacrl);
   mbedtls_debug_set_threshold(1);
 
   /* Entropy generator init */
@@ -157,17 +196,13 @@ int net_sock_open_mbedtls(net_sockhnd_t sockhnd, const char * hostname, int dstp
     return NET_ERR;
   }
 
-  /* Root CA */
-  if (tlsData->tls_ca_certs != NULL)
+  /* Root CA, client cert. and key: parsed once, reused by the next sockets */
+  if( (ret = tls_cache_credentials(tlsData)) != 0 )
   {
-    if( (ret = mbedtls_x509_crt_parse(&tlsData->cacert, (unsigned char const *)tlsData->tls_ca_certs, strlen((char const *) tlsData->tls_ca_certs) + 1)) != 0 )
-    { 
-      msg_error(" failed\n  !  mbedtls_x509_crt_parse returned -0x%x while parsing root cert\n", -ret);
-      internal_close(sock);
-      return NET_ERR;
-    }
+    internal_close(sock);
+    return NET_ERR;
   }
-  
+
   if (tlsData->tls_ca_crl != NULL)
   {
     if( (ret = mbedtls_x509_crl_parse(&tlsData->cacrl, (unsigned char const *)tlsData->tls_ca_crl, strlen((char const *) tlsData->tls_ca_crl) + 1)) != 0 )
@@ -178,39 +213,6 @@ int net_sock_open_mbedtls(net_sockhnd_t sockhnd, const char * hostname, int dstp
     }
   }
 
-  /* Client cert. and key */
-  if( (tlsData->tls_dev_cert != NULL) && (tlsData->tls_dev_key != NULL) )
-  {
-    if( (ret = mbedtls_x509_crt_parse(&tlsData->clicert, (unsigned char const *)tlsData->tls_dev_cert, strlen((char const *)tlsData->tls_dev_cert) + 1)) != 0 )
-    {
-      msg_error(" failed\n  !  mbedtls_x509_crt_parse returned -0x%x while parsing device cert\n", -ret);
-      internal_close(sock);
-      return NET_ERR;
-    }
-#ifdef FIREWALL_MBEDLIB
-    /* Note: The firewall mbedTLS protection does not allow to protect the device private key with a password. */
-    if( (ret = mbedtls_firewall_pk_parse_key(&tlsData->pkey, (unsigned char const *)tlsData->tls_dev_key, (size_t)0 ,
-           (unsigned char const *)"", 0)) != 0 )
-    {
-      msg_error(" failed\n  !  mbedtls_pk_parse_key returned -0x%x while parsing private key\n\n", -ret);
-      internal_close(sock);
-      return NET_ERR;
-    }
-    /* the key is converted to an RSA structure here :  pk_parse_key_pkcs1_der
-       the info pointer are changed in pk_wrap.c*/
-    extern mbedtls_pk_info_t mbedtls_firewall_info;
-    tlsData->pkey.pk_info = &mbedtls_firewall_info;
-#else /* FIREWALL_MBEDLIB */
-    if( (ret = mbedtls_pk_parse_key(&tlsData->pkey, (unsigned char const *)tlsData->tls_dev_key, strlen((char const *)tlsData->tls_dev_key) + 1,
-           (unsigned char const *)tlsData->tls_dev_pwd, tlsData->tls_dev_pwd_len)) != 0 )
-    {
-      msg_error(" failed\n  !  mbedtls_pk_parse_key returned -0x%x while parsing private key\n\n", -ret);
-      internal_close(sock);
-      return NET_ERR;
-    }
-#endif  /* FIREWALL_MBEDLIB */
-  }
-  
   /* TCP Connection */
   msg_debug("  . Connecting to %s:%d...", hostname, dstport);
   if( (ret = net_sock_create(hnet, &sock->underlying_sock_ctxt, NET_PROTO_TCP)) != NET_OK )
@@ -239,6 +241,16 @@ int net_sock_open_mbedtls(net_sockhnd_t sockhnd, const char * hostname, int dstp
     return NET_ERR;
   }
 
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+  /* Ask the server for records that fit the buffers of MBEDTLS_SSL_MAX_CONTENT_LEN (RFC 6066). */
+  if( (ret = mbedtls_ssl_conf_max_frag_len(&tlsData->conf, NET_TLS_MAX_FRAG_LEN)) != 0)
+  {
+    msg_error(" failed\n  ! mbedtls_ssl_conf_max_frag_len returned -0x%x\n\n", -ret);
+    internal_close(sock);
+    return NET_ERR;
+  }
+#endif
+
 #if 0
   mbedtls_ssl_conf_cert_profile(&sock->conf, &mbedtls_x509_crt_XXX_suite);
   // TODO: Allow the user to select a TLS profile?
@@ -255,11 +267,14 @@ int net_sock_open_mbedtls(net_sockhnd_t sockhnd, const char * hostname, int dstp
   }
 
   mbedtls_ssl_conf_rng(&tlsData->conf, mbedtls_ctr_drbg_random, &tlsData->ctr_drbg);
-  mbedtls_ssl_conf_ca_chain(&tlsData->conf, &tlsData->cacert, (tlsData->tls_ca_crl != NULL) ? &tlsData->cacrl : NULL);
+  mbedtls_ssl_conf_ca_chain(&tlsData->conf, &tls_cache.cacert, (tlsData->tls_ca_crl != NULL) ? &tlsData->cacrl : NULL);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+  mbedtls_ssl_conf_session_tickets(&tlsData->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
 
   if( (tlsData->tls_dev_cert != NULL) && (tlsData->tls_dev_key != NULL) )
   {
-    if( (ret = mbedtls_ssl_conf_own_cert(&tlsData->conf, &tlsData->clicert, &tlsData->pkey)) != 0)
+    if( (ret = mbedtls_ssl_conf_own_cert(&tlsData->conf, &tls_cache.clicert, &tls_cache.pkey)) != 0)
     {
       msg_error(" failed\n  ! mbedtls_ssl_conf_own_cert returned -0x%x\n\n", -ret);
       internal_close(sock);
@@ -291,11 +306,19 @@ int net_sock_open_mbedtls(net_sockhnd_t sockhnd, const char * hostname, int dstp
   if (sock->blocking == true)
   {
     mbedtls_ssl_conf_read_timeout(&tlsData->conf, sock->read_timeout);
-    mbedtls_ssl_set_bio(&tlsData->ssl, (void *) sock->underlying_sock_ctxt, mbedtls_net_send, NULL, mbedtls_net_recv_blocking);
+    mbedtls_ssl_set_bio(&tlsData->ssl, (void *) sock->underlying_sock_ctxt, tls_bio_send, NULL, tls_bio_recv_blocking);
   }
   else
   {
-    mbedtls_ssl_set_bio(&tlsData->ssl, (void *) sock->underlying_sock_ctxt, mbedtls_net_send, mbedtls_net_recv, NULL);
+    mbedtls_ssl_set_bio(&tlsData->ssl, (void *) sock->underlying_sock_ctxt, tls_bio_send, tls_bio_recv, NULL);
+  }
+
+  /* Offer the last session negotiated with the same server. A failure only means a full handshake. */
+  bool session_offered = false;
+  if ( tls_cache.session_valid && (dstport == tls_cache.session_port)
+      && (strncmp(hostname, tls_cache.session_host, NET_TLS_CACHE_HOST_SIZE) == 0) )
+  {
+    session_offered = (mbedtls_ssl_set_session(&tlsData->ssl, &tls_cache.session) == 0);
   }
   
   msg_debug("\n\nSSL state connect : %d ", sock->tlsData->ssl.state);
@@ -314,10 +337,21 @@ int net_sock_open_mbedtls(net_sockhnd_t sockhnd, const char * hostname, int dstp
   msg_debug("\n\nSSL state connect : %d ", sock->tlsData->ssl.state);
   msg_debug("  . Performing the SSL/TLS handshake...");
 
+  uint32_t handshake_start = HAL_GetTick();
+  ABRE_SONDA(SONDA_TLS);  /* Full and resumed handshakes show up as two groups of the cycle histogram. */
+  tls_bytes_sent = 0;
+  tls_bytes_recv = 0;
+
   while( (ret = mbedtls_ssl_handshake(&tlsData->ssl)) != 0 )
   {
     if( (ret != MBEDTLS_ERR_SSL_WANT_READ) && (ret != MBEDTLS_ERR_SSL_WANT_WRITE) )
     {
+      if (session_offered)
+      {
+        /* Do not offer it again: the server may have dropped it. */
+        mbedtls_ssl_session_free(&tls_cache.session);
+        tls_cache.session_valid = false;
+      }
       if( (tlsData->flags = mbedtls_ssl_get_verify_result(&tlsData->ssl)) != 0 )
       {
         char vrfy_buf[512];
@@ -347,6 +381,38 @@ int net_sock_open_mbedtls(net_sockhnd_t sockhnd, const char * hostname, int dstp
     }
   }
 
+  CIERRA_SONDA(SONDA_TLS);
+
+  {
+    /* A resumed session keeps the master secret of the cached one. */
+    bool resumed = session_offered && (tlsData->ssl.session != NULL)
+                   && (memcmp(tlsData->ssl.session->master, tls_cache.session.master, sizeof(tls_cache.session.master)) == 0);
+
+    if (resumed)
+    {
+      tls_cache.resumed_handshakes++;
+    }
+    else
+    {
+      tls_cache.full_handshakes++;
+    }
+    msg_info("TLS handshake %s in %lu ms, %lu bytes sent, %lu bytes received (full: %lu, resumed: %lu).\n",
+             resumed ? "resumed" : "full", (unsigned long) (HAL_GetTick() - handshake_start),
+             (unsigned long) tls_bytes_sent, (unsigned long) tls_bytes_recv,
+             (unsigned long) tls_cache.full_handshakes, (unsigned long) tls_cache.resumed_handshakes);
+
+    /* Keep the (possibly renewed) session and ticket for the next socket. */
+    mbedtls_ssl_session_free(&tls_cache.session);
+    mbedtls_ssl_session_init(&tls_cache.session);
+    tls_cache.session_valid = (mbedtls_ssl_get_session(&tlsData->ssl, &tls_cache.session) == 0);
+    if (tls_cache.session_valid)
+    {
+      strncpy(tls_cache.session_host, hostname, NET_TLS_CACHE_HOST_SIZE - 1);
+      tls_cache.session_host[NET_TLS_CACHE_HOST_SIZE - 1] = '\0';
+      tls_cache.session_port = dstport;
+    }
+  }
+
   msg_debug(" ok\n    [ Protocol is %s ]\n    [ Ciphersuite is %s ]\n",
      mbedtls_ssl_get_version(&sock->tlsData->ssl),
      mbedtls_ssl_get_ciphersuite(&sock->tlsData->ssl));
@@ -568,9 +634,7 @@ static void internal_close(net_sock_ctxt_t * sock)
   
   sock->underlying_sock_ctxt = (net_sockhnd_t) -1;
  
-  mbedtls_x509_crt_free(&tlsData->clicert);
-  mbedtls_pk_free(&tlsData->pkey);
-  mbedtls_x509_crt_free(&tlsData->cacert);
+  /* The cached certificates and key are not freed: they serve the next socket. */
   mbedtls_x509_crl_free(&tlsData->cacrl);
   mbedtls_ssl_free(&tlsData->ssl);
   mbedtls_ssl_config_free(&tlsData->conf);
@@ -580,5 +644,116 @@ static void internal_close(net_sock_ctxt_t * sock)
   return;
 }
 
+
+/** Parse the root CA, device certificate and key into the shared cache, unless they are already parsed from the
+ *  same PEM buffers. On error the cache is left empty.
+ */
+static int tls_cache_credentials(net_tls_data_t * tlsData)
+{
+  int ret = 0;
+  bool with_dev_cred = (tlsData->tls_dev_cert != NULL) && (tlsData->tls_dev_key != NULL);
+
+  if ( tls_cache.crt_valid
+      && (tls_cache.ca_pem == tlsData->tls_ca_certs)
+      && (tls_cache.dev_cert_pem == (with_dev_cred ? tlsData->tls_dev_cert : NULL))
+      && (tls_cache.dev_key_pem == (with_dev_cred ? tlsData->tls_dev_key : NULL)) )
+  {
+    return 0;
+  }
+
+  tls_cache_drop_credentials();
+
+  /* Root CA */
+  if (tlsData->tls_ca_certs != NULL)
+  {
+    if( (ret = mbedtls_x509_crt_parse(&tls_cache.cacert, (unsigned char const *)tlsData->tls_ca_certs, strlen((char const *) tlsData->tls_ca_certs) + 1)) != 0 )
+    {
+      msg_error(" failed\n  !  mbedtls_x509_crt_parse returned -0x%x while parsing root cert\n", -ret);
+      tls_cache_drop_credentials();
+      return ret;
+    }
+  }
+
+  /* Client cert. and key */
+  if (with_dev_cred)
+  {
+    if( (ret = mbedtls_x509_crt_parse(&tls_cache.clicert, (unsigned char const *)tlsData->tls_dev_cert, strlen((char const *)tlsData->tls_dev_cert) + 1)) != 0 )
+    {
+      msg_error(" failed\n  !  mbedtls_x509_crt_parse returned -0x%x while parsing device cert\n", -ret);
+      tls_cache_drop_credentials();
+      return ret;
+    }
+#ifdef FIREWALL_MBEDLIB
+    /* Note: The firewall mbedTLS protection does not allow to protect the device private key with a password. */
+    if( (ret = mbedtls_firewall_pk_parse_key(&tls_cache.pkey, (unsigned char const *)tlsData->tls_dev_key, (size_t)0 ,
+           (unsigned char const *)"", 0)) != 0 )
+    {
+      msg_error(" failed\n  !  mbedtls_pk_parse_key returned -0x%x while parsing private key\n\n", -ret);
+      tls_cache_drop_credentials();
+      return ret;
+    }
+    /* the key is converted to an RSA structure here :  pk_parse_key_pkcs1_der
+       the info pointer are changed in pk_wrap.c*/
+    extern mbedtls_pk_info_t mbedtls_firewall_info;
+    tls_cache.pkey.pk_info = &mbedtls_firewall_info;
+#else /* FIREWALL_MBEDLIB */
+    if( (ret = mbedtls_pk_parse_key(&tls_cache.pkey, (unsigned char const *)tlsData->tls_dev_key, strlen((char const *)tlsData->tls_dev_key) + 1,
+           (unsigned char const *)tlsData->tls_dev_pwd, tlsData->tls_dev_pwd_len)) != 0 )
+    {
+      msg_error(" failed\n  !  mbedtls_pk_parse_key returned -0x%x while parsing private key\n\n", -ret);
+      tls_cache_drop_credentials();
+      return ret;
+    }
+#endif  /* FIREWALL_MBEDLIB */
+  }
+
+  tls_cache.ca_pem = tlsData->tls_ca_certs;
+  tls_cache.dev_cert_pem = with_dev_cred ? tlsData->tls_dev_cert : NULL;
+  tls_cache.dev_key_pem = with_dev_cred ? tlsData->tls_dev_key : NULL;
+  tls_cache.crt_valid = true;
+
+  return 0;
+}
+
+
+/** Free the cached credentials, and the cached session that was authenticated with them. */
+static void tls_cache_drop_credentials(void)
+{
+  mbedtls_x509_crt_free(&tls_cache.cacert);
+  mbedtls_x509_crt_free(&tls_cache.clicert);
+  mbedtls_pk_free(&tls_cache.pkey);
+  mbedtls_x509_crt_init(&tls_cache.cacert);
+  mbedtls_x509_crt_init(&tls_cache.clicert);
+  mbedtls_pk_init(&tls_cache.pkey);
+  tls_cache.crt_valid = false;
+
+  mbedtls_ssl_session_free(&tls_cache.session);
+  mbedtls_ssl_session_init(&tls_cache.session);
+  tls_cache.session_valid = false;
+}
+
+
+/** BIO wrappers: same as mbedtls_net.c, plus the byte count of the handshake. */
+static int tls_bio_send(void *ctx, const unsigned char *buf, size_t len)
+{
+  int ret = mbedtls_net_send(ctx, buf, len);
+  if (ret > 0) tls_bytes_sent += ret;
+  return ret;
+}
+
+static int tls_bio_recv(void *ctx, unsigned char *buf, size_t len)
+{
+  int ret = mbedtls_net_recv(ctx, buf, len);
+  if (ret > 0) tls_bytes_recv += ret;
+  return ret;
+}
+
+static int tls_bio_recv_blocking(void *ctx, unsigned char *buf, size_t len, uint32_t timeout)
+{
+  int ret = mbedtls_net_recv_blocking(ctx, buf, len, timeout);
+  if (ret > 0) tls_bytes_recv += ret;
+  return ret;
+}
+
 #endif /* USE_MBED_TLS */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -43,6 +43,7 @@
   ******************************************************************************
   */
 
+
 /* Includes ------------------------------------------------------------------*/
 #ifdef RFU
 
@@ -50,182 +51,644 @@
 #include <string.h>
 #include <stdlib.h>
 #include "main.h"         
-#ifdef OLD_RFU
-#define SE_FW_HEADER_TOT_LEN    1
-extern void __ICFEDIT_fw_download_area_start__;
-const  uint32_t *l_fw_download_area_start = &__ICFEDIT_fw_download_area_start__;
-extern void __ICFEDIT_fw_download_area_size__;
-const  uint32_t *l_fw_download_area_size = &__ICFEDIT_fw_download_area_size__;
-#else
-#include "se_def.h"
-#include "se_interface.h"
-#endif
 #include "http_util.h"
 #include "msg.h"
 #include "net.h"
 #include "flash.h"
-#include "iot_flash_config.h"
+#include "rfu.h"
+#include "mbedtls/sha256.h"
 
 
 /* Private defines -----------------------------------------------------------*/
+#define RFU_RANGE_SIZE        (2 * FLASH_PAGE_SIZE)   /**< Bytes requested per HTTP range and programmed per rfu_step(). Multiple of FLASH_PAGE_SIZE. */
+#define RFU_VERIFY_SIZE       (32 * 1024)             /**< Bytes of the programmed image hashed per rfu_step(). */
+#define RFU_MAX_FAILED_RANGES 5                       /**< Consecutive failed ranges before rfu_step() gives up. The next rfu_start() resumes. */
+#define RFU_TRIAL_BOOTS       3                       /**< Boots of a new image without rfu_confirm() before rolling back. */
+#define RFU_MAX_URL_SIZE      (80 + 50 + 16)          /**< Host, query and scheme, as accepted by http_url_parse(). */
+#define RFU_BANK_ADDR         (FLASH_BASE + FLASH_BANK_SIZE)  /**< The inactive bank is always mapped above the running one. */
+
+/* The state survives resets in the RTC backup registers, but not a power loss: VBAT is tied to VDD on the board.
+ * 5 registers from BKP_PRIMERO_RFU: see the register map in main.h. */
+#define RFU_BKP_STATE         (BKP_PRIMERO_RFU + 0)   /**< RFU_MAGIC | state << 12 | previous bank << 8 | trial boots. */
+#define RFU_BKP_SIZE          (BKP_PRIMERO_RFU + 1)   /**< Image size. */
+#define RFU_BKP_DONE          (BKP_PRIMERO_RFU + 2)   /**< Bytes programmed into the inactive bank and accounted in RFU_BKP_CRC. */
+#define RFU_BKP_CRC           (BKP_PRIMERO_RFU + 3)   /**< CRC-32 of the programmed bytes. */
+#define RFU_BKP_TAG           (BKP_PRIMERO_RFU + 4)   /**< Image identifier: first bytes of its SHA-256, or CRC-32 of its URL. */
+#define RFU_MAGIC             0x52460000U
+#define RFU_MAGIC_MASK        0xFFFF0000U
+
+#define ALIGN8(a)      ((a+7)/8)*8
+
 /* Private typedef -----------------------------------------------------------*/
+/** Persistent update state. */
+typedef enum {
+  RFU_ST_IDLE = 0,
+  RFU_ST_DOWNLOAD,      /**< Image partly programmed into the inactive bank. */
+  RFU_ST_READY,         /**< Image programmed and verified, waiting for rfu_swap_banks(). */
+  RFU_ST_TRIAL,         /**< Booted from the new image, not confirmed yet. */
+  RFU_ST_ROLLBACK       /**< Back to the previous image, not reported yet. */
+} rfu_state_t;
+
+typedef enum {
+  RFU_PHASE_IDLE = 0,
+  RFU_PHASE_DOWNLOAD,
+  RFU_PHASE_VERIFY
+} rfu_phase_t;
+
+/** Download session context. */
+typedef struct {
+  rfu_phase_t phase;
+  char url[RFU_MAX_URL_SIZE];     /**< Copy of the URL, to reconnect. */
+  http_handle_t http;
+  bool http_open;
+  bool opened_once;
+  bool has_sha256;
+  uint8_t sha256[RFU_SHA256_SIZE];  /**< Expected digest, from an authenticated source. */
+  uint32_t tag;
+  uint32_t crc;                   /**< Running CRC-32 of the received bytes. */
+  uint32_t failures;              /**< Consecutive failed ranges. */
+  uint32_t verified;              /**< Bytes hashed in RFU_PHASE_VERIFY. */
+  mbedtls_sha256_context sha_ctx;
+  rfu_progress_t progress;
+} rfu_context_t;
+
 /* Private variables ----------------------------------------------------------*/
+static rfu_context_t rfu;
+static uint64_t rfu_buffer[RFU_RANGE_SIZE / sizeof(uint64_t)];  /**< One range. 8-byte aligned for FLASH_Write(). */
+
+extern CRC_HandleTypeDef hcrc;
+extern uint32_t _sidata, _sdata, _edata;   /* Linker script: the running image ends at the load address of .data plus its size. */
+
 /* Private function prototypes -----------------------------------------------*/
-/* Functions Definition ------------------------------------------------------*/
+static uint32_t rfu_crc(uint32_t crc, const void *data, uint32_t len);
+static void rfu_set_state(rfu_state_t state, uint32_t bank, uint32_t boots);
+static rfu_state_t rfu_get_state(uint32_t *bank, uint32_t *boots);
+static uint32_t rfu_running_bank(void);
+static int rfu_download_range(void);
+static int rfu_range_failed(void);
+static int rfu_verify_chunk(void);
+static bool rfu_is_bootable(uint32_t address, uint32_t size);
+static void rfu_close_http(void);
 
+/* Functions Definition ------------------------------------------------------*/
 
 /**
- * @brief   Download a firmware image from an HTTP server into the alternate Flash bank.
+ * @brief   Download a firmware image from an HTTP server into the alternate Flash bank, and verify it.
+ * @note    Blocking version of rfu_start() / rfu_step(), for the console. Without an expected SHA-256, the image is
+ *          only checked against the received data with the CRC unit. rfu_swap_banks() boots it.
  * @note    The current program, as well as the update, must fit in a single bank of the embedded FLASH:
- *          [0x08000000 - 0x08080000] on STM32L745.
+ *          [0x08000000 - 0x08080000] on STM32L475.
  * @note    The HTTP server must support the "Range:" request header. This is the case with HTTP/1.1.
  * @param   In: url    Location of the new firmware (HTTP url: "http://<hostname>:<port>/<path>")
  * @retval  Error code
  *             RFU_OK (0) Success.
  *             <0         Failure.
  *                          RFU_ERR_HTTP  Error downloading over HTTP.
- *                          RFU_ERR_FF    Error decoding the simple code file format.
  *                          RFU_ERR_FLASH Error erasing or programming the Flash memory.
+ *                          RFU_ERR_CRC   The programmed image does not match the received data.
+ *                          RFU_ERR_FF    The image does not start with a valid vector table.
+ *                          RFU_ERR_SIZE  The image does not fit in a Flash bank.
  */
+int rfu_update(const char * const url)
+{
+  int rc = rfu_start(url, NULL);
 
-#define ALIGN8(a)      ((a+7)/8)*8
-#define ALIGN64(a)      ((a+63)/64)*64
+  while ((rc == RFU_OK) || (rc == RFU_IN_PROGRESS))
+  {
+    rc = rfu_step();
+    if (rc == RFU_OK)
+    {
+      printf("Downloaded and verified %lu bytes in %lu ms.\n", rfu.progress.size, rfu.progress.download_ms + rfu.progress.verify_ms);
+      break;
+    }
+  }
+  rfu_stop();
+  return rc;
+}
 
-int rfu_update(const char * const url)
+
+/**
+ * @brief   Start, or resume, the download of a firmware image into the alternate Flash bank.
+ * @note    The download resumes where a previous one of the same image stopped, after a disconnection or a reset,
+ *          if the programmed part still matches its CRC. Otherwise it starts over.
+ * @note    Refused while the running image is on trial: the alternate bank holds the image to roll back to.
+ * @param   In: url      Location of the new firmware (HTTP url: "http://<hostname>:<port>/<path>")
+ * @param   In: sha256   Expected SHA-256 of the image, from an authenticated source. NULL to skip the hash check.
+ * @retval  RFU_OK, then call rfu_step() until it stops returning RFU_IN_PROGRESS.
+ *          <0 Failure: RFU_ERR (URL too long), RFU_ERR_SIZE, RFU_ERR_STATE.
+ */
+int rfu_start(const char * const url, const uint8_t * const sha256)
 {
-  int rc = RFU_OK;  
-  uint8_t  readbuffer[FLASH_PAGE_SIZE];
-  uint8_t  fw_header_input[SE_FW_HEADER_TOT_LEN];
-  http_sock_handle_t sockHnd;
-  int file_size;
-  int request_size;
-  int read_size;
-  int received_size;
-  uint32_t areaAddr;
-  uint32_t area_size;
-#ifndef OLD_RFU
-  SE_StatusTypeDef e_se_status;
-  SE_FwImageFlashTypeDef area;
-#endif
-  
-  rc = http_sock_open(&sockHnd, url);
-  if (RFU_OK != rc) {
-    msg_error("Could not open %s\n", url);
-    return RFU_ERR_HTTP;
+  uint32_t bank = 0;
+  uint32_t boots = 0;
+  uint32_t image_end = (uint32_t) &_sidata + ((uint32_t) &_edata - (uint32_t) &_sdata);
+  rfu_state_t state = RFU_ST_IDLE;
+
+  rfu_stop();
+  memset(&rfu, 0, sizeof(rfu));
+
+  if (strlen(url) >= sizeof(rfu.url))
+  {
+    msg_error("The firmware URL is too long.\n");
+    return RFU_ERR;
   }
-  
-  /* Read the file header and the first record header */
-  read_size = http_sock_rcv(fw_header_input, SE_FW_HEADER_TOT_LEN, sockHnd);
-  if ( SE_FW_HEADER_TOT_LEN != read_size )  
+  if (image_end > RFU_BANK_ADDR)
   {
-    msg_error("can not read header part of file %s(expected %d bytes , get %d)\n", url,SE_FW_HEADER_TOT_LEN,read_size);
-	http_sock_close(sockHnd);
-    return RFU_ERR_HTTP;
+    msg_error("The running image ends at 0x%08lx, in the alternate bank: there is no room for an update.\n", image_end);
+    return RFU_ERR_SIZE;
   }
-  
- file_size = http_sock_get_resource_size(sockHnd); 
- 
-#ifndef RFU_DRY_RUN
-  printf("calling SE to getsecure area size\n");
-  
-#ifdef OLD_RFU
-  areaAddr  = (uint32_t) l_fw_download_area_start;
-  area_size = (uint32_t) l_fw_download_area_size;
-#else
-  if (SE_SFU_IMG_Download_Area(&e_se_status, &area) == SE_ERROR )
-  {
-	msg_error("can not reach se_sfu module information\n");
-	http_sock_close(sockHnd);
-    return RFU_ERR_HTTP;
+  state = rfu_get_state(&bank, &boots);
+  if (state == RFU_ST_TRIAL)
+  {
+    msg_error("The running image is not confirmed yet: the alternate bank holds the previous one.\n");
+    return RFU_ERR_STATE;
   }
 
-  areaAddr = area.DownloadAddr;
-  area_size = area.MaxSizeInBytes;
-  printf("calling SE to getsecure area size DowloadAddr %x  size %d\n",areaAddr,area_size);
-#endif
+  strcpy(rfu.url, url);
+  rfu.has_sha256 = (sha256 != NULL);
+  if (rfu.has_sha256)
+  {
+    memcpy(rfu.sha256, sha256, RFU_SHA256_SIZE);
+    rfu.tag = ((uint32_t) sha256[0] << 24) | ((uint32_t) sha256[1] << 16) | ((uint32_t) sha256[2] << 8) | sha256[3];
+  }
+  else
+  {
+    rfu.tag = rfu_crc(DEFAULT_CRC_INITVALUE, url, strlen(url));
+  }
+  rfu.crc = DEFAULT_CRC_INITVALUE;
 
+  /* Resume the same image if what is already programmed still matches. */
+  if ( ((state == RFU_ST_DOWNLOAD) || (state == RFU_ST_READY)) && (HAL_RTCEx_BKUPRead(&hrtc, RFU_BKP_TAG) == rfu.tag) )
+  {
+    uint32_t size = HAL_RTCEx_BKUPRead(&hrtc, RFU_BKP_SIZE);
+    uint32_t done = HAL_RTCEx_BKUPRead(&hrtc, RFU_BKP_DONE);
+    uint32_t crc = HAL_RTCEx_BKUPRead(&hrtc, RFU_BKP_CRC);
 
-  /* Clear download area*/
-  printf("  -- -- Erasing download area ...\r\n\n"); 
-  rc = (HAL_StatusTypeDef) FLASH_Erase_Size(areaAddr, area_size / 2U); /* erase first half of slot 1 */
-  if (rc ) 
+    if ( (size <= FLASH_BANK_SIZE) && (done <= size) && (((done % RFU_RANGE_SIZE) == 0) || (done == size))
+        && (rfu_crc(DEFAULT_CRC_INITVALUE, (const void *) RFU_BANK_ADDR, done) == crc) )
+    {
+      rfu.progress.size = size;
+      rfu.progress.done = done;
+      rfu.progress.resumed_from = done;
+      rfu.crc = crc;
+      msg_info("Resuming the firmware download at %lu/%lu bytes.\n", done, size);
+    }
+  }
+
+  if (rfu.progress.done == 0)
   {
-    printf("ERROR: Unable to erase flash area at [%x - %x [\n", areaAddr, area_size / 2U);
+    /* The progress is cleared before the new tag is written: a reset in between must not resume the new image
+       on top of the bytes of the previous one. */
+    rfu.progress.size = 0;
+    HAL_RTCEx_BKUPWrite(&hrtc, RFU_BKP_DONE, 0);
+    HAL_RTCEx_BKUPWrite(&hrtc, RFU_BKP_SIZE, 0);
+    HAL_RTCEx_BKUPWrite(&hrtc, RFU_BKP_CRC, rfu.crc);
+    HAL_RTCEx_BKUPWrite(&hrtc, RFU_BKP_TAG, rfu.tag);
   }
-  /* Refresh Watchdog */
-  WRITE_REG(IWDG->KR, IWDG_KEY_RELOAD);
+  rfu_set_state(RFU_ST_DOWNLOAD, rfu_running_bank(), 0);
 
-  rc = (HAL_StatusTypeDef) FLASH_Erase_Size(areaAddr + area_size / 2U,
-                                                  area_size / 2U); /* erase second half of slot 1 */
-  if (rc ) 
+  if ((rfu.progress.size != 0) && (rfu.progress.done == rfu.progress.size))
+  {
+    rfu.phase = RFU_PHASE_VERIFY;
+    mbedtls_sha256_init(&rfu.sha_ctx);
+    mbedtls_sha256_starts(&rfu.sha_ctx, 0);
+  }
+  else
   {
-    printf("ERROR: Unable to erase flash area at [%x - %x [\n", areaAddr+ area_size / 2U,areaAddr+area_size);
+    rfu.phase = RFU_PHASE_DOWNLOAD;
   }
+  return RFU_OK;
+}
 
-  /* Refresh Watchdog */
-  WRITE_REG(IWDG->KR, IWDG_KEY_RELOAD);
-  
-#endif
 
- // flashing header
-#ifndef OLD_RFU
-#ifndef RFU_DRY_RUN
-      rc = FLASH_Write(areaAddr, (uint32_t *) fw_header_input, read_size);
-      if (rc ) 
-      {
-        printf("ERROR:Unable to write flash area at [%x - %x [\n", areaAddr,read_size);
-      }
-      areaAddr += area.ImageOffsetInBytes;
-#endif
-#endif
-  
-  
-  received_size = read_size ;
-  do
-  {
-
-     request_size = file_size - received_size;
-     if (request_size > FLASH_PAGE_SIZE) request_size = FLASH_PAGE_SIZE;
-
-     read_size = http_sock_rcv(readbuffer, request_size, sockHnd);
-     if (read_size < 0)
-     {
-       /* HTTP download or socket error. Will retry. */
-       continue;
-     }
-     
-     received_size += read_size;
-     
-#ifndef RFU_DRY_RUN
-      printf("flash %x  %d\n",areaAddr,ALIGN64(read_size));
-      rc = FLASH_Write(areaAddr, (uint32_t *) readbuffer, ALIGN64(read_size));    
-      if (rc ) 
-      {
-        printf("ERROR:Unable to write flash area at [%x - %x [\n", areaAddr,ALIGN64(read_size));
-      }
-      areaAddr += read_size;
-#endif
+/**
+ * @brief   One step of the download started by rfu_start(): one HTTP range request programmed into the alternate
+ *          bank, or RFU_VERIFY_SIZE bytes of the verification once the whole image is there.
+ * @note    Each step is short enough to be run from the application main loop, which keeps running between steps.
+ *          A failed range closes the connection and is retried by the next step, after a reconnection.
+ * @retval  RFU_IN_PROGRESS   Call again.
+ *          RFU_OK (0)        The image is programmed and verified: rfu_swap_banks() can boot it.
+ *          <0                Failure.
+ *                              RFU_ERR_HTTP   RFU_MAX_FAILED_RANGES ranges failed in a row. rfu_start() resumes.
+ *                              RFU_ERR_FLASH  Error erasing or programming the Flash memory.
+ *                              RFU_ERR_SIZE   The image does not fit in a Flash bank.
+ *                              RFU_ERR_CRC    The programmed image does not match the received data.
+ *                              RFU_ERR_HASH   The SHA-256 of the image does not match the expected one.
+ *                              RFU_ERR_FF     The image does not start with a valid vector table.
+ *                              RFU_ERR_STATE  No download in progress.
+ */
+int rfu_step(void)
+{
+  uint32_t start = HAL_GetTick();
+  uint32_t elapsed = 0;
+  int rc = RFU_ERR_STATE;
+
+  switch (rfu.phase)
+  {
+    case RFU_PHASE_DOWNLOAD:
+      rc = rfu_download_range();
+      elapsed = HAL_GetTick() - start;
+      rfu.progress.download_ms += elapsed;
+      break;
+    case RFU_PHASE_VERIFY:
+      rc = rfu_verify_chunk();
+      elapsed = HAL_GetTick() - start;
+      rfu.progress.verify_ms += elapsed;
+      break;
+    default:
+      break;
   }
-  while(received_size < file_size);
-  
-  printf("Downloaded total size %d bytes\n",received_size);
+  if (elapsed > rfu.progress.longest_step_ms)
+  {
+    rfu.progress.longest_step_ms = elapsed;
+  }
+  return rc;
+}
 
-  http_sock_close(sockHnd);
 
-  /* - System Reboot*/
-#ifndef RFU_DRY_RUN
-#ifndef OLD_RFU 
-  SE_SFU_IMG_Install(&e_se_status, (uint8_t *) fw_header_input);
-  if (e_se_status != SE_OK) {
-    printf("ERROR , unable to install headers"); 
+/**
+ * @brief   Stop the download in progress, if any, and close its HTTP connection.
+ * @note    The programmed part is kept: the next rfu_start() of the same image resumes it.
+ */
+void rfu_stop(void)
+{
+  rfu_close_http();
+  if (rfu.phase == RFU_PHASE_VERIFY)
+  {
+    mbedtls_sha256_free(&rfu.sha_ctx);
   }
-  printf("  -- Image correctly downloaded - reboot\r\n\n");
-  HAL_Delay(1000U);
-  NVIC_SystemReset();
-#endif
-#endif
+  rfu.phase = RFU_PHASE_IDLE;
+}
+
+
+/**
+ * @brief   Get the progress of the download in progress, or of the last one.
+ * @param   Out: progress   Copy of the progress counters.
+ */
+void rfu_get_progress(rfu_progress_t * const progress)
+{
+  *progress = rfu.progress;
+}
+
+
+/**
+ * @brief   Boot the verified image from the alternate bank, on trial.
+ * @note    The BFB2 option bit is toggled and the option bytes are reloaded, which resets the device. The new image
+ *          must then call rfu_boot_check() at boot, and rfu_confirm() once healthy.
+ * @retval  Does not return on success.
+ *          RFU_ERR_STATE  No verified image in the alternate bank.
+ *          RFU_ERR_OB     Option bytes programming error.
+ */
+int rfu_swap_banks(void)
+{
+  uint32_t bank = 0;
+  uint32_t boots = 0;
+
+  if (rfu_get_state(&bank, &boots) != RFU_ST_READY)
+  {
+    return RFU_ERR_STATE;
+  }
+  rfu_set_state(RFU_ST_TRIAL, rfu_running_bank(), 0);
+  msg_info("Booting the new image from the alternate Flash bank.\n");
+  if (FLASH_set_boot_bank(FLASH_BANK_BOTH) != 0)
+  {
+    rfu_set_state(RFU_ST_READY, bank, 0);
+    return RFU_ERR_OB;
+  }
+  return RFU_OK;
+}
+
+
+/**
+ * @brief   Update the trial state at boot. To be called early, once the RTC and the CRC unit are initialized.
+ * @note    A new image gets RFU_TRIAL_BOOTS boots to call rfu_confirm(). A hard fault resets the device, so a
+ *          crashing image runs out of boots and the previous one is booted again. So is an image which does not
+ *          match the CRC-32 of the downloaded one.
+ * @retval  RFU_BOOT_NORMAL, RFU_BOOT_TRIAL, or RFU_BOOT_ROLLED_BACK once after a rollback.
+ *          Does not return when rolling back.
+ */
+rfu_boot_t rfu_boot_check(void)
+{
+  uint32_t previous = 0;
+  uint32_t boots = 0;
+  rfu_state_t state = rfu_get_state(&previous, &boots);
+
+  if (state == RFU_ST_ROLLBACK)
+  {
+    rfu_set_state(RFU_ST_IDLE, 0, 0);
+    msg_warning("The new firmware image failed its trial: the previous image is running again.\n");
+    return RFU_BOOT_ROLLED_BACK;
+  }
+  if (state != RFU_ST_TRIAL)
+  {
+    return RFU_BOOT_NORMAL;
+  }
+  if (rfu_running_bank() == previous)
+  {
+    /* The system bootloader fell back to the previous bank: the new one has no valid vector table. */
+    rfu_set_state(RFU_ST_IDLE, 0, 0);
+    msg_warning("The new firmware image could not boot: the previous image is running again.\n");
+    return RFU_BOOT_ROLLED_BACK;
+  }
+
+  boots++;
+  rfu_set_state(RFU_ST_TRIAL, previous, boots);
+  if (boots > RFU_TRIAL_BOOTS)
+  {
+    msg_error("The new firmware image was not confirmed after %d boots.\n", RFU_TRIAL_BOOTS);
+    rfu_rollback();
+  }
+  if (rfu_crc(DEFAULT_CRC_INITVALUE, (const void *) FLASH_BASE, HAL_RTCEx_BKUPRead(&hrtc, RFU_BKP_SIZE))
+      != HAL_RTCEx_BKUPRead(&hrtc, RFU_BKP_CRC))
+  {
+    msg_error("The running image does not match the downloaded one.\n");
+    rfu_rollback();
+  }
+  msg_info("New firmware image on trial, boot %lu/%d.\n", boots, RFU_TRIAL_BOOTS);
+  return RFU_BOOT_TRIAL;
+}
+
+
+/**
+ * @brief   Keep the image on trial: it will not be rolled back any more.
+ */
+void rfu_confirm(void)
+{
+  uint32_t previous = 0;
+  uint32_t boots = 0;
+
+  if (rfu_get_state(&previous, &boots) == RFU_ST_TRIAL)
+  {
+    rfu_set_state(RFU_ST_IDLE, 0, 0);
+    msg_info("New firmware image confirmed.\n");
+  }
+}
+
+
+/**
+ * @brief   Boot the previous image again, if the running one is on trial.
+ * @note    The previous image is still in the alternate bank: rfu_start() does not overwrite it during a trial.
+ *          Does not return on success.
+ */
+void rfu_rollback(void)
+{
+  uint32_t previous = 0;
+  uint32_t boots = 0;
+
+  if (rfu_get_state(&previous, &boots) != RFU_ST_TRIAL)
+  {
+    return;
+  }
+  rfu_set_state(RFU_ST_ROLLBACK, previous, boots);
+  msg_error("Rolling back to the previous firmware image.\n");
+  HAL_Delay(100);
+  if (FLASH_set_boot_bank(previous) != 0)
+  {
+    msg_error("Could not select the boot bank.\n");
+  }
+  HAL_NVIC_SystemReset();
+}
+
+
+/**
+ * @brief   Tell whether the running image is on trial, waiting for rfu_confirm() or rfu_rollback().
+ */
+bool rfu_on_trial(void)
+{
+  uint32_t previous = 0;
+  uint32_t boots = 0;
+
+  return (rfu_get_state(&previous, &boots) == RFU_ST_TRIAL);
+}
+
+
+/**
+ * @brief   Continue a CRC-32 with the hardware CRC unit.
+ * @note    As configured in MX_CRC_Init() (polynomial 0x04C11DB7, no reflection, no final XOR), the running value is
+ *          also the initial value of the next chunk. The default initial value is restored for the other users.
+ * @param   In: crc    CRC of the previous chunks. DEFAULT_CRC_INITVALUE for the first one.
+ * @param   In: data   Next chunk.
+ * @param   In: len    Chunk length in bytes.
+ * @retval  CRC of the previous chunks and this one.
+ */
+static uint32_t rfu_crc(uint32_t crc, const void *data, uint32_t len)
+{
+  if (len > 0)
+  {
+    __HAL_CRC_INITIALCRCVALUE_CONFIG(&hcrc, crc);
+    crc = HAL_CRC_Calculate(&hcrc, (uint32_t *) data, len);
+    __HAL_CRC_INITIALCRCVALUE_CONFIG(&hcrc, DEFAULT_CRC_INITVALUE);
+  }
+  return crc;
+}
+
+
+static void rfu_set_state(rfu_state_t state, uint32_t bank, uint32_t boots)
+{
+  HAL_RTCEx_BKUPWrite(&hrtc, RFU_BKP_STATE, RFU_MAGIC | ((uint32_t) state << 12) | ((bank & 0xFU) << 8) | (boots & 0xFFU));
+}
+
+
+static rfu_state_t rfu_get_state(uint32_t *bank, uint32_t *boots)
+{
+  uint32_t value = HAL_RTCEx_BKUPRead(&hrtc, RFU_BKP_STATE);
+
+  if ((value & RFU_MAGIC_MASK) != RFU_MAGIC)
+  {
+    return RFU_ST_IDLE;
+  }
+  *bank = (value >> 8) & 0xFU;
+  *boots = value & 0xFFU;
+  return (rfu_state_t) ((value >> 12) & 0xFU);
+}
+
+
+/**
+ * @brief   Physical bank the device is running from, the one mapped at FLASH_BASE.
+ */
+static uint32_t rfu_running_bank(void)
+{
+  return (READ_BIT(SYSCFG->MEMRMP, SYSCFG_MEMRMP_FB_MODE) == 0) ? FLASH_BANK_1 : FLASH_BANK_2;
+}
+
+
+/**
+ * @brief   Download the next range and program it at the same offset of the alternate bank.
+ * @note    The pages are erased just before being programmed, so a resumed download never erases what it keeps.
+ */
+static int rfu_download_range(void)
+{
+  http_range_status_t status = { 0, 0, 0, false };
+  uint32_t done = rfu.progress.done;
+  uint32_t request = RFU_RANGE_SIZE;
+  uint32_t address = RFU_BANK_ADDR + done;
+  int read_size = 0;
+
+  if ((rfu.progress.size != 0) && (rfu.progress.size - done < request))
+  {
+    request = rfu.progress.size - done;
+  }
+
+  if (rfu.http_open == false)
+  {
+    if (HTTP_OK != http_open(&rfu.http, rfu.url))
+    {
+      msg_error("Could not open %s\n", rfu.url);
+      return rfu_range_failed();
+    }
+    rfu.http_open = true;
+    if (rfu.opened_once)
+    {
+      rfu.progress.reconnections++;
+    }
+    rfu.opened_once = true;
+  }
+
+  read_size = http_read((uint8_t *) rfu_buffer, &status, done, request, NULL, NULL, 0, rfu.http);
+  if ((read_size < 0) || (http_is_open(rfu.http) == false))
+  {
+    rfu_close_http();   /* The server may close a keep-alive connection after a complete range. */
+  }
+  if ( (read_size <= 0) || (status.first_byte != done) || ((read_size != request) && (done + read_size != status.resource_size)) )
+  {
+    return rfu_range_failed();
+  }
+
+  if (rfu.progress.size == 0)
+  {
+    if ((status.resource_size <= 0) || (status.resource_size > FLASH_BANK_SIZE))
+    {
+      msg_error("The firmware image (%d bytes) does not fit in a Flash bank.\n", status.resource_size);
+      rfu_stop();
+      rfu_set_state(RFU_ST_IDLE, 0, 0);
+      return RFU_ERR_SIZE;
+    }
+    rfu.progress.size = status.resource_size;
+    HAL_RTCEx_BKUPWrite(&hrtc, RFU_BKP_SIZE, rfu.progress.size);
+  }
+  else if (status.resource_size != rfu.progress.size)
+  {
+    msg_error("The firmware image changed on the server during the download.\n");
+    rfu_stop();
+    rfu_set_state(RFU_ST_IDLE, 0, 0);
+    return RFU_ERR_HTTP;
+  }
+
+  memset((uint8_t *) rfu_buffer + read_size, 0xFF, ALIGN8(read_size) - read_size);
+  if ( (FLASH_Erase_Size(address, RFU_RANGE_SIZE) != HAL_OK)
+      || (FLASH_Write(address, (uint32_t *) rfu_buffer, ALIGN8(read_size)) != HAL_OK) )
+  {
+    msg_error("ERROR: Unable to program the flash area at [%lx - %lx[\n", address, address + ALIGN8(read_size));
+    rfu_stop();
+    return RFU_ERR_FLASH;
+  }
+
+  rfu.crc = rfu_crc(rfu.crc, rfu_buffer, read_size);
+  rfu.progress.done += read_size;
+  rfu.progress.ranges++;
+  rfu.failures = 0;
+  HAL_RTCEx_BKUPWrite(&hrtc, RFU_BKP_CRC, rfu.crc);
+  HAL_RTCEx_BKUPWrite(&hrtc, RFU_BKP_DONE, rfu.progress.done);
+
+  if (rfu.progress.done == rfu.progress.size)
+  {
+    rfu_close_http();
+    rfu.phase = RFU_PHASE_VERIFY;
+    rfu.verified = 0;
+    mbedtls_sha256_init(&rfu.sha_ctx);
+    mbedtls_sha256_starts(&rfu.sha_ctx, 0);
+  }
+  return RFU_IN_PROGRESS;
+}
+
+
+/**
+ * @brief   Drop the connection after a failed range. The next step reconnects and requests it again.
+ */
+static int rfu_range_failed(void)
+{
+  rfu_close_http();
+  rfu.failures++;
+  if (rfu.failures >= RFU_MAX_FAILED_RANGES)
+  {
+    msg_error("The firmware download stopped at %lu/%lu bytes after %d failed ranges.\n",
+              rfu.progress.done, rfu.progress.size, RFU_MAX_FAILED_RANGES);
+    rfu_stop();
+    return RFU_ERR_HTTP;
+  }
+  return RFU_IN_PROGRESS;
+}
+
+
+/**
+ * @brief   Hash the next RFU_VERIFY_SIZE bytes of the programmed image; at the end, compare its SHA-256 with the
+ *          expected one and its CRC-32, computed again from the Flash memory, with the one of the received data.
+ */
+static int rfu_verify_chunk(void)
+{
+  uint8_t digest[RFU_SHA256_SIZE];
+  uint32_t len = rfu.progress.size - rfu.verified;
+  int rc = RFU_OK;
+
+  if (len > RFU_VERIFY_SIZE)
+  {
+    len = RFU_VERIFY_SIZE;
+  }
+  if (rfu.has_sha256)
+  {
+    mbedtls_sha256_update(&rfu.sha_ctx, (const uint8_t *) (RFU_BANK_ADDR + rfu.verified), len);
+  }
+  rfu.verified += len;
+  if (rfu.verified < rfu.progress.size)
+  {
+    return RFU_IN_PROGRESS;
+  }
+
+  mbedtls_sha256_finish(&rfu.sha_ctx, digest);
+  if (rfu_crc(DEFAULT_CRC_INITVALUE, (const void *) RFU_BANK_ADDR, rfu.progress.size) != rfu.crc)
+  {
+    msg_error("The programmed firmware image does not match the received data.\n");
+    rc = RFU_ERR_CRC;
+  }
+  else if (rfu.has_sha256 && (memcmp(digest, rfu.sha256, RFU_SHA256_SIZE) != 0))
+  {
+    msg_error("The SHA-256 of the firmware image does not match the expected one.\n");
+    rc = RFU_ERR_HASH;
+  }
+  else if (rfu_is_bootable(RFU_BANK_ADDR, rfu.progress.size) == false)
+  {
+    msg_error("The firmware image does not start with a valid vector table.\n");
+    rc = RFU_ERR_FF;
+  }
+  rfu_stop();
+  rfu_set_state((rc == RFU_OK) ? RFU_ST_READY : RFU_ST_IDLE, rfu_running_bank(), 0);
   return rc;
 }
+
+
+/**
+ * @brief   Check the vector table of an image: initial stack pointer in SRAM, reset handler in the image (Thumb).
+ * @note    Bank 1 boots without any check when BFB2 is cleared: an image which cannot reach rfu_boot_check() would
+ *          never be rolled back. The stack pointer test is the one of the system bootloader for bank 2.
+ */
+static bool rfu_is_bootable(uint32_t address, uint32_t size)
+{
+  uint32_t sp = ((const uint32_t *) address)[0];
+  uint32_t reset = ((const uint32_t *) address)[1];
+
+  return (size >= 8) && ((sp & 0x2FFE0000U) == 0x20000000U)
+      && ((reset & 1U) != 0) && (reset > FLASH_BASE) && (reset < FLASH_BASE + size);
+}
+
+
+static void rfu_close_http(void)
+{
+  if (rfu.http_open)
+  {
+    http_close(rfu.http);
+    rfu.http_open = false;
+  }
+}
 #endif
 
 
@@ -59,12 +59,47 @@
 #define RFU_OK                0
 #define RFU_ERR               -1
 #define RFU_ERR_HTTP          -2  /**< HTTP error */
-#define RFU_ERR_FF            -3  /**< IAR simple file format error */
+#define RFU_ERR_FF            -3  /**< IAR simple file format error, or no valid vector table at the start of the image. */
 #define RFU_ERR_FLASH         -4  /**< FLASH erase or programming error */
 #define RFU_ERR_OB            -5  /**< Option bytes programming error */
 #define RFU_ERR_HTTP_CLOSED   -6  /**< The HTTP connection was closed by the server. */
+#define RFU_ERR_HASH          -7  /**< The SHA-256 of the downloaded image does not match the expected one. */
+#define RFU_ERR_CRC           -8  /**< The image in the Flash memory does not match the received data. */
+#define RFU_ERR_SIZE          -9  /**< The image does not fit in a bank, or the running image crosses the bank boundary. */
+#define RFU_ERR_STATE         -10 /**< Call out of sequence: no download started, or no verified image to boot. */
+#define RFU_IN_PROGRESS       1   /**< rfu_step(): the download or the verification needs more steps. */
+
+#define RFU_SHA256_SIZE       32
+
+/** State of the boot, as found by rfu_boot_check(). */
+typedef enum {
+  RFU_BOOT_NORMAL = 0,        /**< No update pending. */
+  RFU_BOOT_TRIAL,             /**< First boots of a new image: rfu_confirm() it once it is healthy, or rfu_rollback(). */
+  RFU_BOOT_ROLLED_BACK        /**< The previous image is running again after a failed trial. Reported once. */
+} rfu_boot_t;
+
+/** Progress and timing of the download in progress, or of the last one. */
+typedef struct {
+  uint32_t size;              /**< Image size from the Content-Range header. 0 before the first range. */
+  uint32_t done;              /**< Bytes programmed into the inactive bank. */
+  uint32_t resumed_from;      /**< Offset the download resumed from. 0 for a fresh download. */
+  uint32_t ranges;            /**< Range requests served in this session. */
+  uint32_t reconnections;     /**< HTTP reconnections after a failed range. */
+  uint32_t download_ms;       /**< Time spent in download steps. */
+  uint32_t verify_ms;         /**< Time spent verifying the programmed image. */
+  uint32_t longest_step_ms;   /**< Longest single rfu_step(). */
+} rfu_progress_t;
 
 int rfu_update(const char * const url);
+int rfu_start(const char * const url, const uint8_t * const sha256);
+int rfu_step(void);
+void rfu_stop(void);
+void rfu_get_progress(rfu_progress_t * const progress);
+int rfu_swap_banks(void);
+rfu_boot_t rfu_boot_check(void);
+void rfu_confirm(void);
+void rfu_rollback(void);
+bool rfu_on_trial(void);
 
 #ifdef __cplusplus
 }
@@ -67,6 +67,7 @@ typedef struct{
 	float alebeo;
 	float cabeceo;
 	float guino_brujula;
+	float dispersion_rumbo;		// Desviación circular del rumbo en el periodo, en grados
 
 	float latitud;
 	float longitud;
@@ -0,0 +1,322 @@
+/**
+  ******************************************************************************
+  * @file    sntp.c
+  * @author  MCD Application Team
+  * @brief   SNTP client (RFC 4330) on the UDP socket API, for the RTC synchronization.
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright (c) 2017 STMicroelectronics International N.V. 
+  * All rights reserved.</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without 
+  * modification, are permitted, provided that the following conditions are met:
+  *
+  * 1. Redistribution of source code must retain the above copyright notice, 
+  *    this list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  * 3. Neither the name of STMicroelectronics nor the names of other 
+  *    contributors to this software may be used to endorse or promote products 
+  *    derived from this software without specific written permission.
+  * 4. This software, including modifications and/or derivative works of this 
+  *    software, must execute solely and exclusively on microcontroller or
+  *    microprocessor devices manufactured by or for STMicroelectronics.
+  * 5. Redistribution and use of this software other than as permitted under 
+  *    this license is void and will automatically terminate your rights under 
+  *    this license. 
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS" 
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT 
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW. IN NO EVENT 
+  * SHALL STMICROELECTRONICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+  * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "main.h"
+#include "sntp.h"
+#include "net.h"
+#include "msg.h"
+#include "timingSystem.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define SNTP_PACKET_SIZE      48
+#define SNTP_SAMPLES          3         /**< Requests per synchronization. The one with the shortest round trip is kept. */
+#define SNTP_READ_TIMEOUT_MS  1000      /**< Per request. */
+#define SNTP_MAX_LOST         2         /**< Unanswered requests before giving up: a silent server costs 2 s. */
+#define SNTP_MAX_DELAY_MS     2000U     /**< Samples with a longer round trip are not accurate enough. */
+#define SNTP_NTP_UNIX_DELTA   2208988800U   /**< Seconds from 1900 (NTP era 0) to 1970. */
+
+#define SNTP_LI_ALARM         3         /**< Leap indicator: server clock not synchronized. */
+#define SNTP_VERSION          4
+#define SNTP_MODE_CLIENT      3
+#define SNTP_MODE_SERVER      4
+
+#define SNTP_STR(x)           #x
+#define SNTP_XSTR(x)          SNTP_STR(x)
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  int64_t offset_ms;
+  int64_t delay_ms;
+  uint8_t stratum;
+} sntp_sample_t;
+
+/* Private function prototypes -----------------------------------------------*/
+static void sntp_put_timestamp(uint8_t * buf, int64_t unix_ms);
+static int64_t sntp_get_timestamp(const uint8_t * buf);
+static int sntp_parse_reply(const uint8_t * reply, int len, const uint8_t * request,
+                            int64_t t1, int64_t t4, sntp_sample_t * sample, char * kiss);
+static int64_t sntp_now_ms(void);
+
+/* Functions Definition ------------------------------------------------------*/
+
+/**
+ * @brief Set the RTC from an SNTP server.
+ * @note  Each request carries the local transmit time T1; the reply carries the
+ *        server receive and transmit times T2 and T3, and is received at T4.
+ *        offset = ((T2 - T1) + (T3 - T4)) / 2, delay = (T4 - T1) - (T3 - T2).
+ *        T4 is taken as T1 plus the elapsed system ticks, so the round trip is
+ *        measured at 1 ms even if the RTC resolution is coarser.
+ * @note  Pre-conditions:
+ *   . Wifi network connected
+ *   . One free socket
+ * @param In:  host    Server name, or NULL for SNTP_SERVER_HOST.
+ * @param Out: result  Outcome. May be NULL.
+ * @retval  Error code
+ *            SNTP_OK
+ *            SNTP_ERR_CONNECT    Could not resolve the server or open the socket.
+ *            SNTP_ERR_TIMEOUT    No valid answer.
+ *            SNTP_ERR_KOD        The server sent a Kiss-o'-Death.
+ *            SNTP_ERR_RTC        Could not adjust the RTC.
+ */
+int SNTP_SyncRTC(const char * host, sntp_result_t * result)
+{
+  int rc = SNTP_ERR_TIMEOUT;
+  net_sockhnd_t socket = NULL;
+  net_ipaddr_t server;
+  sntp_result_t res;
+  sntp_sample_t best = { 0, 0, 0 };
+  bool have_best = false;
+  int lost = 0;
+  uint8_t request[SNTP_PACKET_SIZE];
+  uint8_t reply[SNTP_PACKET_SIZE];
+
+  memset(&res, 0, sizeof(res));
+  if (host == NULL)
+  {
+    host = SNTP_SERVER_HOST;
+  }
+
+  if ( (net_get_hostaddress(hnet, &server, host) != NET_OK)
+      || (net_sock_create(hnet, &socket, NET_PROTO_UDP) != NET_OK) )
+  {
+    msg_error("Could not reach the SNTP server %s.\n", host);
+    rc = SNTP_ERR_CONNECT;
+  }
+  else if ( (net_sock_setopt(socket, "sock_read_timeout", (uint8_t *) SNTP_XSTR(SNTP_READ_TIMEOUT_MS), sizeof(SNTP_XSTR(SNTP_READ_TIMEOUT_MS))) != NET_OK)
+           || (net_sock_open(socket, host, SNTP_SERVER_PORT, 0) != NET_OK) )
+  {
+    msg_error("Could not open the SNTP socket.\n");
+    rc = SNTP_ERR_CONNECT;
+  }
+  else
+  {
+    for (int i = 0; (i < SNTP_SAMPLES) && (lost < SNTP_MAX_LOST) && (rc != SNTP_ERR_KOD); i++)
+    {
+      bool answered = false;
+      sntp_sample_t sample;
+      net_ipaddr_t from;
+      int from_port = 0;
+      int len;
+
+      memset(request, 0, sizeof(request));
+      request[0] = (SNTP_VERSION << 3) | SNTP_MODE_CLIENT;
+
+      int64_t t1 = sntp_now_ms();
+      uint32_t tick1 = HAL_GetTick();
+      sntp_put_timestamp(&request[40], t1);
+      if (net_sock_sendto(socket, request, sizeof(request), &server, SNTP_SERVER_PORT) != sizeof(request))
+      {
+        lost++;
+        continue;
+      }
+
+      /* Skip the datagrams which do not answer this request, until the timeout. */
+      do
+      {
+        len = net_sock_recvfrom(socket, reply, sizeof(reply), &from, &from_port);
+        if (len > 0)
+        {
+          int ret = sntp_parse_reply(reply, len, request, t1, t1 + (int64_t)(HAL_GetTick() - tick1), &sample, res.kiss);
+          if (ret == SNTP_OK)
+          {
+            answered = true;
+            res.samples++;
+            if ((have_best == false) || (sample.delay_ms < best.delay_ms))
+            {
+              best = sample;
+              have_best = true;
+            }
+            break;
+          }
+          if (ret == SNTP_ERR_KOD)
+          {
+            msg_warning("SNTP server %s sent the kiss code %s.\n", host, res.kiss);
+            rc = SNTP_ERR_KOD;
+            break;
+          }
+        }
+      } while ((len > 0) && (HAL_GetTick() - tick1 < SNTP_READ_TIMEOUT_MS));
+
+      if (answered == false)
+      {
+        lost++;
+      }
+    }
+
+    if (have_best == true)
+    {
+      res.offset_ms = best.offset_ms;
+      res.delay_ms = (uint32_t) best.delay_ms;
+      res.stratum = best.stratum;
+      rc = (TimingSystemAdjustSystemTimeMs(best.offset_ms) == 1) ? SNTP_OK : SNTP_ERR_RTC;
+    }
+    net_sock_close(socket);
+  }
+
+  if (socket != NULL)
+  {
+    net_sock_destroy(socket);
+  }
+
+  if (rc == SNTP_OK)
+  {
+    int64_t abs_ms = (res.offset_ms < 0) ? -res.offset_ms : res.offset_ms;
+    msg_info("RTC adjusted by %c%lu.%03lu s from %s (stratum %d, round trip %lu ms, %d/%d answers).\n",
+             (res.offset_ms < 0) ? '-' : '+', (unsigned long)(abs_ms / 1000), (unsigned long)(abs_ms % 1000),
+             host, res.stratum, (unsigned long) res.delay_ms, res.samples, SNTP_SAMPLES);
+  }
+  if (result != NULL)
+  {
+    *result = res;
+  }
+  return rc;
+}
+
+
+/**
+ * @brief Check an SNTP reply and compute the clock offset and the round trip.
+ * @param In:  reply     Received datagram.
+ * @param In:  len       Length of the datagram.
+ * @param In:  request   Request which was sent. Its transmit timestamp must be echoed as originate timestamp.
+ * @param In:  t1, t4    Local send and receive times, in ms since 1970.
+ * @param Out: sample    Offset, delay and stratum.
+ * @param Out: kiss      Kiss code, 4 characters and '\0', if the reply is a Kiss-o'-Death.
+ * @retval SNTP_OK, SNTP_ERR_KOD, or SNTP_ERR_TIMEOUT if the datagram must be ignored.
+ */
+static int sntp_parse_reply(const uint8_t * reply, int len, const uint8_t * request,
+                            int64_t t1, int64_t t4, sntp_sample_t * sample, char * kiss)
+{
+  uint8_t li = reply[0] >> 6;
+  uint8_t mode = reply[0] & 0x07;
+  uint8_t stratum = reply[1];
+  int64_t t2, t3;
+
+  if ( (len < SNTP_PACKET_SIZE) || (mode != SNTP_MODE_SERVER)
+      || (memcmp(&reply[24], &request[40], 8) != 0) )
+  {
+    return SNTP_ERR_TIMEOUT;   /* Not an answer to this request: stale, duplicated or forged. */
+  }
+
+  if (stratum == 0)
+  {
+    memcpy(kiss, &reply[12], 4);
+    kiss[4] = '\0';
+    return SNTP_ERR_KOD;
+  }
+
+  t2 = sntp_get_timestamp(&reply[32]);
+  t3 = sntp_get_timestamp(&reply[40]);
+  if ( (li == SNTP_LI_ALARM) || (stratum > 15) || (t3 == 0) || (t3 < t2) )
+  {
+    return SNTP_ERR_TIMEOUT;
+  }
+
+  sample->offset_ms = ((t2 - t1) + (t3 - t4)) / 2;
+  sample->delay_ms = (t4 - t1) - (t3 - t2);
+  if (sample->delay_ms < 0)
+  {
+    sample->delay_ms = 0;   /* Server processing time reported longer than the local round trip. */
+  }
+  sample->stratum = stratum;
+  return (sample->delay_ms <= SNTP_MAX_DELAY_MS) ? SNTP_OK : SNTP_ERR_TIMEOUT;
+}
+
+
+/**
+ * @brief Write an NTP timestamp: 32 bits of seconds since 1900 and 32 bits of fraction, big endian.
+ */
+static void sntp_put_timestamp(uint8_t * buf, int64_t unix_ms)
+{
+  uint32_t sec = (uint32_t)(unix_ms / 1000) + SNTP_NTP_UNIX_DELTA;   /* Wraps into era 1 after 2036. */
+  uint32_t frac = (uint32_t)(((uint64_t)(unix_ms % 1000) << 32) / 1000);
+
+  for (int i = 0; i < 4; i++)
+  {
+    buf[i] = (uint8_t)(sec >> (24 - 8 * i));
+    buf[4 + i] = (uint8_t)(frac >> (24 - 8 * i));
+  }
+}
+
+
+/**
+ * @brief Read an NTP timestamp, in ms since 1970. 0 for a null timestamp.
+ * @note  Seconds below 2^31 are taken as NTP era 1 (from 2036 on).
+ */
+static int64_t sntp_get_timestamp(const uint8_t * buf)
+{
+  uint32_t sec = ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) | ((uint32_t) buf[2] << 8) | buf[3];
+  uint32_t frac = ((uint32_t) buf[4] << 24) | ((uint32_t) buf[5] << 16) | ((uint32_t) buf[6] << 8) | buf[7];
+  int64_t unix_sec;
+
+  if ((sec == 0) && (frac == 0))
+  {
+    return 0;
+  }
+  unix_sec = (int64_t) sec - SNTP_NTP_UNIX_DELTA;
+  if ((sec & 0x80000000U) == 0)
+  {
+    unix_sec += 0x100000000LL;
+  }
+  return unix_sec * 1000 + (int64_t)(((uint64_t) frac * 1000 + 0x80000000U) >> 32);   /* Rounded to the nearest ms. */
+}
+
+
+/**
+ * @brief Current RTC time, in ms since 1970.
+ */
+static int64_t sntp_now_ms(void)
+{
+  uint32_t ms = 0;
+  time_t now = TimingSystemGetSystemTimeMs(&ms);
+
+  return (int64_t) now * 1000 + ms;
+}
+
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
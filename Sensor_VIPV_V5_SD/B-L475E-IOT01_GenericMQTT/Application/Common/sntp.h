@@ -0,0 +1,77 @@
+/**
+  ******************************************************************************
+  * @file    sntp.h
+  * @author  MCD Application Team
+  * @brief   SNTP client: RTC synchronization over UDP.
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright (c) 2017 STMicroelectronics International N.V. 
+  * All rights reserved.</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without 
+  * modification, are permitted, provided that the following conditions are met:
+  *
+  * 1. Redistribution of source code must retain the above copyright notice, 
+  *    this list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  * 3. Neither the name of STMicroelectronics nor the names of other 
+  *    contributors to this software may be used to endorse or promote products 
+  *    derived from this software without specific written permission.
+  * 4. This software, including modifications and/or derivative works of this 
+  *    software, must execute solely and exclusively on microcontroller or
+  *    microprocessor devices manufactured by or for STMicroelectronics.
+  * 5. Redistribution and use of this software other than as permitted under 
+  *    this license is void and will automatically terminate your rights under 
+  *    this license. 
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS" 
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT 
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW. IN NO EVENT 
+  * SHALL STMICROELECTRONICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+  * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+#ifndef SNTP_H
+#define SNTP_H
+
+#include <stdint.h>
+
+/** Time server. The pool hands out a nearby server at each resolution. */
+#ifndef SNTP_SERVER_HOST
+#define SNTP_SERVER_HOST    "pool.ntp.org"
+#endif
+#define SNTP_SERVER_PORT    123
+
+#define SNTP_OK             0
+#define SNTP_ERR_CONNECT   -1   /**< Could not resolve the server or open the UDP socket. */
+#define SNTP_ERR_TIMEOUT   -2   /**< No valid answer to any request. */
+#define SNTP_ERR_KOD       -3   /**< Kiss-o'-Death: the server asks to stop or slow down. */
+#define SNTP_ERR_RTC       -4   /**< Could not adjust the RTC. */
+
+/** Outcome of a synchronization. */
+typedef struct {
+  int64_t  offset_ms;   /**< Correction applied to the RTC. Positive when the RTC was late. */
+  uint32_t delay_ms;    /**< Round-trip delay of the selected sample. The offset error is below half of it. */
+  uint8_t  stratum;     /**< Stratum of the server. */
+  uint8_t  samples;     /**< Valid answers out of SNTP_SAMPLES requests. */
+  char     kiss[5];     /**< Kiss code of a Kiss-o'-Death answer (e.g. "RATE"), empty otherwise. */
+} sntp_result_t;
+
+int SNTP_SyncRTC(const char * host, sntp_result_t * result);
+
+
+#endif // SNTP_H
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
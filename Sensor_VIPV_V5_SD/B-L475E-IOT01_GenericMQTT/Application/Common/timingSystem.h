@@ -48,10 +48,13 @@
 #define __TIMING_AGENT_H
 
 #include <time.h>
+#include <stdint.h>
 
 extern void TimingSystemInitialize(void);
 extern int TimingSystemSetSystemTime(time_t epochTimeNow);
 extern time_t TimingSystemGetSystemTime(void);
+extern time_t TimingSystemGetSystemTimeMs(uint32_t *ms);
+extern int TimingSystemAdjustSystemTimeMs(int64_t offset_ms);
 
 #define YYEAR0           1900                    /* the first year */
 #define EEPOCH_YR        1970            /* EPOCH = Jan 1 1970 00:00:00 */
@@ -58,10 +58,15 @@
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
+static const wifi_network_t *selected_network = NULL;   /* Roaming choice; NULL: the credentials of checkWiFiCredentials() */
+
 /* Private function prototypes -----------------------------------------------*/
 int net_if_init(void * if_ctxt);
 int net_if_deinit(void * if_ctxt);
 int net_if_reinit(void * if_ctxt);
+int net_if_rejoin(void * if_ctxt);
+void net_if_select_network(const wifi_network_t *network);
+static int net_if_credentials(const char **ssid, const char **psk, WIFI_Ecn_t *security_mode);
 
 /* Functions Definition ------------------------------------------------------*/
 int net_if_init(void * if_ctxt)
@@ -167,7 +172,7 @@ int net_if_reinit(void * if_ctxt)
     msg_error("\n\t WIFI_Init() failed.\n");
   }
   
-  if (checkWiFiCredentials(&ssid, &psk, (uint8_t *) &security_mode) != HAL_OK)
+  if (net_if_credentials(&ssid, &psk, &security_mode) != HAL_OK)
   {
     ret = -1;
   }
@@ -190,5 +195,55 @@ int net_if_reinit(void * if_ctxt)
   return ret;
 }
 
+
+/* Fast rejoin: the module is alive and keeps its configuration, so it is not reset with WIFI_Init().
+ * Only the join itself is repeated. */
+int net_if_rejoin(void * if_ctxt)
+{
+  const char *ssid = "WIFI_TFGSVM";
+  const char  *psk = "Heliodorum98";
+  WIFI_Ecn_t security_mode = WIFI_ECN_WPA2_PSK;
+
+  if (net_if_credentials(&ssid, &psk, &security_mode) != HAL_OK)
+  {
+    return -1;
+  }
+
+  if (WIFI_Connect(ssid, psk, security_mode) != WIFI_STATUS_OK)
+  {
+    printf("\nFallo en el rejoin rapido al HotSpot: %s\n",ssid);
+    return -1;
+  }
+  printf("\nRejoin rapido al HotSpot: %s\n",ssid);
+  return 0;
+}
+
+
+/* Network for the next net_if_reinit() / net_if_rejoin(), chosen by the roaming scan. NULL goes back to
+ * the single network of checkWiFiCredentials(). The table lives in the user configuration, so only the
+ * pointer is kept. */
+void net_if_select_network(const wifi_network_t *network)
+{
+  selected_network = network;
+}
+
+
+static int net_if_credentials(const char **ssid, const char **psk, WIFI_Ecn_t *security_mode)
+{
+  uint8_t mode = (uint8_t) *security_mode;
+  int ret;
+
+  if (selected_network != NULL)
+  {
+    *ssid = selected_network->ssid;
+    *psk = selected_network->psk;
+    *security_mode = (WIFI_Ecn_t) selected_network->security_mode;
+    return HAL_OK;
+  }
+  ret = checkWiFiCredentials(ssid, psk, &mode);
+  *security_mode = (WIFI_Ecn_t) mode;
+  return ret;
+}
+
 #endif /* USE_WIFI */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,477 @@
+  /******************************************************************************
+  * @file    ColaMQTT.h
+  * @author  Sergio Vera Muñoz
+  * @brief   Cola de salida de paquetes MQTT PUBLISH (QoS 0 o QoS 1). Las publicaciones se
+  *  		 serializan al encolarlas y se envian de forma oportunista desde el bucle
+  *  		 principal, sin esperas: el socket es no bloqueante.
+  *  		 La lectura del socket y el keep-alive (MQTTYield sin espera) se reparten a
+  *  		 lo largo de la ventana de publicación en lugar de bloquear 500 ms por mensaje.
+  *  		 Los paquetes pendientes se agrupan en una sola trama por transacción
+  *  		 SendData del ISM43362 (cada una son 3 comandos AT por SPI), que se envía al
+  *  		 descargar la cola al final de la ventana o al llenarse la trama.
+  *  		 Con QoS 1 cada paquete conserva su hueco hasta el PUBACK con su identificador:
+  *  		 como mucho COLA_MQTT_VENTANA_QOS1 en vuelo, sondeo del socket cada
+  *  		 PERIODO_SONDEO_ACK_MS mientras haya alguno y, al rehacer la sesión, reenvío de los
+  *  		 que estaban en vuelo con DUP. Un PUBACK que no llega en COLA_MQTT_T_ACK_MS da
+  *  		 la conexión por caida: MQTT 3.1.1 solo reenvía al reconectar.
+  ******************************************************************************
+  * @attention
+  *
+  *  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+  *  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+  * All rights reserved
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+  ******************************************************************************
+  */
+#ifndef APPLICATION_USER_COLAMQTT_H_
+#define APPLICATION_USER_COLAMQTT_H_
+
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "MQTTClient.h"
+#include "es_wifi.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Defines Privados ------------------------------------------------------------*/
+
+#define COLA_MQTT_HUECOS          6		// Paquetes en espera: los 4 canales de una ventana mas margen para la FIFO
+#define PERIODO_SONDEO_MQTT_MS    1000	// Periodo de lectura del socket y de comprobación del keep-alive, en [ms]
+
+#define COLA_MQTT_MARGEN_TLS      64		// Cabecera, IV y MAC de un registro TLS: el registro cifrado debe caber en la transacción
+#define COLA_MQTT_TRAMA_MAX       (ES_WIFI_PAYLOAD_SIZE - COLA_MQTT_MARGEN_TLS)	// Bytes MQTT por transacción SendData
+#define COLA_MQTT_PAQUETE_SIZE    COLA_MQTT_TRAMA_MAX	// Cabecera MQTT + tema + payload: una ventana entera de Codec_Ventana.h. Mayor no saldría nunca en una trama
+#define COLA_MQTT_MARGEN_PING_MS  2000	// Antelación con la que se adelanta el PINGREQ para que viaje en la trama
+#define PINGREQ_SIZE              2
+
+#define COLA_MQTT_VENTANA_QOS1    4		// Publicaciones QoS 1 en vuelo sin PUBACK: el resto espera en la cola
+#define PERIODO_SONDEO_ACK_MS     50		// Periodo de lectura del socket con publicaciones en vuelo, en [ms]
+#define COLA_MQTT_T_ACK_MS        15000	// Espera máxima del PUBACK de la publicación más antigua, en [ms]
+#define MQTT_FLAG_DUP             0x08	// Bit DUP de la cabecera fija del PUBLISH
+
+
+/* Private typedef -----------------------------------------------------------*/
+
+typedef struct {
+  unsigned char paquete[COLA_MQTT_PAQUETE_SIZE];	/*< PUBLISH ya serializado */
+  uint16_t  longitud;
+  uint32_t  t_encolado;		/*< HAL_GetTick() al encolar, para la latencia */
+  uint32_t  t_enviado;		/*< HAL_GetTick() al pasar a la trama, para el PUBACK */
+  uint16_t  id_paquete;		/*< Identificador del PUBLISH QoS 1, 0 con QoS 0 */
+  bool      confirmado;		/*< PUBACK recibido fuera de orden, el hueco se libera al llegar a inicio */
+  uint8_t   etiqueta;		/*< La del llamante al encolar, ver huecos_EtiquetaColaMQTT() */
+} huecoColaMQTT;
+
+typedef struct {
+  huecoColaMQTT hueco[COLA_MQTT_HUECOS];
+  uint8_t   inicio;			/*< Hueco del paquete en vuelo mas antiguo: los n_en_vuelo desde aqui esperan su PUBACK */
+  uint8_t   n_en_vuelo;
+  uint8_t   cabeza;			/*< Hueco del paquete mas antiguo aun no pasado a la trama, inicio + n_en_vuelo */
+  uint8_t   n_pendientes;
+  bool      qos1;
+  uint16_t  ultimo_id;
+  uint8_t   etiqueta;		/*< Etiqueta de los paquetes que se encolen a partir de ahora */
+  uint32_t  t_ultimo_sondeo;
+  bool      descarga;		/*< Pedida por descarga_ColaMQTT(): enviar aunque la trama no esté llena */
+
+  unsigned char trama[COLA_MQTT_TRAMA_MAX];		/*< Paquetes agrupados para una sola transacción SendData */
+  uint16_t  trama_longitud;
+  uint16_t  trama_enviados;		/*< Bytes ya escritos: el socket no bloqueante puede aceptar la trama por partes */
+  uint8_t   trama_publicaciones;
+  uint32_t  trama_t_encolado[COLA_MQTT_HUECOS];
+
+  uint32_t  n_publicados;	/*< Estadisticas acumuladas desde la ultima impresion */
+  uint32_t  n_transacciones;	/*< Llamadas a mqttwrite(), cada una una transacción SendData por SPI */
+  uint32_t  n_pings;
+  uint32_t  n_confirmados, n_reenvios;	/*< PUBACK recibidos y PUBLISH reenviados con DUP al reconectar */
+  uint32_t  rtt_suma_ms, rtt_max_ms;		/*< Desde la trama hasta el PUBACK */
+  uint32_t  latencia_suma_ms, latencia_max_ms;
+  uint32_t  bloqueo_suma_ms, bloqueo_max_ms;		/*< Tiempo dentro de servicio_ColaMQTT() */
+  uint32_t  n_servicios;
+} colaMQTT;
+
+
+/* Prototipos privados de funciones -----------------------------------------------*/
+
+void inicia_ColaMQTT(colaMQTT * cola);
+uint8_t huecos_LibresColaMQTT(colaMQTT * cola);
+uint8_t huecos_EtiquetaColaMQTT(colaMQTT * cola, uint8_t etiqueta);
+void reanuda_ColaMQTT(colaMQTT * cola, bool qos1);
+int encola_PublicacionMQTT(colaMQTT * cola, MQTTClient * c, const char * topic, const char * msg);
+int encola_CargaMQTT(colaMQTT * cola, MQTTClient * c, const char * topic, const uint8_t * carga, uint16_t longitud);
+int servicio_ColaMQTT(colaMQTT * cola, MQTTClient * c);
+void descarga_ColaMQTT(colaMQTT * cola);
+static void llena_TramaMQTT(colaMQTT * cola, MQTTClient * c);
+static int sondea_SocketMQTT(colaMQTT * cola, MQTTClient * c);
+static void confirma_PublicacionMQTT(colaMQTT * cola, uint16_t id);
+static void libera_ConfirmadosMQTT(colaMQTT * cola);
+void imprime_EstadisticasColaMQTT(colaMQTT * cola);
+
+
+/* Declaraciones de dichas funciones -----------------------------------------------*/
+
+/** Deja la cola vacía y las estadisticas a cero.
+ */
+void inicia_ColaMQTT(colaMQTT * cola)
+{
+  memset(cola, 0, sizeof(colaMQTT));
+}
+
+
+/** Número de paquetes que aun caben en la cola. El llamante comprueba que caben todos los canales de un dato
+ *  antes de encolarlo, para no dejar publicado medio dato. Los paquetes en vuelo ocupan hueco hasta su PUBACK.
+ */
+uint8_t huecos_LibresColaMQTT(colaMQTT * cola)
+{
+  return (uint8_t)(COLA_MQTT_HUECOS - cola->n_pendientes - cola->n_en_vuelo);
+}
+
+
+/** Número de paquetes con una etiqueta aun en la cola, pendientes o sin PUBACK. A cero, todos los que se
+ *  encolaron con ella están entregados: con QoS 1, confirmados por el broker; con QoS 0, escritos en el socket.
+ */
+uint8_t huecos_EtiquetaColaMQTT(colaMQTT * cola, uint8_t etiqueta)
+{
+  uint8_t n = 0;
+
+  for (uint8_t i = 0; i < (cola->n_en_vuelo + cola->n_pendientes); i++)
+  {
+    if (cola->hueco[(cola->inicio + i) % COLA_MQTT_HUECOS].etiqueta == etiqueta) n++;
+  }
+  return n;
+}
+
+
+/** Al abrir cada sesión MQTT: fija el QoS de las siguientes publicaciones y devuelve a la cola los paquetes que
+ *  estaban en vuelo, con DUP, para que salgan los primeros. Con cleansession el broker los trata como nuevos;
+ *  la entrega es al menos una vez.
+ */
+void reanuda_ColaMQTT(colaMQTT * cola, bool qos1)
+{
+  for (uint8_t i = 0; i < cola->n_en_vuelo; i++)
+  {
+    cola->hueco[(cola->inicio + i) % COLA_MQTT_HUECOS].paquete[0] |= MQTT_FLAG_DUP;
+  }
+  cola->n_reenvios += cola->n_en_vuelo;
+  cola->n_pendientes += cola->n_en_vuelo;
+  cola->n_en_vuelo = 0;
+  cola->cabeza = cola->inicio;
+  cola->trama_longitud = 0;
+  cola->trama_enviados = 0;
+  cola->descarga = (cola->n_pendientes > 0);
+  cola->qos1 = qos1;
+}
+
+
+/** Serializa un PUBLISH con un mensaje de texto en el siguiente hueco libre, con el QoS de la cola. No toca el socket.
+ * @return - MQSUCCESS si ha quedado encolado
+ *         - FAILURE si la cola está llena, el cliente no está conectado o el mensaje no cabe en el paquete
+ */
+int encola_PublicacionMQTT(colaMQTT * cola, MQTTClient * c, const char * topic, const char * msg)
+{
+  return encola_CargaMQTT(cola, c, topic, (const uint8_t *) msg, (uint16_t) strlen(msg));
+}
+
+
+/** Como encola_PublicacionMQTT() con una carga binaria de longitud dada, que puede contener ceros (CBOR).
+ */
+int encola_CargaMQTT(colaMQTT * cola, MQTTClient * c, const char * topic, const uint8_t * carga, uint16_t longitud)
+{
+  MQTTString topicName = MQTTString_initializer;
+  huecoColaMQTT * hueco = NULL;
+  int len = 0;
+
+  if ( !c->isconnected || (huecos_LibresColaMQTT(cola) == 0) )
+  {
+    return FAILURE;
+  }
+
+  hueco = &cola->hueco[(cola->cabeza + cola->n_pendientes) % COLA_MQTT_HUECOS];
+  topicName.cstring = (char *) topic;
+  hueco->id_paquete = 0;
+  if (cola->qos1)
+  {
+    cola->ultimo_id = (cola->ultimo_id == 0xFFFF) ? 1 : (uint16_t)(cola->ultimo_id + 1);	/* 0 no es un identificador valido */
+    hueco->id_paquete = cola->ultimo_id;
+  }
+
+  len = MQTTSerialize_publish(hueco->paquete, COLA_MQTT_PAQUETE_SIZE, 0, cola->qos1 ? QOS1 : QOS0, 0, hueco->id_paquete,
+                              topicName, (unsigned char *) carga, longitud);
+  if (len <= 0)
+  {
+    msg_error("\n\nEl mensaje para el Tema %s no cabe en un paquete MQTT.\n", topic);
+    return FAILURE;
+  }
+
+  hueco->longitud = (uint16_t) len;
+  hueco->t_encolado = HAL_GetTick();
+  hueco->confirmado = false;
+  hueco->etiqueta = cola->etiqueta;
+  cola->n_pendientes++;
+
+  return MQSUCCESS;
+}
+
+
+/** Pide que la trama salga en la proxima pasada aunque no esté llena. Se invoca al terminar de encolar los
+ *  canales de una ventana o de un dato recuperado de la FIFO.
+ */
+void descarga_ColaMQTT(colaMQTT * cola)
+{
+  cola->descarga = true;
+}
+
+
+/** Pasa a la trama tantos paquetes completos de la cola como quepan, en orden; con QoS 1, sin pasar de
+ *  COLA_MQTT_VENTANA_QOS1 en vuelo, y quedan en su hueco hasta el PUBACK. Si el keep-alive va a vencer
+ *  añade un PINGREQ, como haría keepalive() de Paho, para no gastar una transacción propia.
+ */
+static void llena_TramaMQTT(colaMQTT * cola, MQTTClient * c)
+{
+  huecoColaMQTT * hueco = NULL;
+
+  cola->trama_longitud = 0;
+  cola->trama_enviados = 0;
+  cola->trama_publicaciones = 0;
+
+  while ( (cola->n_pendientes > 0) && (!cola->qos1 || (cola->n_en_vuelo < COLA_MQTT_VENTANA_QOS1)) )
+  {
+    hueco = &cola->hueco[cola->cabeza];
+    if ((cola->trama_longitud + hueco->longitud) > COLA_MQTT_TRAMA_MAX)
+    {
+      break;
+    }
+    memcpy(&cola->trama[cola->trama_longitud], hueco->paquete, hueco->longitud);
+    cola->trama_longitud += hueco->longitud;
+    cola->trama_t_encolado[cola->trama_publicaciones++] = hueco->t_encolado;
+    hueco->t_enviado = HAL_GetTick();
+
+    cola->cabeza = (cola->cabeza + 1) % COLA_MQTT_HUECOS;
+    cola->n_pendientes--;
+    if (cola->qos1)
+    {
+      hueco->confirmado = (hueco->id_paquete == 0);	/* serializado con QoS 0 antes de la sesión: sin PUBACK */
+      cola->n_en_vuelo++;
+    }
+    else
+    {
+      cola->inicio = cola->cabeza;	/* QoS 0: el hueco queda libre, su copia va en la trama */
+    }
+  }
+  libera_ConfirmadosMQTT(cola);
+
+  if ( (c->keepAliveInterval > 0) && !c->ping_outstanding &&
+       (TimerLeftMS(&c->last_received) < COLA_MQTT_MARGEN_PING_MS) &&
+       ((cola->trama_longitud + PINGREQ_SIZE) <= COLA_MQTT_TRAMA_MAX) )
+  {
+    int len = MQTTSerialize_pingreq(&cola->trama[cola->trama_longitud], COLA_MQTT_TRAMA_MAX - cola->trama_longitud);
+    if (len > 0)
+    {
+      cola->trama_longitud += len;
+      c->ping_outstanding = 1;
+      TimerCountdownMS(&c->last_received, 5000);	/* mismo margen que keepalive() para el PINGRESP */
+      cola->n_pings++;
+    }
+  }
+}
+
+
+/** Una pasada de la cola, pensada para cada vuelta del bucle principal. Si no hay trama en curso y se ha pedido
+ *  descarga, o los pendientes ya llenan una trama, agrupa los paquetes en una trama. Despues escribe en el socket
+ *  lo que este acepte de ella: una sola transacción SendData si el módulo la acepta entera. Como mucho una vez
+ *  por PERIODO_SONDEO_MQTT_MS (PERIODO_SONDEO_ACK_MS con paquetes en vuelo) lee el socket y atiende el keep-alive
+ *  con MQTTYield de espera nula. Ante un error de socket o un PUBACK vencido se marca el cliente como desconectado;
+ *  la trama a medias se descarta (el broker podría recibir un paquete cortado) y los paquetes aun en la cola, y
+ *  con QoS 1 los que estaban en vuelo, salen tras rehacer la conexion MQTT (reanuda_ColaMQTT()).
+ * @return - Nº de publicaciones completadas en esta pasada: escritas con QoS 0, confirmadas con QoS 1
+ *         - FAILURE si ha fallado el socket, el keep-alive o un PUBACK
+ */
+int servicio_ColaMQTT(colaMQTT * cola, MQTTClient * c)
+{
+  int rc = 0, completados = 0;
+  uint32_t t_inicio = HAL_GetTick(), t_bloqueo = 0;
+
+  if (!c->isconnected)
+  {
+    cola->trama_longitud = 0;
+    cola->trama_enviados = 0;
+    return 0;
+  }
+
+  if ( (cola->trama_longitud == 0) && (cola->n_pendientes > 0) &&
+       (cola->descarga || (cola->n_pendientes >= COLA_MQTT_HUECOS)) )
+  {
+    llena_TramaMQTT(cola, c);
+  }
+
+  if (cola->trama_longitud > 0)
+  {
+    rc = c->ipstack->mqttwrite(c->ipstack, &cola->trama[cola->trama_enviados], cola->trama_longitud - cola->trama_enviados, 0);
+    if (rc < 0)
+    {
+      c->isconnected = 0;
+      cola->trama_longitud = 0;
+      cola->trama_enviados = 0;
+      return FAILURE;
+    }
+    cola->n_transacciones++;
+
+    cola->trama_enviados += (uint16_t) rc;
+    if (cola->trama_enviados >= cola->trama_longitud)
+    {
+      for (uint8_t i = 0; i < cola->trama_publicaciones; i++)
+      {
+        uint32_t latencia = HAL_GetTick() - cola->trama_t_encolado[i];
+        cola->latencia_suma_ms += latencia;
+        if (latencia > cola->latencia_max_ms) cola->latencia_max_ms = latencia;
+      }
+      TimerCountdown(&c->last_sent, c->keepAliveInterval);	/* como sendPacket(): el broker ha recibido trafico */
+      cola->n_publicados += cola->trama_publicaciones;
+      if (!cola->qos1)
+      {
+        completados = cola->trama_publicaciones;
+      }
+
+      cola->trama_longitud = 0;
+      cola->trama_enviados = 0;
+      if (cola->n_pendientes == 0)
+      {
+        cola->descarga = false;
+      }
+    }
+  }
+  else if ( (HAL_GetTick() - cola->t_ultimo_sondeo) >= ((cola->n_en_vuelo > 0) ? PERIODO_SONDEO_ACK_MS : PERIODO_SONDEO_MQTT_MS) )
+  {
+    cola->t_ultimo_sondeo = HAL_GetTick();
+
+    rc = sondea_SocketMQTT(cola, c);
+    if (rc < 0)
+    {
+      return FAILURE;
+    }
+    completados = rc;
+
+    if ( (cola->n_en_vuelo > 0) && ((HAL_GetTick() - cola->hueco[cola->inicio].t_enviado) > COLA_MQTT_T_ACK_MS) )
+    {
+      msg_error("\n\nSin PUBACK del paquete %u en %u ms.\n", cola->hueco[cola->inicio].id_paquete, COLA_MQTT_T_ACK_MS);
+      c->isconnected = 0;
+      return FAILURE;
+    }
+  }
+
+  t_bloqueo = HAL_GetTick() - t_inicio;
+  cola->bloqueo_suma_ms += t_bloqueo;
+  if (t_bloqueo > cola->bloqueo_max_ms) cola->bloqueo_max_ms = t_bloqueo;
+  cola->n_servicios++;
+
+  return completados;
+}
+
+
+/** Lee del socket los paquetes que hayan llegado, hasta uno por hueco, con MQTTYield de espera nula (que además
+ *  atiende el keep-alive). Paho descarta los PUBACK sin mirarlos: su identificador se lee del buffer de lectura,
+ *  que se marca con una cabecera nula antes de cada lectura para distinguir un paquete nuevo de uno ya visto.
+ * @return - Nº de publicaciones confirmadas
+ *         - FAILURE si ha fallado el socket o el keep-alive
+ */
+static int sondea_SocketMQTT(colaMQTT * cola, MQTTClient * c)
+{
+  uint32_t confirmados = cola->n_confirmados;
+  unsigned char tipo = 0, dup = 0;
+  unsigned short id = 0;
+
+  for (uint8_t i = 0; i <= COLA_MQTT_HUECOS; i++)
+  {
+    c->readbuf[0] = 0;
+    if (MQTTYield(c, 0) != MQSUCCESS)
+    {
+      return FAILURE;
+    }
+    if (c->readbuf[0] == 0)
+    {
+      break;		/* nada más en el socket */
+    }
+    if ( (cola->n_en_vuelo > 0) && ((c->readbuf[0] >> 4) == PUBACK) &&
+         (MQTTDeserialize_ack(&tipo, &dup, &id, c->readbuf, c->readbuf_size) == 1) )
+    {
+      confirma_PublicacionMQTT(cola, id);
+    }
+  }
+  return (int)(cola->n_confirmados - confirmados);
+}
+
+
+/** Marca el paquete en vuelo con ese identificador; los PUBACK llegan en orden, pero uno fuera de orden espera a que se
+ *  liberen los anteriores. Un identificador desconocido (PUBACK repetido tras un reenvio) se ignora.
+ */
+static void confirma_PublicacionMQTT(colaMQTT * cola, uint16_t id)
+{
+  for (uint8_t i = 0; i < cola->n_en_vuelo; i++)
+  {
+    huecoColaMQTT * hueco = &cola->hueco[(cola->inicio + i) % COLA_MQTT_HUECOS];
+    if ( (hueco->id_paquete == id) && !hueco->confirmado )
+    {
+      uint32_t rtt = HAL_GetTick() - hueco->t_enviado;
+      cola->rtt_suma_ms += rtt;
+      if (rtt > cola->rtt_max_ms) cola->rtt_max_ms = rtt;
+      hueco->confirmado = true;
+      cola->n_confirmados++;
+      break;
+    }
+  }
+  libera_ConfirmadosMQTT(cola);
+}
+
+
+/** Libera los huecos confirmados desde el más antiguo en vuelo. cabeza (inicio + n_en_vuelo) no cambia.
+ */
+static void libera_ConfirmadosMQTT(colaMQTT * cola)
+{
+  while ( (cola->n_en_vuelo > 0) && cola->hueco[cola->inicio].confirmado )
+  {
+    cola->inicio = (cola->inicio + 1) % COLA_MQTT_HUECOS;
+    cola->n_en_vuelo--;
+  }
+}
+
+
+/** Muestra latencia desde el encolado hasta el ultimo byte escrito, transacciones SendData usadas, tiempo
+ *  bloqueado en la cola y, con QoS 1, PUBACK y reenvios, y reinicia las estadisticas.
+ */
+void imprime_EstadisticasColaMQTT(colaMQTT * cola)
+{
+  printf("Cola MQTT: %lu publicados y %lu PINGREQ en %lu transacciones, %u pendientes. Latencia media %lu ms (max %lu ms). Bloqueo total %lu ms (max %lu ms por pasada)\n",
+         (unsigned long) cola->n_publicados, (unsigned long) cola->n_pings, (unsigned long) cola->n_transacciones, cola->n_pendientes,
+         (unsigned long) ((cola->n_publicados > 0) ? (cola->latencia_suma_ms / cola->n_publicados) : 0),
+         (unsigned long) cola->latencia_max_ms,
+         (unsigned long) cola->bloqueo_suma_ms, (unsigned long) cola->bloqueo_max_ms);
+  if (cola->qos1)
+  {
+    printf("Cola MQTT QoS 1: %lu PUBACK, %u en vuelo, %lu reenviados. RTT medio %lu ms (max %lu ms)\n",
+           (unsigned long) cola->n_confirmados, cola->n_en_vuelo, (unsigned long) cola->n_reenvios,
+           (unsigned long) ((cola->n_confirmados > 0) ? (cola->rtt_suma_ms / cola->n_confirmados) : 0),
+           (unsigned long) cola->rtt_max_ms);
+  }
+
+  cola->n_publicados = 0;
+  cola->n_transacciones = 0;
+  cola->n_pings = 0;
+  cola->n_confirmados = 0;     cola->n_reenvios = 0;
+  cola->rtt_suma_ms = 0;       cola->rtt_max_ms = 0;
+  cola->latencia_suma_ms = 0;  cola->latencia_max_ms = 0;
+  cola->bloqueo_suma_ms = 0;   cola->bloqueo_max_ms = 0;
+  cola->n_servicios = 0;
+}
+
+
+#endif /* APPLICATION_USER_COLAMQTT_H_ */
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE************************************************/
@@ -43,6 +43,7 @@
 #define MODEL_DEFAULT_LEDON               true
 
 #define MQTT_SEND_BUFFER_SIZE             600
+#define MQTT_READ_BUFFER_SIZE             448	/**< Acks de 5 bytes como mucho y los PUBLISH del topic de comandos: cabecera, topic y COMANDO_TAM_MAX. Uno mayor corta la sesión */
 
 #define MQTT_CMD_TIMEOUT                  5000
 #define MAX_SOCKET_ERRORS_BEFORE_NETIF_RESET  3	//este parámetro da el numero de intentos de conexion fallidos
@@ -84,7 +85,7 @@ typedef enum {
 /* Declaraicion de variables -----------------------------------------------*/
 
 static unsigned char mqtt_send_buffer[MQTT_SEND_BUFFER_SIZE];
-  	  	 unsigned char mqtt_read_buffer[1]; 	//no se usará
+  	  	 unsigned char mqtt_read_buffer[MQTT_READ_BUFFER_SIZE]; 	//acks del broker, ver ColaMQTT.h
 bool b_mqtt_connected = false;
 device_config_t * device_config = NULL;
 conn_sec_t connection_security  = CONN_SEC_UNDEFINED;
@@ -116,6 +117,8 @@ int string_allocate_from_token(char ** pDestString, char * tokenName, const char
 /* The init/deinit netif functions are called from cloud.c.
  * However, the application needs to reinit whenever the connectivity seems to be broken. */
 extern int net_if_reinit(void * if_ctxt);
+extern int net_if_rejoin(void * if_ctxt);
+extern void net_if_select_network(const wifi_network_t *network);
 
 
 /* Funciones externas de otros ficheros-----------------------------------------------------------*/
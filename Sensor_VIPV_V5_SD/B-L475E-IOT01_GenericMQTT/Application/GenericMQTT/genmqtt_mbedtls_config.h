@@ -862,7 +862,7 @@
  *
  * Uncomment this macro to let the buffer allocator print out error messages.
  */
-//#define MBEDTLS_MEMORY_DEBUG
+#define MBEDTLS_MEMORY_DEBUG      /* Needed by mbedtls_memory_buffer_alloc_cur_get() / _max_get(). */
 
 /**
  * \def MBEDTLS_MEMORY_BACKTRACE
@@ -1958,7 +1958,7 @@
  *
  * Enable this module to enable the buffer memory allocator.
  */
-//#define MBEDTLS_MEMORY_BUFFER_ALLOC_C
+#define MBEDTLS_MEMORY_BUFFER_ALLOC_C   /* Fixed pool in RAM2, see heap_tls_pool_init(). */
 
 /**
  * \def MBEDTLS_NET_C
@@ -2517,7 +2517,8 @@
 /* ECP options */
 //#define MBEDTLS_ECP_MAX_BITS             521 /**< Maximum bit size of groups */
 //#define MBEDTLS_ECP_WINDOW_SIZE            6 /**< Maximum window size used */
-//#define MBEDTLS_ECP_FIXED_POINT_OPTIM      1 /**< Enable fixed-point speed-up */
+/* Off: the precomputed table takes about 6 KB more of the TLS pool (HEAP_TLS_POOL_SIZE) during the handshake. */
+#define MBEDTLS_ECP_FIXED_POINT_OPTIM      0 /**< Enable fixed-point speed-up */
 
 /* Entropy options */
 #define MBEDTLS_ENTROPY_MAX_SOURCES                2 /**< Maximum number of sources supported */
@@ -2562,7 +2563,10 @@
 //#define MBEDTLS_SSL_CACHE_DEFAULT_MAX_ENTRIES      50 /**< Maximum entries in cache */
 
 /* SSL options */
-#define MBEDTLS_SSL_MAX_CONTENT_LEN             5000 /**< Maximum fragment length in bytes, determines the size of each of the two internal I/O buffers */
+/* 4096 matches the max_fragment_length extension requested by net_tls_mbedtls.c. A server that ignores
+ * the extension may still send 16 KB records during the handshake (long certificate chains): then this
+ * value has to be raised, together with HEAP_TLS_POOL_SIZE. */
+#define MBEDTLS_SSL_MAX_CONTENT_LEN             4096 /**< Maximum fragment length in bytes, determines the size of each of the two internal I/O buffers */
 //#define MBEDTLS_SSL_DEFAULT_TICKET_LIFETIME     86400 /**< Lifetime of session tickets (if enabled) */
 //#define MBEDTLS_PSK_MAX_LEN               32 /**< Max size of TLS pre-shared keys, in bytes (default 256 bits) */
 //#define MBEDTLS_SSL_COOKIE_TIMEOUT        60 /**< Default expiration delay of DTLS cookies, in seconds if HAVE_TIME, or in number of cookies issued */
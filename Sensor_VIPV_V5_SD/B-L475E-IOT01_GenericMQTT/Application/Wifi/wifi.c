@@ -87,6 +87,7 @@ WIFI_Status_t WIFI_ListAccessPoints(WIFI_APs_t *APs, uint8_t AP_MaxNbr)
   WIFI_Status_t ret = WIFI_STATUS_ERROR;  
   ES_WIFI_APs_t esWifiAPs;
   
+  APs->count = 0;
   if(ES_WIFI_ListAccessPoints(&EsWifiObj, &esWifiAPs) == ES_WIFI_STATUS_OK)
   {
     if(esWifiAPs.nbr > 0)
@@ -98,6 +99,7 @@ WIFI_Status_t WIFI_ListAccessPoints(WIFI_APs_t *APs, uint8_t AP_MaxNbr)
         strncpy( (char *)APs->ap[APCount].SSID, (char *)esWifiAPs.AP[APCount].SSID, MIN (WIFI_MAX_SSID_NAME, WIFI_MAX_SSID_NAME));    
         APs->ap[APCount].RSSI = esWifiAPs.AP[APCount].RSSI;
         memcpy(APs->ap[APCount].MAC, esWifiAPs.AP[APCount].MAC, 6);
+        APs->ap[APCount].Channel = esWifiAPs.AP[APCount].Channel;
       }
     }
     ret = WIFI_STATUS_OK;  
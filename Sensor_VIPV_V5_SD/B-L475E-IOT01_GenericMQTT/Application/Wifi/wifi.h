@@ -56,7 +56,7 @@
 /* Exported constants --------------------------------------------------------*/
 #define WIFI_MAX_SSID_NAME            100
 #define WIFI_MAX_PSWD_NAME            100
-#define WIFI_MAX_APS                  100
+#define WIFI_MAX_APS                  ES_WIFI_MAX_DETECTED_AP   /* The module never reports more: 10 instead of 100 saves ~10 KB per WIFI_APs_t */
 #define WIFI_MAX_CONNECTIONS          4
 #define WIFI_MAX_MODULE_NAME          100
 #define WIFI_MAX_CONNECTED_STATIONS   2
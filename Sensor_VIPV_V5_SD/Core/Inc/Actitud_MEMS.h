@@ -0,0 +1,204 @@
+/******************************************************************************
+* @file    Actitud_MEMS.h
+* @author  Sergio Vera Muñoz
+* @brief   Acumulador de actitud del vehiculo a partir de la salida de fusión de
+* Motion-FX. En lugar de sumar alabeo, cabeceo y guiñada como escalares (lo que
+* falla cuando la guiñada cruza 359º-1º), se acumulan los cuaterniones alineados
+* en signo y los vectores unitarios de rumbo. Los angulos de Euler solo se calculan
+* al cerrar cada segundo y cada ventana de publicacion, junto a la dispersion
+* circular del rumbo.
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_ACTITUD_MEMS_H_
+#define INC_ACTITUD_MEMS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+/* Private defines -----------------------------------------------------------*/
+#define QX  0		// Motion-FX entrega el cuaternion como (x, y, z, w), parte escalar la ultima
+#define QY  1
+#define QZ  2
+#define QW  3
+
+#define NORMA_MIN_ACTITUD  1.0e-6f	// Por debajo de esta norma la media no está definida (muestras opuestas)
+
+
+/*--------Estructura del acumulador de actitud------------------------*/
+typedef struct
+{
+	float q_suma[4];		// Suma de cuaterniones alineados en el hemisferio de q_ref
+	float q_ref[4];			// Primer cuaternion acumulado, referencia de signo (q y -q son la misma rotación)
+	float rumbo_cos;		// Suma de cos(guiñada) de cada muestra
+	float rumbo_sin;		// Suma de sin(guiñada) de cada muestra
+	uint32_t n_muestras;
+
+}acumuladorActitud;
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+void reinicia_Actitud(acumuladorActitud* acc);
+void acumula_Actitud(acumuladorActitud* acc, const float q[4]);
+void fusiona_Actitud(acumuladorActitud* destino, const acumuladorActitud* origen);
+bool media_Actitud(const acumuladorActitud* acc, float* roll, float* pitch, float* yaw, float* dispersion_rumbo);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Deja el acumulador vacío, listo para un nuevo periodo de promediado
+  * @param  acc: acumulador a reiniciar
+  * @retval None
+  */
+void reinicia_Actitud(acumuladorActitud* acc)
+{
+	memset(acc, 0, sizeof(*acc));
+}
+
+
+/**
+  * @brief  Añade una muestra de orientación al acumulador. Solo sumas y un producto escalar, sin
+  * trigonometría: el signo del cuaternion se alinea con la referencia y el vector de rumbo se obtiene
+  * directamente de las componentes del cuaternion.
+  * @param  acc: acumulador a actualizar
+  * @param  q: cuaternion de la salida quaternion_9X de Motion-FX (x, y, z, w)
+  * @retval None
+  */
+void acumula_Actitud(acumuladorActitud* acc, const float q[4])
+{
+	float signo = 1.0f, hx = 0.0f, hy = 0.0f, norma = 0.0f;
+
+	if (acc->n_muestras == 0) {
+		memcpy(acc->q_ref, q, sizeof(acc->q_ref));
+	}
+	else if ( (acc->q_ref[QX]*q[QX] + acc->q_ref[QY]*q[QY] + acc->q_ref[QZ]*q[QZ] + acc->q_ref[QW]*q[QW]) < 0.0f ) {
+		signo = -1.0f;	//hemisferio opuesto, se invierte para no cancelar la suma
+	}
+
+	acc->q_suma[QX] += signo * q[QX];
+	acc->q_suma[QY] += signo * q[QY];
+	acc->q_suma[QZ] += signo * q[QZ];
+	acc->q_suma[QW] += signo * q[QW];
+
+	/* Dirección de la guiñada (cos, sin) sin calcular el angulo: columna X de la matriz de rotacion NED */
+	hx = 1.0f - 2.0f*(q[QY]*q[QY] + q[QZ]*q[QZ]);
+	hy = 2.0f*(q[QW]*q[QZ] + q[QX]*q[QY]);
+	norma = sqrtf(hx*hx + hy*hy);
+
+	if (norma > NORMA_MIN_ACTITUD) {	//vehiculo en vertical: rumbo indefinido, no aporta
+		acc->rumbo_cos += hx / norma;
+		acc->rumbo_sin += hy / norma;
+	}
+
+	acc->n_muestras++;
+}
+
+
+/**
+  * @brief  Añade el contenido de un acumulador a otro. Se usa para pasar el acumulado de cada segundo
+  * al de la ventana de publicación sin volver a recorrer las muestras.
+  * @param  destino: acumulador que recibe las sumas
+  * @param  origen: acumulador a añadir
+  * @retval None
+  */
+void fusiona_Actitud(acumuladorActitud* destino, const acumuladorActitud* origen)
+{
+	float signo = 1.0f;
+
+	if (origen->n_muestras == 0) {
+		return;
+	}
+
+	if (destino->n_muestras == 0) {
+		memcpy(destino->q_ref, origen->q_ref, sizeof(destino->q_ref));
+	}
+	else if ( (destino->q_ref[QX]*origen->q_suma[QX] + destino->q_ref[QY]*origen->q_suma[QY] +
+			   destino->q_ref[QZ]*origen->q_suma[QZ] + destino->q_ref[QW]*origen->q_suma[QW]) < 0.0f ) {
+		signo = -1.0f;
+	}
+
+	destino->q_suma[QX] += signo * origen->q_suma[QX];
+	destino->q_suma[QY] += signo * origen->q_suma[QY];
+	destino->q_suma[QZ] += signo * origen->q_suma[QZ];
+	destino->q_suma[QW] += signo * origen->q_suma[QW];
+
+	destino->rumbo_cos += origen->rumbo_cos;
+	destino->rumbo_sin += origen->rumbo_sin;
+	destino->n_muestras += origen->n_muestras;
+}
+
+
+/**
+  * @brief  Calcula la orientación media del periodo acumulado. El cuaternion medio se normaliza una sola
+  * vez y se convierte a Euler (Z-Y-X, NED), reproduciendo el convenio de rotation_9X de Motion-FX.
+  * La dispersión del rumbo es la desviación circular sqrt(-2 ln R), con R la longitud media resultante.
+  * @param  acc: acumulador del periodo
+  * @param  roll, pitch, yaw: punteros donde devolver los angulos medios en grados, yaw en [0, 360)
+  * @param  dispersion_rumbo: desviación circular del rumbo en grados (puede ser NULL)
+  * @retval false si no hay muestras o la media no está definida; los punteros no se modifican
+  */
+bool media_Actitud(const acumuladorActitud* acc, float* roll, float* pitch, float* yaw, float* dispersion_rumbo)
+{
+	float x, y, z, w, norma, seno_pitch, R;
+
+	if (acc->n_muestras == 0) {
+		return false;
+	}
+
+	norma = sqrtf(acc->q_suma[QX]*acc->q_suma[QX] + acc->q_suma[QY]*acc->q_suma[QY] +
+				  acc->q_suma[QZ]*acc->q_suma[QZ] + acc->q_suma[QW]*acc->q_suma[QW]);
+
+	if (norma < NORMA_MIN_ACTITUD) {
+		return false;
+	}
+
+	x = acc->q_suma[QX] / norma;	y = acc->q_suma[QY] / norma;
+	z = acc->q_suma[QZ] / norma;	w = acc->q_suma[QW] / norma;
+
+	seno_pitch = 2.0f*(w*y - z*x);
+	if (seno_pitch > 1.0f) seno_pitch = 1.0f;		//saturación numérica en ±90º
+	if (seno_pitch < -1.0f) seno_pitch = -1.0f;
+
+	*roll  = rad2deg( atan2f(2.0f*(w*x + y*z), 1.0f - 2.0f*(x*x + y*y)) );
+	*pitch = rad2deg( asinf(seno_pitch) );
+	*yaw   = rad2deg( atan2f(2.0f*(w*z + x*y), 1.0f - 2.0f*(y*y + z*z)) );
+	*yaw = (*yaw < 0.0f) ? (360.0f + *yaw) : (*yaw);	//positivo, como en FX_Data_Handler
+	if (*yaw >= 360.0f) *yaw = 0.0f;					//-0.0001º + 360 se redondea a 360 en float
+
+	if (dispersion_rumbo != NULL) {
+
+		R = sqrtf(acc->rumbo_cos*acc->rumbo_cos + acc->rumbo_sin*acc->rumbo_sin) / (float)acc->n_muestras;
+
+		if (R >= 1.0f) {
+			*dispersion_rumbo = 0.0f;
+		}
+		else if (R < NORMA_MIN_ACTITUD) {
+			*dispersion_rumbo = 180.0f;	//rumbo uniformemente repartido, cota superior
+		}
+		else {
+			*dispersion_rumbo = rad2deg( sqrtf(-2.0f * logf(R)) );
+		}
+	}
+
+	return true;
+}
+
+#endif  /* INC_ACTITUD_MEMS_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
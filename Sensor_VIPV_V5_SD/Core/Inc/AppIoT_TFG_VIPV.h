@@ -31,16 +31,50 @@
 //#define ENABLE_SLEEP
 				/*Compila el código habilitando la funcionalidad de entrar en modo Sleep. Comentar para deshabilitar */
 #define ENABLE_IMPRIMIR_MUESTRAS
-				/*Compila el código habilitando la funcionalidad de Imprimir los datos muestreados. Comentar para deshabilitar */
+				/*Imprime por defecto los datos muestreados. Comentar para deshabilitar. Todas las opciones de ejecución de este
+				 * bloque y del siguiente son valores por defecto: config.json en la SD los puede cambiar (ver Configuracion_SD.h) */
 //#define ENABLE_LOWPWR
 				/*Compila el código habilitando la funcionalidad de Bajo Consumo. Comentar para deshabilitar */
 //#define ENABLE_PULSADOR
 				/*Compila el código habilitando la funcionalidad de accionar el pulsador para detener publicacion. Comentar para deshabilitar */
-#define OPCION_IoT 0
-				/* 0 - Carga en tarjeta SD; 1 - Carga datos en nube Thingspeak (seleccionar si se quiere publicar datos concatenados o no) */
+#define HABILITA_SD    1
+				/* 1 - Registra cada muestra en la tarjeta SD, referencia de los datos; 0 - sin SD */
+#define HABILITA_NUBE  1
+				/* 1 - Publica la media de cada ventana en la nube Thingspeak, en la medida en que haya red (seleccionar si se quiere
+				 * publicar datos concatenados o no); 0 - sin publicación. Ambos destinos pueden estar activos a la vez */
+//#define ENABLE_TELEMETRIA_BINARIA
+				/*Envía por el USART1 tramas binarias (muestras, actitud y tiempos de las tareas) en lugar de imprimir cada muestra
+				 * en texto; se leen con Herramientas/monitor_telemetria.py. Comentar para el texto de TeraTerm */
+#define PERIODO_PERFIL_S  0
+				/*Periodo en segundos del informe del perfilador DWT por consola y en la SD (perfil.txt); 0 - solo a
+				 * petición, pulsando 'p' en el terminal del USART1 */
+//#define ENABLE_PUBLICA_PERFIL
+				/*Publica además un resumen de cada informe del perfilador en el campo status del canal 4 de ThingSpeak */
+#define PERIODO_MEMORIA_S  600
+				/*Periodo en segundos del informe de memoria (heap, fragmentación, clases de reserva y pila) por consola;
+				 * 0 - sin informe. Los fallos de reserva y la falta de holgura de la pila se avisan en cada uno */
+//#define ENABLE_PUBLICA_MEMORIA
+				/*Publica además un resumen de cada informe de memoria en el campo status del canal 3 de ThingSpeak */
+//#define ENABLE_SD_BINARIO
+				/*Registra en la SD los registros compactos de 40 bytes (fichero .bin) en lugar de lineas CSV (.txt). Comentar para CSV */
+//#define ENABLE_ENLACE_MQTTSN
+				/*Envía la media de cada ventana como un datagrama MQTT-SN por UDP a la pasarela PASARELA_SN_HOST, en lugar
+				 * de publicarla por MQTT sobre TLS en ThingSpeak (ver Enlace_MQTTSN.h). Sin datos concatenados */
+#define ENABLE_CONFIRMA_MQTTSN
+				/*Con el enlace MQTT-SN, QoS 1: cada media sale de la FIFO con el PUBACK de la pasarela. Comentar para QoS -1 */
+//#define ENABLE_QOS1_MQTT
+				/*Publica por MQTT con QoS 1: cada paquete ocupa la cola MQTT hasta su PUBACK y los que no lo tienen se reenvían
+				 * al reconectar (ver ColaMQTT.h). El broker de ThingSpeak solo admite QoS 0: para un broker propio */
+//#define ENABLE_COMANDOS_REMOTOS
+				/*Se suscribe a TOPIC_COMANDOS y ejecuta los comandos firmados con CLAVE_COMANDOS (ver Comandos_Remotos.h):
+				 * consulta y cambio de la configuración, ráfagas, extracción del log de la SD, actualización y reinicio.
+				 * Responde en TOPIC_RESPUESTAS. Para un broker propio: ThingSpeak no admite topics arbitrarios.
+				 * El verbo actualiza necesita compilar con RFU definido (en el preprocesador del proyecto, como
+				 * USE_WIFI): descarga la imagen al otro banco de la flash y arranca de él a prueba (ver rfu.c) */
 #define PUBLI_DATOS_THINGSPEAK_CONCATENADOS
 				// Compila el código encargado de concatenar y publicar los datos concatenados. Comentar para deshabilitar.
-				// Si no se compila, solo se publica la información media en los canales 1 y 2
+				// Si no se compila, solo se publica la información media en los canales 1 y 2. La serie de la ventana
+				// para los codecs JSON y CBOR no depende de esto (Ventanas_Muestras.h)
 
 
 
@@ -50,6 +84,32 @@
 #define PERIODO_LECTURA_DATOS     1		//Periodo de lectura de los datos
 #define PERIODO_RECUPERA_DATOS    5 	/*periodo minimo de ThingSpeak para recuperar los datos es de 15 seg
 										 https://thingspeak.com/pages/license_faq   */
+#ifdef ENABLE_SD_BINARIO
+#define EXTENSION_SD              "bin"
+#else
+#define EXTENSION_SD              "txt"
+#endif
+#define ESPERA_ERROR_SD_MS        5000U	//Espera antes de volver a montar la SD tras un fallo, en ms
+#define T_ARRANQUE_SD_MS          1000U	//Tiempo desde el reset antes del primer acceso a la SD, en ms
+#define PERIODO_SNTP_MS           3600000U	//Resincronizacion del RTC por SNTP con la red arriba, en ms (50 ppm del cristal: 180 ms/h)
+#define REINTENTO_SNTP_MS         300000U	//Espera tras una resincronizacion SNTP fallida, en ms
+#define PASARELA_SN_HOST          "192.168.1.10"	//Pasarela MQTT-SN del enlace UDP
+#define PASARELA_SN_PUERTO        1884
+#define TOPIC_SN_MEDIA            1		//Topic predefinido en la pasarela para las medias de ventana
+#define CODEC_NUBE                CODEC_THINGSPEAK	/*Formato de la nube: CODEC_THINGSPEAK (canales 1 a 4 de ThingSpeak) o
+													 CODEC_JSON y CODEC_CBOR (la ventana entera en un mensaje, ver Codec_Ventana.h) */
+#define TOPIC_NUBE                "vipv/%s/ventana"	//Topic de los codecs JSON y CBOR en el broker propio; %s es la MAC
+#define TOPIC_COMANDOS            "vipv/%s/cmd"		//Comandos remotos firmados, suscripción QoS 0; %s es la MAC
+#define TOPIC_RESPUESTAS          "vipv/%s/resp"		//Respuestas a los comandos remotos
+#define RESPUESTA_SIZE            1024	//Respuesta a un comando o parte de una ráfaga o del log: cabe en un paquete de la cola MQTT
+#define RAFAGA_MAX_MUESTRAS       120	//Muestras de irradiancia de una ráfaga
+#define RAFAGA_PERIODO_MIN_MS     60		//mideRadiacion() tarda 6*(T_ESPERA+T_MEDICION) ms
+#define RAFAGA_PERIODO_MAX_MS     10000
+#define RAFAGA_LINEAS_PARTE       20		//Muestras por mensaje de la ráfaga
+#define RFU_PLAZO_PRUEBA_MS       900000U	//Una imagen nueva que no abre la sesión MQTT en 15 min vuelve a la anterior
+#define N_VENTANAS_LARGAS         2
+#define DURACION_VENTANAS_LARGAS_S  {60, 900}			//Ventanas de media larga para los estudios energeticos, en segundos
+#define NOMBRE_VENTANAS_LARGAS      {"1 min", "15 min"}
 
 #define T_MEDICION		  3     //Tiempo en ms durante el cual permanece midiendo un módulo FV
 #define T_ESPERA		  5	   //Tiempo que espera entre permutaciones de los BJT para tomar las medidas, por si acaso, grande, no hay prisa
@@ -72,17 +132,33 @@
 #define noesNAN(x)    ( !( (x)!=(x) ) )  //MACRO para idefntificar a los NaN
 #define deg2rad(x)    ( (float)(x) * (M_PI/180.0f))
 #define rad2deg(x)    ( (float)(x) * (180.0f/M_PI))
-#define N_ELEMENTOS  (PERIODO_PUBLI_DATOS / PERIODO_LECTURA_DATOS)
 
 /* Includes ------------------------------------------------------------------*/
 
 #include "main.h"
+#include "Registro_Compacto.h"	//registro de 40 bytes de lo que se guarda o se encola
 #include "FIFO.h"	//contiene las funciones y estructuras para crear una lista enlazada comportamiento fifo
 #include "Low_Power.h"
 #include "GenericMQTT.h"
+#include "ColaMQTT.h"		//cola de salida de publicaciones MQTT no bloqueante
 #include "fatfs.h"
 
 #include "mi_MEMS.h"
+#include "Actitud_MEMS.h"	//acumulador de cuaterniones para las medias de actitud
+#include "Fusion_Adaptativa.h"	//frecuencia y motor 6X/9X de Motion-FX segun el movimiento del vehiculo
+#include "Tuberia_Datos.h"		//reparto de cada registro a los sumideros SD, nube y UART
+#include "Estadistica_Ventana.h"	//media, desviación, minimo y maximo en linea de cada ventana
+#include "Configuracion_SD.h"	//configuración en tiempo de ejecución desde config.json en la SD
+#include "Ventanas_Muestras.h"	//ventanas de muestras en ping-pong entre la lectura y la publicación
+#include "Telemetria_Binaria.h"	//tramas COBS con CRC por el USART1 para el banco de pruebas
+#include "Perfilador_DWT.h"		//sondas de ciclos DWT con histograma de las tareas y de la red
+#include "Monitor_Memoria.h"	//heap, clases de reserva y pila pintada, siempre activo
+#include "Gestor_Conectividad.h"	//maquina de estados de la red con espera exponencial y rejoin rapido
+#include "Redes_Conocidas.h"		//itinerancia entre las redes conocidas por RSSI y por zona GPS
+#include "Enlace_MQTTSN.h"			//medias en datagramas MQTT-SN por UDP, alternativa a MQTT sobre TLS
+#include "Codec_Ventana.h"			//ventana entera en un mensaje JSON o CBOR para un broker MQTT propio
+#include "Comandos_Remotos.h"		//comandos remotos firmados con HMAC-SHA256 por una suscripción MQTT
+#include "Extractor_Log.h"			//registros de la SD de una franja horaria, por partes, para el comando log
 
 
 #endif /* __AppIOTGenericaMQTT_H */
@@ -116,28 +192,39 @@ void aplicacion_ClienteMQTT_XCLD_IoT(void);
 
 void mideRadiacion(float vectIrradiancia[]);
 void recabar_Datos(megaDato* miLectura); //función de recogida de datos
-bool publica_DatosThingSpeak(megaDato* miDato);
+bool publica_Media(const registroCompacto* registro);
+bool publica_DatosThingSpeak(const registroCompacto* registro);
 bool publica_DatosConcatThingSpeak(megaDatoConcat* miDatoConcat);
-void calcula_mediaVector(megaDato* mediaDatos, megaDato* p_ectorLecturas, uint8_t n_elem );
-void calcula_concatenar(megaDatoConcat* mediaDatos, megaDato* p_ectorLecturas, uint8_t n_elem );
+void calcula_concatenar(megaDatoConcat* mediaDatos, const registroCompacto* p_ectorLecturas, uint16_t n_elem );
 void imprimir_Dato(megaDato Dato);
 void computa_algoritmoMEMS(void);
 bool reconecta_WiFi(void);
-void inicializa_SD(void);
-void escribir_fichero(char *nombre, char *mensaje);
-void obtencion_dato_SD(megaDato* miLectura);	// función de escritura en la memoria externa
+bool inicializa_SD(const megaDato* miLectura);
+bool escribir_fichero(char *nombre, char *mensaje);
+bool escribir_datos(char *nombre, const void *datos, UINT longitud);
+bool obtencion_dato_SD(megaDato* miLectura);	// función de escritura en la memoria externa
+void carga_Configuracion(void);
+void conecta_Sumideros(void);
 
 
 void bucle_Principal(void);
 void hilo1_Lectura(void);	//Rutinas de hilos de ejecucción
+void acumula_VentanasLargas(const megaDato* muestra);
 void hilo2_Publicacion(void);
-bool hilo3_Reconexion(void);
+void hilo3_Reconexion(void);
+void envia_ColaMQTT(void);
+void envia_EnlaceSN(void);
+void inicia_RedSegundoPlano(void);
+void servicio_RedSegundoPlano(void);
+void servicio_Perfil(void);
+void servicio_Memoria(void);
+void servicio_Comandos(void);
 
 
 int  check_protocoloConexion(void);
 bool inicia_ClienteMQTT(int ret);
 bool desconectaConexionMQTT(void);
-bool inicializa_ConexionIoT(void);
+bool inicializa_Plataforma(void);
 void switch_Temporizadores(bool estado);
 
 /* Funcíón externa de la biblioteca NMEA --------------------------------------------------------*/
@@ -0,0 +1,478 @@
+/******************************************************************************
+* @file    Codec_Ventana.h
+* @author  Sergio Vera Muñoz
+* @brief   Codificadores de la carga de la nube: una ventana de publicación entera (la
+* media y la serie de muestras de 1 Hz) en un solo mensaje, para un broker MQTT propio.
+*  - "json": JSON compacto escrito en flujo sobre el buffer de salida, sin árbol de cJSON
+*    ni heap. Las magnitudes salen en decimal con la resolución del registro compacto.
+*  - "cbor": CBOR (RFC 8949) con las mismas claves; cada magnitud es el entero escalado
+*    del registro compacto (ESCALA_* de Registro_Compacto.h), sin pasar por float. La
+*    humedad va en décimas de %HR en los dos, como el resto de magnitudes de 1 decimal.
+*  - "thingspeak": el formato field1=...&created_at=... de siempre, en 2 o 4 canales, que
+*    formatea la aplicación (publica_DatosThingSpeak()); aquí solo tiene nombre.
+* Estructura de ambos:
+*   { "id": MAC, "t": epoch de la media,
+*     "m": { "g1".."g5", "T", "P", "H", "rol", "cab", "gui", "dr", "lat", "lon", "alt", "vel" },
+*     "s": { "t0": epoch de la primera muestra, "n": lecturas de la ventana (solo si se envían menos),
+*            "dt": segundos entre muestras o "t": [segundos desde t0],
+*            "g1".."g5", "T", "vel", "dlat", "dlon", "alt", "rol", "cab", "gui": [una por muestra] } }
+* "dlat" y "dlon" son la diferencia con "lat" y "lon" de la media en unidades de 1e-7 º: la
+* mitad de cifras que la coordenada entera. Las magnitudes sin su bit de validez van como null. Sin serie no hay "s". Si la ventana
+* no cabe en el destino, codifica_Ventana() diezma la serie (una de cada 2, de cada 3...)
+* hasta que quepa. "dt" sustituye a "t" si las muestras enviadas están equiespaciadas, lo
+* normal salvo lecturas perdidas. Una ventana de más de N_MAX_SERIE lecturas ya llega
+* diezmada de Ventanas_Muestras.h; en cuanto la serie enviada tiene menos muestras que
+* lecturas tuvo la ventana, "n" lo indica con el numero de lecturas.
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_CODEC_VENTANA_H_
+#define INC_CODEC_VENTANA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "Registro_Compacto.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define PASO_MAX_SERIE           8			// Diezmado máximo de la serie antes de enviar solo la media
+
+
+/*--------Codecs y magnitudes------------------------*/
+typedef enum {CODEC_THINGSPEAK=0, CODEC_JSON, CODEC_CBOR, N_CODECS} tipoCodec;
+
+/* Codifica la media y una de cada paso muestras de la serie. Devuelve los bytes escritos, o -1 si no cabe */
+typedef int (*codificadorVentana)(const registroCompacto* media, const registroCompacto* serie, uint16_t n_serie,
+								  uint32_t n_leidas, uint8_t paso, const char* id, uint8_t* destino, size_t tam);
+
+typedef struct
+{
+	const char* nombre;				// Valor de "codec_nube" en config.json
+	codificadorVentana codifica;	// NULL: lo formatea la aplicación
+
+}codecVentana;
+
+typedef enum {CAMPO_G1=0, CAMPO_G2, CAMPO_G3, CAMPO_G4, CAMPO_G5, CAMPO_T, CAMPO_P, CAMPO_H, CAMPO_ROL, CAMPO_CAB,
+			  CAMPO_GUI, CAMPO_DR, CAMPO_LAT, CAMPO_LON, CAMPO_ALT, CAMPO_VEL, N_CAMPOS} campoVentana;
+
+typedef struct
+{
+	const char* clave;
+	uint8_t decimales;				// log10 de su ESCALA_*, para el JSON
+
+}descriptorCampo;
+
+typedef struct
+{
+	campoVentana campo;
+	const char* clave;
+	uint8_t decimales;				// 0 en las coordenadas, que van como diferencia entera con la media
+
+}columnaSerie;
+
+typedef struct
+{
+	uint8_t* p;
+	size_t libre;
+	bool desborde;
+
+}escritorCarga;
+
+
+/* ------------------------------------------------- Variables ---------------------------------------------------------*/
+static const descriptorCampo CAMPOS[N_CAMPOS] = {
+	{"g1", 1}, {"g2", 1}, {"g3", 1}, {"g4", 1}, {"g5", 1}, {"T", 2}, {"P", 1}, {"H", 1},
+	{"rol", 2}, {"cab", 2}, {"gui", 2}, {"dr", 2}, {"lat", 7}, {"lon", 7}, {"alt", 1}, {"vel", 2}
+};
+
+/* Magnitudes de la serie: las de los canales concatenados de ThingSpeak */
+static const columnaSerie COLUMNAS_SERIE[] = {
+	{CAMPO_G1, "g1", 1}, {CAMPO_G2, "g2", 1}, {CAMPO_G3, "g3", 1}, {CAMPO_G4, "g4", 1}, {CAMPO_G5, "g5", 1},
+	{CAMPO_T, "T", 2}, {CAMPO_VEL, "vel", 2}, {CAMPO_LAT, "dlat", 0}, {CAMPO_LON, "dlon", 0}, {CAMPO_ALT, "alt", 1},
+	{CAMPO_ROL, "rol", 2}, {CAMPO_CAB, "cab", 2}, {CAMPO_GUI, "gui", 2}
+};
+#define N_COLUMNAS_SERIE         (sizeof(COLUMNAS_SERIE) / sizeof(COLUMNAS_SERIE[0]))
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+int codifica_Ventana(tipoCodec codec, const registroCompacto* media, const registroCompacto* serie, uint16_t n_serie,
+					 uint32_t n_leidas, const char* id, uint8_t* destino, size_t tam, uint8_t* paso);
+int codifica_VentanaJSON(const registroCompacto* media, const registroCompacto* serie, uint16_t n_serie,
+						 uint32_t n_leidas, uint8_t paso, const char* id, uint8_t* destino, size_t tam);
+int codifica_VentanaCBOR(const registroCompacto* media, const registroCompacto* serie, uint16_t n_serie,
+						 uint32_t n_leidas, uint8_t paso, const char* id, uint8_t* destino, size_t tam);
+int busca_Codec(const char* nombre);
+
+static int32_t valor_Campo(const registroCompacto* reg, campoVentana campo, bool* valido);
+static int32_t valor_Serie(const registroCompacto* media, const registroCompacto* reg, campoVentana campo, bool* valido);
+static int32_t espaciado_Serie(const registroCompacto* serie, uint16_t n_serie, uint8_t paso);
+static void escribe_Bytes(escritorCarga* e, const void* datos, size_t n);
+static void escribe_Texto(escritorCarga* e, const char* texto);
+static void escribe_Entero(escritorCarga* e, int64_t valor);
+static void escribe_Fijo(escritorCarga* e, int32_t valor, uint8_t decimales);
+static void cbor_Cabecera(escritorCarga* e, uint8_t tipo, uint64_t valor);
+static void cbor_Entero(escritorCarga* e, int64_t valor);
+static void cbor_Texto(escritorCarga* e, const char* texto);
+
+static const codecVentana CODECS_VENTANA[N_CODECS] = {
+	{"thingspeak", NULL}, {"json", codifica_VentanaJSON}, {"cbor", codifica_VentanaCBOR}
+};
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Codifica una ventana con el codec elegido. Si no cabe con la serie entera, la diezma hasta
+  * PASO_MAX_SERIE; si aun así no cabe, envía solo la media.
+  * @param  codec: CODEC_JSON o CODEC_CBOR
+  * @param  media: media de la ventana
+  * @param  serie: muestras de la ventana en orden, NULL si no hay
+  * @param  n_serie: número de muestras
+  * @param  n_leidas: lecturas de la ventana; si son más que las muestras enviadas la serie lleva "n"
+  * @param  id: identificador del sensor (MAC en hexadecimal)
+  * @param  destino: buffer de salida
+  * @param  tam: tamaño del buffer
+  * @param  paso: salida, diezmado aplicado (1 serie entera, 0 sin serie)
+  * @retval bytes escritos, o -1 si no cabe ni la media o el codec no tiene codificador
+  */
+int codifica_Ventana(tipoCodec codec, const registroCompacto* media, const registroCompacto* serie, uint16_t n_serie,
+					 uint32_t n_leidas, const char* id, uint8_t* destino, size_t tam, uint8_t* paso)
+{
+	int longitud = -1;
+
+	if ( (codec >= N_CODECS) || (CODECS_VENTANA[codec].codifica == NULL) ) {
+		return -1;
+	}
+	if (serie == NULL) {
+		n_serie = 0;
+	}
+	for (*paso = 1; (n_serie > 0) && (*paso <= PASO_MAX_SERIE); (*paso)++) {
+		longitud = CODECS_VENTANA[codec].codifica(media, serie, n_serie, n_leidas, *paso, id, destino, tam);
+		if (longitud >= 0) {
+			return longitud;
+		}
+	}
+	*paso = 0;
+	return CODECS_VENTANA[codec].codifica(media, NULL, 0, 0, 1, id, destino, tam);
+}
+
+
+/**
+  * @brief  Ventana en JSON compacto, escrito en flujo sobre el destino
+  * @param  media, serie, n_serie, n_leidas, id, destino, tam: como codifica_Ventana()
+  * @param  paso: se envía una de cada paso muestras, empezando por la primera
+  * @retval bytes escritos, sin nulo final, o -1 si no cabe
+  */
+int codifica_VentanaJSON(const registroCompacto* media, const registroCompacto* serie, uint16_t n_serie,
+						 uint32_t n_leidas, uint8_t paso, const char* id, uint8_t* destino, size_t tam)
+{
+	escritorCarga e = {destino, tam, false};
+	uint16_t n_enviadas = (n_serie + paso - 1) / paso;
+	int32_t dt = espaciado_Serie(serie, n_serie, paso);
+	bool valido = false;
+	int32_t v = 0;
+
+	escribe_Texto(&e, "{\"id\":\"");
+	escribe_Texto(&e, id);
+	escribe_Texto(&e, "\",\"t\":");
+	escribe_Entero(&e, media->epoch);
+	escribe_Texto(&e, ",\"m\":{");
+	for (uint8_t c = 0; c < N_CAMPOS; c++) {
+		escribe_Texto(&e, (c == 0) ? "\"" : ",\"");
+		escribe_Texto(&e, CAMPOS[c].clave);
+		escribe_Texto(&e, "\":");
+		v = valor_Campo(media, (campoVentana)c, &valido);
+		if (valido) escribe_Fijo(&e, v, CAMPOS[c].decimales);
+		else escribe_Texto(&e, "null");
+	}
+	escribe_Bytes(&e, "}", 1);
+
+	if (n_serie > 0) {
+		escribe_Texto(&e, ",\"s\":{\"t0\":");
+		escribe_Entero(&e, serie[0].epoch);
+		if (n_enviadas < n_leidas) {
+			escribe_Texto(&e, ",\"n\":");
+			escribe_Entero(&e, n_leidas);
+		}
+		if (dt >= 0) {
+			escribe_Texto(&e, ",\"dt\":");
+			escribe_Entero(&e, dt);
+		}
+		else {
+			escribe_Texto(&e, ",\"t\":[");
+			for (uint16_t i = 0; i < n_serie; i += paso) {
+				if (i > 0) escribe_Bytes(&e, ",", 1);
+				escribe_Entero(&e, (int64_t)serie[i].epoch - (int64_t)serie[0].epoch);
+			}
+			escribe_Bytes(&e, "]", 1);
+		}
+		for (uint8_t c = 0; c < N_COLUMNAS_SERIE; c++) {
+			escribe_Texto(&e, ",\"");
+			escribe_Texto(&e, COLUMNAS_SERIE[c].clave);
+			escribe_Texto(&e, "\":[");
+			for (uint16_t i = 0; i < n_serie; i += paso) {
+				if (i > 0) escribe_Bytes(&e, ",", 1);
+				v = valor_Serie(media, &serie[i], COLUMNAS_SERIE[c].campo, &valido);
+				if (valido) escribe_Fijo(&e, v, COLUMNAS_SERIE[c].decimales);
+				else escribe_Texto(&e, "null");
+			}
+			escribe_Bytes(&e, "]", 1);
+		}
+		escribe_Bytes(&e, "}", 1);
+	}
+	escribe_Bytes(&e, "}", 1);
+
+	return e.desborde ? -1 : (int)(tam - e.libre);
+}
+
+
+/**
+  * @brief  Ventana en CBOR, con los enteros escalados del registro compacto
+  * @param  media, serie, n_serie, n_leidas, paso, id, destino, tam: como codifica_VentanaJSON()
+  * @retval bytes escritos, o -1 si no cabe
+  */
+int codifica_VentanaCBOR(const registroCompacto* media, const registroCompacto* serie, uint16_t n_serie,
+						 uint32_t n_leidas, uint8_t paso, const char* id, uint8_t* destino, size_t tam)
+{
+	escritorCarga e = {destino, tam, false};
+	uint16_t n_enviadas = (n_serie + paso - 1) / paso;
+	int32_t dt = espaciado_Serie(serie, n_serie, paso);
+	bool valido = false;
+	int32_t v = 0;
+
+	cbor_Cabecera(&e, 5, (n_serie > 0) ? 4 : 3);		//mapa
+	cbor_Texto(&e, "id");
+	cbor_Texto(&e, id);
+	cbor_Texto(&e, "t");
+	cbor_Entero(&e, media->epoch);
+	cbor_Texto(&e, "m");
+	cbor_Cabecera(&e, 5, N_CAMPOS);
+	for (uint8_t c = 0; c < N_CAMPOS; c++) {
+		cbor_Texto(&e, CAMPOS[c].clave);
+		v = valor_Campo(media, (campoVentana)c, &valido);
+		if (valido) cbor_Entero(&e, v);
+		else escribe_Bytes(&e, "\xF6", 1);		//null
+	}
+
+	if (n_serie > 0) {
+		cbor_Texto(&e, "s");
+		cbor_Cabecera(&e, 5, ((n_enviadas < n_leidas) ? 3 : 2) + N_COLUMNAS_SERIE);
+		cbor_Texto(&e, "t0");
+		cbor_Entero(&e, serie[0].epoch);
+		if (n_enviadas < n_leidas) {
+			cbor_Texto(&e, "n");
+			cbor_Entero(&e, n_leidas);
+		}
+		if (dt >= 0) {
+			cbor_Texto(&e, "dt");
+			cbor_Entero(&e, dt);
+		}
+		else {
+			cbor_Texto(&e, "t");
+			cbor_Cabecera(&e, 4, n_enviadas);		//vector
+			for (uint16_t i = 0; i < n_serie; i += paso) {
+				cbor_Entero(&e, (int64_t)serie[i].epoch - (int64_t)serie[0].epoch);
+			}
+		}
+		for (uint8_t c = 0; c < N_COLUMNAS_SERIE; c++) {
+			cbor_Texto(&e, COLUMNAS_SERIE[c].clave);
+			cbor_Cabecera(&e, 4, n_enviadas);
+			for (uint16_t i = 0; i < n_serie; i += paso) {
+				v = valor_Serie(media, &serie[i], COLUMNAS_SERIE[c].campo, &valido);
+				if (valido) cbor_Entero(&e, v);
+				else escribe_Bytes(&e, "\xF6", 1);
+			}
+		}
+	}
+
+	return e.desborde ? -1 : (int)(tam - e.libre);
+}
+
+
+/**
+  * @brief  Codec por su nombre en config.json
+  * @param  nombre: "thingspeak", "json" o "cbor"
+  * @retval tipoCodec, o -1 si no existe
+  */
+int busca_Codec(const char* nombre)
+{
+	for (int i = 0; i < N_CODECS; i++) {
+		if (strcmp(nombre, CODECS_VENTANA[i].nombre) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+/* Entero escalado de una magnitud del registro; las que dependen de un bit de validez sin él no son validas */
+static int32_t valor_Campo(const registroCompacto* reg, campoVentana campo, bool* valido)
+{
+	*valido = true;
+	switch (campo) {
+	case CAMPO_G1: case CAMPO_G2: case CAMPO_G3: case CAMPO_G4: case CAMPO_G5:
+		return reg->irradiancia[campo - CAMPO_G1];
+	case CAMPO_T:	return reg->temperatura;
+	case CAMPO_P:	return reg->presion;
+	case CAMPO_H:	return reg->humedad * 5;		//ESCALA_HUMEDAD 2: en décimas de %HR
+	case CAMPO_ROL:	return reg->alabeo;
+	case CAMPO_CAB:	return reg->cabeceo;
+	case CAMPO_GUI:	return reg->guinada;
+	case CAMPO_DR:	return reg->dispersion_rumbo;
+	case CAMPO_LAT:	*valido = (reg->validez & REG_POSICION) != 0;	return reg->latitud;
+	case CAMPO_LON:	*valido = (reg->validez & REG_POSICION) != 0;	return reg->longitud;
+	case CAMPO_ALT:	*valido = (reg->validez & REG_ALTITUD) != 0;	return reg->altitud;
+	case CAMPO_VEL:	*valido = (reg->validez & REG_VELOCIDAD) != 0;	return reg->velocidad;
+	default:		*valido = false;	return 0;
+	}
+}
+
+/* Como valor_Campo() para una muestra de la serie: las coordenadas, como diferencia con las de la media */
+static int32_t valor_Serie(const registroCompacto* media, const registroCompacto* reg, campoVentana campo, bool* valido)
+{
+	int32_t v = valor_Campo(reg, campo, valido);
+
+	if ( (campo == CAMPO_LAT) || (campo == CAMPO_LON) ) {
+		int32_t base = valor_Campo(media, campo, valido);		//valido queda a false si la media no tiene posición
+		*valido = *valido && ((reg->validez & REG_POSICION) != 0);
+		v = (int32_t)((int64_t)v - base);		//en una ventana, unos metros
+	}
+	return v;
+}
+
+/* Segundos entre las muestras enviadas si son equiespaciadas (0 con una sola), -1 si no */
+static int32_t espaciado_Serie(const registroCompacto* serie, uint16_t n_serie, uint8_t paso)
+{
+	int32_t dt = 0;
+
+	if (n_serie > paso) {
+		dt = (int32_t)(serie[paso].epoch - serie[0].epoch);
+	}
+	for (uint16_t i = paso; i < n_serie; i += paso) {
+		if ((int32_t)(serie[i].epoch - serie[i - paso].epoch) != dt) {
+			return -1;
+		}
+	}
+	return dt;
+}
+
+/* Copia al destino; si no cabe lo marca y deja de escribir */
+static void escribe_Bytes(escritorCarga* e, const void* datos, size_t n)
+{
+	if (e->desborde || (n > e->libre)) {
+		e->desborde = true;
+		return;
+	}
+	memcpy(e->p, datos, n);
+	e->p += n;
+	e->libre -= n;
+}
+
+static void escribe_Texto(escritorCarga* e, const char* texto)
+{
+	escribe_Bytes(e, texto, strlen(texto));
+}
+
+/* Entero en decimal, sin printf */
+static void escribe_Entero(escritorCarga* e, int64_t valor)
+{
+	char cifras[21];
+	uint8_t n = sizeof(cifras);
+	uint64_t u = (valor < 0) ? (uint64_t)(-valor) : (uint64_t)valor;
+
+	do {
+		cifras[--n] = (char)('0' + (u % 10U));
+		u /= 10U;
+	} while (u > 0);
+	if (valor < 0) {
+		cifras[--n] = '-';
+	}
+	escribe_Bytes(e, &cifras[n], sizeof(cifras) - n);
+}
+
+/* Entero escalado como decimal con sus cifras fijas: 8124 con 1 decimal es 812.4, -5 con 2 es -0.05 */
+static void escribe_Fijo(escritorCarga* e, int32_t valor, uint8_t decimales)
+{
+	char cifras[16];
+	uint8_t n = sizeof(cifras);
+	uint32_t u = (valor < 0) ? (uint32_t)(-(int64_t)valor) : (uint32_t)valor;
+
+	for (uint8_t i = 0; i < decimales; i++) {
+		cifras[--n] = (char)('0' + (u % 10U));
+		u /= 10U;
+	}
+	if (decimales > 0) {
+		cifras[--n] = '.';
+	}
+	do {
+		cifras[--n] = (char)('0' + (u % 10U));
+		u /= 10U;
+	} while (u > 0);
+	if (valor < 0) {
+		cifras[--n] = '-';
+	}
+	escribe_Bytes(e, &cifras[n], sizeof(cifras) - n);
+}
+
+/* Cabecera CBOR con el argumento en la forma más corta */
+static void cbor_Cabecera(escritorCarga* e, uint8_t tipo, uint64_t valor)
+{
+	uint8_t b[9];
+	uint8_t n = 0;
+
+	tipo = (uint8_t)(tipo << 5);
+	if (valor < 24U) {
+		b[n++] = tipo | (uint8_t)valor;
+	}
+	else if (valor <= 0xFFU) {
+		b[n++] = tipo | 24U;
+		b[n++] = (uint8_t)valor;
+	}
+	else if (valor <= 0xFFFFU) {
+		b[n++] = tipo | 25U;
+		b[n++] = (uint8_t)(valor >> 8);
+		b[n++] = (uint8_t)valor;
+	}
+	else if (valor <= 0xFFFFFFFFU) {
+		b[n++] = tipo | 26U;
+		for (int8_t i = 3; i >= 0; i--) b[n++] = (uint8_t)(valor >> (8 * i));
+	}
+	else {
+		b[n++] = tipo | 27U;
+		for (int8_t i = 7; i >= 0; i--) b[n++] = (uint8_t)(valor >> (8 * i));
+	}
+	escribe_Bytes(e, b, n);
+}
+
+/* Tipo 0 para positivos, tipo 1 con -1 - valor para negativos */
+static void cbor_Entero(escritorCarga* e, int64_t valor)
+{
+	if (valor >= 0) cbor_Cabecera(e, 0, (uint64_t)valor);
+	else cbor_Cabecera(e, 1, (uint64_t)(-1 - valor));
+}
+
+static void cbor_Texto(escritorCarga* e, const char* texto)
+{
+	size_t n = strlen(texto);
+
+	cbor_Cabecera(e, 3, n);
+	escribe_Bytes(e, texto, n);
+}
+
+#endif  /* INC_CODEC_VENTANA_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
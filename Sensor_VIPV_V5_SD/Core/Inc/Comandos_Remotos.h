@@ -0,0 +1,368 @@
+/******************************************************************************
+* @file    Comandos_Remotos.h
+* @author  Sergio Vera Muñoz
+* @brief   Canal de comandos remotos por una suscripción MQTT. Cada mensaje del topic
+* de comandos es una línea de texto firmada con HMAC-SHA256 y una clave compartida:
+*
+*   <firma> <sello> <verbo> [argumentos]
+*
+*  - firma: HMAC-SHA256 de "<sello> <verbo> [argumentos]", 64 caracteres hexadecimales.
+*  - sello: milisegundos UTC desde 1970. Ha de estar a menos de COMANDO_DESFASE_S del RTC
+*    y ser mayor que el del último comando aceptado, de modo que un comando capturado no
+*    se puede repetir. El canal arranca sin sello: el llamante le da con fija_SelloMinimo()
+*    el último aceptado antes del reinicio y la hora de la red al fijarla, para que tampoco
+*    se pueda repetir tras el reinicio que provoca un reinicia.
+*  - verbos: get, set {json}, guarda, rafaga <n> <periodo_ms>, log <t0> <t1>,
+*    actualiza <url> <sha256> y reinicia. Los ejecuta el llamante (AppIoT_TFG_VIPV.c).
+*
+* La recepción, que Paho llama desde MQTTYield() en medio del sondeo del socket, solo copia
+* el mensaje en un buzón de COMANDOS_BUZON huecos, con coste acotado por COMANDO_TAM_MAX. La
+* firma se comprueba, y el comando se ejecuta, despues, desde el punto seguro del bucle
+* principal. El HMAC usa el SHA-256 de mbedTLS sin reservas de heap.
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_COMANDOS_REMOTOS_H_
+#define INC_COMANDOS_REMOTOS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mbedtls/sha256.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define COMANDO_TAM_MAX          384		// Firma, sello, verbo y argumentos: un set con varias claves
+#define COMANDOS_BUZON           2			// Comandos recibidos a la espera del punto seguro del bucle
+#define COMANDO_CLAVE_MAX        32			// Clave del HMAC, en bytes
+#define COMANDO_CLAVE_MIN        16
+#define COMANDO_FIRMA_HEX        64			// HMAC-SHA256 en hexadecimal
+#define COMANDO_DESFASE_S        300U		// Diferencia máxima entre el sello y el RTC, en segundos
+#define COMANDO_SELLO_TEXTO      21			// uint64_t en decimal con el nulo
+#define HMAC_BLOQUE              64			// Bloque de SHA-256
+
+
+/*--------Verbos, resultado y estado del canal------------------------*/
+typedef enum {VERBO_GET=0, VERBO_SET, VERBO_GUARDA, VERBO_RAFAGA, VERBO_LOG, VERBO_ACTUALIZA, VERBO_REINICIA, N_VERBOS} verboComando;
+
+typedef enum {
+	COMANDO_NINGUNO = 0,	// Buzón vacío
+	COMANDO_VALIDO,			// Firma, sello y verbo correctos: se ejecuta
+	COMANDO_RECHAZADO		// Se responde con el motivo y se descarta
+}resultadoComando;
+
+typedef struct
+{
+	char texto[COMANDO_TAM_MAX + 1];
+	uint16_t longitud;
+
+}mensajeComando;
+
+typedef struct
+{
+	uint32_t recibidos;
+	uint32_t descartados;			// Buzón lleno o mensaje mayor que COMANDO_TAM_MAX, sin mirar la firma
+	uint32_t rechazados;			// Formato, firma, sello o verbo incorrectos
+	uint32_t aceptados;
+
+}estadisticaComandos;
+
+typedef struct
+{
+	uint8_t clave[COMANDO_CLAVE_MAX];
+	uint8_t tam_clave;				// 0: canal deshabilitado
+	mensajeComando buzon[COMANDOS_BUZON];
+	uint8_t cabeza;
+	uint8_t n_buzon;
+	mensajeComando en_curso;		// Copia del comando extraido: el buzón sigue recibiendo mientras se ejecuta
+	uint64_t ultimo_sello;
+	estadisticaComandos estadistica;
+
+}canalComandos;
+
+typedef struct
+{
+	verboComando verbo;
+	uint64_t sello;					// 0 si no se ha podido leer
+	const char* argumentos;			// En canal->en_curso, hasta el siguiente extrae_Comando()
+	const char* motivo;				// Con COMANDO_RECHAZADO
+	bool firmado;					// Firma correcta: el rechazo se puede responder sin dar eco a mensajes ajenos
+
+}comandoRemoto;
+
+
+/* ------------------------------------------------- Variables ---------------------------------------------------------*/
+static const char* const VERBOS_COMANDO[N_VERBOS] = {"get", "set", "guarda", "rafaga", "log", "actualiza", "reinicia"};
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+bool inicia_Comandos(canalComandos* canal, const char* clave_hex);
+void fija_SelloMinimo(canalComandos* canal, uint64_t sello);
+bool recibe_Comando(canalComandos* canal, const void* carga, size_t longitud);
+resultadoComando extrae_Comando(canalComandos* canal, uint32_t epoch_ahora, comandoRemoto* cmd);
+int  cabecera_Respuesta(char* texto, size_t tam, uint64_t sello, const char* verbo);
+void firma_HMAC(const uint8_t* clave, size_t tam_clave, const uint8_t* datos, size_t longitud, uint8_t firma[32]);
+
+static int  lee_Hexadecimal(const char* hex, size_t n_caracteres, uint8_t* destino);
+static bool compara_Firma(const uint8_t* a, const uint8_t* b, size_t n);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Deja el canal con el buzón vacío y la clave del HMAC. Sin una clave válida el canal queda deshabilitado
+  * y recibe_Comando() descarta todo.
+  * @param  canal: canal de comandos
+  * @param  clave_hex: clave compartida en hexadecimal, de COMANDO_CLAVE_MIN a COMANDO_CLAVE_MAX bytes
+  * @retval true si la clave es válida
+  */
+bool inicia_Comandos(canalComandos* canal, const char* clave_hex)
+{
+	size_t n = (clave_hex != NULL) ? strlen(clave_hex) : 0;
+
+	memset(canal, 0, sizeof(*canal));
+	if ( (n % 2 != 0) || (n < 2 * COMANDO_CLAVE_MIN) || (n > 2 * COMANDO_CLAVE_MAX)
+		 || (lee_Hexadecimal(clave_hex, n, canal->clave) != (int)(n / 2)) ) {
+		memset(canal->clave, 0, sizeof(canal->clave));
+		return false;
+	}
+	canal->tam_clave = (uint8_t)(n / 2);
+	return true;
+}
+
+
+/**
+  * @brief  Sube el último sello aceptado a sello, si es mayor: desde entonces solo valen los comandos posteriores.
+  * @param  canal: canal de comandos
+  * @param  sello: milisegundos UTC desde 1970
+  * @retval None
+  */
+void fija_SelloMinimo(canalComandos* canal, uint64_t sello)
+{
+	if (sello > canal->ultimo_sello) {
+		canal->ultimo_sello = sello;
+	}
+}
+
+
+/**
+  * @brief  Deja un mensaje del topic de comandos en el buzón, sin interpretarlo. Pensada para el manejador de
+  * Paho: solo copia, como mucho COMANDO_TAM_MAX bytes, y nunca espera.
+  * @param  canal: canal de comandos
+  * @param  carga: payload del PUBLISH
+  * @param  longitud: bytes del payload
+  * @retval false si se descarta: canal deshabilitado, buzón lleno o mensaje demasiado largo
+  */
+bool recibe_Comando(canalComandos* canal, const void* carga, size_t longitud)
+{
+	mensajeComando* hueco = NULL;
+
+	if (canal->tam_clave == 0) {
+		return false;
+	}
+	canal->estadistica.recibidos++;
+	if ( (longitud > COMANDO_TAM_MAX) || (canal->n_buzon >= COMANDOS_BUZON) ) {
+		canal->estadistica.descartados++;
+		return false;
+	}
+
+	hueco = &canal->buzon[(canal->cabeza + canal->n_buzon) % COMANDOS_BUZON];
+	memcpy(hueco->texto, carga, longitud);
+	hueco->texto[longitud] = '\0';
+	hueco->longitud = (uint16_t)longitud;
+	canal->n_buzon++;
+	return true;
+}
+
+
+/**
+  * @brief  Saca el comando más antiguo del buzón y lo valida: formato, firma, sello dentro de plazo y posterior al
+  * último aceptado, y verbo conocido. Un comando bien firmado con un verbo desconocido también consume su sello.
+  * @param  canal: canal de comandos
+  * @param  epoch_ahora: hora del RTC en segundos UTC; 0 si aun no se ha fijado, y entonces se rechaza todo
+  * @param  cmd: comando leido; con COMANDO_RECHAZADO solo el sello, si se ha podido leer, y el motivo
+  * @retval COMANDO_NINGUNO, COMANDO_VALIDO o COMANDO_RECHAZADO
+  */
+resultadoComando extrae_Comando(canalComandos* canal, uint32_t epoch_ahora, comandoRemoto* cmd)
+{
+	char* texto = canal->en_curso.texto;
+	char* firmado = NULL;
+	char* fin = NULL;
+	uint8_t firma[32], calculada[32];
+	size_t n_verbo = 0;
+	uint64_t segundos = 0;
+
+	if (canal->n_buzon == 0) {
+		return COMANDO_NINGUNO;
+	}
+	canal->en_curso = canal->buzon[canal->cabeza];
+	canal->cabeza = (canal->cabeza + 1) % COMANDOS_BUZON;
+	canal->n_buzon--;
+
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->argumentos = "";
+	cmd->motivo = "formato";
+	canal->estadistica.rechazados++;	//se deshace al final si es valido
+
+	if ( (canal->en_curso.longitud < COMANDO_FIRMA_HEX + 2) || (texto[COMANDO_FIRMA_HEX] != ' ')
+		 || (lee_Hexadecimal(texto, COMANDO_FIRMA_HEX, firma) != (int)sizeof(firma)) ) {
+		return COMANDO_RECHAZADO;
+	}
+	firmado = &texto[COMANDO_FIRMA_HEX + 1];
+	cmd->sello = strtoull(firmado, &fin, 10);
+	if ( (fin == firmado) || (*fin != ' ') ) {
+		cmd->sello = 0;
+		return COMANDO_RECHAZADO;
+	}
+
+	firma_HMAC(canal->clave, canal->tam_clave, (const uint8_t*)firmado, strlen(firmado), calculada);
+	if ( !compara_Firma(firma, calculada, sizeof(firma)) ) {
+		cmd->motivo = "firma";
+		return COMANDO_RECHAZADO;
+	}
+	cmd->firmado = true;
+
+	segundos = cmd->sello / 1000U;
+	if (epoch_ahora == 0) {
+		cmd->motivo = "sin hora";
+		return COMANDO_RECHAZADO;
+	}
+	if ( (segundos + COMANDO_DESFASE_S < epoch_ahora) || (segundos > (uint64_t)epoch_ahora + COMANDO_DESFASE_S) ) {
+		cmd->motivo = "sello fuera de plazo";
+		return COMANDO_RECHAZADO;
+	}
+	if (cmd->sello <= canal->ultimo_sello) {
+		cmd->motivo = "sello repetido";
+		return COMANDO_RECHAZADO;
+	}
+	canal->ultimo_sello = cmd->sello;
+
+	while (*fin == ' ') fin++;
+	n_verbo = strcspn(fin, " ");
+	cmd->motivo = "verbo";
+	for (uint8_t v = 0; v < N_VERBOS; v++) {
+		if ( (strlen(VERBOS_COMANDO[v]) == n_verbo) && (strncmp(fin, VERBOS_COMANDO[v], n_verbo) == 0) ) {
+			cmd->verbo = (verboComando)v;
+			cmd->motivo = NULL;
+			break;
+		}
+	}
+	if (cmd->motivo != NULL) {
+		return COMANDO_RECHAZADO;
+	}
+
+	fin += n_verbo;
+	while (*fin == ' ') fin++;
+	cmd->argumentos = fin;
+	canal->estadistica.rechazados--;
+	canal->estadistica.aceptados++;
+	return COMANDO_VALIDO;
+}
+
+
+/**
+  * @brief  Primera línea de una respuesta, "<sello> <verbo> ", que relaciona la respuesta con su comando. El sello
+  * se escribe a mano: printf de newlib-nano no admite %llu.
+  * @param  texto: destino
+  * @param  tam: tamaño del destino
+  * @param  sello: sello del comando, 0 si no se pudo leer
+  * @param  verbo: verbo del comando, o "?" si no se pudo leer
+  * @retval caracteres escritos, como snprintf
+  */
+int cabecera_Respuesta(char* texto, size_t tam, uint64_t sello, const char* verbo)
+{
+	char cifras[COMANDO_SELLO_TEXTO];
+	uint8_t n = sizeof(cifras) - 1;
+
+	cifras[n] = '\0';
+	do {
+		cifras[--n] = (char)('0' + (sello % 10U));
+		sello /= 10U;
+	} while (sello > 0);
+
+	return snprintf(texto, tam, "%s %s ", &cifras[n], verbo);
+}
+
+
+/**
+  * @brief  HMAC-SHA256 (RFC 2104) con el SHA-256 de mbedTLS, sin reservas de heap: mbedtls_md_hmac() reserva su
+  * contexto con calloc en cada llamada. Claves de hasta HMAC_BLOQUE bytes.
+  * @param  clave: clave
+  * @param  tam_clave: bytes de la clave, como mucho HMAC_BLOQUE
+  * @param  datos: mensaje
+  * @param  longitud: bytes del mensaje
+  * @param  firma: HMAC resultante
+  * @retval None
+  */
+void firma_HMAC(const uint8_t* clave, size_t tam_clave, const uint8_t* datos, size_t longitud, uint8_t firma[32])
+{
+	mbedtls_sha256_context sha;
+	uint8_t relleno[HMAC_BLOQUE];
+
+	for (uint8_t i = 0; i < HMAC_BLOQUE; i++) {
+		relleno[i] = ((i < tam_clave) ? clave[i] : 0) ^ 0x36;	//ipad
+	}
+	mbedtls_sha256_init(&sha);
+	mbedtls_sha256_starts(&sha, 0);
+	mbedtls_sha256_update(&sha, relleno, HMAC_BLOQUE);
+	mbedtls_sha256_update(&sha, datos, longitud);
+	mbedtls_sha256_finish(&sha, firma);
+
+	for (uint8_t i = 0; i < HMAC_BLOQUE; i++) {
+		relleno[i] ^= 0x36 ^ 0x5C;	//opad
+	}
+	mbedtls_sha256_starts(&sha, 0);
+	mbedtls_sha256_update(&sha, relleno, HMAC_BLOQUE);
+	mbedtls_sha256_update(&sha, firma, 32);
+	mbedtls_sha256_finish(&sha, firma);
+	mbedtls_sha256_free(&sha);
+	memset(relleno, 0, sizeof(relleno));
+}
+
+
+/* Lee n_caracteres hexadecimales (mayusculas o minusculas) en n_caracteres/2 bytes; devuelve los bytes leidos o -1 */
+static int lee_Hexadecimal(const char* hex, size_t n_caracteres, uint8_t* destino)
+{
+	for (size_t i = 0; i < n_caracteres; i++) {
+		char c = hex[i];
+		uint8_t nibble = 0;
+
+		if ( (c >= '0') && (c <= '9') )      nibble = (uint8_t)(c - '0');
+		else if ( (c >= 'a') && (c <= 'f') ) nibble = (uint8_t)(c - 'a' + 10);
+		else if ( (c >= 'A') && (c <= 'F') ) nibble = (uint8_t)(c - 'A' + 10);
+		else return -1;
+
+		if (i % 2 == 0) destino[i / 2] = (uint8_t)(nibble << 4);
+		else            destino[i / 2] |= nibble;
+	}
+	return (int)(n_caracteres / 2);
+}
+
+/* Comparación en tiempo constante, para no dar pistas de la firma por el tiempo de respuesta */
+static bool compara_Firma(const uint8_t* a, const uint8_t* b, size_t n)
+{
+	uint8_t diferencia = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		diferencia |= a[i] ^ b[i];
+	}
+	return (diferencia == 0);
+}
+
+#endif  /* INC_COMANDOS_REMOTOS_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
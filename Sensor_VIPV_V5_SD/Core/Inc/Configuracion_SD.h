@@ -0,0 +1,528 @@
+/******************************************************************************
+* @file    Configuracion_SD.h
+* @author  Sergio Vera Muñoz
+* @brief   Configuración del sensor en tiempo de ejecución, leida al arrancar del
+* fichero config.json de la tarjeta SD. Los #define de AppIoT_TFG_VIPV.h quedan como
+* valores por defecto: cada clave presente en el fichero se valida contra sus limites
+* y, si es correcta, sustituye al valor por defecto; si no, se avisa y se mantiene éste.
+* El árbol de cJSON se construye en un arena estático que se descarta entero al terminar,
+* sin dejar huecos en el heap. El comando remoto "guarda" escribe la configuración
+* efectiva en el mismo fichero con guarda_ConfiguracionSD().
+*
+* Ejemplo de config.json (todas las claves son opcionales):
+*   { "periodo_publi_s": 60, "periodo_lectura_s": 5, "t_medicion_ms": 3, "t_espera_ms": 5,
+*     "frec_fusion_hz": 50, "habilita_sd": true, "habilita_nube": false, "imprime_muestras": true,
+*     "periodo_perfil_s": 600, "publica_perfil": false, "periodo_memoria_s": 600, "publica_memoria": false,
+*     "enlace_mqttsn": false, "confirma_mqttsn": true, "codec_nube": "json", "topic_nube": "vipv/%s/ventana",
+*     "qos1_mqtt": true, "comandos_remotos": true,
+*     "cte_calibr_fv": [3.81, 3.80, 3.70, 3.80, 3.67] }
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_CONFIGURACION_SD_H_
+#define INC_CONFIGURACION_SD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "fatfs.h"
+#include "cJSON.h"
+#include "Codec_Ventana.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define CONFIG_FICHERO         "config.json"
+#define CONFIG_FICHERO_TMP     "config.tmp"	// Se escribe entero antes de sustituir a CONFIG_FICHERO
+#define CONFIG_TAM_MAX         1024		// Tamaño máximo del fichero, en bytes
+#define CONFIG_ARENA_SIZE      4096		// Memoria para el árbol de cJSON de un fichero de CONFIG_TAM_MAX
+#define CONFIG_TEXTO_SIZE      608		// Configuración efectiva en una línea de texto JSON
+#define TOPIC_NUBE_SIZE        64		// Con la MAC sustituida ha de caber en MQTT_TOPIC_BUFFER_SIZE
+
+#define N_MAX_ELEMENTOS        24		// Muestras por ventana en los campos concatenados de 255 caracteres de
+										// megaDatoConcat; una serie más larga se diezma (calcula_concatenar())
+
+
+/*--------Configuración efectiva del sensor------------------------*/
+typedef struct
+{
+	uint16_t periodo_publi_s;			// PERIODO_PUBLI_DATOS, multiplo de PERIODO_MIN_LPTIM2
+	uint16_t periodo_lectura_s;			// PERIODO_LECTURA_DATOS, divisor del periodo de publicación
+	uint16_t t_medicion_ms;				// T_MEDICION
+	uint16_t t_espera_ms;				// T_ESPERA
+	float frec_fusion_hz;				// ALGORITHM_FREQ, frecuencia nominal del TIM6 en movimiento
+	bool habilita_sd;					// HABILITA_SD
+	bool habilita_nube;					// HABILITA_NUBE
+	bool imprime_muestras;				// ENABLE_IMPRIMIR_MUESTRAS
+	bool telemetria_binaria;			// ENABLE_TELEMETRIA_BINARIA
+	uint16_t periodo_perfil_s;			// PERIODO_PERFIL_S, informe del perfilador DWT; 0 solo a petición
+	bool publica_perfil;				// ENABLE_PUBLICA_PERFIL, resumen del perfil en el status de ThingSpeak
+	uint16_t periodo_memoria_s;			// PERIODO_MEMORIA_S, informe del monitor de memoria; 0 sin informe
+	bool publica_memoria;				// ENABLE_PUBLICA_MEMORIA, resumen de memoria en el status de ThingSpeak
+	bool enlace_mqttsn;					// ENABLE_ENLACE_MQTTSN, medias por MQTT-SN/UDP a la pasarela en vez de MQTT/TLS a ThingSpeak
+	bool confirma_mqttsn;				// ENABLE_CONFIRMA_MQTTSN, QoS 1 en el enlace MQTT-SN; QoS -1 si es false
+	uint8_t codec_nube;					// CODEC_NUBE, tipoCodec de Codec_Ventana.h
+	char topic_nube[TOPIC_NUBE_SIZE];	// TOPIC_NUBE, topic de los codecs JSON y CBOR; un %s opcional es la MAC
+	bool qos1_mqtt;						// ENABLE_QOS1_MQTT, publicaciones QoS 1 confirmadas por PUBACK; QoS 0 si es false
+	bool comandos_remotos;				// ENABLE_COMANDOS_REMOTOS, suscripción al topic de comandos firmados
+	float cte_calibr_fv[NMAX_MODULOS];	// CTE_CALIBR_FV
+
+}configSensor;
+
+
+/* ------------------------------------------------- Variables ---------------------------------------------------------*/
+extern const float CTE_CALIBR_FV[NMAX_MODULOS];	// Calibración por defecto, en AppIoT_TFG_VIPV.h
+
+static uint8_t config_arena[CONFIG_ARENA_SIZE] __attribute__((aligned(8)));
+static size_t config_arena_usado = 0;
+static size_t config_arena_max = 0;		// Ocupación máxima, para dimensionar CONFIG_ARENA_SIZE
+static char config_texto[CONFIG_TAM_MAX + 1];
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+void config_PorDefecto(configSensor* cfg);
+int  carga_ConfiguracionSD(configSensor* cfg, FATFS* fs);
+int  parsea_Configuracion(configSensor* cfg, const char* texto);
+int  imprime_Configuracion(const configSensor* cfg, char* texto, size_t tam);
+bool guarda_ConfiguracionSD(const configSensor* cfg, FATFS* fs);
+uint16_t elementos_Ventana(const configSensor* cfg);
+bool cuenta_Disparo(uint16_t* contador, uint16_t periodo_s, uint16_t periodo_min_s);
+
+static void* reserva_ArenaConfig(size_t tam);
+static void libera_ArenaConfig(void* p);
+static int lee_EnteroConfig(cJSON* raiz, const char* clave, int min, int max, uint16_t* destino);
+static int lee_RealConfig(cJSON* raiz, const char* clave, float min, float max, float* destino);
+static int lee_BoolConfig(cJSON* raiz, const char* clave, bool* destino);
+static int lee_CodecConfig(cJSON* raiz, const char* clave, uint8_t* destino);
+static int lee_TopicConfig(cJSON* raiz, const char* clave, char* destino, size_t tam);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Rellena la configuración con los #define de compilación
+  * @param  cfg: configuración a rellenar
+  * @retval None
+  */
+void config_PorDefecto(configSensor* cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->periodo_publi_s = PERIODO_PUBLI_DATOS;
+	cfg->periodo_lectura_s = PERIODO_LECTURA_DATOS;
+	cfg->t_medicion_ms = T_MEDICION;
+	cfg->t_espera_ms = T_ESPERA;
+	cfg->frec_fusion_hz = ALGORITHM_FREQ;
+	cfg->habilita_sd = HABILITA_SD;
+	cfg->habilita_nube = HABILITA_NUBE;
+#ifdef ENABLE_IMPRIMIR_MUESTRAS
+	cfg->imprime_muestras = true;
+#else
+	cfg->imprime_muestras = false;
+#endif
+#ifdef ENABLE_TELEMETRIA_BINARIA
+	cfg->telemetria_binaria = true;
+#else
+	cfg->telemetria_binaria = false;
+#endif
+	cfg->periodo_perfil_s = PERIODO_PERFIL_S;
+#ifdef ENABLE_PUBLICA_PERFIL
+	cfg->publica_perfil = true;
+#else
+	cfg->publica_perfil = false;
+#endif
+	cfg->periodo_memoria_s = PERIODO_MEMORIA_S;
+#ifdef ENABLE_PUBLICA_MEMORIA
+	cfg->publica_memoria = true;
+#else
+	cfg->publica_memoria = false;
+#endif
+#ifdef ENABLE_ENLACE_MQTTSN
+	cfg->enlace_mqttsn = true;
+#else
+	cfg->enlace_mqttsn = false;
+#endif
+#ifdef ENABLE_CONFIRMA_MQTTSN
+	cfg->confirma_mqttsn = true;
+#else
+	cfg->confirma_mqttsn = false;
+#endif
+	cfg->codec_nube = CODEC_NUBE;
+	snprintf(cfg->topic_nube, sizeof(cfg->topic_nube), "%s", TOPIC_NUBE);
+#ifdef ENABLE_QOS1_MQTT
+	cfg->qos1_mqtt = true;
+#else
+	cfg->qos1_mqtt = false;
+#endif
+#ifdef ENABLE_COMANDOS_REMOTOS
+	cfg->comandos_remotos = true;
+#else
+	cfg->comandos_remotos = false;
+#endif
+	memcpy(cfg->cte_calibr_fv, CTE_CALIBR_FV, sizeof(cfg->cte_calibr_fv));
+}
+
+
+/**
+  * @brief  Lee config.json de la SD y lo aplica sobre la configuración. Sin tarjeta o sin fichero se queda la
+  * configuración por defecto. Monta y desmonta la SD.
+  * @param  cfg: configuración, con los valores por defecto ya cargados
+  * @param  fs: objeto FatFs de la aplicación
+  * @retval claves válidas, o -1 si no hay fichero valido
+  */
+int carga_ConfiguracionSD(configSensor* cfg, FATFS* fs)
+{
+	FIL fichero;
+	FRESULT res;
+	UINT leidos = 0;
+
+	res = f_mount(fs, "", 1);
+	if (res != FR_OK) {
+		printf("Configuracion: SD no disponible (%i), se usan los valores por defecto.\n", res);
+		return -1;
+	}
+
+	res = f_open(&fichero, CONFIG_FICHERO, FA_READ);
+	if (res == FR_NO_FILE) {
+		res = f_open(&fichero, CONFIG_FICHERO_TMP, FA_READ);	//corte entre el borrado y el renombrado de guarda_ConfiguracionSD()
+	}
+	if (res != FR_OK) {
+		printf("Configuracion: sin %s (%i), se usan los valores por defecto.\n", CONFIG_FICHERO, res);
+		f_mount(NULL, "", 0);
+		return -1;
+	}
+
+	if (f_size(&fichero) > CONFIG_TAM_MAX) {
+		printf("Configuracion: %s supera %d bytes, se ignora.\n", CONFIG_FICHERO, CONFIG_TAM_MAX);
+		res = FR_INVALID_PARAMETER;
+	}
+	else {
+		res = f_read(&fichero, config_texto, CONFIG_TAM_MAX, &leidos);
+	}
+
+	f_close(&fichero);
+	f_mount(NULL, "", 0);
+
+	if (res != FR_OK) {
+		return -1;
+	}
+	config_texto[leidos] = '\0';
+
+	return parsea_Configuracion(cfg, config_texto);
+}
+
+
+/**
+  * @brief  Valida y aplica un texto JSON sobre la configuración. Cada clave se comprueba por separado; el periodo de
+  * lectura y el de publicación se comprueban además juntos y, si no encajan, se mantienen los dos anteriores.
+  * cJSON reserva sus nodos en config_arena, que se vacía entero al terminar.
+  * @param  cfg: configuración a modificar
+  * @param  texto: contenido de config.json terminado en nulo
+  * @retval claves válidas, o -1 si el JSON no es válido
+  */
+int parsea_Configuracion(configSensor* cfg, const char* texto)
+{
+	cJSON_Hooks arena = { reserva_ArenaConfig, libera_ArenaConfig };
+	cJSON *raiz = NULL, *vector = NULL;
+	configSensor nueva = *cfg;
+	int aplicadas = 0;
+
+	config_arena_usado = 0;
+	cJSON_InitHooks(&arena);
+
+	raiz = cJSON_Parse(texto);
+	if ( (raiz == NULL) || !cJSON_IsObject(raiz) ) {
+		printf("Configuracion: %s no es un objeto JSON valido, se ignora.\n", CONFIG_FICHERO);
+		cJSON_InitHooks(NULL);
+		config_arena_usado = 0;
+		return -1;
+	}
+
+	aplicadas += lee_EnteroConfig(raiz, "periodo_publi_s", PERIODO_MIN_LPTIM2, 3600, &nueva.periodo_publi_s);
+	aplicadas += lee_EnteroConfig(raiz, "periodo_lectura_s", PERIODO_MIN_LPTIM1, 60, &nueva.periodo_lectura_s);
+	aplicadas += lee_EnteroConfig(raiz, "t_medicion_ms", 1, 50, &nueva.t_medicion_ms);
+	aplicadas += lee_EnteroConfig(raiz, "t_espera_ms", 1, 100, &nueva.t_espera_ms);
+	aplicadas += lee_RealConfig(raiz, "frec_fusion_hz", FREC_FUSION_PARADO, ALGORITHM_FREQ, &nueva.frec_fusion_hz);	//ODR de los MEMS fijado para ALGORITHM_FREQ
+	aplicadas += lee_BoolConfig(raiz, "habilita_sd", &nueva.habilita_sd);
+	aplicadas += lee_BoolConfig(raiz, "habilita_nube", &nueva.habilita_nube);
+	aplicadas += lee_BoolConfig(raiz, "imprime_muestras", &nueva.imprime_muestras);
+	aplicadas += lee_BoolConfig(raiz, "telemetria_binaria", &nueva.telemetria_binaria);
+	aplicadas += lee_EnteroConfig(raiz, "periodo_perfil_s", 0, 3600, &nueva.periodo_perfil_s);
+	aplicadas += lee_BoolConfig(raiz, "publica_perfil", &nueva.publica_perfil);
+	aplicadas += lee_EnteroConfig(raiz, "periodo_memoria_s", 0, 3600, &nueva.periodo_memoria_s);
+	aplicadas += lee_BoolConfig(raiz, "publica_memoria", &nueva.publica_memoria);
+	aplicadas += lee_BoolConfig(raiz, "enlace_mqttsn", &nueva.enlace_mqttsn);
+	aplicadas += lee_BoolConfig(raiz, "confirma_mqttsn", &nueva.confirma_mqttsn);
+	aplicadas += lee_CodecConfig(raiz, "codec_nube", &nueva.codec_nube);
+	aplicadas += lee_TopicConfig(raiz, "topic_nube", nueva.topic_nube, sizeof(nueva.topic_nube));
+	aplicadas += lee_BoolConfig(raiz, "qos1_mqtt", &nueva.qos1_mqtt);
+	aplicadas += lee_BoolConfig(raiz, "comandos_remotos", &nueva.comandos_remotos);
+
+	vector = cJSON_GetObjectItemCaseSensitive(raiz, "cte_calibr_fv");
+	if (vector != NULL) {
+		bool correcto = cJSON_IsArray(vector) && (cJSON_GetArraySize(vector) == NMAX_MODULOS);
+
+		for (int i = 0; correcto && (i < NMAX_MODULOS); i++) {
+			cJSON* cte = cJSON_GetArrayItem(vector, i);
+			correcto = cJSON_IsNumber(cte) && (cte->valuedouble >= 1.0) && (cte->valuedouble <= 10.0);
+			if (correcto) nueva.cte_calibr_fv[i] = (float)cte->valuedouble;
+		}
+		if (correcto) {
+			aplicadas++;
+		} else {
+			printf("Configuracion: cte_calibr_fv debe ser un vector de %d valores en [1, 10], se mantiene.\n", NMAX_MODULOS);
+			memcpy(nueva.cte_calibr_fv, cfg->cte_calibr_fv, sizeof(nueva.cte_calibr_fv));
+		}
+	}
+
+	/* Los periodos se cuentan en disparos de los LPTIM y la ventana es un numero entero de lecturas */
+	if ( (nueva.periodo_publi_s % PERIODO_MIN_LPTIM2 != 0) || (nueva.periodo_lectura_s % PERIODO_MIN_LPTIM1 != 0)
+		 || (nueva.periodo_publi_s % nueva.periodo_lectura_s != 0) ) {
+		printf("Configuracion: periodo_publi_s=%u y periodo_lectura_s=%u no encajan (multiplos de %d s y %d s, "
+			   "el primero multiplo del segundo), se mantienen %u y %u.\n",
+			   nueva.periodo_publi_s, nueva.periodo_lectura_s, PERIODO_MIN_LPTIM2, PERIODO_MIN_LPTIM1,
+			   cfg->periodo_publi_s, cfg->periodo_lectura_s);
+		nueva.periodo_publi_s = cfg->periodo_publi_s;
+		nueva.periodo_lectura_s = cfg->periodo_lectura_s;
+	}
+
+	cJSON_Delete(raiz);		//no libera nada: el arena se descarta entero
+	cJSON_InitHooks(NULL);
+	if (config_arena_usado > config_arena_max) {
+		config_arena_max = config_arena_usado;
+	}
+	config_arena_usado = 0;
+
+	*cfg = nueva;
+	printf("Configuracion: %d claves validas en %s, arena de cJSON %u/%u bytes.\n",
+		   aplicadas, CONFIG_FICHERO, (unsigned)config_arena_max, CONFIG_ARENA_SIZE);
+	return aplicadas;
+}
+
+
+/**
+  * @brief  Escribe la configuración efectiva como una línea JSON, para la consola y la cabecera de los ficheros
+  * @param  cfg: configuración
+  * @param  texto: destino
+  * @param  tam: tamaño del destino, CONFIG_TEXTO_SIZE basta
+  * @retval caracteres escritos, como snprintf
+  */
+int imprime_Configuracion(const configSensor* cfg, char* texto, size_t tam)
+{
+	return snprintf(texto, tam,
+			"{\"periodo_publi_s\":%u,\"periodo_lectura_s\":%u,\"t_medicion_ms\":%u,\"t_espera_ms\":%u,"
+			"\"frec_fusion_hz\":%.1f,\"habilita_sd\":%s,\"habilita_nube\":%s,\"imprime_muestras\":%s,\"telemetria_binaria\":%s,"
+			"\"periodo_perfil_s\":%u,\"publica_perfil\":%s,\"periodo_memoria_s\":%u,\"publica_memoria\":%s,"
+			"\"enlace_mqttsn\":%s,\"confirma_mqttsn\":%s,\"codec_nube\":\"%s\",\"topic_nube\":\"%s\",\"qos1_mqtt\":%s,"
+			"\"comandos_remotos\":%s,\"cte_calibr_fv\":[%.6f,%.6f,%.6f,%.6f,%.6f]}",
+			cfg->periodo_publi_s, cfg->periodo_lectura_s, cfg->t_medicion_ms, cfg->t_espera_ms,
+			cfg->frec_fusion_hz, cfg->habilita_sd ? "true" : "false", cfg->habilita_nube ? "true" : "false",
+			cfg->imprime_muestras ? "true" : "false", cfg->telemetria_binaria ? "true" : "false",
+			cfg->periodo_perfil_s, cfg->publica_perfil ? "true" : "false",
+			cfg->periodo_memoria_s, cfg->publica_memoria ? "true" : "false",
+			cfg->enlace_mqttsn ? "true" : "false", cfg->confirma_mqttsn ? "true" : "false",
+			CODECS_VENTANA[cfg->codec_nube].nombre, cfg->topic_nube, cfg->qos1_mqtt ? "true" : "false",
+			cfg->comandos_remotos ? "true" : "false", cfg->cte_calibr_fv[0], cfg->cte_calibr_fv[1], cfg->cte_calibr_fv[2], cfg->cte_calibr_fv[3], cfg->cte_calibr_fv[4]);
+}
+
+
+/**
+  * @brief  Guarda la configuración en CONFIG_FICHERO para los siguientes arranques. Se escribe primero entera en
+  * CONFIG_FICHERO_TMP y solo despues sustituye al fichero anterior, de modo que un corte a mitad deja el anterior o
+  * el nuevo, nunca uno a medias (entre el borrado y el renombrado carga_ConfiguracionSD() lee CONFIG_FICHERO_TMP). Monta y desmonta la SD.
+  * @param  cfg: configuración a guardar
+  * @param  fs: objeto FatFs de la aplicación
+  * @retval true si CONFIG_FICHERO ha quedado sustituido
+  */
+bool guarda_ConfiguracionSD(const configSensor* cfg, FATFS* fs)
+{
+	FIL fichero;
+	FRESULT res;
+	UINT escritos = 0;
+	int longitud = imprime_Configuracion(cfg, config_texto, sizeof(config_texto));
+
+	if ( (longitud <= 0) || (longitud >= (int)sizeof(config_texto)) ) {
+		return false;
+	}
+
+	res = f_mount(fs, "", 1);
+	if (res == FR_OK) {
+		res = f_open(&fichero, CONFIG_FICHERO_TMP, FA_CREATE_ALWAYS | FA_WRITE);
+	}
+	if (res == FR_OK) {
+		res = f_write(&fichero, config_texto, (UINT)longitud, &escritos);
+		if ( (f_close(&fichero) != FR_OK) || (escritos != (UINT)longitud) ) {
+			res = (res != FR_OK) ? res : FR_DISK_ERR;
+		}
+	}
+	if (res == FR_OK) {
+		f_unlink(CONFIG_FICHERO);	//FatFs no sustituye un fichero existente al renombrar
+		res = f_rename(CONFIG_FICHERO_TMP, CONFIG_FICHERO);
+	}
+	f_mount(NULL, "", 0);
+
+	if (res != FR_OK) {
+		printf("Configuracion: no se ha podido guardar %s (%i).\n", CONFIG_FICHERO, res);
+		return false;
+	}
+	printf("Configuracion: guardada en %s, %d bytes.\n", CONFIG_FICHERO, longitud);
+	return true;
+}
+
+
+/**
+  * @brief  Muestras por ventana de publicación, sustituye a N_ELEMENTOS
+  * @param  cfg: configuración
+  * @retval periodo de publicación entre periodo de lectura
+  */
+uint16_t elementos_Ventana(const configSensor* cfg)
+{
+	return cfg->periodo_publi_s / cfg->periodo_lectura_s;
+}
+
+
+/**
+  * @brief  Cuenta un disparo de un LPTIM en HAL_LPTIM_CompareMatchCallback() y avisa al completar el periodo. El
+  * contador es de 16 bits: con periodo_publi_s=3600 son 360 disparos del LPTIM2, que en 8 bits no se alcanzan nunca.
+  * @param  contador: disparos acumulados, vuelve a cero al completar el periodo
+  * @param  periodo_s: periodo configurado
+  * @param  periodo_min_s: periodo de disparo del LPTIM (PERIODO_MIN_LPTIM1 o PERIODO_MIN_LPTIM2)
+  * @retval true en el disparo que completa el periodo
+  */
+bool cuenta_Disparo(uint16_t* contador, uint16_t periodo_s, uint16_t periodo_min_s)
+{
+	if (++(*contador) >= (periodo_s / periodo_min_s)) {
+		*contador = 0;
+		return true;
+	}
+	return false;
+}
+
+
+/* Reserva de cJSON en el arena, alineada a 8 bytes. Sin sitio devuelve NULL y cJSON_Parse falla limpiamente */
+static void* reserva_ArenaConfig(size_t tam)
+{
+	void* p = NULL;
+
+	tam = (tam + 7U) & ~((size_t)7U);
+	if (config_arena_usado + tam > CONFIG_ARENA_SIZE) {
+		return NULL;
+	}
+	p = &config_arena[config_arena_usado];
+	config_arena_usado += tam;
+	return p;
+}
+
+/* Las liberaciones individuales no hacen nada: el arena se vacía de una vez en parsea_Configuracion() */
+static void libera_ArenaConfig(void* p)
+{
+	(void)p;
+}
+
+
+/* Devuelve 1 si la clave existe, es un entero y está en [min, max]; si existe pero no es válida avisa y devuelve 0 */
+static int lee_EnteroConfig(cJSON* raiz, const char* clave, int min, int max, uint16_t* destino)
+{
+	cJSON* item = cJSON_GetObjectItemCaseSensitive(raiz, clave);
+
+	if (item == NULL) {
+		return 0;
+	}
+	if ( !cJSON_IsNumber(item) || (item->valuedouble != (double)item->valueint) || (item->valueint < min) || (item->valueint > max) ) {
+		printf("Configuracion: %s debe ser un entero en [%d, %d], se mantiene %u.\n", clave, min, max, *destino);
+		return 0;
+	}
+	*destino = (uint16_t)item->valueint;
+	return 1;
+}
+
+/* Igual que lee_EnteroConfig(), para un real */
+static int lee_RealConfig(cJSON* raiz, const char* clave, float min, float max, float* destino)
+{
+	cJSON* item = cJSON_GetObjectItemCaseSensitive(raiz, clave);
+
+	if (item == NULL) {
+		return 0;
+	}
+	if ( !cJSON_IsNumber(item) || (item->valuedouble < min) || (item->valuedouble > max) ) {
+		printf("Configuracion: %s debe estar en [%.1f, %.1f], se mantiene %.1f.\n", clave, min, max, *destino);
+		return 0;
+	}
+	*destino = (float)item->valuedouble;
+	return 1;
+}
+
+/* Igual que lee_EnteroConfig(), para true/false */
+static int lee_BoolConfig(cJSON* raiz, const char* clave, bool* destino)
+{
+	cJSON* item = cJSON_GetObjectItemCaseSensitive(raiz, clave);
+
+	if (item == NULL) {
+		return 0;
+	}
+	if ( !cJSON_IsBool(item) ) {
+		printf("Configuracion: %s debe ser true o false, se mantiene %s.\n", clave, *destino ? "true" : "false");
+		return 0;
+	}
+	*destino = cJSON_IsTrue(item);
+	return 1;
+}
+
+/* Igual que lee_EnteroConfig(), para el nombre de un codec de CODECS_VENTANA */
+static int lee_CodecConfig(cJSON* raiz, const char* clave, uint8_t* destino)
+{
+	cJSON* item = cJSON_GetObjectItemCaseSensitive(raiz, clave);
+	int codec = -1;
+
+	if (item == NULL) {
+		return 0;
+	}
+	if (cJSON_IsString(item)) {
+		codec = busca_Codec(item->valuestring);
+	}
+	if (codec < 0) {
+		printf("Configuracion: %s debe ser \"thingspeak\", \"json\" o \"cbor\", se mantiene %s.\n", clave, CODECS_VENTANA[*destino].nombre);
+		return 0;
+	}
+	*destino = (uint8_t)codec;
+	return 1;
+}
+
+/* Igual que lee_EnteroConfig(), para un topic de publicación: sin comodines + y #, y como mucho un %s para la MAC */
+static int lee_TopicConfig(cJSON* raiz, const char* clave, char* destino, size_t tam)
+{
+	cJSON* item = cJSON_GetObjectItemCaseSensitive(raiz, clave);
+	const char* p = NULL;
+	bool correcto = false;
+
+	if (item == NULL) {
+		return 0;
+	}
+	if ( cJSON_IsString(item) && (item->valuestring[0] != '\0') && (strlen(item->valuestring) < tam)
+		 && (strpbrk(item->valuestring, "+#") == NULL) ) {
+		p = strchr(item->valuestring, '%');
+		correcto = (p == NULL) || ( (p[1] == 's') && (strchr(p + 2, '%') == NULL) );
+	}
+	if (!correcto) {
+		printf("Configuracion: %s debe ser un topic de menos de %u caracteres, sin + ni # y con un %%s como mucho, se mantiene %s.\n",
+			   clave, (unsigned)tam, destino);
+		return 0;
+	}
+	strcpy(destino, item->valuestring);
+	return 1;
+}
+
+#endif  /* INC_CONFIGURACION_SD_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
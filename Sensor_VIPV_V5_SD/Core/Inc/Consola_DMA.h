@@ -0,0 +1,381 @@
+/******************************************************************************
+* @file    Consola_DMA.h
+* @author  Sergio Vera Muñoz
+* @brief   Consola por el USART1 sin esperas: printf() y los msg_*() dejan el texto
+* en un anillo de CONSOLA_TAM bytes y el DMA del USART1 lo vacía en segundo plano.
+* Un solo productor (el bucle principal) y un solo consumidor (la interrupción de fin
+* de transmisión): cada lado escribe solo su indice, cabeza o cola, y no hace falta
+* deshabilitar interrupciones. Lo que no cabe se descarta según la politica del nivel
+* y se contabiliza; los niveles por debajo de CONSOLA_WARN dejan CONSOLA_RESERVA bytes
+* libres para que los avisos y errores encuentren sitio.
+* Solo lo incluye main.c, dueño del USART1; el resto usa los prototipos de msg.h.
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_CONSOLA_DMA_H_
+#define INC_CONSOLA_DMA_H_
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "main.h"		// HAL del UART, CMSIS y niveles CONSOLA_* de msg.h
+
+/* Private defines -----------------------------------------------------------*/
+#define CONSOLA_TAM            4096		// Potencia de 2: unos 350 ms de texto a 115200 baudios
+#define CONSOLA_MASCARA        (CONSOLA_TAM - 1)
+#define CONSOLA_RESERVA        512		// Bytes que DEBUG, TEXTO e INFO dejan libres a WARN y ERROR
+#define CONSOLA_MENSAJE_MAX    256		// Longitud maxima de un msg_*(), con su prefijo
+#define CONSOLA_NIVEL_MINIMO   CONSOLA_DEBUG	// Los niveles inferiores se filtran sin contar como perdidos
+#define CONSOLA_ESPERA_MS      2000		// Tope del vaciado bloqueante de pasa_ConsolaBloqueante()
+
+_Static_assert((CONSOLA_TAM & CONSOLA_MASCARA) == 0, "CONSOLA_TAM debe ser potencia de 2");
+
+
+/*--------Politica de descarte y estado de la consola------------------------*/
+typedef enum {
+	CONSOLA_DESCARTA = 0,	// Si el mensaje no cabe entero, se pierde entero
+	CONSOLA_TRUNCA			// Se escribe lo que quepa y se pierde el resto
+}politicaConsola;
+
+typedef struct
+{
+	char anillo[CONSOLA_TAM];
+	volatile uint32_t cabeza;			// Solo la escribe el productor; cuenta bytes, sin enmascarar
+	volatile uint32_t cola;				// Solo la escribe el consumidor
+	volatile uint16_t en_vuelo;			// Bytes de la transferencia DMA en curso, 0 si el UART está parado
+	UART_HandleTypeDef* huart;			// NULL: sin DMA, escritura bloqueante como el antiguo __io_putchar
+
+	uint32_t bytes_escritos;			// Estadisticas, se reinician al imprimirlas
+	uint32_t bytes_perdidos;
+	uint32_t mensajes_perdidos;			// Mensajes descartados o truncados
+	uint32_t perdidos_isr;				// Escrituras desde una interrupción: no son del productor
+	uint32_t ocupacion_max;
+	volatile uint32_t transferencias;
+	uint32_t fallos_dma;				// Arranques rechazados por el HAL o transferencias abortadas
+
+}consolaDMA;
+
+consolaDMA consola;
+extern UART_HandleTypeDef huart1;		// Consola antes de inicia_Consola() y en modo bloqueante
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+void inicia_Consola(UART_HandleTypeDef* huart);
+int consola_Escribe(uint8_t nivel, const char* datos, int len);
+int consola_Log(uint8_t nivel, const char* funcion, int linea, const char* formato, ...);
+uint32_t consola_Libre(void);
+void pasa_ConsolaBloqueante(void);
+void imprime_EstadisticasConsola(void);
+int consola_LeeCaracter(void);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+
+static void lanza_Transmision(void);
+static void vigila_Transmision(void);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Pasa la consola al anillo con DMA. Antes de llamarla todo se escribe de forma bloqueante.
+  * @param  huart: UART ya iniciado, con su canal DMA de transmisión enlazado (hdmatx)
+  * @retval None
+  */
+void inicia_Consola(UART_HandleTypeDef* huart)
+{
+	memset(&consola, 0, sizeof(consola));
+	consola.huart = huart;
+}
+
+
+/**
+  * @brief  Deja texto en el anillo y arranca el DMA si estaba parado. Nunca espera al UART.
+  * @param  nivel: CONSOLA_*, decide la politica de descarte y la reserva
+  * @param  datos: texto, sin terminar en nulo
+  * @param  len: bytes a escribir
+  * @retval bytes aceptados
+  */
+int consola_Escribe(uint8_t nivel, const char* datos, int len)
+{
+	static const politicaConsola POLITICA_NIVEL[] = {
+		CONSOLA_DESCARTA,	// DEBUG
+		CONSOLA_TRUNCA,		// TEXTO: printf() de la aplicación, llega por lineas desde _write()
+		CONSOLA_DESCARTA,	// INFO
+		CONSOLA_DESCARTA,	// WARN
+		CONSOLA_TRUNCA		// ERROR: mejor medio mensaje que ninguno
+	};
+	uint32_t libre, n, inicio, primero;
+
+	if ( (len <= 0) || (nivel > CONSOLA_ERROR) ) {
+		return 0;
+	}
+#if CONSOLA_NIVEL_MINIMO > CONSOLA_DEBUG
+	if (nivel < CONSOLA_NIVEL_MINIMO) {
+		return 0;
+	}
+#endif
+
+	if (consola.huart == NULL) {		// Arranque o fallo grave: como el antiguo __io_putchar
+		HAL_UART_Transmit(&huart1, (uint8_t*)datos, (uint16_t)len, 30000);
+		return len;
+	}
+
+	if (__get_IPSR() != 0) {			// Otro productor romperia el anillo; se pierde
+		consola.perdidos_isr++;
+		consola.bytes_perdidos += (uint32_t)len;
+		return 0;
+	}
+
+	vigila_Transmision();
+
+	libre = CONSOLA_TAM - (consola.cabeza - consola.cola);
+	if (nivel < CONSOLA_WARN) {
+		libre = (libre > CONSOLA_RESERVA) ? (libre - CONSOLA_RESERVA) : 0;
+	}
+
+	n = (uint32_t)len;
+	if (n > libre) {
+		n = (POLITICA_NIVEL[nivel] == CONSOLA_TRUNCA) ? libre : 0;
+		consola.mensajes_perdidos++;
+		consola.bytes_perdidos += (uint32_t)len - n;
+	}
+
+	if (n > 0) {
+		inicio = consola.cabeza & CONSOLA_MASCARA;
+		primero = (n < (CONSOLA_TAM - inicio)) ? n : (CONSOLA_TAM - inicio);
+		memcpy(&consola.anillo[inicio], datos, primero);
+		memcpy(&consola.anillo[0], datos + primero, n - primero);
+
+		__DMB();						// Los datos, antes que la cabeza que los publica
+		consola.cabeza += n;
+		consola.bytes_escritos += n;
+
+		if ( (consola.cabeza - consola.cola) > consola.ocupacion_max ) {
+			consola.ocupacion_max = consola.cabeza - consola.cola;
+		}
+	}
+
+	if (consola.en_vuelo == 0) {
+		lanza_Transmision();
+	}
+
+	return (int)n;
+}
+
+
+/**
+  * @brief  Formatea un mensaje de msg_*() y lo escribe de una vez, con su prefijo de nivel. Vacía antes el
+  * buffer de stdout para que no se adelante a un printf() anterior.
+  * @param  nivel: CONSOLA_*
+  * @param  funcion: función que llama, o NULL para no poner prefijo (msg_info)
+  * @param  linea: linea del fuente
+  * @param  formato: formato de printf
+  * @retval bytes aceptados
+  */
+int consola_Log(uint8_t nivel, const char* funcion, int linea, const char* formato, ...)
+{
+	static const char* const PREFIJO_NIVEL[] = {"DEBUG:   ", "", "", "WARN:  ", "ERROR: "};	// Los de msg.h
+	static char mensaje[CONSOLA_MENSAJE_MAX];		// Solo desde el bucle principal, como el anillo
+	va_list args;
+	int n = 0, texto = 0;
+
+	if (nivel > CONSOLA_ERROR) {
+		return 0;
+	}
+#if CONSOLA_NIVEL_MINIMO > CONSOLA_DEBUG
+	if (nivel < CONSOLA_NIVEL_MINIMO) {
+		return 0;
+	}
+#endif
+	if ( (__get_IPSR() != 0) && (consola.huart != NULL) ) {	// mensaje[] y stdout son del bucle principal
+		consola.perdidos_isr++;
+		return 0;
+	}
+	fflush(stdout);
+
+	if (funcion != NULL) {
+		n = snprintf(mensaje, sizeof(mensaje), "%s%s L#%d ", PREFIJO_NIVEL[nivel], funcion, linea);
+	}
+	if (n < 0) {
+		n = 0;
+	}
+	else if (n >= (int)sizeof(mensaje)) {	// Prefijo truncado (nombre de función muy largo): el texto ya no cabe
+		n = sizeof(mensaje) - 1;
+	}
+	va_start(args, formato);
+	texto = vsnprintf(&mensaje[n], sizeof(mensaje) - (size_t)n, formato, args);
+	va_end(args);
+
+	if (texto < 0) {
+		return 0;
+	}
+	n += texto;
+	if (n >= (int)sizeof(mensaje)) {
+		n = sizeof(mensaje) - 1;
+	}
+	return consola_Escribe(nivel, mensaje, n);
+}
+
+
+/**
+  * @brief  Bytes que aún admite el anillo para texto normal, descontada la reserva de avisos y errores.
+  * Permite a un sumidero de la tubería esperar su turno en vez de perder texto.
+  * @param  None
+  * @retval bytes libres
+  */
+uint32_t consola_Libre(void)
+{
+	uint32_t libre = CONSOLA_TAM - (consola.cabeza - consola.cola);
+
+	if (consola.huart == NULL) {
+		return CONSOLA_TAM;
+	}
+	return (libre > CONSOLA_RESERVA) ? (libre - CONSOLA_RESERVA) : 0;
+}
+
+
+/**
+  * @brief  Para el DMA, vacía por sondeo lo que quede en el anillo y deja la consola en modo bloqueante.
+  * Para Error_Handler(), que puede llegar desde una interrupción o con el DMA detenido.
+  * @param  None
+  * @retval None
+  */
+void pasa_ConsolaBloqueante(void)
+{
+	UART_HandleTypeDef* huart = consola.huart;
+	uint32_t inicio, trozo;
+
+	if (huart == NULL) {
+		return;
+	}
+	consola.huart = NULL;
+
+	if (consola.en_vuelo != 0) {		// Lo que haya salido de la transferencia abortada no se sabe; se repite entera
+		HAL_UART_AbortTransmit(huart);
+		consola.fallos_dma++;
+		consola.en_vuelo = 0;
+	}
+
+	while (consola.cabeza != consola.cola) {
+		inicio = consola.cola & CONSOLA_MASCARA;
+		trozo = consola.cabeza - consola.cola;
+		if (trozo > (CONSOLA_TAM - inicio)) {
+			trozo = CONSOLA_TAM - inicio;
+		}
+		HAL_UART_Transmit(huart, (uint8_t*)&consola.anillo[inicio], (uint16_t)trozo, CONSOLA_ESPERA_MS);
+		consola.cola += trozo;
+	}
+}
+
+
+/**
+  * @brief  Imprime bytes escritos y perdidos, ocupación maxima y transferencias DMA, y reinicia las estadisticas
+  * @param  None
+  * @retval None
+  */
+void imprime_EstadisticasConsola(void)
+{
+	printf("Consola: %lu bytes escritos, %lu perdidos en %lu mensajes, %lu desde interrupcion, "
+		   "ocupacion max %lu/%u, %lu transferencias DMA, %lu fallos\n",
+		   (unsigned long)consola.bytes_escritos, (unsigned long)consola.bytes_perdidos,
+		   (unsigned long)consola.mensajes_perdidos, (unsigned long)consola.perdidos_isr,
+		   (unsigned long)consola.ocupacion_max, CONSOLA_TAM, (unsigned long)consola.transferencias,
+		   (unsigned long)consola.fallos_dma);
+
+	consola.bytes_escritos = 0;
+	consola.bytes_perdidos = 0;
+	consola.mensajes_perdidos = 0;
+	consola.perdidos_isr = 0;
+	consola.ocupacion_max = 0;
+	consola.transferencias = 0;
+	consola.fallos_dma = 0;
+}
+
+
+/**
+  * @brief  Caracter recibido por el UART de la consola, sin esperar. El bucle principal lo consulta por sondeo para las
+  * ordenes de una tecla; un desbordamiento por no leer a tiempo se limpia y solo pierde teclas.
+  * @param  None
+  * @retval caracter recibido, o -1 si no hay ninguno
+  */
+int consola_LeeCaracter(void)
+{
+	UART_HandleTypeDef* huart = (consola.huart != NULL) ? consola.huart : &huart1;
+
+	if (__HAL_UART_GET_FLAG(huart, UART_FLAG_ORE)) {
+		__HAL_UART_CLEAR_OREFLAG(huart);
+	}
+	if (!__HAL_UART_GET_FLAG(huart, UART_FLAG_RXNE)) {
+		return -1;
+	}
+	return (int)(huart->Instance->RDR & 0xFFU);
+}
+
+
+/**
+  * @brief  Fin de una transferencia DMA: libera sus bytes del anillo y lanza la siguiente si hay texto pendiente
+  * @param  huart: UART que ha terminado
+  * @retval None
+  */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+	if ( (huart != consola.huart) || (consola.en_vuelo == 0) ) {
+		return;
+	}
+	consola.cola += consola.en_vuelo;
+	consola.transferencias++;
+	lanza_Transmision();
+}
+
+
+/* Arranca el DMA con el tramo contiguo más largo pendiente. La llaman el productor con el UART parado
+ * (en_vuelo == 0) y la interrupción de fin de transmisión con él en marcha, nunca los dos a la vez. */
+static void lanza_Transmision(void)
+{
+	uint32_t pendiente = consola.cabeza - consola.cola;
+	uint32_t inicio = consola.cola & CONSOLA_MASCARA;
+	uint32_t trozo = CONSOLA_TAM - inicio;
+
+	if (pendiente == 0) {
+		consola.en_vuelo = 0;
+		return;
+	}
+	if (trozo > pendiente) {
+		trozo = pendiente;
+	}
+
+	consola.en_vuelo = (uint16_t)trozo;	// Antes del arranque: el fin de un tramo corto puede llegar dentro del HAL
+	if (HAL_OK != HAL_UART_Transmit_DMA(consola.huart, (uint8_t*)&consola.anillo[inicio], (uint16_t)trozo)) {
+		consola.en_vuelo = 0;				// UART ocupado (p. ej. __io_getchar); se reintenta en la proxima escritura
+		consola.fallos_dma++;
+	}
+}
+
+/* Una transferencia terminada sin llamar a HAL_UART_TxCpltCallback (error de DMA) dejaría el anillo lleno
+ * para siempre: se da por enviada y se sigue */
+static void vigila_Transmision(void)
+{
+	if ( (consola.en_vuelo != 0) && (consola.huart->gState == HAL_UART_STATE_READY) ) {
+		consola.cola += consola.en_vuelo;
+		consola.en_vuelo = 0;
+		consola.fallos_dma++;
+	}
+}
+
+#endif  /* INC_CONSOLA_DMA_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
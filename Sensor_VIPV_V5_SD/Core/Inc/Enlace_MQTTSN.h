@@ -0,0 +1,400 @@
+/******************************************************************************
+* @file    Enlace_MQTTSN.h
+* @author  Sergio Vera Muñoz
+* @brief   Enlace ligero de telemetría por UDP con el formato de MQTT-SN v1.2: cada
+* registro compacto de 40 bytes sale en un solo PUBLISH de 47 bytes a un topic
+* predefinido en la pasarela, sin sesión TLS que mantener ni reconexión completa
+* tras cada caída del enlace.
+*  - QoS -1: sin CONNECT ni confirmación; el registro se da por entregado al enviarlo.
+*  - QoS 1: CONNECT y CONNACK al abrir el enlace, un PUBLISH en vuelo cada vez (parada
+*    y espera) que se da por entregado con su PUBACK. Sin él se reenvía con DUP cada
+*    T_REINTENTO_SN_MS; tras N_REINTENTOS_SN el enlace se da por caído. Sin tráfico se
+*    envía un PINGREQ antes de que venza la duración de la sesión en la pasarela.
+* El llamante pasa en cada vuelta el registro a la cabeza de su FIFO y lo elimina
+* cuando servicio_EnlaceSN() lo da por entregado. El envío y la recepción de los
+* datagramas los hace el transporte del llamante (transporteSN).
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_ENLACE_MQTTSN_H_
+#define INC_ENLACE_MQTTSN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "main.h"
+#include "Registro_Compacto.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define T_REINTENTO_SN_MS        3000U		// Espera del CONNACK, PUBACK o PINGRESP antes de reenviar (Tretry)
+#define N_REINTENTOS_SN          3			// Reenvíos sin respuesta antes de dar el enlace por caído (Nretry)
+#define DURACION_SN_S            300U		// Duración de la sesión anunciada en el CONNECT, en segundos
+#define ID_CLIENTE_SN_MAX        23			// Longitud máxima del ClientId de MQTT-SN
+#define TRAMA_SN_MAX             (7 + sizeof(registroCompacto))	// PUBLISH con un registro, la trama mas larga
+#define SN_TEXTO_SIZE            256		// Informe para la consola
+
+/* Tipos de mensaje y banderas de MQTT-SN v1.2 */
+#define SN_CONNECT               0x04
+#define SN_CONNACK               0x05
+#define SN_PUBLISH               0x0C
+#define SN_PUBACK                0x0D
+#define SN_PINGREQ               0x16
+#define SN_PINGRESP              0x17
+#define SN_DISCONNECT            0x18
+#define SN_FLAG_DUP              0x80
+#define SN_FLAG_QOS1             0x20
+#define SN_FLAG_QOS_M1           0x60
+#define SN_FLAG_LIMPIA           0x04		// CleanSession
+#define SN_FLAG_PREDEFINIDO      0x01		// TopicIdType: topic predefinido en la pasarela
+#define SN_ID_PROTOCOLO          0x01
+#define SN_ACEPTADO              0x00
+#define SN_CONGESTION            0x01
+
+
+/*--------Transporte, estado y estadística del enlace------------------------*/
+typedef struct
+{
+	int (*envia)(const uint8_t* trama, uint16_t tam);	// Bytes enviados, o negativo si el socket ha fallado
+	int (*recibe)(uint8_t* trama, uint16_t tam);		// Un datagrama sin esperar: bytes, 0 si no hay nada, negativo si ha fallado
+
+}transporteSN;
+
+typedef enum {SN_DESCONECTADO=0, SN_ACTIVO} estadoSN;
+
+typedef struct
+{
+	uint32_t enviados;				// PUBLISH distintos
+	uint32_t entregados;			// Registros dados por entregados al llamante
+	uint32_t reenvios;				// PUBLISH con DUP y PINGREQ repetidos
+	uint32_t rechazados;			// PUBACK con error distinto de congestión: el registro se descarta
+	uint32_t congestion;			// PUBACK de congestión: se reenvía pasado T_REINTENTO_SN_MS
+	uint32_t pings;
+	uint32_t caidas;				// Enlace dado por caído sin respuesta
+	uint32_t bytes_tx;				// Bytes de MQTT-SN, sin las cabeceras UDP e IP
+	uint32_t bytes_rx;
+
+}estadisticaSN;
+
+typedef struct
+{
+	const transporteSN* transporte;
+	bool confirmado;				// QoS 1; QoS -1 si es false
+	uint16_t id_topic;				// Topic predefinido de las medias en la pasarela
+	char id_cliente[ID_CLIENTE_SN_MAX + 1];
+	estadoSN estado;
+	bool en_vuelo;					// PUBLISH pendiente de PUBACK, ya guardado en trama
+	bool ping_pendiente;
+	uint16_t id_mensaje;			// MsgId del PUBLISH en vuelo
+	uint8_t reintentos;
+	uint8_t trama[TRAMA_SN_MAX];	// PUBLISH en vuelo, para reenviarlo tal cual con DUP
+	uint8_t tam_trama;
+	uint32_t t_envio;				// HAL_GetTick() del ultimo envío pendiente de respuesta
+	uint32_t t_trafico;				// HAL_GetTick() del ultimo datagrama enviado, para el keep-alive
+	estadisticaSN estadistica;
+
+}enlaceSN;
+
+
+/* ------------------------------------------------- Variables ---------------------------------------------------------*/
+static const uint8_t trama_PingreqSN[2] = {2, SN_PINGREQ};
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+void inicia_EnlaceSN(enlaceSN* sn, const transporteSN* transporte, bool confirmado, uint16_t id_topic, const char* id_cliente);
+bool conecta_EnlaceSN(enlaceSN* sn);
+int  servicio_EnlaceSN(enlaceSN* sn, const registroCompacto* cabeza);
+void cierra_EnlaceSN(enlaceSN* sn);
+int  informe_EnlaceSN(const enlaceSN* sn, char* texto, size_t tam);
+
+static bool envia_TramaSN(enlaceSN* sn, const uint8_t* trama, uint8_t tam);
+static int  recibe_TramaSN(enlaceSN* sn, uint8_t* trama, uint16_t tam);
+static uint8_t forma_PublishSN(enlaceSN* sn, const registroCompacto* registro);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Deja el enlace desconectado y sin nada en vuelo, con la estadística a cero
+  * @param  sn: enlace
+  * @param  transporte: envío y recepción de datagramas del llamante
+  * @param  confirmado: true para QoS 1, false para QoS -1
+  * @param  id_topic: topic predefinido en la pasarela
+  * @param  id_cliente: ClientId del CONNECT, se recorta a ID_CLIENTE_SN_MAX caracteres
+  * @retval None
+  */
+void inicia_EnlaceSN(enlaceSN* sn, const transporteSN* transporte, bool confirmado, uint16_t id_topic, const char* id_cliente)
+{
+	memset(sn, 0, sizeof(*sn));
+	sn->transporte = transporte;
+	sn->confirmado = confirmado;
+	sn->id_topic = id_topic;
+	strncpy(sn->id_cliente, id_cliente, ID_CLIENTE_SN_MAX);
+	sn->estado = SN_DESCONECTADO;
+}
+
+
+/**
+  * @brief  Abre el enlace. Con QoS -1 no hay sesión y queda activo sin enviar nada; con QoS 1 envía el CONNECT
+  * y espera el CONNACK hasta T_REINTENTO_SN_MS. Un solo intento: los reintentos los lleva el gestor de red.
+  * El PUBLISH que estuviera en vuelo se vuelve a enviar desde la FIFO con un MsgId nuevo.
+  * @param  sn: enlace
+  * @retval true si el enlace queda activo
+  */
+bool conecta_EnlaceSN(enlaceSN* sn)
+{
+	uint8_t trama[6 + ID_CLIENTE_SN_MAX];
+	uint8_t respuesta[TRAMA_SN_MAX];
+	uint8_t tam_id = (uint8_t)strlen(sn->id_cliente);
+	uint32_t t_inicio;
+	int leidos = 0;
+
+	sn->en_vuelo = false;
+	sn->ping_pendiente = false;
+	sn->reintentos = 0;
+
+	if (!sn->confirmado) {
+		sn->estado = SN_ACTIVO;
+		sn->t_trafico = HAL_GetTick();
+		return true;
+	}
+
+	trama[0] = 6 + tam_id;
+	trama[1] = SN_CONNECT;
+	trama[2] = SN_FLAG_LIMPIA;
+	trama[3] = SN_ID_PROTOCOLO;
+	trama[4] = (uint8_t)(DURACION_SN_S >> 8);
+	trama[5] = (uint8_t)(DURACION_SN_S & 0xFF);
+	memcpy(&trama[6], sn->id_cliente, tam_id);
+	if (!envia_TramaSN(sn, trama, trama[0])) {
+		return false;
+	}
+
+	t_inicio = HAL_GetTick();
+	do {
+		leidos = recibe_TramaSN(sn, respuesta, sizeof(respuesta));
+		if ( (leidos == 3) && (respuesta[1] == SN_CONNACK) ) {
+			if (respuesta[2] != SN_ACEPTADO) {
+				printf("MQTT-SN: CONNECT rechazado por la pasarela (%u).\n", respuesta[2]);
+				return false;
+			}
+			sn->estado = SN_ACTIVO;
+			return true;
+		}
+	} while ( (leidos >= 0) && (HAL_GetTick() - t_inicio < T_REINTENTO_SN_MS) );
+
+	return false;
+}
+
+
+/**
+  * @brief  Un paso del enlace, sin bloquear: atiende las respuestas de la pasarela, reenvía lo que haya vencido,
+  * mantiene viva la sesión y, sin nada en vuelo, envía el registro de la cabeza de la FIFO.
+  * @param  sn: enlace activo
+  * @param  cabeza: registro a la cabeza de la FIFO del llamante, NULL si está vacía. Debe ser el mismo hasta que
+  * se dé por entregado
+  * @retval 1 si la cabeza está entregada (o rechazada por la pasarela) y se puede eliminar, 0 si no, -1 si el
+  * enlace se ha caído
+  */
+int servicio_EnlaceSN(enlaceSN* sn, const registroCompacto* cabeza)
+{
+	uint8_t respuesta[TRAMA_SN_MAX];
+	int leidos = 0;
+
+	if (sn->estado != SN_ACTIVO) {
+		return -1;
+	}
+
+	/* Respuestas de la pasarela: solo las hay con QoS 1, pero un DISCONNECT se atiende siempre */
+	while ( (leidos = recibe_TramaSN(sn, respuesta, sizeof(respuesta))) > 0 ) {
+
+		if ( (leidos == 7) && (respuesta[1] == SN_PUBACK) && sn->en_vuelo
+			 && (((uint16_t)respuesta[4] << 8 | respuesta[5]) == sn->id_mensaje) ) {
+			if (respuesta[6] == SN_CONGESTION) {
+				sn->estadistica.congestion++;
+				sn->t_envio = HAL_GetTick();	//se reenvía pasado T_REINTENTO_SN_MS, sin gastar reintentos
+				sn->reintentos = 0;
+				continue;
+			}
+			if (respuesta[6] != SN_ACEPTADO) {
+				sn->estadistica.rechazados++;
+				printf("MQTT-SN: PUBLISH %u rechazado por la pasarela (%u), se descarta el registro.\n", sn->id_mensaje, respuesta[6]);
+			}
+			else {
+				sn->estadistica.entregados++;
+			}
+			sn->en_vuelo = false;
+			return 1;
+		}
+		else if ( (leidos == 2) && (respuesta[1] == SN_PINGRESP) ) {
+			sn->ping_pendiente = false;
+			sn->reintentos = sn->en_vuelo ? sn->reintentos : 0;
+		}
+		else if ( (leidos >= 2) && (respuesta[1] == SN_DISCONNECT) ) {
+			printf("MQTT-SN: la pasarela ha cerrado la sesion.\n");
+			sn->estado = SN_DESCONECTADO;
+			return -1;
+		}
+	}
+	if (leidos < 0) {
+		sn->estado = SN_DESCONECTADO;
+		return -1;
+	}
+
+	/* Reenvío del PUBLISH o del PINGREQ sin respuesta */
+	if ( (sn->en_vuelo || sn->ping_pendiente) && (HAL_GetTick() - sn->t_envio >= T_REINTENTO_SN_MS) ) {
+		if (sn->reintentos >= N_REINTENTOS_SN) {
+			printf("MQTT-SN: sin respuesta de la pasarela tras %d reenvios, enlace caido.\n", N_REINTENTOS_SN);
+			sn->estadistica.caidas++;
+			sn->estado = SN_DESCONECTADO;
+			return -1;
+		}
+		sn->reintentos++;
+		sn->estadistica.reenvios++;
+		if (sn->en_vuelo) {
+			sn->trama[2] |= SN_FLAG_DUP;
+			if (!envia_TramaSN(sn, sn->trama, sn->tam_trama)) {
+				return -1;
+			}
+		}
+		else if (!envia_TramaSN(sn, trama_PingreqSN, sizeof(trama_PingreqSN))) {
+			return -1;
+		}
+		sn->t_envio = HAL_GetTick();
+		return 0;
+	}
+
+	/* Registro nuevo: con QoS -1 queda entregado al salir */
+	if (!sn->en_vuelo && (cabeza != NULL)) {
+		sn->tam_trama = forma_PublishSN(sn, cabeza);
+		if (!envia_TramaSN(sn, sn->trama, sn->tam_trama)) {
+			return -1;
+		}
+		sn->estadistica.enviados++;
+		if (!sn->confirmado) {
+			sn->estadistica.entregados++;
+			return 1;
+		}
+		sn->en_vuelo = true;
+		sn->reintentos = 0;
+		sn->t_envio = HAL_GetTick();
+		return 0;
+	}
+
+	/* Keep-alive: un PINGREQ a la mitad de la duración sin tráfico */
+	if (sn->confirmado && !sn->en_vuelo && !sn->ping_pendiente
+		&& (HAL_GetTick() - sn->t_trafico >= DURACION_SN_S * 500U)) {
+		if (!envia_TramaSN(sn, trama_PingreqSN, sizeof(trama_PingreqSN))) {
+			return -1;
+		}
+		sn->estadistica.pings++;
+		sn->ping_pendiente = true;
+		sn->reintentos = 0;
+		sn->t_envio = HAL_GetTick();
+	}
+	return 0;
+}
+
+
+/**
+  * @brief  Cierra la sesión con un DISCONNECT si la había, sin esperar respuesta. El PUBLISH en vuelo sigue en
+  * la FIFO del llamante y sale de nuevo al reabrir el enlace.
+  * @param  sn: enlace
+  * @retval None
+  */
+void cierra_EnlaceSN(enlaceSN* sn)
+{
+	static const uint8_t disconnect[2] = {2, SN_DISCONNECT};
+
+	if ( sn->confirmado && (sn->estado == SN_ACTIVO) ) {
+		envia_TramaSN(sn, disconnect, sizeof(disconnect));
+	}
+	sn->estado = SN_DESCONECTADO;
+	sn->en_vuelo = false;
+	sn->ping_pendiente = false;
+}
+
+
+/**
+  * @brief  Escribe la estadística del enlace en una línea de texto
+  * @param  sn: enlace
+  * @param  texto: destino
+  * @param  tam: tamaño del destino, SN_TEXTO_SIZE basta
+  * @retval caracteres escritos, como snprintf
+  */
+int informe_EnlaceSN(const enlaceSN* sn, char* texto, size_t tam)
+{
+	const estadisticaSN* e = &sn->estadistica;
+
+	return snprintf(texto, tam,
+			"MQTT-SN QoS %s: %lu enviados, %lu entregados, %lu reenvios, %lu rechazados, %lu congestion, %lu pings, "
+			"%lu caidas, %lu/%lu bytes tx/rx\n",
+			sn->confirmado ? "1" : "-1", (unsigned long)e->enviados, (unsigned long)e->entregados,
+			(unsigned long)e->reenvios, (unsigned long)e->rechazados, (unsigned long)e->congestion,
+			(unsigned long)e->pings, (unsigned long)e->caidas, (unsigned long)e->bytes_tx, (unsigned long)e->bytes_rx);
+}
+
+
+/* Envía una trama por el transporte; un fallo del socket deja el enlace desconectado */
+static bool envia_TramaSN(enlaceSN* sn, const uint8_t* trama, uint8_t tam)
+{
+	if (sn->transporte->envia(trama, tam) != tam) {
+		sn->estado = SN_DESCONECTADO;
+		return false;
+	}
+	sn->estadistica.bytes_tx += tam;
+	sn->t_trafico = HAL_GetTick();
+	return true;
+}
+
+/* Lee un datagrama y descarta los que no traen una cabecera de un byte coherente con su tamaño */
+static int recibe_TramaSN(enlaceSN* sn, uint8_t* trama, uint16_t tam)
+{
+	int leidos = sn->transporte->recibe(trama, tam);
+
+	if (leidos <= 0) {
+		return leidos;
+	}
+	sn->estadistica.bytes_rx += (uint32_t)leidos;
+	if ( (leidos < 2) || (trama[0] != leidos) ) {
+		return 1;	//ni PUBACK ni PINGRESP ni DISCONNECT: se ignora y se sigue leyendo
+	}
+	return leidos;
+}
+
+/* PUBLISH del registro al topic predefinido: 7 bytes de cabecera y el registro compacto tal cual */
+static uint8_t forma_PublishSN(enlaceSN* sn, const registroCompacto* registro)
+{
+	uint16_t id = 0;
+
+	if (sn->confirmado) {
+		sn->id_mensaje = (sn->id_mensaje == 0xFFFF) ? 1 : sn->id_mensaje + 1;	//el 0 queda para QoS -1
+		id = sn->id_mensaje;
+	}
+	sn->trama[0] = (uint8_t)TRAMA_SN_MAX;
+	sn->trama[1] = SN_PUBLISH;
+	sn->trama[2] = (sn->confirmado ? SN_FLAG_QOS1 : SN_FLAG_QOS_M1) | SN_FLAG_PREDEFINIDO;
+	sn->trama[3] = (uint8_t)(sn->id_topic >> 8);
+	sn->trama[4] = (uint8_t)(sn->id_topic & 0xFF);
+	sn->trama[5] = (uint8_t)(id >> 8);
+	sn->trama[6] = (uint8_t)(id & 0xFF);
+	memcpy(&sn->trama[7], registro, sizeof(*registro));
+	return (uint8_t)TRAMA_SN_MAX;
+}
+
+#endif  /* INC_ENLACE_MQTTSN_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
@@ -0,0 +1,209 @@
+/******************************************************************************
+* @file    Estadistica_Ventana.h
+* @author  Sergio Vera Muñoz
+* @brief   Estadistica en linea de una ventana de muestras. Cada magnitud lleva su
+* número de muestras, media, M2 (algoritmo de Welford), minimo y maximo, actualizados
+* en O(1) con cada muestra; la media de la ventana se obtiene al cerrarla sin haber
+* guardado las muestras. La memoria no depende de la duración de la ventana, de modo
+* que pueden correr a la vez ventanas de 10 s, 1 min o 15 min.
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_ESTADISTICA_VENTANA_H_
+#define INC_ESTADISTICA_VENTANA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "sensors_data.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define N_IRRADIANCIAS   5		// Campos irradiancia[] de megaDato
+
+
+/*--------Estadistica de una magnitud y de una ventana------------------------*/
+typedef struct
+{
+	uint32_t n;
+	float media;
+	float m2;				// Suma de cuadrados de las desviaciones a la media
+	float min;
+	float max;
+
+}estadisticaCampo;
+
+typedef struct
+{
+	estadisticaCampo irradiancia[N_IRRADIANCIAS];
+	estadisticaCampo temperatura;
+	estadisticaCampo presion;
+	estadisticaCampo humedad;
+
+	estadisticaCampo latitud;		// Solo con las muestras de ubicación valida
+	estadisticaCampo longitud;
+	estadisticaCampo altitud;
+	estadisticaCampo velocidad;
+
+	uint32_t n_muestras;
+	uint32_t n_gps_validos;
+	megaDato ultima;				// Fecha y hora de la ventana: las de su ultima muestra
+
+}estadisticaVentana;
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+void reinicia_Estadistica(estadisticaVentana* e);
+void acumula_Estadistica(estadisticaVentana* e, const megaDato* dato);
+bool media_Estadistica(const estadisticaVentana* e, megaDato* media);
+float desviacion_Campo(const estadisticaCampo* c);
+void imprime_Estadistica(const char* nombre, const estadisticaVentana* e);
+
+static void acumula_Campo(estadisticaCampo* c, float x);
+static bool ubicacion_Valida(const megaDato* dato);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Deja la ventana sin muestras
+  * @param  e: estadistica a reiniciar
+  * @retval None
+  */
+void reinicia_Estadistica(estadisticaVentana* e)
+{
+	memset(e, 0, sizeof(*e));
+}
+
+
+/**
+  * @brief  Añade una muestra a la ventana. La posición, altitud y velocidad solo cuentan si la muestra tiene
+  * ubicación valida, con el mismo criterio que la antigua media del vector de lecturas.
+  * @param  e: estadistica de la ventana
+  * @param  dato: muestra leida
+  * @retval None
+  */
+void acumula_Estadistica(estadisticaVentana* e, const megaDato* dato)
+{
+	for (uint8_t i = 0; i < N_IRRADIANCIAS; i++) {
+		acumula_Campo(&e->irradiancia[i], dato->irradiancia[i]);
+	}
+	acumula_Campo(&e->temperatura, dato->temperatura);
+	acumula_Campo(&e->presion, dato->presion);
+	acumula_Campo(&e->humedad, dato->humedad);
+
+	if (ubicacion_Valida(dato)) {
+		acumula_Campo(&e->latitud, dato->latitud);
+		acumula_Campo(&e->longitud, dato->longitud);
+		acumula_Campo(&e->altitud, dato->altitud);
+		acumula_Campo(&e->velocidad, dato->velocidad);
+		e->n_gps_validos++;
+	}
+
+	e->ultima = *dato;
+	e->n_muestras++;
+}
+
+
+/**
+  * @brief  Cierra la ventana en un registro de medias. La ubicación se da por valida si lo es al menos la mitad
+  * de las muestras; sin ninguna valida la posición queda a NaN. La actitud no se toca: sale del acumulador
+  * de cuaterniones.
+  * @param  e: estadistica de la ventana
+  * @param  media: registro donde devolver las medias, con la fecha de la ultima muestra
+  * @retval false si la ventana no tiene muestras; el registro no se modifica
+  */
+bool media_Estadistica(const estadisticaVentana* e, megaDato* media)
+{
+	if (e->n_muestras == 0) {
+		return false;
+	}
+
+	media->agno = e->ultima.agno;	media->mes = e->ultima.mes;		media->dia = e->ultima.dia;
+	media->hora = e->ultima.hora;	media->min = e->ultima.min;		media->seg = e->ultima.seg;
+
+	for (uint8_t i = 0; i < N_IRRADIANCIAS; i++) {
+		media->irradiancia[i] = e->irradiancia[i].media;
+	}
+	media->temperatura = e->temperatura.media;
+	media->presion = e->presion.media;
+	media->humedad = e->humedad.media;
+
+	media->ubicacion_fix = ( (e->n_muestras - e->n_gps_validos) <= (e->n_muestras / 2) );
+	media->latitud   = (e->n_gps_validos > 0) ? e->latitud.media   : NAN;
+	media->longitud  = (e->n_gps_validos > 0) ? e->longitud.media  : NAN;
+	media->altitud   = (e->n_gps_validos > 0) ? e->altitud.media   : NAN;
+	media->velocidad = (e->n_gps_validos > 0) ? e->velocidad.media : NAN;
+
+	return true;
+}
+
+
+/**
+  * @brief  Desviación tipica muestral de una magnitud
+  * @param  c: estadistica de la magnitud
+  * @retval desviación, 0 con menos de dos muestras
+  */
+float desviacion_Campo(const estadisticaCampo* c)
+{
+	return (c->n > 1) ? sqrtf(c->m2 / (float)(c->n - 1)) : 0.0f;
+}
+
+
+/**
+  * @brief  Imprime media, desviación, minimo y maximo de las irradiancias y la temperatura de una ventana
+  * @param  nombre: nombre de la ventana para la consola
+  * @param  e: estadistica de la ventana
+  * @retval None
+  */
+void imprime_Estadistica(const char* nombre, const estadisticaVentana* e)
+{
+	printf("\nVentana %s: %lu muestras, %lu con ubicacion, cerrada a las %02d:%02d:%02d\n", nombre,
+		   (unsigned long)e->n_muestras, (unsigned long)e->n_gps_validos, e->ultima.hora, e->ultima.min, e->ultima.seg);
+
+	for (uint8_t i = 0; i < N_IRRADIANCIAS; i++) {
+		printf("  Irradiancia %d:  media %8.2f  desv %7.2f  min %8.2f  max %8.2f\n", i + 1, e->irradiancia[i].media,
+			   desviacion_Campo(&e->irradiancia[i]), e->irradiancia[i].min, e->irradiancia[i].max);
+	}
+	printf("  Temperatura  :  media %8.2f  desv %7.2f  min %8.2f  max %8.2f\n", e->temperatura.media,
+		   desviacion_Campo(&e->temperatura), e->temperatura.min, e->temperatura.max);
+}
+
+
+/* Un paso de Welford: media y M2 sin restar sumas grandes, estable en ventanas largas */
+static void acumula_Campo(estadisticaCampo* c, float x)
+{
+	float delta = x - c->media;
+
+	c->n++;
+	c->media += delta / (float)c->n;
+	c->m2 += delta * (x - c->media);
+
+	if ( (c->n == 1) || (x < c->min) ) c->min = x;
+	if ( (c->n == 1) || (x > c->max) ) c->max = x;
+}
+
+/* Misma condición que aplicaba calcula_mediaVector(): coordenadas numericas y distintas de 0 */
+static bool ubicacion_Valida(const megaDato* dato)
+{
+	return noesNAN(dato->longitud) && noesNAN(dato->latitud) && noesNAN(dato->altitud) && noesNAN(dato->velocidad)
+		   && (dato->longitud != 0.0f) && (dato->latitud != 0.0f) && (dato->altitud != 0.0f);
+}
+
+#endif  /* INC_ESTADISTICA_VENTANA_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
@@ -0,0 +1,412 @@
+/******************************************************************************
+* @file    Extractor_Log.h
+* @author  Sergio Vera Muñoz
+* @brief   Extracción por partes de los registros de la SD de una franja horaria
+* [t0, t1], para el comando remoto "log". Cada fichero de la SD empieza en la hora de su
+* nombre (MMDDhhmm) y sigue hasta el siguiente, de modo que basta el último que empieza
+* antes de t0 y los que empiezan dentro de la franja. Dentro de cada fichero el primer
+* registro de la franja se busca por bisección sobre el desplazamiento, porque los
+* registros van en orden de tiempo; despues se lee hacia delante hasta pasar de t1.
+* Cada paso es un montaje, una lectura de LOG_BLOQUE bytes y un desmontaje, como
+* escribir_datos(), para no retener el bucle principal ni dejar la SD montada entre
+* vueltas. Sirve para el CSV (.txt) y para los registros compactos (.bin).
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_EXTRACTOR_LOG_H_
+#define INC_EXTRACTOR_LOG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "fatfs.h"
+#include "Registro_Compacto.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define LOG_BLOQUE             1024		// Lectura de la SD por paso: cabe la cabecera (configuración y columnas)
+#define LOG_MAX_FICHEROS       8		// Ficheros de una franja; con más se avisa de que va truncada
+#define LOG_BYTES_MAX          65536U	// Registros por comando; se sigue con otro desde ultimo_epoch
+#define LOG_NOMBRE_SIZE        13		// 8.3 y el nulo
+#define LOG_LINEAS_CABECERA    2		// "# configuración" y columnas del CSV o descripción del binario
+
+#define LOG_FIN                (-1)
+#define LOG_ERROR              (-2)
+
+
+/*--------Estado de la extracción------------------------*/
+typedef enum {LOG_INACTIVO=0, LOG_CABECERA, LOG_BUSCANDO, LOG_LEYENDO} faseLog;
+
+typedef struct
+{
+	bool binario;							// Registros compactos; si no, lineas CSV
+	uint32_t t0, t1;						// Franja, en segundos UTC, ambos incluidos
+	char fichero[LOG_MAX_FICHEROS][LOG_NOMBRE_SIZE];	// En orden de hora de inicio
+	uint8_t n_ficheros;
+	uint8_t actual;
+	faseLog fase;
+	uint32_t inicio_datos;					// Primer registro tras la cabecera
+	uint32_t bajo, alto;					// Bisección: antes de bajo todo es anterior a t0
+	uint32_t posicion;						// Siguiente registro a leer
+	uint32_t enviados;						// Bytes de registros entregados
+	uint32_t ultimo_epoch;					// Del último registro entregado
+	uint16_t pasos;							// Lecturas de la SD, para el informe
+	bool lleno;								// El último paso ha parado por falta de sitio en destino
+	bool truncado;							// Más ficheros que LOG_MAX_FICHEROS o más de LOG_BYTES_MAX
+
+}extractorLog;
+
+
+/* ------------------------------------------------- Variables ---------------------------------------------------------*/
+static uint8_t log_bloque[LOG_BLOQUE];
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+int  inicia_ExtractorLog(extractorLog* ext, FATFS* fs, const char* extension, bool binario, uint32_t t0, uint32_t t1);
+int  paso_ExtractorLog(extractorLog* ext, FATFS* fs, uint8_t* destino, uint16_t tam);
+
+static uint32_t inicio_FicheroLog(const char* nombre, const char* extension, uint32_t referencia);
+static uint32_t instante_RegistroLog(const extractorLog* ext, const uint8_t* p, uint32_t disponibles, uint16_t* longitud);
+static int  lee_BloqueLog(FIL* fichero, uint32_t posicion, UINT* leidos);
+static int  paso_CabeceraLog(extractorLog* ext, FIL* fichero);
+static void paso_BusquedaLog(extractorLog* ext, FIL* fichero);
+static int  paso_LecturaLog(extractorLog* ext, FIL* fichero, uint8_t* destino, uint16_t tam);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Elige los ficheros de la franja recorriendo el directorio raiz de la SD una vez. Monta y desmonta la SD.
+  * @param  ext: extracción a iniciar
+  * @param  fs: objeto FatFs de la aplicación
+  * @param  extension: EXTENSION_SD, "txt" o "bin"
+  * @param  binario: true para registros compactos
+  * @param  t0: inicio de la franja, segundos UTC
+  * @param  t1: fin de la franja, incluido
+  * @retval ficheros elegidos, o LOG_ERROR sin SD
+  */
+int inicia_ExtractorLog(extractorLog* ext, FATFS* fs, const char* extension, bool binario, uint32_t t0, uint32_t t1)
+{
+	DIR directorio;
+	FILINFO info;
+	char anterior[LOG_NOMBRE_SIZE] = "";
+	uint32_t inicio_anterior = 0;
+	uint32_t inicio[LOG_MAX_FICHEROS];
+	uint8_t n = 0;
+
+	memset(ext, 0, sizeof(*ext));
+	ext->binario = binario;
+	ext->t0 = t0;
+	ext->t1 = t1;
+
+	if ( (f_mount(fs, "", 1) != FR_OK) || (f_opendir(&directorio, "") != FR_OK) ) {
+		f_mount(NULL, "", 0);
+		return LOG_ERROR;
+	}
+
+	while ( (f_readdir(&directorio, &info) == FR_OK) && (info.fname[0] != '\0') ) {
+
+		uint32_t t = inicio_FicheroLog(info.fname, extension, t1);
+		uint8_t i = 0;
+
+		if ( (t == 0) || (t > t1) ) {
+			continue;
+		}
+		if (t <= t0) {	//solo hace falta el último que empieza antes de la franja
+			if (t >= inicio_anterior) {
+				inicio_anterior = t;
+				snprintf(anterior, sizeof(anterior), "%s", info.fname);
+			}
+			continue;
+		}
+
+		for (i = n; (i > 0) && (inicio[i - 1] > t); i--);	//insercion ordenada
+		if (i >= LOG_MAX_FICHEROS - 1) {
+			ext->truncado = true;	//sitio reservado para el anterior: se pierden los más tardios
+			continue;
+		}
+		if (n == LOG_MAX_FICHEROS - 1) {
+			ext->truncado = true;
+			n--;
+		}
+		memmove(&inicio[i + 1], &inicio[i], (n - i) * sizeof(inicio[0]));
+		memmove(ext->fichero[i + 1], ext->fichero[i], (n - i) * LOG_NOMBRE_SIZE);
+		inicio[i] = t;
+		snprintf(ext->fichero[i], LOG_NOMBRE_SIZE, "%s", info.fname);
+		n++;
+	}
+	f_closedir(&directorio);
+	f_mount(NULL, "", 0);
+
+	if (anterior[0] != '\0') {
+		memmove(ext->fichero[1], ext->fichero[0], n * LOG_NOMBRE_SIZE);
+		snprintf(ext->fichero[0], LOG_NOMBRE_SIZE, "%s", anterior);
+		n++;
+	}
+	ext->n_ficheros = n;
+	ext->fase = (n > 0) ? LOG_CABECERA : LOG_INACTIVO;
+	return n;
+}
+
+
+/**
+  * @brief  Un paso de la extracción: una lectura de la SD. Salta la cabecera del fichero, estrecha la bisección o
+  * copia en destino los registros de la franja que quepan enteros. Al pasar de t1, o al final del fichero, sigue
+  * con el siguiente.
+  * @param  ext: extracción en curso
+  * @param  fs: objeto FatFs de la aplicación
+  * @param  destino: registros de la franja, tal cual estan en el fichero
+  * @param  tam: tamaño de destino, al menos una linea del CSV
+  * @retval bytes copiados en destino (0 si el paso no ha dado registros), LOG_FIN o LOG_ERROR. Con ext->lleno el
+  * siguiente registro no cabía: hay que vaciar destino antes del siguiente paso
+  */
+int paso_ExtractorLog(extractorLog* ext, FATFS* fs, uint8_t* destino, uint16_t tam)
+{
+	FIL fichero;
+	int resultado = 0;
+
+	if ( (ext->fase == LOG_INACTIVO) || (ext->actual >= ext->n_ficheros) ) {
+		ext->fase = LOG_INACTIVO;
+		return LOG_FIN;
+	}
+
+	if (f_mount(fs, "", 1) != FR_OK) {
+		f_mount(NULL, "", 0);
+		return LOG_ERROR;
+	}
+	if (f_open(&fichero, ext->fichero[ext->actual], FA_READ) != FR_OK) {
+		f_mount(NULL, "", 0);
+		ext->actual++;	//borrado entre tanto: se sigue con el siguiente
+		ext->fase = LOG_CABECERA;
+		return 0;
+	}
+	ext->pasos++;
+	ext->lleno = false;
+
+	switch (ext->fase) {
+		case LOG_CABECERA:
+			resultado = paso_CabeceraLog(ext, &fichero);
+			break;
+		case LOG_BUSCANDO:
+			paso_BusquedaLog(ext, &fichero);
+			break;
+		default:
+			resultado = paso_LecturaLog(ext, &fichero, destino, tam);
+			break;
+	}
+
+	f_close(&fichero);
+	f_mount(NULL, "", 0);
+
+	if (resultado == LOG_FIN) {		//fichero terminado
+		ext->actual++;
+		ext->fase = (ext->truncado && (ext->enviados >= LOG_BYTES_MAX)) ? LOG_INACTIVO : LOG_CABECERA;
+		return 0;
+	}
+	return resultado;
+}
+
+
+/* Hora de inicio de un fichero MMDDhhmm.<extension>, en el año de referencia o en el anterior si saldría despues
+ * de ella; 0 si el nombre no es de un fichero de datos */
+static uint32_t inicio_FicheroLog(const char* nombre, const char* extension, uint32_t referencia)
+{
+	time_t instante = (time_t)referencia;
+	struct tm* fecha = gmtime(&instante);
+	int campo[4];
+	uint32_t t = 0;
+
+	for (uint8_t i = 0; i < 8; i++) {
+		if ( (nombre[i] < '0') || (nombre[i] > '9') ) return 0;
+	}
+	if ( (nombre[8] != '.') || (strlen(&nombre[9]) != strlen(extension)) ) {
+		return 0;
+	}
+	for (uint8_t i = 0; extension[i] != '\0'; i++) {	//FatFs sin LFN da el nombre en mayusculas
+		char c = nombre[9 + i];
+		if ( ((c | 0x20) != (extension[i] | 0x20)) ) return 0;
+	}
+	for (uint8_t i = 0; i < 4; i++) {
+		campo[i] = (nombre[2 * i] - '0') * 10 + (nombre[2 * i + 1] - '0');
+	}
+	if ( (campo[0] < 1) || (campo[0] > 12) || (campo[1] < 1) || (campo[1] > 31) || (campo[2] > 23) || (campo[3] > 59) ) {
+		return 0;
+	}
+
+	t = epoch_Fecha(fecha->tm_year + 1900, campo[0], campo[1], campo[2], campo[3], 0);
+	if (t > referencia) {
+		t = epoch_Fecha(fecha->tm_year + 1899, campo[0], campo[1], campo[2], campo[3], 0);
+	}
+	return t;
+}
+
+/* Instante del registro que empieza en p y su longitud (la linea con su '\n', o un registro compacto). Longitud 0 si
+ * no está entero en los bytes disponibles; instante 0 si es una linea sin fecha (cabecera) */
+static uint32_t instante_RegistroLog(const extractorLog* ext, const uint8_t* p, uint32_t disponibles, uint16_t* longitud)
+{
+	const uint8_t* fin = NULL;
+	int d = 0, m = 0, a = 0, h = 0, mi = 0, s = 0;
+	uint32_t t = 0;
+
+	*longitud = 0;
+	if (ext->binario) {
+		if (disponibles < sizeof(registroCompacto)) {
+			return 0;
+		}
+		*longitud = sizeof(registroCompacto);
+		memcpy(&t, p, sizeof(t));	//epoch, primer campo del registro, little-endian como el micro
+		return t;
+	}
+
+	fin = memchr(p, '\n', disponibles);
+	if (fin == NULL) {
+		return 0;
+	}
+	*longitud = (uint16_t)(fin - p + 1);
+	if ( (*longitud < 20) || (sscanf((const char*)p, "%2d-%2d-%4d;%2d:%2d:%2d;", &d, &m, &a, &h, &mi, &s) != 6) ) {
+		return 0;
+	}
+	return epoch_Fecha(a, m, d, h, mi, s);
+}
+
+/* Lee hasta LOG_BLOQUE bytes desde posicion; FR_OK o el error de FatFs */
+static int lee_BloqueLog(FIL* fichero, uint32_t posicion, UINT* leidos)
+{
+	int res = f_lseek(fichero, posicion);
+
+	*leidos = 0;
+	if (res == FR_OK) {
+		res = f_read(fichero, log_bloque, LOG_BLOQUE, leidos);
+	}
+	return res;
+}
+
+/* Salta las LOG_LINEAS_CABECERA lineas de texto del principio y deja preparada la bisección */
+static int paso_CabeceraLog(extractorLog* ext, FIL* fichero)
+{
+	UINT leidos = 0;
+	uint32_t p = 0;
+
+	if (lee_BloqueLog(fichero, 0, &leidos) != FR_OK) {
+		return LOG_FIN;
+	}
+	for (uint8_t linea = 0; linea < LOG_LINEAS_CABECERA; linea++) {
+		const uint8_t* fin = NULL;
+
+		if ( (p >= leidos) || (log_bloque[p] == '\0') ) {
+			return LOG_FIN;
+		}
+		fin = memchr(&log_bloque[p], '\n', leidos - p);
+		if (fin == NULL) {
+			return LOG_FIN;		//cabecera mayor que un bloque: no es un fichero de datos
+		}
+		p = (uint32_t)(fin - log_bloque) + 1;
+	}
+
+	ext->inicio_datos = p;
+	ext->bajo = p;
+	ext->alto = f_size(fichero);
+	ext->fase = LOG_BUSCANDO;
+	return 0;
+}
+
+/* Un paso de la bisección: el primer registro entero desde la mitad decide en qué mitad empieza la franja */
+static void paso_BusquedaLog(extractorLog* ext, FIL* fichero)
+{
+	UINT leidos = 0;
+	uint32_t medio = 0, registro = 0, t = 0;
+	uint16_t longitud = 0;
+	const uint8_t* salto = NULL;
+
+	if (ext->alto - ext->bajo <= LOG_BLOQUE) {
+		ext->posicion = ext->bajo;
+		ext->fase = LOG_LEYENDO;
+		return;
+	}
+
+	medio = ext->bajo + (ext->alto - ext->bajo) / 2;
+	if (ext->binario) {
+		medio -= (medio - ext->inicio_datos) % sizeof(registroCompacto);
+	}
+	if (lee_BloqueLog(fichero, medio, &leidos) != FR_OK) {
+		ext->alto = medio;
+		return;
+	}
+
+	if (!ext->binario) {	//se resincroniza con el principio de la siguiente linea
+		salto = memchr(log_bloque, '\n', leidos);
+		registro = (salto != NULL) ? (uint32_t)(salto - log_bloque) + 1 : leidos;
+	}
+	t = instante_RegistroLog(ext, &log_bloque[registro], leidos - registro, &longitud);
+
+	if ( (longitud > 0) && (t != 0) && (t < ext->t0) ) {
+		ext->bajo = medio + registro;
+	} else {
+		ext->alto = medio;
+	}
+}
+
+/* Copia los registros de la franja del bloque en posicion; LOG_FIN al pasar de t1 o al llegar al final */
+static int paso_LecturaLog(extractorLog* ext, FIL* fichero, uint8_t* destino, uint16_t tam)
+{
+	UINT leidos = 0;
+	uint32_t p = 0;
+	uint16_t escritos = 0, longitud = 0;
+
+	if ( (lee_BloqueLog(fichero, ext->posicion, &leidos) != FR_OK) ) {
+		return LOG_FIN;
+	}
+
+	while (p < leidos) {
+		uint32_t t = instante_RegistroLog(ext, &log_bloque[p], leidos - p, &longitud);
+
+		if (longitud == 0) {
+			break;		//registro a caballo entre bloques, o cortado al final del fichero
+		}
+		if (t > ext->t1) {
+			ext->posicion += p;
+			return (escritos > 0) ? escritos : LOG_FIN;	//el fichero se cierra en el siguiente paso
+		}
+		if ( (t != 0) && (t >= ext->t0) ) {
+			if (escritos + longitud > tam) {
+				ext->lleno = true;	//sigue en este registro en el siguiente paso
+				break;
+			}
+			if (ext->enviados + longitud > LOG_BYTES_MAX) {
+				ext->truncado = true;
+				ext->n_ficheros = ext->actual + 1;
+				ext->posicion += p;
+				return (escritos > 0) ? escritos : LOG_FIN;
+			}
+			memcpy(&destino[escritos], &log_bloque[p], longitud);
+			escritos += longitud;
+			ext->enviados += longitud;
+			ext->ultimo_epoch = t;
+		}
+		p += longitud;
+	}
+
+	ext->posicion += p;
+	if ( (p == 0) && !ext->lleno ) {
+		return LOG_FIN;		//nada entero que leer: final del fichero
+	}
+	return escritos;
+}
+
+#endif  /* INC_EXTRACTOR_LOG_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
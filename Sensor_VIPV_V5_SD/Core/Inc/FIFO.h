@@ -23,8 +23,10 @@ extern "C" {
 
 /* Includes ------------------------------------------------------------------*/
 #include "sensors_data.h"
+#include "Registro_Compacto.h"	//los nodos guardan el registro compacto, no el megaDato completo
 #include <stdlib.h>
 #include <stdio.h>
+#include "heap.h"		//reserva contabilizada en HEAP_CLASS_FIFO, para el monitor de memoria
 
 
 /*-----------------Estructuras de la lista dinamica, comportamiento FIFO: First Input First Output------------------*/
@@ -32,7 +34,7 @@ extern "C" {
 typedef struct elemento
 {
 	int indice ;
-	megaDato Dato;
+	registroCompacto Dato;
 	struct elemento *siguiente;
 }nodo;
 
@@ -45,10 +47,10 @@ typedef struct listaenlazada
 
 /*----------------Declaraciones de las funciones para manejar la lista dinamica-----------------------*/
 
-nodo* crearNodo(megaDato miDato);
+nodo* crearNodo(registroCompacto miDato);
 void liberarNodo(nodo* miNodo);
-bool insertarFIFO(fifo* mififo, megaDato miDato );
-megaDato* obtenerDatoFIFO(fifo* mififo);
+bool insertarFIFO(fifo* mififo, registroCompacto miDato );
+registroCompacto* obtenerDatoFIFO(fifo* mififo);
 bool eliminarDatoFIFO(fifo* mififo) ;
 int estaFIFOvacia(fifo* mififo);
 
@@ -57,13 +59,12 @@ int estaFIFOvacia(fifo* mififo);
 
 
 /* A no usar por el usuario, invocar a la funcion insertarFIFO()*/
-nodo* crearNodo(megaDato miDato)  {
+nodo* crearNodo(registroCompacto miDato)  {
 	nodo* nuevo = NULL;
 
-	nuevo = (nodo*) malloc( sizeof(nodo) );
+	nuevo = (nodo*) heap_class_alloc(HEAP_CLASS_FIFO, 1, sizeof(nodo) );
 
-		 if( nuevo == NULL) {
-			 free(nuevo);
+		 if( nuevo == NULL) {	//contado como fallo de la clase FIFO
 			 return NULL;
 		 }
 
@@ -77,12 +78,12 @@ nodo* crearNodo(megaDato miDato)  {
 /* A no usar por el usuario, invocar a la funcion eliminaDatoFIFO()*/
 void liberarNodo(nodo* miNodo) {
 
-	free(miNodo);
+	heap_class_free(HEAP_CLASS_FIFO, miNodo);
 }
 
 /* Crea un nodo al final de la lista enlazada y lo rellena con el dato,
  *  a invocar como primera funcion*/
-bool insertarFIFO(fifo* mififo, megaDato miDato )  {
+bool insertarFIFO(fifo* mififo, registroCompacto miDato )  {
 
 	nodo* miNodo = crearNodo(miDato);
 	int contador = 0;
@@ -117,7 +118,7 @@ bool insertarFIFO(fifo* mififo, megaDato miDato )  {
 
 /*Devuelve el dato almacenado en la cabecera de la lista enlazada,
  * si está vacía, devuelve NULL. A invocar la segunda función*/
-megaDato* obtenerDatoFIFO(fifo* mififo)  {
+registroCompacto* obtenerDatoFIFO(fifo* mififo)  {
 
 	if(mififo->cabecera == NULL) {	//si la lista esta vacía
 		printf("Fallo al extraer dato de la FIFO. Lista dinamica esta vacia. \n");
@@ -0,0 +1,318 @@
+/******************************************************************************
+* @file    Fusion_Adaptativa.h
+* @author  Sergio Vera Muñoz
+* @brief   Politica de frecuencia y motor de fusión de Motion-FX segun el estado
+* del vehiculo. Con el vehiculo parado (velocidad GPS y varianza del acelerometro
+* bajas durante un tiempo) se baja la frecuencia del TIM6 y se pasa al motor 6X,
+* dejando de leer el magnetometro. Con movimiento se vuelve de inmediato a la
+* frecuencia nominal y al motor 9X. Si el error de rumbo del 9X indica perturbación
+* magnética, se usa el 6X hasta que el error se recupere. El delta_time que recibe
+* el filtro de Kalman es siempre el del periodo vigente.
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_FUSION_ADAPTATIVA_H_
+#define INC_FUSION_ADAPTATIVA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "mi_MEMS.h"
+#include "Actitud_MEMS.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define FREC_BASE_TIM6			10000U		// 80 MHz / Prescaler 8000 del MX_TIM6_Init, en [Hz]
+#define FREC_FUSION_PARADO		10.0f		// Frecuencia de fusión con el vehiculo parado, divisor entero de FREC_BASE_TIM6
+
+#define VELOCIDAD_PARADO		2.0f		// Velocidad GPS por debajo de la cual se considera parado, en [km/h]
+#define VARIANZA_ACC_PARADO		(0.02f*0.02f)	// Varianza del modulo de la aceleracion en un segundo, en [g^2]
+#define SEGUNDOS_PARA_PARADO	30			// Segundos seguidos cumpliendo ambas condiciones para bajar la frecuencia
+
+#define ERROR_RUMBO_PERTURBADO	15.0f		// headingErr_9X a partir del cual el magnetometro no es fiable, en [º]
+#define ERROR_RUMBO_RECUPERADO	5.0f		// headingErr_9X por debajo del cual se vuelve a confiar en el, en [º]
+#define SEGUNDOS_MAG_ESTABLE	5			// Segundos seguidos con error bajo para volver al 9X tras una perturbación
+#define TICKS_SOLAPE_MOTORES	10			// Iteraciones con ambos motores activos antes de soltar el 9X
+
+
+/*--------Estado de la politica de fusión------------------------*/
+typedef enum {FUSION_MOVIMIENTO=0, FUSION_PARADO} modoFusion;
+
+typedef struct
+{
+	modoFusion modo;
+	float frecuencia;				// Frecuencia vigente del TIM6, en [Hz]
+	float frec_nominal;				// Frecuencia en movimiento, frec_fusion_hz de la configuración, en [Hz]
+	bool motor_9X;					// Motor cuya salida se entrega al acumulador de actitud
+	bool perturbacion_mag;			// headingErr_9X fuera de rango, se mantiene el 6X aunque haya movimiento
+	uint8_t ticks_solape;			// >0 mientras ambos motores corren para enganchar el rumbo del 6X al del 9X
+	float offset_guinada;			// Giro en Z que se aplica a la salida del 6X, en [º]
+	float error_rumbo_max;			// Maximo headingErr_9X del ultimo segundo, en [º]
+	uint16_t segundos_quieto;
+	uint16_t segundos_mag_ok;
+
+	uint32_t n_acc;					// Welford del modulo de la aceleración en el segundo en curso
+	float media_acc;
+	float m2_acc;
+
+	uint32_t ticks_9X, ticks_6X;		// Iteraciones ejecutadas con cada motor
+	uint32_t us_9X, us_6X;				// Tiempo de CPU de MotionFX con cada motor, en [us]
+	uint32_t despertares_ahorrados;		// Interrupciones del TIM6 evitadas respecto a frec_nominal
+	uint32_t cambios_modo;
+
+}estadoFusion;
+
+
+/* ------------------------------------------------- Variables ---------------------------------------------------------*/
+static estadoFusion fusion;
+
+extern TIM_HandleTypeDef htim6;
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+void inicia_FusionAdaptativa(float frec_nominal);
+void computa_FusionAdaptativa(float quaternion[4]);
+void evalua_FusionAdaptativa(float velocidad, bool ubicacion_fix);
+void imprime_EstadisticasFusion(void);
+
+static void programa_FrecuenciaFusion(float frecuencia);
+static void selecciona_MotorFusion(bool usa_9X);
+static float guinada_Cuaternion(const float q[4]);
+static void rota_Guinada(float q[4], float grados);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Arranca la politica en movimiento: frecuencia nominal y motor 9X, como deja MX_MEMS_Init(). Se invoca
+  * antes de arrancar el TIM6, ya que un paro previo pudo dejar el ARR en la frecuencia de parado.
+  * @param  frec_nominal: frecuencia en movimiento, entre FREC_FUSION_PARADO y ALGORITHM_FREQ, en [Hz]
+  * @retval None
+  */
+void inicia_FusionAdaptativa(float frec_nominal)
+{
+	memset(&fusion, 0, sizeof(fusion));
+	fusion.frec_nominal = frec_nominal;
+	fusion.modo = FUSION_MOVIMIENTO;
+	fusion.motor_9X = true;
+
+	MotionFX_enable_6X(MFX_ENGINE_DISABLE);
+	MotionFX_enable_9X(MFX_ENGINE_ENABLE);
+	programa_FrecuenciaFusion(fusion.frec_nominal);
+}
+
+
+/**
+  * @brief  Una iteración de fusión, invocada en cada tick del TIM6. Lee el magnetometro solo si corre el 9X,
+  * pasa a Motion-FX el periodo vigente y devuelve el cuaternion del motor activo. La salida del 6X se gira en Z
+  * para continuar el rumbo que tenia el 9X al soltarlo, ya que el 6X no tiene referencia de norte.
+  * @param  quaternion: vector de 4 elementos (x, y, z, w) donde se devuelve la orientación estimada
+  * @retval None
+  */
+void computa_FusionAdaptativa(float quaternion[4])
+{
+	MFX_output_t salida;
+	float modulo_acc, delta;
+	bool corre_9X = fusion.motor_9X || (fusion.ticks_solape > 0);
+
+	memset(&salida, 0, sizeof(salida));
+	MX_MEMS_Process(&salida, 1.0f / fusion.frecuencia, corre_9X);
+
+	if (corre_9X) { fusion.ticks_9X++;  fusion.us_9X += tiempo_FX_us; }
+	else 		  { fusion.ticks_6X++;  fusion.us_6X += tiempo_FX_us; }
+
+	/* Varianza del modulo de la aceleración (independiente de la orientación), algoritmo de Welford */
+	modulo_acc = sqrtf((float)(AccValue.x*AccValue.x + AccValue.y*AccValue.y + AccValue.z*AccValue.z)) * FROM_MG_TO_G;
+	fusion.n_acc++;
+	delta = modulo_acc - fusion.media_acc;
+	fusion.media_acc += delta / (float)fusion.n_acc;
+	fusion.m2_acc += delta * (modulo_acc - fusion.media_acc);
+
+	if (corre_9X && salida.headingErr_9X > fusion.error_rumbo_max) {
+		fusion.error_rumbo_max = salida.headingErr_9X;
+	}
+
+	if (fusion.ticks_solape > 0) {		//ambos motores activos: se engancha el rumbo del 6X al del 9X
+		fusion.offset_guinada = guinada_Cuaternion(salida.quaternion_9X) - guinada_Cuaternion(salida.quaternion_6X);
+		memcpy(quaternion, salida.quaternion_9X, 4*sizeof(float));
+
+		if (--fusion.ticks_solape == 0) {
+			MotionFX_enable_9X(MFX_ENGINE_DISABLE);
+		}
+	}
+	else if (fusion.motor_9X) {
+		memcpy(quaternion, salida.quaternion_9X, 4*sizeof(float));
+	}
+	else {
+		memcpy(quaternion, salida.quaternion_6X, 4*sizeof(float));
+		rota_Guinada(quaternion, fusion.offset_guinada);
+	}
+}
+
+
+/**
+  * @brief  Decide una vez por segundo el modo y el motor a partir de la velocidad GPS, la varianza del
+  * acelerometro y el error de rumbo del 9X acumulados en el segundo. Sin fix GPS solo decide el acelerometro.
+  * La bajada de frecuencia exige SEGUNDOS_PARA_PARADO seguidos; la subida es inmediata.
+  * @param  velocidad: ultima velocidad GPS en [km/h]
+  * @param  ubicacion_fix: si el GPS tiene posición valida en este segundo
+  * @retval None
+  */
+void evalua_FusionAdaptativa(float velocidad, bool ubicacion_fix)
+{
+	float varianza = (fusion.n_acc > 1) ? (fusion.m2_acc / (float)(fusion.n_acc - 1)) : 0.0f;
+	bool quieto = (varianza < VARIANZA_ACC_PARADO) && ( !ubicacion_fix || !noesNAN(velocidad) || (velocidad < VELOCIDAD_PARADO) );
+	modoFusion modo_anterior = fusion.modo;
+
+	if (fusion.n_acc == 0) {		//sin iteraciones en este segundo no hay información para decidir
+		return;
+	}
+
+	if (fusion.modo == FUSION_PARADO) {
+		fusion.despertares_ahorrados += (uint32_t)(fusion.frec_nominal - FREC_FUSION_PARADO);
+	}
+
+	/* Perturbación magnetica, con histeresis, solo observable mientras corre el 9X */
+	if (fusion.motor_9X && fusion.error_rumbo_max > ERROR_RUMBO_PERTURBADO) {
+		fusion.perturbacion_mag = true;
+		fusion.segundos_mag_ok = 0;
+	}
+	else if (fusion.perturbacion_mag) {
+		if (fusion.error_rumbo_max < ERROR_RUMBO_RECUPERADO) {	//durante el 6X el error se queda a 0: se reintenta el 9X
+			if (++fusion.segundos_mag_ok >= SEGUNDOS_MAG_ESTABLE)
+				fusion.perturbacion_mag = false;
+		}
+		else { fusion.segundos_mag_ok = 0; }
+	}
+
+	if (quieto) {
+		if (fusion.segundos_quieto < SEGUNDOS_PARA_PARADO)
+			fusion.segundos_quieto++;
+	}
+	else { fusion.segundos_quieto = 0; }
+
+	fusion.modo = (fusion.segundos_quieto >= SEGUNDOS_PARA_PARADO) ? FUSION_PARADO : FUSION_MOVIMIENTO;
+
+	if (fusion.modo != modo_anterior) {
+		programa_FrecuenciaFusion( (fusion.modo == FUSION_PARADO) ? FREC_FUSION_PARADO : fusion.frec_nominal );
+		fusion.cambios_modo++;
+		imprime_EstadisticasFusion();
+	}
+
+	selecciona_MotorFusion( (fusion.modo == FUSION_MOVIMIENTO) && !fusion.perturbacion_mag );
+
+	fusion.n_acc = 0;  fusion.media_acc = 0.0f;  fusion.m2_acc = 0.0f;
+	fusion.error_rumbo_max = 0.0f;
+}
+
+
+/**
+  * @brief  Muestra por consola el modo actual y el ahorro acumulado. El tiempo de CPU ahorrado se estima con el
+  * coste medio medido de una iteración 9X: ticks no ejecutados más la diferencia de coste de las iteraciones 6X.
+  * @retval None
+  */
+void imprime_EstadisticasFusion(void)
+{
+	uint32_t us_medio_9X = (fusion.ticks_9X > 0) ? (fusion.us_9X / fusion.ticks_9X) : 0;
+	uint32_t us_medio_6X = (fusion.ticks_6X > 0) ? (fusion.us_6X / fusion.ticks_6X) : 0;
+	uint32_t us_ahorrados = fusion.despertares_ahorrados * us_medio_9X;
+
+	if (us_medio_9X > us_medio_6X) {
+		us_ahorrados += fusion.ticks_6X * (us_medio_9X - us_medio_6X);
+	}
+
+	printf("Fusion MEMS: modo %s a %.0f Hz, motor %s%s. Iteraciones 9X: %lu (%lu us/it), 6X: %lu (%lu us/it). "
+			"Despertares ahorrados: %lu, CPU ahorrada: %lu ms\n",
+			(fusion.modo == FUSION_PARADO) ? "PARADO" : "MOVIMIENTO", fusion.frecuencia,
+			fusion.motor_9X ? "9X" : "6X", fusion.perturbacion_mag ? " (perturbacion magnetica)" : "",
+			(unsigned long)fusion.ticks_9X, (unsigned long)us_medio_9X,
+			(unsigned long)fusion.ticks_6X, (unsigned long)us_medio_6X,
+			(unsigned long)fusion.despertares_ahorrados, (unsigned long)(us_ahorrados / 1000U));
+}
+
+
+/**
+  * @brief  Reprograma el periodo del TIM6 en caliente. El ARR no tiene precarga (MX_TIM6_Init), así que se
+  * reinicia el contador para que el primer periodo tras el cambio sea completo y coincida con el delta_time.
+  * @param  frecuencia: nueva frecuencia de fusión en [Hz]
+  * @retval None
+  */
+static void programa_FrecuenciaFusion(float frecuencia)
+{
+	__HAL_TIM_SET_AUTORELOAD(&htim6, (uint32_t)((float)FREC_BASE_TIM6 / frecuencia) - 1U);
+	__HAL_TIM_SET_COUNTER(&htim6, 0);
+	fusion.frecuencia = frecuencia;
+}
+
+
+/**
+  * @brief  Cambia el motor que alimenta la actitud. Al pasar a 6X se activa primero y ambos corren
+  * TICKS_SOLAPE_MOTORES iteraciones para calcular el giro en Z que alinea los rumbos; al volver a 9X se usa su
+  * salida directamente, ya referida al norte magnetico.
+  * @param  usa_9X: motor deseado
+  * @retval None
+  */
+static void selecciona_MotorFusion(bool usa_9X)
+{
+	if (usa_9X == fusion.motor_9X) {
+		return;
+	}
+
+	if (usa_9X) {
+		MotionFX_enable_9X(MFX_ENGINE_ENABLE);
+		MotionFX_enable_6X(MFX_ENGINE_DISABLE);
+		fusion.ticks_solape = 0;
+	}
+	else {
+		MotionFX_enable_6X(MFX_ENGINE_ENABLE);
+		fusion.ticks_solape = TICKS_SOLAPE_MOTORES;
+	}
+	fusion.motor_9X = usa_9X;
+}
+
+
+/**
+  * @brief  Guiñada (Z-Y-X, NED) de un cuaternion (x, y, z, w), mismo convenio que media_Actitud()
+  * @retval Angulo en grados
+  */
+static float guinada_Cuaternion(const float q[4])
+{
+	return rad2deg( atan2f(2.0f*(q[QW]*q[QZ] + q[QX]*q[QY]), 1.0f - 2.0f*(q[QY]*q[QY] + q[QZ]*q[QZ])) );
+}
+
+
+/**
+  * @brief  Aplica un giro en el eje Z del sistema de referencia (q' = qz * q). Suma 'grados' a la guiñada sin
+  * modificar alabeo ni cabeceo.
+  * @param  q: cuaternion (x, y, z, w) a girar, se modifica en el sitio
+  * @param  grados: giro en grados
+  * @retval None
+  */
+static void rota_Guinada(float q[4], float grados)
+{
+	float c = cosf(deg2rad(grados) * 0.5f), s = sinf(deg2rad(grados) * 0.5f);
+	float x = q[QX], y = q[QY], z = q[QZ], w = q[QW];
+
+	q[QX] = c*x - s*y;
+	q[QY] = c*y + s*x;
+	q[QZ] = c*z + s*w;
+	q[QW] = c*w - s*z;
+}
+
+#endif  /* INC_FUSION_ADAPTATIVA_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
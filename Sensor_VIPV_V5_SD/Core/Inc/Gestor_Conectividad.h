@@ -0,0 +1,423 @@
+/******************************************************************************
+* @file    Gestor_Conectividad.h
+* @author  Sergio Vera Muñoz
+* @brief   Gestor de la conectividad en segundo plano: máquina de estados sin enlace,
+* asociando, IP, hora, TLS, MQTT, enlazada y reposo, que da como mucho un paso por
+* llamada. Cada paso lo ejecuta una acción del llamante (accionesRed), de modo que el
+* bucle principal solo se retiene lo que dura ese paso y la adquisición no se para.
+* Tras un paso fallido se espera con backoff exponencial y jitter (mitad fija, mitad
+* al azar) entre ESPERA_MIN_RED_MS y ESPERA_MAX_RED_MS; la espera vuelve al mínimo al
+* enlazar. Del último AP visto se guardan BSSID, canal y RSSI: con la caché reciente
+* se intenta primero un rejoin rápido, sin reiniciar el modulo; sin ella la acción
+* localiza_AP elige la red (ver Redes_Conocidas.h) y no se intenta la asociación si
+* no hay ninguna a la vista.
+* Mide el tiempo de cada recuperación y el paso más largo de cada estado.
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_GESTOR_CONECTIVIDAD_H_
+#define INC_GESTOR_CONECTIVIDAD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "main.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define ESPERA_MIN_RED_MS        2000U		// Espera tras el primer paso fallido
+#define ESPERA_MAX_RED_MS        120000U	// Tope del backoff: sin AP a la vista, un scan cada 1 a 2 min
+#define CADUCIDAD_CACHE_AP_MS    600000U	// Un AP visto hace más de 10 min se vuelve a buscar antes de asociarse
+#define INTENTOS_REJOIN_RAPIDO   2			// Rejoins sin reiniciar el modulo antes de la asociación completa
+#define INTENTOS_IP_RED          3			// Comprobaciones sin dirección antes de volver a asociarse
+#define INTENTOS_SESION_RED      3			// Fallos seguidos de socket o sesión MQTT antes de comprobar la IP
+#define INTENTOS_HORA_RED        3			// Intentos de fijar el RTC desde la red antes de seguir sin él
+#define INTENTOS_SCAN_RED        8			// Scans sin ninguna red a la vista antes de reiniciar el modulo con una asociación completa
+#define RED_TEXTO_SIZE           768		// Informe completo para la consola
+
+
+/*--------Fases, caché del AP y acciones del llamante------------------------*/
+typedef enum {RED_SIN_ENLACE=0, RED_ASOCIANDO, RED_IP, RED_HORA, RED_TLS, RED_MQTT, RED_ENLAZADA, RED_REPOSO, N_FASES_RED} faseRed;
+
+typedef struct
+{
+	bool valido;
+	bool sin_scan;					// Red recordada para la zona, sin scan: si no se asocia a la primera se hace el scan
+	uint8_t bssid[6];
+	uint8_t canal;
+	int16_t rssi;
+	uint32_t t_visto;				// HAL_GetTick() del último scan o dirección IP con este AP
+
+}cacheAP;
+
+typedef struct
+{
+	bool (*localiza_AP)(cacheAP* ap);	// Elige la red: true si hay una conocida a la vista (o recordada), con su BSSID, canal y RSSI
+	bool (*asocia)(bool rapido);		// rapido: sin reiniciar el modulo. La primera vez siempre es completa
+	bool (*tiene_IP)(void);				// Asociado al AP y con dirección
+	bool (*fija_Hora)(void);			// RTC desde la red
+	bool (*abre_Socket)(void);			// Socket TCP y handshake TLS con el broker
+	bool (*conecta_MQTT)(void);			// Sesión MQTT sobre el socket abierto
+	bool (*enlazada)(void);				// Sesión viva, según los envíos del llamante
+	void (*cierra)(void);				// Cierra la sesión MQTT y el socket, esten como esten
+
+}accionesRed;
+
+
+/*--------Estadistica y estado del gestor------------------------*/
+typedef struct
+{
+	uint32_t n_caidas;
+	uint32_t recuperacion_ult_ms;	// Desde la caida (o el arranque) hasta volver a enlazar
+	uint32_t recuperacion_max_ms;
+	uint32_t n_rejoin_rapido;
+	uint32_t n_rejoin_completo;
+	uint32_t n_scans;
+	uint32_t n_pasos[N_FASES_RED];
+	uint32_t n_fallos[N_FASES_RED];
+	uint32_t paso_max_ms[N_FASES_RED];	// Lo más que ha retenido el bucle principal un paso de cada fase
+
+}estadisticaRed;
+
+typedef struct
+{
+	const accionesRed* acciones;
+	faseRed fase;
+	bool con_nube;					// Sin nube, la red solo se usa para fijar el RTC
+	bool modulo_iniciado;			// Tras una asociación completa (WIFI_Init): ya se puede hacer scan
+	bool caida_en_curso;
+	uint8_t fallos_seguidos;		// Pasos fallidos desde el último enlace, exponente del backoff
+	uint8_t fallos_fase;			// Pasos fallidos seguidos de la fase actual
+	uint8_t fallos_sesion;			// Fallos seguidos de TLS o MQTT
+	uint8_t intentos_hora;
+	uint32_t t_reintento;			// HAL_GetTick() a partir del cual se puede dar el siguiente paso
+	uint32_t espera_ms;				// Última espera calculada
+	uint32_t t_caida;
+	uint32_t semilla;				// xorshift32 del jitter
+	cacheAP ap;
+	estadisticaRed est;
+
+}gestorRed;
+
+static const char* const NOMBRE_FASE_RED[N_FASES_RED] = {
+	"SIN ENLACE", "ASOCIANDO", "IP", "HORA", "TLS", "MQTT", "ENLAZADA", "REPOSO"
+};
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+void inicia_GestorRed(gestorRed* g, const accionesRed* acciones, bool con_nube, uint32_t semilla);
+bool servicio_GestorRed(gestorRed* g);
+void adelanta_GestorRed(gestorRed* g);
+uint32_t espera_GestorRed(gestorRed* g);
+int  informe_GestorRed(const gestorRed* g, char* texto, size_t tam);
+
+static void paso_Hecho(gestorRed* g, faseRed siguiente);
+static void paso_Fallido(gestorRed* g, uint8_t intentos, faseRed alternativa);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Deja la red pendiente de levantar desde el principio, con el primer paso en la siguiente llamada
+  * @param  g: gestor
+  * @param  acciones: pasos del llamante (estáticos)
+  * @param  con_nube: false para solo fijar la hora y quedarse en reposo
+  * @param  semilla: semilla del jitter, distinta en cada sensor (p. ej. el UID del micro)
+  * @retval None
+  */
+void inicia_GestorRed(gestorRed* g, const accionesRed* acciones, bool con_nube, uint32_t semilla)
+{
+	memset(g, 0, sizeof(*g));
+	g->acciones = acciones;
+	g->con_nube = con_nube;
+	g->fase = RED_SIN_ENLACE;
+	g->semilla = (semilla != 0) ? semilla : 0x9E3779B9U;
+	g->t_reintento = HAL_GetTick();
+	g->t_caida = g->t_reintento;	// La primera recuperación es la del arranque
+	g->caida_en_curso = true;
+}
+
+
+/**
+  * @brief  Da como mucho un paso de la puesta en marcha o de la recuperación de la red. Enlazada, solo pregunta al
+  * llamante si la sesión sigue viva; si ha caido la cierra y sigue por TLS si aun hay IP, o por el AP si no.
+  * @param  g: gestor
+  * @retval true si ha dado un paso, false si estaba enlazada, en reposo o esperando
+  */
+bool servicio_GestorRed(gestorRed* g)
+{
+	uint32_t t_inicio = HAL_GetTick();
+	faseRed fase = g->fase;
+	bool exito = false;
+
+	if (fase == RED_REPOSO) {
+		return false;
+	}
+
+	if (fase == RED_ENLAZADA) {
+
+		if (g->acciones->enlazada()) {
+			return false;
+		}
+		g->est.n_caidas++;
+		g->caida_en_curso = true;
+		g->t_caida = t_inicio;
+		g->fallos_seguidos = 0;
+		g->fallos_fase = 0;
+		g->fallos_sesion = 0;
+		g->acciones->cierra();
+		g->fase = g->acciones->tiene_IP() ? RED_TLS : RED_SIN_ENLACE;	// Sin IP, la caché del AP da el rejoin rápido
+		g->t_reintento = HAL_GetTick();
+		return true;
+	}
+
+	if ( (int32_t)(t_inicio - g->t_reintento) < 0 ) {
+		return false;
+	}
+
+	switch (fase) {
+
+	case RED_SIN_ENLACE:	// Solo decide si merece la pena asociarse: el scan requiere el modulo ya iniciado
+		if ( !g->modulo_iniciado || (g->ap.valido && (t_inicio - g->ap.t_visto < CADUCIDAD_CACHE_AP_MS)) ) {
+			exito = true;
+		}
+		else {
+			g->ap.valido = g->acciones->localiza_AP(&g->ap);
+			g->ap.t_visto = HAL_GetTick();
+			g->est.n_scans += (g->ap.valido && g->ap.sin_scan) ? 0 : 1;
+			exito = g->ap.valido;
+		}
+		if (exito) {
+			paso_Hecho(g, RED_ASOCIANDO);
+		}
+		else {
+			paso_Fallido(g, INTENTOS_SCAN_RED, RED_ASOCIANDO);
+			if (g->fase == RED_ASOCIANDO) {
+				g->modulo_iniciado = false;		// Nada a la vista en varios scans: puede que el modulo no responda
+			}
+		}
+		break;
+
+	case RED_ASOCIANDO: {
+		bool rapido = g->modulo_iniciado && (g->fallos_fase < INTENTOS_REJOIN_RAPIDO);
+
+		if (rapido) {
+			g->est.n_rejoin_rapido++;
+		}
+		else {
+			g->est.n_rejoin_completo++;
+		}
+		exito = g->acciones->asocia(rapido);
+		g->modulo_iniciado |= !rapido;
+		if (exito) {
+			paso_Hecho(g, RED_IP);
+		}
+		else if (!rapido || g->ap.sin_scan) {
+			g->ap.valido = false;	// Ni el modulo recién iniciado se asocia, o la red de la zona no está: se busca con un scan
+			paso_Fallido(g, 1, RED_SIN_ENLACE);
+		}
+		else {
+			paso_Fallido(g, 0, RED_ASOCIANDO);
+		}
+		break;
+	}
+
+	case RED_IP:
+		exito = g->acciones->tiene_IP();
+		if (exito) {
+			g->ap.t_visto = HAL_GetTick();
+			paso_Hecho(g, (g->intentos_hora < INTENTOS_HORA_RED) ? RED_HORA : ((g->con_nube) ? RED_TLS : RED_REPOSO));
+		}
+		else {
+			paso_Fallido(g, INTENTOS_IP_RED, RED_ASOCIANDO);
+		}
+		break;
+
+	case RED_HORA:
+		exito = g->acciones->fija_Hora();
+		if (exito) {
+			g->intentos_hora = INTENTOS_HORA_RED;	// No se vuelve a pedir tras una reasociación
+		}
+		else if (++g->intentos_hora >= INTENTOS_HORA_RED) {
+			exito = true;		// Se sigue con la hora actual
+		}
+		if (exito) {
+			paso_Hecho(g, (g->con_nube) ? RED_TLS : RED_REPOSO);
+		}
+		else {
+			paso_Fallido(g, 0, RED_HORA);
+		}
+		break;
+
+	case RED_TLS:
+		exito = g->acciones->abre_Socket();
+		if (exito) {
+			paso_Hecho(g, RED_MQTT);
+		}
+		else {
+			g->acciones->cierra();
+			paso_Fallido(g, 0, RED_TLS);
+		}
+		break;
+
+	case RED_MQTT:
+		exito = g->acciones->conecta_MQTT();
+		if (exito) {
+			paso_Hecho(g, RED_ENLAZADA);
+		}
+		else {
+			g->acciones->cierra();
+			paso_Fallido(g, 1, RED_TLS);	// Con el socket cerrado se vuelve a abrir, no se reintenta la sesión sobre él
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	/* TLS y MQTT cuentan juntos: tras INTENTOS_SESION_RED fallos se comprueba el enlace con el AP */
+	if ( (fase == RED_TLS) || (fase == RED_MQTT) ) {
+		g->fallos_sesion = exito ? g->fallos_sesion : (uint8_t)(g->fallos_sesion + 1);
+		if (g->fallos_sesion >= INTENTOS_SESION_RED) {
+			g->fallos_sesion = 0;
+			g->fallos_fase = 0;			// La IP tiene sus INTENTOS_IP_RED comprobaciones
+			g->fase = RED_IP;
+		}
+	}
+
+	if ( (uint32_t)(HAL_GetTick() - t_inicio) > g->est.paso_max_ms[fase] ) {
+		g->est.paso_max_ms[fase] = HAL_GetTick() - t_inicio;
+	}
+	return true;
+}
+
+
+/**
+  * @brief  Adelanta el siguiente intento sin tocar el backoff, p. ej. al llegar a una zona con red conocida: solo
+  * sin enlace con el AP, la sesión se sigue reintentando a su ritmo
+  * @param  g: gestor
+  * @retval None
+  */
+void adelanta_GestorRed(gestorRed* g)
+{
+	if ( (g->fase == RED_ASOCIANDO) && !g->modulo_iniciado && (g->est.n_rejoin_completo > 0) ) {
+		g->modulo_iniciado = true;		// En lugar del reinicio tras INTENTOS_SCAN_RED scans vacios, un scan en la zona nueva
+		g->fase = RED_SIN_ENLACE;
+	}
+	if ( (g->fase == RED_SIN_ENLACE) || (g->fase == RED_ASOCIANDO) ) {
+		g->t_reintento = HAL_GetTick();
+	}
+}
+
+
+/**
+  * @brief  Espera antes del siguiente intento: ESPERA_MIN_RED_MS * 2^(fallos - 1) hasta ESPERA_MAX_RED_MS, de la que
+  * la mitad es fija y la otra mitad al azar, para que los sensores que pierden el mismo AP no vuelvan a la vez
+  * @param  g: gestor, con fallos_seguidos ya incrementado
+  * @retval espera en ms
+  */
+uint32_t espera_GestorRed(gestorRed* g)
+{
+	uint32_t tope = ESPERA_MIN_RED_MS;
+
+	for (uint8_t i = 1; (i < g->fallos_seguidos) && (tope < ESPERA_MAX_RED_MS); i++) {
+		tope <<= 1;
+	}
+	if (tope > ESPERA_MAX_RED_MS) {
+		tope = ESPERA_MAX_RED_MS;
+	}
+
+	g->semilla ^= g->semilla << 13;		// xorshift32
+	g->semilla ^= g->semilla >> 17;
+	g->semilla ^= g->semilla << 5;
+
+	return tope / 2U + g->semilla % (tope / 2U + 1U);
+}
+
+
+/**
+  * @brief  Informe para la consola: fase, caché del AP, recuperaciones y paso más largo de cada fase
+  * @param  g: gestor
+  * @param  texto: destino, RED_TEXTO_SIZE basta
+  * @param  tam: tamaño del destino
+  * @retval caracteres escritos
+  */
+int informe_GestorRed(const gestorRed* g, char* texto, size_t tam)
+{
+	size_t n = 0;
+
+	n += snprintf(&texto[n], tam - n, "Red: %s, %lu caidas, recuperacion ultima %lu ms (max %lu), rejoins %lu rapidos y %lu "
+				  "completos, %lu scans, espera actual %lu ms\n", NOMBRE_FASE_RED[g->fase], (unsigned long)g->est.n_caidas,
+				  (unsigned long)g->est.recuperacion_ult_ms, (unsigned long)g->est.recuperacion_max_ms,
+				  (unsigned long)g->est.n_rejoin_rapido, (unsigned long)g->est.n_rejoin_completo,
+				  (unsigned long)g->est.n_scans, (unsigned long)g->espera_ms);
+	if ( g->ap.valido && (n < tam) ) {
+		n += snprintf(&texto[n], tam - n, "  AP %02X:%02X:%02X:%02X:%02X:%02X canal %u, %d dBm\n", g->ap.bssid[0],
+					  g->ap.bssid[1], g->ap.bssid[2], g->ap.bssid[3], g->ap.bssid[4], g->ap.bssid[5], g->ap.canal, g->ap.rssi);
+	}
+	for (uint8_t i = 0; (i < N_FASES_RED) && (n < tam); i++) {
+		if (g->est.n_pasos[i] > 0) {
+			n += snprintf(&texto[n], tam - n, "  %-10s %5lu pasos, %5lu fallidos, paso max %6lu ms\n", NOMBRE_FASE_RED[i],
+						  (unsigned long)g->est.n_pasos[i], (unsigned long)g->est.n_fallos[i], (unsigned long)g->est.paso_max_ms[i]);
+		}
+	}
+	return (n < tam) ? (int)n : (int)tam - 1;
+}
+
+
+/* Paso correcto: siguiente fase sin esperar. Al enlazar se cierra la recuperación y el backoff vuelve al mínimo */
+static void paso_Hecho(gestorRed* g, faseRed siguiente)
+{
+	g->est.n_pasos[g->fase]++;
+	g->fase = siguiente;
+	g->fallos_fase = 0;
+	g->t_reintento = HAL_GetTick();
+
+	if ( (siguiente == RED_ENLAZADA) || (siguiente == RED_REPOSO) ) {
+		g->fallos_seguidos = 0;
+		g->fallos_sesion = 0;
+		g->espera_ms = 0;
+		if (g->caida_en_curso) {
+			g->caida_en_curso = false;
+			g->est.recuperacion_ult_ms = HAL_GetTick() - g->t_caida;
+			if (g->est.recuperacion_ult_ms > g->est.recuperacion_max_ms) {
+				g->est.recuperacion_max_ms = g->est.recuperacion_ult_ms;
+			}
+		}
+	}
+}
+
+
+/* Paso fallido: tras 'intentos' fallos seguidos de la fase (0, sin limite) pasa a 'alternativa'; siempre con backoff */
+static void paso_Fallido(gestorRed* g, uint8_t intentos, faseRed alternativa)
+{
+	g->est.n_pasos[g->fase]++;
+	g->est.n_fallos[g->fase]++;
+	if (g->fallos_seguidos < UINT8_MAX) {
+		g->fallos_seguidos++;
+	}
+	g->fallos_fase++;
+	if ( (intentos > 0) && (g->fallos_fase >= intentos) ) {
+		g->fase = alternativa;
+		g->fallos_fase = 0;
+	}
+	g->espera_ms = espera_GestorRed(g);
+	g->t_reintento = HAL_GetTick() + g->espera_ms;
+}
+
+#endif  /* INC_GESTOR_CONECTIVIDAD_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
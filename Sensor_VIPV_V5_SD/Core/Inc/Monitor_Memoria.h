@@ -0,0 +1,286 @@
+/******************************************************************************
+* @file    Monitor_Memoria.h
+* @author  Sergio Vera Muñoz
+* @brief   Observación de la memoria en ejecución, siempre activa y de bajo coste:
+*   - Heap: arena pedida al sistema, bytes libres y fragmentación de la lista libre de
+*     newlib-nano (1 - mayor bloque libre / total libre), recorrida al medir.
+*   - Clases de reserva: uso actual, máximo, mayor reserva y fallos de TLS, FIFO, NMEA
+*     y red, que cuenta heap_class_alloc() (heap.c) en cada reserva. TLS no sale del heap
+*     sino de su pool fijo en RAM2 (heap_tls_pool_init()), y cuenta bytes útiles sin las
+*     cabeceras del asignador de mbedTLS. cJSON no usa el heap sino el arena de
+*     Configuracion_SD.h, del que se da su ocupación máxima.
+*   - Pila: inicia_MonitorMemoria() pinta con un patrón el hueco entre el heap y la pila;
+*     cada medida busca la palabra pintada más baja que la pila ha pisado. Da la pila
+*     máxima usada y la holgura mínima que ha quedado entre el heap y la pila.
+* Medir no reserva nada y solo recorre la lista libre y el hueco pintado, palabra a palabra.
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_MONITOR_MEMORIA_H_
+#define INC_MONITOR_MEMORIA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>				// sbrk()
+#include "main.h"				// __get_MSP()
+#include "heap.h"				// heap_class_stat(), heap_tls_pool_stat()
+#include "Configuracion_SD.h"	// config_arena_max
+
+/* Private defines -----------------------------------------------------------*/
+#define PATRON_PILA            0xC8C8C8C8U	// El byte de stack_measure_prologue() de heap.c
+#define MARGEN_PINTADO_PILA    128		// Bytes bajo el sp de inicia_MonitorMemoria() que no se pintan
+#define HOLGURA_AVISO_PILA     2048		// Holgura heap-pila por debajo de la cual se avisa
+#define MEMORIA_RESUMEN_SIZE   256		// Resumen para el campo status de ThingSpeak (255 caracteres)
+
+static const char* const NOMBRE_CLASE_HEAP[HEAP_CLASS_COUNT] = {"TLS", "FIFO", "NMEA", "red"};
+
+
+/*--------Lista libre de newlib-nano y estado de la memoria------------------------*/
+typedef struct bloqueLibre		// Cabecera de un bloque de nano-mallocr.c (chunk)
+{
+	long tam;						// Bytes del bloque, cabecera incluida
+	struct bloqueLibre* siguiente;
+
+}bloqueLibre;
+
+extern bloqueLibre* __malloc_free_list;		// Lista libre de nano-mallocr.c, ordenada por direcciones
+extern char* __malloc_sbrk_start;			// Primera dirección entregada por sbrk()
+extern uint32_t _estack;					// Fondo de la pila, del script del enlazador
+
+typedef struct
+{
+	uint32_t libre;					// Bytes en la lista libre
+	uint32_t mayor_libre;			// Mayor bloque de la lista libre
+	uint32_t n_libres;				// Bloques de la lista libre
+	uint8_t fragmentacion;			// 100 * (1 - mayor_libre / libre), 0 sin huecos
+
+}estadoHeap;
+
+typedef struct
+{
+	uint32_t* suelo;				// Palabra pintada más baja
+	uint32_t* techo;				// Primera palabra sin pintar por encima
+	uint32_t arena;					// Bytes pedidos al sistema por malloc
+	estadoHeap heap;
+	heap_class_stat_t clase[HEAP_CLASS_COUNT];
+	uint32_t pool_tls;				// Tamaño del pool de mbedTLS en RAM2, 0 si TLS usa el heap
+	uint32_t bloques_tls;			// Bloques ahora en el pool, reservados o huecos entre ellos
+	uint32_t pila_max;				// Bytes de pila usados como máximo desde _estack
+	uint32_t holgura;				// Bytes entre el final del heap y lo más bajo que ha llegado la pila, ahora
+	uint32_t holgura_min;
+	uint32_t fallos_avisados;		// Fallos de reserva ya avisados por la consola
+
+}monitorMemoria;
+
+static monitorMemoria memoria;
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+void inicia_MonitorMemoria(void);
+void mide_Memoria(monitorMemoria* m);
+int  informe_Memoria(const monitorMemoria* m, char* texto, size_t tam);
+int  resumen_Memoria(const monitorMemoria* m, char* texto, size_t tam);
+bool avisos_Memoria(monitorMemoria* m);
+void analiza_ListaLibre(const bloqueLibre* lista, estadoHeap* e);
+void pinta_Pila(uint32_t* suelo, uint32_t* techo);
+uint32_t* marca_Pila(uint32_t* desde, uint32_t* techo);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Pinta el hueco libre entre el heap y la pila. Se llama una vez, con la pila poco profunda: lo que la pila
+  * use por encima de este punto no se mide.
+  * @param  None
+  * @retval None
+  */
+void inicia_MonitorMemoria(void)
+{
+	uintptr_t suelo = ((uintptr_t)sbrk(0) + 3U) & ~(uintptr_t)3U;
+	uintptr_t techo = (__get_MSP() - MARGEN_PINTADO_PILA) & ~(uintptr_t)3U;
+
+	memset(&memoria, 0, sizeof(memoria));
+	memoria.suelo = (uint32_t*)suelo;
+	memoria.techo = (uint32_t*)((techo > suelo) ? techo : suelo);
+	memoria.holgura_min = UINT32_MAX;
+
+	pinta_Pila(memoria.suelo, memoria.techo);
+	mide_Memoria(&memoria);
+}
+
+
+/**
+  * @brief  Toma el estado del heap, de las clases de reserva y de la pila
+  * @param  m: monitor
+  * @retval None
+  */
+void mide_Memoria(monitorMemoria* m)
+{
+	uint32_t* fin_heap = (uint32_t*)(((uintptr_t)sbrk(0) + 3U) & ~(uintptr_t)3U);
+	uint32_t* pisada;
+
+	m->arena = (__malloc_sbrk_start != NULL) ? (uint32_t)((char*)sbrk(0) - __malloc_sbrk_start) : 0;
+	analiza_ListaLibre(__malloc_free_list, &m->heap);
+	heap_class_stat(m->clase);
+#if defined(USE_MBED_TLS) && !defined(HEAP_DEBUG)
+	heap_tls_pool_stat(&m->pool_tls, &m->bloques_tls);
+#endif
+
+	/* El heap solo crece y pisa el pintado por abajo: se busca desde su final */
+	pisada = marca_Pila((fin_heap > m->suelo) ? fin_heap : m->suelo, m->techo);
+	m->pila_max = (uint32_t)((uintptr_t)&_estack - (uintptr_t)pisada);
+	m->holgura = (pisada > fin_heap) ? (uint32_t)((uintptr_t)pisada - (uintptr_t)fin_heap) : 0;
+	if (m->holgura < m->holgura_min) {
+		m->holgura_min = m->holgura;
+	}
+}
+
+
+/**
+  * @brief  Recorre una lista libre de newlib-nano: bytes libres, mayor bloque, numero de bloques y fragmentación
+  * @param  lista: primer bloque, o NULL
+  * @param  e: resultado
+  * @retval None
+  */
+void analiza_ListaLibre(const bloqueLibre* lista, estadoHeap* e)
+{
+	memset(e, 0, sizeof(*e));
+
+	for (const bloqueLibre* b = lista; b != NULL; b = b->siguiente) {
+		e->libre += (uint32_t)b->tam;
+		if ((uint32_t)b->tam > e->mayor_libre) {
+			e->mayor_libre = (uint32_t)b->tam;
+		}
+		e->n_libres++;
+	}
+	if (e->libre > 0) {
+		e->fragmentacion = (uint8_t)(100U - (uint32_t)(((uint64_t)e->mayor_libre * 100U) / e->libre));
+	}
+}
+
+
+/**
+  * @brief  Rellena con PATRON_PILA las palabras de [suelo, techo)
+  * @param  suelo: primera palabra
+  * @param  techo: primera palabra que no se pinta
+  * @retval None
+  */
+void pinta_Pila(uint32_t* suelo, uint32_t* techo)
+{
+	for (volatile uint32_t* p = suelo; p < techo; p++) {
+		*p = PATRON_PILA;
+	}
+}
+
+
+/**
+  * @brief  Primera palabra de [desde, techo) que ya no tiene el patrón: lo más bajo que ha llegado la pila
+  * @param  desde: palabra por la que empezar, dentro de lo pintado
+  * @param  techo: final de lo pintado
+  * @retval palabra pisada más baja, o techo si la pila no ha bajado de él
+  */
+uint32_t* marca_Pila(uint32_t* desde, uint32_t* techo)
+{
+	volatile uint32_t* p = desde;
+
+	while ( (p < techo) && (*p == PATRON_PILA) ) {
+		p++;
+	}
+	return (uint32_t*)p;
+}
+
+
+/**
+  * @brief  Informe para la consola: heap, clases de reserva, arena de cJSON y pila
+  * @param  m: monitor, tras mide_Memoria()
+  * @param  texto: destino, 640 bytes bastan
+  * @param  tam: tamaño del destino
+  * @retval caracteres escritos
+  */
+int informe_Memoria(const monitorMemoria* m, char* texto, size_t tam)
+{
+	size_t n = 0;
+
+	n += snprintf(&texto[n], tam - n, "Memoria: heap %lu B pedidos, %lu libres en %lu bloques (mayor %lu, fragmentacion %u %%); "
+				  "pila max %lu B, holgura heap-pila %lu B (min %lu)\n",
+				  (unsigned long)m->arena, (unsigned long)m->heap.libre, (unsigned long)m->heap.n_libres,
+				  (unsigned long)m->heap.mayor_libre, m->heap.fragmentacion, (unsigned long)m->pila_max,
+				  (unsigned long)m->holgura, (unsigned long)m->holgura_min);
+
+	for (uint8_t i = 0; (i < HEAP_CLASS_COUNT) && (n < tam); i++) {
+		n += snprintf(&texto[n], tam - n, "  %-5s %6lu B, max %6lu B, mayor reserva %5lu B, %lu reservas, %lu fallos\n",
+					  NOMBRE_CLASE_HEAP[i], (unsigned long)m->clase[i].current, (unsigned long)m->clase[i].peak,
+					  (unsigned long)m->clase[i].largest, (unsigned long)m->clase[i].allocs,
+					  (unsigned long)m->clase[i].failures);
+	}
+	if ( (m->pool_tls > 0) && (n < tam) ) {
+		n += snprintf(&texto[n], tam - n, "  TLS pool RAM2 %lu B, max %lu%% ocupado, %lu bloques ahora\n", (unsigned long)m->pool_tls,
+					  (unsigned long)(100U * m->clase[HEAP_CLASS_TLS].peak / m->pool_tls), (unsigned long)m->bloques_tls);
+	}
+	if (n < tam) {
+		n += snprintf(&texto[n], tam - n, "  cJSON arena estatico, max %u/%u B\n", (unsigned)config_arena_max, CONFIG_ARENA_SIZE);
+	}
+	return (n < tam) ? (int)n : (int)tam - 1;
+}
+
+
+/**
+  * @brief  Resumen en una linea para publicarlo como status
+  * @param  m: monitor, tras mide_Memoria()
+  * @param  texto: destino, MEMORIA_RESUMEN_SIZE basta
+  * @param  tam: tamaño del destino
+  * @retval caracteres escritos
+  */
+int resumen_Memoria(const monitorMemoria* m, char* texto, size_t tam)
+{
+	int n = snprintf(texto, tam, "heap %lu libre %lu frag %u%% pila %lu holgura %lu; max TLS %lu FIFO %lu NMEA %lu red %lu; "
+					 "fallos %lu/%lu/%lu/%lu",
+					 (unsigned long)m->arena, (unsigned long)m->heap.libre, m->heap.fragmentacion,
+					 (unsigned long)m->pila_max, (unsigned long)m->holgura_min,
+					 (unsigned long)m->clase[HEAP_CLASS_TLS].peak, (unsigned long)m->clase[HEAP_CLASS_FIFO].peak,
+					 (unsigned long)m->clase[HEAP_CLASS_NMEA].peak, (unsigned long)m->clase[HEAP_CLASS_NET].peak,
+					 (unsigned long)m->clase[HEAP_CLASS_TLS].failures, (unsigned long)m->clase[HEAP_CLASS_FIFO].failures,
+					 (unsigned long)m->clase[HEAP_CLASS_NMEA].failures, (unsigned long)m->clase[HEAP_CLASS_NET].failures);
+
+	return ( (n >= 0) && ((size_t)n < tam) ) ? n : (int)tam - 1;
+}
+
+
+/**
+  * @brief  Indica si hay algo que avisar: holgura heap-pila por debajo de HOLGURA_AVISO_PILA o reservas fallidas
+  * nuevas desde el ultimo aviso
+  * @param  m: monitor, tras mide_Memoria()
+  * @retval true si hay que avisar
+  */
+bool avisos_Memoria(monitorMemoria* m)
+{
+	uint32_t fallos = 0;
+
+	for (uint8_t i = 0; i < HEAP_CLASS_COUNT; i++) {
+		fallos += m->clase[i].failures;
+	}
+	if ( (fallos != m->fallos_avisados) || (m->holgura < HOLGURA_AVISO_PILA) ) {
+		m->fallos_avisados = fallos;
+		return true;
+	}
+	return false;
+}
+
+#endif  /* INC_MONITOR_MEMORIA_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
@@ -0,0 +1,240 @@
+/******************************************************************************
+* @file    Perfilador_DWT.h
+* @author  Sergio Vera Muñoz
+* @brief   Perfilador de ciclos con el contador DWT->CYCCNT del Cortex-M4. Cada sonda
+* (sondaPerfil, en main.h) guarda en una tabla estatica su número de ejecuciones, el
+* minimo, el maximo, la suma y un histograma log2 de los ciclos: el cubo k cuenta las
+* ejecuciones de [2^k, 2^(k+1)) ciclos. Las sondas se ponen con ABRE_SONDA() y
+* CIERRA_SONDA() alrededor del codigo a medir, también desde otros ficheros fuente.
+* El contador corre libre desde inicia_Perfilador(), así que las sondas pueden
+* anidarse; una sonda no puede medir más de 2^32 ciclos (53 s a 80 MHz).
+* El coste de las propias sondas se mide al arrancar y se incluye en el informe.
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_PERFILADOR_DWT_H_
+#define INC_PERFILADOR_DWT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "main.h"		// sondaPerfil, ABRE_SONDA() y CIERRA_SONDA()
+#include "mi_MEMS.h"	// DWT_Init()
+
+/* Private defines -----------------------------------------------------------*/
+#define N_CUBOS_PERFIL        32		// Uno por bit de los ciclos
+#define N_CALIBRA_PERFIL      64		// Repeticiones para medir el coste de una sonda
+#define PERFIL_FICHERO        "perfil.txt"
+#define PERFIL_TEXTO_SIZE     2048		// Informe completo, para la consola y la SD
+#define PERFIL_RESUMEN_SIZE   256		// Resumen para el campo status de ThingSpeak (255 caracteres)
+
+
+/*--------Estadistica de una sonda y del perfilador------------------------*/
+typedef struct
+{
+	uint32_t n;
+	uint32_t min;
+	uint32_t max;
+	uint64_t suma;
+	uint32_t cubo[N_CUBOS_PERFIL];		// Histograma log2 de los ciclos
+
+}estadisticaSonda;
+
+typedef struct
+{
+	estadisticaSonda sonda[N_SONDAS];
+	uint32_t coste_lectura;			// Ciclos entre dos lecturas seguidas de CYCCNT: sesgo de toda medida
+	uint32_t coste_registro;		// Ciclos de una llamada a registra_Sonda()
+	uint32_t t_inicio_ms;			// HAL_GetTick() del último reinicio de la tabla
+
+}perfiladorDWT;
+
+static perfiladorDWT perfil;
+
+static const char* const NOMBRE_SONDA[N_SONDAS] = {
+	"mideRadiacion", "recabar_Datos", "decodificadorNMEA", "computa_algoritmoMEMS", "MotionFX_manager_run",
+	"escritura SD", "publica_DatosThingSpeak", "envio MQTT", "handshake TLS", "sonda vacia"
+};
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+void inicia_Perfilador(void);
+void registra_Sonda(sondaPerfil sonda, uint32_t ciclos);
+void reinicia_Perfil(void);
+int  informe_Perfil(char* texto, size_t tam);
+int  resumen_Perfil(char* texto, size_t tam);
+
+static float ciclos_us(uint64_t ciclos);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Arranca el DWT en modo libre, vacía la tabla y mide el coste de las sondas
+  * @param  None
+  * @retval None
+  */
+void inicia_Perfilador(void)
+{
+	uint32_t t0, t1;
+
+	DWT_Init();
+	reinicia_Perfil();
+
+	perfil.coste_lectura = UINT32_MAX;
+	perfil.coste_registro = UINT32_MAX;
+	for (uint8_t i = 0; i < N_CALIBRA_PERFIL; i++) {
+		t0 = DWT->CYCCNT;
+		t1 = DWT->CYCCNT;
+		if (t1 - t0 < perfil.coste_lectura) perfil.coste_lectura = t1 - t0;
+
+		t0 = DWT->CYCCNT;
+		registra_Sonda(SONDA_VACIA, 0);
+		t1 = DWT->CYCCNT;
+		if (t1 - t0 < perfil.coste_registro) perfil.coste_registro = t1 - t0;
+	}
+
+	/* La primera pasada solo calienta la caché de la flash; la sonda vacia se queda con lo que mide una sonda sin
+	 * nada dentro, el sesgo de todas las demás */
+	for (uint8_t i = 0; i < N_CALIBRA_PERFIL; i++) {
+		ABRE_SONDA(SONDA_VACIA);
+		CIERRA_SONDA(SONDA_VACIA);
+	}
+	memset(&perfil.sonda[SONDA_VACIA], 0, sizeof(perfil.sonda[SONDA_VACIA]));
+	for (uint8_t i = 0; i < N_CALIBRA_PERFIL; i++) {
+		ABRE_SONDA(SONDA_VACIA);
+		CIERRA_SONDA(SONDA_VACIA);
+	}
+}
+
+
+/**
+  * @brief  Añade una medida a una sonda. Solo desde el bucle principal: la tabla no se protege de interrupciones.
+  * @param  sonda: SONDA_*
+  * @param  ciclos: ciclos medidos entre ABRE_SONDA() y CIERRA_SONDA()
+  * @retval None
+  */
+void registra_Sonda(sondaPerfil sonda, uint32_t ciclos)
+{
+	estadisticaSonda* s;
+
+	if ((uint32_t)sonda >= N_SONDAS) {
+		return;
+	}
+	s = &perfil.sonda[sonda];
+
+	if ( (s->n == 0) || (ciclos < s->min) ) s->min = ciclos;
+	if (ciclos > s->max) s->max = ciclos;
+	s->n++;
+	s->suma += ciclos;
+	s->cubo[(ciclos == 0) ? 0 : (31U - __CLZ(ciclos))]++;
+}
+
+
+/**
+  * @brief  Vacía la tabla de todas las sondas salvo la vacia, que guarda la calibración
+  * @param  None
+  * @retval None
+  */
+void reinicia_Perfil(void)
+{
+	for (uint8_t i = 0; i < N_SONDAS; i++) {
+		if (i != SONDA_VACIA) {
+			memset(&perfil.sonda[i], 0, sizeof(perfil.sonda[i]));
+		}
+	}
+	perfil.t_inicio_ms = HAL_GetTick();
+}
+
+
+/**
+  * @brief  Informe de todas las sondas con ejecuciones: minimo, media y maximo en us, tiempo total, y los cubos no
+  * vacios del histograma con su limite inferior, en ciclos hasta 512 y en us a partir de ahí
+  * @param  texto: destino, PERFIL_TEXTO_SIZE basta
+  * @param  tam: tamaño del destino
+  * @retval caracteres escritos
+  */
+int informe_Perfil(char* texto, size_t tam)
+{
+	size_t n = 0;
+	uint32_t periodo_ms = HAL_GetTick() - perfil.t_inicio_ms;
+
+	n += snprintf(&texto[n], tam - n, "\nPerfil DWT de los ultimos %lu s a %lu MHz. Coste de una sonda: %lu ciclos de lectura "
+				  "+ %lu de registro\n", (unsigned long)(periodo_ms / 1000U), (unsigned long)(SystemCoreClock / 1000000U),
+				  (unsigned long)perfil.coste_lectura, (unsigned long)perfil.coste_registro);
+
+	for (uint8_t i = 0; (i < N_SONDAS) && (n < tam); i++) {
+		const estadisticaSonda* s = &perfil.sonda[i];
+
+		if (s->n == 0) {
+			continue;
+		}
+		n += snprintf(&texto[n], tam - n, "  %-24s %7lu x  min %9.1f  media %9.1f  max %9.1f us  total %8.1f ms (%4.1f %%)\n    ",
+					  NOMBRE_SONDA[i], (unsigned long)s->n, ciclos_us(s->min), ciclos_us(s->suma / s->n), ciclos_us(s->max),
+					  ciclos_us(s->suma) / 1000.0f,
+					  (periodo_ms > 0) ? (ciclos_us(s->suma) / 10.0f / (float)periodo_ms) : 0.0f);
+
+		for (uint8_t k = 0; (k < N_CUBOS_PERFIL) && (n < tam); k++) {
+			if ( (s->cubo[k] != 0) && (k < 10) ) {		// Por debajo de 1024 ciclos el us no tiene resolución
+				n += snprintf(&texto[n], tam - n, " >=%luc:%lu", (unsigned long)((k == 0) ? 0UL : (1UL << k)), (unsigned long)s->cubo[k]);
+			}
+			else if (s->cubo[k] != 0) {
+				n += snprintf(&texto[n], tam - n, " >=%.1fus:%lu", ciclos_us(1ULL << k), (unsigned long)s->cubo[k]);
+			}
+		}
+		if (n < tam) {
+			n += snprintf(&texto[n], tam - n, "\n");
+		}
+	}
+	return (n < tam) ? (int)n : (int)tam - 1;
+}
+
+
+/**
+  * @brief  Resumen en una linea, media y maximo en ms de cada sonda con ejecuciones, para publicarlo como status
+  * @param  texto: destino, PERFIL_RESUMEN_SIZE basta
+  * @param  tam: tamaño del destino
+  * @retval caracteres escritos
+  */
+int resumen_Perfil(char* texto, size_t tam)
+{
+	static const char* const CORTO_SONDA[N_SONDAS] = {"rad", "rec", "nmea", "mems", "mfx", "sd", "pub", "mqtt", "tls", "vac"};
+	size_t n = 0;
+
+	texto[0] = '\0';
+	for (uint8_t i = 0; (i < N_SONDAS) && (n < tam); i++) {
+		const estadisticaSonda* s = &perfil.sonda[i];
+
+		if ( (s->n == 0) || (i == SONDA_VACIA) ) {
+			continue;
+		}
+		n += snprintf(&texto[n], tam - n, "%s%s %.2f/%.2fms", (n > 0) ? ", " : "", CORTO_SONDA[i],
+					  ciclos_us(s->suma / s->n) / 1000.0f, ciclos_us(s->max) / 1000.0f);
+	}
+	return (n < tam) ? (int)n : (int)tam - 1;
+}
+
+
+/* Ciclos del nucleo a microsegundos */
+static float ciclos_us(uint64_t ciclos)
+{
+	return (float)ciclos / (float)(SystemCoreClock / 1000000U);
+}
+
+#endif  /* INC_PERFILADOR_DWT_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
@@ -0,0 +1,300 @@
+/******************************************************************************
+* @file    Redes_Conocidas.h
+* @author  Sergio Vera Muñoz
+* @brief   Itinerancia entre las redes Wi-Fi conocidas (cochera, oficina, casa...) de la
+* configuración de usuario en flash. Tras perder la asociación, un scan con
+* WIFI_ListAccessPoints() elige la red conocida con más RSSI. Además se recuerda qué
+* red funcionó por última vez en cada zona GPS (celdas de 0,01º, unos 1,1 km): al
+* volver a la zona se intenta esa red directamente, sin scan, y solo si no se asocia
+* a la primera se hace el scan. La elección la consume Gestor_Conectividad.h como su
+* acción localiza_AP.
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_REDES_CONOCIDAS_H_
+#define INC_REDES_CONOCIDAS_H_
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "main.h"
+#include "wifi.h"
+#include "iot_flash_config.h"
+#include "Gestor_Conectividad.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define N_ZONAS_RED          8			// Zonas GPS recordadas; al llenarse se sustituye la usada hace más tiempo
+#define CELDAS_POR_GRADO     100.0f		// Lado de la zona: 0,01º, unos 1,1 km en latitud
+#define MARGEN_ZONA_DB       10			// La red de la zona se prefiere en el scan salvo que otra le saque más de 10 dB
+#define SIN_RED_CONOCIDA     0xFF
+
+
+/*--------Zonas GPS y estado de la itinerancia------------------------*/
+typedef struct
+{
+	int16_t lat;		// Celda: grados * CELDAS_POR_GRADO
+	int16_t lon;
+
+}zonaGPS;
+
+typedef struct
+{
+	bool valida;
+	zonaGPS zona;
+	uint8_t red;		// Índice en la tabla de redes conocidas
+	uint32_t t_uso;		// HAL_GetTick() de la última asociación en la zona
+
+}memoriaZona;
+
+typedef struct
+{
+	const wifi_network_t* redes;	// Tabla de la configuración de usuario (checkKnownWiFiNetworks())
+	uint8_t n_redes;
+	uint8_t elegida;				// Red del último scan o de la memoria de la zona
+	bool hay_posicion;
+	bool zona_probada;				// La red de la zona ya se ha intentado sin scan en esta zona
+	zonaGPS zona;
+	memoriaZona memoria[N_ZONAS_RED];
+	uint32_t n_scans;
+	uint32_t n_sin_visibles;		// Scans sin ninguna red conocida
+	uint32_t n_atajos_zona;			// Asociaciones intentadas por la memoria de la zona, sin scan
+	uint32_t t_scans_ms;			// Tiempo total de los scans, que retiene el bucle principal
+	uint32_t scan_max_ms;
+
+}gestorRedes;
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+void inicia_RedesConocidas(gestorRedes* r, const wifi_network_t* redes, int n_redes);
+bool anota_PosicionRedes(gestorRedes* r, float latitud, float longitud);
+bool localiza_RedConocida(gestorRedes* r, cacheAP* ap);
+void recuerda_RedZona(gestorRedes* r);
+const wifi_network_t* red_Elegida(const gestorRedes* r);
+int  informe_RedesConocidas(const gestorRedes* r, char* texto, size_t tam);
+
+static int8_t busca_MemoriaZona(const gestorRedes* r);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Prepara la itinerancia con la tabla de redes conocidas, sin posición ni zonas recordadas
+  * @param  r: gestor
+  * @param  redes: tabla de la configuración de usuario, la primera es la de arranque
+  * @param  n_redes: entradas válidas; <= 0 deja la itinerancia sin redes (se usa la red única de la flash)
+  * @retval None
+  */
+void inicia_RedesConocidas(gestorRedes* r, const wifi_network_t* redes, int n_redes)
+{
+	memset(r, 0, sizeof(*r));
+	r->redes = redes;
+	r->n_redes = (n_redes > 0) ? (uint8_t)n_redes : 0;
+	r->elegida = (r->n_redes > 0) ? 0 : SIN_RED_CONOCIDA;
+}
+
+
+/**
+  * @brief  Anota la última posición con fix. Al cambiar de zona se vuelve a permitir el atajo de su red recordada
+  * @param  r: gestor
+  * @param  latitud, longitud: en grados
+  * @retval true al entrar en una zona con red recordada: merece la pena adelantar el intento (adelanta_GestorRed())
+  */
+bool anota_PosicionRedes(gestorRedes* r, float latitud, float longitud)
+{
+	zonaGPS zona = { (int16_t)floorf(latitud * CELDAS_POR_GRADO), (int16_t)floorf(longitud * CELDAS_POR_GRADO) };
+	bool nueva = !r->hay_posicion || (zona.lat != r->zona.lat) || (zona.lon != r->zona.lon);
+
+	if (nueva) {
+		r->zona = zona;
+		r->zona_probada = false;
+	}
+	r->hay_posicion = true;
+	return nueva && (busca_MemoriaZona(r) >= 0);
+}
+
+
+/**
+  * @brief  Acción localiza_AP del gestor de red. Con la zona actual recordada y sin probar, elige su red sin scan
+  * (cacheAP.sin_scan). Si no, hace un scan y elige la red conocida con más RSSI; la de la zona cuenta con
+  * MARGEN_ZONA_DB de ventaja, para no saltar entre dos redes de señal parecida.
+  * @param  r: gestor
+  * @param  ap: caché del gestor, con BSSID, canal y RSSI de la red elegida
+  * @retval true si hay una red conocida que intentar
+  */
+bool localiza_RedConocida(gestorRedes* r, cacheAP* ap)
+{
+	static WIFI_APs_t aps;		// ~1 KB: fuera de la pila
+	int8_t zona = busca_MemoriaZona(r);
+	uint8_t favorita = (zona >= 0) ? r->memoria[zona].red : SIN_RED_CONOCIDA;
+	uint8_t elegida = SIN_RED_CONOCIDA;
+	int16_t mejor = INT16_MIN;
+	uint32_t t_inicio;
+
+	if (r->n_redes == 0) {
+		return false;
+	}
+
+	if ( (zona >= 0) && !r->zona_probada ) {
+		r->zona_probada = true;
+		r->n_atajos_zona++;
+		r->elegida = favorita;
+		memset(ap->bssid, 0, sizeof(ap->bssid));
+		ap->canal = 0;
+		ap->rssi = 0;
+		ap->sin_scan = true;
+		return true;
+	}
+
+	t_inicio = HAL_GetTick();
+	r->n_scans++;
+	if (WIFI_ListAccessPoints(&aps, WIFI_MAX_APS) != WIFI_STATUS_OK) {
+		aps.count = 0;
+	}
+
+	ap->sin_scan = false;
+	for (uint8_t i = 0; i < aps.count; i++) {
+		for (uint8_t j = 0; j < r->n_redes; j++) {
+			int16_t nota;
+
+			if (strncmp(aps.ap[i].SSID, r->redes[j].ssid, USER_CONF_WIFI_SSID_MAX_LENGTH) != 0) {
+				continue;
+			}
+			nota = aps.ap[i].RSSI + ((j == favorita) ? MARGEN_ZONA_DB : 0);
+			if (nota > mejor) {
+				mejor = nota;
+				elegida = j;
+				memcpy(ap->bssid, aps.ap[i].MAC, sizeof(ap->bssid));
+				ap->canal = aps.ap[i].Channel;
+				ap->rssi = aps.ap[i].RSSI;
+			}
+		}
+	}
+
+	if ( (uint32_t)(HAL_GetTick() - t_inicio) > r->scan_max_ms ) {
+		r->scan_max_ms = HAL_GetTick() - t_inicio;
+	}
+	r->t_scans_ms += HAL_GetTick() - t_inicio;
+
+	if (elegida == SIN_RED_CONOCIDA) {
+		r->n_sin_visibles++;		// Se mantiene la elegida antes, para la asociación completa que reinicia el modulo
+		return false;
+	}
+	r->elegida = elegida;
+	return true;
+}
+
+
+/**
+  * @brief  Asociada a la red elegida: queda como la red de la zona actual, sustituyendo la zona usada hace más tiempo
+  * @param  r: gestor
+  * @retval None
+  */
+void recuerda_RedZona(gestorRedes* r)
+{
+	uint8_t zona = 0;
+	bool libre = false;
+
+	if ( !r->hay_posicion || (r->elegida == SIN_RED_CONOCIDA) ) {
+		return;
+	}
+
+	for (uint8_t i = 0; i < N_ZONAS_RED; i++) {
+		if ( r->memoria[i].valida && (r->memoria[i].zona.lat == r->zona.lat) && (r->memoria[i].zona.lon == r->zona.lon) ) {
+			zona = i;		// La misma zona: se actualiza
+			break;
+		}
+		if (!r->memoria[i].valida) {
+			zona = libre ? zona : i;
+			libre = true;
+		}
+		else if ( !libre && ((int32_t)(r->memoria[i].t_uso - r->memoria[zona].t_uso) < 0) ) {
+			zona = i;		// Sin huecos, la usada hace más tiempo
+		}
+	}
+
+	r->memoria[zona].valida = true;
+	r->memoria[zona].zona = r->zona;
+	r->memoria[zona].red = r->elegida;
+	r->memoria[zona].t_uso = HAL_GetTick();
+	r->zona_probada = true;		// Ya asociado: un nuevo atajo solo tras cambiar de zona
+}
+
+
+/**
+  * @brief  Red que debe intentar la próxima asociación
+  * @param  r: gestor
+  * @retval entrada de la tabla, o NULL sin redes conocidas
+  */
+const wifi_network_t* red_Elegida(const gestorRedes* r)
+{
+	return (r->elegida < r->n_redes) ? &r->redes[r->elegida] : NULL;
+}
+
+
+/**
+  * @brief  Informe para la consola: red elegida, scans y su coste, atajos por zona y zonas recordadas
+  * @param  r: gestor
+  * @param  texto: destino
+  * @param  tam: tamaño del destino
+  * @retval caracteres escritos
+  */
+int informe_RedesConocidas(const gestorRedes* r, char* texto, size_t tam)
+{
+	const wifi_network_t* red = red_Elegida(r);
+	uint8_t zonas = 0;
+	int n;
+
+	for (uint8_t i = 0; i < N_ZONAS_RED; i++) {
+		zonas += r->memoria[i].valida ? 1 : 0;
+	}
+	n = snprintf(texto, tam, "Redes conocidas: %u, red actual %s, %lu scans (%lu sin ninguna conocida, %lu ms en total, "
+				 "max %lu ms), %lu atajos por zona, %u zonas recordadas\n", r->n_redes, (red != NULL) ? red->ssid : "-",
+				 (unsigned long)r->n_scans, (unsigned long)r->n_sin_visibles, (unsigned long)r->t_scans_ms,
+				 (unsigned long)r->scan_max_ms, (unsigned long)r->n_atajos_zona, zonas);
+	return (n < (int)tam) ? n : (int)tam - 1;
+}
+
+
+/* Zona recordada de la posición actual: la misma celda o, en su defecto, una vecina, para no fallar en el borde */
+static int8_t busca_MemoriaZona(const gestorRedes* r)
+{
+	int8_t vecina = -1;
+
+	if (!r->hay_posicion) {
+		return -1;
+	}
+	for (uint8_t i = 0; i < N_ZONAS_RED; i++) {
+		int16_t d_lat = r->memoria[i].zona.lat - r->zona.lat;
+		int16_t d_lon = r->memoria[i].zona.lon - r->zona.lon;
+
+		if (!r->memoria[i].valida || (r->memoria[i].red >= r->n_redes)) {
+			continue;
+		}
+		if ( (d_lat == 0) && (d_lon == 0) ) {
+			return (int8_t)i;
+		}
+		if ( (d_lat >= -1) && (d_lat <= 1) && (d_lon >= -1) && (d_lon <= 1) && (vecina < 0) ) {
+			vecina = (int8_t)i;
+		}
+	}
+	return vecina;
+}
+
+#endif  /* INC_REDES_CONOCIDAS_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
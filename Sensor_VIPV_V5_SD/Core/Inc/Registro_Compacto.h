@@ -0,0 +1,204 @@
+/******************************************************************************
+* @file    Registro_Compacto.h
+* @author  Sergio Vera Muñoz
+* @brief   Registro compacto de una muestra, de 40 bytes frente a los 92 de megaDato.
+* La fecha es un instante epoch UTC en segundos y las magnitudes son enteros escalados;
+* unos bits de validez sustituyen a los NaN. Es el formato de todo lo que se guarda
+* o se encola (tubería de sumideros, FIFO de recuperación, concatenados de la ventana
+* y registro binario de la SD). megaDato queda para la lectura de los sensores y para
+* los formateadores de texto, que lo obtienen con expande_Registro().
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_REGISTRO_COMPACTO_H_
+#define INC_REGISTRO_COMPACTO_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "sensors_data.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define ESCALA_IRRADIANCIA   10.0f		// 0,1 W/m^2
+#define ESCALA_TEMPERATURA   100.0f		// 0,01 ºC
+#define ESCALA_PRESION       10.0f		// 0,1 hPa
+#define ESCALA_HUMEDAD       2.0f		// 0,5 %HR, por debajo de la precisión del HTS221
+#define ESCALA_ANGULO        100.0f		// 0,01 º
+#define ESCALA_COORDENADA    1.0e7f		// 1e-7 º, unos 1,1 cm
+#define ESCALA_ALTITUD       10.0f		// 0,1 m
+#define ESCALA_VELOCIDAD     100.0f		// 0,01 km/h
+
+#define REG_UBICACION_FIX    0x01		// ubicacion_fix de megaDato
+#define REG_POSICION         0x02		// latitud y longitud numericas (no NaN)
+#define REG_ALTITUD          0x04
+#define REG_VELOCIDAD        0x08
+
+
+/*--------Registro compacto------------------------*/
+/* Campos en orden de alineación natural: packed solo fija el formato del fichero binario, sin accesos desalineados */
+typedef struct __attribute__((packed))
+{
+	uint32_t epoch;						// Segundos UTC desde 1970, del RTC
+	int32_t latitud;					// ESCALA_COORDENADA
+	int32_t longitud;
+	uint16_t irradiancia[5];			// ESCALA_IRRADIANCIA
+	int16_t temperatura;				// ESCALA_TEMPERATURA
+	uint16_t presion;					// ESCALA_PRESION
+	int16_t alabeo;						// ESCALA_ANGULO
+	int16_t cabeceo;
+	uint16_t guinada;					// [0, 360), ESCALA_ANGULO
+	uint16_t dispersion_rumbo;
+	int16_t altitud;					// ESCALA_ALTITUD
+	uint16_t velocidad;					// ESCALA_VELOCIDAD
+	uint8_t humedad;					// ESCALA_HUMEDAD
+	uint8_t validez;					// REG_*
+
+}registroCompacto;
+
+_Static_assert(sizeof(registroCompacto) == 40, "registroCompacto debe ocupar 40 bytes");
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+uint32_t epoch_Fecha(int agno, int mes, int dia, int hora, int min, int seg);
+void compacta_Dato(const megaDato* dato, registroCompacto* reg);
+void expande_Registro(const registroCompacto* reg, megaDato* dato);
+
+static int32_t escala_Entero(float x, float escala, int32_t min, int32_t max);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Instante epoch de una fecha UTC del calendario gregoriano, sin mktime() ni zona horaria
+  * (días desde 1970 por el algoritmo de H. Hinnant)
+  * @param  agno: año completo, p. ej. 2023
+  * @param  mes: 1 a 12
+  * @param  dia: 1 a 31
+  * @param  hora, min, seg: hora del dia
+  * @retval segundos desde 1970-01-01 00:00:00
+  */
+uint32_t epoch_Fecha(int agno, int mes, int dia, int hora, int min, int seg)
+{
+	int32_t a = (mes <= 2) ? (agno - 1) : agno;
+	int32_t era = a / 400;
+	uint32_t yoe = (uint32_t)(a - era * 400);
+	uint32_t doy = (153U * (uint32_t)(mes + ((mes > 2) ? -3 : 9)) + 2U) / 5U + (uint32_t)dia - 1U;
+	uint32_t doe = yoe * 365U + yoe / 4U - yoe / 100U + doy;
+	int32_t dias = era * 146097 + (int32_t)doe - 719468;
+
+	return (uint32_t)dias * 86400U + (uint32_t)(hora * 3600 + min * 60 + seg);
+}
+
+
+/**
+  * @brief  Pasa una muestra a registro compacto. Los valores fuera de rango se saturan y los NaN dejan
+  * su bit de validez a 0.
+  * @param  dato: muestra leida o media de ventana
+  * @param  reg: registro de salida
+  * @retval None
+  */
+void compacta_Dato(const megaDato* dato, registroCompacto* reg)
+{
+	memset(reg, 0, sizeof(*reg));
+
+	reg->epoch = epoch_Fecha(dato->agno, dato->mes, dato->dia, dato->hora, dato->min, dato->seg);
+
+	for (uint8_t i = 0; i < 5; i++) {
+		reg->irradiancia[i] = (uint16_t)escala_Entero(dato->irradiancia[i], ESCALA_IRRADIANCIA, 0, UINT16_MAX);
+	}
+	reg->temperatura = (int16_t)escala_Entero(dato->temperatura, ESCALA_TEMPERATURA, INT16_MIN, INT16_MAX);
+	reg->presion = (uint16_t)escala_Entero(dato->presion, ESCALA_PRESION, 0, UINT16_MAX);
+	reg->humedad = (uint8_t)escala_Entero(dato->humedad, ESCALA_HUMEDAD, 0, UINT8_MAX);
+
+	reg->alabeo = (int16_t)escala_Entero(dato->alebeo, ESCALA_ANGULO, INT16_MIN, INT16_MAX);
+	reg->cabeceo = (int16_t)escala_Entero(dato->cabeceo, ESCALA_ANGULO, INT16_MIN, INT16_MAX);
+	reg->guinada = (uint16_t)escala_Entero(dato->guino_brujula, ESCALA_ANGULO, 0, UINT16_MAX);
+	reg->dispersion_rumbo = (uint16_t)escala_Entero(dato->dispersion_rumbo, ESCALA_ANGULO, 0, UINT16_MAX);
+
+	if (noesNAN(dato->latitud) && noesNAN(dato->longitud)) {
+		reg->latitud = escala_Entero(dato->latitud, ESCALA_COORDENADA, -900000000, 900000000);
+		reg->longitud = escala_Entero(dato->longitud, ESCALA_COORDENADA, -1800000000, 1800000000);
+		reg->validez |= REG_POSICION;
+	}
+	if (noesNAN(dato->altitud)) {
+		reg->altitud = (int16_t)escala_Entero(dato->altitud, ESCALA_ALTITUD, INT16_MIN, INT16_MAX);
+		reg->validez |= REG_ALTITUD;
+	}
+	if (noesNAN(dato->velocidad)) {
+		reg->velocidad = (uint16_t)escala_Entero(dato->velocidad, ESCALA_VELOCIDAD, 0, UINT16_MAX);
+		reg->validez |= REG_VELOCIDAD;
+	}
+	if (dato->ubicacion_fix) {
+		reg->validez |= REG_UBICACION_FIX;
+	}
+}
+
+
+/**
+  * @brief  Reconstruye la muestra de un registro compacto para los formateadores. La fecha sale de una sola
+  * llamada a gmtime() (timingSystem.c); las magnitudes sin bit de validez vuelven como NaN.
+  * @param  reg: registro compacto
+  * @param  dato: muestra de salida
+  * @retval None
+  */
+void expande_Registro(const registroCompacto* reg, megaDato* dato)
+{
+	time_t instante = (time_t)reg->epoch;
+	struct tm* fecha = gmtime(&instante);
+
+	for (uint8_t i = 0; i < 5; i++) {
+		dato->irradiancia[i] = reg->irradiancia[i] / ESCALA_IRRADIANCIA;
+	}
+	dato->temperatura = reg->temperatura / ESCALA_TEMPERATURA;
+	dato->presion = reg->presion / ESCALA_PRESION;
+	dato->humedad = reg->humedad / ESCALA_HUMEDAD;
+
+	dato->alebeo = reg->alabeo / ESCALA_ANGULO;
+	dato->cabeceo = reg->cabeceo / ESCALA_ANGULO;
+	dato->guino_brujula = reg->guinada / ESCALA_ANGULO;
+	dato->dispersion_rumbo = reg->dispersion_rumbo / ESCALA_ANGULO;
+
+	dato->latitud   = (reg->validez & REG_POSICION)  ? (float)(reg->latitud / (double)ESCALA_COORDENADA)  : NAN;
+	dato->longitud  = (reg->validez & REG_POSICION)  ? (float)(reg->longitud / (double)ESCALA_COORDENADA) : NAN;
+	dato->altitud   = (reg->validez & REG_ALTITUD)   ? (reg->altitud / ESCALA_ALTITUD)     : NAN;
+	dato->velocidad = (reg->validez & REG_VELOCIDAD) ? (reg->velocidad / ESCALA_VELOCIDAD) : NAN;
+	dato->ubicacion_fix = (reg->validez & REG_UBICACION_FIX) != 0;
+
+	dato->agno = fecha->tm_year + 1900;
+	dato->mes = fecha->tm_mon + 1;
+	dato->dia = fecha->tm_mday;
+	dato->hora = fecha->tm_hour;
+	dato->min = fecha->tm_min;
+	dato->seg = fecha->tm_sec;
+}
+
+
+/* Redondeo al entero más proximo de x*escala, saturado a [min, max]; NaN da 0 */
+static int32_t escala_Entero(float x, float escala, int32_t min, int32_t max)
+{
+	float v = x * escala;
+
+	if (!noesNAN(v)) 		return 0;
+	if (v <= (float)min)	return min;
+	if (v >= (float)max)	return max;
+	return (int32_t)lroundf(v);
+}
+
+#endif  /* INC_REGISTRO_COMPACTO_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
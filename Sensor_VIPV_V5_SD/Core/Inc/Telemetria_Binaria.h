@@ -0,0 +1,284 @@
+/******************************************************************************
+* @file    Telemetria_Binaria.h
+* @author  Sergio Vera Muñoz
+* @brief   Telemetria binaria por el USART1 para el banco de pruebas: cada muestra de
+* 1 s, cada actualización de actitud de la fusión y un resumen de tiempos de las
+* tareas, en tramas COBS con CRC que sustituyen a los volcados de texto de TeraTerm.
+* Las tramas van a la consola (Consola_DMA.h) enteras o no van: el texto que se
+* siga imprimiendo queda entre delimitadores y el decodificador lo separa.
+* Herramientas/monitor_telemetria.py las decodifica, imprime, grafica y guarda en CSV.
+*
+* Trama en la linea:  0x00 | COBS( tipo, secuencia, datos[n], crc16 LSB, crc16 MSB ) | 0x00
+*   - COBS elimina los 0x00 del contenido, que solo aparecen como delimitadores. El
+*     0x00 inicial aisla la trama de cualquier texto previo sin delimitar.
+*   - crc16: CRC-16/CCITT-FALSE (0x1021, inicio 0xFFFF) de tipo, secuencia y datos.
+*   - secuencia: contador de 8 bits de todas las tramas, para contar las perdidas.
+*   - Datos en little endian, sin relleno:
+*     TELE_MUESTRA  (40 B) registroCompacto (Registro_Compacto.h)
+*     TELE_ACTITUD  (12 B) tick ms u32, cuaternion x, y, z, w en i16 a 1/32767
+*     TELE_TIEMPOS  (36 B) tramaTiempos
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_TELEMETRIA_BINARIA_H_
+#define INC_TELEMETRIA_BINARIA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "main.h"				// HAL_GetTick() y consola_Escribe() de msg.h
+#include "Registro_Compacto.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define TELE_MUESTRA         0x01
+#define TELE_ACTITUD         0x02
+#define TELE_TIEMPOS         0x03
+
+#define TELE_DATOS_MAX       40		// La mayor carga, la muestra
+#define TELE_CONTENIDO_MAX   (2 + TELE_DATOS_MAX + 2)		// Tipo, secuencia, datos y CRC
+#define TELE_TRAMA_MAX       (1 + TELE_CONTENIDO_MAX + 1 + 1)	// Delimitador, COBS (+1 byte hasta 254) y delimitador
+#define ESCALA_CUATERNION    32767.0f
+
+/* Tareas medidas en la trama de tiempos */
+typedef enum {TAREA_LECTURA=0, TAREA_PUBLICACION, TAREA_FUSION, TAREA_RED, N_TAREAS} tareaTelemetria;
+
+
+/*--------Cargas de las tramas y estado de la telemetria------------------------*/
+typedef struct __attribute__((packed))
+{
+	uint16_t ejecuciones;				// Desde la trama anterior
+	uint16_t total_ms;
+	uint16_t max_ms;
+
+}tiempoTarea;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t tick_ms;					// HAL_GetTick() al enviarla
+	uint32_t vueltas_bucle;				// Vueltas del bucle principal desde la trama anterior
+	tiempoTarea tarea[N_TAREAS];
+	uint16_t tramas_perdidas;			// Tramas que no cupieron en la consola desde la anterior
+	uint8_t pendientes_tuberia;			// Registros sin entregar a los sumideros
+	uint8_t reservado;
+
+}tramaTiempos;
+
+_Static_assert(sizeof(registroCompacto) <= TELE_DATOS_MAX, "La muestra no cabe en una trama");
+_Static_assert(sizeof(tramaTiempos) == 36, "tramaTiempos debe ocupar 36 bytes");
+
+typedef struct
+{
+	uint8_t secuencia;
+	tramaTiempos tiempos;				// Se acumula entre tramas de tiempos
+	uint32_t tramas_enviadas;			// Totales, para la consola
+	uint32_t tramas_perdidas;
+
+}telemetriaBinaria;
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+void inicia_Telemetria(telemetriaBinaria* t);
+bool envia_TramaTelemetria(telemetriaBinaria* t, uint8_t tipo, const void* datos, uint8_t len);
+bool telemetria_Muestra(telemetriaBinaria* t, const registroCompacto* registro);
+bool telemetria_Actitud(telemetriaBinaria* t, const float cuaternion[4]);
+bool telemetria_Tiempos(telemetriaBinaria* t, uint8_t pendientes_tuberia);
+void anota_TiempoTarea(telemetriaBinaria* t, tareaTelemetria tarea, uint32_t duracion_ms);
+uint16_t crc16_Telemetria(const uint8_t* datos, size_t len);
+size_t codifica_COBS(const uint8_t* entrada, size_t len, uint8_t* salida);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Deja la telemetria sin tramas enviadas ni tiempos acumulados
+  * @param  t: telemetria a iniciar
+  * @retval None
+  */
+void inicia_Telemetria(telemetriaBinaria* t)
+{
+	memset(t, 0, sizeof(*t));
+}
+
+
+/**
+  * @brief  Empaqueta, codifica y deja en la consola una trama. Si no cabe entera se descarta y se contabiliza:
+  * nunca espera al UART.
+  * @param  t: telemetria
+  * @param  tipo: TELE_*
+  * @param  datos: carga de la trama
+  * @param  len: bytes de la carga, hasta TELE_DATOS_MAX
+  * @retval true si la trama entró en la consola
+  */
+bool envia_TramaTelemetria(telemetriaBinaria* t, uint8_t tipo, const void* datos, uint8_t len)
+{
+	uint8_t contenido[TELE_CONTENIDO_MAX];
+	uint8_t trama[TELE_TRAMA_MAX];
+	uint16_t crc;
+	size_t n;
+
+	if (len > TELE_DATOS_MAX) {
+		return false;
+	}
+
+	contenido[0] = tipo;
+	contenido[1] = t->secuencia++;
+	memcpy(&contenido[2], datos, len);
+	crc = crc16_Telemetria(contenido, 2U + len);
+	contenido[2 + len] = (uint8_t)(crc & 0xFF);
+	contenido[3 + len] = (uint8_t)(crc >> 8);
+
+	trama[0] = 0x00;
+	n = 1 + codifica_COBS(contenido, 4U + len, &trama[1]);
+	trama[n++] = 0x00;
+
+	if (consola_Escribe(CONSOLA_INFO, (const char*)trama, (int)n) != (int)n) {	//INFO descarta la trama entera
+		t->tramas_perdidas++;
+		t->tiempos.tramas_perdidas++;
+		return false;
+	}
+	t->tramas_enviadas++;
+	return true;
+}
+
+
+/**
+  * @brief  Trama de la muestra de cada segundo, tal cual el registro compacto
+  * @param  t: telemetria
+  * @param  registro: muestra
+  * @retval true si la trama entró en la consola
+  */
+bool telemetria_Muestra(telemetriaBinaria* t, const registroCompacto* registro)
+{
+	return envia_TramaTelemetria(t, TELE_MUESTRA, registro, sizeof(*registro));
+}
+
+
+/**
+  * @brief  Trama de una actualización de la fusión, con el cuaternion a 16 bits por componente
+  * @param  t: telemetria
+  * @param  cuaternion: x, y, z, w de Motion-FX, normalizado
+  * @retval true si la trama entró en la consola
+  */
+bool telemetria_Actitud(telemetriaBinaria* t, const float cuaternion[4])
+{
+	uint8_t datos[12];
+	uint32_t tick = HAL_GetTick();
+
+	memcpy(&datos[0], &tick, sizeof(tick));
+	for (uint8_t i = 0; i < 4; i++) {
+		float q = cuaternion[i];
+		int16_t v;
+
+		q = (q > 1.0f) ? 1.0f : ((q < -1.0f) ? -1.0f : q);
+		v = (int16_t)lroundf(q * ESCALA_CUATERNION);
+		memcpy(&datos[4 + 2 * i], &v, sizeof(v));
+	}
+	return envia_TramaTelemetria(t, TELE_ACTITUD, datos, sizeof(datos));
+}
+
+
+/**
+  * @brief  Trama con los tiempos acumulados de las tareas desde la anterior, que se reinician si se envía
+  * @param  t: telemetria
+  * @param  pendientes_tuberia: registros sin entregar a los sumideros
+  * @retval true si la trama entró en la consola
+  */
+bool telemetria_Tiempos(telemetriaBinaria* t, uint8_t pendientes_tuberia)
+{
+	t->tiempos.tick_ms = HAL_GetTick();
+	t->tiempos.pendientes_tuberia = pendientes_tuberia;
+
+	if (!envia_TramaTelemetria(t, TELE_TIEMPOS, &t->tiempos, sizeof(t->tiempos))) {
+		return false;
+	}
+	memset(&t->tiempos, 0, sizeof(t->tiempos));
+	return true;
+}
+
+
+/**
+  * @brief  Suma una ejecución de una tarea a la siguiente trama de tiempos
+  * @param  t: telemetria
+  * @param  tarea: TAREA_*
+  * @param  duracion_ms: lo que ha tardado, medido con HAL_GetTick()
+  * @retval None
+  */
+void anota_TiempoTarea(telemetriaBinaria* t, tareaTelemetria tarea, uint32_t duracion_ms)
+{
+	tiempoTarea* c = &t->tiempos.tarea[tarea];
+	uint16_t d = (duracion_ms > UINT16_MAX) ? UINT16_MAX : (uint16_t)duracion_ms;
+
+	if (c->ejecuciones < UINT16_MAX) c->ejecuciones++;
+	c->total_ms = ((uint32_t)c->total_ms + d > UINT16_MAX) ? UINT16_MAX : (uint16_t)(c->total_ms + d);
+	if (d > c->max_ms) c->max_ms = d;
+}
+
+
+/**
+  * @brief  CRC-16/CCITT-FALSE, bit a bit: las tramas son cortas y no merece una tabla en flash
+  * @param  datos: bytes a proteger
+  * @param  len: numero de bytes
+  * @retval CRC
+  */
+uint16_t crc16_Telemetria(const uint8_t* datos, size_t len)
+{
+	uint16_t crc = 0xFFFF;
+
+	while (len--) {
+		crc ^= (uint16_t)(*datos++) << 8;
+		for (uint8_t b = 0; b < 8; b++) {
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+
+/**
+  * @brief  Codificación COBS: cada grupo de hasta 254 bytes sin ceros va precedido de su longitud + 1
+  * @param  entrada: bytes a codificar
+  * @param  len: numero de bytes
+  * @param  salida: al menos len + len/254 + 1 bytes
+  * @retval bytes escritos, sin delimitador
+  */
+size_t codifica_COBS(const uint8_t* entrada, size_t len, uint8_t* salida)
+{
+	size_t codigo = 0, n = 1;
+	uint8_t cuenta = 1;
+
+	for (size_t i = 0; i < len; i++) {
+		if (entrada[i] == 0x00) {
+			salida[codigo] = cuenta;
+			codigo = n++;
+			cuenta = 1;
+		}
+		else {
+			salida[n++] = entrada[i];
+			if (++cuenta == 0xFF) {
+				salida[codigo] = cuenta;
+				codigo = n++;
+				cuenta = 1;
+			}
+		}
+	}
+	salida[codigo] = cuenta;
+	return n;
+}
+
+#endif  /* INC_TELEMETRIA_BINARIA_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
@@ -0,0 +1,243 @@
+/******************************************************************************
+* @file    Tuberia_Datos.h
+* @author  Sergio Vera Muñoz
+* @brief   Tubería de datos con sumideros: la adquisición deja cada registro en la
+* tubería y ésta lo copia en la cola propia de cada sumidero (SD, nube MQTT, monitor
+* por UART). Cada sumidero se atiende por separado, un registro por vuelta del bucle
+* principal, de modo que un sumidero lento o caído solo llena su propia cola y nunca
+* retiene la adquisición ni a los demás. Con la cola llena se descarta el registro más
+* antiguo de ese sumidero y se contabiliza.
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_TUBERIA_DATOS_H_
+#define INC_TUBERIA_DATOS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "main.h"
+#include "Registro_Compacto.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define N_MAX_SUMIDEROS        3	// SD, nube y monitor UART
+#define COLA_SUMIDERO_HUECOS   8	// Registros que aguanta cada sumidero sin ser atendido
+
+
+/*--------Tipos de registro y resultado de un sumidero------------------------*/
+typedef enum {DATO_MUESTRA=0, DATO_MEDIA} tipoDato;	// Muestra de cada segundo o media de la ventana de publicación
+
+typedef enum {
+	SUMIDERO_ERROR = -1,	// Fallo: el registro se conserva y no se reintenta hasta pasado espera_error_ms
+	SUMIDERO_OCUPADO = 0,	// Sin sitio de momento: el registro se conserva y se reintenta en la siguiente vuelta
+	SUMIDERO_HECHO = 1		// Registro entregado, sale de la cola
+}resultadoSumidero;
+
+
+/*--------Estructura de un sumidero y de la tubería------------------------*/
+typedef struct
+{
+	const char * nombre;
+	tipoDato tipo;								// Solo recibe los registros de este tipo
+	resultadoSumidero (*consume)(const registroCompacto* registro);	// Entrega de un registro; debe volver sin esperar a nada
+	uint32_t espera_error_ms;
+
+	registroCompacto cola[COLA_SUMIDERO_HUECOS];	// Cola circular propia del sumidero
+	uint8_t cabeza;								// Registro más antiguo
+	uint8_t n_pendientes;
+	uint32_t t_reintento;						// HAL_GetTick() a partir del cual se puede volver a llamar tras un error
+
+	uint32_t n_recibidos;						// Estadisticas, se reinician al imprimirlas
+	uint32_t n_entregados;
+	uint32_t n_descartados;
+	uint32_t n_errores;
+	uint32_t t_consume_max_ms;
+
+}sumideroDatos;
+
+typedef struct
+{
+	sumideroDatos* sumidero[N_MAX_SUMIDEROS];
+	uint8_t n_sumideros;
+
+}tuberiaDatos;
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+void inicia_Tuberia(tuberiaDatos* tuberia);
+bool conecta_Sumidero(tuberiaDatos* tuberia, sumideroDatos* sumidero, const char* nombre, tipoDato tipo,
+					  resultadoSumidero (*consume)(const registroCompacto* registro), uint32_t espera_error_ms);
+void difunde_Tuberia(tuberiaDatos* tuberia, const registroCompacto* dato, tipoDato tipo);
+void servicio_Tuberia(tuberiaDatos* tuberia);
+uint32_t pendientes_Tuberia(const tuberiaDatos* tuberia);
+void imprime_EstadisticasTuberia(tuberiaDatos* tuberia);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Deja la tubería sin sumideros
+  * @param  tuberia: tubería a iniciar
+  * @retval None
+  */
+void inicia_Tuberia(tuberiaDatos* tuberia)
+{
+	memset(tuberia, 0, sizeof(*tuberia));
+}
+
+
+/**
+  * @brief  Inicia un sumidero con su cola vacía y lo añade a la tubería
+  * @param  tuberia: tubería destino
+  * @param  sumidero: almacenamiento del sumidero, con su cola (estatico en el llamante)
+  * @param  nombre: nombre para las estadisticas
+  * @param  tipo: tipo de registro que recibe
+  * @param  consume: función de entrega de un registro
+  * @param  espera_error_ms: tiempo sin llamarlo tras un SUMIDERO_ERROR
+  * @retval false si la tubería ya tiene N_MAX_SUMIDEROS
+  */
+bool conecta_Sumidero(tuberiaDatos* tuberia, sumideroDatos* sumidero, const char* nombre, tipoDato tipo,
+					  resultadoSumidero (*consume)(const registroCompacto* registro), uint32_t espera_error_ms)
+{
+	if (tuberia->n_sumideros >= N_MAX_SUMIDEROS) {
+		return false;
+	}
+
+	memset(sumidero, 0, sizeof(*sumidero));
+	sumidero->nombre = nombre;
+	sumidero->tipo = tipo;
+	sumidero->consume = consume;
+	sumidero->espera_error_ms = espera_error_ms;
+	sumidero->t_reintento = HAL_GetTick();
+
+	tuberia->sumidero[tuberia->n_sumideros++] = sumidero;
+	return true;
+}
+
+
+/**
+  * @brief  Copia un registro en la cola de cada sumidero de su tipo. Nunca espera: si la cola de un
+  * sumidero está llena se pierde su registro más antiguo, solo en ese sumidero.
+  * @param  tuberia: tubería
+  * @param  dato: registro a difundir
+  * @param  tipo: DATO_MUESTRA o DATO_MEDIA
+  * @retval None
+  */
+void difunde_Tuberia(tuberiaDatos* tuberia, const registroCompacto* dato, tipoDato tipo)
+{
+	for (uint8_t i = 0; i < tuberia->n_sumideros; i++) {
+
+		sumideroDatos* s = tuberia->sumidero[i];
+
+		if (s->tipo != tipo) {
+			continue;
+		}
+
+		if (s->n_pendientes >= COLA_SUMIDERO_HUECOS) {	//cola llena: sale el más antiguo
+			s->cabeza = (s->cabeza + 1) % COLA_SUMIDERO_HUECOS;
+			s->n_pendientes--;
+			s->n_descartados++;
+		}
+
+		s->cola[(s->cabeza + s->n_pendientes) % COLA_SUMIDERO_HUECOS] = *dato;
+		s->n_pendientes++;
+		s->n_recibidos++;
+	}
+}
+
+
+/**
+  * @brief  Atiende a los sumideros: como mucho un registro por sumidero y llamada, el más antiguo de su
+  * cola. Los que están esperando tras un error se saltan sin llamarlos.
+  * @param  tuberia: tubería
+  * @retval None
+  */
+void servicio_Tuberia(tuberiaDatos* tuberia)
+{
+	for (uint8_t i = 0; i < tuberia->n_sumideros; i++) {
+
+		sumideroDatos* s = tuberia->sumidero[i];
+		resultadoSumidero resultado;
+		uint32_t t_inicio = HAL_GetTick(), t_consume = 0;
+
+		if ( (s->n_pendientes == 0) || ((int32_t)(t_inicio - s->t_reintento) < 0) ) {
+			continue;
+		}
+
+		resultado = s->consume(&s->cola[s->cabeza]);
+
+		t_consume = HAL_GetTick() - t_inicio;
+		if (t_consume > s->t_consume_max_ms) {
+			s->t_consume_max_ms = t_consume;
+		}
+
+		if (resultado == SUMIDERO_HECHO) {
+			s->cabeza = (s->cabeza + 1) % COLA_SUMIDERO_HUECOS;
+			s->n_pendientes--;
+			s->n_entregados++;
+		}
+		else if (resultado == SUMIDERO_ERROR) {
+			s->n_errores++;
+			s->t_reintento = HAL_GetTick() + s->espera_error_ms;
+		}
+	}
+}
+
+
+/**
+  * @brief  Registros pendientes en el conjunto de sumideros, para no entrar en bajo consumo con trabajo pendiente
+  * @param  tuberia: tubería
+  * @retval numero de registros sin entregar
+  */
+uint32_t pendientes_Tuberia(const tuberiaDatos* tuberia)
+{
+	uint32_t n = 0;
+
+	for (uint8_t i = 0; i < tuberia->n_sumideros; i++) {
+		n += tuberia->sumidero[i]->n_pendientes;
+	}
+	return n;
+}
+
+
+/**
+  * @brief  Imprime por cada sumidero los registros recibidos, entregados, descartados por cola llena,
+  * los errores y el mayor tiempo de una entrega, y reinicia las estadisticas
+  * @param  tuberia: tubería
+  * @retval None
+  */
+void imprime_EstadisticasTuberia(tuberiaDatos* tuberia)
+{
+	for (uint8_t i = 0; i < tuberia->n_sumideros; i++) {
+
+		sumideroDatos* s = tuberia->sumidero[i];
+
+		printf("Sumidero %-5s: %lu recibidos, %lu entregados, %lu descartados, %lu errores, %u en cola, entrega max %lu ms\n",
+			   s->nombre, (unsigned long)s->n_recibidos, (unsigned long)s->n_entregados, (unsigned long)s->n_descartados,
+			   (unsigned long)s->n_errores, s->n_pendientes, (unsigned long)s->t_consume_max_ms);
+
+		s->n_recibidos = 0;
+		s->n_entregados = 0;
+		s->n_descartados = 0;
+		s->n_errores = 0;
+		s->t_consume_max_ms = 0;
+	}
+}
+
+#endif  /* INC_TUBERIA_DATOS_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
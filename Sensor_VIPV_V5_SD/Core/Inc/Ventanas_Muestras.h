@@ -0,0 +1,230 @@
+/******************************************************************************
+* @file    Ventanas_Muestras.h
+* @author  Sergio Vera Muñoz
+* @brief   Ventanas de muestras en ping-pong para la media de publicación. La lectura
+* llena siempre una ventana (LLENANDO) mientras la publicación calcula la media de la
+* anterior (PUBLICANDO); el paso de una a otra es explicito: cierra_Ventana() entrega la
+* ventana llena a la publicación y libera_Ventana() la devuelve cuando ya no se usa. Si
+* la publicación aún no ha liberado la ventana anterior, el cierre se pospone y la
+* lectura sigue en la misma.
+* Cada ventana acumula su estadistica en linea (Estadistica_Ventana.h), sin limite de
+* muestras, y además la serie de muestras a 1 Hz que se publica con la media (campo "s"
+* de Codec_Ventana.h) y de la que salen los campos concatenados de ThingSpeak.
+* La serie tiene sitio para N_MAX_SERIE muestras: una ventana de hasta N_MAX_SERIE
+* lecturas se guarda entera. En una ventana más larga, al llenarse la serie se diezma
+* a la mitad (se quedan las muestras pares) y se dobla paso_serie, de modo que la serie
+* sigue equiespaciada y cubre la ventana completa con N_MAX_SERIE/2..N_MAX_SERIE muestras,
+* una de cada paso_serie lecturas. Cada diezmado se contabiliza en n_diezmados y el
+* codificador marca la serie con el numero de lecturas reales.
+******************************************************************************
+* @attention
+*
+*  Copyright (c) 2020 Sergio Vera - TFG: "Sensor IoT para integración de
+*  generacion fotovoltáica en vehículos eléltricos". ETSIDI - UPM
+* All rights reserved
+*
+* THIS SOFTWARE IS PROVIDED BY SERGIOVERAELECTRONICS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+* PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+* RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW.
+******************************************************************************
+*/
+
+#ifndef INC_VENTANAS_MUESTRAS_H_
+#define INC_VENTANAS_MUESTRAS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "sensors_data.h"
+#include "Estadistica_Ventana.h"
+#include "Registro_Compacto.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define N_VENTANAS   2		// Una llenándose y otra publicándose
+#define N_MAX_SERIE  60		// Muestras de la serie: un minuto a 1 Hz sin diezmar
+
+
+/*--------Estado de una ventana y del gestor------------------------*/
+typedef enum {
+	VENTANA_LIBRE = 0,		// Sin dueño, disponible para la lectura
+	VENTANA_LLENANDO,		// De la lectura: solo guarda_Muestra() escribe en ella
+	VENTANA_PUBLICANDO		// De la publicación, desde cierra_Ventana() hasta libera_Ventana()
+}estadoVentana;
+
+typedef struct
+{
+	estadisticaVentana estadistica;	// Todas las muestras de la ventana, para la media
+	registroCompacto muestra[N_MAX_SERIE];	// Serie equiespaciada: una de cada paso_serie lecturas
+	uint16_t n_muestras;
+	uint16_t paso_serie;			// Potencia de 2, se dobla en cada diezmado
+	estadoVentana estado;
+	uint32_t secuencia;				// Numero de ventana cerrada, para seguir las entregas en la consola
+
+}ventanaMuestras;
+
+typedef struct
+{
+	ventanaMuestras ventana[N_VENTANAS];
+	ventanaMuestras* llenando;		// Ventana en la que escribe la lectura
+	uint32_t n_cerradas;
+
+	uint32_t n_guardadas;			// Estadisticas, se reinician al imprimirlas
+	uint32_t n_diezmados;			// Veces que una serie llena se redujo a la mitad
+	uint32_t n_pospuestas;			// Cierres sin ventana libre: la publicación no liberó la anterior
+
+}gestorVentanas;
+
+
+/* ------------------------------------Prototipos de funciones ----------------------------------------------------------*/
+
+void inicia_Ventanas(gestorVentanas* g);
+void guarda_Muestra(gestorVentanas* g, const megaDato* dato, const registroCompacto* registro);
+uint32_t muestras_Ventana(const gestorVentanas* g);
+ventanaMuestras* cierra_Ventana(gestorVentanas* g);
+void libera_Ventana(gestorVentanas* g, ventanaMuestras* v);
+void imprime_EstadisticasVentanas(gestorVentanas* g);
+
+
+/* ------------------------------------Definicion de funciones ----------------------------------------------------------*/
+
+/**
+  * @brief  Deja todas las ventanas libres y la primera en manos de la lectura
+  * @param  g: gestor a iniciar
+  * @retval None
+  */
+void inicia_Ventanas(gestorVentanas* g)
+{
+	memset(g, 0, sizeof(*g));
+	for (uint8_t i = 0; i < N_VENTANAS; i++) {
+		g->ventana[i].paso_serie = 1;
+	}
+	g->llenando = &g->ventana[0];
+	g->llenando->estado = VENTANA_LLENANDO;
+}
+
+
+/**
+  * @brief  Añade una muestra a la ventana que se está llenando. Entra en la serie si le toca por paso_serie;
+  * si además la serie está llena, antes se diezma a la mitad y se dobla el paso.
+  * @param  g: gestor
+  * @param  dato: muestra leida, para la estadistica
+  * @param  registro: la misma muestra compactada, para la serie
+  * @retval None
+  */
+void guarda_Muestra(gestorVentanas* g, const megaDato* dato, const registroCompacto* registro)
+{
+	ventanaMuestras* v = g->llenando;
+	uint32_t indice = v->estadistica.n_muestras;		// Lecturas anteriores de la ventana
+
+	acumula_Estadistica(&v->estadistica, dato);
+	g->n_guardadas++;
+
+	if ((indice % v->paso_serie) != 0) {
+		return;
+	}
+	if (v->n_muestras >= N_MAX_SERIE) {
+		/* Las muestras pares de la serie son las de indice multiplo de 2*paso: siguen equiespaciadas */
+		for (uint16_t i = 0; (2 * i) < v->n_muestras; i++) {
+			v->muestra[i] = v->muestra[2 * i];
+		}
+		v->n_muestras = (uint16_t)((v->n_muestras + 1) / 2);
+		v->paso_serie *= 2;
+		g->n_diezmados++;
+
+		if ((indice % v->paso_serie) != 0) {
+			return;
+		}
+	}
+	v->muestra[v->n_muestras++] = *registro;
+}
+
+
+/**
+  * @brief  Muestras de la ventana que se está llenando
+  * @param  g: gestor
+  * @retval numero de muestras
+  */
+uint32_t muestras_Ventana(const gestorVentanas* g)
+{
+	return g->llenando->estadistica.n_muestras;
+}
+
+
+/**
+  * @brief  Entrega a la publicación la ventana que se está llenando y pasa la lectura a una ventana libre.
+  * La ventana devuelta no se modifica hasta libera_Ventana().
+  * @param  g: gestor
+  * @retval ventana cerrada, o NULL si está vacía o no hay ventana libre (el cierre se pospone)
+  */
+ventanaMuestras* cierra_Ventana(gestorVentanas* g)
+{
+	ventanaMuestras* cerrada = g->llenando;
+	ventanaMuestras* libre = NULL;
+
+	if (cerrada->estadistica.n_muestras == 0) {
+		return NULL;
+	}
+
+	for (uint8_t i = 0; i < N_VENTANAS; i++) {
+		if (g->ventana[i].estado == VENTANA_LIBRE) {
+			libre = &g->ventana[i];
+			break;
+		}
+	}
+
+	if (libre == NULL) {
+		g->n_pospuestas++;
+		return NULL;
+	}
+
+	cerrada->estado = VENTANA_PUBLICANDO;
+	cerrada->secuencia = ++g->n_cerradas;
+
+	reinicia_Estadistica(&libre->estadistica);
+	libre->n_muestras = 0;
+	libre->paso_serie = 1;
+	libre->estado = VENTANA_LLENANDO;
+	g->llenando = libre;
+
+	return cerrada;
+}
+
+
+/**
+  * @brief  Devuelve al gestor una ventana cerrada, una vez calculada su media y publicada su serie
+  * @param  g: gestor
+  * @param  v: ventana obtenida de cierra_Ventana()
+  * @retval None
+  */
+void libera_Ventana(gestorVentanas* g, ventanaMuestras* v)
+{
+	if ( (v == NULL) || (v == g->llenando) ) {
+		return;
+	}
+	v->estado = VENTANA_LIBRE;
+}
+
+
+/**
+  * @brief  Imprime las muestras guardadas, los diezmados de la serie y los cierres pospuestos, y reinicia
+  * las estadisticas
+  * @param  g: gestor
+  * @retval None
+  */
+void imprime_EstadisticasVentanas(gestorVentanas* g)
+{
+	printf("Ventanas: %lu cerradas, %lu muestras guardadas, %lu diezmados de serie, %lu cierres pospuestos, %lu en curso\n",
+		   (unsigned long)g->n_cerradas, (unsigned long)g->n_guardadas, (unsigned long)g->n_diezmados,
+		   (unsigned long)g->n_pospuestas, (unsigned long)muestras_Ventana(g));
+
+	g->n_guardadas = 0;
+	g->n_diezmados = 0;
+	g->n_pospuestas = 0;
+}
+
+#endif  /* INC_VENTANAS_MUESTRAS_H_ */
+
+/************************ (C) COPYRIGHT Sergio Vera Muñoz --- TFG 2020   --- *****END OF FILE****/
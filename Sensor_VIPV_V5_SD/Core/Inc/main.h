@@ -44,12 +44,19 @@ extern "C" {
 #define MI_SSID_WIFI  "HP de David"
 #define MI_PSWRD_WIFI "prueba1234"
 #define MI_SCRTYLVL  WIFI_ECN_WPA2_PSK
+#define MIS_REDES_WIFI  { {MI_SSID_WIFI, MI_PSWRD_WIFI, MI_SCRTYLVL} }
+	/* Redes conocidas para la itinerancia (cochera, oficina, casa...), hasta USER_CONF_WIFI_KNOWN_MAX entradas
+	 * {ssid, clave, seguridad}. La primera es la de arranque; se pueden cambiar desde la consola al reconfigurar */
 
 #define CANAL1_THINSPEAK_WR_APIKEY "channels/2022892/publish"
 #define CANAL2_THINSPEAK_WR_APIKEY "channels/2022893/publish"
 #define CANAL3_THINSPEAK_WR_APIKEY "channels/2044103/publish"
 #define CANAL4_THINSPEAK_WR_APIKEY "channels/2048028/publish"
 
+#define CLAVE_COMANDOS  ""
+	/* Clave HMAC-SHA256 de los comandos remotos, de 32 a 64 caracteres hexadecimales (16 a 32 bytes), compartida
+	 * con quien los firma. Vacía, el canal de comandos queda deshabilitado (ver Comandos_Remotos.h) */
+
 
 #include "stm32l475e_iot01.h"
 #include "stm32l4xx_hal_iwdg.h"
@@ -70,6 +77,7 @@ extern "C" {
 #include <stdio.h>
 #include <stdbool.h>
 #include "timedate.h"
+#include "sntp.h"
 #include "flash.h"
 #ifdef FIREWALL_MBEDLIB
 #include "firewall_wrapper.h"
@@ -104,15 +112,32 @@ extern int mbedtls_hardware_poll( void *data, unsigned char *output, size_t len,
 enum {BP_NOT_PUSHED=0, BP_SINGLE_PUSH, BP_MULTIPLE_PUSH};
 /*enumeración para ver el nº veces botón de usuario pulsado por itnerrupción*/
 
+typedef enum {SONDA_RADIACION=0, SONDA_RECABAR, SONDA_NMEA, SONDA_FUSION, SONDA_MOTIONFX, SONDA_SD,
+			  SONDA_PUBLICACION, SONDA_ENVIO_MQTT, SONDA_TLS, SONDA_VACIA, N_SONDAS} sondaPerfil;
+/*sondas del perfilador de ciclos DWT (Perfilador_DWT.h)*/
+
 /* USER CODE END ET */
 
 /* Exported constants --------------------------------------------------------*/
 /* USER CODE BEGIN EC */
+/*Registros de backup del RTC: 32, de RTC_BKP_DR0 a RTC_BKP_DR31. Sobreviven a los reinicios, pero no a un corte de
+ *alimentación (VBAT va a VDD en la placa). Cada uno tiene un único dueño:
+ *  DR0         marca de RTC configurado (STM32CubeRTCInterface.c)
+ *  DR1-DR15    libres
+ *  DR16-DR24   caché DNS: cabecera y 4 entradas de hash e IPv4 (net_dns_cache.c)
+ *  DR25-DR29   actualización del firmware: estado, tamaño, progreso, CRC y etiqueta de la imagen (rfu.c)
+ *  DR30-DR31   sello del último comando remoto aceptado, mitades baja y alta (AppIoT_TFG_VIPV.c) */
+#define BKP_PRIMERO_DNS       RTC_BKP_DR16
+#define BKP_PRIMERO_RFU       RTC_BKP_DR25
+#define BKP_SELLO_COMANDOS    RTC_BKP_DR30
 
 /* USER CODE END EC */
 
 /* Exported macro ------------------------------------------------------------*/
 /* USER CODE BEGIN EM */
+/*Medida en ciclos del codigo entre las dos macros, en el mismo bloque: ABRE_SONDA(SONDA_SD); f_write(...); CIERRA_SONDA(SONDA_SD);*/
+#define ABRE_SONDA(s)    uint32_t inicio_##s = DWT->CYCCNT
+#define CIERRA_SONDA(s)  registra_Sonda((s), DWT->CYCCNT - inicio_##s)
 
 /* USER CODE END EM */
 
@@ -134,6 +159,8 @@ extern net_hnd_t         hnet;
 
 extern const user_config_t *lUserConfigPtr;
 
+void registra_Sonda(sondaPerfil sonda, uint32_t ciclos);
+
 /* USER CODE END EFP */
 
 /* Private defines -----------------------------------------------------------*/
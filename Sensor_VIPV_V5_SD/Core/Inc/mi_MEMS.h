@@ -33,7 +33,7 @@
 #define MAG_HIOFFSET_Y 			 233	// Comprobar paper de STM: "Getting started with MotionFX sensor fusion library in X-CUBE-MEMS1expansion"
 #define MAG_HIOFFSET_Z			 91		// https://www.st.com/resource/en/user_manual/dm00394369-getting-started-with-motionfx-sensor-fusion-library-in-xcubemems1-expansion-for-stm32cube-stmicroelectronics.pdf
 
-#define ALGORITHM_FREQ  50.0f 			// Frecuencia de ejecución del algoritomo, necesita ser modificada desde el MX TIM6
+#define ALGORITHM_FREQ  50.0f 			// Frecuencia nominal del algoritmo, debe coincidir con el MX TIM6 (ver Fusion_Adaptativa.h)
 
 #define ALGO_PERIOD  ((int)(1000.0f / ALGORITHM_FREQ)) 				 // Algorithm period [ms]
 #define MOTION_FX_ENGINE_DELTATIME  ((float)(1.0f / ALGORITHM_FREQ)) //periodo de computacion de f. Kalman en [s]
@@ -97,6 +97,7 @@ static MOTION_SENSOR_Axes_t AccValue;
 static MOTION_SENSOR_Axes_t GyrValue;
 static MOTION_SENSOR_Axes_t MagValue;
 static volatile uint32_t TimeStamp = 0;
+static uint32_t tiempo_FX_us = 0;		//Duración de la última iteración de MotionFX medida con el DWT, en [us]
 
 
 static MOTION_SENSOR_Axes_t MagOffset = {MAG_HIOFFSET_X, MAG_HIOFFSET_Y, MAG_HIOFFSET_Z}; //pueden estar inicializados
@@ -123,12 +124,10 @@ void BSP_SENSOR_MAG_GetOrientation(char *Orientation);
 
 void get_DatosIMU(int16_t* pAcc, float* pGyr, int16_t* pMag);
 void MX_MEMS_Init(void);
-void MX_MEMS_Process(float* roll, float* pitch, float* yaw);
-void FX_Data_Handler(float* roll, float* pitch, float* yaw);
+void MX_MEMS_Process(MFX_output_t* salida, float delta_time, bool lee_magnetometro);
+void FX_Data_Handler(MFX_output_t* salida, float delta_time);
 
 void DWT_Init(void);
-void DWT_Start(void);
-uint32_t DWT_Stop(void);
 char MotionFX_LoadMagCalFromNVM(unsigned short int dataSize, unsigned int *data);
 char MotionFX_SaveMagCalInNVM(unsigned short int dataSize, unsigned int *data);
 
@@ -182,24 +181,30 @@ char MotionFX_SaveMagCalInNVM(unsigned short int dataSize, unsigned int *data);
   * @brief  Función principal de procesado del algoritmo. Cada llamada representa una iteración de cómputo del
   * algoritmo entero de las funciones de la libería. Recaba datos de sensores y provesa el algoritmo, realizando un
   * cambio de base espacial en función de los ejes definidos para la aplicación.
-  * @param punteros a variables que albergan los datos a ser devueltos por el algoritmo
+  * @param salida: estructura de salida de Motion-FX con las soluciones de los motores habilitados
+  * @param delta_time: tiempo transcurrido desde la iteración anterior, en [s]
+  * @param lee_magnetometro: si es falso no se lee el LIS3MDL (motor 6X), el campo magnético entra a 0
   * @retval None
   */
- void MX_MEMS_Process(float* roll, float* pitch, float* yaw)
+ void MX_MEMS_Process(MFX_output_t* salida, float delta_time, bool lee_magnetometro)
 {
   int16_t AccData[MFX_NUM_AXES] = {0};
   float GyroData[MFX_NUM_AXES] = {0.0f};
   int16_t MagnetoData[MFX_NUM_AXES] = {0};
 
 	 /*SENSOR	gaterhing Data*/
-	get_DatosIMU(&AccData[0], &GyroData[0], &MagnetoData[0]);
+	Accelero_Sensor_Handler(&AccData[0]);
+	Gyro_Sensor_Handler(&GyroData[0]);
+	if (lee_magnetometro) {
+		Magneto_Sensor_Handler(&MagnetoData[0]);
+	}
 
 	AccValue.x = (int32_t) AccData[0];  AccValue.y = (int32_t) AccData[1];  AccValue.z = (int32_t) AccData[2];
 	MagValue.x = (int32_t) MagnetoData[0]; MagValue.y = (int32_t) MagnetoData[1];  MagValue.z = (int32_t) MagnetoData[2];
 	GyrValue.x = (int32_t) roundf(GyroData[0]);  GyrValue.y = (int32_t) roundf(GyroData[1]);    GyrValue.z = (int32_t) roundf(GyroData[2]);
 
 	/* Sensor Fusion specific part */
-	FX_Data_Handler(roll, pitch, yaw);
+	FX_Data_Handler(salida, delta_time);
 
 	//printf("\x1b[2J" "\x1b[f"); //limpiar buffer y ventana de TeraTerm
 
@@ -208,17 +213,16 @@ char MotionFX_SaveMagCalInNVM(unsigned short int dataSize, unsigned int *data);
 
 /**
  * @brief  Función de llamada a la funcion interna de procesado de datos. Convierte los datos de entrada a las unidades
- * correspondientes.
- * @param  punteros a vectores que albergan los datos devueltos por el algoritmo
+ * correspondientes. No calcula angulos de Euler: se obtienen una vez por segundo a partir de la media acumulada
+ * de los cuaterniones (ver Actitud_MEMS.h), no en cada iteración.
+ * @param  salida: estructura donde Motion-FX devuelve su solución
+ * @param  delta_time: periodo de la iteración en [s], depende de la frecuencia de fusión vigente
  * @retval None
  */
- void FX_Data_Handler(float* roll, float* pitch, float* yaw)
+ void FX_Data_Handler(MFX_output_t* salida, float delta_time)
 {
- // uint32_t elapsed_time_us = 0U;
   MFX_input_t data_in;
   MFX_input_t *pdata_in = &data_in;
-  MFX_output_t data_out;
-  MFX_output_t *pdata_out = &data_out;
 
 	/* Convert angular velocity from [mdps] to [dps] */
 	data_in.gyro[0] = (float)GyrValue.x * FROM_MDPS_TO_DPS;
@@ -236,9 +240,12 @@ char MotionFX_SaveMagCalInNVM(unsigned short int dataSize, unsigned int *data);
 	data_in.mag[2] = (float)MagValue.z * FROM_MGAUSS_TO_UT50;
 
 	/* Run Sensor Fusion algorithm */
-	DWT_Start();
-	MotionFX_manager_run(pdata_in, pdata_out, MOTION_FX_ENGINE_DELTATIME);
-	DWT_Stop();
+	uint32_t inicio_FX = DWT->CYCCNT;
+	MotionFX_manager_run(pdata_in, salida, delta_time);
+	uint32_t ciclos_FX = DWT->CYCCNT - inicio_FX;
+
+	registra_Sonda(SONDA_MOTIONFX, ciclos_FX);
+	tiempo_FX_us = ciclos_FX / (SystemCoreClock / 1000000U);
 
 //	typedef struct		//Estructura de datos que maneja la liberia
 //	{
@@ -251,9 +258,6 @@ char MotionFX_SaveMagCalInNVM(unsigned short int dataSize, unsigned int *data);
 //	} MFX_output_t;
 
 
-	*roll =  pdata_out->rotation_9X[2] ; 	//Cambio sistema referencia del vehiculo, a NED
-	*pitch=  pdata_out->rotation_9X[1] ;
-	*yaw =   (pdata_out->rotation_9X[0] < 0.0f ) ? (360.0f + pdata_out->rotation_9X[0]) : (pdata_out->rotation_9X[0]); //positivo
 
 }
 
@@ -465,7 +469,8 @@ void BSP_SENSOR_MAG_GetOrientation(char *Orientation)
 
 
 /**
- * @brief  Initialize DWT register for counting clock cycles purpose
+ * @brief  Initialize DWT register for counting clock cycles purpose. The counter runs free from here on and
+ * is shared by every probe of the profiler (Perfilador_DWT.h): it is never cleared nor stopped.
  * @param  None
  * @retval None
  */
@@ -473,38 +478,9 @@ void BSP_SENSOR_MAG_GetOrientation(char *Orientation)
 {
   CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
 
-  DWT->CTRL &= ~DWT_CTRL_CYCCNTENA_Msk; /* Disable counter */
-}
-
-/**
- * @brief  Start counting clock cycles
- * @param  None
- * @retval None
- */
- void DWT_Start(void)
-{
-  DWT->CYCCNT = 0; /* Clear count of clock cycles */
   DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk; /* Enable counter */
 }
 
-/**
- * @brief  Stop counting clock cycles and calculate elapsed time in [us]
- * @param  None
- * @retval Elapsed time in [us]
- */
- uint32_t DWT_Stop(void)
-{
-  volatile uint32_t cycles_count = 0U;
-  uint32_t system_core_clock_mhz = 0U;
-
-  DWT->CTRL &= ~DWT_CTRL_CYCCNTENA_Msk; /* Disable counter */
-  cycles_count = DWT->CYCCNT; /* Read count of clock cycles */
-
-  /* Calculate elapsed time in [us] */
-  system_core_clock_mhz = SystemCoreClock / 1000000U;
-  return cycles_count / system_core_clock_mhz;
-}
-
  /**
   * @brief  Load calibration parameter from memory
   * @param  dataSize length ot the data
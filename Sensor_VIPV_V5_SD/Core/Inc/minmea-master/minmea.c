@@ -14,6 +14,7 @@
 #include <stdarg.h>
 #include <time.h>
 #include "main.h"
+#include "heap.h"
 
 #define boolstr(s) ((s) ? "true" : "false")
 
@@ -666,7 +667,11 @@ uint8_t segmentarNMEA(char* src,  size_t old_posi,size_t posi,  sentenciaNMEA mi
   size_t tam = (posi>old_posi)? (posi-old_posi) : (TAM_BUFNMEA-old_posi+posi ) ;
 	if(posi-old_posi==0) tam=MINMEA_MAX_LENGTH*NMAX_FRASES;
 
-  char* dest = (char*) malloc( tam * sizeof(char) + 1 );
+  char* dest = (char*) heap_class_alloc(HEAP_CLASS_NMEA, tam + 1, sizeof(char));
+
+  if (dest == NULL) {
+	  return 0;
+  }
 
   //Primero de todo, segmenta el Buffer para extraer el mensaje en funcion de los punteros old_pos y pos
 
@@ -732,12 +737,12 @@ uint8_t segmentarNMEA(char* src,  size_t old_posi,size_t posi,  sentenciaNMEA mi
    n_frase++;
 
    } while( ! (posicion_ini[1] == NULL || n_frase>= NMAX_FRASES || long_buff>=TAM_BUFNMEA)); // continuará busando frases NMEA mientras se agote el Buffer o haya como maximo NMAX_FRASES
-   free(dest);
+   heap_class_free(HEAP_CLASS_NMEA, dest);
    return nfrases_correct;     // seria return --n_frase;
   }
 
   else 	{
-	  free(dest);
+	  heap_class_free(HEAP_CLASS_NMEA, dest);
 	  return 0; // si no ha encontrado ningún $ en el buffer
   }
 }
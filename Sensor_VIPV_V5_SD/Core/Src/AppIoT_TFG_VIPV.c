@@ -30,18 +30,106 @@
 
 /* Private variables ---------------------------------------------------------*/
 
-static bool estado = CONECTADO;
+static bool estado = DESCONECTADO;		//CONECTADO solo con la sesion MQTT abierta por servicio_RedSegundoPlano()
 #ifdef ENABLE_LOWPWR
 bool modo_BajoConsumo = false, ocioso = true;
 #endif
-static uint16_t contador_lectura = 0, contador_MEMS = 0;
 
-static megaDato vectorLecturaDato[N_ELEMENTOS] = { {0.0f} };	//inicializacion a 0 de todo el vector
+static gestorVentanas ventanas;		//ventanas de muestras en ping-pong: una se llena mientras se publica la otra
+static estadisticaVentana ventanasLargas[N_VENTANAS_LARGAS];	//medias largas para los estudios energeticos, solo por consola
+static const uint16_t duracion_VentanasLargas[N_VENTANAS_LARGAS] = DURACION_VENTANAS_LARGAS_S;
+static const char* const nombre_VentanasLargas[N_VENTANAS_LARGAS] = NOMBRE_VENTANAS_LARGAS;
 
 static bool flag_lectura_datos=false, flag_publi_datos = false, flag_recupera_datos = false;
 static bool flag_lecturaMEMS = false;
 
-static float alebeo_sum = 0.0f, cabeceo_sum = 0.0f, guino_sum = 0.0f;
+static acumuladorActitud actitud_segundo, actitud_ventana;	//acumuladores de cuaterniones del segundo y de la ventana de publicacion
+static telemetriaBinaria telemetriaUART;		//tramas binarias por el USART1 con config.telemetria_binaria
+
+static colaMQTT colaPublicacion;				//paquetes PUBLISH serializados pendientes de envio o, con QoS 1, de su PUBACK
+static bool fifo_EnCola = false;				//media de la cabeza de la FIFO en la cola MQTT, se elimina al entregarse
+#define ETIQUETA_FIFO           1				//etiqueta en la cola MQTT de los paquetes de la media recuperada
+static volatile uint8_t parpadeos_LED = 0;		//conmutaciones del LED Wi-Fi pendientes, las consume el TIM6
+#define PARPADEOS_PUBLICACION   10				//notificacion visual de cada paquete publicado
+#define CANALES_POR_DATO        2				//paquetes que genera cada publica_Datos...ThingSpeak()
+#define PAQUETES_POR_MEDIA      ( (config.codec_nube == CODEC_THINGSPEAK) ? CANALES_POR_DATO : 1 )	//paquetes de publica_Media()
+#define HUECO_CONSOLA_MUESTRA   1024			//bytes de consola que ocupa una muestra de entrega_UART()
+
+static gestorRed red;							//puesta en marcha y recuperación de la red, un paso por vuelta del bucle principal
+static gestorRedes redesWiFi;					//red conocida elegida por scan o por la zona GPS
+static bool hora_Fijada = false;
+static uint32_t t_SNTP = 0, espera_SNTP = PERIODO_SNTP_MS;	//ultima sincronizacion del RTC y espera hasta la siguiente
+static bool red_LocalizaAP(cacheAP* ap);
+static bool red_Asocia(bool rapido);
+static bool red_TieneIP(void);
+static bool red_FijaHora(void);
+static void resincroniza_Hora(void);
+static bool red_AbreSocket(void);
+static bool red_ConectaMQTT(void);
+static bool red_Enlazada(void);
+static void red_Cierra(void);
+static bool abre_SocketSN(void);
+static const accionesRed acciones_Red = {red_LocalizaAP, red_Asocia, red_TieneIP, red_FijaHora,
+										 red_AbreSocket, red_ConectaMQTT, red_Enlazada, red_Cierra};
+static enlaceSN enlaceMQTTSN;					//medias por MQTT-SN/UDP con config.enlace_mqttsn
+static net_sockhnd_t socket_SN = NULL;
+static net_ipaddr_t ip_PasarelaSN;
+static int envia_UDP_SN(const uint8_t* trama, uint16_t tam);
+static int recibe_UDP_SN(uint8_t* trama, uint16_t tam);
+static const transporteSN transporte_SN = {envia_UDP_SN, recibe_UDP_SN};
+static volatile uint32_t lecturas_Perdidas = 0;	//disparos del LPTIM1 con la lectura anterior aun pendiente
+static bool primera_Muestra = true;
+
+static tuberiaDatos tuberia;					//reparto de muestras y medias a los sumideros
+static sumideroDatos sumideroSD, sumideroNube, sumideroUART;
+static bool sd_Montada = false;					//fichero creado y SD respondiendo; si falla se vuelve a montar
+
+static resultadoSumidero entrega_SD(const registroCompacto* registro);
+static resultadoSumidero entrega_Nube(const registroCompacto* registro);
+static resultadoSumidero entrega_UART(const registroCompacto* registro);
+
+static canalComandos comandos;					//comandos remotos firmados de TOPIC_COMANDOS, ver Comandos_Remotos.h
+static bool sello_Sembrado = false;				//sello mínimo subido a la hora de la red en este arranque
+static char topic_Comandos[MQTT_TOPIC_BUFFER_SIZE];	//Paho guarda el puntero al filtro de la suscripción
+static char topic_Respuestas[MQTT_TOPIC_BUFFER_SIZE];
+static char respuesta[RESPUESTA_SIZE];			//respuesta, o parte de una ráfaga o del log, a la espera de hueco en la cola MQTT
+static uint16_t longitud_Respuesta = 0;
+static configSensor config_Siguiente;			//config.json con los set remotos, también las claves que esperan al reinicio
+static bool sumideros_Pendientes = false;		//un set ha cambiado los sumideros con registros aun en sus colas
+#define ESPERA_COLA_COMANDO_MS  10000U			//espera máxima a que salga la cola MQTT antes de actualizar o reiniciar
+static struct {
+	bool activa;
+	verboComando verbo;							// VERBO_RAFAGA, VERBO_LOG, VERBO_ACTUALIZA o VERBO_REINICIA
+	uint64_t sello;
+	uint32_t t_inicio;							// HAL_GetTick() al aceptar el comando
+	uint16_t parte;								// Mensajes ya encolados
+	uint16_t n_muestras, hechas, enviadas, periodo_ms;	// Ráfaga
+	uint32_t epoch_inicio, t_siguiente;
+	uint32_t dt_ms[RAFAGA_MAX_MUESTRAS];
+	uint16_t irradiancia[RAFAGA_MAX_MUESTRAS][NMAX_MODULOS];	// En décimas de W/m2
+	extractorLog log;							// Log: registros de la franja por partes
+	uint16_t cabecera, ocupados;				// Bytes de la cabecera y de la parte del log en respuesta, aun sin encolar
+	bool error_sd;
+	bool descargada;							// Actualización: imagen verificada en el otro banco, a la espera de la cola
+} ejecucion;									//comando de varios pasos en curso, uno por vuelta del bucle
+static void recibe_MensajeComando(MessageData* md);
+static void suscribe_Comandos(void);
+static uint32_t epoch_RTC(void);
+static uint64_t lee_SelloComandos(void);
+static void guarda_SelloComandos(uint64_t sello);
+static void prepara_Respuesta(uint64_t sello, const char* verbo, const char* formato, ...);
+static bool envia_Respuesta(void);
+static void ejecuta_Comando(const comandoRemoto* cmd);
+static int  aplica_ConfiguracionRemota(const configSensor* nueva, char* texto, size_t tam);
+static void paso_Rafaga(void);
+static void paso_Log(void);
+static void paso_Salida(void);
+#ifdef RFU
+static void paso_Actualizacion(void);
+static void vigila_FirmwarePrueba(void);
+#endif
+
+configSensor config;						// Configuración efectiva: valores por defecto y config.json de la SD
 
 RTC_TimeTypeDef sTiempo_actual;			// Variables para el RTC
 RTC_DateTypeDef sDia_actual;
@@ -50,8 +138,15 @@ float Hora_Atardecer_Oficial = 24.0f;	// Esto en relacion al GMT, la franja que
 
 fifo miFIFO;								// Estructura FIFO para la recuperación de datos
 megaDato mimegaDato = {0.0f};				// Estrucutra de dato con todas las magnitudes a medir
-char fichName[12] = "";						// Nombre del fichero
+char fichName[13] = "";						// Nombre del fichero, MMDDhhmm.txt (o .bin) y el nulo
+char textoConfig[CONFIG_TEXTO_SIZE] = "";	// Configuración efectiva en JSON, para la consola y la cabecera de los ficheros
 megaDatoConcat mimegaDatoConcat;
+static struct {
+	uint32_t epoch;								// Epoch de la media de la ventana a la que pertenece
+	uint32_t n_leidas;							// Lecturas de la ventana: más que n_muestras si la serie se diezmó
+	uint16_t n_muestras;
+	registroCompacto muestra[N_MAX_SERIE];
+} serieVentana;								// Serie de la última ventana cerrada, para los codecs JSON y CBOR
 
 // variables para FATS
 FATFS FatFs; 	//Fatfs handle
@@ -59,7 +154,6 @@ FRESULT fres; //Result after operations
 
 FIL fil;
 FRESULT fres;
-BYTE readBuf[250];
 
 
 MQTTClient client;	//Variables para implementar la conexión MQTT a través de un socket
@@ -67,62 +161,46 @@ Network network;
 net_sockhnd_t socket;
 
 /**
- * @brief   Funcion principal del programa, la cual establece la conexión a internet, abre los sokets,
- * establece la conexión MQTT con el servidor IoT y lleva a cabo las comprobaciones de errores oportunas.
- * El bucle principal es infinito, con bucles itnernos propios condicionados a variables de salida de éstos.
- * Se basa en llamadas a otras rutinas y funciones para distribuir tareas. En caso de error severo, informa
- * al usuario por pantalla y resetea el programa completo.
+ * @brief   Funcion principal del programa. Arranca sin esperar a la red: tras leer la configuración de la flash
+ * y la de config.json en la SD, pone en marcha los sumideros de datos, los temporizadores y el bucle principal, de modo que la primera muestra se toma al segundo
+ * del reset aunque no haya cobertura. La conexión Wi-Fi, la hora de la red, el socket y la sesión MQTT se levantan
+ * despues en segundo plano, un paso por vuelta del bucle, con servicio_RedSegundoPlano(). En caso de error severo
+ * en la configuración, informa al usuario por pantalla y resetea el programa completo.
  * @param   void: no recibe parametros
  * @retval  no devuelve parametros.
  */
 void aplicacion_ClienteMQTT_XCLD_IoT(void)
 {
-  int ret = 0;	//valor de retorno de algunas funciones, para evaluarlo
-  bool conex_correcta = false;
   iniciado_Programa = false;
+  inicia_MonitorMemoria();	//con la pila aun poco profunda: pinta el hueco entre el heap y la pila
 
   memset(&mimegaDato, 0, sizeof(mimegaDato));
+  inicia_ColaMQTT(&colaPublicacion);
+  inicia_Perfilador();	//contador DWT en marcha y coste de las sondas medido antes de la primera
 
-  if ( inicializa_ConexionIoT() == true)  {	//si es correcto
-    iniciado_Programa = true;
+  if ( inicializa_Plataforma() == true)  {	//si es correcto, sin haber tocado la red
+    iniciado_Programa = true;	//timeouts cortos del modulo Wi-Fi: la adquisicion ya no espera a la red
     get_AmanecerAtardecer(&Hora_Amanecer_Oficial, &Hora_Atardecer_Oficial, LATITUD_STD, LONGITUD_STD) ;
     	/* De partida, sin estar listo el modulo de GPS, calculamos a priori si es de noche o de dia en el IES */
 
-    do { 	/*++++++++++++++++++++++ B U C L E    P R I N C I P A L    D E L	  P R O G R A M A ++++++++++++++++++++++++++++++++*/
-
-      /*Asegura los protocolos y niveles de seguidad en la conexion con el shocket*/
-       ret = check_protocoloConexion();
-       conex_correcta = inicia_ClienteMQTT(ret);
-
-      if (conex_correcta)  {
+    carga_Configuracion();
+    inicia_RedSegundoPlano();
+    conecta_Sumideros();	//la SD se vuelve a montar con el primer registro, sin retener el arranque
+    switch_Temporizadores(ENCENDER_TIMERS);
 
-    	 switch_Temporizadores(ENCENDER_TIMERS);
+    bucle_Principal();  /*-------------------------BUCLE INTERNO DE LECTURA Y ENVÍO DE DATOS----------------------------*/
 
-    	 if (OPCION_IoT == 0)	// Entramos en la función cuando la opción IoT está desactivada
-    		 inicializa_SD();
-
-         bucle_Principal();  /*-------------------------BUCLE INTERNO DE ENVÍO DE DATOS----------------------------*/
-
-         switch_Temporizadores(APAGAR_TIMERS);
-
-      }
-      else   {
-
-    	  if ( reconecta_WiFi() ) { //si ha habido exito
-    		  HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_SET);	//LED de conexión Wi-Fi}
-    	  }
-      }
-
-      desconectaConexionMQTT();
-
-    } while (g_connection_needed_score > 0);	/* FIN BUCLE PRINCIPAL DE LA APLICACIÓN*/
+    switch_Temporizadores(APAGAR_TIMERS);
+    desconectaConexionMQTT();
 
   }	// fin del if configuracion inicial correcta
 
   else {
 
   free_device_config(device_config);
-  platform_deinit();
+  if (hnet != NULL) {	//la red no se ha llegado a iniciar
+	  platform_deinit();
+  }
 
     msg_info("\nLlamando a HAL_NVIC_SystemReset(). Se reseteara el programa...\n");
     HAL_Delay(1500);
@@ -135,9 +213,9 @@ void aplicacion_ClienteMQTT_XCLD_IoT(void)
 
 /**
  * @brief   Funcion que implementa un bucle interno de Lectura-Publicacion de Datos
- * Recaba datos continuamente, hace media de ellos y los publica mientras no haya errores.
- *  Si todo es correcto, permanece leyendo y publicando datos continuamente en bucle,
- *  marcando su salida la variable de estado de conexion global "g_connection_needed_score"
+ * Recaba datos continuamente, hace media de ellos y los publica cuando hay enlace con la nube.
+ *  La red se levanta y se recupera desde el propio bucle, sin salir de él, por lo que la lectura
+ *  no se interrumpe por una caída de la conexión.
  *  Se basa en llamadas a otras rutinas para distribuir tareas, implementando 3 hilos de ejecucción
  * @param   void: no recibe parametros
  * @retval  no devuelve parametros.
@@ -148,9 +226,11 @@ void bucle_Principal(void)  {
 #ifdef ENABLE_LOWPWR
   uint32_t n_ocio = 0;
 #endif
+  uint32_t t_tarea = 0;	//inicio de la tarea en curso, para la telemetria de tiempos
 
   do
   {
+    telemetriaUART.tiempos.vueltas_bucle++;
 #ifdef ENABLE_LOWPWR
 	ocioso = true;
 #endif
@@ -171,29 +251,52 @@ void bucle_Principal(void)  {
     /***********************************************************************************************************************/
     if ( flag_lectura_datos )  {	  /* Lee los datos de todos los sensores */
 
+    	t_tarea = HAL_GetTick();
     	hilo1_Lectura();
+    	anota_TiempoTarea(&telemetriaUART, TAREA_LECTURA, HAL_GetTick() - t_tarea);
 
+    	if (config.telemetria_binaria) {	//un resumen de tiempos por muestra
+    		telemetria_Tiempos(&telemetriaUART, (uint8_t)pendientes_Tuberia(&tuberia));
+    	}
     }
 
-if (OPCION_IoT)			// En el caso de que la opción IoT este desactivada, no compilamos los hilos de publicación ni recuperacion
+    /*********************************************************************************************************************************/
+    /***********************   ENTREGA A LOS SUMIDEROS, UN REGISTRO POR SUMIDERO Y VUELTA ********************************************/
+    /*********************************************************************************************************************************/
+    servicio_Tuberia(&tuberia);
+
+#ifdef ENABLE_LOWPWR
+    if (pendientes_Tuberia(&tuberia) > 0) {  ocioso = false;  }	//no se duerme con registros pendientes
+#endif
+
+if (config.habilita_nube)	// En el caso de que la publicación este desactivada, no ejecutamos los hilos de publicación ni recuperacion
 {
 
+    /*********************************************************************************************************************************/
+    /***********************   ENVÍO OPORTUNISTA DE LA COLA MQTT, O DE LA FIFO POR EL ENLACE MQTT-SN *********************************/
+    /*********************************************************************************************************************************/
+    if (config.enlace_mqttsn) {
+    	envia_EnlaceSN();
+    } else {
+    	envia_ColaMQTT();
+    }
+
     /*********************************************************************************************************************************/
     /***********************   HILO DE EJECUCCIÓN DE PUBLICACION DE DATOS EN THINGSPEAK **********************************************/
     /*********************************************************************************************************************************/
-    if ( flag_publi_datos && (contador_lectura>0) && (g_publishData == true) )	/*Publica los datos de la media*/
+    if ( flag_publi_datos && (muestras_Ventana(&ventanas)>0) && (g_publishData == true) )	/*Publica los datos de la media*/
     {
+    	t_tarea = HAL_GetTick();
     	hilo2_Publicacion();
+    	anota_TiempoTarea(&telemetriaUART, TAREA_PUBLICACION, HAL_GetTick() - t_tarea);
     }
 
     /*********************************************************************************************************************************/
     /********************   HILO DE EJECUCCIÓN DE RECUPERACIÓN DE DATOS EN LA FIFO DE MEMORIA SRAM ***********************************/
     /*********************************************************************************************************************************/
-    if ( flag_recupera_datos && estaFIFOvacia(&miFIFO)  && (g_publishData == true) )
+    if ( flag_recupera_datos && estaFIFOvacia(&miFIFO)  && (g_publishData == true) && !config.enlace_mqttsn )	//con MQTT-SN la vacía envia_EnlaceSN()
     {
-    	if ( hilo3_Reconexion() ) {	//s ha recuperado la conexion a internet, sale del bucle principal para rehacerla
-    		return ;
-    	}
+    	hilo3_Reconexion();
 	}
 }
 
@@ -202,9 +305,31 @@ if (OPCION_IoT)			// En el caso de que la opción IoT este desactivada, no compi
     /*********************************************************************************************************************************/
      if( flag_lecturaMEMS  )
     {
+    	t_tarea = HAL_GetTick();
     	computa_algoritmoMEMS();
+    	anota_TiempoTarea(&telemetriaUART, TAREA_FUSION, HAL_GetTick() - t_tarea);
     }
 
+    /*********************************************************************************************************************************/
+    /********************   PUESTA EN MARCHA Y RECUPERACIÓN DE LA RED EN SEGUNDO PLANO, SOLO SIN LECTURAS PENDIENTES *****************/
+    /*********************************************************************************************************************************/
+     if ( !flag_lectura_datos && !flag_lecturaMEMS && !primera_Muestra )	//la asociación no retiene la primera muestra
+    {
+    	t_tarea = HAL_GetTick();
+    	servicio_RedSegundoPlano();
+    	anota_TiempoTarea(&telemetriaUART, TAREA_RED, HAL_GetTick() - t_tarea);
+    	servicio_Comandos();	//comandos remotos y sus respuestas, fuera de la recepción de Paho
+#ifdef RFU
+    	vigila_FirmwarePrueba();
+#endif
+    }
+
+    /*********************************************************************************************************************************/
+    /********************   INFORME DEL PERFILADOR DWT, A PETICIÓN O PERIODICO *******************************************************/
+    /*********************************************************************************************************************************/
+     servicio_Perfil();
+     servicio_Memoria();
+
 #ifdef ENABLE_LOWPWR
      if (ocioso)  {	//en caso de que no haya entrado a ninguno de los 3 hilos, suma 1 a la variable n_ocio
 
@@ -232,186 +357,1412 @@ if (OPCION_IoT)			// En el caso de que la opción IoT este desactivada, no compi
  * @param   void: no recibe parametros
  * @retval  no devuelve parametros
  */
-void hilo1_Lectura(void)
+void hilo1_Lectura(void)
+{
+
+#ifdef ENABLE_LOWPWR
+	if(modo_BajoConsumo) {  salir_LowPowerMode();  } //saliendo del modo de bajo consumo
+#endif
+
+	static uint16_t muestras_Estadisticas = 0;
+	static megaDato muestra;	//parte de la lectura anterior: un campo sin lectura valida (sin ticks del MEMS, fallo del
+								//HTS221/LPS22HB o sin GPS) mantiene su ultimo valor, nunca 0 en la SD ni en la ventana
+	registroCompacto registro;
+
+	recabar_Datos(&muestra);		// Función para obtener los datos de los sensores
+	compacta_Dato(&muestra, &registro);	// Lo que se guarda o se encola va en registro compacto
+	if ( muestra.ubicacion_fix && anota_PosicionRedes(&redesWiFi, muestra.latitud, muestra.longitud) ) {
+		adelanta_GestorRed(&red);	// Zona con red conocida recordada: se intenta ya, sin esperar al backoff
+	}
+
+	guarda_Muestra(&ventanas, &muestra, &registro);	// A la estadistica de la ventana en curso, en O(1)
+	acumula_VentanasLargas(&muestra);
+	difunde_Tuberia(&tuberia, &registro, DATO_MUESTRA);	// A la SD y al monitor UART, sin esperar
+
+	if (primera_Muestra) {
+		primera_Muestra = false;
+		msg_info("Primera muestra a los %lu ms del reset.\n", (unsigned long) HAL_GetTick());
+	}
+
+	if (++muestras_Estadisticas >= elementos_Ventana(&config)) {
+		muestras_Estadisticas = 0;
+		imprime_EstadisticasTuberia(&tuberia);
+		imprime_EstadisticasVentanas(&ventanas);
+		imprime_EstadisticasConsola();
+	}
+
+	flag_lectura_datos = false; //resetea flag
+}
+
+
+/**
+ * @brief   Añade la muestra a las ventanas largas (1 y 15 min). Al completar su duración en lecturas, cada una
+ * imprime media, desviación, minimo y maximo y vuelve a empezar. Su memoria no depende de la duración.
+ * @param   muestra: muestra leida
+ * @retval  void
+ */
+void acumula_VentanasLargas(const megaDato* muestra)
+{
+	for (uint8_t i = 0; i < N_VENTANAS_LARGAS; i++) {
+
+		acumula_Estadistica(&ventanasLargas[i], muestra);
+
+		if (ventanasLargas[i].n_muestras * config.periodo_lectura_s >= duracion_VentanasLargas[i]) {
+			imprime_Estadistica(nombre_VentanasLargas[i], &ventanasLargas[i]);
+			reinicia_Estadistica(&ventanasLargas[i]);
+		}
+	}
+}
+
+
+/**
+ * @brief   Rutina que implementa la tarea de publicación de la media de las muestras de datos.
+ * En primer lugar, cierra la ventana de muestras, obtiene su media y la deja en la tubería para el sumidero de la nube,
+ * que la publica o la guarda en la FIFO según haya conexión (ver entrega_Nube()). Ademas
+ * de eso, realiza la comprobación de la hora local para determinar si el dispositivo tiene que entrar en el
+ * modo de bajo consumo al estar de noche. Se trata de la 2ª rutina de ejecución del Bucle principal
+ * @param   void: no recibe parametros
+ * @retval  no devuelve parametros
+ */
+void hilo2_Publicacion(void)
+{
+
+#ifdef ENABLE_LOWPWR
+	if(modo_BajoConsumo) { salir_LowPowerMode();  } //saliendo del modo de bajo consumo
+#endif
+
+    	ventanaMuestras* ventana = NULL;
+    	registroCompacto mediaCompacta;
+
+    	flag_publi_datos = false;
+
+    	printf("\n$$$$$$$$$$$$$$$ THREAD DE PUBLICION DE DATOS EN THINGSPEAK $$$$$$$$$$$$$$$\n");
+
+    	ventana = cierra_Ventana(&ventanas);	//la lectura sigue en la otra ventana desde aqui
+    	if (ventana == NULL) {
+    		printf("Ventana anterior aun sin liberar, se pospone la publicacion y la lectura sigue en la misma.\n");
+    		return;
+    	}
+
+    	media_Estadistica(&ventana->estadistica, &mimegaDato);	//medias de toda la ventana, sin recorrer muestras
+
+    	/* La actitud media de la ventana sale del acumulador de cuaterniones, no de la media de los angulos de cada segundo */
+    	if ( media_Actitud(&actitud_ventana, &mimegaDato.alebeo, &mimegaDato.cabeceo, &mimegaDato.guino_brujula, &mimegaDato.dispersion_rumbo) == false ) {
+    		printf("Sin iteraciones del algoritmo MEMS en la ventana, se mantiene la actitud anterior.\n");
+    	}
+    	reinicia_Actitud(&actitud_ventana);
+
+		#ifdef PUBLI_DATOS_THINGSPEAK_CONCATENADOS
+    		calcula_concatenar(&mimegaDatoConcat, ventana->muestra, ventana->n_muestras);
+		#endif
+    	serieVentana.n_muestras = ventana->n_muestras;		//la ventana vuelve al gestor antes de que entrega_Nube() la publique
+    	serieVentana.n_leidas = ventana->estadistica.n_muestras;
+    	memcpy(serieVentana.muestra, ventana->muestra, ventana->n_muestras * sizeof(registroCompacto));
+
+    	printf("\nEl N%c de lecturas con la que se ha calculado la Media estadistica de la ventana %lu es: %d \n", SUPER_O,
+    		   (unsigned long)ventana->secuencia, (int)ventana->estadistica.n_muestras);
+    	libera_Ventana(&ventanas, ventana);	//media y concatenados ya calculados, vuelve al gestor
+
+#ifdef ENABLE_SLEEP
+      /*Antes de continuar, compurba si ya es de noche para seguir captando y enviando datos */
+      if( SUENYO == get_PeriodoDia(&Hora_Amanecer_Oficial, &Hora_Atardecer_Oficial) && estaFIFOvacia(&miFIFO)==0 )
+    	{
+      	printf("\n La hora actual indica que es de Noche, el dispositivo entrara en Sleep Mode...\n");
+      	entraSleepMode(Hora_Amanecer_Oficial);
+      	//una vez despierta, resetea el programa para reiniciar todo de nuevo
+         }else{
+
+#endif
+
+
+		  compacta_Dato(&mimegaDato, &mediaCompacta);
+		  serieVentana.epoch = mediaCompacta.epoch;
+		  difunde_Tuberia(&tuberia, &mediaCompacta, DATO_MEDIA);	//la publica entrega_Nube() en cuanto quepa en la cola MQTT
+
+#ifdef PUBLI_DATOS_THINGSPEAK_CONCATENADOS
+
+		  // Llamada a la función para PUBLICAR DATOS CONCATENADOS
+		  // Si esta conectado al wifi publicamos, sino, reseteamos directamente las muestras concatenadas
+
+		  if (estado == true && !config.enlace_mqttsn && (config.codec_nube == CODEC_THINGSPEAK)	//los otros codecs llevan la serie en la media
+			  && (huecos_LibresColaMQTT(&colaPublicacion) >= CANALES_POR_DATO) ){
+
+			  publica_DatosConcatThingSpeak(&mimegaDatoConcat);
+
+		  }else{
+
+			  memset(&mimegaDatoConcat, 0,sizeof(megaDatoConcat));	//Reseteo de las muestras concatenadas
+
+		  }
+
+#endif
+
+		  if (!config.enlace_mqttsn) {
+			  descarga_ColaMQTT(&colaPublicacion);	//los canales de la ventana salen juntos en la misma trama
+			  imprime_EstadisticasColaMQTT(&colaPublicacion);
+		  }
+}
+
+/**
+ * @brief   Rutina que implementa la recuperación de los datos guardados en la FIFO durante la falta de conexión.
+ * Con enlace, publica el dato más antiguo de la FIFO e indica el estado de conexión mediante el LED de conexión Wi-Fi.
+ * El dato sigue en la FIFO hasta que envia_ColaMQTT() lo da por entregado (con QoS 1, al llegar sus PUBACK) y hasta
+ * entonces no se publica el siguiente.
+ * Sin enlace no hace nada: la reconexión la lleva servicio_RedSegundoPlano() sin salir del bucle principal.
+ * Se trata de la 3ª rutina de ejecución del Bucle principal
+ * @param   void: no recibe parametros
+ * @retval  no devuelve parametros
+ */
+void hilo3_Reconexion(void)
+{
+
+#ifdef ENABLE_LOWPWR
+	if(modo_BajoConsumo) {  salir_LowPowerMode();  }  //saliendo del modo de bajo consumo
+#endif
+
+    	flag_recupera_datos = false;
+
+    	printf("\n$$$$$$$$$$$$$$$ THREAD DE RECUPERACION DE DATOS DE CONEXION $$$$$$$$$$$$$$$\n");
+    	if( estado==DESCONECTADO )  {	//la red se esta recuperando en segundo plano
+
+    		printf("Sin enlace con la nube, se pospone la recuperacion del dato de la FIFO\n");
+    	}
+
+    	else if ( fifo_EnCola ) {	//la anterior aun sin entregar: con QoS 1, a la espera de su PUBACK
+
+    		printf("Dato recuperado aun sin confirmar, se pospone el siguiente de la FIFO\n");
+    	}
+
+    	else if ( huecos_LibresColaMQTT(&colaPublicacion) < PAQUETES_POR_MEDIA ) {	//conectado pero con la cola aun llena
+
+    		printf("Cola MQTT ocupada, se pospone la recuperacion del dato de la FIFO\n");
+    	}
+
+    	else{	//si ya esta conectado, trata de publicar los datos de la FIFO
+
+			bool encolado = false;
+
+			colaPublicacion.etiqueta = ETIQUETA_FIFO;
+			encolado = publica_Media( obtenerDatoFIFO(&miFIFO) );
+			colaPublicacion.etiqueta = 0;
+
+			if( encolado == true)	//se elimina de la FIFO al entregarse, ver envia_ColaMQTT()
+			{
+				printf("Dato RECUPERADO encolado, se eliminara de la fifo al entregarse...\n");
+				descarga_ColaMQTT(&colaPublicacion);
+				fifo_EnCola = true;
+				estado = CONECTADO;
+				 HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_SET); //LED conexión Wi-Fi
+
+			}else {
+				estado = DESCONECTADO;
+				HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_RESET); //LED conexión Wi-Fi
+				}
+
+		}
+		printf("El numero de nodos en la FIFO es: %d \n", estaFIFOvacia(&miFIFO) );
+
+}
+
+
+/**
+ * @brief   Rutina de envío de la cola de publicaciones MQTT. Se invoca en cada vuelta del bucle principal: tras
+ * cada descarga agrupa los paquetes pendientes en una trama por transacción del modulo Wi-Fi, escribe en el socket
+ * no bloqueante lo que este acepte y reparte el keep-alive a lo largo de la ventana. Cada paquete completado pide el parpadeo del LED, que ejecuta el TIM6 sin HAL_Delay(). Un error de socket
+ * marca la conexion como caida; los paquetes pendientes se conservan y salen tras rehacer la conexion MQTT. Cuando
+ * no queda en la cola ningún paquete de la media recuperada de la FIFO, la elimina de ésta.
+ * @param   void
+ * @retval  void
+ */
+void envia_ColaMQTT(void)
+{
+	bool con_pendientes = (colaPublicacion.n_pendientes > 0);	//las vueltas sin nada que enviar no se perfilan
+	uint32_t inicio_envio = DWT->CYCCNT;
+	int resultado = servicio_ColaMQTT(&colaPublicacion, &client);
+
+	if (con_pendientes) {
+		registra_Sonda(SONDA_ENVIO_MQTT, DWT->CYCCNT - inicio_envio);
+	}
+
+	if (resultado > 0) {
+		parpadeos_LED = PARPADEOS_PUBLICACION * resultado;	// Notificación visual de publciación exitosa de mensajes
+	}
+	else if (resultado < 0) {
+		msg_error("\n\nEnvio de la cola MQTT fallido, %d paquetes a la espera de reconexion.\n",
+				  colaPublicacion.n_pendientes + colaPublicacion.n_en_vuelo);
+		g_connection_needed_score++;
+		estado = DESCONECTADO;
+		parpadeos_LED = 0;
+		HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_RESET); //LED conexión Wi-Fi
+	}
+
+	if ( fifo_EnCola && (huecos_EtiquetaColaMQTT(&colaPublicacion, ETIQUETA_FIFO) == 0) ) {	//con QoS 1, tras su PUBACK
+		printf("Dato RECUPERADO entregado, eliminandolo de la fifo...\n");
+		eliminarDatoFIFO(&miFIFO);
+		fifo_EnCola = false;
+	}
+
+#ifdef ENABLE_LOWPWR
+	if ( (colaPublicacion.n_pendientes > 0) || (colaPublicacion.n_en_vuelo > 0) ) {  ocioso = false;  }	//no se duerme con paquetes pendientes
+#endif
+}
+
+
+/**
+ * @brief   Rutina de envío por el enlace MQTT-SN, alternativa a envia_ColaMQTT() con config.enlace_mqttsn. Se invoca
+ * en cada vuelta del bucle principal: con enlace, da un paso de servicio_EnlaceSN() con la media a la cabeza de la
+ * FIFO, que solo se elimina cuando el enlace la da por entregada (el PUBACK con QoS 1, el envío con QoS -1). Así la
+ * FIFO es a la vez la cola de envío y la de recuperación, y un dato en vuelo sobrevive a la caída del enlace.
+ * @param   void
+ * @retval  void
+ */
+void envia_EnlaceSN(void)
+{
+	int resultado = 0;
+	bool con_pendientes = (estaFIFOvacia(&miFIFO) > 0);	//las vueltas sin nada que enviar no se perfilan
+	uint32_t inicio_envio = DWT->CYCCNT;
+
+	if (estado != CONECTADO) {
+		return;		//la red se esta recuperando en segundo plano
+	}
+
+	resultado = servicio_EnlaceSN(&enlaceMQTTSN, con_pendientes ? obtenerDatoFIFO(&miFIFO) : NULL);
+	if (con_pendientes) {
+		registra_Sonda(SONDA_ENVIO_MQTT, DWT->CYCCNT - inicio_envio);
+	}
+
+	if (resultado > 0) {
+		eliminarDatoFIFO(&miFIFO);
+		parpadeos_LED = PARPADEOS_PUBLICACION;	// Notificación visual de la entrega
+	}
+	else if (resultado < 0) {
+		msg_error("\n\nEnlace MQTT-SN caido, %d medias en la FIFO a la espera de reconexion.\n", estaFIFOvacia(&miFIFO));
+		g_connection_needed_score++;
+		estado = DESCONECTADO;
+		parpadeos_LED = 0;
+		HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_RESET); //LED conexión Wi-Fi
+	}
+
+#ifdef ENABLE_LOWPWR
+	if (enlaceMQTTSN.en_vuelo || enlaceMQTTSN.ping_pendiente || estaFIFOvacia(&miFIFO)) {  ocioso = false;  }	//no se duerme esperando respuesta
+#endif
+}
+
+
+/**
+ * @brief   Informe del perfilador DWT, a petición con la tecla 'p' en el terminal del USART1 y cada
+ * config.periodo_perfil_s si no es 0. Se imprime por la consola, se añade a PERFIL_FICHERO con la SD habilitada y, con
+ * config.publica_perfil y la sesión MQTT abierta, su resumen se encola como status del canal 4 de ThingSpeak. El
+ * informe periodico reinicia la tabla, de modo que cada uno cubre su periodo; el pedido a mano no la toca.
+ * @param   void
+ * @retval  void
+ */
+void servicio_Perfil(void)
+{
+	static char informe[PERFIL_TEXTO_SIZE];
+	static uint32_t t_informe = 0;
+	char resumen[PERFIL_RESUMEN_SIZE];
+	bool periodico = (config.periodo_perfil_s > 0) && (HAL_GetTick() - t_informe >= config.periodo_perfil_s * 1000U);
+	bool pedido = (consola_LeeCaracter() == 'p');
+
+	if (!periodico && !pedido) {
+		return;
+	}
+
+	informe_Perfil(informe, sizeof(informe));
+	printf("%s", informe);
+
+	if (config.habilita_sd && (escribir_fichero(PERFIL_FICHERO, informe) == false)) {
+		msg_warning("\nNo se ha podido guardar el perfil en %s.\n", PERFIL_FICHERO);
+	}
+
+	if (config.publica_perfil && (estado == CONECTADO) && !config.enlace_mqttsn && (config.codec_nube == CODEC_THINGSPEAK)
+		&& (huecos_LibresColaMQTT(&colaPublicacion) > 0)) {
+		resumen_Perfil(resumen, sizeof(resumen));
+		snprintf(mqtt_pubtopic, MQTT_TOPIC_BUFFER_SIZE, CANAL4_THINSPEAK_WR_APIKEY);
+		snprintf(mqtt_msg, MQTT_MSG_BUFFER_SIZE, "status=%s", resumen);
+		if (encola_PublicacionMQTT(&colaPublicacion, &client, mqtt_pubtopic, mqtt_msg) != MQSUCCESS) {
+			msg_warning("\nNo se ha podido encolar el resumen del perfil.\n");
+		}
+	}
+
+	if (periodico) {
+		t_informe = HAL_GetTick();
+		reinicia_Perfil();
+	}
+}
+
+
+/**
+ * @brief   Informe del monitor de memoria cada config.periodo_memoria_s si no es 0: heap, fragmentación de la lista libre,
+ * uso maximo de cada clase de reserva y pila pintada. Las reservas fallidas nuevas y la falta de holgura entre el heap y
+ * la pila se avisan como WARN. Con config.publica_memoria y la sesión MQTT abierta, su resumen se encola como status del
+ * canal 3 de ThingSpeak.
+ * @param   void
+ * @retval  void
+ */
+void servicio_Memoria(void)
+{
+	static uint32_t t_informe = 0;
+	char texto[640];
+
+	if ( (config.periodo_memoria_s == 0) || (HAL_GetTick() - t_informe < config.periodo_memoria_s * 1000U) ) {
+		return;
+	}
+	t_informe = HAL_GetTick();
+
+	mide_Memoria(&memoria);
+	informe_Memoria(&memoria, texto, sizeof(texto));
+	printf("%s", texto);
+	if (avisos_Memoria(&memoria)) {
+		resumen_Memoria(&memoria, texto, sizeof(texto));
+		msg_warning("\nMemoria al limite: %s\n", texto);
+	}
+
+	if (config.publica_memoria && (estado == CONECTADO) && !config.enlace_mqttsn && (config.codec_nube == CODEC_THINGSPEAK)
+		&& (huecos_LibresColaMQTT(&colaPublicacion) > 0)) {
+		resumen_Memoria(&memoria, texto, MEMORIA_RESUMEN_SIZE);
+		snprintf(mqtt_pubtopic, MQTT_TOPIC_BUFFER_SIZE, CANAL3_THINSPEAK_WR_APIKEY);
+		snprintf(mqtt_msg, MQTT_MSG_BUFFER_SIZE, "status=%s", texto);
+		if (encola_PublicacionMQTT(&colaPublicacion, &client, mqtt_pubtopic, mqtt_msg) != MQSUCCESS) {
+			msg_warning("\nNo se ha podido encolar el resumen de memoria.\n");
+		}
+	}
+}
+
+
+/**
+ * @brief   Canal de comandos remotos (ver Comandos_Remotos.h), desde el punto seguro del bucle principal: sin lecturas
+ * pendientes y tras el paso de la red. Encola la respuesta pendiente cuando hay sesión MQTT y hueco en la cola, da un
+ * paso del comando en curso (ráfaga, log, actualización o reinicio) y, si no hay ninguno, valida y ejecuta el
+ * siguiente del buzón. Las respuestas van a TOPIC_RESPUESTAS y empiezan por el sello del comando. Los mensajes sin una
+ * firma valida solo se cuentan y se avisan por consola: no se responden, para no ocupar la cola MQTT con mensajes ajenos.
+ * @param   void
+ * @retval  void
+ */
+void servicio_Comandos(void)
+{
+	comandoRemoto cmd;
+	resultadoComando resultado = COMANDO_NINGUNO;
+	uint64_t sello_anterior = 0;
+	uint32_t ahora = 0;
+
+	if (comandos.tam_clave == 0) {
+		return;		//canal deshabilitado
+	}
+#ifdef ENABLE_LOWPWR
+	if (ejecucion.activa || (longitud_Respuesta > 0) || (comandos.n_buzon > 0)) {  ocioso = false;  }
+#endif
+
+	if ( sumideros_Pendientes && (pendientes_Tuberia(&tuberia) == 0) ) {
+		conecta_Sumideros();	//inicia_Tuberia() descarta lo encolado: solo con las colas vacias
+		sumideros_Pendientes = false;
+	}
+
+	if (longitud_Respuesta > 0) {
+		envia_Respuesta();
+	}
+	if (ejecucion.activa) {
+		switch (ejecucion.verbo) {
+			case VERBO_RAFAGA:
+				paso_Rafaga();
+				break;
+			case VERBO_LOG:
+				paso_Log();
+				break;
+#ifdef RFU
+			case VERBO_ACTUALIZA:
+				paso_Actualizacion();
+				break;
+#endif
+			default:
+				paso_Salida();
+				break;
+		}
+		return;
+	}
+	if (longitud_Respuesta > 0) {
+		return;		//una respuesta cada vez, en orden
+	}
+
+	ahora = epoch_RTC();
+	if ( !sello_Sembrado && (ahora != 0) ) {
+		fija_SelloMinimo(&comandos, (uint64_t)ahora * 1000U);	//nada firmado antes de fijar la hora en este arranque
+		sello_Sembrado = true;
+	}
+	sello_anterior = comandos.ultimo_sello;
+	resultado = extrae_Comando(&comandos, ahora, &cmd);
+	if (comandos.ultimo_sello != sello_anterior) {
+		guarda_SelloComandos(comandos.ultimo_sello);
+	}
+	if (resultado == COMANDO_RECHAZADO) {
+		msg_warning("\nComando remoto rechazado: %s (%lu rechazados, %lu descartados).\n", cmd.motivo,
+					(unsigned long)comandos.estadistica.rechazados, (unsigned long)comandos.estadistica.descartados);
+		if (cmd.firmado) {
+			prepara_Respuesta(cmd.sello, "?", "rechazado %s", cmd.motivo);
+		}
+	}
+	else if (resultado == COMANDO_VALIDO) {
+		ejecuta_Comando(&cmd);
+	}
+}
+
+
+/* Manejador de Paho para TOPIC_COMANDOS. Lo llama MQTTYield() en mitad del sondeo del socket: solo copia al buzón */
+static void recibe_MensajeComando(MessageData* md)
+{
+	if ( !recibe_Comando(&comandos, md->message->payload, md->message->payloadlen) ) {
+		printf("Comando remoto descartado: buzon lleno o mayor que %d bytes.\n", COMANDO_TAM_MAX);
+	}
+}
+
+/* Suscripción QoS 0 a TOPIC_COMANDOS al abrir cada sesión (cleansession las borra). Con QoS 1 Paho respondería el
+ * PUBACK por su cuenta en mitad de una trama de la cola MQTT. Sin SUBACK la sesión sigue, sin comandos */
+static void suscribe_Comandos(void)
+{
+	if (comandos.tam_clave == 0) {
+		return;
+	}
+	snprintf(topic_Comandos, sizeof(topic_Comandos), TOPIC_COMANDOS, pub_data.mac);
+	if (MQTTSubscribe(&client, topic_Comandos, QOS0, recibe_MensajeComando) != MQSUCCESS) {
+		msg_warning("\nSin SUBACK de %s, la sesion sigue sin comandos remotos.\n", topic_Comandos);
+	}
+}
+
+/* Sello del último comando aceptado en los registros de backup (ver main.h): un comando capturado no vale tras el
+ * reinicio que provoca. Sin alimentación se pierde, y lo cubre la hora de la red al fijarla (ver servicio_Comandos) */
+static uint64_t lee_SelloComandos(void)
+{
+	return ((uint64_t)HAL_RTCEx_BKUPRead(&hrtc, BKP_SELLO_COMANDOS + 1) << 32) | HAL_RTCEx_BKUPRead(&hrtc, BKP_SELLO_COMANDOS);
+}
+
+static void guarda_SelloComandos(uint64_t sello)
+{
+	HAL_RTCEx_BKUPWrite(&hrtc, BKP_SELLO_COMANDOS, (uint32_t)sello);
+	HAL_RTCEx_BKUPWrite(&hrtc, BKP_SELLO_COMANDOS + 1, (uint32_t)(sello >> 32));
+}
+
+/* Hora del RTC en segundos UTC, o 0 si aun no se ha fijado desde la red y el sello de un comando no se puede comprobar */
+static uint32_t epoch_RTC(void)
+{
+	RTC_TimeTypeDef hora;
+	RTC_DateTypeDef fecha;
+
+	if ( !hora_Fijada || (HAL_RTC_GetTime(&hrtc, &hora, RTC_FORMAT_BIN) != HAL_OK)	//la fecha despues de la hora, como pide el RTC
+		 || (HAL_RTC_GetDate(&hrtc, &fecha, RTC_FORMAT_BIN) != HAL_OK) ) {
+		return 0;
+	}
+	return epoch_Fecha(2000 + fecha.Year, fecha.Month, fecha.Date, hora.Hours, hora.Minutes, hora.Seconds);
+}
+
+/* Deja en respuesta "<sello> <verbo> " seguido del texto con formato, a la espera de envia_Respuesta() */
+static void prepara_Respuesta(uint64_t sello, const char* verbo, const char* formato, ...)
+{
+	va_list argumentos;
+	int n = cabecera_Respuesta(respuesta, sizeof(respuesta), sello, verbo);
+
+	va_start(argumentos, formato);
+	n += vsnprintf(&respuesta[n], sizeof(respuesta) - n, formato, argumentos);
+	va_end(argumentos);
+	longitud_Respuesta = (n < (int)sizeof(respuesta)) ? (uint16_t)n : (uint16_t)(sizeof(respuesta) - 1);
+}
+
+/* Encola la respuesta en TOPIC_RESPUESTAS con la sesión MQTT abierta, sin quitar a la media de la siguiente ventana los
+ * huecos que necesita. Mientras tanto se queda en respuesta; true si ha salido */
+static bool envia_Respuesta(void)
+{
+	if ( (estado != CONECTADO) || config.enlace_mqttsn || (huecos_LibresColaMQTT(&colaPublicacion) <= PAQUETES_POR_MEDIA) ) {
+		return false;
+	}
+	snprintf(topic_Respuestas, sizeof(topic_Respuestas), TOPIC_RESPUESTAS, pub_data.mac);
+	if (encola_CargaMQTT(&colaPublicacion, &client, topic_Respuestas, (const uint8_t*)respuesta, longitud_Respuesta) != MQSUCCESS) {
+		return false;
+	}
+	descarga_ColaMQTT(&colaPublicacion);
+	longitud_Respuesta = 0;
+	return true;
+}
+
+/* Ejecuta un comando valido: los de un paso responden ya; ráfaga, log, actualización y reinicio quedan en ejecucion */
+static void ejecuta_Comando(const comandoRemoto* cmd)
+{
+	const char* verbo = VERBOS_COMANDO[cmd->verbo];
+	char avisos[192];		//todas las claves al_reiniciar, qos1 y sumideros: 187 caracteres y el nulo
+	unsigned long a = 0, b = 0;
+	bool correctos = (sscanf(cmd->argumentos, "%lu %lu", &a, &b) == 2);
+
+	msg_info("\nComando remoto: %s %s\n", verbo, cmd->argumentos);
+
+	switch (cmd->verbo) {
+		case VERBO_GET:
+			prepara_Respuesta(cmd->sello, verbo, "ok %s recibidos=%lu descartados=%lu rechazados=%lu aceptados=%lu", textoConfig,
+							  (unsigned long)comandos.estadistica.recibidos, (unsigned long)comandos.estadistica.descartados,
+							  (unsigned long)comandos.estadistica.rechazados, (unsigned long)comandos.estadistica.aceptados);
+			return;
+
+		case VERBO_SET: {
+			configSensor nueva = config_Siguiente;
+
+			if (parsea_Configuracion(&nueva, cmd->argumentos) <= 0) {
+				prepara_Respuesta(cmd->sello, verbo, "error sin claves validas");
+				return;
+			}
+			aplica_ConfiguracionRemota(&nueva, avisos, sizeof(avisos));
+			prepara_Respuesta(cmd->sello, verbo, "ok%s %s", avisos, textoConfig);
+			return;
+		}
+
+		case VERBO_GUARDA:
+			if (guarda_ConfiguracionSD(&config_Siguiente, &FatFs)) {
+				prepara_Respuesta(cmd->sello, verbo, "ok %s", CONFIG_FICHERO);
+			} else {
+				prepara_Respuesta(cmd->sello, verbo, "error sd");
+			}
+			return;
+
+		case VERBO_RAFAGA:
+			if ( !correctos || (a < 1) || (a > RAFAGA_MAX_MUESTRAS) || (b < RAFAGA_PERIODO_MIN_MS) || (b > RAFAGA_PERIODO_MAX_MS) ) {
+				prepara_Respuesta(cmd->sello, verbo, "error rafaga <1..%d muestras> <%d..%d ms>",
+								  RAFAGA_MAX_MUESTRAS, RAFAGA_PERIODO_MIN_MS, RAFAGA_PERIODO_MAX_MS);
+				return;
+			}
+			break;
+
+		case VERBO_LOG:
+			if ( !correctos || (a > b) ) {
+				prepara_Respuesta(cmd->sello, verbo, "error log <t0> <t1>, segundos UTC con t0 <= t1");
+				return;
+			}
+			break;
+
+		case VERBO_ACTUALIZA: {
+#ifdef RFU
+			/* "<url> <sha256>": el SHA-256 de la imagen llega firmado con el comando, y la autentica */
+			const char* hash = strchr(cmd->argumentos, ' ');
+			char url[COMANDO_TAM_MAX];
+			uint8_t sha256[RFU_SHA256_SIZE];
+			int ret = 0;
+
+			if ( (hash == NULL) || (strlen(hash + 1) != 2 * RFU_SHA256_SIZE)
+				 || (lee_Hexadecimal(hash + 1, 2 * RFU_SHA256_SIZE, sha256) != RFU_SHA256_SIZE) ) {
+				prepara_Respuesta(cmd->sello, verbo, "error actualiza <url> <sha256 en hexadecimal>");
+				return;
+			}
+			snprintf(url, sizeof(url), "%.*s", (int)(hash - cmd->argumentos), cmd->argumentos);
+			ret = rfu_start(url, sha256);
+			if (ret != RFU_OK) {
+				prepara_Respuesta(cmd->sello, verbo, "error rfu %d", ret);
+				return;
+			}
+			prepara_Respuesta(cmd->sello, verbo, "ok descargando %s", url);
+			break;
+#else
+			prepara_Respuesta(cmd->sello, verbo, "error firmware sin RFU");
+			return;
+#endif
+		}
+
+		default:	//VERBO_REINICIA
+			prepara_Respuesta(cmd->sello, verbo, "ok");
+			break;
+	}
+
+	memset(&ejecucion, 0, sizeof(ejecucion));
+	ejecucion.verbo = cmd->verbo;
+	ejecucion.sello = cmd->sello;
+	ejecucion.t_inicio = HAL_GetTick();
+	if (cmd->verbo == VERBO_RAFAGA) {
+		ejecucion.n_muestras = (uint16_t)a;
+		ejecucion.periodo_ms = (uint16_t)b;
+		ejecucion.epoch_inicio = epoch_RTC();
+		ejecucion.t_siguiente = ejecucion.t_inicio;
+	}
+	if (cmd->verbo == VERBO_LOG) {
+#ifdef ENABLE_SD_BINARIO
+		bool binario = true;
+#else
+		bool binario = false;
+#endif
+		ejecucion.error_sd = (inicia_ExtractorLog(&ejecucion.log, &FatFs, EXTENSION_SD, binario, (uint32_t)a, (uint32_t)b) < 0);
+	}
+	ejecucion.activa = true;
+}
+
+/* Aplica un set: config_Siguiente se queda con la configuración entera, para guarda, y la efectiva con lo que se puede
+ * cambiar en marcha. El TIM6, la red y el canal de comandos se preparan al arrancar: sus claves esperan al reinicio.
+ * Los periodos también: la ventana en curso y los contadores del LPTIM se cuentan con los de antes, y cambiarlos a
+ * mitad mezclaría lecturas de los dos periodos en una media y adelantaría o saltaría un disparo.
+ * Deja en texto lo que no se ha aplicado ya; devuelve sus caracteres */
+static int aplica_ConfiguracionRemota(const configSensor* nueva, char* texto, size_t tam)
+{
+	configSensor anterior = config;
+	bool sumideros = (nueva->habilita_sd != anterior.habilita_sd) || (nueva->imprime_muestras != anterior.imprime_muestras)
+					 || (nueva->telemetria_binaria != anterior.telemetria_binaria);
+	int n = 0;
+
+	config_Siguiente = *nueva;
+	__disable_irq();		//el LPTIM lee config en su interrupción
+	config = *nueva;
+	config.periodo_publi_s = anterior.periodo_publi_s;
+	config.periodo_lectura_s = anterior.periodo_lectura_s;
+	config.frec_fusion_hz = anterior.frec_fusion_hz;
+	config.habilita_nube = anterior.habilita_nube;
+	config.enlace_mqttsn = anterior.enlace_mqttsn;
+	config.confirma_mqttsn = anterior.confirma_mqttsn;
+	config.comandos_remotos = anterior.comandos_remotos;
+	__enable_irq();
+	imprime_Configuracion(&config, textoConfig, sizeof(textoConfig));
+
+	texto[0] = '\0';
+	if ( (nueva->periodo_publi_s != config.periodo_publi_s) || (nueva->periodo_lectura_s != config.periodo_lectura_s)
+		 || (nueva->frec_fusion_hz != config.frec_fusion_hz) || (nueva->habilita_nube != config.habilita_nube)
+		 || (nueva->enlace_mqttsn != config.enlace_mqttsn) || (nueva->confirma_mqttsn != config.confirma_mqttsn)
+		 || (nueva->comandos_remotos != config.comandos_remotos) ) {
+		n += snprintf(&texto[n], tam - n, " al_reiniciar:%s%s%s%s%s%s%s",
+					  (nueva->periodo_publi_s != config.periodo_publi_s) ? "periodo_publi_s," : "",
+					  (nueva->periodo_lectura_s != config.periodo_lectura_s) ? "periodo_lectura_s," : "",
+					  (nueva->frec_fusion_hz != config.frec_fusion_hz) ? "frec_fusion_hz," : "",
+					  (nueva->habilita_nube != config.habilita_nube) ? "habilita_nube," : "",
+					  (nueva->enlace_mqttsn != config.enlace_mqttsn) ? "enlace_mqttsn," : "",
+					  (nueva->confirma_mqttsn != config.confirma_mqttsn) ? "confirma_mqttsn," : "",
+					  (nueva->comandos_remotos != config.comandos_remotos) ? "comandos_remotos," : "");
+		texto[--n] = '\0';	//sin la ultima coma
+	}
+	if (nueva->qos1_mqtt != anterior.qos1_mqtt) {
+		n += snprintf(&texto[n], tam - n, " qos1_mqtt_en_la_siguiente_sesion");	//reanuda_ColaMQTT() al reconectar
+	}
+	if (sumideros) {
+		if (pendientes_Tuberia(&tuberia) == 0) {
+			conecta_Sumideros();
+		} else {
+			sumideros_Pendientes = true;
+			n += snprintf(&texto[n], tam - n, " sumideros_al_vaciar_la_tuberia");
+		}
+	}
+	return n;
+}
+
+/* Ráfaga: una medida de irradiancia cuando toca, con su instante real, y una parte de RAFAGA_LINEAS_PARTE muestras
+ * "dt_ms;g1;..;g5" en W/m2 cuando la respuesta anterior ha salido. Las medidas siguen aunque la cola MQTT esté llena */
+static void paso_Rafaga(void)
+{
+	float irradiancia[NMAX_MODULOS];
+	uint16_t hasta = 0;
+	int n = 0;
+
+	if ( (ejecucion.hechas < ejecucion.n_muestras) && ((int32_t)(HAL_GetTick() - ejecucion.t_siguiente) >= 0) ) {
+		uint32_t ahora = HAL_GetTick();
+
+		mideRadiacion(irradiancia);
+		ejecucion.dt_ms[ejecucion.hechas] = ahora - ejecucion.t_inicio;
+		for (uint8_t i = 0; i < NMAX_MODULOS; i++) {
+			float decimas = irradiancia[i] * 10.0f + 0.5f;
+			ejecucion.irradiancia[ejecucion.hechas][i] = (decimas >= 65535.0f) ? 65535U : (uint16_t)decimas;
+		}
+		ejecucion.hechas++;
+		ejecucion.t_siguiente += ejecucion.periodo_ms;
+		if ((int32_t)(ahora - ejecucion.t_siguiente) >= 0) {
+			ejecucion.t_siguiente = ahora + ejecucion.periodo_ms;	//retenida por otro paso del bucle: sin recuperar
+		}
+	}
+
+	hasta = ejecucion.enviadas + RAFAGA_LINEAS_PARTE;
+	if (hasta > ejecucion.n_muestras) {
+		hasta = ejecucion.n_muestras;
+	}
+	if ( (longitud_Respuesta > 0) || (ejecucion.hechas < hasta) ) {
+		return;
+	}
+
+	/* RAFAGA_LINEAS_PARTE lineas de como mucho 43 caracteres y la cabecera caben en RESPUESTA_SIZE */
+	n = cabecera_Respuesta(respuesta, sizeof(respuesta), ejecucion.sello, "rafaga");
+	n += snprintf(&respuesta[n], sizeof(respuesta) - n, "%u/%u t0=%lu periodo=%u\n", ejecucion.parte + 1,
+				  (ejecucion.n_muestras + RAFAGA_LINEAS_PARTE - 1) / RAFAGA_LINEAS_PARTE,
+				  (unsigned long)ejecucion.epoch_inicio, ejecucion.periodo_ms);
+	for (uint16_t k = ejecucion.enviadas; k < hasta; k++) {
+		n += snprintf(&respuesta[n], sizeof(respuesta) - n, "%lu", (unsigned long)ejecucion.dt_ms[k]);
+		for (uint8_t i = 0; i < NMAX_MODULOS; i++) {
+			n += snprintf(&respuesta[n], sizeof(respuesta) - n, ";%u.%u",
+						  ejecucion.irradiancia[k][i] / 10U, ejecucion.irradiancia[k][i] % 10U);	//sin %f en newlib-nano
+		}
+		n += snprintf(&respuesta[n], sizeof(respuesta) - n, "\n");
+	}
+	longitud_Respuesta = (uint16_t)n;
+	ejecucion.parte++;
+	ejecucion.enviadas = hasta;
+	ejecucion.activa = (ejecucion.enviadas < ejecucion.n_muestras);
+}
+
+/* Log: un paso del extractor por vuelta, acumulando registros en la parte en curso hasta que no cabe el siguiente o se
+ * acaba la franja. Al final, "fin" con las partes, los bytes, el último instante entregado (para pedir lo que falte
+ * con otro log si va truncado) y los pasos por la SD */
+static void paso_Log(void)
+{
+	extractorLog* ext = &ejecucion.log;
+	bool terminado = false;
+	int n = 0;
+
+	if (longitud_Respuesta > 0) {
+		return;		//la parte anterior aun no ha salido
+	}
+	if (ejecucion.ocupados == 0) {		//parte nueva: "<sello> log <parte>" y los registros tal cual estan en la SD
+		ejecucion.cabecera = (uint16_t)cabecera_Respuesta(respuesta, sizeof(respuesta), ejecucion.sello, "log");
+		ejecucion.cabecera += (uint16_t)snprintf(&respuesta[ejecucion.cabecera], sizeof(respuesta) - ejecucion.cabecera,
+												 "%u\n", ejecucion.parte + 1);
+		ejecucion.ocupados = ejecucion.cabecera;
+	}
+
+	if ( !ejecucion.error_sd && (ext->fase != LOG_INACTIVO) ) {
+		n = paso_ExtractorLog(ext, &FatFs, (uint8_t*)&respuesta[ejecucion.ocupados], sizeof(respuesta) - ejecucion.ocupados);
+		if (n > 0) {
+			ejecucion.ocupados += (uint16_t)n;
+		}
+		ejecucion.error_sd = (n == LOG_ERROR);
+	}
+	terminado = ejecucion.error_sd || (ext->fase == LOG_INACTIVO);
+
+	if ( (ejecucion.ocupados > ejecucion.cabecera) && (ext->lleno || terminado) ) {
+		longitud_Respuesta = ejecucion.ocupados;
+		ejecucion.parte++;
+		ejecucion.ocupados = 0;
+	}
+	else if (terminado) {
+		prepara_Respuesta(ejecucion.sello, "log", "fin partes=%u bytes=%lu ultimo=%lu pasos=%u%s%s", ejecucion.parte,
+						  (unsigned long)ext->enviados, (unsigned long)ext->ultimo_epoch, ext->pasos,
+						  ext->truncado ? " truncado" : "", ejecucion.error_sd ? " error sd" : "");
+		ejecucion.activa = false;
+	}
+}
+
+#ifdef RFU
+/* Actualización: un rango HTTP o un trozo de la verificación por vuelta (ver rfu_step()), con la sesión MQTT y las
+ * medidas en marcha. Con la imagen verificada en el otro banco, el cambio de banco espera a la cola como un reinicio */
+static void paso_Actualizacion(void)
+{
+	rfu_progress_t progreso;
+	int ret = 0;
+
+	if (ejecucion.descargada) {
+		paso_Salida();
+		return;
+	}
+	ret = rfu_step();
+	if (ret == RFU_IN_PROGRESS) {
+		return;
+	}
+	rfu_get_progress(&progreso);
+	if (ret != RFU_OK) {
+		rfu_stop();		//lo programado y su CRC se quedan en los registros de backup: otro actualiza reanuda
+		prepara_Respuesta(ejecucion.sello, VERBOS_COMANDO[VERBO_ACTUALIZA], "error rfu %d bytes=%lu/%lu", ret,
+						  (unsigned long)progreso.done, (unsigned long)progreso.size);
+		ejecucion.activa = false;
+		return;
+	}
+	prepara_Respuesta(ejecucion.sello, VERBOS_COMANDO[VERBO_ACTUALIZA], "ok verificada bytes=%lu reanudada_en=%lu "
+					  "rangos=%lu reconexiones=%lu descarga_ms=%lu verificacion_ms=%lu paso_max_ms=%lu",
+					  (unsigned long)progreso.size, (unsigned long)progreso.resumed_from, (unsigned long)progreso.ranges,
+					  (unsigned long)progreso.reconnections, (unsigned long)progreso.download_ms,
+					  (unsigned long)progreso.verify_ms, (unsigned long)progreso.longest_step_ms);
+	ejecucion.descargada = true;
+	ejecucion.t_inicio = HAL_GetTick();
+}
+
+/* Imagen nueva a prueba (ver rfu_boot_check() en main.c): se confirma con la primera sesión MQTT, o al arrancar si no
+ * hay nube. Si en RFU_PLAZO_PRUEBA_MS no lo consigue, vuelve al banco anterior */
+static void vigila_FirmwarePrueba(void)
+{
+	if (!rfu_on_trial()) {
+		return;
+	}
+	if (!config.habilita_nube || (estado == CONECTADO)) {
+		rfu_confirm();
+		msg_info("\nFirmware nuevo confirmado.\n");
+	}
+	else if (HAL_GetTick() > RFU_PLAZO_PRUEBA_MS) {
+		msg_error("\nEl firmware nuevo no ha abierto la sesion MQTT en %lu s. Volviendo al anterior...\n",
+				  (unsigned long)(RFU_PLAZO_PRUEBA_MS / 1000U));
+		rfu_rollback();
+	}
+}
+#endif
+
+/* Actualización o reinicio: espera a que salgan la respuesta y la cola MQTT, como mucho ESPERA_COLA_COMANDO_MS. La
+ * actualización ya tiene la imagen verificada en el otro banco: solo cambia de banco, que reinicia */
+static void paso_Salida(void)
+{
+	bool cola_vacia = (longitud_Respuesta == 0) && (colaPublicacion.n_pendientes == 0) && (colaPublicacion.n_en_vuelo == 0);
+
+	if ( !cola_vacia && (HAL_GetTick() - ejecucion.t_inicio < ESPERA_COLA_COMANDO_MS) ) {
+		return;
+	}
+
+	if (ejecucion.verbo == VERBO_REINICIA) {
+		msg_info("\nReinicio remoto. Llamando a HAL_NVIC_SystemReset()...\n");
+		HAL_Delay(1500);
+		HAL_NVIC_SystemReset();
+	}
+#ifdef RFU
+	else {
+		int ret = 0;
+
+		msg_info("\nActualizacion remota: arrancando el firmware del otro banco...\n");
+		ret = rfu_swap_banks();		//solo vuelve si no ha podido escribir los option bytes
+		msg_error("\nActualizacion remota fallida (%d), se sigue con el firmware actual.\n", ret);
+		prepara_Respuesta(ejecucion.sello, VERBOS_COMANDO[VERBO_ACTUALIZA], "error rfu %d", ret);
+	}
+#endif
+	ejecucion.activa = false;
+}
+
+
+/**
+ * @brief   Carga la configuración del sensor: parte de los #define de AppIoT_TFG_VIPV.h y aplica encima las claves
+ * válidas de config.json en la SD. Deja el tamaño de la ventana y la configuración efectiva en texto, que se
+ * imprime aquí y encabeza cada fichero de la SD. Es el primer acceso a la SD, por lo que espera a que la tarjeta
+ * lleve T_ARRANQUE_SD_MS alimentada.
+ * @param   void
+ * @retval  void
+ */
+void carga_Configuracion(void)
+{
+	config_PorDefecto(&config);
+
+	if (HAL_GetTick() < T_ARRANQUE_SD_MS) {
+		HAL_Delay(T_ARRANQUE_SD_MS - HAL_GetTick());	//Importante para la buena configuración de la SD
+	}
+	carga_ConfiguracionSD(&config, &FatFs);
+	config_Siguiente = config;
+
+	inicia_Ventanas(&ventanas);
+	inicia_Telemetria(&telemetriaUART);
+	for (uint8_t i = 0; i < N_VENTANAS_LARGAS; i++) {
+		reinicia_Estadistica(&ventanasLargas[i]);
+	}
+	imprime_Configuracion(&config, textoConfig, sizeof(textoConfig));
+	msg_info("Configuracion efectiva: %s\n", textoConfig);
+}
+
+
+/**
+ * @brief   Conecta a la tubería los sumideros habilitados: la SD recibe cada muestra, la nube la media de cada
+ * ventana y el monitor UART cada muestra si se imprimen o van en telemetria binaria. Cada uno tiene su propia cola, de modo que un fallo de la
+ * SD o de la red no retiene la lectura ni a los otros sumideros.
+ * @param   void
+ * @retval  void
+ */
+void conecta_Sumideros(void)
+{
+	inicia_Tuberia(&tuberia);
+
+	if (config.habilita_sd)
+		conecta_Sumidero(&tuberia, &sumideroSD, "SD", DATO_MUESTRA, entrega_SD, ESPERA_ERROR_SD_MS);
+	if (config.habilita_nube)
+		conecta_Sumidero(&tuberia, &sumideroNube, "NUBE", DATO_MEDIA, entrega_Nube, 0);
+	if (config.imprime_muestras || config.telemetria_binaria)
+		conecta_Sumidero(&tuberia, &sumideroUART, "UART", DATO_MUESTRA, entrega_UART, 0);
+}
+
+
+/**
+ * @brief   Sumidero de la SD: escribe la muestra en el fichero, montando la SD si hace falta. Tras un fallo
+ * la muestra se queda en su cola y la tubería no lo vuelve a intentar hasta pasados ESPERA_ERROR_SD_MS.
+ * Con ENABLE_SD_BINARIO el registro compacto se escribe tal cual, sin formatear.
+ * @param   registro: muestra a registrar
+ * @retval  SUMIDERO_HECHO o SUMIDERO_ERROR
+ */
+static resultadoSumidero entrega_SD(const registroCompacto* registro)
+{
+	megaDato dato;
+	bool escrito = false;
+
+	expande_Registro(registro, &dato);
+
+	if (!sd_Montada) {
+		sd_Montada = inicializa_SD(&dato);
+		if (!sd_Montada) {
+			return SUMIDERO_ERROR;
+		}
+	}
+
+#ifdef ENABLE_SD_BINARIO
+	escrito = escribir_datos(fichName, registro, sizeof(*registro));
+#else
+	escrito = obtencion_dato_SD(&dato);
+#endif
+
+	if ( escrito == false ) {
+		sd_Montada = false;		//se vuelve a montar en el siguiente intento
+		return SUMIDERO_ERROR;
+	}
+	return SUMIDERO_HECHO;
+}
+
+
+/**
+ * @brief   Sumidero de la nube: con enlace y la FIFO vacía encola la media en la cola MQTT; si la cola MQTT no
+ * tiene sitio la deja en la tubería para la siguiente vuelta. Sin enlace, o con medias anteriores aun por recuperar,
+ * la guarda en la FIFO, que vacía hilo3_Reconexion() al recuperar la conexión. Con config.enlace_mqttsn la media
+ * va siempre a la FIFO, de la que la saca envia_EnlaceSN() cuando la pasarela la confirma.
+ * @param   registro: media de la ventana de publicación
+ * @retval  SUMIDERO_HECHO, SUMIDERO_OCUPADO o SUMIDERO_ERROR si no cabe en la FIFO
+ */
+static resultadoSumidero entrega_Nube(const registroCompacto* registro)
+{
+	if ( (estado == CONECTADO) && !estaFIFOvacia(&miFIFO) && !config.enlace_mqttsn ) {
+
+		if ( huecos_LibresColaMQTT(&colaPublicacion) < PAQUETES_POR_MEDIA ) {
+			return SUMIDERO_OCUPADO;
+		}
+
+		if ( publica_Media(registro) == true ) {
+			HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_SET); //LED conexión Wi-Fi
+			descarga_ColaMQTT(&colaPublicacion);	//los canales de la ventana salen juntos en la misma trama
+			return SUMIDERO_HECHO;
+		}
+
+		estado = DESCONECTADO;
+		HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_RESET); //LED conexión Wi-Fi
+		printf("Fallo de conexion en publica_Media()\n");
+	}
+
+	if ( insertarFIFO(&miFIFO, *registro) == false ) {
+		return SUMIDERO_ERROR;		//sin heap: se queda en la tubería
+	}
+	printf("Dato INSERTADO en la FIFO, pendiente de conexion. El numero de nodos en la FIFO es: %d \n", estaFIFOvacia(&miFIFO) );
+	return SUMIDERO_HECHO;
+}
+
+
+/**
+ * @brief   Sumidero del monitor por UART: imprime la muestra leida, o la envía en una trama binaria de 47 bytes con
+ * config.telemetria_binaria. Si la consola no tiene sitio para la muestra entera, la deja en su cola hasta que el
+ * DMA vacíe el anillo, en vez de imprimirla a medias.
+ * @param   registro: muestra a imprimir
+ * @retval  SUMIDERO_HECHO o SUMIDERO_OCUPADO
+ */
+static resultadoSumidero entrega_UART(const registroCompacto* registro)
+{
+		megaDato dato;
+		const megaDato* miLectura = &dato;
+
+		if (config.telemetria_binaria) {
+			if (consola_Libre() < TELE_TRAMA_MAX) {
+				return SUMIDERO_OCUPADO;
+			}
+			return telemetria_Muestra(&telemetriaUART, registro) ? SUMIDERO_HECHO : SUMIDERO_OCUPADO;
+		}
+		if (consola_Libre() < HUECO_CONSOLA_MUESTRA) {
+			return SUMIDERO_OCUPADO;
+		}
+		expande_Registro(registro, &dato);
+
+		printf("\x1b[2J" "\x1b[f"); //limpiar buffer y ventana de TeraTerm
+
+	    printf("\n\t-------------- Datos Leidos por el uC STM32-L475-VGT6 ----------------\n"
+	    		"Irradiancia modulo FV 1:   %f\n"
+	    		"Irradiancia modulo FV 2:   %f\n"
+	    		"Irradiancia modulo FV 3:   %f\n"
+	    		"Irradiancia modulo FV 4:   %f\n"
+	    		"Irradiancia modulo FV 5:   %f\n"
+	    		"Temperatura interior del sensor:  %f\n"
+	    		"Presion interior del sensor:      %f\n"
+	    		"Humedad interior del sensor:      %f\n"
+	    		"Latitud geografica         :      %f\n"
+	    		"Longitud geografica        :      %f\n"
+	    		"Altitud geografica         :      %f\n"
+	    		"Velocidad desplazamiento   :      %f\n"
+	    		"Alabeo    X :                     %f\n"
+	    		"Cabeceo   Y :                     %f\n"
+	    		"Gui%cada   Z :                     %f\n"
+	    		"Dispersion del rumbo :            %f\n"
+	    		"Fecha y hora de la medicion:      %02d-%02d-%04d  %02d:%02d:%02d \n",
+				miLectura->irradiancia[0], miLectura->irradiancia[1], miLectura->irradiancia[2], miLectura->irradiancia[3], miLectura->irradiancia[4],
+				miLectura->temperatura, miLectura->presion,miLectura->humedad,
+				miLectura->latitud, miLectura->longitud, miLectura->altitud, miLectura->velocidad,
+				miLectura->alebeo, miLectura->cabeceo, 165, miLectura->guino_brujula, miLectura->dispersion_rumbo,
+				miLectura->dia , miLectura->mes,  miLectura->agno , miLectura->hora , miLectura->min, miLectura->seg
+	    		);
+
+	return SUMIDERO_HECHO;
+}
+
+
+/**
+ * @brief   Deja la red pendiente de levantar desde el principio, sin haber bloqueado el arranque. El jitter de las
+ * esperas parte del UID del micro, para que los sensores que pierden el mismo AP no reintenten a la vez. Con
+ * config.comandos_remotos prepara el canal de comandos con CLAVE_COMANDOS; la suscripción se hace en cada sesión.
+ * @param   void
+ * @retval  void
+ */
+void inicia_RedSegundoPlano(void)
+{
+	const wifi_network_t* tabla = NULL;
+	int n_redes = checkKnownWiFiNetworks(&tabla);
+	char id_cliente[ID_CLIENTE_SN_MAX + 1];
+
+	inicia_GestorRed(&red, &acciones_Red, config.habilita_nube, HAL_GetUIDw0() ^ HAL_GetUIDw1() ^ HAL_GetUIDw2());
+	inicia_RedesConocidas(&redesWiFi, tabla, n_redes);
+	net_if_select_network(red_Elegida(&redesWiFi));	//la primera de la tabla, antes del primer scan
+	hora_Fijada = false;
+	estado = DESCONECTADO;
+
+	snprintf(id_cliente, sizeof(id_cliente), "VIPV-%08lX", (unsigned long)(HAL_GetUIDw0() ^ HAL_GetUIDw1() ^ HAL_GetUIDw2()));
+	inicia_EnlaceSN(&enlaceMQTTSN, &transporte_SN, config.confirma_mqttsn, TOPIC_SN_MEDIA, id_cliente);
+
+	memset(&comandos, 0, sizeof(comandos));
+	if ( config.comandos_remotos && !inicia_Comandos(&comandos, CLAVE_COMANDOS) ) {
+		msg_warning("\nCLAVE_COMANDOS no es una clave de %d a %d bytes en hexadecimal: comandos remotos deshabilitados.\n",
+					COMANDO_CLAVE_MIN, COMANDO_CLAVE_MAX);
+	}
+	fija_SelloMinimo(&comandos, lee_SelloComandos());	//el último aceptado antes del reinicio, si no ha faltado la alimentación
+	sello_Sembrado = false;
+}
+
+
+/**
+ * @brief   Red en segundo plano con el gestor de Gestor_Conectividad.h. Cada llamada da como mucho un paso (scan,
+ * asociación al AP, comprobación de la IP, hora de la red, socket TLS o sesión MQTT), de modo que el bucle principal
+ * solo se retiene lo que dura ese paso con los timeouts cortos del modulo Wi-Fi. Tras un paso fallido espera con
+ * backoff exponencial y jitter. Con config.enlace_mqttsn el socket es UDP a la pasarela y la sesión la de MQTT-SN
+ * (ver red_AbreSocket() y red_ConectaMQTT()). Al abrir la sesión MQTT engancha la publicación en la nube (estado CONECTADO); si
+ * después se cae (marcado por envia_ColaMQTT() o los hilos de publicacion) la cierra y la rehace sin volver a
+ * asociarse mientras siga habiendo IP. Sin la nube habilitada la red solo se usa para fijar el RTC. Con la red arriba
+ * resincroniza el RTC por SNTP cada PERIODO_SNTP_MS.
+ * @param   void
+ * @retval  void
+ */
+void servicio_RedSegundoPlano(void)
 {
+	static char texto[RED_TEXTO_SIZE];
+	uint32_t t_inicio = HAL_GetTick();
+	faseRed fase_anterior = red.fase;
+
+	if ( ((red.fase == RED_ENLAZADA) || (red.fase == RED_REPOSO)) && (HAL_GetTick() - t_SNTP >= espera_SNTP) ) {
+		resincroniza_Hora();
+		return;		//un solo paso bloqueante por vuelta del bucle
+	}
+
+	if ( !servicio_GestorRed(&red) ) {
+		return;		//enlazada, en reposo o esperando al siguiente intento
+	}
 
 #ifdef ENABLE_LOWPWR
-	if(modo_BajoConsumo) {  salir_LowPowerMode();  } //saliendo del modo de bajo consumo
+	ocioso = false;
 #endif
 
-	recabar_Datos( &vectorLecturaDato[contador_lectura]  );		// Función para obtener los datos de los sensores
-
-	if (OPCION_IoT == 0)	// Entramos en el bucle cuando la opción IoT está desactivada
-		obtencion_dato_SD( &vectorLecturaDato[contador_lectura] );	// Función para escribir los datos en la tarjeta SD
+	if (fase_anterior == RED_ENLAZADA) {
+		msg_info("\nEnlace MQTT caido, se rehace en segundo plano desde %s.\n", NOMBRE_FASE_RED[red.fase]);
+		return;
+	}
 
-	flag_lectura_datos = false; //resetea flag
-	contador_lectura++;
-	contador_MEMS = 0; //reseteo contador MEMS al segundo
+	msg_info("Red en segundo plano: %s -> %s en %lu ms, siguiente paso en %lu ms, a los %lu ms del reset (%lu lecturas perdidas en total).\n",
+			 NOMBRE_FASE_RED[fase_anterior], NOMBRE_FASE_RED[red.fase], (unsigned long)(HAL_GetTick() - t_inicio),
+			 (unsigned long)((int32_t)(red.t_reintento - HAL_GetTick()) > 0 ? red.t_reintento - HAL_GetTick() : 0),
+			 (unsigned long) HAL_GetTick(), (unsigned long) lecturas_Perdidas);
 
-	if(contador_lectura >= (N_ELEMENTOS-1)){
-	   contador_lectura = (N_ELEMENTOS-1);	//va desde 0 a N-1
+	if ( (fase_anterior == RED_HORA) && (red.fase != RED_HORA) && !hora_Fijada ) {
+		msg_warning("\nNo se pudo fijar el RTC desde la red, se sigue con la hora actual.\n");
+	}
+	if ( (red.fase == RED_ENLAZADA) || (red.fase == RED_REPOSO) ) {
+		informe_GestorRed(&red, texto, sizeof(texto));
+		msg_info("%s", texto);
+		informe_RedesConocidas(&redesWiFi, texto, sizeof(texto));
+		msg_info("%s", texto);
+		net_dns_stats_t dns;
+		net_dns_get_stats(&dns);
+		msg_info("DNS: %lu en cache, %lu consultas, %lu ultima IP buena (%lu locales rechazadas), %lu fallos, %lu recuperadas\n",
+				dns.hits, dns.queries, dns.fallbacks, dns.rejected, dns.failures, dns.restored);
+		if (config.enlace_mqttsn) {
+			informe_EnlaceSN(&enlaceMQTTSN, texto, sizeof(texto));
+			msg_info("%s", texto);
+		}
 	}
 }
 
 
-/**
- * @brief   Rutina que implementa la tarea de publicación de la media de las muestras de datos.
- * En primer lugar, calcula la media del vector de datos, y tras compribar que no existen datos pendientes
- * en el buffer FIFO, realiza su publicación inmediata. En caso contrario, los almacena en la FIFO. Ademas
- * de eso, realiza la comprobación de la hora local para determinar si el dispositivo tiene que entrar en el
- * modo de bajo consumo al estar de noche. Se trata de la 2ª rutina de ejecución del Bucle principal
- * @param   void: no recibe parametros
- * @retval  no devuelve parametros
- */
-void hilo2_Publicacion(void)
-{
-
-#ifdef ENABLE_LOWPWR
-	if(modo_BajoConsumo) { salir_LowPowerMode();  } //saliendo del modo de bajo consumo
-#endif
-
-    	flag_publi_datos = false;
+/* Acciones del gestor de red: un solo intento cada una, con los timeouts cortos del modulo Wi-Fi */
 
-    	printf("\n$$$$$$$$$$$$$$$ THREAD DE PUBLICION DE DATOS EN THINGSPEAK $$$$$$$$$$$$$$$\n");
-    	calcula_mediaVector(&mimegaDato, vectorLecturaDato, contador_lectura);
+static bool red_LocalizaAP(cacheAP* ap)
+{
+	if ( !localiza_RedConocida(&redesWiFi, ap) ) {
+		msg_info("\nNinguna red WiFi conocida a la vista.\n");
+		return false;
+	}
+	net_if_select_network(red_Elegida(&redesWiFi));
+	if (ap->sin_scan) {
+		msg_info("\nRed WiFi recordada en esta zona: %s, sin scan.\n", red_Elegida(&redesWiFi)->ssid);
+	}
+	else {
+		msg_info("\nRed WiFi conocida con mas senal: %s, canal %u, %d dBm.\n", red_Elegida(&redesWiFi)->ssid, ap->canal, ap->rssi);
+	}
+	return true;
+}
 
-		#ifdef PUBLI_DATOS_THINGSPEAK_CONCATENADOS
-    		calcula_concatenar(&mimegaDatoConcat, vectorLecturaDato, contador_lectura);
-		#endif
 
-    	printf("\nEl N%c de lecturas con la que se ha calculado la Media estadistica para el dato es: %d \n", SUPER_O, contador_lectura+1);
-    	contador_lectura = 0; //reseteo del contadores
+static bool red_Asocia(bool rapido)
+{
+	bool exito;
 
-#ifdef ENABLE_SLEEP
-      /*Antes de continuar, compurba si ya es de noche para seguir captando y enviando datos */
-      if( SUENYO == get_PeriodoDia(&Hora_Amanecer_Oficial, &Hora_Atardecer_Oficial) && estaFIFOvacia(&miFIFO)==0 )
-    	{
-      	printf("\n La hora actual indica que es de Noche, el dispositivo entrara en Sleep Mode...\n");
-      	entraSleepMode(Hora_Amanecer_Oficial);
-      	//una vez despierta, resetea el programa para reiniciar todo de nuevo
-         }else{
+	if (hnet == NULL) {		//primera vez: un solo intento de asociación, no los 17 de net_if_init()
+		exito = (net_init(&hnet, NET_IF, (net_if_reinit)) == NET_OK);
+	}
+	else if (rapido) {		//modulo vivo y configurado: solo se repite la asociación
+		exito = (net_reinit(hnet, (net_if_rejoin)) == NET_OK);
+	}
+	else {
+		exito = reconecta_WiFi();
+	}
 
-#endif
+	if (exito) {
+		net_macaddr_t mac = { 0 };
+		if (net_get_mac_address(hnet, &mac) == NET_OK) {
+			snprintf(pub_data.mac, MODEL_MAC_SIZE , "%02X%02X%02X%02X%02X%02X",
+					 mac.mac[0], mac.mac[1], mac.mac[2], mac.mac[3], mac.mac[4], mac.mac[5]);
+		}
+		HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_SET);	//LED de conexión Wi-Fi
+		recuerda_RedZona(&redesWiFi);
+	}
+	return exito;
+}
 
 
-		  if( !estaFIFOvacia(&miFIFO) ){	//solo trata de publicar si la lista esta vacía
+static bool red_TieneIP(void)
+{
+	net_ipaddr_t ip;
 
-			  if( publica_DatosThingSpeak(&mimegaDato) == false)
-			  {
-				 insertarFIFO(&miFIFO, mimegaDato);
-				 estado = DESCONECTADO;
-				 HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_RESET); //LED conexión Wi-Fi
-				 printf("Dato INSERTADO en la FIFO por fallo de conexion en publica_DatosThingSpeak()\n");
-				 printf("El numero de nodos en la FIFO es: %d \n", estaFIFOvacia(&miFIFO) );
+	if ( (hnet == NULL) || (net_get_ip_address(hnet, &ip) != NET_OK) ) {
+		return false;
+	}
+	return (ip.ip[12] | ip.ip[13] | ip.ip[14] | ip.ip[15]) != 0;	//0.0.0.0 mientras el DHCP no responde
+}
 
-			  }else {
 
-				  estado = CONECTADO;
-				  HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_SET); //LED conexión Wi-Fi
+static bool red_FijaHora(void)
+{
+	hora_Fijada = (SNTP_SyncRTC(NULL, NULL) == SNTP_OK);	//UDP: sin TLS que dependa de la hora que se quiere fijar
+	if (!hora_Fijada) {
+#ifdef CLOUD_TIMEDATE_TLS_VERIFICATION_IGNORE
+		hora_Fijada = (setRTCTimeDateFromNetwork(true) == TD_OK);
+#else
+		hora_Fijada = (setRTCTimeDateFromNetwork(false) == TD_OK) || (setRTCTimeDateFromNetwork(true) == TD_OK);
+#endif
+	}
+	t_SNTP = HAL_GetTick();
+	espera_SNTP = (hora_Fijada) ? PERIODO_SNTP_MS : REINTENTO_SNTP_MS;
+	return hora_Fijada;
+}
 
-			  }
 
-		  }else{	//si la lista tiene elementos
+/**
+ * @brief   Resincronización periódica del RTC por SNTP con la red arriba, para acotar la deriva del cristal del RTC;
+ * también fija la hora si no se pudo al enlazar. Tras un fallo se reintenta a los REINTENTO_SNTP_MS; tras un
+ * Kiss-o'-Death del servidor se espera el periodo completo.
+ * @param   void
+ * @retval  void
+ */
+static void resincroniza_Hora(void)
+{
+	int rc = SNTP_SyncRTC(NULL, NULL);
 
-			 insertarFIFO(&miFIFO, mimegaDato);
-			 printf("Dato INSERTADO en la FIFO por encontrarse la FIFO pendiente de envio\n");
-			 printf("El numero de nodos en la FIFO es: %d \n", estaFIFOvacia(&miFIFO) );
+	hora_Fijada |= (rc == SNTP_OK);
+	t_SNTP = HAL_GetTick();
+	espera_SNTP = ((rc == SNTP_OK) || (rc == SNTP_ERR_KOD)) ? PERIODO_SNTP_MS : REINTENTO_SNTP_MS;
+	if (rc != SNTP_OK) {
+		msg_warning("Resincronizacion SNTP fallida (%d), se reintenta en %lu s.\n", rc, (unsigned long)(espera_SNTP / 1000U));
+	}
+}
 
-		  }
 
-#ifdef PUBLI_DATOS_THINGSPEAK_CONCATENADOS
+static bool red_AbreSocket(void)
+{
+	if (config.enlace_mqttsn) {
+		return abre_SocketSN();
+	}
+	if (check_protocoloConexion() != NET_OK) {
+		msg_error("\nNo se pudo abrir un socket en la direccion %s  con puerto %d.\n", device_config->HostName, atoi(device_config->HostPort));
+		g_connection_needed_score++;
+		return false;
+	}
+	return true;
+}
 
-		  // Llamada a la función para PUBLICAR DATOS CONCATENADOS
-		  // Si esta conectado al wifi publicamos, sino, reseteamos directamente las muestras concatenadas
 
-		  if (estado == true){
+static bool red_ConectaMQTT(void)
+{
+	bool exito = (config.enlace_mqttsn) ? conecta_EnlaceSN(&enlaceMQTTSN) : inicia_ClienteMQTT(NET_OK);
 
-			  publica_DatosConcatThingSpeak(&mimegaDatoConcat);
+	if (!exito) {
+		if (config.enlace_mqttsn) {
+			msg_error("\nSin CONNACK de la pasarela MQTT-SN %s:%d.\n", PASARELA_SN_HOST, PASARELA_SN_PUERTO);
+		}
+		return false;
+	}
+	if (!config.enlace_mqttsn) {
+		suscribe_Comandos();	//antes de que la cola vuelva a escribir en el socket
+		reanuda_ColaMQTT(&colaPublicacion, config.qos1_mqtt);	//con QoS 1, los que no tenían PUBACK salen de nuevo con DUP
+	}
+	estado = CONECTADO;
+	HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_SET);	//LED de conexión Wi-Fi
+	return true;
+}
 
-		  }else{
 
-			  memset(&mimegaDatoConcat, 0,sizeof(megaDatoConcat));	//Reseteo de las muestras concatenadas
+static bool red_Enlazada(void)
+{
+	return (estado == CONECTADO);
+}
 
-		  }
 
-#endif
+static void red_Cierra(void)
+{
+	if (config.enlace_mqttsn) {
+		cierra_EnlaceSN(&enlaceMQTTSN);
+		if (socket_SN != NULL) {
+			net_sock_close(socket_SN);
+			net_sock_destroy(socket_SN);
+			socket_SN = NULL;
+		}
+	}
+	else {
+		desconectaConexionMQTT();
+	}
+	estado = DESCONECTADO;
 }
 
+
 /**
- * @brief   Rutina que implementa la reconexión al hotspot tras una publciación fallida de los datos.
- * Realiza las pertinentes comprobaciones de conexión, intentos de reconexión e indicaciones exteriores
- * del estado de conexión mediante el LED de conexión Wi-Fi. Si la reconexión ha surtido efecto, devuelve un
- * valor verdadero para que se salga del bucle pirincipal para rehacer la conexión MQTT. En caso contratio, devuelve
- * un valor falso. En caso de que haya que recuperar datos desde la FIFO, los publica a una frecuencia mayor. disparada
- * por el Timer 6. Se trata de la 3ª rutina de ejecución del Bucle principal
- * @param   void: no recibe parametros
- * @retval  estado tras el intento de reconexión
+ * @brief   Socket UDP hacia la pasarela MQTT-SN, con la lectura limitada a 1 ms para no retener el bucle. La dirección se resuelve una vez aquí, con la caché
+ * de DNS, y los datagramas salen con net_sock_sendto(): el modulo Wi-Fi no resuelve el nombre al abrir un socket UDP.
+ * @param   void
+ * @retval  true si el socket queda abierto
  */
-bool hilo3_Reconexion(void)
+static bool abre_SocketSN(void)
 {
+	if ( (net_get_hostaddress(hnet, &ip_PasarelaSN, PASARELA_SN_HOST) != NET_OK)
+		 || (net_sock_create(hnet, &socket_SN, NET_PROTO_UDP) != NET_OK) ) {
+		msg_error("\nNo se pudo alcanzar la pasarela MQTT-SN %s.\n", PASARELA_SN_HOST);
+		g_connection_needed_score++;
+		return false;
+	}
+	if ( (net_sock_setopt(socket_SN, "sock_read_timeout", (uint8_t*)"1", sizeof("1")) != NET_OK)	//envío bloqueante, lectura sin esperar
+		 || (net_sock_open(socket_SN, PASARELA_SN_HOST, PASARELA_SN_PUERTO, 0) != NET_OK) ) {
+		msg_error("\nNo se pudo abrir el socket UDP con la pasarela MQTT-SN %s:%d.\n", PASARELA_SN_HOST, PASARELA_SN_PUERTO);
+		net_sock_destroy(socket_SN);
+		socket_SN = NULL;
+		g_connection_needed_score++;
+		return false;
+	}
+	return true;
+}
 
-#ifdef ENABLE_LOWPWR
-	if(modo_BajoConsumo) {  salir_LowPowerMode();  }  //saliendo del modo de bajo consumo
-#endif
-
-    	flag_recupera_datos = false;
-
-    	printf("\n$$$$$$$$$$$$$$$ THREAD DE RECUPERACION DE DATOS DE CONEXION $$$$$$$$$$$$$$$\n");
-    	if( estado==DESCONECTADO )  {	//si se encuentra desconectado, trata de reconectar
 
-    		estado = reconecta_WiFi() ;
+/* Transporte del enlace MQTT-SN sobre el socket UDP de la pasarela */
+static int envia_UDP_SN(const uint8_t* trama, uint16_t tam)
+{
+	if (socket_SN == NULL) {
+		return -1;
+	}
+	return net_sock_sendto(socket_SN, trama, tam, &ip_PasarelaSN, PASARELA_SN_PUERTO);
+}
 
-    		if( estado==CONECTADO )
-    		{
-    			 HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_SET); //LED conexión Wi-Fi
-    			return true;  //sale del bucle principal a rehacer la conexion MQTT
-    		}
+static int recibe_UDP_SN(uint8_t* trama, uint16_t tam)
+{
+	net_ipaddr_t origen;
+	int puerto = 0;
+	int leidos = 0;
 
-    		HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_RESET); //LED conexión Wi-Fi
-    	}
+	if (socket_SN == NULL) {
+		return -1;
+	}
+	leidos = net_sock_recvfrom(socket_SN, trama, tam, &origen, &puerto);
+	if (leidos == NET_TIMEOUT) {
+		return 0;	//nada pendiente en el socket
+	}
+	if ( (leidos > 0) && (memcmp(&origen.ip[12], &ip_PasarelaSN.ip[12], 4) != 0) ) {
+		return 0;	//datagrama ajeno a la pasarela
+	}
+	return leidos;
+}
 
-    	else{	//si ya esta conectado, trata de publicar los datos de la FIFO
 
-			if( publica_DatosThingSpeak( obtenerDatoFIFO(&miFIFO) ) == true)	//si lo publica, lo elimina
-			{
-				printf("Dato PUBLICADO RECUPERADO con exito, eliminandolo de la fifo...\n");
-				eliminarDatoFIFO(&miFIFO);
-				estado = CONECTADO;
-				 HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_SET); //LED conexión Wi-Fi
+/**
+ * @brief   Encola la media de una ventana con el codec de config.codec_nube: en los canales 1 y 2 de ThingSpeak
+ * (publica_DatosThingSpeak()) o en un solo mensaje JSON o CBOR al topic config.topic_nube (Codec_Ventana.h). La serie
+ * solo acompaña a la media de la última ventana cerrada; las medias recuperadas de la FIFO van solas. La serie tiene
+ * como mucho N_MAX_SERIE muestras (Ventanas_Muestras.h): en ventanas más largas llega diezmada y el codec lo marca con
+ * las lecturas reales ("n"). El llamante
+ * comprueba antes que caben PAQUETES_POR_MEDIA paquetes.
+ * @param   In:   registro    media de la ventana
+ * @retval  Verdadero si ha quedado encolada, falso en caso de error
+ */
+bool publica_Media(const registroCompacto* registro)  {
+
+	static uint8_t carga[COLA_MQTT_PAQUETE_SIZE];		//mqtt_msg se queda corto para una ventana entera
+	const registroCompacto* serie = NULL;
+	uint16_t n_serie = 0;
+	uint32_t n_leidas = 0;
+	uint8_t paso = 0;
+	int longitud = -1;
+	int cabecera = 0;
+
+	if (config.codec_nube == CODEC_THINGSPEAK) {
+		return publica_DatosThingSpeak(registro);
+	}
+	if (registro == NULL) {
+		return false;
+	}
+	ABRE_SONDA(SONDA_PUBLICACION);
 
-			}else {
-				estado = DESCONECTADO;
-				HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_RESET); //LED conexión Wi-Fi
-				}
+	if ( (serieVentana.n_muestras > 0) && (serieVentana.epoch == registro->epoch) ) {
+		serie = serieVentana.muestra;
+		n_serie = serieVentana.n_muestras;
+		n_leidas = serieVentana.n_leidas;
+	}
 
-		}
-		printf("El numero de nodos en la FIFO es: %d \n", estaFIFOvacia(&miFIFO) );
+	snprintf(mqtt_pubtopic, MQTT_TOPIC_BUFFER_SIZE, config.topic_nube, pub_data.mac);	//%s validado al cargar la configuración
+	cabecera = 1 + 2 + 2 + (int)strlen(mqtt_pubtopic);		//tipo, longitud restante (< 16 KB), longitud del topic y topic
+	longitud = codifica_Ventana((tipoCodec)config.codec_nube, registro, serie, n_serie, n_leidas, pub_data.mac,
+								carga, sizeof(carga) - cabecera, &paso);
 
-		return false; //no sale del bucle principal
+	if ( (longitud < 0) || (encola_CargaMQTT(&colaPublicacion, &client, mqtt_pubtopic, carga, (uint16_t)longitud) != MQSUCCESS) ) {
+		printf("\nErrores al publicar la ventana, se agregara el dato a la FIFO...\n");
+		CIERRA_SONDA(SONDA_PUBLICACION);
+		return false;
+	}
 
+	printf("\n##### Ventana ENCOLADA en %s: %s de %d bytes, %u muestras de la serie de %lu lecturas (paso %u) #####\n\n",
+		   mqtt_pubtopic, CODECS_VENTANA[config.codec_nube].nombre, longitud,
+		   (paso > 0) ? (unsigned)((n_serie + paso - 1) / paso) : 0U, (unsigned long)n_leidas, paso);
+	CIERRA_SONDA(SONDA_PUBLICACION);
+	return true;
 }
 
 
 /**
- * @brief   Funcion para realizar el envío de datos a través de el módulo establecido, el socket,
- * y la configuración IoT de servidor y canales preestablecidos. Lleva a cabo las oportunas comprobaciones
- * de errores, informando al usuario.
- * @param   In:   miDato    estructura del dato a publicar con todas sus magnitudes
- * @retval  Verdadero si exito en la publicación, falso en caso de error
+ * @brief   Funcion para preparar el envío de datos a través de el módulo establecido, el socket,
+ * y la configuración IoT de servidor y canales preestablecidos. Los mensajes de ambos canales se serializan
+ * en la cola MQTT y los envía envia_ColaMQTT() desde el bucle principal, sin bloquear. El llamante comprueba
+ * antes que caben CANALES_POR_DATO paquetes. Lleva a cabo las oportunas comprobaciones de errores, informando al usuario.
+ * @param   In:   registro    registro compacto del dato a publicar con todas sus magnitudes
+ * @retval  Verdadero si se han encolado ambos canales, falso en caso de error
  */
-bool publica_DatosThingSpeak(megaDato* miDato)  {
+bool publica_DatosThingSpeak(const registroCompacto* registro)  {
 
 	int resultado = -1;
 	bool retorno = true;	//suponemos que no hay problemas a priori
     char* payload = "";
+    megaDato dato;
+    megaDato* miDato = &dato;
 
-    if( miDato == NULL) {
+    if( registro == NULL) {
     	return false;
     }
+    ABRE_SONDA(SONDA_PUBLICACION);		//formato y encolado de los 2 canales, el envío lo mide SONDA_ENVIO_MQTT
+    expande_Registro(registro, &dato);	//fecha de una sola conversion del epoch
 
-#ifdef ENABLE_IMPRIMIR_MUESTRAS
-    imprimir_Dato(*miDato);
-#endif
+    if (config.imprime_muestras && !config.telemetria_binaria) {
+    	imprimir_Dato(*miDato);
+    }
 
 
     for(int n_canal = 1; n_canal<=2 ; n_canal++)   {	//Bucle de publicacion en los 2 canales
@@ -448,19 +1799,19 @@ bool publica_DatosThingSpeak(megaDato* miDato)  {
 
     		    if( miDato->ubicacion_fix )	//en funcion de si tiene o no la ubicacion disponible, publicara una cosa u otra
     		    {
-    		    	payload =   "field1=%f&field2=%f&field3=%f&field4=%f&field5=%f&field6=%f&field7=%f&lat=%f&long=%f&elevation=%f&created_at=%04d-%02d-%02dT%02d:%02d:%02dZ"	;
+    		    	payload =   "field1=%f&field2=%f&field3=%f&field4=%f&field5=%f&field6=%f&field7=%f&field8=%f&lat=%f&long=%f&elevation=%f&created_at=%04d-%02d-%02dT%02d:%02d:%02dZ"	;
     		    	//en formato RTC ISO 8601: &created_at=2011-07-18T01:02:03Z  Se consigue con el especificador de printf ( %02d : 2 cifras a rellenar con ceros)
     		    	resultado=  snprintf( mqtt_msg, MQTT_MSG_BUFFER_SIZE,  payload ,
     		        			miDato->latitud, miDato->longitud, miDato->altitud, miDato->velocidad,
-    							miDato->alebeo, miDato->cabeceo,  miDato->guino_brujula,
+    							miDato->alebeo, miDato->cabeceo,  miDato->guino_brujula, miDato->dispersion_rumbo,
     							miDato->latitud, miDato->longitud, miDato->altitud,
     							miDato->agno,  miDato->mes, miDato->dia ,  miDato->hora, miDato->min, miDato->seg  );
     		    }else
     		    {
-    		    	payload =   "field5=%f&field6=%f&field7=%f&created_at=%04d-%02d-%02dT%02d:%02d:%02dZ"	;
+    		    	payload =   "field5=%f&field6=%f&field7=%f&field8=%f&created_at=%04d-%02d-%02dT%02d:%02d:%02dZ"	;
     		    	//en formato RTC ISO 8601: &created_at=2011-07-18T01:02:03Z  Se consigue con el especificador de printf ( %02d : 2 cifras a rellenar con ceros)
     		    	resultado=  snprintf( mqtt_msg, MQTT_MSG_BUFFER_SIZE,  payload ,
-    		    				miDato->alebeo, miDato->cabeceo,  miDato->guino_brujula,
+    		    				miDato->alebeo, miDato->cabeceo,  miDato->guino_brujula, miDato->dispersion_rumbo,
     							miDato->agno,  miDato->mes, miDato->dia ,  miDato->hora, miDato->min, miDato->seg  );
     		    }
     	break;
@@ -476,31 +1827,11 @@ bool publica_DatosThingSpeak(megaDato* miDato)  {
         }
         else
         {
-          resultado = stiot_publish(&client, mqtt_pubtopic, mqtt_msg);  /* Wrapper for MQTTPublish() */
-
-          if (resultado == MQSUCCESS)
-          {
-        	// HAL_ResumeTick();	//Habilita ticks
-            // Notificación visual de publciación exitosa de mensajes:LED blink. */
-        	  for (uint8_t i=0 ;i<10; i++) {
-        		  HAL_GPIO_TogglePin(GPIOC, ARD_A1_LEDWIFI_Pin);
-        		  HAL_Delay(15);
-        	  }
-        	  //printf("Tamaño del payload 1: %d\n", strlen(*payload));
-        	  //msg_info("#Publicado en el Tema MQTT: %s \n ->Payload del mensaje enviado: %s\n", mqtt_pubtopic, mqtt_msg);
-        	  // HAL_SuspendTick();
-          }
-          else
-          {
-            msg_error("\n\nPublicacion Telemetrica fallida. Mensaje error: \n");
-            g_connection_needed_score++;
-            retorno &= false;
-          }
+          resultado = encola_PublicacionMQTT(&colaPublicacion, &client, mqtt_pubtopic, mqtt_msg);  /* El envío y la notificación visual los hace envia_ColaMQTT() */
 
-          resultado = MQTTYield(&client, 500);
           if (resultado != MQSUCCESS)
           {
-            msg_error("\n\nYield fallido. Mensaje error:\n");
+            msg_error("\n\nPublicacion Telemetrica fallida. Mensaje error: \n");
             g_connection_needed_score++;
             retorno &= false;
           }
@@ -508,9 +1839,10 @@ bool publica_DatosThingSpeak(megaDato* miDato)  {
 
     }	//fin for(canales)
 
-    if (retorno) printf("\n##### Publicacion EXITOSA en los Canales 1 y 2 del servidor ThingSpeak #####\n\n");
+    if (retorno) printf("\n##### Publicacion ENCOLADA en los Canales 1 y 2 del servidor ThingSpeak #####\n\n");
     else printf("\nErrores al publicar los Datos, se agregara el dato a la FIFO...\n");
 
+    CIERRA_SONDA(SONDA_PUBLICACION);
     return retorno;
 }
 
@@ -566,31 +1898,11 @@ bool publica_DatosConcatThingSpeak(megaDatoConcat* miDatoConcat)  { // Pruebas
         }
         else
         {
-          resultado = stiot_publish(&client, mqtt_pubtopic, mqtt_msg);  // Wrapper for MQTTPublish()
-
-          if (resultado == MQSUCCESS)
-          {
-        	  // HAL_ResumeTick();								//Habilita ticks
-        	  // Notificación visual de publciación exitosa de mensajes:LED blink.
-        	  for (uint8_t i=0 ;i<10; i++) {
-        		  HAL_GPIO_TogglePin(GPIOC, ARD_A1_LEDWIFI_Pin);
-        		  HAL_Delay(15);
-        	  }
-
-        	 //msg_info("#Publicado en el Tema MQTT: %s \n ->Payload del mensaje enviado: %s\n", mqtt_pubtopic, mqtt_msg);
-        	 // HAL_SuspendTick();
-          }
-          else
-          {
-            msg_error("\n\n***Publicacion Telemetrica fallida (DATOS CONCATENADOS). Mensaje error: \n");
-            g_connection_needed_score++;
-            retorno &= false;
-          }
+          resultado = encola_PublicacionMQTT(&colaPublicacion, &client, mqtt_pubtopic, mqtt_msg);  // Lo envia envia_ColaMQTT()
 
-          resultado = MQTTYield(&client, 500);
           if (resultado != MQSUCCESS)
           {
-            msg_error("\n\n***Yield fallido (DATOS CONCATENADOS). Mensaje error:\n");
+            msg_error("\n\n***Publicacion Telemetrica fallida (DATOS CONCATENADOS). Mensaje error: \n");
             g_connection_needed_score++;
             retorno &= false;
           }
@@ -599,7 +1911,7 @@ bool publica_DatosConcatThingSpeak(megaDatoConcat* miDatoConcat)  { // Pruebas
     }
     //fin for(canales)
 
-    if (retorno) printf("\n##### Publicacion EXITOSA de todos los Datos en todos los Canales 3 y 4 del servidor ThingSpeak #####\n\n");
+    if (retorno) printf("\n##### Publicacion ENCOLADA de todos los Datos en todos los Canales 3 y 4 del servidor ThingSpeak #####\n\n");
     else printf("\n***Errores al publicar los Datos en los canales 3 y 4.\n");
 
 	memset(miDatoConcat, 0,sizeof(*miDatoConcat));	//Reseteo de las muestras concatenadas
@@ -608,91 +1920,17 @@ bool publica_DatosConcatThingSpeak(megaDatoConcat* miDatoConcat)  { // Pruebas
 }
 
 /**
- * @brief   Funcion para calcular la media aritmética de las muestras a lo largo de un minuto.
- * @param   mediaDatos:   estructura de retorno para devolver la media de todas las magnitudes
- * @param   p_vectorLecturas:   vector de muestras de donde saca la media
- * @param   n_elem:   contador del nº elementos del vector
- * @retval  void no devuelve nada
+ * @brief   Concatena la serie de una ventana en los campos de texto de los canales 3 y 4 de ThingSpeak. Los campos de
+ * 255 caracteres solo admiten N_MAX_ELEMENTOS muestras: con una serie más larga se toma una de cada paso, equiespaciadas.
+ * @param   Out:  datosConcat       campos concatenados
+ * @param   In:   p_vectorLecturas  serie de la ventana (Ventanas_Muestras.h)
+ * @param   In:   n_elem            muestras de la serie
+ * @retval  None
  */
-void calcula_mediaVector(megaDato* mediaDatos, megaDato* p_vectorLecturas, uint8_t n_elem )   {
-
-	uint8_t restador = 0;
-	megaDato suma;
-
-	if(n_elem==0){
-		printf("Invocada funcion de calcula_mediaVector sin elementos en el vector\n");
-		mediaDatos = NULL;	//acuse de recibo
-		return ;
-	}
-	/* Lo primero de todo, obtiene la fecha y hora  a partir del ultimo elemento del vector */
-	mediaDatos->agno = (p_vectorLecturas+n_elem-1)->agno;
-	mediaDatos->mes = (p_vectorLecturas+n_elem-1)->mes;
-	mediaDatos->dia = (p_vectorLecturas+n_elem-1)->dia;
-	mediaDatos->hora = (p_vectorLecturas+n_elem-1)->hora;
-	mediaDatos->min = (p_vectorLecturas+n_elem-1)->min;
-	mediaDatos->seg = (p_vectorLecturas+n_elem-1)->seg;
-
-	memset(&suma, 0, sizeof(suma));	//inicializa a 0
-
-	for (uint8_t i=0; i<n_elem; i++)
-	{
-
-		suma.irradiancia[0] += (p_vectorLecturas+i)->irradiancia[0];
-		suma.irradiancia[1] += (p_vectorLecturas+i)->irradiancia[1];
-		suma.irradiancia[2] += (p_vectorLecturas+i)->irradiancia[2];
-		suma.irradiancia[3] += (p_vectorLecturas+i)->irradiancia[3];
-		suma.irradiancia[4] += (p_vectorLecturas+i)->irradiancia[4];
-
-		suma.temperatura += (p_vectorLecturas+i)->temperatura;
-		suma.humedad += (p_vectorLecturas+i)->humedad;
-		suma.presion += (p_vectorLecturas+i)->presion;
+void calcula_concatenar(megaDatoConcat* datosConcat, const registroCompacto* p_vectorLecturas, uint16_t n_elem)   {
 
-		suma.alebeo += (p_vectorLecturas+i)->alebeo;
-		suma.cabeceo += (p_vectorLecturas+i)->cabeceo;
-		suma.guino_brujula += (p_vectorLecturas+i)->guino_brujula;
-
-
-		if (noesNAN((p_vectorLecturas+i)->longitud) && noesNAN((p_vectorLecturas+i)->latitud) && noesNAN((p_vectorLecturas+i)->altitud) && noesNAN((p_vectorLecturas+i)->velocidad)
-			&& (p_vectorLecturas+i)->longitud != 0.0f && (p_vectorLecturas+i)->latitud != 0.0f && (p_vectorLecturas+i)->altitud != 0.0f	) {
-			suma.latitud += (p_vectorLecturas+i)->latitud;
-			suma.longitud += (p_vectorLecturas+i)->longitud;
-			suma.altitud += (p_vectorLecturas+i)->altitud;
-			suma.velocidad += (p_vectorLecturas+i)->velocidad;
-		}
-		else{
-			restador ++;	//añade 1 al numero de datos fallidos en localizacion
-		}
-	}
-
-		if(restador <= (n_elem/2)) {			/*Si el numero de medidas correctas es mas de la mitad */
-			mediaDatos->ubicacion_fix = true;
-		}else {  mediaDatos->ubicacion_fix = false; }
-
-		mediaDatos->irradiancia[0] = suma.irradiancia[0] / n_elem;
-		mediaDatos->irradiancia[1] = suma.irradiancia[1] / n_elem;
-		mediaDatos->irradiancia[2] = suma.irradiancia[2] / n_elem;
-		mediaDatos->irradiancia[3] = suma.irradiancia[3] / n_elem;
-		mediaDatos->irradiancia[4] = suma.irradiancia[4] / n_elem;
-
-		mediaDatos->temperatura = suma.temperatura / n_elem;
-		mediaDatos->humedad = suma.humedad  / n_elem;
-	    mediaDatos->presion = suma.presion  / n_elem;
-
-	    mediaDatos->longitud = suma.longitud / (n_elem-restador);	//obtiene la media de todos los elementos menos los que no se hayan añadido
-	    mediaDatos->latitud = suma.latitud / (n_elem-restador);
-	    mediaDatos->altitud = suma.altitud / (n_elem-restador);
-	    mediaDatos->velocidad = suma.velocidad / (n_elem-restador);
-
-	    mediaDatos->alebeo = suma.alebeo / n_elem;
-		mediaDatos->cabeceo = suma.cabeceo / n_elem;
-		mediaDatos->guino_brujula = suma.guino_brujula / n_elem ;
-
-
-	    //memset(p_vectorLecturas, 0, (N_ELEMENTOS-1)*sizeof(megaDato));	//Reseteo del vector de muestras
-
-}
-
-void calcula_concatenar(megaDatoConcat* datosConcat, megaDato* p_vectorLecturas, uint8_t n_elem)   {
+	megaDato m;
+	uint16_t paso = (n_elem + N_MAX_ELEMENTOS - 1) / N_MAX_ELEMENTOS;
 
 	if(n_elem==0){
 		printf("Invocada funcion de calcula_concatenar sin elementos en el vector\n");
@@ -704,17 +1942,19 @@ void calcula_concatenar(megaDatoConcat* datosConcat, megaDato* p_vectorLecturas,
 	 * Será de utilidad para el posterior procesado de los datos
 	 * */
 
-	datosConcat->agno = (p_vectorLecturas+n_elem-1)->agno;
-	datosConcat->mes = (p_vectorLecturas+n_elem-1)->mes;
-	datosConcat->dia = (p_vectorLecturas+n_elem-1)->dia;
-	datosConcat->hora = (p_vectorLecturas+n_elem-1)->hora;
-	datosConcat->min = (p_vectorLecturas+n_elem-1)->min;
-	datosConcat->seg = (p_vectorLecturas+n_elem-1)->seg;
+	expande_Registro(p_vectorLecturas+n_elem-1, &m);
+	datosConcat->agno = m.agno;
+	datosConcat->mes = m.mes;
+	datosConcat->dia = m.dia;
+	datosConcat->hora = m.hora;
+	datosConcat->min = m.min;
+	datosConcat->seg = m.seg;
 
 	char c[255] = "";
 
-	for (uint8_t i=0; i<n_elem; i++)
+	for (uint16_t i=0; i<n_elem; i+=paso)
 	{
+		expande_Registro(p_vectorLecturas+i, &m);
 		/* En función de los decimales que queramos obtener, variamos el "02d" de cada caso.
 		 * Si se quiere dos numeros enteros 	-> "%02d", obteniendo "23"
 		 * Si se quiere cuatro numeros enteros	-> "%04d" obteniendo "2023"
@@ -725,96 +1965,96 @@ void calcula_concatenar(megaDatoConcat* datosConcat, megaDato* p_vectorLecturas,
 		 */
 
 		// CONCATENACIÓN DE LA HORA
-		sprintf(c, "%02d", (p_vectorLecturas+i)->hora);			// Conversión de "float" a "string"
+		sprintf(c, "%02d", m.hora);			// Conversión de "float" a "string"
 		strcat(datosConcat->tiempo_concat, c);					// Concatenamos el "string" con el contenido de la variable, en este caso "tiempo_Concat"
 		strcat(datosConcat->tiempo_concat, "-");				// Concatenamos el elemento "-" para separar las muestras dentro de la varible
 
-		sprintf(c, "%02d", (p_vectorLecturas+i)->min);
+		sprintf(c, "%02d", m.min);
 		strcat(datosConcat->tiempo_concat, c);
 		strcat(datosConcat->tiempo_concat, "-");
 
-		sprintf(c, "%02d", (p_vectorLecturas+i)->seg);
+		sprintf(c, "%02d", m.seg);
 		strcat(datosConcat->tiempo_concat, c);
 		strcat(datosConcat->tiempo_concat, ";");
 
 		/* CONCATENCACIÓN DE LAS IRRADIANCIAS */
-		sprintf(c, "%0.1f", (p_vectorLecturas+i)->irradiancia[0]);
+		sprintf(c, "%0.1f", m.irradiancia[0]);
 		strcat(datosConcat->irradiancia_1, c);
 		strcat(datosConcat->irradiancia_1, ";");
 		//printf("IRRADIANCIA 1 concatenada: %s\n", datosConcat->irradiancia_1);
 
-		sprintf(c, "%0.1f", (p_vectorLecturas+i)->irradiancia[1]);
+		sprintf(c, "%0.1f", m.irradiancia[1]);
 		strcat(datosConcat->irradiancia_2, c);
 		strcat(datosConcat->irradiancia_2, ";");
 		//printf("IRRADIANCIA 2 concatenada: %s\n", datosConcat->irradiancia_2);
 
-		sprintf(c, "%0.1f", (p_vectorLecturas+i)->irradiancia[2]);
+		sprintf(c, "%0.1f", m.irradiancia[2]);
 		strcat(datosConcat->irradiancia_3, c);
 		strcat(datosConcat->irradiancia_3, ";");
 		//printf("IRRADIANCIA 3 concatenada: %s\n", datosConcat->irradiancia_3);
 
-		sprintf(c, "%0.1f", (p_vectorLecturas+i)->irradiancia[3]);
+		sprintf(c, "%0.1f", m.irradiancia[3]);
 		strcat(datosConcat->irradiancia_4, c);
 		strcat(datosConcat->irradiancia_4, ";");
 		//printf("IRRADIANCIA 4 concatenada: %s\n", datosConcat->irradiancia_4);
 
-		sprintf(c, "%0.1f", (p_vectorLecturas+i)->irradiancia[4]);
+		sprintf(c, "%0.1f", m.irradiancia[4]);
 		strcat(datosConcat->irradiancia_5, c);
 		strcat(datosConcat->irradiancia_5, ";");
 		//printf("IRRADIANCIA 5 concatenada: %s\n", datosConcat->irradiancia_5);
 
 
 		// CONCATENACIÓN DE LA TEMPERATURA
-		sprintf(c, "%0.1f", (p_vectorLecturas+i)->temperatura);
+		sprintf(c, "%0.1f", m.temperatura);
 		strcat(datosConcat->temperatura, c);
 		strcat(datosConcat->temperatura, ";");
 
 		// Concatenación de la presión
-		sprintf(c, "%0.1f", (p_vectorLecturas+i)->presion);
+		sprintf(c, "%0.1f", m.presion);
 		strcat(datosConcat->presion, c);
 		strcat(datosConcat->presion, ";");
 
 		// Concatenación de la humedad
-		sprintf(c, "%0.1f", (p_vectorLecturas+i)->humedad);
+		sprintf(c, "%0.1f", m.humedad);
 		strcat(datosConcat->humedad, c);
 		strcat(datosConcat->humedad, ";");
 
 		// Concatenación del alabeo
-		sprintf(c, "%0.3f", (p_vectorLecturas+i)->alebeo);
+		sprintf(c, "%0.3f", m.alebeo);
 		strcat(datosConcat->alabeo, c);
 		strcat(datosConcat->alabeo, ";");
 
 		// Concatenación del cabeceo
-		sprintf(c, "%0.3f", (p_vectorLecturas+i)->cabeceo);
+		sprintf(c, "%0.3f", m.cabeceo);
 		strcat(datosConcat->cabeceo, c);
 		strcat(datosConcat->cabeceo, ";");
 
 		// Concatenación del guiño
-		sprintf(c, "%0.3f", (p_vectorLecturas+i)->guino_brujula);
+		sprintf(c, "%0.3f", m.guino_brujula);
 		strcat(datosConcat->guino_brujula, c);
 		strcat(datosConcat->guino_brujula, ";");
 
 		// Concatenación del latitud
-		sprintf(c, "%0.6f", (p_vectorLecturas+i)->latitud);
+		sprintf(c, "%0.6f", m.latitud);
 		strcat(datosConcat->latitud, c);
 		strcat(datosConcat->latitud, ";");
 
 		// Concatenación del longitud
-		sprintf(c, "%0.6f", (p_vectorLecturas+i)->longitud);
+		sprintf(c, "%0.6f", m.longitud);
 		strcat(datosConcat->longitud, c);
 		strcat(datosConcat->longitud, ";");
 
 		// Concatenación del altitud
-		sprintf(c, "%0.3f", (p_vectorLecturas+i)->altitud);
+		sprintf(c, "%0.3f", m.altitud);
 		strcat(datosConcat->altitud, c);
 		strcat(datosConcat->altitud, ";");
 
 		// Concatenación del velocidad
-		sprintf(c, "%0.1f", (p_vectorLecturas+i)->velocidad);
+		sprintf(c, "%0.1f", m.velocidad);
 		strcat(datosConcat->velocidad, c);
 		strcat(datosConcat->velocidad, ";");
 
-		//printf("/n El valor float es: %f y en string es: %s\n",(p_vectorLecturas+i)->temperatura, datosConcat->temperatura);
+		//printf("/n El valor float es: %f y en string es: %s\n",m.temperatura, datosConcat->temperatura);
 	}
 
 		/* MUESTRA EN PANTALLA DE LOS DATOS CONCATENADOS */
@@ -840,8 +2080,6 @@ void calcula_concatenar(megaDatoConcat* datosConcat, megaDato* p_vectorLecturas,
 
 		printf("La fecha es: %s \n", datosConcat->tiempo_concat);
 
-
-	    memset(p_vectorLecturas, 0, (N_ELEMENTOS-1)*sizeof(megaDato));	//Reseteo del vector de muestras, no eliminar
 }
 
 /**
@@ -854,6 +2092,7 @@ void calcula_concatenar(megaDatoConcat* datosConcat, megaDato* p_vectorLecturas,
 void recabar_Datos(megaDato* miLectura){
 
 	float latit_raw=NAN, longit_raw=NAN, altit_raw=NAN,speed_raw=NAN, temp_raw=NAN, hum_raw=NAN, pres_raw=NAN;
+	ABRE_SONDA(SONDA_RECABAR);
 
 	 if (HAL_RTC_GetTime(&hrtc, &sTiempo_actual, RTC_FORMAT_BIN) != HAL_OK ) {	//prioritario, tomar hora actual
 	    	printf("Error al dar las obterner hora-fecha actual del RTC.\n");
@@ -884,14 +2123,21 @@ void recabar_Datos(megaDato* miLectura){
 	}
 
 
-	miLectura->alebeo = alebeo_sum / (float)contador_MEMS;
-	miLectura->cabeceo = cabeceo_sum / (float)contador_MEMS;
-	miLectura->guino_brujula = guino_sum / (float)contador_MEMS;
+	/* Media normalizada de los cuaterniones del ultimo segundo. Si no ha habido ningun tick del MEMS no se divide
+	 * entre 0: se mantiene la actitud anterior, igual que con los sensores ambientales */
+	if ( media_Actitud(&actitud_segundo, &miLectura->alebeo, &miLectura->cabeceo, &miLectura->guino_brujula, &miLectura->dispersion_rumbo) == false ) {
+		printf("Sin iteraciones del algoritmo MEMS en el ultimo segundo, se mantiene la actitud anterior.\n");
+	}
+
+	if (config.habilita_nube)		//solo se publica la media de la ventana con la nube habilitada
+		fusiona_Actitud(&actitud_ventana, &actitud_segundo);
 
-	alebeo_sum = 0.0f;  cabeceo_sum = 0.0f;   guino_sum = 0.0f; //Reseteo de acumuladores de medias parciales
+	reinicia_Actitud(&actitud_segundo); //Reseteo del acumulador de medias parciales
 
 
+	ABRE_SONDA(SONDA_NMEA);
 	miLectura->ubicacion_fix = decodificadorNMEA(buffc_DMA_UART, &latit_raw, &longit_raw, &altit_raw, &speed_raw);
+	CIERRA_SONDA(SONDA_NMEA);
 
 	if(miLectura->ubicacion_fix || ((noesNAN(latit_raw) && noesNAN(longit_raw))) )	//comprobación errores
 	{
@@ -901,59 +2147,36 @@ void recabar_Datos(megaDato* miLectura){
 		if(noesNAN(speed_raw)) miLectura->velocidad = speed_raw;
 	}
 
-	mideRadiacion(miLectura->irradiancia);	//llamada a función a parte para las irradiancias
-
-
-#ifdef ENABLE_IMPRIMIR_MUESTRAS	//imprime cada muestra si el usuario compilador lo desea
+	evalua_FusionAdaptativa(miLectura->velocidad, miLectura->ubicacion_fix);	//frecuencia y motor de fusión del proximo segundo
 
-		printf("\x1b[2J" "\x1b[f"); //limpiar buffer y ventana de TeraTerm
+	ABRE_SONDA(SONDA_RADIACION);
+	mideRadiacion(miLectura->irradiancia);	//llamada a función a parte para las irradiancias
+	CIERRA_SONDA(SONDA_RADIACION);
 
-	    printf("\n\t-------------- Datos Leidos por el uC STM32-L475-VGT6 ----------------\n"
-	    		"Irradiancia modulo FV 1:   %f\n"
-	    		"Irradiancia modulo FV 2:   %f\n"
-	    		"Irradiancia modulo FV 3:   %f\n"
-	    		"Irradiancia modulo FV 4:   %f\n"
-	    		"Irradiancia modulo FV 5:   %f\n"
-	    		"Temperatura interior del sensor:  %f\n"
-	    		"Presion interior del sensor:      %f\n"
-	    		"Humedad interior del sensor:      %f\n"
-	    		"Latitud geografica         :      %f\n"
-	    		"Longitud geografica        :      %f\n"
-	    		"Altitud geografica         :      %f\n"
-	    		"Velocidad desplazamiento   :      %f\n"
-	    		"Alabeo    X :                     %f\n"
-	    		"Cabeceo   Y :                     %f\n"
-	    		"Gui%cada   Z :                     %f\n"
-	    		"Fecha y hora de la medicion:      %02d-%02d-%04d  %02d:%02d:%02d \n",
-				miLectura->irradiancia[0], miLectura->irradiancia[1], miLectura->irradiancia[2], miLectura->irradiancia[3], miLectura->irradiancia[4],
-				miLectura->temperatura, miLectura->presion,miLectura->humedad,
-				miLectura->latitud, miLectura->longitud, miLectura->altitud, miLectura->velocidad,
-				miLectura->alebeo, miLectura->cabeceo, 165, miLectura->guino_brujula,
-				miLectura->dia , miLectura->mes,  miLectura->agno , miLectura->hora , miLectura->min, miLectura->seg
-	    		);
-#endif
+	CIERRA_SONDA(SONDA_RECABAR);
 
 		//HAL_SuspendTick();
 		//HAL_GPIO_WritePin(GPIOC, ARD_A2_LEDON_Pin, GPIO_PIN_RESET); //indicador visual
 
 }
 
-void inicializa_SD()
+/**
+ * @brief   Monta la SD e informa de su espacio. La primera vez crea el fichero, con nombre MMDDhhmm.txt a partir
+ * de la fecha del primer registro, y escribe la cabecera; tras un fallo posterior solo vuelve a montar y sigue en el
+ * mismo fichero. Un fallo no detiene el programa: el sumidero de la SD lo reintenta más tarde.
+ * @param   miLectura: registro del que se toma la fecha para el nombre del fichero
+ * @retval  true si la SD responde y el fichero está listo
+ */
+bool inicializa_SD(const megaDato* miLectura)
 {
 	// **************** PRUEBA DE LA TARJETA SD ***********
 	  printf("\r\n~ SD INIT ~\r\n\r\n");
 
-	  HAL_Delay(1000); //Importante para la buena configuración de la SD
-
-	  // Variables para FatFs
-	  //FATFS FatFs; 	//Fatfs handle
-	  //FRESULT fres; 	//Result after operations
-
 	  // Montamos la SD
 	  fres = f_mount(&FatFs, "", 1); //1=mount now
 	  if (fres != FR_OK) {
 		printf("f_mount error (%i)\r\n", fres);
-		while(1);
+		return false;
 	  }
 
 	  // Obtención de espacio total y libre de la SD
@@ -964,7 +2187,8 @@ void inicializa_SD()
 	  fres = f_getfree("", &free_clusters, &getFreeFs);
 	  if (fres != FR_OK) {
 		printf("f_getfree error (%i)\r\n", fres);
-		while(1);
+		f_mount(NULL, "", 0);
+		return false;
 	  }
 
 	  //Formula comes from ChaN's documentation
@@ -973,50 +2197,67 @@ void inicializa_SD()
 
 	  printf("SD card stats:\r\n%10lu KiB total drive space.\r\n%10lu KiB available.\r\n", total_sectors / 2, free_sectors / 2);
 
+	  //De-mount the drive
+	  f_mount(NULL, "", 0);
+
+	  if (fichName[0] != '\0') {	//remontaje tras un fallo: se sigue en el mismo fichero
+		  return true;
+	  }
 
 	  // ***************** NOMBRE DEL FICHERO  ****************
-	  megaDato name;
-	  recabar_Datos(&name);			// Obtención de la fecha y hora
-
 	  // Crear el nombre del fichero. Puede tener como máximo 12 caracteres
-	  char c[5] = "";
-
-	  sprintf(c, "%02d", name.mes);
-	  strcat(fichName,c);
-	  sprintf(c, "%02d", name.dia);
-	  strcat(fichName,c);
-	  sprintf(c, "%02d", name.hora);
-	  strcat(fichName,c);
-	  sprintf(c, "%02d", name.min);
-	  strcat(fichName,c);
-	  strcat(fichName, ".txt");
+	  snprintf(fichName, sizeof(fichName), "%02d%02d%02d%02d.%s", miLectura->mes, miLectura->dia, miLectura->hora, miLectura->min, EXTENSION_SD);
 
 	  printf("\nEl nombre del fichero es: '%s' , y tiene %d caracteres \n", fichName, strlen(fichName));
 
-	  // Cabecera de los datos
-	  char cabecera[130] = "date;time;irr_sup;irr_fro;irr_tra;irr_der;irr_izq;temp;pres;hum;latitude;longitude;altitude;speed;alabeo;cabeceo;orientation\n";
+	  // Cabecera de los datos: columnas del CSV o, en binario, descripción de los registros que siguen
+#ifdef ENABLE_SD_BINARIO
+	  char cabecera[150] = "# registroCompacto, 40 bytes little-endian por muestra tras esta linea (ver Registro_Compacto.h)\n";
+#else
+	  char cabecera[150] = "date;time;irr_sup;irr_fro;irr_tra;irr_der;irr_izq;temp;pres;hum;latitude;longitude;altitude;speed;alabeo;cabeceo;orientation;heading_std\n";
+#endif
 	  printf ("El tamano del mensaje es: %d\n", strlen(cabecera));
 
-	  // Escribir cabecera en el fichero
-	  escribir_fichero(fichName, cabecera);
+	  // Escribir cabecera en el fichero, precedida de la configuración con la que se han tomado los datos
+	  if ( (escribir_fichero(fichName, "# ") == false) || (escribir_fichero(fichName, textoConfig) == false)
+		   || (escribir_fichero(fichName, "\n") == false) || (escribir_fichero(fichName, cabecera) == false) ) {
+		  fichName[0] = '\0';	//se vuelve a crear en el siguiente intento
+		  return false;
+	  }
 
-	  //De-mount the drive
-	  f_mount(NULL, "", 0);
+	  return true;
+}
 
+/**
+ * @brief   Añade un mensaje al final del fichero, montando y desmontando la SD
+ * @param   nombre: nombre del fichero
+ * @param   mensaje: cadena terminada en nulo
+ * @retval  true si se ha escrito el mensaje completo
+ */
+bool escribir_fichero(char *nombre, char *mensaje)
+{
+	return escribir_datos(nombre, mensaje, strlen(mensaje));
 }
 
-void escribir_fichero(char *nombre, char *mensaje)
+/**
+ * @brief   Añade bytes al final del fichero, montando y desmontando la SD. Sirve para texto y para los registros
+ * compactos del fichero binario.
+ * @param   nombre: nombre del fichero
+ * @param   datos: bytes a escribir
+ * @param   longitud: numero de bytes
+ * @retval  true si se han escrito todos
+ */
+bool escribir_datos(char *nombre, const void *datos, UINT longitud)
 {
-	//FRESULT fres; 	//Result after operations
-	//FIL fil; 			//File handle
-	//BYTE readBuf[250];
-	UINT bytesWrote;
+	UINT bytesWrote = 0;
+	ABRE_SONDA(SONDA_SD);		//montaje, apertura, escritura y cierre: lo que retiene al sumidero de la SD
 
 	// Montaje de la SD
 	fres = f_mount(&FatFs, "", 1); //1=mount now
 	if (fres != FR_OK) {
 		printf("f_mount error (%i)\r\n", fres);
-		while(1);
+		CIERRA_SONDA(SONDA_SD);
+		return false;
 	 }
 
 	// Mensaje de verificación
@@ -1028,29 +2269,39 @@ void escribir_fichero(char *nombre, char *mensaje)
 		printf("He podido abrir el fichero para escribir\r\n");
 	} else {
 		printf("f_open error (%i)\r\n", fres);
+		f_mount(NULL, "", 0);
+		CIERRA_SONDA(SONDA_SD);
+		return false;
 	}
 
-
-	// Escritura en el fichero
-	strncpy((char*)readBuf, mensaje , strlen(mensaje) );
-	fres = f_write(&fil, readBuf, strlen(mensaje) , &bytesWrote);
+	// Escritura en el fichero, directamente desde el mensaje
+	fres = f_write(&fil, datos, longitud, &bytesWrote);
 	if(fres == FR_OK) {
 		printf("He escrito %i bytes\r\n", bytesWrote);
 	} else {
-		printf("f_write error (%i)\r\n");
+		printf("f_write error (%i)\r\n", fres);
 	}
 
 	// Cerrar fichero y desmontar SD
 	f_close(&fil);
 	f_mount(NULL, "", 0);
+	CIERRA_SONDA(SONDA_SD);
+
+	return (fres == FR_OK) && (bytesWrote == longitud);
 }
 
-void obtencion_dato_SD(megaDato* miLectura)
+/**
+ * @brief   Escribe una muestra como una línea del fichero CSV de la SD, con las mismas columnas que la cabecera
+ * @param   miLectura: muestra a registrar
+ * @retval  true si se ha escrito
+ */
+bool obtencion_dato_SD(megaDato* miLectura)
 {
-	char dato[190] = "";
-	char c[10] = "";
+	char dato[320] = "";		//hasta 18 campos %f de 13 caracteres mas fecha y hora
+	char c[16] = "";
 
-	HAL_GPIO_TogglePin(GPIOC, ARD_A1_LEDWIFI_Pin);				//Indicador visual con el led Azul
+	if (!config.habilita_nube)
+		HAL_GPIO_TogglePin(GPIOC, ARD_A1_LEDWIFI_Pin);			//Indicador visual con el led Azul, si no indica la conexion
 
     // Concatenar datos para la publicación en la SD
 
@@ -1089,9 +2340,6 @@ void obtencion_dato_SD(megaDato* miLectura)
     sprintf(c, "%f", miLectura->irradiancia[4]);
     strcat(dato, c);
     strcat(dato, ";");
-    sprintf(c, "%f", miLectura->irradiancia[5]);
-    strcat(dato, c);
-    strcat(dato, ";");
 
     sprintf(c, "%f", miLectura->temperatura);
     strcat(dato, c);
@@ -1123,13 +2371,16 @@ void obtencion_dato_SD(megaDato* miLectura)
     strcat(dato, ";");
     sprintf(c, "%f", miLectura->guino_brujula);
     strcat(dato, c);
+    strcat(dato, ";");
+    sprintf(c, "%f", miLectura->dispersion_rumbo);
+    strcat(dato, c);
     strcat(dato, "\n");
 
     // Mensaje de verificación
     // printf ("\n\nDato escrito en la SD:\n %s\n Y su tamano: %d\n", dato, strlen(dato));
 
     // Llamada a la función para escribir en el fichero
-    escribir_fichero(fichName, dato);
+    return escribir_fichero(fichName, dato);
 }
 
 
@@ -1214,7 +2465,7 @@ void mideRadiacion(float vectIrradiancia[])
 			break;
 		}
 
-		HAL_Delay(T_ESPERA);	//5 milisegundo de Delay entre medidas, para conmutar los interruptores y estabilizar medidas del ADC.
+		HAL_Delay(config.t_espera_ms);	//5 milisegundo de Delay entre medidas, para conmutar los interruptores y estabilizar medidas del ADC.
 
 
 		mseg = HAL_GetTick();
@@ -1222,7 +2473,7 @@ void mideRadiacion(float vectIrradiancia[])
 		do{	// medidas medias redundantes del ADC además del oversampling.
 			suma_media += ADC1_buffer;
 			contador++;
-		}while (HAL_GetTick() - mseg < T_MEDICION);
+		}while (HAL_GetTick() - mseg < config.t_medicion_ms);
 
 		nivelmedioADC =  (float) suma_media / contador;
 
@@ -1235,7 +2486,7 @@ void mideRadiacion(float vectIrradiancia[])
 
 		corrienteFV =  tensionADC /  (SENS_HALL * FACTOR_OPAMP);	//en mA
 
-		irradianciaFV = corrienteFV *  CTE_CALIBR_FV[npv-1] ;	//en W
+		irradianciaFV = corrienteFV *  config.cte_calibr_fv[npv-1] ;	//en W
 
 		vectIrradiancia[npv-1] = irradianciaFV;
 		}
@@ -1309,12 +2560,13 @@ void imprimir_Dato(megaDato Dato)  {
     			"Campo 5: Incliacion Alebeo  X :            %f %c\n"
     			"Campo 6: Incliacion Cabeceo Y :            %f %c\n"
 				"Campo 7: Orientacion Norte  Z :            %f %c\n"
+				"Campo 8: Dispersion del rumbo :            %f %c\n"
 
    	    		"  Fecha y hora de la medicion :        %02d-%02d-%04d   %02d:%02d:%02d \n\n",
 				Dato.irradiancia[0], Dato.irradiancia[1], Dato.irradiancia[2], Dato.irradiancia[3], Dato.irradiancia[4],
    				Dato.temperatura, SUPER_O, Dato.presion,Dato.humedad,
 				Dato.latitud, SUPER_O, Dato.longitud, SUPER_O, Dato.altitud, Dato.velocidad,
-				Dato.alebeo, SUPER_O, Dato.cabeceo, SUPER_O, Dato.guino_brujula, SUPER_O,
+				Dato.alebeo, SUPER_O, Dato.cabeceo, SUPER_O, Dato.guino_brujula, SUPER_O, Dato.dispersion_rumbo, SUPER_O,
    				Dato.dia , Dato.mes,  Dato.agno , Dato.hora , Dato.min, Dato.seg
    	    		);
 }
@@ -1323,26 +2575,30 @@ void imprimir_Dato(megaDato Dato)  {
 /**
  * @brief   Rutina que implementa la  ejecución del algoritmo de estimación de la posición del MEMS de la placa.
  * Se implementa en una función a parte de l de lectura por necesitar una frecuencia de iteración muy superior a la
- * de lectura. 	Los valores devueltos son añadidos a un sumador para que posteriormente la funcion de lectura calcule
- * la media de todos elos cada segundo.
+ * de lectura. 	El cuaternion devuelto se añade al acumulador de actitud para que posteriormente la funcion de
+ * lectura calcule su media normalizada cada segundo. La frecuencia del TIM6 y el motor usado dependen del estado
+ * de movimiento del vehiculo (ver Fusion_Adaptativa.h).
  * @param   void
  * @retval  void
  */
 void computa_algoritmoMEMS(void)
 {
 
-	float roll = 0.0f, pitch = 0.0f, yaw = 0.0f;
+	float cuaternion[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+	ABRE_SONDA(SONDA_FUSION);
 
 #ifdef ENABLE_LOWPWR
 	if(modo_BajoConsumo) {  salir_LowPowerMode();  }  //saliendo del modo de bajo consumo
 #endif
 
-	 MX_MEMS_Process(&roll, &pitch, &yaw);	//función de computo
+	 computa_FusionAdaptativa(cuaternion);	//función de computo
 	 flag_lecturaMEMS = false;
-	 alebeo_sum += roll;
-	 cabeceo_sum += pitch;
-	 guino_sum +=  yaw;
-	 contador_MEMS ++;
+	 acumula_Actitud(&actitud_segundo, cuaternion);
+
+	 if (config.telemetria_binaria) {
+		 telemetria_Actitud(&telemetriaUART, cuaternion);	//sin sitio en la consola se pierde: llega otra en 20 ms
+	 }
+	 CIERRA_SONDA(SONDA_FUSION);
 
 }
 
@@ -1367,6 +2623,10 @@ bool desconectaConexionMQTT(void)  {
 		  }
 		  b_mqtt_connected = false;
 		}
+	  if (socket == NULL)
+		{
+		  return ret;	//ya cerrado, o sin llegar a crearse: net_sock_destroy() libera el contexto
+		}
 	  if (NET_OK !=  net_sock_close(socket))
 		{
 		  msg_error("\nnet_sock_close() fallo.\n");
@@ -1376,6 +2636,7 @@ bool desconectaConexionMQTT(void)  {
 	  {
 		msg_error("\nnet_sock_destroy() fallo.\n");
 	  }
+	  socket = NULL;
 	return ret;
 }
 
@@ -1462,7 +2723,7 @@ bool inicia_ClienteMQTT(int ret)	{
       network.mqttread = (network_read);
       network.mqttwrite = (network_write);
 
-      MQTTClientInit(&client, &network, MQTT_CMD_TIMEOUT, mqtt_send_buffer, MQTT_SEND_BUFFER_SIZE, mqtt_read_buffer, 1);
+      MQTTClientInit(&client, &network, MQTT_CMD_TIMEOUT, mqtt_send_buffer, MQTT_SEND_BUFFER_SIZE, mqtt_read_buffer, MQTT_READ_BUFFER_SIZE);
 
       /* MQTT connect */
       MQTTPacket_connectData options = MQTTPacket_connectData_initializer;
@@ -1496,33 +2757,22 @@ bool inicia_ClienteMQTT(int ret)	{
 
 
 /**
- * @brief   Funcion de inicio de conexión con la plataforma, la red Wi-Fi el módulo y su correspodiente puerto SPI3.
- *  A continuación, identifica la red a la que se conecta, al igual que el dispositivo cliente, obteniendo su
- *  ID y dirección MAC.Lee desde memoria flash la configuración preestablecida de  autentificación con la red W-Fi.
+ * @brief   Funcion de inicio de la plataforma sin tocar la red: semilla, cabecera y aprovisionamiento de credenciales
+ *  (solo pide datos por consola si faltan) y lectura desde memoria flash de la configuración de conexión MQTT.
+ *  La conexión Wi-Fi y la dirección MAC del dispositivo se obtienen después en servicio_RedSegundoPlano().
  *   Al igual que el resto de funciones, lleva a cabo comprobación de errores para avisar al usuario
  * @param   void
- * @retval  bool: true si no existen errores de ningún tipo en las conexiones, false en caso contrario.
+ * @retval  bool: true si no existen errores de ningún tipo en la configuración, false en caso contrario.
  */
-bool inicializa_ConexionIoT(void)   {
+bool inicializa_Plataforma(void)   {
 
 	int ret = 0;
 	const char * connectionString   = NULL;
 
-    ret = platform_init();
+    ret = platform_init_local();
 
-	  if (ret != 0)
-	  {
-	    msg_error("\nFallo al inicializar la plataforma de conexión a Internet.\n");
-	    HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_RESET);	//LED de conexión Wi-Fi}
-	  }
-	  else
-	  {
-	    ret = (getIoTDeviceConfig(&connectionString) != 0);
-	    ret |= (parse_and_fill_device_config(&device_config, connectionString) != 0);
-
-	    connection_security = (conn_sec_t) atoi(device_config->ConnSecurity);
-	    HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_SET);	//LED de conexión Wi-Fi}
-	  }
+    ret |= (getIoTDeviceConfig(&connectionString) != 0);
+    ret |= (parse_and_fill_device_config(&device_config, connectionString) != 0);
 
 	  if (ret != 0)
 	  {
@@ -1530,17 +2780,7 @@ bool inicializa_ConexionIoT(void)   {
 	  }
 	  else
 	  {
-	    net_macaddr_t mac = { 0 };
-	    if (net_get_mac_address(hnet, &mac) == NET_OK)
-	    {
-	      snprintf(pub_data.mac, MODEL_MAC_SIZE , "%02X%02X%02X%02X%02X%02X",
-	               mac.mac[0], mac.mac[1], mac.mac[2], mac.mac[3], mac.mac[4], mac.mac[5]);
-	    }
-	    else
-	    {
-	      msg_warning("\nNo se pudo recuperar la direccion MAC pare establecer la ID del dispositivo \n");
-	      snprintf(pub_data.mac, MODEL_MAC_SIZE -1 , "UnknownMAC");
-	    }
+	    connection_security = (conn_sec_t) atoi(device_config->ConnSecurity);
 	  }
 	  return (ret == 0);
 }
@@ -1553,6 +2793,7 @@ void switch_Temporizadores(bool estado)
   	  	  { Error_Handler(); }
   	  if ( HAL_LPTIM_TimeOut_Start_IT(&hlptim2, PERIODO_LPTIM, TIMEOUT_LPTIM2) != HAL_OK)
   	      { Error_Handler(); }
+  	  inicia_FusionAdaptativa(config.frec_fusion_hz);	//TIM6 a la frecuencia nominal antes de arrancarlo
   	  if ( HAL_TIM_Base_Start_IT(&htim6) != HAL_OK )
   	  	  { Error_Handler(); }
 	}
@@ -1579,28 +2820,28 @@ void switch_Temporizadores(bool estado)
  */
 void HAL_LPTIM_CompareMatchCallback(LPTIM_HandleTypeDef *hlptim)
 {
-	static uint8_t contador_publi = 0, contador_reconex = 0;
+	static uint16_t contador_publi = 0, contador_reconex = 0, contador_lect = 0;	//hasta 3600/10 = 360 vueltas
 
 	if(hlptim == &hlptim1) {	//primer temporizador de muestreo
-		flag_lectura_datos = true;
+
+		if (cuenta_Disparo(&contador_lect, config.periodo_lectura_s, PERIODO_MIN_LPTIM1)) {
+			if (flag_lectura_datos) {
+				lecturas_Perdidas++;	//el bucle sigue retenido en la lectura anterior (p. ej. un paso de la red)
+			}
+			flag_lectura_datos = true;
+		}
 	}
 
 	if (hlptim == &hlptim2) {	//segundo temporizador de publicacion/recuperacion
 
-		contador_publi++;
-
-		if(contador_publi >= (PERIODO_PUBLI_DATOS/PERIODO_MIN_LPTIM2)) {	//si supera los 60/10 = 6 vueltas
+		if (cuenta_Disparo(&contador_publi, config.periodo_publi_s, PERIODO_MIN_LPTIM2)) {	//si supera los 60/10 = 6 vueltas
 			 flag_publi_datos = true;
-			 contador_publi = 0;
 		}
 
 		if ( estado == DESCONECTADO || estaFIFOvacia(&miFIFO)) {	//si se encuentra desconectado
 
-			contador_reconex++;
-
-			if (contador_reconex >= (PERIODO_RECUPERA_DATOS/PERIODO_MIN_LPTIM2) ) {
+			if (cuenta_Disparo(&contador_reconex, PERIODO_RECUPERA_DATOS, PERIODO_MIN_LPTIM2)) {
 				flag_recupera_datos = true;
-				contador_reconex = 0;
 			}
 		}
 	}
@@ -1616,6 +2857,12 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef* htim)
 
 		flag_lecturaMEMS = true;
 
+		if (parpadeos_LED > 0) {	//parpadeo de publicacion, sin bloquear el bucle principal
+			HAL_GPIO_TogglePin(GPIOC, ARD_A1_LEDWIFI_Pin);
+			if (--parpadeos_LED == 0) {
+				HAL_GPIO_WritePin(GPIOC, ARD_A1_LEDWIFI_Pin, GPIO_PIN_SET);	//tras publicar, LED de conexión encendido
+			}
+		}
 	}
 }
 
@@ -24,6 +24,7 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "Consola_DMA.h"
 
 /* USER CODE END Includes */
 
@@ -79,6 +80,7 @@ TIM_HandleTypeDef htim6;
 UART_HandleTypeDef huart4;
 UART_HandleTypeDef huart1;
 DMA_HandleTypeDef hdma_uart4_rx;
+DMA_HandleTypeDef hdma_usart1_tx;
 
 /* USER CODE BEGIN PV */
 net_hnd_t         hnet; /* Es inicializado porcloud_main(). */
@@ -165,6 +167,11 @@ int main(void)
   MX_FATFS_Init();
   /* USER CODE BEGIN 2 */
 
+#ifdef RFU
+  rfu_boot_check();	/* Con una imagen nueva a prueba cuenta el arranque, y vuelve a la anterior tras RFU_TRIAL_BOOTS
+  	  	  	  	  	   * sin confirmar: antes de los sensores, para que tambien cuenten los fallos al iniciarlos */
+#endif
+
   if( HAL_OK != init_sensors() )
   {
 	  Error_Handler();
@@ -910,6 +917,7 @@ static void MX_USART1_UART_Init(void)
   }
   /* USER CODE BEGIN USART1_Init 2 */
   BSP_COM_Init(COM1,&huart1);		//Transmisión de los datos por el puerto USART1 al COM del ordenador por USB
+  inicia_Consola(&huart1);			//Desde aqui printf() y msg_*() no esperan al UART: anillo vaciado por DMA
   /* USER CODE END USART1_Init 2 */
 
 }
@@ -928,6 +936,9 @@ static void MX_DMA_Init(void)
   /* DMA1_Channel1_IRQn interrupt configuration */
   HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, 0, 0);
   HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+  /* DMA1_Channel4_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel4_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel4_IRQn);
   /* DMA2_Channel5_IRQn interrupt configuration */
   HAL_NVIC_SetPriority(DMA2_Channel5_IRQn, 0, 0);
   HAL_NVIC_EnableIRQ(DMA2_Channel5_IRQn);
@@ -1139,12 +1150,10 @@ void HAL_ADC_Conv_CpltCallback(ADC_HandleTypeDef* hadc)
   */
 PUTCHAR_PROTOTYPE
 {
-  /* Place your implementation of fputc here */
-  /* e.g. write a character to the USART2 and Loop until the end of transmission */
-  while (HAL_OK != HAL_UART_Transmit(&huart1, (uint8_t *) &ch, 1, 30000))
-  {
-    ;
-  }
+  /* Al anillo de la consola (Consola_DMA.h); printf() llega por lineas a través de _write() */
+  char c = (char)ch;
+
+  consola_Escribe(CONSOLA_TEXTO, &c, 1);
   return ch;
 }
 
@@ -1267,6 +1276,7 @@ void Error_Handler(void)
 {
   /* USER CODE BEGIN Error_Handler_Debug */
   /* User can add his own implementation to report the HAL error return state */
+	  pasa_ConsolaBloqueante();	//Puede venir de una interrupción: la consola deja el DMA y escribe esperando
 	  while(1)			//En caso de error, informa, espera y reinicia el programa
 	  {
 		printf("\n\n\n\t                  E R R O R                 \n");
@@ -30,6 +30,7 @@
 #include <time.h>
 #include <sys/time.h>
 #include <sys/times.h>
+#include "msg.h"		// consola_Escribe() y CONSOLA_TEXTO
 
 
 /* Variables */
@@ -111,12 +112,8 @@ int _read (int file, char *ptr, int len)
 
 int _write(int file, char *ptr, int len)
 {
-	int DataIdx;
-
-	for (DataIdx = 0; DataIdx < len; DataIdx++)
-	{
-		__io_putchar(*ptr++);
-	}
+	/* Toda la linea de una vez al anillo de la consola; lo que no quepa se pierde y se contabiliza */
+	consola_Escribe(CONSOLA_TEXTO, ptr, len);
 	return len;
 }
 
@@ -0,0 +1,341 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+monitor_telemetria.py - Monitor de la telemetria binaria del sensor VIPV (Linux)
+
+Decodifica las tramas COBS con CRC que envia el sensor por el USART1 con
+ENABLE_TELEMETRIA_BINARIA (o "telemetria_binaria": true en config.json), desde el
+puerto serie de la placa o desde una captura guardada con --graba. El formato de
+las tramas esta descrito en Core/Inc/Telemetria_Binaria.h.
+
+Ejemplos:
+    ./monitor_telemetria.py /dev/ttyACM0
+    ./monitor_telemetria.py /dev/ttyACM0 --csv banco --graba banco.bin --grafica
+    ./monitor_telemetria.py banco.bin --csv banco --silencio
+
+Con pyserial instalado se usa para abrir el puerto; si no, se configura con termios.
+La grafica necesita matplotlib.
+
+Sergio Vera Muñoz --- TFG 2020
+"""
+
+import argparse
+import csv
+import math
+import os
+import stat
+import struct
+import sys
+import time
+from collections import deque
+
+TELE_MUESTRA = 0x01
+TELE_ACTITUD = 0x02
+TELE_TIEMPOS = 0x03
+
+# registroCompacto de Registro_Compacto.h, 40 bytes
+FORMATO_MUESTRA = struct.Struct("<Iii5HhHhhHHhHBB")
+FORMATO_ACTITUD = struct.Struct("<I4h")
+FORMATO_TIEMPOS = struct.Struct("<II" + "3H" * 4 + "HBB")
+
+REG_UBICACION_FIX = 0x01
+REG_POSICION = 0x02
+REG_ALTITUD = 0x04
+REG_VELOCIDAD = 0x08
+
+TAREAS = ("lectura", "publicacion", "fusion", "red")
+
+CAMPOS_MUESTRA = ["epoch", "fecha", "irradiancia1", "irradiancia2", "irradiancia3", "irradiancia4",
+                  "irradiancia5", "temperatura", "presion", "humedad", "latitud", "longitud", "altitud",
+                  "velocidad", "ubicacion_fix", "alabeo", "cabeceo", "guinada", "dispersion_rumbo"]
+CAMPOS_ACTITUD = ["tick_ms", "qx", "qy", "qz", "qw", "alabeo", "cabeceo", "guinada"]
+CAMPOS_TIEMPOS = (["tick_ms", "vueltas_bucle"]
+                  + [f"{t}_{c}" for t in TAREAS for c in ("ejecuciones", "total_ms", "max_ms")]
+                  + ["tramas_perdidas", "pendientes_tuberia"])
+
+
+# ---------------------------------------------------------------- Decodificacion
+
+def crc16_ccitt(datos):
+    """CRC-16/CCITT-FALSE, el mismo que crc16_Telemetria()."""
+    crc = 0xFFFF
+    for b in datos:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if (crc & 0x8000) else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def decodifica_cobs(trama):
+    """Deshace COBS; devuelve None si la trama no es COBS valido."""
+    salida = bytearray()
+    i = 0
+    while i < len(trama):
+        codigo = trama[i]
+        if codigo == 0 or i + codigo > len(trama):
+            return None
+        salida += trama[i + 1:i + codigo]
+        i += codigo
+        if codigo < 0xFF and i < len(trama):
+            salida.append(0)
+    return bytes(salida)
+
+
+def decodifica_muestra(datos):
+    v = FORMATO_MUESTRA.unpack(datos)
+    epoch, lat, lon = v[0], v[1], v[2]
+    irr = [x / 10.0 for x in v[3:8]]
+    temp, pres, alabeo, cabeceo, guinada, disp, alt, vel, hum, validez = v[8:18]
+    nan = float("nan")
+    return {
+        "epoch": epoch,
+        "fecha": time.strftime("%Y-%m-%d %H:%M:%S", time.gmtime(epoch)),
+        "irradiancia1": irr[0], "irradiancia2": irr[1], "irradiancia3": irr[2],
+        "irradiancia4": irr[3], "irradiancia5": irr[4],
+        "temperatura": temp / 100.0, "presion": pres / 10.0, "humedad": hum / 2.0,
+        "latitud": lat / 1e7 if validez & REG_POSICION else nan,
+        "longitud": lon / 1e7 if validez & REG_POSICION else nan,
+        "altitud": alt / 10.0 if validez & REG_ALTITUD else nan,
+        "velocidad": vel / 100.0 if validez & REG_VELOCIDAD else nan,
+        "ubicacion_fix": int(bool(validez & REG_UBICACION_FIX)),
+        "alabeo": alabeo / 100.0, "cabeceo": cabeceo / 100.0,
+        "guinada": guinada / 100.0, "dispersion_rumbo": disp / 100.0,
+    }
+
+
+def decodifica_actitud(datos):
+    tick, qx, qy, qz, qw = FORMATO_ACTITUD.unpack(datos)
+    x, y, z, w = (q / 32767.0 for q in (qx, qy, qz, qw))
+    alabeo = math.degrees(math.atan2(2 * (w * x + y * z), 1 - 2 * (x * x + y * y)))
+    cabeceo = math.degrees(math.asin(max(-1.0, min(1.0, 2 * (w * y - z * x)))))
+    guinada = math.degrees(math.atan2(2 * (w * z + x * y), 1 - 2 * (y * y + z * z))) % 360.0
+    return {"tick_ms": tick, "qx": x, "qy": y, "qz": z, "qw": w,
+            "alabeo": alabeo, "cabeceo": cabeceo, "guinada": guinada}
+
+
+def decodifica_tiempos(datos):
+    v = FORMATO_TIEMPOS.unpack(datos)
+    r = {"tick_ms": v[0], "vueltas_bucle": v[1]}
+    for n, t in enumerate(TAREAS):
+        r[f"{t}_ejecuciones"], r[f"{t}_total_ms"], r[f"{t}_max_ms"] = v[2 + 3 * n:5 + 3 * n]
+    r["tramas_perdidas"], r["pendientes_tuberia"] = v[14], v[15]
+    return r
+
+
+DECODIFICADORES = {
+    TELE_MUESTRA: ("muestra", FORMATO_MUESTRA.size, decodifica_muestra, CAMPOS_MUESTRA),
+    TELE_ACTITUD: ("actitud", FORMATO_ACTITUD.size, decodifica_actitud, CAMPOS_ACTITUD),
+    TELE_TIEMPOS: ("tiempos", FORMATO_TIEMPOS.size, decodifica_tiempos, CAMPOS_TIEMPOS),
+}
+
+
+class Decodificador:
+    """Separa el flujo por los 0x00 y valida cada trama. Lo que no es trama (el texto que el
+    firmware sigue imprimiendo) se devuelve como texto."""
+
+    def __init__(self):
+        self.pendiente = bytearray()
+        self.secuencia = None
+        self.cuenta = {nombre: 0 for nombre, _, _, _ in DECODIFICADORES.values()}
+        self.errores_crc = 0
+        self.perdidas = 0
+
+    def alimenta(self, datos):
+        self.pendiente += datos
+        while True:
+            fin = self.pendiente.find(b"\x00")
+            if fin < 0:
+                return
+            trozo = bytes(self.pendiente[:fin])
+            del self.pendiente[:fin + 1]
+            if trozo:
+                yield from self._trama(trozo)
+
+    def _trama(self, trozo):
+        contenido = decodifica_cobs(trozo)
+        if contenido is None or len(contenido) < 4 or contenido[0] not in DECODIFICADORES:
+            yield ("texto", trozo.decode("latin-1"))
+            return
+        nombre, tam, decodifica, _ = DECODIFICADORES[contenido[0]]
+        crc = contenido[-2] | (contenido[-1] << 8)
+        if len(contenido) != tam + 4 or crc16_ccitt(contenido[:-2]) != crc:
+            self.errores_crc += 1
+            yield ("texto", trozo.decode("latin-1"))
+            return
+        secuencia = contenido[1]
+        if self.secuencia is not None:
+            self.perdidas += (secuencia - self.secuencia - 1) & 0xFF
+        self.secuencia = secuencia
+        self.cuenta[nombre] += 1
+        yield (nombre, decodifica(contenido[2:-2]))
+
+
+# ---------------------------------------------------------------- Entrada y salidas
+
+def abre_origen(ruta, baudios):
+    """Devuelve una funcion lee() -> bytes ('' al terminar) y si el origen es en vivo."""
+    if ruta == "-":
+        return (lambda: sys.stdin.buffer.read1(4096)), False
+    if not stat.S_ISCHR(os.stat(ruta).st_mode):
+        f = open(ruta, "rb")
+        return (lambda: f.read(65536)), False
+    try:
+        import serial
+        puerto = serial.Serial(ruta, baudios, timeout=0.1)
+        return (lambda: puerto.read(4096) or None), True
+    except ImportError:
+        import termios
+        import tty
+        fd = os.open(ruta, os.O_RDONLY | os.O_NOCTTY)
+        tty.setraw(fd)
+        attr = termios.tcgetattr(fd)
+        velocidad = getattr(termios, f"B{baudios}")
+        attr[4] = attr[5] = velocidad
+        attr[6][termios.VMIN] = 0
+        attr[6][termios.VTIME] = 1
+        termios.tcsetattr(fd, termios.TCSANOW, attr)
+        return (lambda: os.read(fd, 4096) or None), True
+
+
+class SalidaCSV:
+    def __init__(self, prefijo):
+        self.ficheros = {}
+        self.escritores = {}
+        for nombre, _, _, campos in DECODIFICADORES.values():
+            f = open(f"{prefijo}_{nombre}.csv", "w", newline="")
+            self.ficheros[nombre] = f
+            self.escritores[nombre] = csv.DictWriter(f, fieldnames=campos)
+            self.escritores[nombre].writeheader()
+
+    def escribe(self, nombre, registro):
+        self.escritores[nombre].writerow(registro)
+
+    def cierra(self):
+        for f in self.ficheros.values():
+            f.close()
+
+
+class Grafica:
+    """Irradiancias de las muestras y angulos de la actitud, refrescada cada medio segundo."""
+
+    def __init__(self, puntos):
+        import matplotlib.pyplot as plt
+        self.plt = plt
+        self.irr = [deque(maxlen=puntos) for _ in range(5)]
+        self.t_irr = deque(maxlen=puntos)
+        self.ang = [deque(maxlen=puntos * 50) for _ in range(3)]
+        self.t_ang = deque(maxlen=puntos * 50)
+        plt.ion()
+        self.fig, (self.ax1, self.ax2) = plt.subplots(2, 1, figsize=(10, 7))
+        self.ultimo = 0.0
+
+    def anade(self, nombre, r):
+        if nombre == "muestra":
+            self.t_irr.append(r["epoch"])
+            for i in range(5):
+                self.irr[i].append(r[f"irradiancia{i + 1}"])
+        elif nombre == "actitud":
+            self.t_ang.append(r["tick_ms"] / 1000.0)
+            for i, c in enumerate(("alabeo", "cabeceo", "guinada")):
+                self.ang[i].append(r[c])
+
+    def refresca(self, forzar=False):
+        if not forzar and time.monotonic() - self.ultimo < 0.5:
+            return
+        self.ultimo = time.monotonic()
+        self.ax1.cla()
+        for i in range(5):
+            self.ax1.plot(list(self.t_irr), list(self.irr[i]), label=f"FV {i + 1}")
+        self.ax1.set_ylabel("Irradiancia [W/m2]")
+        self.ax1.legend(loc="upper left")
+        self.ax2.cla()
+        for i, c in enumerate(("alabeo", "cabeceo", "guinada")):
+            self.ax2.plot(list(self.t_ang), list(self.ang[i]), label=c)
+        self.ax2.set_ylabel("Angulo [grados]")
+        self.ax2.set_xlabel("Tiempo [s]")
+        self.ax2.legend(loc="upper left")
+        self.plt.pause(0.001)
+
+
+def imprime(nombre, r):
+    if nombre == "muestra":
+        print(f"{r['fecha']}  G=" + " ".join(f"{r[f'irradiancia{i}']:7.1f}" for i in range(1, 6))
+              + f"  T={r['temperatura']:6.2f}  P={r['presion']:7.1f}  H={r['humedad']:4.1f}"
+              + f"  pos=({r['latitud']:.6f}, {r['longitud']:.6f}) v={r['velocidad']:.1f}")
+    elif nombre == "actitud":
+        print(f"  actitud t={r['tick_ms']:>9} ms  alabeo={r['alabeo']:7.2f}  cabeceo={r['cabeceo']:7.2f}"
+              f"  guinada={r['guinada']:7.2f}")
+    elif nombre == "tiempos":
+        tareas = "  ".join(f"{t} {r[f'{t}_ejecuciones']}x max {r[f'{t}_max_ms']} ms" for t in TAREAS)
+        print(f"  tiempos: {r['vueltas_bucle']} vueltas  {tareas}  perdidas {r['tramas_perdidas']}"
+              f"  pendientes {r['pendientes_tuberia']}")
+    else:
+        texto = r.strip()
+        if texto:
+            print(f"  | {texto}")
+
+
+def main():
+    p = argparse.ArgumentParser(description="Monitor de la telemetria binaria del sensor VIPV")
+    p.add_argument("origen", help="puerto serie (/dev/ttyACM0), captura binaria o - para stdin")
+    p.add_argument("--baudios", type=int, default=115200)
+    p.add_argument("--csv", metavar="PREFIJO", help="guarda PREFIJO_muestra.csv, _actitud.csv y _tiempos.csv")
+    p.add_argument("--graba", metavar="FICHERO", help="guarda los bytes recibidos, para reproducirlos despues")
+    p.add_argument("--grafica", action="store_true", help="grafica en vivo (matplotlib)")
+    p.add_argument("--puntos", type=int, default=300, help="muestras en la grafica")
+    p.add_argument("--silencio", action="store_true", help="no imprime las tramas")
+    p.add_argument("--texto", action="store_true", help="imprime tambien el texto de la consola")
+    p.add_argument("--sin-actitud", action="store_true", help="no imprime las tramas de actitud de 50 Hz")
+    args = p.parse_args()
+
+    lee, en_vivo = abre_origen(args.origen, args.baudios)
+    decodificador = Decodificador()
+    salida_csv = SalidaCSV(args.csv) if args.csv else None
+    captura = open(args.graba, "wb") if args.graba else None
+    grafica = Grafica(args.puntos) if args.grafica else None
+
+    try:
+        while True:
+            datos = lee()
+            if datos is None:          # puerto sin datos de momento
+                if grafica:
+                    grafica.refresca()
+                continue
+            if not datos:              # fin del fichero
+                break
+            if captura:
+                captura.write(datos)
+            for nombre, r in decodificador.alimenta(datos):
+                if nombre == "texto":
+                    if args.texto and not args.silencio:
+                        imprime(nombre, r)
+                    continue
+                if salida_csv:
+                    salida_csv.escribe(nombre, r)
+                if grafica:
+                    grafica.anade(nombre, r)
+                if not args.silencio and not (args.sin_actitud and nombre == "actitud"):
+                    imprime(nombre, r)
+            if grafica and en_vivo:
+                grafica.refresca()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if salida_csv:
+            salida_csv.cierra()
+        if captura:
+            captura.close()
+
+    c = decodificador.cuenta
+    print(f"\nTramas: {c['muestra']} muestras, {c['actitud']} de actitud, {c['tiempos']} de tiempos; "
+          f"{decodificador.perdidas} perdidas por secuencia, {decodificador.errores_crc} con CRC erroneo.",
+          file=sys.stderr)
+    if grafica:
+        grafica.refresca(forzar=True)
+        grafica.plt.ioff()
+        grafica.plt.show()
+
+
+if __name__ == "__main__":
+    main()
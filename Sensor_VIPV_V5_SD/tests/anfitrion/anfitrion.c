@@ -0,0 +1,44 @@
+/******************************************************************************
+* @file    anfitrion.c
+* @brief   HAL y consola mínimos para las pruebas en el PC: el tick y los
+* registros de backup son variables que cada prueba avanza o corrompe.
+******************************************************************************
+*/
+
+#include <stdarg.h>
+
+RTC_HandleTypeDef hrtc;
+uint32_t tick_anfitrion = 0;
+uint32_t bkp_anfitrion[32];
+bool consola_anfitrion = false;
+
+uint32_t HAL_GetTick(void)
+{
+	return tick_anfitrion;
+}
+
+uint32_t HAL_RTCEx_BKUPRead(RTC_HandleTypeDef* h, uint32_t registro)
+{
+	(void)h;
+	return (registro < 32) ? bkp_anfitrion[registro] : 0;
+}
+
+void HAL_RTCEx_BKUPWrite(RTC_HandleTypeDef* h, uint32_t registro, uint32_t dato)
+{
+	(void)h;
+	if (registro < 32) bkp_anfitrion[registro] = dato;
+}
+
+/* Débil: prueba_Consola.c pone la de Consola_DMA.h */
+__attribute__((weak)) int consola_Log(uint8_t nivel, const char* funcion, int linea, const char* formato, ...)
+{
+	va_list args;
+	int n;
+
+	(void)nivel; (void)funcion; (void)linea;
+	if (!consola_anfitrion) return 0;
+	va_start(args, formato);
+	n = vprintf(formato, args);
+	va_end(args);
+	return n;
+}
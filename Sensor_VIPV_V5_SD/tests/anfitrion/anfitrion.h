@@ -0,0 +1,80 @@
+/******************************************************************************
+* @file    anfitrion.h
+* @brief   Sustituto de main.h para compilar los módulos en el PC (gcc nativo).
+* Se incluye antes que nada con -include: define la guarda de main.h, que
+* arrastraría el HAL entero, y declara solo lo que usan los módulos probados.
+* Las funciones del HAL están en anfitrion.c, sobre un reloj y unos registros
+* de backup que cada prueba maneja a su gusto.
+******************************************************************************
+*/
+
+#ifndef ANFITRION_H_
+#define ANFITRION_H_
+
+#define __MAIN_H			// el main.h del firmware no se incluye
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "msg.h"
+
+/* De AppIoT_TFG_VIPV.h, que los módulos dan por incluido */
+#define noesNAN(x)    ( !( (x)!=(x) ) )
+#define deg2rad(x)    ( (float)(x) * (M_PI/180.0f))
+#define rad2deg(x)    ( (float)(x) * (180.0f/M_PI))
+
+/* RTC: solo los registros de backup */
+typedef struct { uint32_t reservado; } RTC_HandleTypeDef;
+extern RTC_HandleTypeDef hrtc;
+
+#define RTC_BKP_DR0   0x00u
+#define RTC_BKP_DR1   0x01u
+#define RTC_BKP_DR2   0x02u
+#define RTC_BKP_DR3   0x03u
+#define RTC_BKP_DR4   0x04u
+#define RTC_BKP_DR5   0x05u
+#define RTC_BKP_DR6   0x06u
+#define RTC_BKP_DR7   0x07u
+#define RTC_BKP_DR8   0x08u
+#define RTC_BKP_DR9   0x09u
+#define RTC_BKP_DR10  0x0Au
+#define RTC_BKP_DR11  0x0Bu
+#define RTC_BKP_DR12  0x0Cu
+#define RTC_BKP_DR13  0x0Du
+#define RTC_BKP_DR14  0x0Eu
+#define RTC_BKP_DR15  0x0Fu
+#define RTC_BKP_DR16  0x10u
+#define RTC_BKP_DR17  0x11u
+#define RTC_BKP_DR18  0x12u
+#define RTC_BKP_DR19  0x13u
+#define RTC_BKP_DR20  0x14u
+#define RTC_BKP_DR21  0x15u
+#define RTC_BKP_DR22  0x16u
+#define RTC_BKP_DR23  0x17u
+#define RTC_BKP_DR24  0x18u
+#define RTC_BKP_DR25  0x19u
+#define RTC_BKP_DR26  0x1Au
+#define RTC_BKP_DR27  0x1Bu
+#define RTC_BKP_DR28  0x1Cu
+#define RTC_BKP_DR29  0x1Du
+#define RTC_BKP_DR30  0x1Eu
+#define RTC_BKP_DR31  0x1Fu
+
+/* Mapa de registros de backup de main.h */
+#define BKP_PRIMERO_DNS       RTC_BKP_DR16
+#define BKP_PRIMERO_RFU       RTC_BKP_DR25
+#define BKP_SELLO_COMANDOS    RTC_BKP_DR30
+
+uint32_t HAL_GetTick(void);
+uint32_t HAL_RTCEx_BKUPRead(RTC_HandleTypeDef* hrtc, uint32_t registro);
+void HAL_RTCEx_BKUPWrite(RTC_HandleTypeDef* hrtc, uint32_t registro, uint32_t dato);
+
+/* Estado del "hardware" simulado, a disposición de las pruebas */
+extern uint32_t tick_anfitrion;				// valor de HAL_GetTick()
+extern uint32_t bkp_anfitrion[32];			// registros de backup del RTC
+extern bool consola_anfitrion;				// true: los msg_xxx() se imprimen en stdout
+
+#endif /* ANFITRION_H_ */
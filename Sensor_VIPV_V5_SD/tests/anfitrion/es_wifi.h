@@ -0,0 +1,16 @@
+/******************************************************************************
+* @file    es_wifi.h
+* @brief   Sustituto de Drivers/BSP/es_wifi.h para las pruebas en el PC: el
+* original arrastra CMSIS-RTOS y solo hacen falta el tamaño de la transacción y
+* los límites de es_wifi_conf.h que usan wifi.h y net_tcp_wifi.c.
+******************************************************************************
+*/
+
+#ifndef ES_WIFI_H_ANFITRION_
+#define ES_WIFI_H_ANFITRION_
+
+#define ES_WIFI_PAYLOAD_SIZE           1200		// El mismo que Drivers/BSP/es_wifi.h
+#define ES_WIFI_MAX_SSID_NAME_SIZE     32			// Los mismos que Application/Wifi/es_wifi_conf.h
+#define ES_WIFI_MAX_DETECTED_AP        10
+
+#endif /* ES_WIFI_H_ANFITRION_ */
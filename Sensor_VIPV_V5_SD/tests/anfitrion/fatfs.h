@@ -0,0 +1,45 @@
+/******************************************************************************
+* @file    fatfs.h
+* @brief   Sustituto de FATFS/App/fatfs.h para el PC: los tipos y la parte de
+* la API de FatFs (ff.h) que usan los módulos probados. Las funciones f_xxx()
+* las pone cada prueba que las necesite, normalmente sobre ficheros en memoria.
+******************************************************************************
+*/
+
+#ifndef FATFS_ANFITRION_H_
+#define FATFS_ANFITRION_H_
+
+#include <stdint.h>
+
+typedef unsigned int UINT;
+typedef uint8_t  BYTE;
+typedef uint32_t DWORD;
+
+typedef enum {
+	FR_OK = 0, FR_DISK_ERR, FR_INT_ERR, FR_NOT_READY, FR_NO_FILE, FR_NO_PATH, FR_INVALID_NAME, FR_DENIED,
+	FR_EXIST, FR_INVALID_OBJECT, FR_WRITE_PROTECTED, FR_INVALID_DRIVE, FR_NOT_ENABLED, FR_NO_FILESYSTEM,
+	FR_MKFS_ABORTED, FR_TIMEOUT, FR_LOCKED, FR_NOT_ENOUGH_CORE, FR_TOO_MANY_OPEN_FILES, FR_INVALID_PARAMETER
+} FRESULT;
+
+typedef struct { int montado; } FATFS;
+typedef struct { struct { DWORD objsize; } obj; int fichero; DWORD posicion; } FIL;
+
+#define f_size(fp)          ((fp)->obj.objsize)
+
+#define FA_READ             0x01
+#define FA_WRITE            0x02
+#define FA_OPEN_EXISTING    0x00
+#define FA_CREATE_NEW       0x04
+#define FA_CREATE_ALWAYS    0x08
+#define FA_OPEN_ALWAYS      0x10
+#define FA_OPEN_APPEND      0x30
+
+FRESULT f_mount(FATFS* fs, const char* ruta, BYTE opcion);
+FRESULT f_open(FIL* fp, const char* ruta, BYTE modo);
+FRESULT f_close(FIL* fp);
+FRESULT f_read(FIL* fp, void* buff, UINT btr, UINT* br);
+FRESULT f_write(FIL* fp, const void* buff, UINT btw, UINT* bw);
+FRESULT f_unlink(const char* ruta);
+FRESULT f_rename(const char* antigua, const char* nueva);
+
+#endif /* FATFS_ANFITRION_H_ */
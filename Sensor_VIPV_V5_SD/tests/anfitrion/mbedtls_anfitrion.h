@@ -0,0 +1,11 @@
+/******************************************************************************
+* @file    mbedtls_anfitrion.h
+* @brief   Añadidos a genmqtt_mbedtls_config.h (MBEDTLS_USER_CONFIG_FILE) para
+* la prueba de TLS: el servidor con tickets de sesión y los certificados de
+* prueba de mbedTLS, en el mismo proceso que el cliente del firmware.
+******************************************************************************
+*/
+
+#define MBEDTLS_SSL_SRV_C
+#define MBEDTLS_SSL_TICKET_C
+#define MBEDTLS_CERTS_C
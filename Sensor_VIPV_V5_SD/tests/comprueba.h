@@ -0,0 +1,29 @@
+/******************************************************************************
+* @file    comprueba.h
+* @brief   Comprobaciones de las pruebas en el PC. Cada fallo se imprime con su
+* línea y la prueba termina con código 1 si alguno ha fallado.
+******************************************************************************
+*/
+
+#ifndef COMPRUEBA_H_
+#define COMPRUEBA_H_
+
+#include <stdio.h>
+
+static int n_comprobaciones = 0;
+static int n_fallos = 0;
+
+#define COMPRUEBA(cond) do { \
+		n_comprobaciones++; \
+		if (!(cond)) { n_fallos++; printf("%s:%d: falla %s\n", __FILE__, __LINE__, #cond); } \
+	} while (0)
+
+#define COMPRUEBA_CERCA(a, b, tol)  COMPRUEBA(fabs((double)(a) - (double)(b)) <= (tol))
+
+static inline int fin_Pruebas(const char* nombre)
+{
+	printf("%-24s %4d comprobaciones, %d fallos\n", nombre, n_comprobaciones, n_fallos);
+	return (n_fallos == 0) ? 0 : 1;
+}
+
+#endif /* COMPRUEBA_H_ */
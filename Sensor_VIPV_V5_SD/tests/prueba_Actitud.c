@@ -0,0 +1,106 @@
+/******************************************************************************
+* @file    prueba_Actitud.c
+* @brief   Acumulador de actitud (Actitud_MEMS.h): media de cuaterniones con
+* alineación de signo, rumbo que cruza 359º-1º, fusión por segundos y
+* dispersión circular.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+#include "Actitud_MEMS.h"
+
+/* Euler Z-Y-X en grados a cuaternion (x, y, z, w), el convenio de Motion-FX */
+static void euler_Cuaternion(float roll, float pitch, float yaw, float q[4])
+{
+	double r = deg2rad(roll) / 2, p = deg2rad(pitch) / 2, y = deg2rad(yaw) / 2;
+
+	q[QW] = cos(r)*cos(p)*cos(y) + sin(r)*sin(p)*sin(y);
+	q[QX] = sin(r)*cos(p)*cos(y) - cos(r)*sin(p)*sin(y);
+	q[QY] = cos(r)*sin(p)*cos(y) + sin(r)*cos(p)*sin(y);
+	q[QZ] = cos(r)*cos(p)*sin(y) - sin(r)*sin(p)*cos(y);
+}
+
+/* Distancia angular entre dos rumbos, en [0, 180] */
+static float dif_Rumbo(float a, float b)
+{
+	float d = fmodf(fabsf(a - b), 360.0f);
+	return (d > 180.0f) ? 360.0f - d : d;
+}
+
+int main(void)
+{
+	acumuladorActitud acc, seg, ventana;
+	float q[4], roll, pitch, yaw, disp;
+	float r2, p2, y2, d2;
+
+	/* Orientación constante: la media es la propia orientación, sin dispersión */
+	const float casos[][3] = { {5, -3, 1}, {-30, 20, 90}, {10, -20, 180.5f}, {0, 0, 359.5f}, {170, 45, 270} };
+	for (unsigned i = 0; i < sizeof(casos) / sizeof(casos[0]); i++) {
+		reinicia_Actitud(&acc);
+		euler_Cuaternion(casos[i][0], casos[i][1], casos[i][2], q);
+		for (int k = 0; k < 50; k++) acumula_Actitud(&acc, q);
+		COMPRUEBA(media_Actitud(&acc, &roll, &pitch, &yaw, &disp));
+		COMPRUEBA_CERCA(roll, casos[i][0], 0.01);
+		COMPRUEBA_CERCA(pitch, casos[i][1], 0.01);
+		COMPRUEBA(dif_Rumbo(yaw, casos[i][2]) < 0.01f);
+		COMPRUEBA(yaw >= 0.0f && yaw < 360.0f);
+		COMPRUEBA(disp < 0.1f);
+	}
+
+	/* Guiñada alternando 359º y 1º: la media escalar daría 180º, la circular 0º. Un tercio de las
+	 * muestras llega con el signo cambiado (q y -q son la misma rotación) y no debe cancelar la suma. */
+	reinicia_Actitud(&acc);
+	for (int i = 0; i < 50; i++) {
+		euler_Cuaternion(5, -3, (i % 2) ? 359.0f : 1.0f, q);
+		if (i % 3 == 0) for (int k = 0; k < 4; k++) q[k] = -q[k];
+		acumula_Actitud(&acc, q);
+	}
+	COMPRUEBA(media_Actitud(&acc, &roll, &pitch, &yaw, &disp));
+	COMPRUEBA(dif_Rumbo(yaw, 0.0f) < 0.05f);
+	COMPRUEBA_CERCA(roll, 5.0, 0.05);
+	COMPRUEBA_CERCA(pitch, -3.0, 0.05);
+	COMPRUEBA_CERCA(disp, 1.0, 0.05);		// desviación circular de ±1º
+
+	/* Fusionar los acumulados de cada segundo equivale a acumular todas las muestras */
+	reinicia_Actitud(&acc);
+	reinicia_Actitud(&ventana);
+	for (int s = 0; s < 10; s++) {
+		reinicia_Actitud(&seg);
+		for (int k = 0; k < 25; k++) {
+			euler_Cuaternion(2.0f * sinf(0.1f * k), 1.0f, 350.0f + 2.0f * s + 0.1f * k, q);
+			if ((s + k) % 4 == 0) for (int j = 0; j < 4; j++) q[j] = -q[j];
+			acumula_Actitud(&seg, q);
+			acumula_Actitud(&acc, q);
+		}
+		fusiona_Actitud(&ventana, &seg);
+	}
+	COMPRUEBA(ventana.n_muestras == 250);
+	COMPRUEBA(media_Actitud(&acc, &roll, &pitch, &yaw, &disp));
+	COMPRUEBA(media_Actitud(&ventana, &r2, &p2, &y2, &d2));
+	COMPRUEBA_CERCA(roll, r2, 0.01);
+	COMPRUEBA_CERCA(pitch, p2, 0.01);
+	COMPRUEBA(dif_Rumbo(yaw, y2) < 0.01f);
+	COMPRUEBA_CERCA(disp, d2, 0.01);
+	COMPRUEBA(dif_Rumbo(yaw, 0.0f) < 1.0f);		// rumbos de 350º a 9.4º: media en torno a 0º
+
+	/* Rumbos opuestos a partes iguales: la dispersión satura en 180º */
+	reinicia_Actitud(&acc);
+	for (int i = 0; i < 10; i++) {
+		euler_Cuaternion(0, 0, (i % 2) ? 90.0f : 270.0f, q);
+		acumula_Actitud(&acc, q);
+	}
+	COMPRUEBA(media_Actitud(&acc, &roll, &pitch, &yaw, &disp));
+	COMPRUEBA(disp == 180.0f);
+
+	/* Sin muestras no hay media y los resultados no se tocan; fusionar un acumulador vacío no cambia nada */
+	reinicia_Actitud(&acc);
+	roll = pitch = yaw = disp = 12.5f;
+	COMPRUEBA(!media_Actitud(&acc, &roll, &pitch, &yaw, &disp));
+	COMPRUEBA(roll == 12.5f && pitch == 12.5f && yaw == 12.5f && disp == 12.5f);
+	seg = ventana;
+	fusiona_Actitud(&ventana, &acc);
+	COMPRUEBA(memcmp(&seg, &ventana, sizeof(seg)) == 0);
+	COMPRUEBA(media_Actitud(&ventana, &roll, &pitch, &yaw, NULL));
+
+	return fin_Pruebas("Actitud_MEMS");
+}
@@ -0,0 +1,172 @@
+/******************************************************************************
+* @file    prueba_Arranque.c
+* @brief   Tiempo hasta la primera muestra y lecturas perdidas en el arranque:
+* el orden de bucle_Principal() (lectura pendiente primero, un paso de la red
+* de Gestor_Conectividad.h solo sin lecturas pendientes y tras la primera
+* muestra) con el LPTIM1 disparando cada segundo mientras un paso retiene el
+* bucle, frente a la puesta en marcha bloqueante anterior (platform_init() con
+* hasta 17 WIFI_Connect antes de arrancar los temporizadores). Los pasos de la
+* red cuestan lo supuesto abajo; lo que se comprueba no depende del valor
+* exacto, solo de que la asociación dure varios periodos de lectura.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+#include "Gestor_Conectividad.h"
+
+#define PERIODO_LECTURA_MS  1000	// PERIODO_LECTURA_DATOS
+#define T_RECABAR_MS        5		// recabar_Datos() y el resto de la lectura
+#define T_SCAN_MS           2500
+#define T_ASOCIA_MS         4000	// WIFI_Init + WIFI_Connect con los timeouts cortos
+#define T_REJOIN_MS         1500
+#define T_IP_MS             20
+#define T_HORA_MS           300
+#define T_TLS_MS            1500
+#define T_MQTT_MS           600
+#define INTENTOS_CONNECT    17		// los de net_if_init() antes del arranque en segundo plano
+#define NUNCA               0xFFFFFFFFU
+
+/* ---- LPTIM1 y lectura, como HAL_LPTIM_CompareMatchCallback() y hilo1_Lectura() ---- */
+
+static bool flag_lectura_datos, primera_Muestra;
+static uint32_t lecturas_Perdidas, n_muestras, n_disparos, t_primera, t_lptim;
+
+static void avanza(uint32_t ms)
+{
+	while (ms--) {
+		tick_anfitrion++;
+		if (tick_anfitrion - t_lptim >= PERIODO_LECTURA_MS) {
+			t_lptim += PERIODO_LECTURA_MS;
+			n_disparos++;
+			if (flag_lectura_datos) lecturas_Perdidas++;
+			flag_lectura_datos = true;
+		}
+	}
+}
+
+static void arranca_Temporizadores(void)
+{
+	t_lptim = tick_anfitrion;
+	flag_lectura_datos = false;
+	primera_Muestra = true;
+	lecturas_Perdidas = n_muestras = n_disparos = 0;
+	t_primera = NUNCA;
+}
+
+static void lee(void)
+{
+	avanza(T_RECABAR_MS);
+	n_muestras++;
+	if (primera_Muestra) {
+		primera_Muestra = false;
+		t_primera = tick_anfitrion;
+	}
+	flag_lectura_datos = false;
+}
+
+/* ---- Red: un AP que aparece en t_AP, cada acción retiene el bucle lo que dura ---- */
+
+static uint32_t t_AP;
+static bool sesion;
+
+static bool hay_AP(void) { return (int32_t)(tick_anfitrion - t_AP) >= 0; }
+
+static bool a_Localiza(cacheAP* ap)
+{
+	avanza(T_SCAN_MS);
+	memset(ap, 0, sizeof(*ap));
+	ap->canal = 6;
+	ap->rssi = -60;
+	return hay_AP();
+}
+
+static bool a_Asocia(bool rapido) { avanza(rapido ? T_REJOIN_MS : T_ASOCIA_MS); return hay_AP(); }
+static bool a_IP(void) { avanza(T_IP_MS); return hay_AP(); }
+static bool a_Hora(void) { avanza(T_HORA_MS); return true; }
+static bool a_Socket(void) { avanza(T_TLS_MS); return hay_AP(); }
+static bool a_MQTT(void) { avanza(T_MQTT_MS); sesion = hay_AP(); return sesion; }
+static bool a_Enlazada(void) { return sesion; }
+static void a_Cierra(void) { sesion = false; }
+
+static const accionesRed acciones = { a_Localiza, a_Asocia, a_IP, a_Hora, a_Socket, a_MQTT, a_Enlazada, a_Cierra };
+static gestorRed red;
+
+/* bucle_Principal() hasta 'fin'; espera_primera como el firmware: la red no da pasos antes de la primera muestra.
+ * Devuelve el tick en que se enlazó, o NUNCA */
+static uint32_t bucle(uint32_t fin, bool espera_primera)
+{
+	uint32_t t_enlace = NUNCA;
+
+	while ((int32_t)(tick_anfitrion - fin) < 0) {
+		if (flag_lectura_datos) lee();
+		if ( !flag_lectura_datos && !(espera_primera && primera_Muestra) ) {
+			servicio_GestorRed(&red);
+			if ( (red.fase == RED_ENLAZADA) && (t_enlace == NUNCA) ) t_enlace = tick_anfitrion;
+		}
+		avanza(1);
+	}
+	return t_enlace;
+}
+
+/* Arranque en segundo plano desde el reset (tick 0) durante 'duracion' ms */
+static uint32_t arranque_SegundoPlano(uint32_t ap_desde, uint32_t duracion, bool espera_primera)
+{
+	tick_anfitrion = 0;
+	t_AP = ap_desde;
+	sesion = false;
+	inicia_GestorRed(&red, &acciones, true, 0x1234567U);
+	arranca_Temporizadores();
+	return bucle(duracion, espera_primera);
+}
+
+/* Arranque anterior: la red entera antes de los temporizadores. Sin AP en los 17 intentos, CLOUD_Error_Handler()
+ * reinicia la placa y vuelta a empezar. Devuelve el tick de la primera muestra, o NUNCA. */
+static uint32_t arranque_Bloqueante(uint32_t ap_desde, uint32_t duracion)
+{
+	int i;
+
+	tick_anfitrion = 0;
+	t_AP = ap_desde;
+	while ((int32_t)(tick_anfitrion - duracion) < 0) {
+		for (i = 0; (i < INTENTOS_CONNECT) && !a_Asocia(false); i++) { }
+		if (i == INTENTOS_CONNECT) continue;		// reset
+		a_IP(); a_Hora(); a_Socket(); a_MQTT();
+		return tick_anfitrion + PERIODO_LECTURA_MS;
+	}
+	return NUNCA;
+}
+
+int main(void)
+{
+	uint32_t t_enlace, antes, sin_espera, pasos;
+
+	consola_anfitrion = false;
+
+	/* Con el AP a la vista desde el reset */
+	antes = arranque_Bloqueante(0, 60000);
+	arranque_SegundoPlano(0, 60000, false);
+	sin_espera = t_primera;
+	t_enlace = arranque_SegundoPlano(0, 60000, true);
+	COMPRUEBA(antes >= T_ASOCIA_MS + T_TLS_MS + T_MQTT_MS + PERIODO_LECTURA_MS);
+	COMPRUEBA(sin_espera >= T_ASOCIA_MS);				// la asociación, el primer paso, retenía la primera muestra
+	COMPRUEBA(t_primera <= PERIODO_LECTURA_MS + T_RECABAR_MS);
+	COMPRUEBA(t_enlace != NUNCA && t_enlace < PERIODO_LECTURA_MS + 2 * T_ASOCIA_MS + T_TLS_MS + T_MQTT_MS);
+	COMPRUEBA(n_muestras + lecturas_Perdidas + flag_lectura_datos == n_disparos);	// cada disparo, leído o perdido
+	pasos = T_ASOCIA_MS + T_IP_MS + T_HORA_MS + T_TLS_MS + T_MQTT_MS;
+	COMPRUEBA(lecturas_Perdidas <= pasos / PERIODO_LECTURA_MS);	// solo las que caen dentro de un paso
+	printf("AP a la vista: primera muestra a %u ms (antes %u ms, sin esperarla %u ms), enlazada a %u ms, %u lecturas perdidas\n",
+		   (unsigned)t_primera, (unsigned)antes, (unsigned)sin_espera, (unsigned)t_enlace, (unsigned)lecturas_Perdidas);
+
+	/* Sin cobertura los primeros 10 min: antes, reinicios hasta que aparece el AP; ahora se muestrea desde el primer segundo */
+	antes = arranque_Bloqueante(600000, 900000);
+	t_enlace = arranque_SegundoPlano(600000, 900000, true);
+	COMPRUEBA(antes > 600000);
+	COMPRUEBA(t_primera <= PERIODO_LECTURA_MS + T_RECABAR_MS);
+	COMPRUEBA(t_enlace != NUNCA && t_enlace < 600000 + ESPERA_MAX_RED_MS + 2 * T_ASOCIA_MS + T_SCAN_MS + T_TLS_MS + T_MQTT_MS);
+	COMPRUEBA(n_muestras + lecturas_Perdidas + flag_lectura_datos == n_disparos);	// cada disparo, leído o perdido
+	COMPRUEBA(lecturas_Perdidas * 20 < n_disparos);		// los pasos de la red retienen el bucle menos del 5 %
+	printf("Sin cobertura 10 min: primera muestra a %u ms (antes %u ms), enlazada a %u ms, %u de %u lecturas perdidas\n",
+		   (unsigned)t_primera, (unsigned)antes, (unsigned)t_enlace, (unsigned)lecturas_Perdidas, (unsigned)n_disparos);
+
+	return fin_Pruebas("Arranque");
+}
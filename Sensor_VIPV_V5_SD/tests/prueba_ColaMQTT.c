@@ -0,0 +1,373 @@
+/******************************************************************************
+* @file    prueba_ColaMQTT.c
+* @brief   Cola de publicaciones MQTT (ColaMQTT.h) sobre el cliente Paho real:
+* agrupación en una transacción, ventana de QoS 1, PUBACK fuera de orden y
+* repetidos, vencimiento del PUBACK, reenvío con DUP al reanudar, escrituras
+* parciales y, al final, un enlace con cortes en el que QoS 1 no pierde nada.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+#include "ColaMQTT.h"
+
+#define READ_BUFFER_SIZE  448		// MQTT_READ_BUFFER_SIZE de GenericMQTT.h
+
+/* ---- Red con guion: lo escrito se acumula, lo leido sale de una cola ---- */
+
+static uint8_t al_broker[16384], al_cliente[1024];
+static int n_broker = 0, n_cliente = 0, i_cliente = 0;
+static int n_escrituras = 0, limite_escritura = 0;		// 0: sin límite
+
+static int escribe_Guion(Network* n, unsigned char* b, int len, int to)
+{
+	(void)n; (void)to;
+	n_escrituras++;
+	if ( (limite_escritura > 0) && (len > limite_escritura) ) len = limite_escritura;
+	memcpy(&al_broker[n_broker], b, (size_t)len);
+	n_broker += len;
+	return len;
+}
+
+static int lee_Guion(Network* n, unsigned char* b, int len, int to)
+{
+	(void)n; (void)to;
+	if (n_cliente - i_cliente < len) return 0;
+	memcpy(b, &al_cliente[i_cliente], (size_t)len);
+	i_cliente += len;
+	return len;
+}
+
+static void puback(uint16_t id)
+{
+	uint8_t p[4] = { 0x40, 0x02, (uint8_t)(id >> 8), (uint8_t)id };
+	memcpy(&al_cliente[n_cliente], p, 4);
+	n_cliente += 4;
+}
+
+/* PUBLISH escritos desde 'desde': identificadores y bit DUP, en orden */
+static int publicados(int desde, uint16_t* ids, bool* dup)
+{
+	int n = 0, i = desde;
+
+	while (i < n_broker) {
+		int rem = 0, mul = 1, k = 1;
+		uint8_t b;
+		do { b = al_broker[i + k++]; rem += (b & 127) * mul; mul *= 128; } while (b & 128);
+		if ((al_broker[i] >> 4) == PUBLISH) {
+			const uint8_t* p = &al_broker[i + k];
+			int largo_tema = (p[0] << 8) | p[1];
+			ids[n] = ((al_broker[i] >> 1) & 3) ? (uint16_t)((p[2 + largo_tema] << 8) | p[3 + largo_tema]) : 0;
+			dup[n] = (al_broker[i] & MQTT_FLAG_DUP) != 0;
+			n++;
+		}
+		i += k + rem;
+	}
+	return n;
+}
+
+/* Pasadas del bucle principal durante 'ms' */
+static int sirve(colaMQTT* cola, MQTTClient* c, uint32_t ms)
+{
+	int hechos = 0, rc;
+
+	for (uint32_t t = 0; t < ms; t++) {
+		rc = servicio_ColaMQTT(cola, c);
+		if (rc < 0) return rc;
+		hechos += rc;
+		tick_anfitrion++;
+	}
+	return hechos;
+}
+
+static void pruebas_Guion(void)
+{
+	static MQTTClient c;
+	static Network red = { NULL, lee_Guion, escribe_Guion };
+	static unsigned char sbuf[600], rbuf[READ_BUFFER_SIZE];
+	static colaMQTT cola;
+	uint16_t ids[32];
+	bool dup[32];
+	int marca, rc;
+
+	tick_anfitrion = 1000;
+	MQTTClientInit(&c, &red, 5000, sbuf, sizeof(sbuf), rbuf, sizeof(rbuf));
+	c.isconnected = 1;
+	c.keepAliveInterval = 0;
+	inicia_ColaMQTT(&cola);
+
+	/* QoS 0: tres publicaciones en una sola transacción, huecos libres en cuanto salen */
+	reanuda_ColaMQTT(&cola, false);
+	for (int i = 0; i < 3; i++) COMPRUEBA(encola_PublicacionMQTT(&cola, &c, "vipv/t", "hola") == MQSUCCESS);
+	COMPRUEBA(huecos_LibresColaMQTT(&cola) == COLA_MQTT_HUECOS - 3);
+	COMPRUEBA(sirve(&cola, &c, 5) == 0);			// sin descarga pedida ni cola llena, no sale nada
+	descarga_ColaMQTT(&cola);
+	COMPRUEBA(sirve(&cola, &c, 5) == 3);
+	COMPRUEBA(n_escrituras == 1 && publicados(0, ids, dup) == 3 && ids[0] == 0);
+	COMPRUEBA(huecos_LibresColaMQTT(&cola) == COLA_MQTT_HUECOS);
+
+	/* QoS 1: la cola llena rechaza el séptimo; salen COLA_MQTT_VENTANA_QOS1 y el resto espera */
+	reanuda_ColaMQTT(&cola, true);
+	cola.etiqueta = 1;
+	for (int i = 0; i < 3; i++) encola_PublicacionMQTT(&cola, &c, "vipv/t", "uno");
+	cola.etiqueta = 2;
+	for (int i = 0; i < 3; i++) encola_PublicacionMQTT(&cola, &c, "vipv/t", "dos");
+	COMPRUEBA(huecos_LibresColaMQTT(&cola) == 0);
+	COMPRUEBA(encola_PublicacionMQTT(&cola, &c, "vipv/t", "tres") == FAILURE);
+	marca = n_broker;
+	COMPRUEBA(sirve(&cola, &c, 10) == 0);			// cola llena: sale sin descarga
+	COMPRUEBA(publicados(marca, ids, dup) == COLA_MQTT_VENTANA_QOS1);
+	COMPRUEBA(ids[0] == 1 && ids[3] == 4 && !dup[0]);
+	COMPRUEBA(cola.n_en_vuelo == COLA_MQTT_VENTANA_QOS1 && cola.n_pendientes == 2);
+	COMPRUEBA(huecos_LibresColaMQTT(&cola) == 0);	// en vuelo ocupan hueco hasta el PUBACK
+	COMPRUEBA(huecos_EtiquetaColaMQTT(&cola, 1) == 3 && huecos_EtiquetaColaMQTT(&cola, 2) == 3);
+
+	/* PUBACK fuera de orden: el 2 se anota pero no libera nada hasta el 1; un repetido se ignora */
+	puback(2);
+	COMPRUEBA(sirve(&cola, &c, PERIODO_SONDEO_ACK_MS + 1) == 1);
+	COMPRUEBA(cola.n_en_vuelo == 4 && huecos_LibresColaMQTT(&cola) == 0);
+	puback(1);
+	puback(1);
+	COMPRUEBA(sirve(&cola, &c, PERIODO_SONDEO_ACK_MS + 1) == 1);
+	COMPRUEBA(cola.n_confirmados == 2);
+	COMPRUEBA(cola.n_en_vuelo == 2 && cola.n_pendientes == 2 && huecos_LibresColaMQTT(&cola) == 2);
+	COMPRUEBA(huecos_EtiquetaColaMQTT(&cola, 1) == 1);
+	marca = n_broker;
+	descarga_ColaMQTT(&cola);						// la ventana libre deja pasar a 5 y 6
+	sirve(&cola, &c, 5);
+	COMPRUEBA(publicados(marca, ids, dup) == 2 && ids[0] == 5 && ids[1] == 6 && cola.n_en_vuelo == 4);
+
+	/* Sin el PUBACK del 3 en COLA_MQTT_T_ACK_MS la conexión se da por caida */
+	rc = sirve(&cola, &c, COLA_MQTT_T_ACK_MS + PERIODO_SONDEO_ACK_MS + 10);
+	COMPRUEBA(rc == FAILURE && !c.isconnected);
+
+	/* Al reanudar, los que estaban en vuelo salen los primeros, con DUP y su identificador */
+	c.isconnected = 1;
+	reanuda_ColaMQTT(&cola, true);
+	COMPRUEBA(cola.n_reenvios == 4 && cola.n_en_vuelo == 0 && cola.n_pendientes == 4);
+	marca = n_broker;
+	sirve(&cola, &c, 5);
+	COMPRUEBA(publicados(marca, ids, dup) == 4);
+	COMPRUEBA(ids[0] == 3 && ids[1] == 4 && ids[2] == 5 && ids[3] == 6 && dup[0] && dup[3]);
+	puback(3); puback(4); puback(5); puback(6);
+	COMPRUEBA(sirve(&cola, &c, PERIODO_SONDEO_ACK_MS + 1) == 4);
+	COMPRUEBA(huecos_LibresColaMQTT(&cola) == COLA_MQTT_HUECOS);
+	COMPRUEBA(huecos_EtiquetaColaMQTT(&cola, 1) == 0 && huecos_EtiquetaColaMQTT(&cola, 2) == 0);
+
+	/* Escritura parcial: la trama termina en varias pasadas, sin repetir bytes */
+	limite_escritura = 7;
+	marca = n_broker;
+	encola_PublicacionMQTT(&cola, &c, "vipv/t", "una carga algo mas larga que siete bytes");
+	descarga_ColaMQTT(&cola);
+	sirve(&cola, &c, 20);
+	COMPRUEBA(publicados(marca, ids, dup) == 1 && ids[0] == 7 && cola.trama_longitud == 0);
+	limite_escritura = 0;
+
+	/* El identificador da la vuelta saltándose el 0 */
+	cola.ultimo_id = 0xFFFF;
+	puback(7);
+	sirve(&cola, &c, PERIODO_SONDEO_ACK_MS + 1);
+	encola_PublicacionMQTT(&cola, &c, "vipv/t", "x");
+	COMPRUEBA(cola.hueco[(cola.cabeza + cola.n_pendientes - 1) % COLA_MQTT_HUECOS].id_paquete == 1);
+
+	/* Desconectado no se encola */
+	c.isconnected = 0;
+	COMPRUEBA(encola_PublicacionMQTT(&cola, &c, "vipv/t", "x") == FAILURE);
+}
+
+/* ---- Enlace con cortes y un broker en el mismo proceso ----
+ * Cada llamada al socket cuesta tiempo como una transacción SPI del ES-WiFi. Un corte descarta lo que
+ * está en tránsito en los dos sentidos; una escritura alcanzada por el corte se acepta pero solo llega
+ * un prefijo. */
+
+#define MAXQ    512
+#define MAXMSG  1000
+typedef struct { uint32_t llegada; uint16_t len; uint8_t d[1300]; } unidad;
+static unidad aC[MAXQ], aB[MAXQ];
+static int acI, acN, acOff, abI, abN;
+static bool vivo;
+static double p_corte;
+static const uint32_t latencia = 20;
+static uint8_t bbuf[8192];
+static int bn;
+static int recibidos[MAXMSG];
+
+static double azar(void) { return rand() / (RAND_MAX + 1.0); }
+static void corta(void) { vivo = false; acN = 0; abN = 0; acOff = 0; bn = 0; }
+
+static void a_Cliente(const uint8_t* d, int n)
+{
+	unidad* u = &aC[(acI + acN++) % MAXQ];
+	u->llegada = tick_anfitrion + latencia;
+	u->len = (uint16_t)n;
+	memcpy(u->d, d, (size_t)n);
+}
+
+static void broker(void)
+{
+	int i = 0;
+
+	for (;;) {
+		if (bn - i < 2) break;
+		int rem = 0, mul = 1, k = 1;
+		uint8_t b;
+		do { if (i + k >= bn) goto fin; b = bbuf[i + k++]; rem += (b & 127) * mul; mul *= 128; } while (b & 128);
+		if (i + k + rem > bn) break;
+		uint8_t tipo = bbuf[i] >> 4, qos = (bbuf[i] >> 1) & 3;
+		uint8_t* p = &bbuf[i + k];
+		if (tipo == CONNECT) { uint8_t r[4] = { 0x20, 2, 0, 0 }; a_Cliente(r, 4); }
+		else if (tipo == PUBLISH) {
+			int largo_tema = (p[0] << 8) | p[1], o = 2 + largo_tema, id = 0;
+			unsigned sec = 0;
+			if (qos) { id = (p[o] << 8) | p[o + 1]; o += 2; }
+			if ( (sscanf((char*)&p[o], "sec=%u", &sec) == 1) && (sec < MAXMSG) ) recibidos[sec]++;
+			if (qos == 1) { uint8_t r[4] = { 0x40, 2, (uint8_t)(id >> 8), (uint8_t)id }; a_Cliente(r, 4); }
+		}
+		else if (tipo == PINGREQ) { uint8_t r[2] = { 0xD0, 0 }; a_Cliente(r, 2); }
+		i += k + rem;
+	}
+fin:
+	memmove(bbuf, bbuf + i, (size_t)(bn - i));
+	bn -= i;
+}
+
+static void avanza(uint32_t ms)
+{
+	while (ms--) {
+		tick_anfitrion++;
+		while ( (abN > 0) && (aB[abI].llegada <= tick_anfitrion) ) {
+			memcpy(bbuf + bn, aB[abI].d, aB[abI].len);
+			bn += aB[abI].len;
+			abI = (abI + 1) % MAXQ;
+			abN--;
+			broker();
+		}
+	}
+}
+
+static int escribe_Enlace(Network* n, unsigned char* b, int len, int to)
+{
+	bool cae = azar() < p_corte;
+	int k = len;
+	(void)n; (void)to;
+
+	avanza(2 + (uint32_t)len / 2000);
+	if (!vivo) return -1;
+	if (cae) k = rand() % (len + 1);
+	unidad* u = &aB[(abI + abN++) % MAXQ];
+	u->llegada = tick_anfitrion + latencia;
+	u->len = (uint16_t)k;
+	memcpy(u->d, b, (size_t)k);
+	if (cae) { avanza(latencia + 1); corta(); }		// llega el prefijo y cae la conexión
+	return len;
+}
+
+static int lee_Enlace(Network* n, unsigned char* b, int len, int to)
+{
+	(void)n; (void)to;
+	avanza(1);
+	if (!vivo) return -1;
+	if ( (acN == 0) || (aC[acI].llegada > tick_anfitrion) ) return 0;
+	unidad* u = &aC[acI];
+	int k = u->len - acOff;
+	if (k > len) k = len;
+	memcpy(b, u->d + acOff, (size_t)k);
+	acOff += k;
+	if (acOff == u->len) { acOff = 0; acI = (acI + 1) % MAXQ; acN--; }
+	return k;
+}
+
+static MQTTClient ce;
+static Network enlace = { NULL, lee_Enlace, escribe_Enlace };
+static colaMQTT cola_e;
+static unsigned char sbuf_e[600], rbuf_e[READ_BUFFER_SIZE];
+
+static bool conecta(bool qos1)
+{
+	MQTTPacket_connectData o = MQTTPacket_connectData_initializer;
+
+	vivo = true;
+	acN = abN = acOff = bn = 0;
+	MQTTClientInit(&ce, &enlace, 5000, sbuf_e, sizeof(sbuf_e), rbuf_e, sizeof(rbuf_e));
+	o.clientID.cstring = "vipv";
+	o.keepAliveInterval = 60;
+	o.cleansession = 1;
+	if (MQTTConnect(&ce, &o) != 0) { corta(); return false; }
+	reanuda_ColaMQTT(&cola_e, qos1);
+	return true;
+}
+
+/* n mensajes de 500 B, uno cada 2 s. Devuelve los perdidos; duplicados y cortes por puntero. */
+static int enlace_ConCortes(bool qos1, int n, double p, unsigned semilla, int* duplicados, int* cortes_vistos)
+{
+	static char msg[600];
+	int producidos = 0, siguiente = 0, perdidos = 0, reconexiones = 0;
+	uint32_t t_prod, t_recon = 0, t0;
+	bool conectado;
+
+	srand(semilla);
+	tick_anfitrion = 1000;
+	memset(recibidos, 0, sizeof(recibidos));
+	inicia_ColaMQTT(&cola_e);
+	p_corte = 0;
+	conectado = conecta(qos1);
+	p_corte = p;
+	t_prod = t0 = tick_anfitrion;
+	while (tick_anfitrion - t0 < 24U * 3600U * 1000U) {
+		if ( (producidos < n) && (tick_anfitrion >= t_prod) ) { producidos++; t_prod += 2000; }
+		if (!conectado) {
+			if (tick_anfitrion >= t_recon) {
+				conectado = conecta(qos1);
+				reconexiones++;
+				if (!conectado) t_recon = tick_anfitrion + 2000;
+			}
+		}
+		else {
+			bool nuevo = false;
+			while ( (siguiente < producidos) && (huecos_LibresColaMQTT(&cola_e) > 0) ) {
+				snprintf(msg, sizeof(msg), "sec=%u&", (unsigned)siguiente);
+				memset(msg + strlen(msg), 'x', 500 - strlen(msg));
+				msg[500] = 0;
+				if (encola_PublicacionMQTT(&cola_e, &ce, "vipv/t", msg) != MQSUCCESS) break;
+				siguiente++;
+				nuevo = true;
+			}
+			if (nuevo) descarga_ColaMQTT(&cola_e);
+			if (servicio_ColaMQTT(&cola_e, &ce) < 0) {
+				conectado = false;
+				if (vivo) corta();
+				t_recon = tick_anfitrion + 2000;
+			}
+		}
+		if ( (producidos == n) && (siguiente == n) && (cola_e.n_pendientes == 0) && (cola_e.n_en_vuelo == 0)
+			 && (cola_e.trama_longitud == 0) ) break;
+		avanza(1);
+	}
+	avanza(latencia * 2 + 5);
+	*duplicados = 0;
+	for (int s = 0; s < n; s++) {
+		if (recibidos[s] == 0) perdidos++;
+		else *duplicados += recibidos[s] - 1;
+	}
+	*cortes_vistos = reconexiones;
+	return perdidos;
+}
+
+int main(void)
+{
+	int perdidos, duplicados, cortes;
+
+	pruebas_Guion();
+
+	/* Sin cortes no se pierde ni se duplica nada con ningún QoS */
+	COMPRUEBA(enlace_ConCortes(false, 300, 0.0, 3, &duplicados, &cortes) == 0 && duplicados == 0 && cortes == 0);
+	COMPRUEBA(enlace_ConCortes(true, 300, 0.0, 3, &duplicados, &cortes) == 0 && duplicados == 0 && cortes == 0);
+
+	/* Un corte en el 10 % de las escrituras: QoS 0 pierde lo que iba en la trama cortada, QoS 1 lo reenvía */
+	perdidos = enlace_ConCortes(false, 1000, 0.10, 7, &duplicados, &cortes);
+	COMPRUEBA(perdidos > 0 && cortes > 0);
+	perdidos = enlace_ConCortes(true, 1000, 0.10, 7, &duplicados, &cortes);
+	COMPRUEBA(perdidos == 0 && cortes > 0);
+	printf("QoS 1 con cortes: %d reconexiones, %d duplicados, 0 perdidos de 1000\n", cortes, duplicados);
+
+	return fin_Pruebas("ColaMQTT");
+}
@@ -0,0 +1,242 @@
+/******************************************************************************
+* @file    prueba_Comandos.c
+* @brief   Canal de comandos remotos (Comandos_Remotos.h): HMAC-SHA256 contra los
+* vectores del RFC 4231, validación de clave, formato, firma, plazo y repetición
+* del sello, fija_SelloMinimo(), buzón y cabecera de las respuestas.
+******************************************************************************
+*/
+
+#include <ctype.h>
+#include "comprueba.h"
+#include "Comandos_Remotos.h"
+
+#define CLAVE   "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff"
+#define AHORA   1700000000U					// RTC en segundos
+#define SELLO   (AHORA * 1000ULL)
+
+static canalComandos canal;
+
+static void hexadecimal(const uint8_t* b, size_t n, char* texto)
+{
+	for (size_t i = 0; i < n; i++) sprintf(&texto[2 * i], "%02x", b[i]);
+}
+
+/* Firma "<sello> <resto>" como lo haría el operador */
+static void firma(uint64_t sello, const char* resto, char texto[COMANDO_TAM_MAX + 1])
+{
+	char cuerpo[COMANDO_TAM_MAX];
+	uint8_t f[32];
+
+	snprintf(cuerpo, sizeof(cuerpo), "%llu %s", (unsigned long long)sello, resto);
+	firma_HMAC(canal.clave, canal.tam_clave, (const uint8_t*)cuerpo, strlen(cuerpo), f);
+	hexadecimal(f, sizeof(f), texto);
+	snprintf(&texto[COMANDO_FIRMA_HEX], COMANDO_TAM_MAX + 1 - COMANDO_FIRMA_HEX, " %s", cuerpo);
+}
+
+/* Lo firma y lo deja en el buzón */
+static void envia(uint64_t sello, const char* resto)
+{
+	char texto[COMANDO_TAM_MAX + 1];
+
+	firma(sello, resto, texto);
+	recibe_Comando(&canal, texto, strlen(texto));
+}
+
+static resultadoComando extrae(uint32_t ahora, comandoRemoto* cmd)
+{
+	return extrae_Comando(&canal, ahora, cmd);
+}
+
+static bool rechazado(uint32_t ahora, const char* motivo)
+{
+	comandoRemoto cmd;
+	return (extrae(ahora, &cmd) == COMANDO_RECHAZADO) && (strcmp(cmd.motivo, motivo) == 0);
+}
+
+static void pruebas_HMAC(void)
+{
+	/* RFC 4231, casos 1 a 4: el 5 trunca la salida y el 6 y el 7 usan claves mayores que el bloque */
+	static const struct { uint8_t clave[25]; uint8_t tam_clave; uint8_t dato; uint8_t n_datos; const char* texto; const char* hmac; } v[] = {
+		{ {[0 ... 19] = 0x0b}, 20, 0, 0, "Hi There",
+		  "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7" },
+		{ {'J', 'e', 'f', 'e'}, 4, 0, 0, "what do ya want for nothing?",
+		  "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843" },
+		{ {[0 ... 19] = 0xaa}, 20, 0xdd, 50, NULL,
+		  "773ea91e36800e46854db8ebd09181a72959098b3ef8c122d9635514ced565fe" },
+		{ {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25}, 25, 0xcd, 50, NULL,
+		  "82558a389a443c0ea4cc819899f2083a85f0faa3e578f8077a2e3ff46729665b" },
+	};
+	uint8_t datos[50], firma[32];
+	char texto[65];
+
+	for (size_t i = 0; i < sizeof(v) / sizeof(v[0]); i++) {
+		const uint8_t* d = (const uint8_t*)v[i].texto;
+		size_t n = (d != NULL) ? strlen(v[i].texto) : v[i].n_datos;
+
+		if (d == NULL) {
+			memset(datos, v[i].dato, sizeof(datos));
+			d = datos;
+		}
+		firma_HMAC(v[i].clave, v[i].tam_clave, d, n, firma);
+		hexadecimal(firma, sizeof(firma), texto);
+		COMPRUEBA(strcmp(texto, v[i].hmac) == 0);
+	}
+}
+
+static void pruebas_Clave(void)
+{
+	COMPRUEBA(!inicia_Comandos(&canal, NULL));
+	COMPRUEBA(!inicia_Comandos(&canal, "00112233445566778899aabbccddeef"));		// impar
+	COMPRUEBA(!inicia_Comandos(&canal, "00112233445566778899aabbccddee"));		// 15 bytes
+	COMPRUEBA(!inicia_Comandos(&canal, "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff00"));
+	COMPRUEBA(!inicia_Comandos(&canal, "00112233445566778899aabbccddeefg"));
+	COMPRUEBA(canal.tam_clave == 0 && !recibe_Comando(&canal, "x", 1) && canal.estadistica.recibidos == 0);
+	COMPRUEBA(inicia_Comandos(&canal, "00112233445566778899AABBCCDDEEFF") && canal.tam_clave == 16);
+	COMPRUEBA(inicia_Comandos(&canal, CLAVE) && canal.tam_clave == 32 && canal.clave[31] == 0xff);
+}
+
+static void pruebas_Validacion(void)
+{
+	comandoRemoto cmd;
+	char texto[COMANDO_TAM_MAX + 2];
+
+	inicia_Comandos(&canal, CLAVE);
+	COMPRUEBA(extrae(AHORA, &cmd) == COMANDO_NINGUNO);
+
+	/* Válidos, con y sin argumentos */
+	envia(SELLO, "get");
+	COMPRUEBA(extrae(AHORA, &cmd) == COMANDO_VALIDO && cmd.verbo == VERBO_GET && cmd.sello == SELLO);
+	COMPRUEBA(cmd.firmado && cmd.motivo == NULL && strcmp(cmd.argumentos, "") == 0);
+	envia(SELLO + 1, "set   {\"periodo\":60}");
+	COMPRUEBA(extrae(AHORA, &cmd) == COMANDO_VALIDO && cmd.verbo == VERBO_SET);
+	COMPRUEBA(strcmp(cmd.argumentos, "{\"periodo\":60}") == 0);
+
+	/* Repetición: el mismo sello o uno anterior, aunque estén bien firmados */
+	envia(SELLO + 1, "set   {\"periodo\":60}");
+	COMPRUEBA(rechazado(AHORA, "sello repetido"));
+	envia(SELLO, "reinicia");
+	COMPRUEBA(extrae(AHORA, &cmd) == COMANDO_RECHAZADO && cmd.firmado && cmd.sello == SELLO);
+
+	/* Plazo de COMANDO_DESFASE_S alrededor del RTC, bordes incluidos; sin hora se rechaza todo */
+	envia(SELLO + 2, "guarda");
+	COMPRUEBA(rechazado(0, "sin hora"));
+	envia((AHORA + COMANDO_DESFASE_S + 1) * 1000ULL, "guarda");
+	COMPRUEBA(rechazado(AHORA, "sello fuera de plazo"));
+	envia(SELLO + 3, "guarda");
+	COMPRUEBA(rechazado(AHORA + COMANDO_DESFASE_S + 1, "sello fuera de plazo"));
+	envia(SELLO + 4, "rafaga 10 100");
+	COMPRUEBA(extrae(AHORA + COMANDO_DESFASE_S, &cmd) == COMANDO_VALIDO && cmd.verbo == VERBO_RAFAGA);
+	envia((AHORA + COMANDO_DESFASE_S) * 1000ULL, "log 1 2");
+	COMPRUEBA(extrae(AHORA, &cmd) == COMANDO_VALIDO && cmd.verbo == VERBO_LOG && strcmp(cmd.argumentos, "1 2") == 0);
+
+	/* Un verbo desconocido bien firmado gasta su sello */
+	envia(canal.ultimo_sello + 1, "formatea");
+	COMPRUEBA(rechazado(AHORA, "verbo"));
+	envia(canal.ultimo_sello, "get");
+	COMPRUEBA(rechazado(AHORA, "sello repetido"));
+
+	/* Cualquier carácter cambiado en la firma o en el cuerpo invalida el comando, sin consumir el sello */
+	firma(canal.ultimo_sello + 1, "actualiza http://a/b 00", texto);
+	for (size_t i = 0; texto[i] != '\0'; i++) {
+		char copia[COMANDO_TAM_MAX + 1];
+		comandoRemoto r;
+
+		if ( (i == COMANDO_FIRMA_HEX) || (texto[i] == ' ') ) continue;
+		strcpy(copia, texto);
+		copia[i] = (copia[i] == '1') ? '2' : '1';
+		recibe_Comando(&canal, copia, strlen(copia));
+		if ( (extrae(AHORA, &r) != COMANDO_RECHAZADO) || r.firmado ) {
+			COMPRUEBA(false);
+			break;
+		}
+	}
+	recibe_Comando(&canal, texto, strlen(texto));
+	COMPRUEBA(extrae(AHORA, &cmd) == COMANDO_VALIDO && cmd.verbo == VERBO_ACTUALIZA);
+
+	/* La firma en mayúsculas también vale */
+	envia(canal.ultimo_sello + 1, "reinicia");
+	for (char* c = canal.buzon[canal.cabeza].texto; *c != ' '; c++) *c = (char)toupper((unsigned char)*c);
+	COMPRUEBA(extrae(AHORA, &cmd) == COMANDO_VALIDO && cmd.verbo == VERBO_REINICIA);
+
+	/* Formato */
+	recibe_Comando(&canal, "get", 3);
+	COMPRUEBA(rechazado(AHORA, "formato"));
+	memset(texto, 'a', COMANDO_FIRMA_HEX);
+	strcpy(&texto[COMANDO_FIRMA_HEX], " x get");
+	recibe_Comando(&canal, texto, strlen(texto));
+	COMPRUEBA(extrae(AHORA, &cmd) == COMANDO_RECHAZADO && strcmp(cmd.motivo, "formato") == 0 && cmd.sello == 0);
+	texto[COMANDO_FIRMA_HEX] = '_';
+	recibe_Comando(&canal, texto, strlen(texto));
+	COMPRUEBA(rechazado(AHORA, "formato"));
+	texto[COMANDO_FIRMA_HEX] = ' ';
+	texto[3] = 'g';
+	recibe_Comando(&canal, texto, strlen(texto));
+	COMPRUEBA(rechazado(AHORA, "formato"));
+
+	COMPRUEBA(canal.estadistica.aceptados == 6 && canal.estadistica.descartados == 0);
+	COMPRUEBA(canal.estadistica.recibidos == canal.estadistica.aceptados + canal.estadistica.rechazados);
+}
+
+static void pruebas_SelloMinimo(void)
+{
+	comandoRemoto cmd;
+
+	/* Tras el reinicio, el sello guardado y la hora de la red cierran la puerta a lo capturado antes */
+	inicia_Comandos(&canal, CLAVE);
+	envia(SELLO, "get");
+	fija_SelloMinimo(&canal, SELLO);
+	COMPRUEBA(rechazado(AHORA, "sello repetido"));
+	fija_SelloMinimo(&canal, SELLO - 1000);				// nunca baja
+	COMPRUEBA(canal.ultimo_sello == SELLO);
+	envia(SELLO + 1, "get");
+	COMPRUEBA(extrae(AHORA, &cmd) == COMANDO_VALIDO && canal.ultimo_sello == SELLO + 1);
+}
+
+static void pruebas_Buzon(void)
+{
+	comandoRemoto cmd;
+	char texto[COMANDO_TAM_MAX + 1];
+
+	inicia_Comandos(&canal, CLAVE);
+	envia(SELLO + 1, "set {\"a\":1}");
+	envia(SELLO + 2, "guarda");
+	envia(SELLO + 3, "get");								// buzón lleno
+	COMPRUEBA(canal.n_buzon == COMANDOS_BUZON && canal.estadistica.descartados == 1);
+
+	/* Los argumentos siguen en su sitio aunque el buzón reciba mientras se ejecuta */
+	COMPRUEBA(extrae(AHORA, &cmd) == COMANDO_VALIDO && cmd.sello == SELLO + 1);
+	envia(SELLO + 4, "log 0 0");
+	COMPRUEBA(strcmp(cmd.argumentos, "{\"a\":1}") == 0);
+	COMPRUEBA(extrae(AHORA, &cmd) == COMANDO_VALIDO && cmd.verbo == VERBO_GUARDA);
+	COMPRUEBA(extrae(AHORA, &cmd) == COMANDO_VALIDO && cmd.verbo == VERBO_LOG);
+	COMPRUEBA(extrae(AHORA, &cmd) == COMANDO_NINGUNO);
+
+	/* COMANDO_TAM_MAX entra justo; uno más se descarta sin mirarlo */
+	memset(texto, ' ', sizeof(texto));
+	COMPRUEBA(recibe_Comando(&canal, texto, COMANDO_TAM_MAX) && canal.buzon[canal.cabeza].texto[COMANDO_TAM_MAX] == '\0');
+	COMPRUEBA(!recibe_Comando(&canal, texto, COMANDO_TAM_MAX + 1) && canal.estadistica.descartados == 2);
+}
+
+static void pruebas_Cabecera(void)
+{
+	char texto[64];
+
+	COMPRUEBA(cabecera_Respuesta(texto, sizeof(texto), 0, "?") == 4 && strcmp(texto, "0 ? ") == 0);
+	cabecera_Respuesta(texto, sizeof(texto), SELLO + 7, "get");
+	COMPRUEBA(strcmp(texto, "1700000000007 get ") == 0);
+	cabecera_Respuesta(texto, sizeof(texto), UINT64_MAX, "set");
+	COMPRUEBA(strcmp(texto, "18446744073709551615 set ") == 0);
+	COMPRUEBA(cabecera_Respuesta(texto, 8, UINT64_MAX, "set") == 25 && strlen(texto) == 7);
+}
+
+int main(void)
+{
+	pruebas_HMAC();
+	pruebas_Clave();
+	pruebas_Validacion();
+	pruebas_SelloMinimo();
+	pruebas_Buzon();
+	pruebas_Cabecera();
+
+	return fin_Pruebas("Comandos_Remotos");
+}
@@ -0,0 +1,406 @@
+/******************************************************************************
+* @file    prueba_Conectividad.c
+* @brief   Máquina de estados de la red (Gestor_Conectividad.h) con las acciones
+* del llamante simuladas y fallos inyectados en cada una: AP que desaparece,
+* rejoin rápido que no entra, DHCP sin dirección, RTC sin hora, TLS y MQTT que
+* fallan y sesión que cae. Comprueba el camino de cada fallo, el backoff con
+* jitter y su tope, que cada llamada da como mucho un paso, que el socket se
+* cierra tras cada fallo de sesión, y que tras una racha de fallos al azar la
+* red vuelve a enlazar en cuanto dejan de fallar.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+#include "Gestor_Conectividad.h"
+
+/* Lo que tarda cada acción en el equipo, y lo que el bucle principal queda retenido */
+#define T_SCAN_MS        2500
+#define T_REJOIN_MS      300
+#define T_ASOCIA_MS      4000		// WIFI_Init y asociación completa
+#define T_IP_MS          10
+#define T_HORA_MS        200
+#define T_TLS_MS         1500
+#define T_MQTT_MS        300
+#define T_VUELTA_MS      50			// Vuelta del bucle principal sin paso de red
+
+/* ---- Red simulada: cada acción falla mientras su interruptor lo diga ---- */
+
+static bool ap_visible = true, rejoin_ok = true, asocia_ok = true, ip_ok = true, hora_ok = true;
+static bool tls_ok = true, mqtt_ok = true, sesion_viva = false;
+static bool socket_abierto = false, asociado = false;
+static int n_localiza, n_asocia_rapido, n_asocia_completo, n_ip, n_hora, n_tls, n_mqtt, n_cierra;
+static int acciones_llamada;			// pasos de red dados en la llamada en curso a servicio_GestorRed()
+static int abre_sin_cerrar, mqtt_sin_socket;
+
+static bool localiza_AP(cacheAP* ap)
+{
+	static const uint8_t bssid[6] = { 0x24, 0xA4, 0x3C, 0x01, 0x02, 0x03 };
+
+	n_localiza++;
+	acciones_llamada++;
+	tick_anfitrion += T_SCAN_MS;
+	if (!ap_visible) return false;
+	memcpy(ap->bssid, bssid, sizeof(bssid));
+	ap->canal = 6;
+	ap->rssi = -67;
+	ap->sin_scan = false;
+	return true;
+}
+
+static bool asocia(bool rapido)
+{
+	acciones_llamada++;
+	if (rapido) {
+		n_asocia_rapido++;
+		tick_anfitrion += T_REJOIN_MS;
+		asociado = ap_visible && rejoin_ok;
+	}
+	else {
+		n_asocia_completo++;
+		tick_anfitrion += T_ASOCIA_MS;
+		asociado = ap_visible && asocia_ok;
+	}
+	return asociado;
+}
+
+static bool tiene_IP(void)
+{
+	n_ip++;
+	acciones_llamada++;
+	tick_anfitrion += T_IP_MS;
+	return asociado && ip_ok;
+}
+
+static bool fija_Hora(void)
+{
+	n_hora++;
+	acciones_llamada++;
+	tick_anfitrion += T_HORA_MS;
+	return hora_ok;
+}
+
+static bool abre_Socket(void)
+{
+	n_tls++;
+	acciones_llamada++;
+	tick_anfitrion += T_TLS_MS;
+	if (socket_abierto) abre_sin_cerrar++;
+	socket_abierto = true;				// el TCP se abre aunque luego falle el handshake
+	return tls_ok;
+}
+
+static bool conecta_MQTT(void)
+{
+	n_mqtt++;
+	acciones_llamada++;
+	tick_anfitrion += T_MQTT_MS;
+	if (!socket_abierto) mqtt_sin_socket++;
+	sesion_viva = mqtt_ok;
+	return mqtt_ok;
+}
+
+static bool enlazada(void)
+{
+	return sesion_viva;
+}
+
+static void cierra(void)
+{
+	n_cierra++;
+	socket_abierto = false;
+	sesion_viva = false;
+}
+
+static const accionesRed acciones = { localiza_AP, asocia, tiene_IP, fija_Hora, abre_Socket, conecta_MQTT, enlazada, cierra };
+
+/* ---- Bucle principal: una llamada por vuelta, con el tiempo que corre entre medias ---- */
+
+static gestorRed g;
+static int max_acciones_llamada = 0;
+
+static bool llama(void)
+{
+	bool paso;
+
+	acciones_llamada = 0;
+	paso = servicio_GestorRed(&g);
+	if (acciones_llamada > max_acciones_llamada) max_acciones_llamada = acciones_llamada;
+	if (!paso) tick_anfitrion += T_VUELTA_MS;
+	return paso;
+}
+
+/* Vueltas hasta llegar a la fase, como mucho durante limite_ms; devuelve los pasos dados */
+static int corre_Hasta(faseRed fase, uint32_t limite_ms)
+{
+	uint32_t t0 = tick_anfitrion;
+	int pasos = 0;
+
+	while ( (g.fase != fase) && (tick_anfitrion - t0 < limite_ms) ) {
+		pasos += llama() ? 1 : 0;
+	}
+	return pasos;
+}
+
+static void reinicia_Red(void)
+{
+	ap_visible = rejoin_ok = asocia_ok = ip_ok = hora_ok = tls_ok = mqtt_ok = true;
+	sesion_viva = socket_abierto = asociado = false;
+	n_localiza = n_asocia_rapido = n_asocia_completo = n_ip = n_hora = n_tls = n_mqtt = n_cierra = 0;
+	abre_sin_cerrar = mqtt_sin_socket = 0;
+}
+
+/* ---- Pruebas ---- */
+
+/* Arranque sin fallos: asociación completa (sin scan, el modulo aún no está iniciado), IP, hora, TLS y MQTT, un paso
+ * por llamada y sin esperas */
+static void pruebas_Arranque(void)
+{
+	reinicia_Red();
+	inicia_GestorRed(&g, &acciones, true, 1234);
+	COMPRUEBA(corre_Hasta(RED_ENLAZADA, 60000) == 6);
+	COMPRUEBA(n_localiza == 0 && n_asocia_completo == 1 && n_asocia_rapido == 0 && n_hora == 1 && n_tls == 1 && n_mqtt == 1);
+	COMPRUEBA(g.est.recuperacion_ult_ms == T_ASOCIA_MS + T_IP_MS + T_HORA_MS + T_TLS_MS + T_MQTT_MS);
+	COMPRUEBA(g.est.paso_max_ms[RED_ASOCIANDO] == T_ASOCIA_MS && g.est.paso_max_ms[RED_TLS] == T_TLS_MS);
+	COMPRUEBA(!llama() && g.fase == RED_ENLAZADA);		// enlazada no da pasos
+	COMPRUEBA(g.espera_ms == 0 && g.fallos_seguidos == 0);
+
+	/* Sin nube: solo la hora, y luego reposo */
+	reinicia_Red();
+	inicia_GestorRed(&g, &acciones, false, 1234);
+	COMPRUEBA(corre_Hasta(RED_REPOSO, 60000) == 4);
+	COMPRUEBA(n_tls == 0 && n_mqtt == 0 && n_hora == 1);
+	COMPRUEBA(!llama() && !llama() && g.fase == RED_REPOSO);
+}
+
+/* Caídas con el enlace en distintos estados */
+static void pruebas_Caidas(void)
+{
+	reinicia_Red();
+	inicia_GestorRed(&g, &acciones, true, 77);
+	corre_Hasta(RED_ENLAZADA, 60000);
+
+	/* Cae la sesión con la IP intacta: se cierra y se sigue por TLS, sin tocar el AP */
+	sesion_viva = false;
+	COMPRUEBA(llama() && g.fase == RED_TLS && n_cierra == 1 && !socket_abierto && g.est.n_caidas == 1);
+	COMPRUEBA(corre_Hasta(RED_ENLAZADA, 60000) == 2);
+	COMPRUEBA(n_asocia_completo == 1 && n_asocia_rapido == 0 && n_localiza == 0);
+	COMPRUEBA(g.est.recuperacion_ult_ms == T_IP_MS + T_TLS_MS + T_MQTT_MS);
+
+	/* Se pierde el AP: la primera vez se busca con un scan (la caché está vacía) y se entra con un rejoin rápido */
+	sesion_viva = false;
+	asociado = false;
+	COMPRUEBA(llama() && g.fase == RED_SIN_ENLACE);
+	COMPRUEBA(corre_Hasta(RED_ENLAZADA, 60000) == 5);
+	COMPRUEBA(n_localiza == 1 && n_asocia_rapido == 1 && n_asocia_completo == 1 && g.ap.valido && g.ap.canal == 6);
+	COMPRUEBA(n_hora == 1);				// la hora no se vuelve a pedir tras reasociarse
+
+	/* La segunda vez, con la caché reciente, ni siquiera el scan */
+	tick_anfitrion += 60000;
+	sesion_viva = false;
+	asociado = false;
+	llama();
+	COMPRUEBA(corre_Hasta(RED_ENLAZADA, 60000) == 5);
+	COMPRUEBA(n_localiza == 1 && n_asocia_rapido == 2);
+
+	/* Con la caché caducada se vuelve a buscar */
+	tick_anfitrion += CADUCIDAD_CACHE_AP_MS;
+	sesion_viva = false;
+	asociado = false;
+	llama();
+	corre_Hasta(RED_ENLAZADA, 60000);
+	COMPRUEBA(n_localiza == 2 && n_asocia_rapido == 3);
+	COMPRUEBA(g.est.n_caidas == 4 && g.est.n_scans == 2);
+}
+
+/* El AP no vuelve: rejoins rápidos, una asociación completa, scans con backoff creciente hasta el tope y, tras
+ * INTENTOS_SCAN_RED scans vacíos, el reinicio del modulo. Mientras no hay red a la vista no se intenta asociar */
+static void pruebas_SinAP(void)
+{
+	uint32_t tope = ESPERA_MIN_RED_MS, espera_max = 0;
+	bool jitter_ok = true, esperas_ok = true;
+	int scans0, asocia0, f;
+
+	reinicia_Red();
+	inicia_GestorRed(&g, &acciones, true, 99);
+	corre_Hasta(RED_ENLAZADA, 60000);
+	sesion_viva = false;
+	llama();						// con IP: TLS
+	asociado = false;
+	ap_visible = false;
+	tls_ok = false;
+
+	/* TLS falla sin enlace: tras INTENTOS_SESION_RED fallos se mira la IP, y sin ella se vuelve a asociar */
+	corre_Hasta(RED_ASOCIANDO, 10 * ESPERA_MAX_RED_MS);
+	COMPRUEBA(n_tls == 1 + INTENTOS_SESION_RED && n_cierra == 1 + INTENTOS_SESION_RED && !socket_abierto);
+	COMPRUEBA(n_ip == 1 + 1 + INTENTOS_IP_RED);
+
+	/* Rejoins rápidos y luego la asociación completa; al fallar esta, el AP se da por perdido */
+	asocia0 = n_asocia_completo;
+	corre_Hasta(RED_SIN_ENLACE, 10 * ESPERA_MAX_RED_MS);
+	COMPRUEBA(n_asocia_rapido == INTENTOS_REJOIN_RAPIDO && n_asocia_completo == asocia0 + 1 && !g.ap.valido);
+
+	/* Scans vacíos con backoff exponencial, mitad fija y mitad al azar, hasta ESPERA_MAX_RED_MS */
+	scans0 = n_localiza;
+	asocia0 = n_asocia_rapido + n_asocia_completo;
+	while ( (n_localiza - scans0 < INTENTOS_SCAN_RED) && (tick_anfitrion < 0x40000000U) ) {
+		int antes = n_localiza;
+
+		llama();
+		if (n_localiza == antes) continue;
+		f = g.fallos_seguidos;
+		for (tope = ESPERA_MIN_RED_MS; (f > 1) && (tope < ESPERA_MAX_RED_MS); f--) tope <<= 1;
+		if (tope > ESPERA_MAX_RED_MS) tope = ESPERA_MAX_RED_MS;
+		if ( (g.espera_ms < tope / 2) || (g.espera_ms > tope) ) jitter_ok = false;
+		if (g.t_reintento != tick_anfitrion + g.espera_ms) esperas_ok = false;
+		if (g.espera_ms > espera_max) espera_max = g.espera_ms;
+	}
+	COMPRUEBA(jitter_ok && esperas_ok);
+	COMPRUEBA(espera_max <= ESPERA_MAX_RED_MS && espera_max > ESPERA_MAX_RED_MS / 2);
+	COMPRUEBA(n_asocia_rapido + n_asocia_completo == asocia0);		// sin red a la vista no se asocia
+	COMPRUEBA(g.fase == RED_ASOCIANDO && !g.modulo_iniciado);		// tras los scans, reinicio del modulo
+
+	/* Mientras espera, la llamada no hace nada */
+	COMPRUEBA(!llama() && g.fase == RED_ASOCIANDO);
+
+	/* Vuelve el AP: adelanta_GestorRed() (zona con red conocida) cambia el reinicio por un scan inmediato, sin tocar el
+	 * backoff */
+	ap_visible = tls_ok = true;
+	f = g.fallos_seguidos;
+	adelanta_GestorRed(&g);
+	COMPRUEBA(g.fase == RED_SIN_ENLACE && g.modulo_iniciado && g.fallos_seguidos == f);
+	COMPRUEBA(llama() && g.fase == RED_ASOCIANDO && g.ap.valido);
+	COMPRUEBA(corre_Hasta(RED_ENLAZADA, 60000) == 4);
+	COMPRUEBA(g.espera_ms == 0 && g.fallos_seguidos == 0);
+
+	/* Tras enlazar, el backoff vuelve al mínimo */
+	sesion_viva = false;
+	tls_ok = false;
+	llama();
+	llama();
+	COMPRUEBA(g.espera_ms >= ESPERA_MIN_RED_MS / 2 && g.espera_ms <= ESPERA_MIN_RED_MS);
+	COMPRUEBA(g.est.recuperacion_max_ms > ESPERA_MAX_RED_MS);
+}
+
+/* Fallos que no llegan al AP: DHCP, hora, TLS y MQTT */
+static void pruebas_Sesion(void)
+{
+	int n;
+
+	/* Sin hora del servidor: INTENTOS_HORA_RED intentos y se sigue sin ella */
+	reinicia_Red();
+	hora_ok = false;
+	inicia_GestorRed(&g, &acciones, true, 5);
+	COMPRUEBA(corre_Hasta(RED_TLS, 60000) > 0 && n_hora == INTENTOS_HORA_RED);
+	corre_Hasta(RED_ENLAZADA, 60000);
+	COMPRUEBA(g.fase == RED_ENLAZADA);
+
+	/* Sin dirección: INTENTOS_IP_RED comprobaciones y otra asociación */
+	reinicia_Red();
+	ip_ok = false;
+	inicia_GestorRed(&g, &acciones, true, 6);
+	llama();
+	llama();
+	n = corre_Hasta(RED_ASOCIANDO, 10 * ESPERA_MAX_RED_MS);
+	COMPRUEBA(n == INTENTOS_IP_RED && n_ip == INTENTOS_IP_RED && g.est.n_fallos[RED_IP] == INTENTOS_IP_RED);
+	ip_ok = true;
+	corre_Hasta(RED_ENLAZADA, 10 * ESPERA_MAX_RED_MS);
+	COMPRUEBA(g.fase == RED_ENLAZADA);
+
+	/* TLS y MQTT fallan alternados: cuentan juntos, el socket se cierra tras cada uno y nunca se abre dos veces */
+	reinicia_Red();
+	inicia_GestorRed(&g, &acciones, true, 7);
+	corre_Hasta(RED_ENLAZADA, 60000);
+	n = n_ip;
+	sesion_viva = false;
+	mqtt_ok = false;
+	llama();
+	COMPRUEBA(llama() && g.fase == RED_MQTT);		// TLS bien
+	mqtt_ok = false;
+	corre_Hasta(RED_TLS, 60000);					// MQTT mal: vuelta a TLS
+	tls_ok = false;
+	corre_Hasta(RED_IP, 60000);						// TLS mal, otra vez: tercer fallo de sesión, se mira la IP
+	COMPRUEBA(g.fase == RED_IP && g.est.n_fallos[RED_MQTT] == 1 && g.est.n_fallos[RED_TLS] == 2);
+	COMPRUEBA(!socket_abierto && abre_sin_cerrar == 0 && mqtt_sin_socket == 0);
+	tls_ok = mqtt_ok = true;
+	corre_Hasta(RED_ENLAZADA, 60000);
+	COMPRUEBA(g.fase == RED_ENLAZADA && n_ip == n + 2 && n_hora == 1);
+	COMPRUEBA(g.est.paso_max_ms[RED_MQTT] == T_MQTT_MS);
+}
+
+/* Fallos al azar en todas las acciones durante una hora simulada, y luego ninguno */
+static void pruebas_Azar(void)
+{
+	uint32_t t_fin, t_enlace;
+	int pasos = 0, esperas_mal = 0, socket_mal = 0;
+
+	reinicia_Red();
+	srand(42);
+	inicia_GestorRed(&g, &acciones, true, 0xC0FFEE);
+	max_acciones_llamada = 0;
+	t_fin = tick_anfitrion + 3600000U;
+	while ( (int32_t)(tick_anfitrion - t_fin) < 0 ) {
+		ap_visible = (rand() % 10) != 0;
+		rejoin_ok  = (rand() % 3) != 0;
+		asocia_ok  = (rand() % 4) != 0;
+		ip_ok      = (rand() % 5) != 0;
+		hora_ok    = (rand() % 2) != 0;
+		tls_ok     = (rand() % 3) != 0;
+		mqtt_ok    = (rand() % 4) != 0;
+		if ( (g.fase == RED_ENLAZADA) && ((rand() % 50) == 0) ) {
+			sesion_viva = false;
+			if ((rand() % 2) == 0) asociado = false;
+		}
+		if (llama()) {
+			pasos++;
+			if ( (g.espera_ms > ESPERA_MAX_RED_MS) || ((int32_t)(g.t_reintento - tick_anfitrion) > (int32_t)g.espera_ms) ) esperas_mal++;
+			if ( (g.fase == RED_TLS) && socket_abierto ) socket_mal++;
+		}
+	}
+	COMPRUEBA(max_acciones_llamada == 1);
+	COMPRUEBA(esperas_mal == 0 && socket_mal == 0 && abre_sin_cerrar == 0 && mqtt_sin_socket == 0);
+	COMPRUEBA(pasos > 100 && g.est.n_caidas > 5 && g.est.n_rejoin_rapido > 0 && g.est.n_scans > 0);
+
+	/* Sin más fallos, enlaza en cuanto acaba la espera en curso */
+	ap_visible = rejoin_ok = asocia_ok = ip_ok = hora_ok = tls_ok = mqtt_ok = true;
+	t_enlace = tick_anfitrion;
+	corre_Hasta(RED_ENLAZADA, 2 * ESPERA_MAX_RED_MS);
+	COMPRUEBA(g.fase == RED_ENLAZADA);
+	COMPRUEBA(tick_anfitrion - t_enlace <= ESPERA_MAX_RED_MS + 2 * (T_SCAN_MS + T_ASOCIA_MS) + T_IP_MS + T_HORA_MS + T_TLS_MS + T_MQTT_MS);
+}
+
+/* La espera del backoff sobrevive a la vuelta de HAL_GetTick(): TLS falla 0,5 s antes y reintenta pasada la vuelta */
+static void pruebas_Vuelta(void)
+{
+	bool espera_ok = true;
+
+	reinicia_Red();
+	tick_anfitrion = 0xFFFFFFFFU - 500U - (T_ASOCIA_MS + T_IP_MS + T_HORA_MS + T_TLS_MS);
+	inicia_GestorRed(&g, &acciones, true, 3);
+	tls_ok = false;
+	corre_Hasta(RED_TLS, 60000);
+	COMPRUEBA(llama() && g.fase == RED_TLS && n_tls == 1);
+	COMPRUEBA(tick_anfitrion > 0xFFFFF000U && g.t_reintento < tick_anfitrion);		// la espera acaba pasada la vuelta
+	while ((int32_t)(g.t_reintento - tick_anfitrion) > 0) {
+		if (llama()) espera_ok = false;
+	}
+	COMPRUEBA(espera_ok && n_tls == 1);
+	tls_ok = true;
+	COMPRUEBA(llama() && g.fase == RED_MQTT && n_tls == 2);
+}
+
+int main(void)
+{
+	tick_anfitrion = 1000;
+	pruebas_Arranque();
+	pruebas_Caidas();
+	pruebas_SinAP();
+	pruebas_Sesion();
+	pruebas_Azar();
+	pruebas_Vuelta();
+
+	{
+		char texto[RED_TEXTO_SIZE];
+		COMPRUEBA(informe_GestorRed(&g, texto, sizeof(texto)) > 0 && strstr(texto, "MQTT") != NULL);
+	}
+	return fin_Pruebas("Gestor_Conectividad");
+}
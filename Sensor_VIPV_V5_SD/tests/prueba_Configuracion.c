@@ -0,0 +1,364 @@
+/******************************************************************************
+* @file    prueba_Configuracion.c
+* @brief   config.json (Configuracion_SD.h): un fichero válido, valores fuera de
+* rango, de otro tipo y no enteros, JSON mal formado, periodos que no encajan
+* entre sí, y el arena de cJSON vaciado y reutilizado de un análisis al
+* siguiente. guarda_ConfiguracionSD() y carga_ConfiguracionSD() sobre una SD en
+* memoria (anfitrion/fatfs.h), con el corte entre el borrado y el renombrado.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+
+/* De AppIoT_TFG_VIPV.h, Low_Power.h, mi_MEMS.h y Fusion_Adaptativa.h */
+#define PERIODO_PUBLI_DATOS      10
+#define PERIODO_LECTURA_DATOS    1
+#define PERIODO_MIN_LPTIM1       1
+#define PERIODO_MIN_LPTIM2       10
+#define T_MEDICION               3
+#define T_ESPERA                 5
+#define ALGORITHM_FREQ           50.0f
+#define FREC_FUSION_PARADO       10.0f
+#define HABILITA_SD              1
+#define HABILITA_NUBE            1
+#define PERIODO_PERFIL_S         0
+#define PERIODO_MEMORIA_S        600
+#define CODEC_NUBE               CODEC_THINGSPEAK
+#define TOPIC_NUBE               "vipv/%s/ventana"
+#define NMAX_MODULOS             5
+
+#include "Configuracion_SD.h"
+
+const float CTE_CALIBR_FV[NMAX_MODULOS] = {3.814272392f, 3.804324917f, 3.702794995f, 3.797673078f, 3.666993446f};
+
+#define EJEMPLO "{ \"periodo_publi_s\": 60, \"periodo_lectura_s\": 5, \"t_medicion_ms\": 3, \"t_espera_ms\": 5," \
+	" \"frec_fusion_hz\": 50, \"habilita_sd\": true, \"habilita_nube\": false, \"imprime_muestras\": true," \
+	" \"periodo_perfil_s\": 600, \"publica_perfil\": false, \"periodo_memoria_s\": 600, \"publica_memoria\": false," \
+	" \"enlace_mqttsn\": false, \"confirma_mqttsn\": true, \"codec_nube\": \"json\", \"topic_nube\": \"vipv/%s/ventana\"," \
+	" \"qos1_mqtt\": true, \"comandos_remotos\": true, \"cte_calibr_fv\": [3.81, 3.80, 3.70, 3.80, 3.67] }"
+
+/* ---- SD en memoria: dos ficheros, config.json y config.tmp ---- */
+
+static struct { const char* nombre; bool existe; char datos[CONFIG_TAM_MAX * 2]; UINT tam; } sd[2] = {
+	{ CONFIG_FICHERO }, { CONFIG_FICHERO_TMP }
+};
+static bool sd_presente = true, montada = false;
+
+static int busca(const char* ruta)
+{
+	for (int i = 0; i < 2; i++) if (strcmp(ruta, sd[i].nombre) == 0) return i;
+	return -1;
+}
+
+FRESULT f_mount(FATFS* fs, const char* ruta, BYTE opcion)
+{
+	(void)ruta; (void)opcion;
+	if (fs == NULL) { montada = false; return FR_OK; }
+	if (!sd_presente) return FR_NOT_READY;
+	montada = true;
+	return FR_OK;
+}
+
+FRESULT f_open(FIL* fp, const char* ruta, BYTE modo)
+{
+	int i = busca(ruta);
+
+	if (!montada || (i < 0)) return FR_NO_PATH;
+	if (modo & FA_CREATE_ALWAYS) { sd[i].existe = true; sd[i].tam = 0; }
+	if (!sd[i].existe) return FR_NO_FILE;
+	fp->fichero = i;
+	fp->posicion = 0;
+	fp->obj.objsize = sd[i].tam;
+	return FR_OK;
+}
+
+FRESULT f_close(FIL* fp) { (void)fp; return FR_OK; }
+
+FRESULT f_read(FIL* fp, void* buff, UINT btr, UINT* br)
+{
+	UINT n = sd[fp->fichero].tam - fp->posicion;
+
+	if (n > btr) n = btr;
+	memcpy(buff, &sd[fp->fichero].datos[fp->posicion], n);
+	fp->posicion += n;
+	*br = n;
+	return FR_OK;
+}
+
+FRESULT f_write(FIL* fp, const void* buff, UINT btw, UINT* bw)
+{
+	memcpy(&sd[fp->fichero].datos[fp->posicion], buff, btw);
+	fp->posicion += btw;
+	sd[fp->fichero].tam = fp->posicion;
+	*bw = btw;
+	return FR_OK;
+}
+
+FRESULT f_unlink(const char* ruta)
+{
+	int i = busca(ruta);
+
+	if ( (i < 0) || !sd[i].existe ) return FR_NO_FILE;
+	sd[i].existe = false;
+	return FR_OK;
+}
+
+FRESULT f_rename(const char* antigua, const char* nueva)
+{
+	int a = busca(antigua), n = busca(nueva);
+
+	if (sd[n].existe) return FR_EXIST;
+	memcpy(sd[n].datos, sd[a].datos, sd[a].tam);
+	sd[n].tam = sd[a].tam;
+	sd[n].existe = true;
+	sd[a].existe = false;
+	return FR_OK;
+}
+
+static void escribe_SD(int i, const char* texto)
+{
+	sd[i].existe = true;
+	sd[i].tam = (UINT)strlen(texto);
+	memcpy(sd[i].datos, texto, sd[i].tam);
+}
+
+/* ---- Pruebas ---- */
+
+static configSensor defecto;
+
+/* Aplica el texto sobre la configuración por defecto y comprueba que no se ha tocado nada */
+static bool intacta(const char* texto, int aplicadas_esperadas)
+{
+	configSensor cfg = defecto;
+	return (parsea_Configuracion(&cfg, texto) == aplicadas_esperadas) && (memcmp(&cfg, &defecto, sizeof(cfg)) == 0);
+}
+
+static void pruebas_Valido(void)
+{
+	configSensor cfg = defecto;
+
+	COMPRUEBA(parsea_Configuracion(&cfg, EJEMPLO) == 19);
+	COMPRUEBA(cfg.periodo_publi_s == 60 && cfg.periodo_lectura_s == 5 && elementos_Ventana(&cfg) == 12);
+	COMPRUEBA(cfg.t_medicion_ms == 3 && cfg.t_espera_ms == 5 && cfg.frec_fusion_hz == 50.0f);
+	COMPRUEBA(cfg.habilita_sd && !cfg.habilita_nube && cfg.imprime_muestras);
+	COMPRUEBA(cfg.periodo_perfil_s == 600 && !cfg.publica_perfil && cfg.periodo_memoria_s == 600 && !cfg.publica_memoria);
+	COMPRUEBA(!cfg.enlace_mqttsn && cfg.confirma_mqttsn && cfg.qos1_mqtt && cfg.comandos_remotos);
+	COMPRUEBA(cfg.codec_nube == CODEC_JSON && strcmp(cfg.topic_nube, "vipv/%s/ventana") == 0);
+	COMPRUEBA(cfg.cte_calibr_fv[0] == 3.81f && cfg.cte_calibr_fv[4] == 3.67f);
+
+	/* Las claves ausentes conservan el valor anterior */
+	cfg = defecto;
+	COMPRUEBA(parsea_Configuracion(&cfg, "{}") == 0 && memcmp(&cfg, &defecto, sizeof(cfg)) == 0);
+	COMPRUEBA(parsea_Configuracion(&cfg, "{\"t_espera_ms\": 100, \"clave_desconocida\": 1}") == 1);
+	COMPRUEBA(cfg.t_espera_ms == 100 && cfg.t_medicion_ms == T_MEDICION);
+}
+
+static void pruebas_Invalidos(void)
+{
+	uint16_t v = 7;
+	cJSON* raiz;
+
+	/* Fuera de rango, con los límites incluidos */
+	COMPRUEBA(intacta("{\"periodo_lectura_s\": 61}", 0));
+	COMPRUEBA(intacta("{\"periodo_publi_s\": 3610}", 0));
+	COMPRUEBA(intacta("{\"t_medicion_ms\": 0}", 0));
+	COMPRUEBA(intacta("{\"t_espera_ms\": -5}", 0));
+	COMPRUEBA(intacta("{\"frec_fusion_hz\": 100}", 0));
+	COMPRUEBA(intacta("{\"cte_calibr_fv\": [3.81, 3.80, 3.70, 3.80, 11]}", 0));
+
+	/* De otro tipo */
+	COMPRUEBA(intacta("{\"t_espera_ms\": \"5\"}", 0));
+	COMPRUEBA(intacta("{\"habilita_sd\": 1}", 0));
+	COMPRUEBA(intacta("{\"codec_nube\": \"xml\"}", 0));
+	COMPRUEBA(intacta("{\"codec_nube\": 1}", 0));
+	COMPRUEBA(intacta("{\"topic_nube\": \"vipv/+/ventana\"}", 0));
+	COMPRUEBA(intacta("{\"topic_nube\": \"vipv/%s/%s\"}", 0));
+	COMPRUEBA(intacta("{\"topic_nube\": \"\"}", 0));
+	COMPRUEBA(intacta("{\"cte_calibr_fv\": [3.81, 3.80, 3.70, 3.80]}", 0));
+	COMPRUEBA(intacta("{\"cte_calibr_fv\": 3.81}", 0));
+
+	/* No enteros */
+	COMPRUEBA(intacta("{\"t_medicion_ms\": 2.5}", 0));
+	COMPRUEBA(intacta("{\"periodo_publi_s\": 60.1}", 0));
+
+	/* Una clave mala no arrastra a las buenas */
+	COMPRUEBA(intacta("{\"t_medicion_ms\": 2.5, \"habilita_sd\": \"no\"}", 0));
+	{
+		configSensor cfg = defecto;
+		COMPRUEBA(parsea_Configuracion(&cfg, "{\"t_medicion_ms\": 2.5, \"t_espera_ms\": 9}") == 1);
+		COMPRUEBA(cfg.t_medicion_ms == T_MEDICION && cfg.t_espera_ms == 9);
+	}
+
+	/* lee_EnteroConfig() por separado: [min, max] cerrado, y sin tocar el destino si no vale */
+	raiz = cJSON_Parse("{\"a\": 10, \"b\": 20, \"c\": 21, \"d\": 9, \"e\": 1e1, \"f\": 10.5, \"g\": null}");
+	COMPRUEBA(raiz != NULL);
+	COMPRUEBA(lee_EnteroConfig(raiz, "a", 10, 20, &v) == 1 && v == 10);
+	COMPRUEBA(lee_EnteroConfig(raiz, "b", 10, 20, &v) == 1 && v == 20);
+	COMPRUEBA(lee_EnteroConfig(raiz, "c", 10, 20, &v) == 0 && v == 20);
+	COMPRUEBA(lee_EnteroConfig(raiz, "d", 10, 20, &v) == 0 && v == 20);
+	COMPRUEBA(lee_EnteroConfig(raiz, "e", 10, 20, &v) == 1 && v == 10);
+	COMPRUEBA(lee_EnteroConfig(raiz, "f", 10, 20, &v) == 0 && v == 10);
+	COMPRUEBA(lee_EnteroConfig(raiz, "g", 10, 20, &v) == 0 && v == 10);
+	COMPRUEBA(lee_EnteroConfig(raiz, "h", 10, 20, &v) == 0 && v == 10);
+	cJSON_Delete(raiz);
+}
+
+static void pruebas_MalFormado(void)
+{
+	COMPRUEBA(intacta("{\"periodo_publi_s\": 60,", -1));
+	COMPRUEBA(intacta("{\"periodo_publi_s\" 60}", -1));
+	COMPRUEBA(intacta("{'periodo_publi_s': 60}", -1));
+	COMPRUEBA(intacta("[60, 5]", -1));
+	COMPRUEBA(intacta("60", -1));
+	COMPRUEBA(intacta("", -1));
+	COMPRUEBA(config_arena_usado == 0);
+}
+
+/* Cada periodo vale por separado pero no encajan entre sí: se quedan los dos anteriores */
+static void pruebas_Periodos(void)
+{
+	configSensor cfg = defecto;
+
+	COMPRUEBA(intacta("{\"periodo_publi_s\": 60, \"periodo_lectura_s\": 7}", 2));
+	COMPRUEBA(intacta("{\"periodo_publi_s\": 15}", 1));
+	COMPRUEBA(intacta("{\"periodo_lectura_s\": 3}", 1));		// 10 no es múltiplo de 3
+
+	COMPRUEBA(parsea_Configuracion(&cfg, "{\"periodo_publi_s\": 3600, \"periodo_lectura_s\": 60}") == 2);
+	COMPRUEBA(cfg.periodo_publi_s == 3600 && cfg.periodo_lectura_s == 60 && elementos_Ventana(&cfg) == 60);
+	COMPRUEBA(parsea_Configuracion(&cfg, "{\"periodo_lectura_s\": 7}") == 1);
+	COMPRUEBA(cfg.periodo_publi_s == 3600 && cfg.periodo_lectura_s == 60);	// se mantiene la pareja anterior, no la de por defecto
+	COMPRUEBA(parsea_Configuracion(&cfg, "{\"periodo_lectura_s\": 1}") == 1);
+	COMPRUEBA(cfg.periodo_publi_s == 3600 && cfg.periodo_lectura_s == 1 && elementos_Ventana(&cfg) == 3600);
+}
+
+/* El arena se vacía al terminar cada análisis, se reutiliza desde el principio y config_arena_max guarda el pico */
+static void pruebas_Arena(void)
+{
+	configSensor cfg = defecto;
+	char grande[CONFIG_TAM_MAX + 1];
+	size_t max_ejemplo, n;
+	void* p;
+
+	config_arena_max = 0;
+	COMPRUEBA(parsea_Configuracion(&cfg, "{\"t_espera_ms\": 9}") == 1);
+	COMPRUEBA(config_arena_usado == 0 && config_arena_max > 0);
+	n = config_arena_max;
+
+	COMPRUEBA(parsea_Configuracion(&cfg, EJEMPLO) == 19);
+	max_ejemplo = config_arena_max;
+	COMPRUEBA(config_arena_usado == 0 && max_ejemplo > n && max_ejemplo <= CONFIG_ARENA_SIZE);
+
+	/* El mismo fichero otra vez ocupa lo mismo: empieza desde el principio del arena, no a continuación */
+	COMPRUEBA(parsea_Configuracion(&cfg, EJEMPLO) == 19);
+	COMPRUEBA(config_arena_max == max_ejemplo && config_arena_usado == 0);
+
+	/* Uno más pequeño no baja el pico */
+	COMPRUEBA(parsea_Configuracion(&cfg, "{}") == 0);
+	COMPRUEBA(config_arena_max == max_ejemplo);
+
+	/* Un fichero de CONFIG_TAM_MAX que no cabe en el arena falla limpio y el siguiente análisis funciona */
+	n = (size_t)snprintf(grande, sizeof(grande), "{\"x\": [");
+	while (n + 3 < CONFIG_TAM_MAX) n += (size_t)snprintf(&grande[n], sizeof(grande) - n, "1,");
+	snprintf(&grande[n - 1], sizeof(grande) - n + 1, "]}");
+	COMPRUEBA(strlen(grande) <= CONFIG_TAM_MAX);
+	COMPRUEBA(intacta(grande, -1));
+	COMPRUEBA(config_arena_usado == 0);
+	COMPRUEBA(parsea_Configuracion(&cfg, EJEMPLO) == 19 && config_arena_max == max_ejemplo);
+
+	/* Fuera de parsea_Configuracion() cJSON vuelve al heap */
+	p = cJSON_CreateObject();
+	COMPRUEBA( ((uint8_t*)p < config_arena) || ((uint8_t*)p >= &config_arena[CONFIG_ARENA_SIZE]) );
+	cJSON_Delete(p);
+
+	printf("Arena de cJSON: %u de %u bytes con el ejemplo de config.json (en el PC, punteros de 8 bytes)\n",
+		   (unsigned)max_ejemplo, CONFIG_ARENA_SIZE);
+}
+
+/* guarda_ConfiguracionSD() y carga_ConfiguracionSD(): ida y vuelta, corte a medio sustituir y SD ausente */
+static void pruebas_SD(void)
+{
+	FATFS fs;
+	configSensor cfg = defecto, leida = defecto;
+	char antes[CONFIG_TEXTO_SIZE], despues[CONFIG_TEXTO_SIZE];
+
+	COMPRUEBA(parsea_Configuracion(&cfg, EJEMPLO) == 19);
+	COMPRUEBA(imprime_Configuracion(&cfg, antes, sizeof(antes)) < CONFIG_TEXTO_SIZE);
+
+	escribe_SD(0, "{\"t_espera_ms\": 9}");
+	COMPRUEBA(guarda_ConfiguracionSD(&cfg, &fs));
+	COMPRUEBA(sd[0].existe && !sd[1].existe && !montada);
+	COMPRUEBA(carga_ConfiguracionSD(&leida, &fs) == 20);		// también telemetria_binaria
+	imprime_Configuracion(&leida, despues, sizeof(despues));
+	COMPRUEBA(strcmp(antes, despues) == 0);
+
+	/* Corte entre el f_unlink() y el f_rename(): queda solo config.tmp y se lee ése */
+	sd[1] = sd[0];
+	sd[1].nombre = CONFIG_FICHERO_TMP;
+	sd[0].existe = false;
+	leida = defecto;
+	COMPRUEBA(carga_ConfiguracionSD(&leida, &fs) == 20);
+	COMPRUEBA(leida.periodo_publi_s == 60 && leida.codec_nube == CODEC_JSON);
+
+	/* Sin fichero, fichero demasiado grande o sin tarjeta: se queda la configuración de entrada */
+	sd[1].existe = false;
+	leida = defecto;
+	COMPRUEBA(carga_ConfiguracionSD(&leida, &fs) == -1 && memcmp(&leida, &defecto, sizeof(leida)) == 0);
+	memset(sd[0].datos, ' ', CONFIG_TAM_MAX + 1);
+	sd[0].tam = CONFIG_TAM_MAX + 1;
+	sd[0].existe = true;
+	COMPRUEBA(carga_ConfiguracionSD(&leida, &fs) == -1 && memcmp(&leida, &defecto, sizeof(leida)) == 0);
+	sd_presente = false;
+	COMPRUEBA(carga_ConfiguracionSD(&leida, &fs) == -1 && !guarda_ConfiguracionSD(&cfg, &fs));
+	COMPRUEBA(!montada);
+	sd_presente = true;
+}
+
+/* cuenta_Disparo(): con cualquier pareja de periodos que acepte parsea_Configuracion() la ventana se cierra a su hora,
+ * también la de 3600 s, que son 360 disparos del LPTIM2 */
+static void pruebas_Disparos(void)
+{
+	configSensor cfg = defecto;
+	uint16_t publi = 0, lect = 0;
+	uint32_t cierres = 0, lecturas = 0, t_cierre = 0;
+	bool a_su_hora = true;
+
+	COMPRUEBA(parsea_Configuracion(&cfg, "{\"periodo_publi_s\": 3600, \"periodo_lectura_s\": 60}") == 2);
+	for (uint32_t t = 1; t <= 3 * 3600; t++) {
+		if ( (t % PERIODO_MIN_LPTIM2 == 0) && cuenta_Disparo(&publi, cfg.periodo_publi_s, PERIODO_MIN_LPTIM2) ) {
+			cierres++;
+			a_su_hora &= (t - t_cierre == 3600);
+			t_cierre = t;
+		}
+		lecturas += cuenta_Disparo(&lect, cfg.periodo_lectura_s, PERIODO_MIN_LPTIM1);
+	}
+	COMPRUEBA(cierres == 3 && a_su_hora && publi == 0);
+	COMPRUEBA(lecturas == 3 * 60 && lect == 0);
+
+	/* Todos los periodos de publicación válidos, en disparos del LPTIM2 */
+	for (uint16_t p = PERIODO_MIN_LPTIM2; p <= 3600; p += PERIODO_MIN_LPTIM2) {
+		uint16_t c = 0, n = 1;
+		while (!cuenta_Disparo(&c, p, PERIODO_MIN_LPTIM2) && (n < 1000)) n++;
+		a_su_hora &= (n == p / PERIODO_MIN_LPTIM2) && (c == 0);
+	}
+	COMPRUEBA(a_su_hora);
+}
+
+int main(void)
+{
+	consola_anfitrion = false;
+	config_PorDefecto(&defecto);
+
+	pruebas_Valido();
+	pruebas_Invalidos();
+	pruebas_MalFormado();
+	pruebas_Periodos();
+	pruebas_Arena();
+	pruebas_SD();
+	pruebas_Disparos();
+	return fin_Pruebas("Configuracion_SD");
+}
+
+/* cJSON.c redefine true y false, que -include anfitrion/anfitrion.h ya trae de stdbool.h */
+#undef true
+#undef false
+#include "cJSON.c"
@@ -0,0 +1,295 @@
+/******************************************************************************
+* @file    prueba_Consola.c
+* @brief   Consola por DMA (Consola_DMA.h) sobre un USART1 simulado: el DMA
+* copia lo que se le pide a una salida y la prueba decide cuándo termina cada
+* transferencia. Se comprueba el paso del anillo por el final, la reserva de
+* avisos y errores, la contabilidad de DESCARTA y TRUNCA, la recuperación de
+* vigila_Transmision() tras una transferencia sin fin de transmisión y el
+* prefijo de consola_Log() más largo que el mensaje.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+
+/* ---- Lo que Consola_DMA.h toma de main.h: UART, DMA y CMSIS ---- */
+
+typedef enum { HAL_OK = 0, HAL_ERROR, HAL_BUSY, HAL_TIMEOUT } HAL_StatusTypeDef;
+
+#define HAL_UART_STATE_READY    0x20U
+#define HAL_UART_STATE_BUSY_TX  0x21U
+#define UART_FLAG_ORE           0x08U
+#define UART_FLAG_RXNE          0x20U
+
+typedef struct { volatile uint32_t ISR; volatile uint32_t RDR; } USART_TypeDef;
+typedef struct { USART_TypeDef* Instance; volatile uint32_t gState; } UART_HandleTypeDef;
+
+#define __HAL_UART_GET_FLAG(h, f)      ( ((h)->Instance->ISR & (f)) == (f) )
+#define __HAL_UART_CLEAR_OREFLAG(h)    ( (h)->Instance->ISR &= ~UART_FLAG_ORE )
+#define __DMB()                        __sync_synchronize()
+
+static uint32_t ipsr = 0;				// distinto de 0: dentro de una interrupción
+static uint32_t __get_IPSR(void) { return ipsr; }
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart, uint8_t* datos, uint16_t tam);
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef* huart, uint8_t* datos, uint16_t tam, uint32_t espera);
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef* huart);
+
+#include "Consola_DMA.h"
+
+/* ---- USART1 y su DMA: cada transferencia queda en vuelo hasta que la prueba la termina ---- */
+
+static USART_TypeDef usart1;
+UART_HandleTypeDef huart1 = { &usart1, HAL_UART_STATE_READY };
+
+#define SALIDA_TAM  (64 * 1024)
+static char salida[SALIDA_TAM], esperado[SALIDA_TAM];
+static uint32_t n_salida, n_esperado;
+static const uint8_t* dma_datos;
+static uint16_t dma_tam;
+static uint32_t n_dma, al_final, fuera_del_anillo, n_bloqueante;
+static bool dma_rechaza;
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart, uint8_t* datos, uint16_t tam)
+{
+	if (dma_rechaza || (huart->gState != HAL_UART_STATE_READY)) return HAL_BUSY;
+	huart->gState = HAL_UART_STATE_BUSY_TX;
+	dma_datos = datos;
+	dma_tam = tam;
+	n_dma++;
+	fuera_del_anillo += ( (const char*)datos < consola.anillo ) || ( (const char*)datos + tam > &consola.anillo[CONSOLA_TAM] );
+	al_final += ( (const char*)datos + tam == &consola.anillo[CONSOLA_TAM] );
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef* huart, uint8_t* datos, uint16_t tam, uint32_t espera)
+{
+	(void)huart; (void)espera;
+	memcpy(&salida[n_salida], datos, tam);
+	n_salida += tam;
+	n_bloqueante++;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef* huart)
+{
+	huart->gState = HAL_UART_STATE_READY;
+	return HAL_OK;
+}
+
+/* Termina la transferencia en vuelo: sus bytes salen por el UART y llega el fin de transmisión */
+static bool termina_DMA(void)
+{
+	if (huart1.gState != HAL_UART_STATE_BUSY_TX) return false;
+	memcpy(&salida[n_salida], dma_datos, dma_tam);
+	n_salida += dma_tam;
+	huart1.gState = HAL_UART_STATE_READY;
+	HAL_UART_TxCpltCallback(&huart1);
+	return true;
+}
+
+static void vacia(void) { while (termina_DMA()) { } }
+
+/* Escribe y anota lo que se ha aceptado, para compararlo con lo que sale */
+static int escribe(uint8_t nivel, const char* texto, int len)
+{
+	int n = consola_Escribe(nivel, texto, len);
+
+	memcpy(&esperado[n_esperado], texto, (size_t)n);
+	n_esperado += (uint32_t)n;
+	return n;
+}
+
+static void reinicia(void)
+{
+	inicia_Consola(&huart1);
+	huart1.gState = HAL_UART_STATE_READY;
+	n_salida = n_esperado = n_dma = al_final = fuera_del_anillo = n_bloqueante = 0;
+	dma_rechaza = false;
+}
+
+static bool igual(void)
+{
+	return (n_salida == n_esperado) && (memcmp(salida, esperado, n_salida) == 0);
+}
+
+/* ---- Pruebas ---- */
+
+/* Varias vueltas al anillo con el DMA terminando cada tres escrituras: sale todo, en orden, y ningún tramo pasa del final */
+static void pruebas_Vuelta(void)
+{
+	char linea[80];
+	int len, aceptados = 0, escritos = 0;
+
+	reinicia();
+	for (int i = 0; n_esperado < 5 * CONSOLA_TAM; i++) {
+		len = snprintf(linea, sizeof(linea), "linea %05d %.*s\n", i, i % 50, "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz");
+		aceptados += escribe(CONSOLA_TEXTO, linea, len);
+		escritos += len;
+		if (i % 3 == 2) termina_DMA();
+	}
+	vacia();
+	COMPRUEBA(aceptados == escritos && consola.bytes_perdidos == 0 && consola.mensajes_perdidos == 0);
+	COMPRUEBA(igual());
+	COMPRUEBA(consola.cabeza == consola.cola && consola.en_vuelo == 0 && consola.cabeza > 4 * CONSOLA_TAM);
+	COMPRUEBA(fuera_del_anillo == 0 && al_final >= 4);		// cada vuelta parte un tramo en el final del anillo
+	COMPRUEBA(consola.transferencias == n_dma && consola.fallos_dma == 0 && n_bloqueante == 0);
+}
+
+/* Con el UART parado, DEBUG, TEXTO e INFO no pasan de CONSOLA_TAM - CONSOLA_RESERVA; WARN y ERROR usan la reserva */
+static void pruebas_Reserva(void)
+{
+	char bloque[100];
+	uint32_t perdidos;
+
+	reinicia();
+	memset(bloque, 'i', sizeof(bloque));
+	dma_rechaza = true;		// UART ocupado: nada sale y el anillo se llena
+	while (escribe(CONSOLA_INFO, bloque, sizeof(bloque)) == (int)sizeof(bloque)) { }
+	COMPRUEBA(consola.cabeza - consola.cola <= CONSOLA_TAM - CONSOLA_RESERVA);
+	COMPRUEBA(consola.cabeza - consola.cola > CONSOLA_TAM - CONSOLA_RESERVA - sizeof(bloque));
+	COMPRUEBA(consola_Libre() < sizeof(bloque));
+
+	/* Los niveles bajos siguen sin sitio, aunque el mensaje sea corto */
+	perdidos = consola.mensajes_perdidos;
+	COMPRUEBA(escribe(CONSOLA_DEBUG, bloque, (int)consola_Libre() + 1) == 0);
+	COMPRUEBA(consola.mensajes_perdidos == perdidos + 1);
+
+	/* Los avisos entran en la reserva */
+	memset(bloque, 'w', sizeof(bloque));
+	for (int i = 0; i < CONSOLA_RESERVA / (int)sizeof(bloque); i++) {
+		COMPRUEBA(escribe(CONSOLA_WARN, bloque, sizeof(bloque)) == (int)sizeof(bloque));
+	}
+	COMPRUEBA(consola.cabeza - consola.cola > CONSOLA_TAM - sizeof(bloque));
+	COMPRUEBA(consola_Libre() == 0 && consola.ocupacion_max == consola.cabeza - consola.cola);
+
+	/* Se libera el UART: sale todo lo aceptado, en orden */
+	dma_rechaza = false;
+	COMPRUEBA(escribe(CONSOLA_ERROR, "fin\n", 4) == 4);
+	vacia();
+	COMPRUEBA(igual() && consola.cabeza == consola.cola);
+	COMPRUEBA(consola.fallos_dma > 0);		// los arranques rechazados cuentan
+}
+
+/* DESCARTA pierde el mensaje entero; TRUNCA escribe lo que quepa. Los dos cuentan un mensaje y los bytes que faltan */
+static void pruebas_Politicas(void)
+{
+	char bloque[CONSOLA_TAM];
+	uint32_t libre;
+	int n;
+
+	reinicia();
+	memset(bloque, 'x', sizeof(bloque));
+
+	/* Desde una interrupción no se escribe, ni siquiera con sitio, y no cuenta como mensaje perdido */
+	ipsr = 54;
+	COMPRUEBA(escribe(CONSOLA_ERROR, "isr\n", 4) == 0 && consola.perdidos_isr == 1);
+	COMPRUEBA(consola_Log(CONSOLA_ERROR, __func__, __LINE__, "isr\n") == 0 && consola.perdidos_isr == 2);
+	ipsr = 0;
+	COMPRUEBA(consola.mensajes_perdidos == 0 && consola.cabeza == 0);
+	consola.bytes_perdidos = 0;
+
+	dma_rechaza = true;
+
+	COMPRUEBA(escribe(CONSOLA_TEXTO, bloque, CONSOLA_TAM - CONSOLA_RESERVA - 300) == CONSOLA_TAM - CONSOLA_RESERVA - 300);
+	libre = consola_Libre();
+	COMPRUEBA(libre == 300);
+
+	/* DEBUG e INFO: descartados enteros */
+	COMPRUEBA(escribe(CONSOLA_INFO, bloque, 301) == 0);
+	COMPRUEBA(escribe(CONSOLA_DEBUG, bloque, 1000) == 0);
+	COMPRUEBA(consola.mensajes_perdidos == 2 && consola.bytes_perdidos == 301 + 1000);
+
+	/* TEXTO: truncado a lo que queda fuera de la reserva */
+	n = escribe(CONSOLA_TEXTO, bloque, 500);
+	COMPRUEBA(n == 300 && consola_Libre() == 0);
+	COMPRUEBA(consola.mensajes_perdidos == 3 && consola.bytes_perdidos == 301 + 1000 + 200);
+
+	/* WARN: descartado entero si no cabe ni en la reserva; ERROR: truncado al final del anillo */
+	COMPRUEBA(escribe(CONSOLA_WARN, bloque, CONSOLA_RESERVA + 1) == 0);
+	COMPRUEBA(consola.mensajes_perdidos == 4 && consola.bytes_perdidos == 301 + 1000 + 200 + CONSOLA_RESERVA + 1);
+	COMPRUEBA(escribe(CONSOLA_ERROR, bloque, CONSOLA_RESERVA + 10) == CONSOLA_RESERVA);
+	COMPRUEBA(consola.mensajes_perdidos == 5 && consola.bytes_perdidos == 301 + 1000 + 200 + CONSOLA_RESERVA + 1 + 10);
+	COMPRUEBA(consola.cabeza - consola.cola == CONSOLA_TAM && consola.bytes_escritos == CONSOLA_TAM);
+	COMPRUEBA(escribe(CONSOLA_ERROR, bloque, 1) == 0);
+
+	imprime_EstadisticasConsola();
+	COMPRUEBA(consola.mensajes_perdidos == 0 && consola.bytes_perdidos == 0 && consola.perdidos_isr == 0);
+}
+
+/* Una transferencia que termina sin HAL_UART_TxCpltCallback() (error de DMA): la siguiente escritura la da por
+ * enviada y arranca el resto */
+static void pruebas_Vigilancia(void)
+{
+	uint32_t fallos;
+
+	reinicia();
+	COMPRUEBA(escribe(CONSOLA_TEXTO, "primera\n", 8) == 8);
+	COMPRUEBA(consola.en_vuelo == 8 && huart1.gState == HAL_UART_STATE_BUSY_TX);
+	COMPRUEBA(escribe(CONSOLA_TEXTO, "segunda\n", 8) == 8);		// en cola tras la primera
+	COMPRUEBA(consola.en_vuelo == 8 && consola.cabeza - consola.cola == 16);
+
+	/* El DMA falla: el UART vuelve a READY sin fin de transmisión. Sin vigilancia el anillo se quedaría así */
+	memcpy(&salida[n_salida], dma_datos, dma_tam);
+	n_salida += dma_tam;
+	huart1.gState = HAL_UART_STATE_READY;
+	fallos = consola.fallos_dma;
+
+	COMPRUEBA(escribe(CONSOLA_TEXTO, "tercera\n", 8) == 8);
+	COMPRUEBA(consola.fallos_dma == fallos + 1);
+	COMPRUEBA(consola.en_vuelo == 16 && huart1.gState == HAL_UART_STATE_BUSY_TX);	// segunda y tercera, juntas
+	vacia();
+	COMPRUEBA(igual() && consola.cabeza == consola.cola);
+
+	/* pasa_ConsolaBloqueante() con una transferencia en vuelo: se aborta y se repite entera por sondeo */
+	COMPRUEBA(escribe(CONSOLA_ERROR, "fallo grave\n", 12) == 12);
+	pasa_ConsolaBloqueante();
+	COMPRUEBA(consola.huart == NULL && consola.en_vuelo == 0 && consola.cabeza == consola.cola);
+	COMPRUEBA(igual() && n_bloqueante == 1);
+	COMPRUEBA(consola_Escribe(CONSOLA_DEBUG, "directo\n", 8) == 8 && n_bloqueante == 2);
+}
+
+/* consola_Log(): prefijo de nivel y función; un prefijo más largo que CONSOLA_MENSAJE_MAX no desborda mensaje[] */
+static void pruebas_Log(void)
+{
+	char funcion[CONSOLA_MENSAJE_MAX + 100];
+	int n;
+
+	reinicia();
+	n = consola_Log(CONSOLA_WARN, "lee", 42, "valor %d\n", 7);
+	vacia();
+	COMPRUEBA(n == (int)strlen("WARN:  lee L#42 valor 7\n") && memcmp(salida, "WARN:  lee L#42 valor 7\n", (size_t)n) == 0);
+
+	n = consola_Log(CONSOLA_INFO, NULL, 0, "%s", "sin prefijo\n");
+	vacia();
+	COMPRUEBA(n == 12 && memcmp(&salida[n_salida - 12], "sin prefijo\n", 12) == 0);
+
+	/* El texto se trunca a CONSOLA_MENSAJE_MAX - 1 */
+	memset(funcion, 'f', sizeof(funcion));
+	funcion[CONSOLA_MENSAJE_MAX / 2] = '\0';
+	n = consola_Log(CONSOLA_ERROR, "g", 1, "%s", funcion);
+	COMPRUEBA(n == (int)strlen("ERROR: g L#1 ") + CONSOLA_MENSAJE_MAX / 2);
+	n = consola_Log(CONSOLA_ERROR, "g", 1, "%s%s", funcion, funcion);
+	COMPRUEBA(n == CONSOLA_MENSAJE_MAX - 1);
+
+	/* Nombre de función más largo que el mensaje: el prefijo se corta y el texto no se escribe fuera */
+	funcion[CONSOLA_MENSAJE_MAX / 2] = 'f';
+	funcion[sizeof(funcion) - 1] = '\0';
+	vacia();
+	n_salida = 0;
+	n = consola_Log(CONSOLA_ERROR, funcion, 99, "texto %d\n", 1);
+	vacia();
+	COMPRUEBA(n == CONSOLA_MENSAJE_MAX - 1 && n_salida == CONSOLA_MENSAJE_MAX - 1);
+	COMPRUEBA(memcmp(salida, "ERROR: fff", 10) == 0 && salida[n_salida - 1] == 'f');
+
+	COMPRUEBA(consola_Log(CONSOLA_ERROR + 1, "g", 1, "nivel\n") == 0);
+}
+
+int main(void)
+{
+	pruebas_Vuelta();
+	pruebas_Reserva();
+	pruebas_Politicas();
+	pruebas_Vigilancia();
+	pruebas_Log();
+	return fin_Pruebas("Consola_DMA");
+}
@@ -0,0 +1,139 @@
+/******************************************************************************
+* @file    prueba_DNS.c
+* @brief   Caché de resolución de nombres (net_dns_cache.c): aciertos dentro del
+* TTL, dirección conocida cuando el DNS falla o responde un portal cautivo,
+* persistencia en los registros de backup a través de un reinicio, LRU y
+* desbordamiento del tick.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+
+/* net_internal.h arrastra mbedTLS y el driver WiFi: solo hacen falta net.h y la consulta al módulo */
+#define __NET_INTERNAL_H__
+#include "net.h"
+
+typedef enum { WIFI_STATUS_OK = 0, WIFI_STATUS_ERROR } WIFI_Status_t;
+
+enum { DNS_BIEN, DNS_FALLA, DNS_PORTAL };
+static int modo = DNS_BIEN, n_consultas = 0;
+
+/* El ISM43362 tarda unos 800 ms por consulta, y 10 s más si el servidor no responde */
+WIFI_Status_t WIFI_GetHostAddress(const char* host, uint8_t* ip)
+{
+	static const uint8_t publica[4] = { 52, 29, 1, 7 }, portal[4] = { 192, 168, 4, 1 };
+
+	n_consultas++;
+	tick_anfitrion += 800;
+	if (modo == DNS_FALLA) {
+		tick_anfitrion += 10000;
+		return WIFI_STATUS_ERROR;
+	}
+	memcpy(ip, (modo == DNS_PORTAL) ? portal : publica, 4);
+	if (modo == DNS_BIEN) ip[3] = (uint8_t)(ip[3] + strlen(host) % 7);
+	return WIFI_STATUS_OK;
+}
+
+#include "net_dns_cache.c"
+
+/* Lo que se pierde en un reinicio: la RAM y el tick, no los registros de backup */
+static void reinicia(void)
+{
+	memset(net_dns_cache, 0, sizeof(net_dns_cache));
+	memset(&net_dns_stats, 0, sizeof(net_dns_stats));
+	net_dns_restored = false;
+	tick_anfitrion = 50;
+}
+
+int main(void)
+{
+	const char* broker = "broker.example.com";
+	uint8_t ip[4];
+	uint32_t t0, en_dns = 0;
+	int q0;
+	bool ajenos = true;
+	char nombre[16];
+
+	tick_anfitrion = 1000;
+
+	/* Direcciones literales: sin consulta. Direcciones mal formadas: no son literales */
+	COMPRUEBA(net_dns_resolve("192.168.1.20", ip) == NET_OK && ip[0] == 192 && ip[3] == 20 && n_consultas == 0);
+	COMPRUEBA(!net_dns_parse_ipv4("1.2.3", ip) && !net_dns_parse_ipv4("1.2.3.256", ip));
+	COMPRUEBA(!net_dns_parse_ipv4("1.2.3.4x", ip) && !net_dns_parse_ipv4("1111.2.3.4", ip));
+	COMPRUEBA(net_dns_resolve("", ip) == NET_PARAM && net_dns_resolve(NULL, ip) == NET_PARAM);
+
+	/* 20 reconexiones cada 5 min: una consulta por hora de TTL en lugar de una por reconexión */
+	q0 = n_consultas;
+	for (int i = 0; i < 20; i++) {
+		t0 = tick_anfitrion;
+		COMPRUEBA(net_dns_resolve(broker, ip) == NET_OK && ip[0] == 52);
+		en_dns += tick_anfitrion - t0;
+		tick_anfitrion += 300000;
+	}
+	COMPRUEBA(n_consultas - q0 == 2);
+	COMPRUEBA(en_dns == 1600);
+
+	/* Portal cautivo: una dirección local no sustituye a la pública conocida */
+	modo = DNS_PORTAL;
+	tick_anfitrion += NET_DNS_TTL_MS;
+	COMPRUEBA(net_dns_resolve(broker, ip) == NET_OK && ip[0] == 52 && net_dns_stats.rejected == 1);
+
+	/* DNS caído: la última dirección buena, y no se vuelve a preguntar hasta NET_DNS_RETRY_MS */
+	modo = DNS_FALLA;
+	tick_anfitrion += NET_DNS_TTL_MS;
+	q0 = n_consultas;
+	COMPRUEBA(net_dns_resolve(broker, ip) == NET_OK && ip[0] == 52);
+	COMPRUEBA(net_dns_resolve(broker, ip) == NET_OK && n_consultas == q0 + 1);
+	tick_anfitrion += NET_DNS_RETRY_MS;
+	net_dns_resolve(broker, ip);
+	COMPRUEBA(n_consultas == q0 + 2);
+	COMPRUEBA(net_dns_resolve("desconocido.example.com", ip) == NET_NOT_FOUND);
+
+	/* Reinicio con el DNS caído: la dirección sale de los registros de backup */
+	reinicia();
+	q0 = n_consultas;
+	COMPRUEBA(net_dns_resolve(broker, ip) == NET_OK && ip[0] == 52);
+	COMPRUEBA(n_consultas == q0 + 1 && net_dns_stats.restored == 1);
+
+	/* Solo se escriben los registros de la caché, DR16 a DR24 según el mapa de main.h */
+	for (uint32_t r = 0; r < 32; r++) {
+		if ( (r < BKP_PRIMERO_DNS) || (r > BKP_PRIMERO_DNS + 2 * NET_DNS_CACHE_SIZE) ) ajenos &= (bkp_anfitrion[r] == 0);
+	}
+	COMPRUEBA(ajenos);
+
+	/* Registros corrompidos: no se recupera nada */
+	bkp_anfitrion[BKP_PRIMERO_DNS + 2] ^= 1;
+	reinicia();
+	COMPRUEBA(net_dns_resolve(broker, ip) == NET_NOT_FOUND && net_dns_stats.restored == 0);
+
+	/* LRU: 6 nombres en 4 huecos, se quedan los 4 últimos usados */
+	modo = DNS_BIEN;
+	for (int i = 0; i < 6; i++) {
+		snprintf(nombre, sizeof(nombre), "h%d", i);
+		tick_anfitrion += 10;
+		net_dns_resolve(nombre, ip);
+	}
+	q0 = n_consultas;
+	net_dns_resolve("h5", ip);
+	net_dns_resolve("h2", ip);
+	COMPRUEBA(n_consultas == q0);
+	net_dns_resolve("h0", ip);
+	COMPRUEBA(n_consultas == q0 + 1);
+
+	/* net_dns_expire() obliga a consultar pero conserva la dirección de reserva */
+	net_dns_expire();
+	modo = DNS_FALLA;
+	q0 = n_consultas;
+	COMPRUEBA(net_dns_resolve("h5", ip) == NET_OK && n_consultas == q0 + 1);
+
+	/* El tick da la vuelta sin vaciar la caché */
+	modo = DNS_BIEN;
+	tick_anfitrion = 0xFFFFFF00U;
+	net_dns_resolve("w", ip);
+	q0 = n_consultas;
+	tick_anfitrion += 0x200;
+	net_dns_resolve("w", ip);
+	COMPRUEBA(n_consultas == q0);
+
+	return fin_Pruebas("net_dns_cache");
+}
@@ -0,0 +1,414 @@
+/******************************************************************************
+* @file    prueba_EnlaceSN.c
+* @brief   Enlace MQTT-SN (Enlace_MQTTSN.h) contra una pasarela simulada en el
+* mismo proceso, detrás del transporte del enlace: contesta CONNECT, PUBLISH y
+* PINGREQ como una pasarela MQTT-SN v1.2 con el topic predefinido, y puede
+* perder datagramas en cada sentido, callar, pedir espera por congestión,
+* rechazar el topic o cerrar la sesión. El bucle de la prueba hace lo que
+* envia_EnlaceSN() con la FIFO: la cabeza solo se elimina cuando el enlace la
+* da por entregada, y el enlace caído se reabre como lo haría el gestor de red.
+******************************************************************************
+*/
+
+#include <stdlib.h>
+#include "comprueba.h"
+#include "Enlace_MQTTSN.h"
+
+#define TOPIC_PRUEBA     0x0042
+#define ID_CLIENTE       "VIPV-0001"
+#define T_VUELTA_MS      100			// Vuelta del bucle principal
+#define T_LECTURA_MS     10				// Cada lectura sin datagrama pendiente
+#define T_REAPERTURA_MS  5000			// Espera del gestor de red antes de reabrir el enlace
+#define PERIODO_MEDIA_MS 10000
+#define N_FIFO           512
+
+/* ---- Pasarela simulada ---- */
+
+typedef struct
+{
+	uint8_t trama[8];
+	uint8_t tam;
+
+}datagrama;
+
+static struct
+{
+	bool conectada;
+	bool callada;				// no procesa ni contesta nada
+	uint8_t respuesta_connack;
+	uint8_t n_congestion;		// siguientes PUBLISH que se contestan con congestión
+	uint8_t n_rechazo;			// siguientes PUBLISH que se contestan con el topic rechazado
+	int perdida_subida;			// % de datagramas del equipo que se pierden
+	int perdida_bajada;			// % de respuestas que se pierden
+	uint32_t ultimo_epoch;		// último registro nuevo recibido
+	uint32_t recibidos, duplicados, huecos, con_dup, connects, pings;
+	datagrama cola[8];			// respuestas pendientes de leer por el equipo
+	uint8_t n_cola;
+
+}pasarela;
+
+static bool socket_roto = false;
+static uint8_t ultima_trama[TRAMA_SN_MAX];		// la última que ha salido del equipo, llegue o no
+static uint8_t tam_ultima;
+
+static void contesta(const uint8_t* trama, uint8_t tam)
+{
+	if ( (rand() % 100 < pasarela.perdida_bajada) || (pasarela.n_cola == 8) ) return;
+	memcpy(pasarela.cola[pasarela.n_cola].trama, trama, tam);
+	pasarela.cola[pasarela.n_cola++].tam = tam;
+}
+
+static void procesa_Pasarela(const uint8_t* trama, uint8_t tam)
+{
+	if ( pasarela.callada || (tam < 2) || (trama[0] != tam) ) return;
+
+	if (trama[1] == SN_CONNECT) {
+		uint8_t connack[3] = { 3, SN_CONNACK, pasarela.respuesta_connack };
+
+		pasarela.connects++;
+		pasarela.conectada = (pasarela.respuesta_connack == SN_ACEPTADO);
+		contesta(connack, sizeof(connack));
+	}
+	else if (trama[1] == SN_PUBLISH) {
+		uint8_t puback[7] = { 7, SN_PUBACK, trama[3], trama[4], trama[5], trama[6], SN_ACEPTADO };
+		bool qos1 = (trama[2] & SN_FLAG_QOS_M1) == SN_FLAG_QOS1;
+		registroCompacto r;
+
+		if (trama[2] & SN_FLAG_DUP) pasarela.con_dup++;
+		if (pasarela.n_congestion > 0) {
+			pasarela.n_congestion--;
+			puback[6] = SN_CONGESTION;
+		}
+		else if (pasarela.n_rechazo > 0) {
+			pasarela.n_rechazo--;
+			puback[6] = 0x02;		// Rejected: invalid topic ID
+		}
+		else {
+			memcpy(&r, &trama[7], sizeof(r));
+			if (r.epoch <= pasarela.ultimo_epoch) {
+				pasarela.duplicados++;
+			}
+			else {
+				pasarela.huecos += r.epoch - pasarela.ultimo_epoch - 1;
+				pasarela.ultimo_epoch = r.epoch;
+				pasarela.recibidos++;
+			}
+		}
+		if (qos1) contesta(puback, sizeof(puback));
+	}
+	else if (trama[1] == SN_PINGREQ) {
+		static const uint8_t pingresp[2] = { 2, SN_PINGRESP };
+
+		pasarela.pings++;
+		contesta(pingresp, sizeof(pingresp));
+	}
+	else if (trama[1] == SN_DISCONNECT) {
+		pasarela.conectada = false;
+	}
+}
+
+static void inicia_Pasarela(int perdida)
+{
+	memset(&pasarela, 0, sizeof(pasarela));
+	pasarela.perdida_subida = perdida;
+	pasarela.perdida_bajada = perdida;
+	socket_roto = false;
+}
+
+/* Transporte del enlace: el socket UDP hacia la pasarela */
+static int envia_UDP(const uint8_t* trama, uint16_t tam)
+{
+	if (socket_roto) return -1;
+	memcpy(ultima_trama, trama, tam);
+	tam_ultima = (uint8_t)tam;
+	if (rand() % 100 >= pasarela.perdida_subida) procesa_Pasarela(trama, (uint8_t)tam);
+	return tam;
+}
+
+static int recibe_UDP(uint8_t* trama, uint16_t tam)
+{
+	datagrama d;
+
+	if (socket_roto) return -1;
+	if (pasarela.n_cola == 0) {
+		tick_anfitrion += T_LECTURA_MS;
+		return 0;
+	}
+	d = pasarela.cola[0];
+	memmove(&pasarela.cola[0], &pasarela.cola[1], --pasarela.n_cola * sizeof(datagrama));
+	if (d.tam > tam) return 1;
+	memcpy(trama, d.trama, d.tam);
+	return d.tam;
+}
+
+static const transporteSN transporte = { envia_UDP, recibe_UDP };
+
+/* ---- FIFO del llamante y bucle principal ---- */
+
+static enlaceSN sn;
+static registroCompacto fifo[N_FIFO];
+static uint32_t cabeza, cola, n_generados, n_reaperturas;
+
+static void mete_Media(void)
+{
+	memset(&fifo[cola % N_FIFO], 0, sizeof(registroCompacto));
+	fifo[cola % N_FIFO].epoch = ++n_generados;
+	fifo[cola % N_FIFO].irradiancia[0] = (uint16_t)(n_generados * 7);
+	cola++;
+}
+
+static const registroCompacto* cabeza_FIFO(void)
+{
+	return (cabeza != cola) ? &fifo[cabeza % N_FIFO] : NULL;
+}
+
+static void reinicia_FIFO(void)
+{
+	cabeza = cola = n_generados = n_reaperturas = 0;
+}
+
+/* Una media cada PERIODO_MEDIA_MS mientras queden por generar; después se deja vaciar la FIFO hasta t_fin */
+static void simula(uint32_t duracion_ms, uint32_t n_medias)
+{
+	uint32_t t_fin = tick_anfitrion + duracion_ms;
+	uint32_t t_media = tick_anfitrion;
+	uint32_t t_reabre = tick_anfitrion;
+
+	while ((int32_t)(tick_anfitrion - t_fin) < 0) {
+		if ( (n_generados < n_medias) && ((int32_t)(tick_anfitrion - t_media) >= 0) ) {
+			mete_Media();
+			t_media += PERIODO_MEDIA_MS;
+		}
+		if (sn.estado != SN_ACTIVO) {
+			if ((int32_t)(tick_anfitrion - t_reabre) >= 0) {
+				n_reaperturas++;
+				if (!conecta_EnlaceSN(&sn)) t_reabre = tick_anfitrion + T_REAPERTURA_MS;
+			}
+		}
+		else {
+			int resultado = servicio_EnlaceSN(&sn, cabeza_FIFO());
+
+			if (resultado > 0) cabeza++;
+			else if (resultado < 0) t_reabre = tick_anfitrion + T_REAPERTURA_MS;
+		}
+		tick_anfitrion += T_VUELTA_MS;
+	}
+}
+
+/* ---- Pruebas ---- */
+
+/* Tramas del CONNECT y del PUBLISH con cada QoS, byte a byte */
+static void pruebas_Tramas(void)
+{
+	registroCompacto r;
+
+	inicia_Pasarela(0);
+	inicia_EnlaceSN(&sn, &transporte, true, TOPIC_PRUEBA, "un-ClientId-de-mas-de-23-caracteres");
+	COMPRUEBA(strlen(sn.id_cliente) == ID_CLIENTE_SN_MAX);
+	inicia_EnlaceSN(&sn, &transporte, true, TOPIC_PRUEBA, ID_CLIENTE);
+	COMPRUEBA(conecta_EnlaceSN(&sn) && sn.estado == SN_ACTIVO && pasarela.conectada);
+	COMPRUEBA(tam_ultima == 6 + strlen(ID_CLIENTE) && ultima_trama[0] == tam_ultima && ultima_trama[1] == SN_CONNECT);
+	COMPRUEBA(ultima_trama[2] == SN_FLAG_LIMPIA && ultima_trama[3] == SN_ID_PROTOCOLO);
+	COMPRUEBA(((ultima_trama[4] << 8) | ultima_trama[5]) == DURACION_SN_S);
+	COMPRUEBA(memcmp(&ultima_trama[6], ID_CLIENTE, strlen(ID_CLIENTE)) == 0);
+
+	memset(&r, 0, sizeof(r));
+	r.epoch = 1;
+	r.humedad = 55;
+	COMPRUEBA(servicio_EnlaceSN(&sn, &r) == 0 && sn.en_vuelo);
+	COMPRUEBA(tam_ultima == 47 && ultima_trama[0] == 47 && ultima_trama[1] == SN_PUBLISH);
+	COMPRUEBA(ultima_trama[2] == (SN_FLAG_QOS1 | SN_FLAG_PREDEFINIDO));
+	COMPRUEBA(ultima_trama[3] == 0x00 && ultima_trama[4] == 0x42 && ultima_trama[5] == 0 && ultima_trama[6] == 1);
+	COMPRUEBA(memcmp(&ultima_trama[7], &r, sizeof(r)) == 0);
+	COMPRUEBA(servicio_EnlaceSN(&sn, &r) == 1 && !sn.en_vuelo && pasarela.recibidos == 1);
+
+	/* QoS -1: sin CONNECT, MsgId 0, y entregado al enviarlo */
+	inicia_Pasarela(0);
+	inicia_EnlaceSN(&sn, &transporte, false, TOPIC_PRUEBA, ID_CLIENTE);
+	tam_ultima = 0;
+	COMPRUEBA(conecta_EnlaceSN(&sn) && tam_ultima == 0 && pasarela.connects == 0);
+	COMPRUEBA(servicio_EnlaceSN(&sn, &r) == 1 && pasarela.recibidos == 1);
+	COMPRUEBA(ultima_trama[2] == (SN_FLAG_QOS_M1 | SN_FLAG_PREDEFINIDO) && ultima_trama[5] == 0 && ultima_trama[6] == 0);
+	COMPRUEBA(sn.estadistica.bytes_tx == 47 && sn.estadistica.bytes_rx == 0);
+}
+
+/* QoS 1: con y sin pérdidas todas las medias llegan, en orden, y la FIFO se vacía */
+static void pruebas_QoS1(void)
+{
+	uint32_t bytes;
+
+	srand(42);
+	inicia_Pasarela(0);
+	inicia_EnlaceSN(&sn, &transporte, true, TOPIC_PRUEBA, ID_CLIENTE);
+	reinicia_FIFO();
+	simula(3000U * 1000U + 60000U, 300);
+	COMPRUEBA(pasarela.recibidos == 300 && pasarela.duplicados == 0 && pasarela.huecos == 0);
+	COMPRUEBA(cabeza == cola && sn.estadistica.entregados == 300 && sn.estadistica.reenvios == 0);
+	COMPRUEBA(sn.estadistica.caidas == 0 && n_reaperturas == 1 && pasarela.pings == 0);
+	bytes = (uint32_t)(6 + strlen(ID_CLIENTE)) + 300U * 47U;
+	COMPRUEBA(sn.estadistica.bytes_tx == bytes && sn.estadistica.bytes_rx == 3U + 300U * 7U);
+
+	/* 20 % de pérdidas en cada sentido: reenvíos, duplicados en la pasarela y algún enlace caído, pero todo llega */
+	inicia_Pasarela(20);
+	inicia_EnlaceSN(&sn, &transporte, true, TOPIC_PRUEBA, ID_CLIENTE);
+	reinicia_FIFO();
+	simula(3000U * 1000U + 600000U, 300);
+	COMPRUEBA(pasarela.recibidos == 300 && pasarela.huecos == 0 && cabeza == cola);
+	COMPRUEBA(sn.estadistica.entregados == 300 && sn.estadistica.rechazados == 0);
+	COMPRUEBA(sn.estadistica.reenvios > 0 && pasarela.duplicados > 0 && pasarela.con_dup > 0);
+	printf("QoS 1 con 20 %% de perdidas: %lu reenvios, %lu duplicados en la pasarela, %lu caidas, %lu B/media\n",
+		   (unsigned long)sn.estadistica.reenvios, (unsigned long)pasarela.duplicados,
+		   (unsigned long)sn.estadistica.caidas, (unsigned long)(sn.estadistica.bytes_tx / 300U));
+
+	/* 45 %: el enlace cae a menudo, y la media en vuelo vuelve a salir de la FIFO al reabrirlo */
+	inicia_Pasarela(45);
+	inicia_EnlaceSN(&sn, &transporte, true, TOPIC_PRUEBA, ID_CLIENTE);
+	reinicia_FIFO();
+	simula(1000U * 1000U + 1800000U, 100);
+	COMPRUEBA(pasarela.recibidos == 100 && pasarela.huecos == 0 && cabeza == cola);
+	COMPRUEBA(sn.estadistica.caidas > 0 && n_reaperturas > sn.estadistica.caidas);
+}
+
+/* QoS -1: ninguna confirmación; la FIFO se vacía al ritmo de envío y lo perdido no vuelve */
+static void pruebas_QoSm1(void)
+{
+	srand(42);
+	inicia_Pasarela(20);
+	inicia_EnlaceSN(&sn, &transporte, false, TOPIC_PRUEBA, ID_CLIENTE);
+	reinicia_FIFO();
+	simula(3000U * 1000U + 10000U, 300);
+	COMPRUEBA(cabeza == cola && sn.estadistica.enviados == 300 && sn.estadistica.entregados == 300);
+	COMPRUEBA(pasarela.recibidos + pasarela.huecos == 300 && pasarela.huecos > 30 && pasarela.huecos < 90);
+	COMPRUEBA(sn.estadistica.reenvios == 0 && sn.estadistica.bytes_rx == 0 && sn.estadistica.bytes_tx == 300U * 47U);
+}
+
+/* Respuestas de la pasarela distintas del PUBACK aceptado */
+static void pruebas_Respuestas(void)
+{
+	uint8_t puback_ajeno[7] = { 7, SN_PUBACK, 0x00, 0x42, 0x00, 0x63, SN_ACEPTADO };
+
+	inicia_Pasarela(0);
+	inicia_EnlaceSN(&sn, &transporte, true, TOPIC_PRUEBA, ID_CLIENTE);
+	reinicia_FIFO();
+	conecta_EnlaceSN(&sn);
+
+	/* Congestión: se reenvía con DUP pasado T_REINTENTO_SN_MS sin gastar reintentos, aunque se repita */
+	pasarela.n_congestion = N_REINTENTOS_SN + 1;
+	mete_Media();
+	simula(60000, 1);
+	COMPRUEBA(cabeza == cola && pasarela.recibidos == 1 && sn.estadistica.congestion == N_REINTENTOS_SN + 1);
+	COMPRUEBA(sn.estadistica.caidas == 0 && pasarela.con_dup == N_REINTENTOS_SN + 1);
+
+	/* Topic rechazado: la media se descarta para no bloquear la FIFO */
+	pasarela.n_rechazo = 1;
+	mete_Media();
+	simula(1000, 2);
+	COMPRUEBA(cabeza == cola && pasarela.recibidos == 1 && sn.estadistica.rechazados == 1);
+	COMPRUEBA(sn.estadistica.entregados == 1);
+
+	/* Un PUBACK de otro MsgId no entrega la media en vuelo */
+	pasarela.callada = true;
+	mete_Media();
+	COMPRUEBA(servicio_EnlaceSN(&sn, cabeza_FIFO()) == 0 && sn.en_vuelo);
+	pasarela.callada = false;
+	contesta(puback_ajeno, sizeof(puback_ajeno));
+	COMPRUEBA(servicio_EnlaceSN(&sn, cabeza_FIFO()) == 0 && sn.en_vuelo && sn.estadistica.entregados == 1);
+	simula(10000, 3);
+	COMPRUEBA(cabeza == cola && pasarela.recibidos == 2);
+
+	/* Un datagrama con la longitud mal puesta se ignora */
+	contesta((const uint8_t[]){ 9, SN_DISCONNECT }, 2);
+	COMPRUEBA(servicio_EnlaceSN(&sn, NULL) == 0 && sn.estado == SN_ACTIVO);
+
+	/* DISCONNECT de la pasarela: enlace caído y se reabre */
+	contesta((const uint8_t[]){ 2, SN_DISCONNECT }, 2);
+	COMPRUEBA(servicio_EnlaceSN(&sn, NULL) == -1 && sn.estado == SN_DESCONECTADO);
+	COMPRUEBA(servicio_EnlaceSN(&sn, NULL) == -1);
+
+	/* CONNECT rechazado */
+	pasarela.respuesta_connack = 0x03;
+	COMPRUEBA(!conecta_EnlaceSN(&sn) && sn.estado == SN_DESCONECTADO);
+	pasarela.respuesta_connack = SN_ACEPTADO;
+	COMPRUEBA(conecta_EnlaceSN(&sn));
+
+	/* Socket roto al enviar o al leer */
+	socket_roto = true;
+	mete_Media();
+	COMPRUEBA(servicio_EnlaceSN(&sn, cabeza_FIFO()) == -1 && sn.estado == SN_DESCONECTADO && cabeza != cola);
+	COMPRUEBA(!conecta_EnlaceSN(&sn));
+	socket_roto = false;
+	COMPRUEBA(conecta_EnlaceSN(&sn));
+	simula(1000, 4);
+	COMPRUEBA(cabeza == cola && pasarela.recibidos == 3);
+}
+
+/* Pasarela callada: tras N_REINTENTOS_SN reenvíos el enlace cae, la media sigue en la FIFO y sale al volver */
+static void pruebas_Callada(void)
+{
+	uint32_t t_inicio;
+
+	inicia_Pasarela(0);
+	inicia_EnlaceSN(&sn, &transporte, true, TOPIC_PRUEBA, ID_CLIENTE);
+	reinicia_FIFO();
+	conecta_EnlaceSN(&sn);
+	pasarela.callada = true;
+	mete_Media();
+	t_inicio = tick_anfitrion;
+	while (servicio_EnlaceSN(&sn, cabeza_FIFO()) == 0) tick_anfitrion += T_VUELTA_MS;
+	COMPRUEBA(sn.estadistica.reenvios == N_REINTENTOS_SN && sn.estadistica.caidas == 1);
+	COMPRUEBA(tick_anfitrion - t_inicio >= (N_REINTENTOS_SN + 1) * T_REINTENTO_SN_MS);
+	COMPRUEBA(tick_anfitrion - t_inicio < (N_REINTENTOS_SN + 1) * (T_REINTENTO_SN_MS + T_VUELTA_MS + T_LECTURA_MS));
+	COMPRUEBA(cabeza != cola && sn.estado == SN_DESCONECTADO);
+
+	/* Reabrir espera el CONNACK T_REINTENTO_SN_MS y no más */
+	t_inicio = tick_anfitrion;
+	COMPRUEBA(!conecta_EnlaceSN(&sn));
+	COMPRUEBA(tick_anfitrion - t_inicio >= T_REINTENTO_SN_MS && tick_anfitrion - t_inicio < T_REINTENTO_SN_MS + 50);
+
+	/* Con datos generados mientras tanto: al volver salen todos, la primera con un MsgId nuevo */
+	simula(30000, 4);
+	COMPRUEBA(cabeza != cola && pasarela.recibidos == 0);
+	pasarela.callada = false;
+	simula(60000, 4);
+	COMPRUEBA(cabeza == cola && pasarela.recibidos == 4 && pasarela.duplicados == 0 && pasarela.con_dup == 0);
+	COMPRUEBA(sn.id_mensaje == 5);
+}
+
+/* Enlace sin datos una hora: PINGREQ a la mitad de la duración de la sesión, sin caídas */
+static void pruebas_Vivo(void)
+{
+	char texto[SN_TEXTO_SIZE];
+
+	srand(7);
+	inicia_Pasarela(0);
+	inicia_EnlaceSN(&sn, &transporte, true, TOPIC_PRUEBA, ID_CLIENTE);
+	reinicia_FIFO();
+	simula(3600U * 1000U, 0);
+	COMPRUEBA(sn.estado == SN_ACTIVO && sn.estadistica.caidas == 0 && n_reaperturas == 1);
+	COMPRUEBA(sn.estadistica.pings >= 3600 / (DURACION_SN_S / 2) - 1 && sn.estadistica.pings <= 3600 / (DURACION_SN_S / 2));
+	COMPRUEBA(pasarela.pings == sn.estadistica.pings && !sn.ping_pendiente);
+
+	/* Con pérdidas el PINGREQ se repite, y el enlace sigue vivo */
+	inicia_Pasarela(20);
+	inicia_EnlaceSN(&sn, &transporte, true, TOPIC_PRUEBA, ID_CLIENTE);
+	simula(3600U * 1000U, 0);
+	COMPRUEBA(sn.estadistica.reenvios > 0 && pasarela.pings > sn.estadistica.pings);
+
+	/* Cierre: DISCONNECT y nada en vuelo */
+	cierra_EnlaceSN(&sn);
+	COMPRUEBA(sn.estado == SN_DESCONECTADO && ultima_trama[1] == SN_DISCONNECT);
+	COMPRUEBA(informe_EnlaceSN(&sn, texto, sizeof(texto)) < (int)sizeof(texto) && strstr(texto, "MQTT-SN QoS 1") != NULL);
+	printf("%s", texto);
+}
+
+int main(void)
+{
+	tick_anfitrion = 1000;
+	pruebas_Tramas();
+	pruebas_QoS1();
+	pruebas_QoSm1();
+	pruebas_Respuestas();
+	pruebas_Callada();
+	pruebas_Vivo();
+	return fin_Pruebas("Enlace_MQTTSN");
+}
@@ -0,0 +1,101 @@
+/******************************************************************************
+* @file    prueba_Estadistica.c
+* @brief   Estadística en streaming (Estadistica_Ventana.h): media, desviación,
+* mínimo y máximo de Welford frente a una referencia en double de dos pasadas,
+* y el criterio de ubicación válida de la media.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+#include "Estadistica_Ventana.h"
+
+static double aleatorio(void)
+{
+	return rand() / (double)RAND_MAX;
+}
+
+int main(void)
+{
+	static megaDato v[3600];
+	const int tamanos[] = { 1, 2, 10, 60, 900, 3600 };
+	estadisticaVentana e;
+	megaDato media;
+
+	srand(3);
+
+	for (unsigned t = 0; t < sizeof(tamanos) / sizeof(tamanos[0]); t++) {
+		int n = tamanos[t], n_gps = 0;
+		double suma = 0, m2 = 0, mn = 1e9, mx = -1e9, suma_lat = 0, ref, desv;
+
+		reinicia_Estadistica(&e);
+		for (int i = 0; i < n; i++) {
+			megaDato m = { 0 };
+			for (int k = 0; k < N_IRRADIANCIAS; k++) m.irradiancia[k] = 900 + 200 * aleatorio() + 50 * k;
+			m.temperatura = 25 + 5 * aleatorio();
+			m.presion = 1013 + aleatorio();
+			m.humedad = 40 + aleatorio();
+			if (aleatorio() < 0.7) {
+				m.latitud = 40.4 + 0.01 * aleatorio();
+				m.longitud = -3.7 + 0.01 * aleatorio();
+				m.altitud = 650 + aleatorio();
+				m.velocidad = 50 * aleatorio();
+			}
+			else {
+				m.latitud = NAN;
+			}
+			m.seg = i % 60;
+			v[i] = m;
+			acumula_Estadistica(&e, &m);
+		}
+
+		/* Referencia en dos pasadas, en double */
+		for (int i = 0; i < n; i++) suma += v[i].irradiancia[2];
+		ref = suma / n;
+		for (int i = 0; i < n; i++) {
+			double d = v[i].irradiancia[2] - ref;
+			m2 += d * d;
+			if (v[i].irradiancia[2] < mn) mn = v[i].irradiancia[2];
+			if (v[i].irradiancia[2] > mx) mx = v[i].irradiancia[2];
+			if (noesNAN(v[i].latitud)) { suma_lat += v[i].latitud; n_gps++; }
+		}
+		desv = (n > 1) ? sqrt(m2 / (n - 1)) : 0;
+
+		COMPRUEBA(media_Estadistica(&e, &media));
+		COMPRUEBA(e.n_muestras == (uint32_t)n && e.n_gps_validos == (uint32_t)n_gps);
+		COMPRUEBA_CERCA(media.irradiancia[2], ref, 1e-5 * ref);
+		COMPRUEBA_CERCA(desviacion_Campo(&e.irradiancia[2]), desv, 1e-3 * desv + 1e-4);
+		COMPRUEBA((float)mn == e.irradiancia[2].min && (float)mx == e.irradiancia[2].max);
+		COMPRUEBA(media.seg == v[n - 1].seg);		// la fecha es la de la última muestra
+		COMPRUEBA(media.ubicacion_fix == ((n - n_gps) <= n / 2));
+		if (n_gps > 0) COMPRUEBA_CERCA(media.latitud, suma_lat / n_gps, 1e-4);
+		else COMPRUEBA(!noesNAN(media.latitud));
+	}
+
+	/* Una hora de irradiancia casi constante: la suma de cuadrados en float perdería toda la varianza,
+	 * Welford la mantiene */
+	reinicia_Estadistica(&e);
+	for (int i = 0; i < 3600; i++) {
+		megaDato m = { 0 };
+		m.irradiancia[0] = 1000.0f + ((i % 2) ? 0.5f : -0.5f);
+		acumula_Estadistica(&e, &m);
+	}
+	COMPRUEBA_CERCA(e.irradiancia[0].media, 1000.0, 1e-3);
+	COMPRUEBA_CERCA(desviacion_Campo(&e.irradiancia[0]), 0.50007, 1e-3);
+
+	/* Sin ninguna ubicación válida: posición a NaN y sin fix */
+	reinicia_Estadistica(&e);
+	for (int i = 0; i < 5; i++) {
+		megaDato m = { 0 };			// coordenadas a 0: no válidas
+		acumula_Estadistica(&e, &m);
+	}
+	COMPRUEBA(media_Estadistica(&e, &media));
+	COMPRUEBA(!media.ubicacion_fix && !noesNAN(media.latitud) && !noesNAN(media.velocidad));
+
+	/* Ventana vacía: no hay media y el registro no se toca */
+	reinicia_Estadistica(&e);
+	media.temperatura = 12.5f;
+	COMPRUEBA(!media_Estadistica(&e, &media) && media.temperatura == 12.5f);
+	COMPRUEBA(desviacion_Campo(&e.temperatura) == 0.0f);
+
+	return fin_Pruebas("Estadistica_Ventana");
+}
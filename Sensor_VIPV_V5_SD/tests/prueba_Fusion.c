@@ -0,0 +1,187 @@
+/******************************************************************************
+* @file    prueba_Fusion.c
+* @brief   Politica de fusión adaptativa (Fusion_Adaptativa.h) sobre un trayecto
+* sintético segundo a segundo: semáforo más corto que la espera de parado,
+* aparcamiento con un bache a mitad, perturbación magnética con su histéresis,
+* paradas sin fix GPS y la continuidad del rumbo en el relevo 9X/6X. Motion-FX
+* y el TIM6 son sustitutos; se comprueban las transiciones, el periodo que recibe
+* el filtro, el magnetometro apagado en 6X y la cuenta de despertares ahorrados.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+#include "motion_fx.h"
+
+/* mi_MEMS.h arrastra el BSP de los sensores y el DWT: solo hacen falta sus datos y MX_MEMS_Process() */
+#define INC_MI_MEMS_H_
+#define ALGORITHM_FREQ   50.0f
+#define FROM_MG_TO_G     0.001f
+
+typedef struct { int32_t x, y, z; } MOTION_SENSOR_Axes_t;
+static MOTION_SENSOR_Axes_t AccValue;
+static uint32_t tiempo_FX_us = 0;
+
+typedef struct { uint32_t ARR, CNT; } TIM_HandleTypeDef;
+#define __HAL_TIM_SET_AUTORELOAD(h, v)   ((h)->ARR = (v))
+#define __HAL_TIM_SET_COUNTER(h, v)      ((h)->CNT = (v))
+TIM_HandleTypeDef htim6;
+
+#define US_9X    900U			// Coste simulado de una iteración de cada motor
+#define US_6X    450U
+#define REF_6X   70.0f			// El 6X no tiene norte: su rumbo va desplazado respecto al real
+
+/* Motion-FX sustituto: rumbo real, error de rumbo del 9X y ruido del acelerometro del segundo en curso */
+static bool activo_9X = true, activo_6X = false;
+static float rumbo = 0.0f, deriva_6X = 0.0f, error_rumbo = 2.0f, ruido_mg = 0.0f;
+static int n_periodo_mal = 0, n_mag_mal = 0, n_lecturas_mag = 0;
+static float esperado_dt = 1.0f / ALGORITHM_FREQ;
+
+void MotionFX_enable_6X(MFX_engine_state_t e) { activo_6X = (e == MFX_ENGINE_ENABLE); }
+void MotionFX_enable_9X(MFX_engine_state_t e) { activo_9X = (e == MFX_ENGINE_ENABLE); }
+
+static void cuaternion_Guinada(float grados, float q[4])
+{
+	q[0] = 0.0f;  q[1] = 0.0f;
+	q[2] = sinf(deg2rad(grados) * 0.5f);
+	q[3] = cosf(deg2rad(grados) * 0.5f);
+}
+
+static float azar_Normal(void)
+{
+	float u = (rand() + 1.0f) / (RAND_MAX + 2.0f), v = (rand() + 1.0f) / (RAND_MAX + 2.0f);
+	return sqrtf(-2.0f * logf(u)) * cosf(2.0f * (float)M_PI * v);
+}
+
+void MX_MEMS_Process(MFX_output_t* salida, float delta_time, bool lee_magnetometro)
+{
+	if (fabsf(delta_time - esperado_dt) > 1e-6f) n_periodo_mal++;
+	if (lee_magnetometro != activo_9X) n_mag_mal++;
+	if (lee_magnetometro) n_lecturas_mag++;
+
+	cuaternion_Guinada(rumbo, salida->quaternion_9X);
+	cuaternion_Guinada(rumbo + REF_6X + deriva_6X, salida->quaternion_6X);
+	salida->headingErr_9X = activo_9X ? error_rumbo : 0.0f;
+	tiempo_FX_us = (activo_9X ? US_9X : 0U) + (activo_6X ? US_6X : 0U);
+
+	AccValue.x = (int32_t)lroundf(ruido_mg * azar_Normal());
+	AccValue.y = (int32_t)lroundf(ruido_mg * azar_Normal());
+	AccValue.z = 1000 + (int32_t)lroundf(ruido_mg * azar_Normal());
+}
+
+#include "Actitud_MEMS.h"
+#include "Fusion_Adaptativa.h"
+
+/* Cuenta del trayecto */
+static uint32_t segundos_totales = 0, ticks_totales = 0;
+static int n_rumbo_mal = 0, n_9X_encendido_en_6X = 0;
+
+static float dif_Rumbo(float a, float b)
+{
+	float d = fmodf(fabsf(a - b), 360.0f);
+	return (d > 180.0f) ? 360.0f - d : d;
+}
+
+/* n segundos con una velocidad GPS, fix, ruido del acelerometro (mg), error de rumbo y giro.
+ * Devuelve el segundo (desde 1) del primer cambio de modo, o 0 si no cambia. */
+static int circula(int n, float velocidad, bool fix, float ruido, float error, float giro_dps)
+{
+	int cambio = 0;
+
+	ruido_mg = ruido;
+	error_rumbo = error;
+	for (int s = 1; s <= n; s++) {
+		modoFusion antes = fusion.modo;
+		int ticks = (int)lroundf(fusion.frecuencia);
+
+		esperado_dt = 1.0f / fusion.frecuencia;
+		for (int t = 0; t < ticks; t++) {
+			float q[4];
+
+			rumbo = fmodf(rumbo + giro_dps / fusion.frecuencia + 360.0f, 360.0f);
+			deriva_6X += 0.002f / fusion.frecuencia;		// deriva del giróscopo sin magnetometro
+			computa_FusionAdaptativa(q);
+			if (dif_Rumbo(guinada_Cuaternion(q), rumbo) > 1.0f) n_rumbo_mal++;
+			if (!fusion.motor_9X && (fusion.ticks_solape == 0) && activo_9X) n_9X_encendido_en_6X++;
+		}
+		ticks_totales += (uint32_t)ticks;
+		segundos_totales++;
+		evalua_FusionAdaptativa(velocidad, fix);
+		if ( (cambio == 0) && (fusion.modo != antes) ) cambio = s;
+	}
+	return cambio;
+}
+
+#define EN_MARCHA     60.0f		// ruido del acelerometro circulando, en [mg]
+#define QUIETO         4.0f		// y parado con el motor al ralentí
+
+int main(void)
+{
+	uint32_t cambios;
+
+	srand(27);
+	inicia_FusionAdaptativa(ALGORITHM_FREQ);
+	COMPRUEBA(fusion.modo == FUSION_MOVIMIENTO && fusion.motor_9X && activo_9X && !activo_6X);
+	COMPRUEBA(htim6.ARR == 199 && htim6.CNT == 0);
+
+	/* Circulando, y un semáforo de 20 s: menos de SEGUNDOS_PARA_PARADO, no cambia nada */
+	COMPRUEBA(circula(60, 40.0f, true, EN_MARCHA, 2.0f, 3.0f) == 0);
+	COMPRUEBA(circula(20, 0.0f, true, QUIETO, 2.0f, 0.0f) == 0);
+	COMPRUEBA(circula(30, 30.0f, true, EN_MARCHA, 2.0f, -2.0f) == 0);
+
+	/* Error de rumbo entre ERROR_RUMBO_RECUPERADO y ERROR_RUMBO_PERTURBADO: sigue en 9X */
+	COMPRUEBA(circula(10, 30.0f, true, EN_MARCHA, 10.0f, 1.0f) == 0 && fusion.motor_9X);
+
+	/* Paso bajo un puente: 6X en el segundo de la perturbación, con solape de TICKS_SOLAPE_MOTORES */
+	circula(1, 30.0f, true, EN_MARCHA, 25.0f, 1.0f);
+	COMPRUEBA(fusion.perturbacion_mag && !fusion.motor_9X && fusion.ticks_solape == TICKS_SOLAPE_MOTORES);
+	COMPRUEBA(fusion.modo == FUSION_MOVIMIENTO && fusion.frecuencia == ALGORITHM_FREQ);
+	circula(1, 30.0f, true, EN_MARCHA, 25.0f, 1.0f);
+	COMPRUEBA(fusion.ticks_solape == 0 && !activo_9X && activo_6X);
+	/* En 6X el error no se observa: SEGUNDOS_MAG_ESTABLE después se reintenta el 9X */
+	circula(SEGUNDOS_MAG_ESTABLE - 1, 30.0f, true, EN_MARCHA, 25.0f, 1.0f);
+	COMPRUEBA(fusion.perturbacion_mag && !fusion.motor_9X);
+	circula(1, 30.0f, true, EN_MARCHA, 2.0f, 1.0f);
+	COMPRUEBA(!fusion.perturbacion_mag && fusion.motor_9X && activo_9X && !activo_6X);
+	/* Si al volver sigue perturbado, vuelve al 6X en ese mismo segundo */
+	circula(1, 30.0f, true, EN_MARCHA, 25.0f, 0.0f);
+	COMPRUEBA(fusion.perturbacion_mag && !fusion.motor_9X);
+	circula(SEGUNDOS_MAG_ESTABLE, 30.0f, true, EN_MARCHA, 2.0f, 0.0f);
+	COMPRUEBA(fusion.motor_9X);
+
+	/* Aparcamiento: un bache en el segundo 29 reinicia la cuenta; el modo cambia justo al segundo 30 */
+	cambios = fusion.cambios_modo;
+	COMPRUEBA(circula(SEGUNDOS_PARA_PARADO - 1, 0.0f, true, QUIETO, 2.0f, 0.0f) == 0);
+	COMPRUEBA(circula(1, 0.0f, true, EN_MARCHA, 2.0f, 0.0f) == 0);
+	COMPRUEBA(circula(120, 0.0f, true, QUIETO, 2.0f, 0.0f) == SEGUNDOS_PARA_PARADO);
+	COMPRUEBA(fusion.modo == FUSION_PARADO && fusion.frecuencia == FREC_FUSION_PARADO && !fusion.motor_9X);
+	COMPRUEBA(htim6.ARR == 999 && htim6.CNT == 0 && fusion.cambios_modo == cambios + 1);
+	/* Por encima de VELOCIDAD_PARADO se sale en el acto, aunque el acelerometro siga quieto */
+	COMPRUEBA(circula(10, 3.0f, true, QUIETO, 2.0f, 0.0f) == 1);
+	COMPRUEBA(fusion.modo == FUSION_MOVIMIENTO);
+	COMPRUEBA(circula(SEGUNDOS_PARA_PARADO, 0.0f, true, QUIETO, 2.0f, 0.0f) == SEGUNDOS_PARA_PARADO);
+
+	/* Arranque: el primer segundo con movimiento vuelve a 50 Hz y al 9X */
+	COMPRUEBA(circula(1, 15.0f, true, EN_MARCHA, 2.0f, 5.0f) == 1);
+	COMPRUEBA(fusion.frecuencia == ALGORITHM_FREQ && htim6.ARR == 199 && fusion.motor_9X && activo_9X);
+	COMPRUEBA(circula(60, 50.0f, true, EN_MARCHA, 2.0f, -4.0f) == 0);
+
+	/* Sin fix GPS decide solo el acelerometro; la velocidad NaN se ignora */
+	COMPRUEBA(circula(40, NAN, false, QUIETO, 2.0f, 0.0f) == SEGUNDOS_PARA_PARADO);
+	COMPRUEBA(circula(5, 0.0f, false, EN_MARCHA, 2.0f, 2.0f) == 1);
+	COMPRUEBA(circula(40, 80.0f, true, QUIETO, 2.0f, 0.0f) == 0);		// autopista lisa: el GPS manda
+
+	/* Periodo del filtro, magnetometro apagado en 6X y rumbo continuo en todos los relevos */
+	COMPRUEBA(n_periodo_mal == 0 && n_mag_mal == 0 && n_9X_encendido_en_6X == 0);
+	COMPRUEBA(n_rumbo_mal == 0);
+
+	/* Despertares ahorrados = los que habría a frecuencia nominal menos los ejecutados */
+	COMPRUEBA(fusion.despertares_ahorrados == (uint32_t)ALGORITHM_FREQ * segundos_totales - ticks_totales);
+	COMPRUEBA(fusion.ticks_9X + fusion.ticks_6X == ticks_totales);
+	COMPRUEBA(fusion.us_6X == fusion.ticks_6X * US_6X);
+	COMPRUEBA(fusion.us_9X >= fusion.ticks_9X * US_9X && n_lecturas_mag == (int)fusion.ticks_9X);
+	printf("Fusion: %lu s, %lu despertares de %lu ahorrados, %lu lecturas del magnetometro\n",
+		   (unsigned long)segundos_totales, (unsigned long)fusion.despertares_ahorrados,
+		   (unsigned long)((uint32_t)ALGORITHM_FREQ * segundos_totales), (unsigned long)n_lecturas_mag);
+
+	return fin_Pruebas("Fusion_Adaptativa");
+}
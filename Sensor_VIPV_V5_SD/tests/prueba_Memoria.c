@@ -0,0 +1,250 @@
+/******************************************************************************
+* @file    prueba_Memoria.c
+* @brief   Monitor de memoria (Monitor_Memoria.h) y cuentas por clase de heap.c:
+* fragmentación de una lista libre de newlib-nano construida a mano, máximos
+* de cada clase de reserva a lo largo de reservas y liberaciones con el calloc
+* del PC, y la marca de pila pintada sobre una RAM simulada, con sbrk(),
+* __get_MSP() y _estack apuntando dentro de ella.
+******************************************************************************
+*/
+
+#include <malloc.h>			// malloc_usable_size(), como heap.c
+#include "comprueba.h"
+
+/* ---- RAM simulada: el heap empieza abajo y la pila baja desde _estack, al final ---- */
+
+#define RAM_PALABRAS  4096			// 16 KiB
+#define RAM_BYTES     (RAM_PALABRAS * 4)
+
+uint32_t ram_anfitrion[RAM_PALABRAS] __attribute__((aligned(8)));
+static char* brk_anfitrion = (char*)ram_anfitrion;
+static uint32_t* sp_anfitrion = &ram_anfitrion[RAM_PALABRAS];
+
+#define sbrk      sbrk_anfitrion		// el sbrk() del PC no sirve: su heap no está debajo de esta pila
+#define _estack   ram_anfitrion[RAM_PALABRAS]
+
+static uintptr_t __get_MSP(void) { return (uintptr_t)sp_anfitrion; }
+
+#define INC_CONFIGURACION_SD_H_			// Configuracion_SD.h arrastra FatFs y cJSON: solo hace falta esto
+#define CONFIG_ARENA_SIZE  4096
+static size_t config_arena_max = 1234;
+
+#include "Monitor_Memoria.h"
+
+#undef sbrk
+#undef _estack
+
+void* sbrk_anfitrion(intptr_t incremento)
+{
+	char* anterior = brk_anfitrion;
+
+	brk_anfitrion += incremento;
+	return anterior;
+}
+
+bloqueLibre* __malloc_free_list = NULL;
+char* __malloc_sbrk_start = (char*)ram_anfitrion;
+
+/* Los pide stack_measure_prologue() de heap.c, que aquí no se llama */
+uint32_t _estack;
+uint32_t _Min_Stack_Size;
+
+/* ---- Pruebas ---- */
+
+static void enlaza(bloqueLibre* b, const long* tam, int n)
+{
+	for (int i = 0; i < n; i++) {
+		b[i].tam = tam[i];
+		b[i].siguiente = (i + 1 < n) ? &b[i + 1] : NULL;
+	}
+}
+
+/* Fragmentación = 100 * (1 - mayor bloque / total libre) */
+static void pruebas_ListaLibre(void)
+{
+	static bloqueLibre b[16];
+	static const long tres[] = {1000, 200, 300}, uno[] = {4096}, diez[] = {100, 100, 100, 100, 100, 100, 100, 100, 100, 100};
+	estadoHeap e;
+
+	analiza_ListaLibre(NULL, &e);
+	COMPRUEBA(e.libre == 0 && e.mayor_libre == 0 && e.n_libres == 0 && e.fragmentacion == 0);
+
+	enlaza(b, uno, 1);
+	analiza_ListaLibre(b, &e);
+	COMPRUEBA(e.libre == 4096 && e.mayor_libre == 4096 && e.n_libres == 1 && e.fragmentacion == 0);
+
+	enlaza(b, tres, 3);
+	analiza_ListaLibre(b, &e);
+	COMPRUEBA(e.libre == 1500 && e.mayor_libre == 1000 && e.n_libres == 3 && e.fragmentacion == 34);
+
+	/* El mismo total en diez huecos iguales: una reserva de más de 100 B falla con 1000 B libres */
+	enlaza(b, diez, 10);
+	analiza_ListaLibre(b, &e);
+	COMPRUEBA(e.libre == 1000 && e.mayor_libre == 100 && e.n_libres == 10 && e.fragmentacion == 90);
+
+	/* n huecos sueltos de 64 B, como al liberar bloques alternos, y el mismo total ya juntado */
+	for (int n = 1; n <= 8; n++) {
+		long tam[8];
+		for (int i = 0; i < n; i++) tam[i] = 64;
+		enlaza(b, tam, n);
+		analiza_ListaLibre(b, &e);
+		COMPRUEBA(e.fragmentacion == 100 - 100 / n);
+	}
+	{
+		long juntos[] = {64 * 8};
+		enlaza(b, juntos, 1);
+		analiza_ListaLibre(b, &e);
+		COMPRUEBA(e.libre == 512 && e.fragmentacion == 0);
+	}
+}
+
+/* heap_class_alloc()/heap_class_free(): uso actual, máximo, mayor reserva, reservas y fallos por clase */
+static void pruebas_Clases(void)
+{
+	heap_class_stat_t s[HEAP_CLASS_COUNT];
+	void* p[8];
+	size_t uso[8], pico = 0, actual = 0;
+
+	heap_class_stat(s);
+	for (int i = 0; i < HEAP_CLASS_COUNT; i++) {
+		COMPRUEBA(s[i].current == 0 && s[i].peak == 0 && s[i].allocs == 0 && s[i].failures == 0);
+	}
+
+	/* FIFO: ocho nodos de tamaños crecientes, se liberan los pares y se reservan otros cuatro más pequeños */
+	for (int i = 0; i < 8; i++) {
+		p[i] = heap_class_alloc(HEAP_CLASS_FIFO, 1, 40 + 24 * i);
+		COMPRUEBA(p[i] != NULL && ((uint8_t*)p[i])[0] == 0);
+		uso[i] = malloc_usable_size(p[i]);
+		actual += uso[i];
+	}
+	pico = actual;
+	heap_class_stat(s);
+	COMPRUEBA(s[HEAP_CLASS_FIFO].current == actual && s[HEAP_CLASS_FIFO].peak == pico && s[HEAP_CLASS_FIFO].allocs == 8);
+	COMPRUEBA(s[HEAP_CLASS_FIFO].largest == uso[7] && uso[7] >= 40 + 24 * 7);
+
+	for (int i = 0; i < 8; i += 2) {
+		heap_class_free(HEAP_CLASS_FIFO, p[i]);
+		actual -= uso[i];
+	}
+	heap_class_stat(s);
+	COMPRUEBA(s[HEAP_CLASS_FIFO].current == actual && s[HEAP_CLASS_FIFO].peak == pico);	// el máximo se queda
+
+	for (int i = 0; i < 8; i += 2) {
+		p[i] = heap_class_alloc(HEAP_CLASS_FIFO, 2, 8);
+		uso[i] = malloc_usable_size(p[i]);
+		actual += uso[i];
+	}
+	heap_class_stat(s);
+	COMPRUEBA(s[HEAP_CLASS_FIFO].current == actual && actual < pico && s[HEAP_CLASS_FIFO].peak == pico);
+	COMPRUEBA(s[HEAP_CLASS_FIFO].allocs == 12 && s[HEAP_CLASS_FIFO].largest == uso[7]);
+
+	/* Una reserva imposible cuenta como fallo y devuelve NULL, sin tocar el uso */
+	COMPRUEBA(heap_class_alloc(HEAP_CLASS_NET, SIZE_MAX / 2, 4) == NULL);
+	heap_class_free(HEAP_CLASS_NET, NULL);
+	heap_class_stat(s);
+	COMPRUEBA(s[HEAP_CLASS_NET].failures == 1 && s[HEAP_CLASS_NET].allocs == 0 && s[HEAP_CLASS_NET].current == 0);
+
+	/* Las clases no se mezclan: lo de NMEA no sube el máximo de FIFO */
+	{
+		void* q = heap_class_alloc(HEAP_CLASS_NMEA, 1, 4096);
+		heap_class_stat(s);
+		COMPRUEBA(s[HEAP_CLASS_NMEA].current >= 4096 && s[HEAP_CLASS_NMEA].peak == s[HEAP_CLASS_NMEA].current);
+		COMPRUEBA(s[HEAP_CLASS_FIFO].peak == pico && s[HEAP_CLASS_TLS].allocs == 0);
+		heap_class_free(HEAP_CLASS_NMEA, q);
+	}
+
+	for (int i = 0; i < 8; i++) heap_class_free(HEAP_CLASS_FIFO, p[i]);
+	heap_class_stat(s);
+	COMPRUEBA(s[HEAP_CLASS_FIFO].current == 0 && s[HEAP_CLASS_NMEA].current == 0);
+	COMPRUEBA(s[HEAP_CLASS_FIFO].peak == pico && s[HEAP_CLASS_NMEA].peak >= 4096);
+}
+
+/* pinta_Pila()/marca_Pila() sobre un trozo suelto */
+static void pruebas_Marca(void)
+{
+	static uint32_t hueco[64];
+
+	pinta_Pila(&hueco[8], &hueco[56]);
+	COMPRUEBA(hueco[7] == 0 && hueco[8] == PATRON_PILA && hueco[55] == PATRON_PILA && hueco[56] == 0);
+	COMPRUEBA(marca_Pila(&hueco[8], &hueco[56]) == &hueco[56]);	// sin pisar
+	hueco[40] = 0x12345678U;
+	hueco[50] = 0;
+	COMPRUEBA(marca_Pila(&hueco[8], &hueco[56]) == &hueco[40]);
+	COMPRUEBA(marca_Pila(&hueco[41], &hueco[56]) == &hueco[50]);
+	hueco[8] = 1;
+	COMPRUEBA(marca_Pila(&hueco[8], &hueco[56]) == &hueco[8]);
+}
+
+/* Usa 'palabras' de pila por debajo del sp actual, como una llamada profunda */
+static void usa_Pila(int palabras)
+{
+	for (int i = 1; i <= palabras; i++) {
+		*(sp_anfitrion - i) = (uint32_t)i;
+	}
+}
+
+/* inicia_MonitorMemoria() y mide_Memoria() sobre la RAM simulada: pila máxima, holgura y su mínimo, avisos */
+static void pruebas_Pila(void)
+{
+	static bloqueLibre libres[2];
+	static const long tam[] = {256, 64};
+	char texto[640];
+	uint32_t holgura_antes;
+
+	/* Heap de 2 KiB pedidos, sp 1 KiB por debajo de _estack */
+	brk_anfitrion = (char*)ram_anfitrion + 2048;
+	sp_anfitrion = &ram_anfitrion[RAM_PALABRAS - 256];
+	enlaza(libres, tam, 2);
+	__malloc_free_list = libres;
+
+	inicia_MonitorMemoria();
+	COMPRUEBA(memoria.suelo == (uint32_t*)brk_anfitrion);
+	COMPRUEBA((uint8_t*)memoria.techo == (uint8_t*)sp_anfitrion - MARGEN_PINTADO_PILA);
+	COMPRUEBA(*memoria.suelo == PATRON_PILA && *(memoria.techo - 1) == PATRON_PILA && *memoria.techo != PATRON_PILA);
+	COMPRUEBA(memoria.arena == 2048 && memoria.heap.libre == 320 && memoria.heap.fragmentacion == 20);
+
+	/* Nada ha bajado del techo pintado: la pila medida es hasta el techo */
+	COMPRUEBA(memoria.pila_max == 1024 + MARGEN_PINTADO_PILA);
+	COMPRUEBA(memoria.holgura == RAM_BYTES - 2048 - 1024 - MARGEN_PINTADO_PILA && memoria.holgura_min == memoria.holgura);
+
+	/* Una llamada profunda de 3 KiB por debajo del sp: la marca se queda aunque la pila vuelva a subir */
+	usa_Pila(768);
+	mide_Memoria(&memoria);
+	COMPRUEBA(memoria.pila_max == 1024 + 3072);
+	COMPRUEBA(memoria.holgura == RAM_BYTES - 2048 - 1024 - 3072 && memoria.holgura_min == memoria.holgura);
+	holgura_antes = memoria.holgura;
+	mide_Memoria(&memoria);
+	COMPRUEBA(memoria.pila_max == 1024 + 3072 && memoria.holgura == holgura_antes);
+
+	/* Los fallos de reserva nuevos se avisan una vez: el de red de pruebas_Clases() y luego uno de FIFO */
+	COMPRUEBA(memoria.clase[HEAP_CLASS_NET].failures == 1);
+	COMPRUEBA(avisos_Memoria(&memoria) && !avisos_Memoria(&memoria));
+	heap_class_alloc(HEAP_CLASS_FIFO, SIZE_MAX / 2, 4);
+	mide_Memoria(&memoria);
+	COMPRUEBA(memoria.clase[HEAP_CLASS_FIFO].failures == 1);
+	COMPRUEBA(avisos_Memoria(&memoria) && !avisos_Memoria(&memoria));
+
+	/* El heap crece 9 KiB y escribe en lo pintado: no es pila, pero la holgura baja y se avisa mientras siga baja */
+	memset(sbrk_anfitrion(9216), 0, 9216);
+	mide_Memoria(&memoria);
+	COMPRUEBA(memoria.arena == 2048 + 9216 && memoria.pila_max == 1024 + 3072);
+	COMPRUEBA(memoria.holgura == holgura_antes - 9216 && memoria.holgura_min == memoria.holgura);
+	COMPRUEBA(memoria.holgura < HOLGURA_AVISO_PILA);
+	COMPRUEBA(avisos_Memoria(&memoria) && avisos_Memoria(&memoria));
+
+	/* Informe y resumen caben en lo prometido */
+	COMPRUEBA(informe_Memoria(&memoria, texto, sizeof(texto)) < (int)sizeof(texto) - 1);
+	COMPRUEBA(strstr(texto, "fragmentacion 20 %") != NULL && strstr(texto, "max 1234/4096 B") != NULL);
+	COMPRUEBA(resumen_Memoria(&memoria, texto, MEMORIA_RESUMEN_SIZE) < MEMORIA_RESUMEN_SIZE - 1);
+	printf("%s\n", texto);
+	__malloc_free_list = NULL;
+}
+
+int main(void)
+{
+	pruebas_ListaLibre();
+	pruebas_Clases();
+	pruebas_Marca();
+	pruebas_Pila();
+	return fin_Pruebas("Monitor_Memoria");
+}
@@ -0,0 +1,482 @@
+/******************************************************************************
+* @file    prueba_RFU.c
+* @brief   Descarga por rangos de rfu.c (incluido en la prueba) sobre una flash
+* de dos bancos simulada en 0x08000000 y un servidor HTTP simulado detrás de
+* http_util.h. Comprueba la contabilidad en los registros de backup tras cada
+* rango (tamaño, bytes hechos, CRC y etiqueta de la imagen), que un reinicio o
+* una racha de rangos fallidos reanuda en el último rango programado sin volver
+* a borrar lo guardado, que la descarga empieza de cero si lo guardado no cuadra,
+* y el estado de la prueba de la imagen nueva: arranques, confirmación y vuelta
+* atrás.
+******************************************************************************
+*/
+
+#include <setjmp.h>
+#include <sys/mman.h>
+#include "comprueba.h"
+
+/* Lo que rfu.c toma de main.h y del HAL: flash de dos bancos, CRC, SYSCFG y reinicio */
+#define FLASH_BASE               0x08000000UL
+#define FLASH_BANK_SIZE          0x80000UL
+#define FLASH_PAGE_SIZE          0x800U
+#define FLASH_BANK_1             0x01U
+#define FLASH_BANK_2             0x02U
+#define FLASH_BANK_BOTH          (FLASH_BANK_1 | FLASH_BANK_2)
+#define HAL_OK                   0U
+#define DEFAULT_CRC_INITVALUE    0xFFFFFFFFU
+#define SYSCFG_MEMRMP_FB_MODE    (1U << 8)
+#define READ_BIT(reg, bit)       ((reg) & (bit))
+#define __HAL_CRC_INITIALCRCVALUE_CONFIG(h, valor)   ((h)->inicial = (valor))
+
+typedef struct { uint32_t inicial; } CRC_HandleTypeDef;
+typedef struct { uint32_t MEMRMP; } SYSCFG_TypeDef;
+
+CRC_HandleTypeDef hcrc;
+static SYSCFG_TypeDef syscfg;
+#define SYSCFG   (&syscfg)
+
+uint32_t _sidata, _sdata, _edata;	// la imagen en marcha cabe en el primer banco: ver CFLAGS_prueba_RFU
+
+uint32_t HAL_CRC_Calculate(CRC_HandleTypeDef* h, uint32_t* datos, uint32_t tam);
+void HAL_Delay(uint32_t ms);
+void HAL_NVIC_SystemReset(void);
+
+#include "rfu.c"
+
+#define URL          "http://192.168.1.10:8080/VIPV.bin"
+#define TAM_IMAGEN   (9 * RFU_RANGE_SIZE + 1234)	// el último rango es parcial
+#define N_PAGINAS    (2 * FLASH_BANK_SIZE / FLASH_PAGE_SIZE)
+#define BANCO_NUEVO  ((const uint8_t *) RFU_BANK_ADDR)
+
+/* ---- CRC, reloj y reinicio ---- */
+
+/* CRC-32/MPEG-2 por bytes, como la unidad CRC con la configuración de MX_CRC_Init() */
+static uint32_t crc_Programa(uint32_t crc, const uint8_t* datos, uint32_t tam)
+{
+	for (uint32_t i = 0; i < tam; i++) {
+		crc ^= (uint32_t)datos[i] << 24;
+		for (int b = 0; b < 8; b++) crc = (crc & 0x80000000U) ? (crc << 1) ^ 0x04C11DB7U : crc << 1;
+	}
+	return crc;
+}
+
+uint32_t HAL_CRC_Calculate(CRC_HandleTypeDef* h, uint32_t* datos, uint32_t tam)
+{
+	return crc_Programa(h->inicial, (const uint8_t *) datos, tam);
+}
+
+void HAL_Delay(uint32_t ms)
+{
+	tick_anfitrion += ms;
+}
+
+static jmp_buf reinicio;
+static int n_reinicios;
+
+void HAL_NVIC_SystemReset(void)
+{
+	n_reinicios++;
+	longjmp(reinicio, 1);
+}
+
+/* ---- Flash de dos bancos: el que arranca está en FLASH_BASE y el otro justo encima ---- */
+
+static uint8_t* flash;
+static uint8_t borrados[N_PAGINAS];			// borrados de cada página del banco físico mapeado ahora en su sitio
+static bool flash_falla;
+static int escrituras_sin_borrar;
+
+uint32_t FLASH_Erase_Size(uint32_t uStart, uint32_t uLength)
+{
+	if ( flash_falla || ((uStart - FLASH_BASE) % FLASH_PAGE_SIZE) != 0 ) return 1;
+	for (uint32_t p = uStart; p < uStart + uLength; p += FLASH_PAGE_SIZE) {
+		memset(&flash[p - FLASH_BASE], 0xFF, FLASH_PAGE_SIZE);
+		borrados[(p - FLASH_BASE) / FLASH_PAGE_SIZE]++;
+	}
+	return HAL_OK;
+}
+
+uint32_t FLASH_Write(uint32_t uDestination, uint32_t *pSource, uint32_t uLength)
+{
+	uint8_t* destino = &flash[uDestination - FLASH_BASE];
+
+	if ( flash_falla || (uDestination % 8) || (uLength % 8) ) return 1;
+	for (uint32_t i = 0; i < uLength; i++) {
+		if (destino[i] != 0xFF) {
+			escrituras_sin_borrar++;
+			return 1;
+		}
+	}
+	memcpy(destino, pSource, uLength);
+	return HAL_OK;
+}
+
+/* BFB2: el otro banco pasa a FLASH_BASE. En el equipo recarga los option bytes y reinicia; aquí vuelve */
+int FLASH_set_boot_bank(uint32_t bank)
+{
+	static uint8_t banco[FLASH_BANK_SIZE];
+	static uint8_t paginas[N_PAGINAS / 2];
+
+	if (bank == FLASH_BANK_BOTH) {
+		bank = (READ_BIT(SYSCFG->MEMRMP, SYSCFG_MEMRMP_FB_MODE) == 0) ? FLASH_BANK_2 : FLASH_BANK_1;
+	}
+	if ( (bank == FLASH_BANK_2) != (READ_BIT(SYSCFG->MEMRMP, SYSCFG_MEMRMP_FB_MODE) != 0) ) {
+		memcpy(banco, flash, FLASH_BANK_SIZE);
+		memcpy(flash, flash + FLASH_BANK_SIZE, FLASH_BANK_SIZE);
+		memcpy(flash + FLASH_BANK_SIZE, banco, FLASH_BANK_SIZE);
+		memcpy(paginas, borrados, sizeof(paginas));
+		memcpy(borrados, borrados + N_PAGINAS / 2, sizeof(paginas));
+		memcpy(borrados + N_PAGINAS / 2, paginas, sizeof(paginas));
+		SYSCFG->MEMRMP ^= SYSCFG_MEMRMP_FB_MODE;
+	}
+	return 0;
+}
+
+/* ---- Servidor HTTP con Range ---- */
+
+static uint8_t imagen[TAM_IMAGEN];
+static uint32_t tam_servidor = TAM_IMAGEN;
+static bool servidor_caido, conexion_abierta;
+static int lecturas_fallidas;				// siguientes peticiones que se cortan
+static int n_peticiones, n_aperturas;
+static uint32_t ultimo_offset;
+
+int http_open(http_handle_t * const pHnd, const char *url)
+{
+	(void) url;
+	n_aperturas++;
+	if (servidor_caido) return HTTP_ERR;
+	*pHnd = &conexion_abierta;
+	conexion_abierta = true;
+	return HTTP_OK;
+}
+
+int http_close(const http_handle_t hnd)
+{
+	(void) hnd;
+	conexion_abierta = false;
+	return HTTP_OK;
+}
+
+bool http_is_open(const http_handle_t hnd)
+{
+	(void) hnd;
+	return conexion_abierta;
+}
+
+int http_read(uint8_t * const readbuffer, http_range_status_t * const status, const size_t offset, const size_t size,
+              const char * const extra_headers, const uint8_t * const post_buf, const size_t post_buf_size,
+              const http_handle_t hnd)
+{
+	uint32_t n = (tam_servidor - offset < size) ? tam_servidor - offset : (uint32_t) size;
+
+	(void) extra_headers; (void) post_buf; (void) post_buf_size; (void) hnd;
+	n_peticiones++;
+	ultimo_offset = (uint32_t) offset;
+	tick_anfitrion += 30;
+	if (!conexion_abierta) return HTTP_ERR;
+	if (lecturas_fallidas > 0) {
+		lecturas_fallidas--;
+		conexion_abierta = false;
+		return HTTP_ERR;
+	}
+	memcpy(readbuffer, &imagen[offset], (offset + n <= TAM_IMAGEN) ? n : 0);
+	status->first_byte = (int) offset;
+	status->last_byte = (int) (offset + n - 1);
+	status->resource_size = (int) tam_servidor;
+	status->connection_is_open = true;
+	return (int) n;
+}
+
+/* ---- Ayudas ---- */
+
+static uint8_t sha_imagen[RFU_SHA256_SIZE];
+static uint8_t otro_sha[RFU_SHA256_SIZE];
+
+static void prepara_Imagen(uint32_t semilla)
+{
+	for (uint32_t i = 0; i < TAM_IMAGEN; i++) {
+		semilla = semilla * 1103515245U + 12345U;
+		imagen[i] = (uint8_t) (semilla >> 16);
+	}
+	((uint32_t *) imagen)[0] = 0x20018000U;						// pila inicial en SRAM1
+	((uint32_t *) imagen)[1] = (uint32_t) FLASH_BASE + 0x199U;	// Reset_Handler, Thumb
+	mbedtls_sha256(imagen, TAM_IMAGEN, sha_imagen, 0);
+	tam_servidor = TAM_IMAGEN;
+}
+
+static uint32_t estado_Bkp(rfu_state_t estado, uint32_t banco, uint32_t arranques)
+{
+	return RFU_MAGIC | ((uint32_t) estado << 12) | (banco << 8) | arranques;
+}
+
+static uint32_t etiqueta(const uint8_t* sha)
+{
+	return ((uint32_t) sha[0] << 24) | ((uint32_t) sha[1] << 16) | ((uint32_t) sha[2] << 8) | sha[3];
+}
+
+/* Un reinicio a mitad de descarga: la RAM y la conexión se pierden, los registros de backup y la flash no */
+static void reinicia_Equipo(void)
+{
+	rfu_stop();
+	memset(&rfu, 0, sizeof(rfu));
+	conexion_abierta = false;
+}
+
+static int pasos(int n)
+{
+	int rc = RFU_IN_PROGRESS;
+
+	while ( (n-- > 0) && (rc == RFU_IN_PROGRESS) ) rc = rfu_step();
+	return rc;
+}
+
+static int hasta_Final(void)
+{
+	int rc = RFU_IN_PROGRESS;
+
+	for (int i = 0; (i < 1000) && (rc == RFU_IN_PROGRESS); i++) rc = rfu_step();
+	return rc;
+}
+
+static bool bkp_Cuadra(uint32_t hechos)
+{
+	return (bkp_anfitrion[RFU_BKP_DONE] == hechos) && (bkp_anfitrion[RFU_BKP_SIZE] == TAM_IMAGEN)
+			&& (bkp_anfitrion[RFU_BKP_CRC] == crc_Programa(DEFAULT_CRC_INITVALUE, imagen, hechos));
+}
+
+static bool sin_Reborrar(void)
+{
+	for (int i = 0; i < N_PAGINAS; i++) if (borrados[i] > 1) return false;
+	return true;
+}
+
+/* ---- Pruebas ---- */
+
+/* Descarga nueva: los registros de backup reflejan cada rango programado */
+static void pruebas_Contabilidad(void)
+{
+	memset(bkp_anfitrion, 0, sizeof(bkp_anfitrion));
+	memset(borrados, 0, sizeof(borrados));
+	prepara_Imagen(1);
+
+	COMPRUEBA(rfu_start(URL, sha_imagen) == RFU_OK);
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_STATE] == estado_Bkp(RFU_ST_DOWNLOAD, FLASH_BANK_1, 0));
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_TAG] == etiqueta(sha_imagen));
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_SIZE] == 0 && bkp_anfitrion[RFU_BKP_DONE] == 0);
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_CRC] == DEFAULT_CRC_INITVALUE);
+
+	for (uint32_t k = 0; k < 3; k++) {
+		COMPRUEBA(rfu_step() == RFU_IN_PROGRESS && ultimo_offset == k * RFU_RANGE_SIZE);
+		COMPRUEBA(bkp_Cuadra((k + 1) * RFU_RANGE_SIZE));
+	}
+	COMPRUEBA(memcmp(BANCO_NUEVO, imagen, 3 * RFU_RANGE_SIZE) == 0);
+	COMPRUEBA(borrados[N_PAGINAS / 2] == 1 && borrados[N_PAGINAS / 2 + 6] == 0 && borrados[0] == 0);
+	COMPRUEBA(rfu.progress.resumed_from == 0 && rfu.progress.ranges == 3);
+	COMPRUEBA(bkp_anfitrion[BKP_PRIMERO_DNS + 8] == 0 && bkp_anfitrion[BKP_SELLO_COMANDOS] == 0);	// DR24 y DR30 no son suyos
+}
+
+/* Reinicio, rangos fallidos y servidor caído: se reanuda en el último rango programado, sin volver a borrarlo */
+static void pruebas_Reanuda(void)
+{
+	int peticiones;
+
+	reinicia_Equipo();
+	COMPRUEBA(rfu_start(URL, sha_imagen) == RFU_OK);
+	COMPRUEBA(rfu.progress.resumed_from == 3 * RFU_RANGE_SIZE && rfu.progress.done == 3 * RFU_RANGE_SIZE);
+	COMPRUEBA(rfu.progress.size == TAM_IMAGEN && rfu.crc == bkp_anfitrion[RFU_BKP_CRC]);
+	COMPRUEBA(rfu_step() == RFU_IN_PROGRESS && ultimo_offset == 3 * RFU_RANGE_SIZE && bkp_Cuadra(4 * RFU_RANGE_SIZE));
+
+	/* Dos rangos cortados: se piden otra vez, tras reconectar, y la contabilidad no se mueve */
+	lecturas_fallidas = 2;
+	n_aperturas = 0;
+	COMPRUEBA(pasos(2) == RFU_IN_PROGRESS && ultimo_offset == 4 * RFU_RANGE_SIZE && bkp_Cuadra(4 * RFU_RANGE_SIZE));
+	COMPRUEBA(rfu_step() == RFU_IN_PROGRESS && ultimo_offset == 4 * RFU_RANGE_SIZE && bkp_Cuadra(5 * RFU_RANGE_SIZE));
+	COMPRUEBA(n_aperturas == 2 && rfu.progress.reconnections == 2 && rfu.failures == 0);
+
+	/* RFU_MAX_FAILED_RANGES seguidos: se para, y el siguiente rfu_start() sigue donde estaba */
+	servidor_caido = true;
+	conexion_abierta = false;
+	COMPRUEBA(pasos(RFU_MAX_FAILED_RANGES - 1) == RFU_IN_PROGRESS);
+	COMPRUEBA(rfu_step() == RFU_ERR_HTTP && rfu.phase == RFU_PHASE_IDLE);
+	COMPRUEBA(bkp_Cuadra(5 * RFU_RANGE_SIZE));
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_STATE] == estado_Bkp(RFU_ST_DOWNLOAD, FLASH_BANK_1, 0));
+	servidor_caido = false;
+	COMPRUEBA(rfu_start(URL, sha_imagen) == RFU_OK && rfu.progress.resumed_from == 5 * RFU_RANGE_SIZE);
+
+	/* Hasta el final: el último rango parcial, la verificación y la imagen lista para arrancar */
+	peticiones = n_peticiones;
+	COMPRUEBA(hasta_Final() == RFU_OK);
+	COMPRUEBA(n_peticiones - peticiones == 5 && ultimo_offset == 9 * RFU_RANGE_SIZE);
+	COMPRUEBA(bkp_Cuadra(TAM_IMAGEN) && memcmp(BANCO_NUEVO, imagen, TAM_IMAGEN) == 0);
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_STATE] == estado_Bkp(RFU_ST_READY, FLASH_BANK_1, 0));
+	COMPRUEBA(sin_Reborrar() && escrituras_sin_borrar == 0);
+
+	/* Lista para arrancar y pedida otra vez: solo se verifica, sin pedir nada al servidor */
+	peticiones = n_peticiones;
+	reinicia_Equipo();
+	COMPRUEBA(rfu_start(URL, sha_imagen) == RFU_OK && rfu.phase == RFU_PHASE_VERIFY);
+	COMPRUEBA(rfu.progress.resumed_from == TAM_IMAGEN && hasta_Final() == RFU_OK && n_peticiones == peticiones);
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_STATE] == estado_Bkp(RFU_ST_READY, FLASH_BANK_1, 0));
+}
+
+/* Lo guardado no vale: otra imagen, la flash no cuadra con el CRC, registros incoherentes o perdidos */
+static void pruebas_DeCero(void)
+{
+	/* Otra imagen (otro SHA-256): etiqueta nueva y desde el principio */
+	memcpy(otro_sha, sha_imagen, sizeof(otro_sha));
+	otro_sha[0] ^= 0x5A;
+	reinicia_Equipo();
+	COMPRUEBA(rfu_start(URL, otro_sha) == RFU_OK && rfu.progress.resumed_from == 0 && rfu.progress.done == 0);
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_TAG] == etiqueta(otro_sha) && bkp_anfitrion[RFU_BKP_DONE] == 0);
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_SIZE] == 0 && bkp_anfitrion[RFU_BKP_CRC] == DEFAULT_CRC_INITVALUE);
+	COMPRUEBA(pasos(2) == RFU_IN_PROGRESS && ultimo_offset == RFU_RANGE_SIZE && bkp_Cuadra(2 * RFU_RANGE_SIZE));
+
+	/* Un bit cambiado en lo programado: el CRC no cuadra */
+	reinicia_Equipo();
+	flash[FLASH_BANK_SIZE + RFU_RANGE_SIZE + 100] ^= 0x01;
+	COMPRUEBA(rfu_start(URL, otro_sha) == RFU_OK && rfu.progress.resumed_from == 0);
+	COMPRUEBA(rfu_step() == RFU_IN_PROGRESS && ultimo_offset == 0 && bkp_Cuadra(RFU_RANGE_SIZE));
+
+	/* Bytes hechos sin alinear a un rango, o más que el tamaño */
+	COMPRUEBA(rfu_step() == RFU_IN_PROGRESS && bkp_Cuadra(2 * RFU_RANGE_SIZE));
+	reinicia_Equipo();
+	bkp_anfitrion[RFU_BKP_DONE] = RFU_RANGE_SIZE + 8;
+	bkp_anfitrion[RFU_BKP_CRC] = crc_Programa(DEFAULT_CRC_INITVALUE, imagen, RFU_RANGE_SIZE + 8);
+	COMPRUEBA(rfu_start(URL, otro_sha) == RFU_OK && rfu.progress.resumed_from == 0);
+	pasos(2);
+	reinicia_Equipo();
+	bkp_anfitrion[RFU_BKP_SIZE] = RFU_RANGE_SIZE;
+	COMPRUEBA(rfu_start(URL, otro_sha) == RFU_OK && rfu.progress.resumed_from == 0);
+
+	/* Sin alimentación los registros de backup se pierden (VBAT va a VDD): de cero */
+	pasos(2);
+	reinicia_Equipo();
+	memset(bkp_anfitrion, 0, sizeof(bkp_anfitrion));
+	COMPRUEBA(rfu_start(URL, otro_sha) == RFU_OK && rfu.progress.resumed_from == 0);
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_TAG] == etiqueta(otro_sha));
+
+	/* Sin SHA-256 la etiqueta es el CRC de la URL: otra URL no reanuda */
+	pasos(2);
+	reinicia_Equipo();
+	COMPRUEBA(rfu_start(URL, NULL) == RFU_OK && rfu.progress.resumed_from == 0);
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_TAG] == crc_Programa(DEFAULT_CRC_INITVALUE, (const uint8_t *) URL, strlen(URL)));
+	pasos(2);
+	reinicia_Equipo();
+	COMPRUEBA(rfu_start(URL, NULL) == RFU_OK && rfu.progress.resumed_from == 2 * RFU_RANGE_SIZE);
+	reinicia_Equipo();
+	COMPRUEBA(rfu_start(URL "?v=2", NULL) == RFU_OK && rfu.progress.resumed_from == 0);
+
+}
+
+/* Cambios en el servidor, imágenes que no valen y fallos de la flash: se abandona y el estado queda en reposo */
+static void pruebas_Rechazos(void)
+{
+	uint32_t hechos;
+
+	reinicia_Equipo();
+	COMPRUEBA(rfu_start(URL, sha_imagen) == RFU_OK && rfu.progress.resumed_from == 0);
+	pasos(2);
+	tam_servidor = TAM_IMAGEN - 16;
+	COMPRUEBA(rfu_step() == RFU_ERR_HTTP && bkp_anfitrion[RFU_BKP_STATE] == estado_Bkp(RFU_ST_IDLE, 0, 0));
+	tam_servidor = TAM_IMAGEN;
+	COMPRUEBA(rfu_start(URL, sha_imagen) == RFU_OK && rfu.progress.resumed_from == 0);		// en reposo no se reanuda
+
+	tam_servidor = FLASH_BANK_SIZE + 1;
+	COMPRUEBA(rfu_step() == RFU_ERR_SIZE && bkp_anfitrion[RFU_BKP_STATE] == estado_Bkp(RFU_ST_IDLE, 0, 0));
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_SIZE] == 0 && bkp_anfitrion[RFU_BKP_DONE] == 0);
+	tam_servidor = TAM_IMAGEN;
+
+	/* El fallo de la flash para la descarga sin tocar lo contado: se reanuda igual */
+	COMPRUEBA(rfu_start(URL, sha_imagen) == RFU_OK && pasos(3) == RFU_IN_PROGRESS);
+	hechos = bkp_anfitrion[RFU_BKP_DONE];
+	flash_falla = true;
+	COMPRUEBA(rfu_step() == RFU_ERR_FLASH && bkp_Cuadra(hechos));
+	flash_falla = false;
+	reinicia_Equipo();
+	COMPRUEBA(rfu_start(URL, sha_imagen) == RFU_OK && rfu.progress.resumed_from == hechos);
+
+	/* SHA-256 equivocado, y tabla de vectores que no arranca con su SHA-256 correcto */
+	COMPRUEBA(rfu_start(URL, otro_sha) == RFU_OK && hasta_Final() == RFU_ERR_HASH);
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_STATE] == estado_Bkp(RFU_ST_IDLE, FLASH_BANK_1, 0));
+	((uint32_t *) imagen)[0] = 0xFFFFFFFFU;
+	mbedtls_sha256(imagen, TAM_IMAGEN, sha_imagen, 0);
+	COMPRUEBA(rfu_start(URL, sha_imagen) == RFU_OK && hasta_Final() == RFU_ERR_FF);
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_STATE] == estado_Bkp(RFU_ST_IDLE, FLASH_BANK_1, 0));
+	COMPRUEBA(rfu_swap_banks() == RFU_ERR_STATE && READ_BIT(SYSCFG->MEMRMP, SYSCFG_MEMRMP_FB_MODE) == 0);
+	prepara_Imagen(1);
+}
+
+/* Arranque a prueba de la imagen nueva: arranques contados, vuelta atrás, confirmación y el banco de la siguiente */
+static void pruebas_Prueba(void)
+{
+	reinicia_Equipo();
+	COMPRUEBA(rfu_start(URL, sha_imagen) == RFU_OK && hasta_Final() == RFU_OK);
+	COMPRUEBA(rfu_swap_banks() == RFU_OK);
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_STATE] == estado_Bkp(RFU_ST_TRIAL, FLASH_BANK_1, 0));
+	COMPRUEBA(READ_BIT(SYSCFG->MEMRMP, SYSCFG_MEMRMP_FB_MODE) != 0 && memcmp(flash, imagen, TAM_IMAGEN) == 0);
+
+	for (uint32_t b = 1; b <= RFU_TRIAL_BOOTS; b++) {
+		COMPRUEBA(rfu_boot_check() == RFU_BOOT_TRIAL);
+		COMPRUEBA(bkp_anfitrion[RFU_BKP_STATE] == estado_Bkp(RFU_ST_TRIAL, FLASH_BANK_1, b));
+	}
+	COMPRUEBA(rfu_on_trial() && rfu_start(URL, sha_imagen) == RFU_ERR_STATE);
+
+	/* Un arranque más sin rfu_confirm(): vuelve al banco anterior y reinicia */
+	if (setjmp(reinicio) == 0) {
+		rfu_boot_check();
+		COMPRUEBA(false);
+	}
+	COMPRUEBA(n_reinicios == 1 && READ_BIT(SYSCFG->MEMRMP, SYSCFG_MEMRMP_FB_MODE) == 0);
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_STATE] == estado_Bkp(RFU_ST_ROLLBACK, FLASH_BANK_1, RFU_TRIAL_BOOTS + 1));
+	COMPRUEBA(rfu_boot_check() == RFU_BOOT_ROLLED_BACK && !rfu_on_trial());
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_STATE] == estado_Bkp(RFU_ST_IDLE, 0, 0) && rfu_boot_check() == RFU_BOOT_NORMAL);
+
+	/* La imagen en marcha no cuadra con el CRC descargado: vuelta atrás en el primer arranque */
+	reinicia_Equipo();
+	COMPRUEBA(rfu_start(URL, sha_imagen) == RFU_OK && hasta_Final() == RFU_OK && rfu_swap_banks() == RFU_OK);
+	flash[TAM_IMAGEN / 2] ^= 0x80;
+	if (setjmp(reinicio) == 0) {
+		rfu_boot_check();
+		COMPRUEBA(false);
+	}
+	COMPRUEBA(n_reinicios == 2 && rfu_boot_check() == RFU_BOOT_ROLLED_BACK);
+
+	/* El cargador del sistema vuelve solo al banco anterior: se informa igual */
+	reinicia_Equipo();
+	COMPRUEBA(rfu_start(URL, sha_imagen) == RFU_OK && hasta_Final() == RFU_OK && rfu_swap_banks() == RFU_OK);
+	FLASH_set_boot_bank(FLASH_BANK_1);
+	COMPRUEBA(rfu_boot_check() == RFU_BOOT_ROLLED_BACK && n_reinicios == 2);
+
+	/* Confirmada: ya no hay prueba, y la siguiente descarga va al otro banco físico */
+	reinicia_Equipo();
+	COMPRUEBA(rfu_start(URL, sha_imagen) == RFU_OK && hasta_Final() == RFU_OK && rfu_swap_banks() == RFU_OK);
+	COMPRUEBA(rfu_boot_check() == RFU_BOOT_TRIAL);
+	rfu_confirm();
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_STATE] == estado_Bkp(RFU_ST_IDLE, 0, 0) && rfu_boot_check() == RFU_BOOT_NORMAL);
+	prepara_Imagen(2);
+	reinicia_Equipo();
+	COMPRUEBA(rfu_start(URL, sha_imagen) == RFU_OK && rfu.progress.resumed_from == 0);
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_STATE] == estado_Bkp(RFU_ST_DOWNLOAD, FLASH_BANK_2, 0));
+	COMPRUEBA(hasta_Final() == RFU_OK && memcmp(BANCO_NUEVO, imagen, TAM_IMAGEN) == 0);
+	COMPRUEBA(bkp_anfitrion[RFU_BKP_STATE] == estado_Bkp(RFU_ST_READY, FLASH_BANK_2, 0));
+}
+
+int main(void)
+{
+	flash = mmap((void *) FLASH_BASE, 2 * FLASH_BANK_SIZE, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if (flash != (uint8_t *) FLASH_BASE) {
+		printf("No se puede simular la flash en 0x%08lx\n", FLASH_BASE);
+		return 1;
+	}
+	memset(flash, 0xFF, 2 * FLASH_BANK_SIZE);
+	tick_anfitrion = 1000;
+
+	pruebas_Contabilidad();
+	pruebas_Reanuda();
+	pruebas_DeCero();
+	pruebas_Rechazos();
+	pruebas_Prueba();
+	return fin_Pruebas("rfu");
+}
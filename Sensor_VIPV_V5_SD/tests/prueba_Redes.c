@@ -0,0 +1,217 @@
+/******************************************************************************
+* @file    prueba_Redes.c
+* @brief   Itinerancia entre redes conocidas (Redes_Conocidas.h) sobre una lista
+* de APs simulada en WIFI_ListAccessPoints(): elección por RSSI entre las redes
+* conocidas, con redes ajenas más fuertes, SSID parecidos y el mismo SSID en
+* varios BSSID; la ventaja MARGEN_ZONA_DB de la red recordada en la zona; el
+* atajo sin scan al volver a una zona o a una vecina; la sustitución de la
+* zona usada hace más tiempo, y el coste de los scans.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+#include "Redes_Conocidas.h"
+
+#define T_SCAN_MS   2200			// Lo que tarda el ISM43362 en un scan completo
+
+enum { COCHERA = 0, OFICINA, CASA, N_REDES };
+
+static const wifi_network_t redes[N_REDES] = {
+	{ .ssid = "Cochera" }, { .ssid = "Oficina" }, { .ssid = "Casa" }
+};
+
+/* ---- Lista de APs a la vista y el scan del módulo ---- */
+
+static WIFI_APs_t vista;
+static bool scan_falla = false;
+static int n_scans_modulo = 0;
+
+static void sin_APs(void)
+{
+	memset(&vista, 0, sizeof(vista));
+}
+
+static void pon_AP(const char* ssid, int16_t rssi, uint8_t canal, uint8_t ultimo_mac)
+{
+	WIFI_AP_t* ap = &vista.ap[vista.count++];
+
+	strncpy(ap->SSID, ssid, sizeof(ap->SSID) - 1);
+	ap->RSSI = rssi;
+	ap->Channel = canal;
+	ap->MAC[0] = 0x24; ap->MAC[1] = 0xA4; ap->MAC[2] = 0x3C;
+	ap->MAC[5] = ultimo_mac;
+}
+
+WIFI_Status_t WIFI_ListAccessPoints(WIFI_APs_t* APs, uint8_t AP_MaxNbr)
+{
+	n_scans_modulo++;
+	tick_anfitrion += T_SCAN_MS;
+	if (scan_falla) return WIFI_STATUS_ERROR;
+	*APs = vista;
+	if (APs->count > AP_MaxNbr) APs->count = AP_MaxNbr;
+	return WIFI_STATUS_OK;
+}
+
+/* ---- Pruebas ---- */
+
+static gestorRedes r;
+static cacheAP ap;
+
+/* Sin zonas: la red conocida con más RSSI, aunque haya ajenas más fuertes */
+static void pruebas_Ranking(void)
+{
+	inicia_RedesConocidas(&r, redes, N_REDES);
+	COMPRUEBA(red_Elegida(&r) == &redes[COCHERA]);		// la de arranque
+
+	sin_APs();
+	pon_AP("Vecino", -40, 1, 0x10);
+	pon_AP("Oficina", -71, 11, 0x20);
+	pon_AP("Casa_5G", -45, 36, 0x30);				// SSID que empieza igual: no es Casa
+	pon_AP("Casa", -63, 6, 0x31);
+	pon_AP("Cochera", -80, 1, 0x40);
+	COMPRUEBA(localiza_RedConocida(&r, &ap));
+	COMPRUEBA(red_Elegida(&r) == &redes[CASA] && !ap.sin_scan);
+	COMPRUEBA(ap.rssi == -63 && ap.canal == 6 && ap.bssid[5] == 0x31 && ap.bssid[0] == 0x24);
+
+	/* El mismo SSID en dos BSSID: el más fuerte */
+	pon_AP("Casa", -52, 11, 0x32);
+	COMPRUEBA(localiza_RedConocida(&r, &ap) && r.elegida == CASA && ap.bssid[5] == 0x32 && ap.canal == 11);
+
+	/* Ninguna conocida a la vista, o el scan falla: no hay red que intentar y se mantiene la elegida */
+	sin_APs();
+	pon_AP("Vecino", -40, 1, 0x10);
+	COMPRUEBA(!localiza_RedConocida(&r, &ap) && r.elegida == CASA);
+	scan_falla = true;
+	COMPRUEBA(!localiza_RedConocida(&r, &ap) && r.elegida == CASA);
+	scan_falla = false;
+	COMPRUEBA(r.n_scans == 4 && r.n_sin_visibles == 2);
+	COMPRUEBA(r.t_scans_ms == 4 * T_SCAN_MS && r.scan_max_ms == T_SCAN_MS);
+
+	/* Lista llena de ajenas, con la conocida la última que cabe */
+	sin_APs();
+	for (int i = 0; i < WIFI_MAX_APS - 1; i++) pon_AP("Ajena", (int16_t)(-30 - i), 1, (uint8_t)i);
+	pon_AP("Oficina", -88, 1, 0x20);
+	COMPRUEBA(localiza_RedConocida(&r, &ap) && r.elegida == OFICINA && ap.rssi == -88);
+
+	/* Sin redes conocidas en la configuración: ni scan */
+	inicia_RedesConocidas(&r, redes, 0);
+	n_scans_modulo = 0;
+	COMPRUEBA(!localiza_RedConocida(&r, &ap) && n_scans_modulo == 0 && red_Elegida(&r) == NULL);
+}
+
+/* Memoria por zona GPS: atajo sin scan al volver, una vez por zona, y la ventaja de la red de la zona en el scan */
+static void pruebas_Zonas(void)
+{
+	inicia_RedesConocidas(&r, redes, N_REDES);
+	sin_APs();
+	pon_AP("Oficina", -70, 11, 0x20);
+	pon_AP("Casa", -75, 6, 0x31);
+
+	/* Primera vez en la oficina: scan, Oficina, y queda recordada */
+	COMPRUEBA(!anota_PosicionRedes(&r, 40.4168f, -3.7038f));		// zona sin memoria
+	COMPRUEBA(localiza_RedConocida(&r, &ap) && r.elegida == OFICINA && !ap.sin_scan);
+	recuerda_RedZona(&r);
+	COMPRUEBA(r.memoria[0].valida && r.memoria[0].red == OFICINA);
+
+	/* En casa, a 5 km: scan y Casa */
+	tick_anfitrion += 1000;
+	sin_APs();
+	pon_AP("Casa", -60, 6, 0x31);
+	COMPRUEBA(!anota_PosicionRedes(&r, 40.4500f, -3.7038f));
+	COMPRUEBA(localiza_RedConocida(&r, &ap) && r.elegida == CASA);
+	recuerda_RedZona(&r);
+
+	/* De vuelta a la oficina: Oficina sin scan, y solo la primera vez */
+	n_scans_modulo = 0;
+	sin_APs();
+	pon_AP("Oficina", -70, 11, 0x20);
+	COMPRUEBA(anota_PosicionRedes(&r, 40.4169f, -3.7037f));			// misma celda
+	COMPRUEBA(!anota_PosicionRedes(&r, 40.4169f, -3.7037f));		// sin cambio de zona no se adelanta otra vez
+	COMPRUEBA(localiza_RedConocida(&r, &ap) && ap.sin_scan && r.elegida == OFICINA && n_scans_modulo == 0);
+	COMPRUEBA(r.n_atajos_zona == 1);
+	COMPRUEBA(localiza_RedConocida(&r, &ap) && !ap.sin_scan && n_scans_modulo == 1);	// no se asoció: scan
+
+	/* Celda vecina (justo al otro lado del borde): también vale su memoria */
+	COMPRUEBA(anota_PosicionRedes(&r, 40.4099f, -3.7038f));
+	COMPRUEBA(localiza_RedConocida(&r, &ap) && ap.sin_scan && r.elegida == OFICINA && r.n_atajos_zona == 2);
+
+	/* Ventaja de la red de la zona: otra conocida con 7 dB más no la desplaza, con 15 dB sí */
+	sin_APs();
+	pon_AP("Oficina", -75, 11, 0x20);
+	pon_AP("Casa", -68, 6, 0x31);
+	COMPRUEBA(localiza_RedConocida(&r, &ap) && r.elegida == OFICINA && ap.rssi == -75);
+	sin_APs();
+	pon_AP("Oficina", -75, 11, 0x20);
+	pon_AP("Casa", -60, 6, 0x31);
+	COMPRUEBA(localiza_RedConocida(&r, &ap) && r.elegida == CASA && ap.rssi == -60);
+
+	/* Asociado a Casa en la celda vecina: ocupa su propia entrada, sin tocar la de la oficina */
+	recuerda_RedZona(&r);
+	COMPRUEBA(r.memoria[0].red == OFICINA && r.memoria[1].red == CASA);
+	COMPRUEBA(r.memoria[2].valida && r.memoria[2].red == CASA && r.memoria[2].zona.lat == r.zona.lat);
+	COMPRUEBA(!r.memoria[3].valida);
+
+	/* Otra asociación en la misma celda la actualiza, sin ocupar otra entrada */
+	r.elegida = OFICINA;
+	recuerda_RedZona(&r);
+	COMPRUEBA(r.memoria[2].red == OFICINA && !r.memoria[3].valida);
+
+	/* Coordenadas negativas y el meridiano 0: -0,001 y 0,001 son celdas distintas pero vecinas */
+	inicia_RedesConocidas(&r, redes, N_REDES);
+	sin_APs();
+	pon_AP("Cochera", -50, 1, 0x40);
+	anota_PosicionRedes(&r, 51.4779f, -0.0010f);
+	COMPRUEBA(r.zona.lon == -1);
+	localiza_RedConocida(&r, &ap);
+	recuerda_RedZona(&r);
+	COMPRUEBA(anota_PosicionRedes(&r, 51.4779f, 0.0010f) && r.zona.lon == 0);
+	COMPRUEBA(localiza_RedConocida(&r, &ap) && ap.sin_scan && r.elegida == COCHERA);
+}
+
+/* Sin posición no se recuerda nada; con N_ZONAS_RED llenas se sustituye la usada hace más tiempo */
+static void pruebas_Memoria(void)
+{
+	char texto[256];
+	uint8_t zonas = 0;
+
+	inicia_RedesConocidas(&r, redes, N_REDES);
+	sin_APs();
+	pon_AP("Casa", -60, 6, 0x31);
+	localiza_RedConocida(&r, &ap);
+	recuerda_RedZona(&r);
+	COMPRUEBA(!r.memoria[0].valida);
+
+	for (int i = 0; i < N_ZONAS_RED; i++) {
+		tick_anfitrion += 60000;
+		anota_PosicionRedes(&r, 40.0f + 0.05f * i, -3.0f);
+		localiza_RedConocida(&r, &ap);
+		recuerda_RedZona(&r);
+	}
+	for (int i = 0; i < N_ZONAS_RED; i++) zonas += r.memoria[i].valida ? 1 : 0;
+	COMPRUEBA(zonas == N_ZONAS_RED);
+
+	/* Se vuelve a la primera zona (se refresca) y luego a una nueva: sale la segunda, ahora la más antigua */
+	tick_anfitrion += 60000;
+	COMPRUEBA(anota_PosicionRedes(&r, 40.0f, -3.0f));
+	localiza_RedConocida(&r, &ap);
+	recuerda_RedZona(&r);
+	tick_anfitrion += 60000;
+	COMPRUEBA(!anota_PosicionRedes(&r, 45.0f, -3.0f));
+	localiza_RedConocida(&r, &ap);
+	recuerda_RedZona(&r);
+	COMPRUEBA(r.memoria[0].valida && r.memoria[0].zona.lat == 4000);
+	COMPRUEBA(r.memoria[1].zona.lat == 4500);
+	COMPRUEBA(!anota_PosicionRedes(&r, 40.05f, -3.0f));			// la segunda ya no está
+
+	COMPRUEBA(informe_RedesConocidas(&r, texto, sizeof(texto)) > 0 && strstr(texto, "red actual Casa") != NULL);
+	COMPRUEBA(informe_RedesConocidas(&r, texto, 16) == 15);
+}
+
+int main(void)
+{
+	tick_anfitrion = 1000;
+	pruebas_Ranking();
+	pruebas_Zonas();
+	pruebas_Memoria();
+	return fin_Pruebas("Redes_Conocidas");
+}
@@ -0,0 +1,118 @@
+/******************************************************************************
+* @file    prueba_Registro.c
+* @brief   Registro compacto de 40 bytes (Registro_Compacto.h): epoch_Fecha()
+* frente a timegm(), error de ida y vuelta dentro de medio paso de cada escala,
+* saturación, NaN y el formato del fichero binario.
+******************************************************************************
+*/
+
+#include <stddef.h>
+#include "comprueba.h"
+#include "Registro_Compacto.h"
+
+static double aleatorio(void)
+{
+	return rand() / (double)RAND_MAX;
+}
+
+/* Medio paso de la escala más la resolución del float en el valor */
+static double tolerancia(float escala, double valor)
+{
+	return 0.5 / escala + 2.0 * fabs(valor) * 1.2e-7;
+}
+
+int main(void)
+{
+	megaDato m, e;
+	registroCompacto r;
+	bool fechas = true, campos = true, fecha_vuelta = true;
+
+	srand(1);
+
+	/* Formato del fichero .BIN: 40 bytes y posiciones fijas */
+	COMPRUEBA(sizeof(registroCompacto) == 40);
+	COMPRUEBA(offsetof(registroCompacto, epoch) == 0 && offsetof(registroCompacto, latitud) == 4);
+	COMPRUEBA(offsetof(registroCompacto, irradiancia) == 12 && offsetof(registroCompacto, temperatura) == 22);
+	COMPRUEBA(offsetof(registroCompacto, humedad) == 38 && offsetof(registroCompacto, validez) == 39);
+
+	/* epoch_Fecha() frente a timegm() de 1970 a 2105 */
+	for (int64_t t = 0; t < 4102444800LL; t += 86400LL * 37 + 3671) {
+		time_t tt = (time_t)t;
+		struct tm* f = gmtime(&tt);
+		fechas &= (epoch_Fecha(f->tm_year + 1900, f->tm_mon + 1, f->tm_mday, f->tm_hour, f->tm_min, f->tm_sec) == (uint32_t)t);
+	}
+	COMPRUEBA(fechas);
+	COMPRUEBA(epoch_Fecha(2024, 2, 29, 23, 59, 59) == 1709251199U);		// bisiesto
+	COMPRUEBA(epoch_Fecha(2100, 3, 1, 0, 0, 0) == 4107542400U);		// 2100 no es bisiesto
+
+	/* Ida y vuelta de muestras aleatorias en todo el rango de cada magnitud */
+	for (int i = 0; i < 20000; i++) {
+		memset(&m, 0, sizeof(m));
+		for (int k = 0; k < 5; k++) m.irradiancia[k] = 1400 * aleatorio();
+		m.temperatura = -20 + 80 * aleatorio();
+		m.presion = 900 + 200 * aleatorio();
+		m.humedad = 100 * aleatorio();
+		m.alebeo = -180 + 360 * aleatorio();
+		m.cabeceo = -90 + 180 * aleatorio();
+		m.guino_brujula = 360 * aleatorio();
+		m.dispersion_rumbo = 180 * aleatorio();
+		m.latitud = -90 + 180 * aleatorio();
+		m.longitud = -180 + 360 * aleatorio();
+		m.altitud = -100 + 3000 * aleatorio();
+		m.velocidad = 200 * aleatorio();
+		m.ubicacion_fix = i & 1;
+		m.agno = 2020 + i % 10; m.mes = 1 + i % 12; m.dia = 1 + i % 28;
+		m.hora = i % 24; m.min = i % 60; m.seg = (i * 7) % 60;
+
+		compacta_Dato(&m, &r);
+		expande_Registro(&r, &e);
+
+		for (int k = 0; k < 5; k++) campos &= fabs(e.irradiancia[k] - m.irradiancia[k]) <= tolerancia(ESCALA_IRRADIANCIA, m.irradiancia[k]);
+		campos &= fabs(e.temperatura - m.temperatura) <= tolerancia(ESCALA_TEMPERATURA, m.temperatura);
+		campos &= fabs(e.presion - m.presion) <= tolerancia(ESCALA_PRESION, m.presion);
+		campos &= fabs(e.humedad - m.humedad) <= tolerancia(ESCALA_HUMEDAD, m.humedad);
+		campos &= fabs(e.alebeo - m.alebeo) <= tolerancia(ESCALA_ANGULO, m.alebeo);
+		campos &= fabs(e.cabeceo - m.cabeceo) <= tolerancia(ESCALA_ANGULO, m.cabeceo);
+		campos &= fabs(e.guino_brujula - m.guino_brujula) <= tolerancia(ESCALA_ANGULO, m.guino_brujula);
+		campos &= fabs(e.dispersion_rumbo - m.dispersion_rumbo) <= tolerancia(ESCALA_ANGULO, m.dispersion_rumbo);
+		campos &= fabs(e.latitud - m.latitud) <= tolerancia(ESCALA_COORDENADA, m.latitud);
+		campos &= fabs(e.longitud - m.longitud) <= tolerancia(ESCALA_COORDENADA, m.longitud);
+		campos &= fabs(e.altitud - m.altitud) <= tolerancia(ESCALA_ALTITUD, m.altitud);
+		campos &= fabs(e.velocidad - m.velocidad) <= tolerancia(ESCALA_VELOCIDAD, m.velocidad);
+		campos &= (e.ubicacion_fix == m.ubicacion_fix);
+		fecha_vuelta &= (e.agno == m.agno) && (e.mes == m.mes) && (e.dia == m.dia)
+						&& (e.hora == m.hora) && (e.min == m.min) && (e.seg == m.seg);
+	}
+	COMPRUEBA(campos);
+	COMPRUEBA(fecha_vuelta);
+
+	/* Fuera de rango se satura; NaN deja el bit de validez a 0 y vuelve como NaN */
+	memset(&m, 0, sizeof(m));
+	m.agno = 2026; m.mes = 10; m.dia = 19;
+	m.irradiancia[0] = 7000.0f;
+	m.irradiancia[1] = -5.0f;
+	m.irradiancia[2] = NAN;
+	m.temperatura = 400.0f;
+	m.humedad = 150.0f;
+	m.latitud = NAN;
+	m.longitud = -3.7f;
+	m.altitud = NAN;
+	m.velocidad = NAN;
+	compacta_Dato(&m, &r);
+	COMPRUEBA(r.irradiancia[0] == UINT16_MAX && r.irradiancia[1] == 0 && r.irradiancia[2] == 0);
+	COMPRUEBA(r.temperatura == INT16_MAX && r.humedad == UINT8_MAX);
+	COMPRUEBA(r.validez == 0 && r.latitud == 0 && r.longitud == 0);
+	expande_Registro(&r, &e);
+	COMPRUEBA(!noesNAN(e.latitud) && !noesNAN(e.longitud) && !noesNAN(e.altitud) && !noesNAN(e.velocidad));
+	COMPRUEBA(!e.ubicacion_fix);
+
+	m.latitud = 40.4168f;
+	m.altitud = 650.0f;
+	m.velocidad = 0.0f;
+	m.ubicacion_fix = true;
+	compacta_Dato(&m, &r);
+	COMPRUEBA(r.validez == (REG_UBICACION_FIX | REG_POSICION | REG_ALTITUD | REG_VELOCIDAD));
+	COMPRUEBA(r.latitud == 404168000 && r.longitud == -37000000);
+
+	return fin_Pruebas("Registro_Compacto");
+}
@@ -0,0 +1,199 @@
+/******************************************************************************
+* @file    prueba_SNTP.c
+* @brief   Cliente SNTP (sntp.c): marcas de tiempo NTP en las eras 0 y 1,
+* validación de respuestas en sntp_parse_reply() y sincronización completa
+* contra un servidor simulado con caminos asimétricos, Kiss-o'-Death, reloj
+* del servidor sin sincronizar, respuesta falsificada y servidor mudo.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+#include "net.h"
+#include "timingSystem.h"
+
+net_hnd_t hnet;
+
+/* Tiempo real en ms desde 1970 y RTC = real + desfase. El tick avanza con el tiempo real. */
+static int64_t real_ms = 1760875200000LL;
+static int64_t desfase_ms = 0;
+
+static void avanza(uint32_t ms)
+{
+	real_ms += ms;
+	tick_anfitrion += ms;
+}
+
+time_t TimingSystemGetSystemTimeMs(uint32_t* ms)
+{
+	int64_t rtc = real_ms + desfase_ms;
+	*ms = (uint32_t)(rtc % 1000);
+	return (time_t)(rtc / 1000);
+}
+
+int TimingSystemAdjustSystemTimeMs(int64_t offset_ms)
+{
+	desfase_ms += offset_ms;
+	return 1;
+}
+
+/* Servidor simulado: cada petición tarda ida[i] ms en llegar y la respuesta vuelta[i] ms */
+enum { SRV_BIEN, SRV_KOD, SRV_SIN_HORA, SRV_FALSA_PRIMERO, SRV_MUDO };
+static int modo = SRV_BIEN, n_peticion = 0, falsa_enviada = 0;
+static uint32_t ida[3], vuelta[3];
+static uint8_t peticion[48];
+
+static void pon_Marca(uint8_t* b, int64_t ms)
+{
+	uint32_t s = (uint32_t)(ms / 1000 + 2208988800LL), f = (uint32_t)(((uint64_t)(ms % 1000) << 32) / 1000);
+	for (int i = 0; i < 4; i++) { b[i] = (uint8_t)(s >> (24 - 8 * i)); b[4 + i] = (uint8_t)(f >> (24 - 8 * i)); }
+}
+
+int net_get_hostaddress(net_hnd_t n, net_ipaddr_t* a, const char* host)
+{
+	(void)n; (void)a;
+	return (strcmp(host, "desconocido") == 0) ? NET_ERR : NET_OK;
+}
+int net_sock_create(net_hnd_t n, net_sockhnd_t* s, net_proto_t p) { (void)n; *s = (net_sockhnd_t)&modo; return (p == NET_PROTO_UDP) ? NET_OK : NET_ERR; }
+int net_sock_setopt(net_sockhnd_t s, const char* o, const uint8_t* b, size_t l) { (void)s; (void)o; (void)b; (void)l; return NET_OK; }
+int net_sock_open(net_sockhnd_t s, const char* h, int rp, int lp) { (void)s; (void)h; (void)lp; return (rp == 123) ? NET_OK : NET_ERR; }
+int net_sock_close(net_sockhnd_t s) { (void)s; return NET_OK; }
+int net_sock_destroy(net_sockhnd_t s) { (void)s; return NET_OK; }
+
+int net_sock_sendto(net_sockhnd_t s, const uint8_t* b, size_t l, net_ipaddr_t* a, int p)
+{
+	(void)s; (void)a; (void)p;
+	memcpy(peticion, b, sizeof(peticion));
+	falsa_enviada = 0;
+	return (int)l;
+}
+
+int net_sock_recvfrom(net_sockhnd_t s, uint8_t* const b, size_t l, net_ipaddr_t* a, int* p)
+{
+	static uint8_t buena[48];
+	int i = n_peticion % 3;
+	(void)s; (void)l; (void)a; (void)p;
+
+	if (modo == SRV_MUDO) {
+		avanza(1000);
+		return NET_TIMEOUT;
+	}
+	if (falsa_enviada == 1) {					// la buena llegó a la vez que la falsa
+		falsa_enviada = 2;
+		memcpy(b, buena, 48);
+		n_peticion++;
+		return 48;
+	}
+	memset(b, 0, 48);
+	b[0] = (uint8_t)(((modo == SRV_SIN_HORA) ? 3 << 6 : 0) | (4 << 3) | 4);
+	b[1] = (modo == SRV_KOD) ? 0 : 2;
+	if (modo == SRV_KOD) memcpy(&b[12], "RATE", 4);
+	memcpy(&b[24], &peticion[40], 8);
+	avanza(ida[i]);
+	pon_Marca(&b[32], real_ms);
+	avanza(3);									// proceso en el servidor
+	pon_Marca(&b[40], real_ms);
+	avanza(vuelta[i]);
+	if ( (modo == SRV_FALSA_PRIMERO) && (falsa_enviada == 0) ) {
+		falsa_enviada = 1;						// origen que no es el de la petición, hora adelantada 1 h
+		memcpy(buena, b, 48);
+		b[24] ^= 0x55;
+		pon_Marca(&b[40], real_ms + 3600000);
+		return 48;
+	}
+	n_peticion++;
+	return 48;
+}
+
+#include "sntp.c"
+
+static void caminos(uint32_t i0, uint32_t v0, uint32_t i1, uint32_t v1, uint32_t i2, uint32_t v2)
+{
+	ida[0] = i0; vuelta[0] = v0; ida[1] = i1; vuelta[1] = v1; ida[2] = i2; vuelta[2] = v2;
+	n_peticion = 0;
+}
+
+int main(void)
+{
+	uint8_t b[8], pet[48] = { 0 }, resp[48];
+	sntp_sample_t m;
+	sntp_result_t r;
+	char kiss[5] = "";
+	int64_t antes;
+	uint32_t t0;
+
+	/* Marcas: ida y vuelta en la era 0 y en la 1 (desde 2036), marca nula y redondeo al ms */
+	sntp_put_timestamp(b, 1760000000456LL);
+	COMPRUEBA(sntp_get_timestamp(b) == 1760000000456LL);
+	sntp_put_timestamp(b, 2209075200000LL + 123);
+	COMPRUEBA(sntp_get_timestamp(b) == 2209075200000LL + 123);
+	memset(b, 0, sizeof(b));
+	COMPRUEBA(sntp_get_timestamp(b) == 0);
+
+	/* sntp_parse_reply(): t1 = 1000, t2 = 1600, t3 = 1610, t4 = 1030 da desfase 590 y retardo 20 */
+	sntp_put_timestamp(&pet[40], 1000);
+	memset(resp, 0, sizeof(resp));
+	resp[0] = (4 << 3) | 4;
+	resp[1] = 2;
+	memcpy(&resp[24], &pet[40], 8);
+	sntp_put_timestamp(&resp[32], 1600);
+	sntp_put_timestamp(&resp[40], 1610);
+	COMPRUEBA(sntp_parse_reply(resp, 48, pet, 1000, 1030, &m, kiss) == SNTP_OK);
+	COMPRUEBA(m.offset_ms == 590 && m.delay_ms == 20 && m.stratum == 2);
+	COMPRUEBA(sntp_parse_reply(resp, 47, pet, 1000, 1030, &m, kiss) == SNTP_ERR_TIMEOUT);			// corta
+	COMPRUEBA(sntp_parse_reply(resp, 48, pet, 1000, 1000 + 2100, &m, kiss) == SNTP_ERR_TIMEOUT);	// retardo > 2 s
+	resp[0] = (4 << 3) | 3;
+	COMPRUEBA(sntp_parse_reply(resp, 48, pet, 1000, 1030, &m, kiss) == SNTP_ERR_TIMEOUT);			// modo cliente
+	resp[0] = (3 << 6) | (4 << 3) | 4;
+	COMPRUEBA(sntp_parse_reply(resp, 48, pet, 1000, 1030, &m, kiss) == SNTP_ERR_TIMEOUT);			// LI = 3
+	resp[0] = (4 << 3) | 4;
+	resp[31] ^= 1;
+	COMPRUEBA(sntp_parse_reply(resp, 48, pet, 1000, 1030, &m, kiss) == SNTP_ERR_TIMEOUT);			// otro origen
+	resp[31] ^= 1;
+	sntp_put_timestamp(&resp[40], 1500);
+	COMPRUEBA(sntp_parse_reply(resp, 48, pet, 1000, 1030, &m, kiss) == SNTP_ERR_TIMEOUT);			// t3 < t2
+	resp[1] = 0;
+	memcpy(&resp[12], "DENY", 4);
+	COMPRUEBA(sntp_parse_reply(resp, 48, pet, 1000, 1030, &m, kiss) == SNTP_ERR_KOD && strcmp(kiss, "DENY") == 0);
+
+	/* Arranque en frío: RTC en 2000-01-01 (MX_RTC_Init), camino simétrico */
+	desfase_ms = 946684800000LL - real_ms;
+	caminos(5, 5, 5, 5, 5, 5);
+	COMPRUEBA(SNTP_SyncRTC(NULL, &r) == SNTP_OK);
+	COMPRUEBA(r.samples == 3 && r.stratum == 2 && r.delay_ms == 10);
+	COMPRUEBA(llabs(desfase_ms) <= 1);
+
+	/* Corrección por debajo del segundo, en los dos sentidos */
+	desfase_ms = -430;
+	COMPRUEBA(SNTP_SyncRTC(NULL, &r) == SNTP_OK && llabs(desfase_ms) <= 1);
+	desfase_ms = 270;
+	COMPRUEBA(SNTP_SyncRTC(NULL, &r) == SNTP_OK && llabs(desfase_ms) <= 1);
+
+	/* Camino asimétrico: se queda la muestra de menor retardo y el error no pasa de la mitad de este */
+	desfase_ms = 123456;
+	caminos(80, 20, 12, 2, 40, 40);
+	COMPRUEBA(SNTP_SyncRTC(NULL, &r) == SNTP_OK);
+	COMPRUEBA(r.delay_ms == 14);
+	COMPRUEBA(llabs(desfase_ms) <= r.delay_ms / 2 + 1);
+
+	/* Kiss-o'-Death y servidor sin sincronizar: el RTC no se toca */
+	caminos(5, 5, 5, 5, 5, 5);
+	desfase_ms = antes = 5000;
+	modo = SRV_KOD;
+	COMPRUEBA(SNTP_SyncRTC(NULL, &r) == SNTP_ERR_KOD && strcmp(r.kiss, "RATE") == 0);
+	modo = SRV_SIN_HORA;
+	COMPRUEBA(SNTP_SyncRTC(NULL, &r) == SNTP_ERR_TIMEOUT && r.samples == 0);
+	COMPRUEBA(desfase_ms == antes);
+
+	/* Una respuesta falsificada antes de la buena no desplaza la hora */
+	modo = SRV_FALSA_PRIMERO;
+	COMPRUEBA(SNTP_SyncRTC(NULL, &r) == SNTP_OK && llabs(desfase_ms) <= 1);
+
+	/* Servidor mudo: se abandona tras SNTP_MAX_LOST esperas; nombre sin resolver */
+	modo = SRV_MUDO;
+	t0 = tick_anfitrion;
+	COMPRUEBA(SNTP_SyncRTC(NULL, &r) == SNTP_ERR_TIMEOUT);
+	COMPRUEBA(tick_anfitrion - t0 <= SNTP_MAX_LOST * SNTP_READ_TIMEOUT_MS);
+	COMPRUEBA(SNTP_SyncRTC("desconocido", &r) == SNTP_ERR_CONNECT);
+
+	return fin_Pruebas("sntp");
+}
@@ -0,0 +1,292 @@
+/******************************************************************************
+* @file    prueba_SendData.c
+* @brief   Agrupación de las publicaciones en transacciones SendData del
+* ES-WiFi: ColaMQTT.h y el cliente Paho sobre el socket real de net.c y
+* net_tcp_wifi.c, con WIFI_SendData() sustituida por un contador. Comprueba
+* que cada trama lleva paquetes enteros hasta COLA_MQTT_TRAMA_MAX (nunca más
+* de ES_WIFI_PAYLOAD_SIZE), que sale al cerrar la ventana con
+* descarga_ColaMQTT() y que el flujo de bytes no cambia por agruparlo. Mide
+* además el bloqueo del bucle principal por publicación frente al camino
+* anterior de publicación bloqueante.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+#include "net_internal.h"
+#include "ColaMQTT.h"
+
+#define READ_BUFFER_SIZE  448		// MQTT_READ_BUFFER_SIZE de GenericMQTT.h
+#define T_AT_MS           3			// Cada SendData son tres comandos AT (P0, S2, S3) por SPI
+
+/* ---- El módulo Wi-Fi: cuenta las transacciones y guarda lo escrito ---- */
+
+static uint8_t escrito[65536];
+static int n_escrito = 0;
+static int n_senddata = 0, senddata_max = 0;
+static int acepta_max = 0;			// 0: acepta toda la petición, como con el buffer del módulo libre
+
+WIFI_Status_t WIFI_SendData(uint8_t socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *SentDatalen, uint32_t Timeout)
+{
+	(void)socket; (void)Timeout;
+	n_senddata++;
+	if (Reqlen > senddata_max) senddata_max = Reqlen;
+	if (Reqlen > ES_WIFI_PAYLOAD_SIZE) Reqlen = ES_WIFI_PAYLOAD_SIZE;	// como ES_WIFI_SendData()
+	if ( (acepta_max > 0) && (Reqlen > acepta_max) ) Reqlen = (uint16_t)acepta_max;
+	memcpy(&escrito[n_escrito], pdata, Reqlen);
+	n_escrito += Reqlen;
+	*SentDatalen = Reqlen;
+	tick_anfitrion += 3 * T_AT_MS + Reqlen / 1000;
+	return WIFI_STATUS_OK;
+}
+
+WIFI_Status_t WIFI_ReceiveData(uint8_t socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *RcvDatalen, uint32_t Timeout)
+{
+	(void)socket; (void)pdata; (void)Reqlen;
+	*RcvDatalen = 0;			// el broker no contesta: con QoS 0 no hace falta
+	tick_anfitrion += 2 * T_AT_MS + Timeout;	// P0 y R0, y la espera del módulo por si llega algo
+	return WIFI_STATUS_OK;
+}
+
+WIFI_Status_t WIFI_OpenClientConnection(uint32_t socket, WIFI_Protocol_t type, const char *name, uint8_t *ipaddr, uint16_t port, uint16_t local_port)
+{
+	(void)socket; (void)type; (void)name; (void)ipaddr; (void)port; (void)local_port;
+	return WIFI_STATUS_OK;
+}
+
+WIFI_Status_t WIFI_CloseClientConnection(uint32_t socket) { (void)socket; return WIFI_STATUS_OK; }
+WIFI_Status_t WIFI_GetIP_Address(uint8_t *ipaddr) { memset(ipaddr, 0, 4); return WIFI_STATUS_OK; }
+WIFI_Status_t WIFI_GetMAC_Address(uint8_t *mac) { memset(mac, 0, 6); return WIFI_STATUS_OK; }
+
+WIFI_Status_t WIFI_SendDataTo(uint8_t socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *SentDatalen, uint32_t Timeout, uint8_t *ipaddr, uint16_t port)
+{
+	(void)socket; (void)pdata; (void)Timeout; (void)ipaddr; (void)port;
+	*SentDatalen = Reqlen;
+	return WIFI_STATUS_OK;
+}
+
+WIFI_Status_t WIFI_ReceiveDataFrom(uint8_t socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *RcvDatalen, uint32_t Timeout, uint8_t *ipaddr, uint16_t *port)
+{
+	(void)socket; (void)pdata; (void)Reqlen; (void)Timeout; (void)ipaddr; (void)port;
+	*RcvDatalen = 0;
+	return WIFI_STATUS_OK;
+}
+
+/* ---- Lo que net_tcp_wifi.c toma de heap.c y de la caché DNS ---- */
+
+void *heap_class_alloc(heap_class_t cls, size_t a, size_t b) { (void)cls; return calloc(a, b); }
+void heap_class_free(heap_class_t cls, void *p) { (void)cls; free(p); }
+int net_dns_resolve(const char * host, uint8_t * ip) { (void)host; memset(ip, 10, 4); return NET_OK; }
+void net_dns_expire(void) { }
+
+static int inicia_Interfaz(void * if_ctxt) { (void)if_ctxt; return 0; }
+
+/* network_read() y network_write() de GenericMQTT.h, que no se puede incluir aquí: arrastra la
+ * configuración en flash, cJSON y la aplicación entera. */
+static int network_read(Network* n, unsigned char* buffer, int len, int timeout_ms)
+{
+	int bytes = net_sock_recv((net_sockhnd_t) n->my_socket, buffer, len);
+	(void)timeout_ms;
+	return (bytes < 0) ? -1 : bytes;
+}
+
+static int network_write(Network* n, unsigned char* buffer, int len, int timeout_ms)
+{
+	int rc = net_sock_send((net_sockhnd_t) n->my_socket, buffer, len);
+	(void)timeout_ms;
+	return (rc < 0) ? -1 : rc;
+}
+
+/* ---- Aplicación ---- */
+
+static net_hnd_t hnet;
+static net_sockhnd_t socket_mqtt;
+static Network red;
+static MQTTClient c;
+static unsigned char sbuf[600], rbuf[READ_BUFFER_SIZE];
+static colaMQTT cola;
+
+static uint8_t esperado[65536];		// los PUBLISH tal como los serializó encola_PublicacionMQTT()
+static int n_esperado = 0;
+
+static void conecta(void)
+{
+	COMPRUEBA(net_init(&hnet, NET_IF_WLAN, inicia_Interfaz) == NET_OK);
+	COMPRUEBA(net_sock_create(hnet, &socket_mqtt, NET_PROTO_TCP) == NET_OK);
+	COMPRUEBA(net_sock_setopt(socket_mqtt, "sock_noblocking", NULL, 0) == NET_OK);
+	COMPRUEBA(net_sock_open(socket_mqtt, "mqtt3.thingspeak.com", 1883, 0) == NET_OK);
+
+	red.my_socket = socket_mqtt;
+	red.mqttread = network_read;
+	red.mqttwrite = network_write;
+	MQTTClientInit(&c, &red, 5000, sbuf, sizeof(sbuf), rbuf, sizeof(rbuf));
+	c.isconnected = 1;
+	c.keepAliveInterval = 0;
+	inicia_ColaMQTT(&cola);
+	reanuda_ColaMQTT(&cola, false);
+}
+
+/* Publicación con una carga de 'largo' bytes; copia el paquete serializado para comparar el flujo */
+static int publica(int largo)
+{
+	static char msg[COLA_MQTT_PAQUETE_SIZE];
+	huecoColaMQTT * h;
+	int rc;
+
+	memset(msg, 'a' + (n_esperado % 26), (size_t)largo);
+	msg[largo] = 0;
+	rc = encola_PublicacionMQTT(&cola, &c, "channels/1234567/publish", msg);
+	if (rc == MQSUCCESS) {
+		h = &cola.hueco[(cola.cabeza + cola.n_pendientes - 1) % COLA_MQTT_HUECOS];
+		memcpy(&esperado[n_esperado], h->paquete, h->longitud);
+		n_esperado += h->longitud;
+	}
+	return rc;
+}
+
+static void sirve(int pasadas)
+{
+	while (pasadas--) {
+		servicio_ColaMQTT(&cola, &c);
+		tick_anfitrion++;
+	}
+}
+
+static void pruebas_Tramas(void)
+{
+	int antes;
+
+	tick_anfitrion = 1000;
+	conecta();
+
+	/* Los canales de una ventana esperan en la cola hasta descarga_ColaMQTT() */
+	publica(250);
+	publica(250);
+	sirve(50);
+	COMPRUEBA(n_senddata == 0 && n_escrito == 0);
+	descarga_ColaMQTT(&cola);
+	sirve(5);
+	COMPRUEBA(n_senddata == 1 && cola.n_transacciones == 1 && cola.n_publicados == 2);
+	COMPRUEBA(n_escrito == n_esperado && memcmp(escrito, esperado, (size_t)n_escrito) == 0);
+
+	/* Cinco de ~330 B: tres caben en COLA_MQTT_TRAMA_MAX, el cuarto abriría una trama de más */
+	antes = n_senddata;
+	for (int i = 0; i < 5; i++) publica(300);
+	descarga_ColaMQTT(&cola);
+	sirve(5);
+	COMPRUEBA(n_senddata - antes == 2);
+	COMPRUEBA(senddata_max <= COLA_MQTT_TRAMA_MAX && COLA_MQTT_TRAMA_MAX <= ES_WIFI_PAYLOAD_SIZE);
+	COMPRUEBA(senddata_max > COLA_MQTT_TRAMA_MAX - 340);	// la primera trama iba llena de paquetes enteros
+	COMPRUEBA(n_escrito == n_esperado && memcmp(escrito, esperado, (size_t)n_escrito) == 0);
+
+	/* Con la cola llena sale sin esperar al final de la ventana */
+	antes = n_senddata;
+	for (int i = 0; i < COLA_MQTT_HUECOS; i++) publica(100);
+	sirve(5);
+	COMPRUEBA(n_senddata - antes == 1 && cola.n_pendientes == 0);
+	COMPRUEBA(n_escrito == n_esperado && memcmp(escrito, esperado, (size_t)n_escrito) == 0);
+
+	/* El módulo acepta la trama por partes: se reanuda donde quedó, sin perder ni repetir bytes */
+	acepta_max = 200;
+	antes = n_senddata;
+	publica(400);
+	publica(400);
+	descarga_ColaMQTT(&cola);
+	sirve(10);
+	COMPRUEBA(n_senddata - antes > 2 && cola.trama_longitud == 0);
+	COMPRUEBA(n_escrito == n_esperado && memcmp(escrito, esperado, (size_t)n_escrito) == 0);
+	acepta_max = 0;
+
+	/* El PINGREQ que vence viaja al final de la trama de la ventana, sin transacción propia */
+	c.keepAliveInterval = 60;
+	TimerCountdownMS(&c.last_received, COLA_MQTT_MARGEN_PING_MS / 2);
+	antes = n_senddata;
+	publica(200);
+	descarga_ColaMQTT(&cola);
+	sirve(1);
+	COMPRUEBA(n_senddata - antes == 1 && cola.n_pings == 1 && c.ping_outstanding);
+	COMPRUEBA(n_escrito == n_esperado + PINGREQ_SIZE);
+	COMPRUEBA(escrito[n_escrito - 2] == 0xC0 && escrito[n_escrito - 1] == 0x00);
+	COMPRUEBA(memcmp(escrito, esperado, (size_t)n_esperado) == 0);
+	c.keepAliveInterval = 0;
+	c.ping_outstanding = 0;
+	n_escrito -= PINGREQ_SIZE;
+}
+
+/* Una hora de ventanas de 10 s con los dos canales de ThingSpeak por dato (CANALES_POR_DATO) */
+static void pruebas_Hora(void)
+{
+	const int ventanas = 3600 / 10, canales = 2;
+	int antes = n_senddata, iguales = 0;
+	uint32_t t_spi;
+
+	for (int v = 0; v < ventanas; v++) {
+		n_escrito = n_esperado = 0;		// el flujo se compara ventana a ventana
+		for (int k = 0; k < canales; k++) publica(250);
+		sirve(1000);					// la ventana sigue abierta: no sale nada
+		descarga_ColaMQTT(&cola);
+		sirve(10);
+		iguales += (n_escrito == n_esperado) && (memcmp(escrito, esperado, (size_t)n_escrito) == 0);
+	}
+	COMPRUEBA(n_senddata - antes == ventanas);
+	COMPRUEBA(iguales == ventanas);
+
+	t_spi = (uint32_t)((canales - 1) * ventanas * 3 * T_AT_MS);
+	printf("Una hora: %d transacciones SendData para %d publicaciones, %u ms de SPI ahorrados\n",
+		   n_senddata - antes, canales * ventanas, (unsigned)t_spi);
+}
+
+/* Bloqueo del bucle principal por publicación con los mismos costes de SPI: el camino anterior (publicación
+ * bloqueante, MQTTYield() de 500 ms y parpadeo del LED con diez HAL_Delay(15)) frente a la cola, que encola
+ * los canales al cerrar la ventana y los escribe en las pasadas siguientes del bucle. */
+static void pruebas_Bloqueo(void)
+{
+	const int ventanas = 60, canales = 2;
+	static char msg[251];
+	MQTTMessage m = { QOS0, 0, 0, 0, msg, 250 };
+	uint32_t t0, t, antes_suma = 0, antes_max = 0;
+	uint32_t cola_por_publi, cola_latencia;
+
+	memset(msg, 'x', 250);
+	msg[250] = 0;
+	for (int v = 0; v < ventanas; v++) {
+		for (int k = 0; k < canales; k++) {
+			t0 = tick_anfitrion;
+			COMPRUEBA(MQTTPublish(&c, "channels/1234567/publish", &m) == MQSUCCESS);
+			MQTTYield(&c, 500);
+			tick_anfitrion += 10 * 15;
+			t = tick_anfitrion - t0;
+			antes_suma += t;
+			if (t > antes_max) antes_max = t;
+		}
+	}
+
+	imprime_EstadisticasColaMQTT(&cola);		// la hora anterior; deja a cero las estadísticas de la cola
+	n_escrito = n_esperado = 0;
+	for (int v = 0; v < ventanas; v++) {
+		for (int k = 0; k < canales; k++) publica(250);
+		descarga_ColaMQTT(&cola);
+		t0 = tick_anfitrion;
+		while (tick_anfitrion - t0 < 10000) sirve(1);
+		n_escrito = n_esperado = 0;
+	}
+	COMPRUEBA(cola.n_publicados == (uint32_t)(ventanas * canales));
+	cola_por_publi = cola.bloqueo_suma_ms / cola.n_publicados;
+	cola_latencia = cola.latencia_suma_ms / cola.n_publicados;
+
+	/* Antes: más de medio segundo por publicación. Con la cola ninguna pasada pasa de una transacción */
+	COMPRUEBA(antes_suma / (uint32_t)(ventanas * canales) >= 650);
+	COMPRUEBA(cola.bloqueo_max_ms <= 3 * T_AT_MS + 1);
+	COMPRUEBA(cola_por_publi * 10 < antes_suma / (uint32_t)(ventanas * canales));
+	COMPRUEBA(cola.latencia_max_ms <= 3 * T_AT_MS + 1);
+	printf("Bloqueo por publicacion: antes %u ms (max %u ms), con la cola %u ms (max %u ms por pasada), latencia %u ms\n",
+		   (unsigned)(antes_suma / (uint32_t)(ventanas * canales)), (unsigned)antes_max,
+		   (unsigned)cola_por_publi, (unsigned)cola.bloqueo_max_ms, (unsigned)cola_latencia);
+}
+
+int main(void)
+{
+	pruebas_Tramas();
+	pruebas_Hora();
+	pruebas_Bloqueo();
+	return fin_Pruebas("SendData");
+}
@@ -0,0 +1,372 @@
+/******************************************************************************
+* @file    prueba_TLS.c
+* @brief   Credenciales en caché y reanudación de sesión de net_tls_mbedtls.c:
+* el cliente del firmware (net.c, net_tcp_wifi.c y mbedtls_net.c sobre el
+* ES-WiFi sustituido) contra un servidor mbedTLS con tickets de sesión en el
+* mismo proceso. Mide bytes, transacciones SPI y tiempo de un handshake
+* completo frente a uno reanudado, y comprueba cuándo se reanuda y cuándo no.
+* El cliente reserva del pool de RAM2 de heap.c, con el tamaño del equipo
+* corregido para 64 bits: tras muchas aperturas y cierres, también uno que se
+* aborta al final del handshake, lo que queda en el pool no crece y el pico
+* de cada conexión sigue cabiendo.
+* El tiempo es el del enlace (SPI y RTT simulados): el cálculo de ECDHE y de
+* la firma no se modela, en el equipo lo da la sonda SONDA_TLS.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+#include "net_internal.h"
+#include "mbedtls/certs.h"
+#include "mbedtls/ssl_ticket.h"
+#include "mbedtls/ssl_cache.h"
+#include "mbedtls/memory_buffer_alloc.h"
+#include "mbedtls/platform.h"
+
+/* Lo que net_tls_mbedtls.c toma de main.h y del perfilador */
+typedef struct { uint32_t reservado; } RNG_HandleTypeDef;
+RNG_HandleTypeDef hrng;
+net_hnd_t hnet;
+#define ABRE_SONDA(s)
+#define CIERRA_SONDA(s)
+
+#include "net_tls_mbedtls.c"		// tls_cache y los contadores de bytes son estáticos
+
+#define T_AT_MS      3				// Un comando AT por SPI
+#define RTT_MS       80				// Ida y vuelta al broker
+#define HUECOS_POOL  4				// Huecos libres entre bloques vivos que puede dejar una conexión en el pool
+#define CABECERA_POOL (8 * sizeof(size_t))	// memory_header de memory_buffer_alloc.c, como HEAP_TLS_HEADER_SIZE en heap.c
+
+/* ---- Servidor TLS con tickets de sesión (RFC 5077) y caché de identificadores ---- */
+
+static mbedtls_ssl_context srv;
+static mbedtls_ssl_config srv_conf;
+static mbedtls_x509_crt srv_crt;
+static mbedtls_pk_context srv_key;
+static mbedtls_entropy_context srv_entropia;
+static mbedtls_ctr_drbg_context srv_drbg;
+static mbedtls_ssl_ticket_context srv_tickets;
+static mbedtls_ssl_cache_context srv_cache;
+
+static uint8_t al_srv[16384], al_cli[16384];
+static int n_al_srv, i_al_srv, n_al_cli, i_al_cli;
+static uint32_t t_llegada_cli;			// tick en que lo escrito por el servidor llega al módulo
+static bool srv_abierto = false;
+static bool srv_corrompe = false;		// estropea el ChangeCipherSpec y el Finished del servidor: el cliente aborta al final
+
+/* El servidor toma la memoria del PC: el pool de heap.c queda para el cliente, como en el equipo */
+static void *(*cli_calloc)(size_t, size_t);
+static void (*cli_free)(void *);
+static int en_servidor = 0;
+
+static void srv_Entra(void)
+{
+	if (en_servidor++ > 0) return;
+	cli_calloc = mbedtls_calloc;
+	cli_free = mbedtls_free;
+	mbedtls_platform_set_calloc_free(calloc, free);
+}
+
+static void srv_Sale(void)
+{
+	if (--en_servidor == 0) mbedtls_platform_set_calloc_free(cli_calloc, cli_free);
+}
+
+static int srv_Envia(void *ctx, const unsigned char *buf, size_t len)
+{
+	(void)ctx;
+	if (n_al_cli == i_al_cli) t_llegada_cli = tick_anfitrion + RTT_MS;
+	memcpy(&al_cli[n_al_cli], buf, len);
+	n_al_cli += (int)len;
+	if (srv_corrompe && (srv.state == MBEDTLS_SSL_SERVER_FINISHED)) al_cli[n_al_cli - 1] ^= 0x55;
+	return (int)len;
+}
+
+static int srv_Recibe(void *ctx, unsigned char *buf, size_t len)
+{
+	(void)ctx;
+	if (i_al_srv == n_al_srv) return MBEDTLS_ERR_SSL_WANT_READ;
+	if (len > (size_t)(n_al_srv - i_al_srv)) len = (size_t)(n_al_srv - i_al_srv);
+	memcpy(buf, &al_srv[i_al_srv], len);
+	i_al_srv += (int)len;
+	return (int)len;
+}
+
+static void srv_Olvida(void)
+{
+	srv_Entra();
+	mbedtls_ssl_ticket_free(&srv_tickets);
+	mbedtls_ssl_ticket_init(&srv_tickets);
+	mbedtls_ssl_ticket_setup(&srv_tickets, mbedtls_ctr_drbg_random, &srv_drbg, MBEDTLS_CIPHER_AES_256_GCM, 86400);
+	srv_tickets.keys[srv_tickets.active].generation_time--;	// si no, mbedTLS cambia de clave en cada ticket del mismo segundo
+	mbedtls_ssl_cache_free(&srv_cache);
+	mbedtls_ssl_cache_init(&srv_cache);
+	srv_Sale();
+}
+
+static void srv_Inicia(void)
+{
+	srv_Entra();
+	mbedtls_ssl_init(&srv);
+	mbedtls_ssl_config_init(&srv_conf);
+	mbedtls_x509_crt_init(&srv_crt);
+	mbedtls_pk_init(&srv_key);
+	mbedtls_entropy_init(&srv_entropia);
+	mbedtls_ctr_drbg_init(&srv_drbg);
+	mbedtls_ssl_ticket_init(&srv_tickets);
+	mbedtls_ssl_cache_init(&srv_cache);
+
+	COMPRUEBA(mbedtls_ctr_drbg_seed(&srv_drbg, mbedtls_entropy_func, &srv_entropia, (const unsigned char *)"srv", 3) == 0);
+	COMPRUEBA(mbedtls_x509_crt_parse(&srv_crt, (const unsigned char *)mbedtls_test_srv_crt_ec, mbedtls_test_srv_crt_ec_len) == 0);
+	COMPRUEBA(mbedtls_x509_crt_parse(&srv_crt, (const unsigned char *)mbedtls_test_ca_crt_ec, mbedtls_test_ca_crt_ec_len) == 0);
+	COMPRUEBA(mbedtls_pk_parse_key(&srv_key, (const unsigned char *)mbedtls_test_srv_key_ec, mbedtls_test_srv_key_ec_len, NULL, 0) == 0);
+	COMPRUEBA(mbedtls_ssl_config_defaults(&srv_conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT) == 0);
+	mbedtls_ssl_conf_rng(&srv_conf, mbedtls_ctr_drbg_random, &srv_drbg);
+	COMPRUEBA(mbedtls_ssl_conf_own_cert(&srv_conf, &srv_crt, &srv_key) == 0);
+	srv_Olvida();
+	mbedtls_ssl_conf_session_tickets_cb(&srv_conf, mbedtls_ssl_ticket_write, mbedtls_ssl_ticket_parse, &srv_tickets);
+	mbedtls_ssl_conf_session_cache(&srv_conf, &srv_cache, mbedtls_ssl_cache_get, mbedtls_ssl_cache_set);
+	COMPRUEBA(mbedtls_ssl_setup(&srv, &srv_conf) == 0);
+	mbedtls_ssl_set_bio(&srv, NULL, srv_Envia, srv_Recibe, NULL);
+	srv_Sale();
+}
+
+/* El servidor atiende lo que le ha llegado */
+static void srv_Sirve(void)
+{
+	if (!srv_abierto || (srv.state == MBEDTLS_SSL_HANDSHAKE_OVER)) return;
+	srv_Entra();
+	mbedtls_ssl_handshake(&srv);
+	srv_Sale();
+}
+
+/* ---- El módulo Wi-Fi: cada llamada cuesta sus comandos AT y se cuentan los bytes ---- */
+
+static int n_spi = 0;
+static uint32_t bytes_tx = 0, bytes_rx = 0;
+
+WIFI_Status_t WIFI_OpenClientConnection(uint32_t socket, WIFI_Protocol_t type, const char *name, uint8_t *ipaddr, uint16_t port, uint16_t local_port)
+{
+	(void)socket; (void)type; (void)name; (void)ipaddr; (void)port; (void)local_port;
+	n_al_srv = i_al_srv = n_al_cli = i_al_cli = 0;
+	srv_Entra();
+	mbedtls_ssl_session_reset(&srv);
+	srv_Sale();
+	srv_abierto = true;
+	tick_anfitrion += 4 * T_AT_MS + RTT_MS;		// P0..P6 y el SYN del TCP
+	return WIFI_STATUS_OK;
+}
+
+WIFI_Status_t WIFI_CloseClientConnection(uint32_t socket)
+{
+	(void)socket;
+	srv_abierto = false;
+	return WIFI_STATUS_OK;
+}
+
+WIFI_Status_t WIFI_SendData(uint8_t socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *SentDatalen, uint32_t Timeout)
+{
+	(void)socket; (void)Timeout;
+	if (Reqlen > ES_WIFI_PAYLOAD_SIZE) Reqlen = ES_WIFI_PAYLOAD_SIZE;
+	memcpy(&al_srv[n_al_srv], pdata, Reqlen);
+	n_al_srv += Reqlen;
+	*SentDatalen = Reqlen;
+	bytes_tx += Reqlen;
+	n_spi++;
+	tick_anfitrion += 3 * T_AT_MS + Reqlen / 1000;
+	return WIFI_STATUS_OK;
+}
+
+WIFI_Status_t WIFI_ReceiveData(uint8_t socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *RcvDatalen, uint32_t Timeout)
+{
+	int n = 0;
+	(void)socket;
+
+	srv_Sirve();
+	tick_anfitrion += 2 * T_AT_MS;
+	if ( (i_al_cli < n_al_cli) && ((int32_t)(tick_anfitrion - t_llegada_cli) >= 0) ) {
+		n = n_al_cli - i_al_cli;
+		if (n > Reqlen) n = Reqlen;
+		memcpy(pdata, &al_cli[i_al_cli], (size_t)n);
+		i_al_cli += n;
+		bytes_rx += (uint32_t)n;
+		n_spi++;
+	}
+	else tick_anfitrion += Timeout;
+	*RcvDatalen = (uint16_t)n;
+	return WIFI_STATUS_OK;
+}
+
+WIFI_Status_t WIFI_GetIP_Address(uint8_t *ipaddr) { memset(ipaddr, 0, 4); return WIFI_STATUS_OK; }
+WIFI_Status_t WIFI_GetMAC_Address(uint8_t *mac) { memset(mac, 0, 6); return WIFI_STATUS_OK; }
+WIFI_Status_t WIFI_SendDataTo(uint8_t socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *SentDatalen, uint32_t Timeout, uint8_t *ipaddr, uint16_t port)
+{
+	(void)socket; (void)pdata; (void)Timeout; (void)ipaddr; (void)port;
+	*SentDatalen = Reqlen;
+	return WIFI_STATUS_OK;
+}
+WIFI_Status_t WIFI_ReceiveDataFrom(uint8_t socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *RcvDatalen, uint32_t Timeout, uint8_t *ipaddr, uint16_t *port)
+{
+	(void)socket; (void)pdata; (void)Reqlen; (void)Timeout; (void)ipaddr; (void)port;
+	*RcvDatalen = 0;
+	return WIFI_STATUS_OK;
+}
+
+/* ---- Lo que la pila toma de la caché DNS y del RNG; heap.c va entero ---- */
+
+int net_dns_resolve(const char * host, uint8_t * ip) { (void)host; memset(ip, 10, 4); return NET_OK; }
+void net_dns_expire(void) { }
+
+/* Los pide stack_measure_prologue() de heap.c, que aquí no se llama */
+uint32_t _estack;
+uint32_t _Min_Stack_Size;
+
+int mbedtls_hardware_poll(void *data, unsigned char *output, size_t len, size_t *olen)
+{
+	(void)data;
+	for (size_t i = 0; i < len; i++) output[i] = (unsigned char)rand();
+	*olen = len;
+	return 0;
+}
+
+static int inicia_Interfaz(void * if_ctxt) { (void)if_ctxt; return 0; }
+
+/* ---- Conexiones del firmware: CONN_SEC_SERVERAUTH de AppIoT, socket no bloqueante ---- */
+
+typedef struct { uint32_t ms, tx, rx; int spi; bool ok; } medida;
+
+static medida abre(net_sockhnd_t * s, const char * ca, const char * host, int puerto)
+{
+	medida m;
+	uint32_t t0 = tick_anfitrion, tx0 = bytes_tx, rx0 = bytes_rx;
+	int spi0 = n_spi, rc;
+
+	rc  = net_sock_create(hnet, s, NET_PROTO_TLS);
+	rc |= net_sock_setopt(*s, "tls_server_name", (const uint8_t *)"localhost", 10);
+	rc |= net_sock_setopt(*s, "tls_ca_certs", (const uint8_t *)ca, strlen(ca) + 1);
+	rc |= net_sock_setopt(*s, "tls_server_noverification", NULL, 0);	// los certificados de prueba ya han caducado
+	rc |= net_sock_setopt(*s, "sock_noblocking", NULL, 0);
+	if (rc == NET_OK) rc = net_sock_open(*s, host, puerto, 0);
+	m.ok = (rc == NET_OK);
+	m.ms = tick_anfitrion - t0;
+	m.tx = bytes_tx - tx0;
+	m.rx = bytes_rx - rx0;
+	m.spi = n_spi - spi0;
+	return m;
+}
+
+static void cierra(net_sockhnd_t s)
+{
+	net_sock_close(s);
+	net_sock_destroy(s);
+}
+
+int main(void)
+{
+	static char ca_copia[2048];
+	net_sockhnd_t s;
+	medida completo, reanudado, m;
+	const unsigned char * ca_parseada;
+	heap_class_stat_t clases[HEAP_CLASS_COUNT];
+	uint32_t tam_pool, bloques0, bloques, actual0, pico0;
+	int fugas = 0, fallos = 0;
+
+	srand(5);
+	tick_anfitrion = 1000;
+	consola_anfitrion = false;
+	heap_tls_pool_init();
+	srv_Inicia();
+	COMPRUEBA(net_init(&hnet, NET_IF_WLAN, inicia_Interfaz) == NET_OK);
+
+	/* Primera conexión: handshake completo, se guarda la sesión con su ticket */
+	completo = abre(&s, mbedtls_test_ca_crt_ec, "broker", 8883);
+	COMPRUEBA(completo.ok && tls_cache.full_handshakes == 1 && tls_cache.resumed_handshakes == 0);
+	COMPRUEBA(tls_cache.session_valid && tls_cache.session_port == 8883);
+	COMPRUEBA(tls_cache.session.ticket != NULL);
+	COMPRUEBA(tls_bytes_sent == completo.tx && tls_bytes_recv == completo.rx);	// los contadores del registro
+	ca_parseada = tls_cache.cacert.raw.p;
+	cierra(s);
+
+	/* Reconexión al mismo broker: se reanuda y la CA no se vuelve a parsear */
+	reanudado = abre(&s, mbedtls_test_ca_crt_ec, "broker", 8883);
+	COMPRUEBA(reanudado.ok && tls_cache.full_handshakes == 1 && tls_cache.resumed_handshakes == 1);
+	COMPRUEBA(tls_cache.cacert.raw.p == ca_parseada);
+	COMPRUEBA(tls_bytes_sent == reanudado.tx && tls_bytes_recv == reanudado.rx);
+	COMPRUEBA(reanudado.rx * 3 < completo.rx);			// sin certificado del servidor ni ServerKeyExchange
+	COMPRUEBA(reanudado.ms < completo.ms && reanudado.spi < completo.spi);
+	cierra(s);
+
+	/* Otro puerto: la sesión no se ofrece */
+	m = abre(&s, mbedtls_test_ca_crt_ec, "broker", 8884);
+	COMPRUEBA(m.ok && tls_cache.full_handshakes == 2 && tls_cache.session_port == 8884);
+	cierra(s);
+	m = abre(&s, mbedtls_test_ca_crt_ec, "broker", 8884);
+	COMPRUEBA(m.ok && tls_cache.resumed_handshakes == 2);
+	cierra(s);
+
+	/* El servidor ha olvidado la sesión (reinicio o clave de tickets nueva): completo sin error, y la
+	 * sesión nueva vuelve a servir */
+	srv_Olvida();
+	m = abre(&s, mbedtls_test_ca_crt_ec, "broker", 8884);
+	COMPRUEBA(m.ok && tls_cache.full_handshakes == 3 && tls_cache.resumed_handshakes == 2);
+	cierra(s);
+	m = abre(&s, mbedtls_test_ca_crt_ec, "broker", 8884);
+	COMPRUEBA(m.ok && tls_cache.resumed_handshakes == 3);
+	cierra(s);
+
+	/* Otro buffer de CA: se parsea de nuevo y la sesión autenticada con la anterior se descarta */
+	memcpy(ca_copia, mbedtls_test_ca_crt_ec, mbedtls_test_ca_crt_ec_len);
+	m = abre(&s, ca_copia, "broker", 8884);
+	COMPRUEBA(m.ok && tls_cache.full_handshakes == 4 && tls_cache.resumed_handshakes == 3);
+	COMPRUEBA(tls_cache.ca_pem == (const unsigned char *)ca_copia);
+	cierra(s);
+
+	/* Reutilización del pool: entre conexiones solo quedan la CA y la sesión en caché. Los bytes y las
+	 * cabeceras varían con los huecos que deja cada conexión, pero no crecen, y el pico de las conexiones
+	 * siguientes sube como mucho lo de algún hueco más */
+	heap_tls_pool_stat(&tam_pool, &bloques0);
+	heap_class_stat(clases);
+	actual0 = clases[HEAP_CLASS_TLS].current;
+	pico0 = clases[HEAP_CLASS_TLS].peak;
+	COMPRUEBA(tam_pool == HEAP_TLS_POOL_SIZE && bloques0 > 0 && actual0 > 0);
+	for (int i = 0; i < 40; i++) {
+		if ((i % 4) == 0) srv_Olvida();		// uno de cada cuatro, completo
+		m = abre(&s, ca_copia, "broker", 8884);
+		if (m.ok) cierra(s);
+		else { fallos++; net_sock_destroy(s); }
+		heap_tls_pool_stat(&tam_pool, &bloques);
+		heap_class_stat(clases);
+		if ( (bloques > bloques0 + HUECOS_POOL) || (clases[HEAP_CLASS_TLS].current > actual0 + HUECOS_POOL * CABECERA_POOL) ) fugas++;
+	}
+	COMPRUEBA(fallos == 0 && fugas == 0);
+	COMPRUEBA(tls_cache.full_handshakes == 14 && tls_cache.resumed_handshakes == 33);
+	COMPRUEBA(clases[HEAP_CLASS_TLS].peak <= pico0 + HUECOS_POOL * CABECERA_POOL);
+
+	/* Handshake abortado al final, con todo el estado de la conexión reservado: se libera entero y solo
+	 * se pierde la sesión ofrecida */
+	srv_corrompe = true;
+	m = abre(&s, ca_copia, "broker", 8884);
+	srv_corrompe = false;
+	COMPRUEBA(!m.ok && !tls_cache.session_valid);
+	net_sock_destroy(s);
+	heap_class_stat(clases);
+	COMPRUEBA(clases[HEAP_CLASS_TLS].current < actual0);
+	m = abre(&s, ca_copia, "broker", 8884);
+	COMPRUEBA(m.ok && tls_cache.full_handshakes == 15 && tls_cache.session_valid);
+	cierra(s);
+	heap_tls_pool_stat(&tam_pool, &bloques);
+	heap_class_stat(clases);
+	COMPRUEBA(bloques <= bloques0 + HUECOS_POOL && clases[HEAP_CLASS_TLS].current <= actual0 + HUECOS_POOL * CABECERA_POOL);
+
+	COMPRUEBA(clases[HEAP_CLASS_TLS].failures == 0 && clases[HEAP_CLASS_TLS].peak <= pico0 + HUECOS_POOL * CABECERA_POOL);
+	COMPRUEBA(mbedtls_memory_buffer_alloc_verify() == 0);		// cabeceras y lista libre del pool intactas
+
+	printf("Handshake completo: %u ms, %u B enviados, %u B recibidos, %d transacciones SPI\n",
+		   (unsigned)completo.ms, (unsigned)completo.tx, (unsigned)completo.rx, completo.spi);
+	printf("Handshake reanudado: %u ms, %u B enviados, %u B recibidos, %d transacciones SPI\n",
+		   (unsigned)reanudado.ms, (unsigned)reanudado.tx, (unsigned)reanudado.rx, reanudado.spi);
+	printf("Pool TLS: %u B, pico %u B, %u bloques entre conexiones (%u B), mayor reserva %u B\n",
+		   (unsigned)tam_pool, (unsigned)pico0, (unsigned)bloques0, (unsigned)actual0,
+		   (unsigned)clases[HEAP_CLASS_TLS].largest);
+
+	return fin_Pruebas("TLS");
+}
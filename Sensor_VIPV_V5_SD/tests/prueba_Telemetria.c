@@ -0,0 +1,167 @@
+/******************************************************************************
+* @file    prueba_Telemetria.c
+* @brief   Tramas COBS/CRC de la telemetría binaria (Telemetria_Binaria.h):
+* vectores de COBS y del CRC, y un flujo con texto intercalado y tramas
+* rechazadas por la consola que se decodifica como lo hace
+* Herramientas/monitor_telemetria.py.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+#include "Telemetria_Binaria.h"
+
+/* Consola: acumula lo escrito y rechaza entera una de cada 'rechazo' escrituras */
+static uint8_t linea[1 << 20];
+static size_t n_linea = 0;
+static int rechazo = 0, n_escrituras = 0;
+
+int consola_Escribe(uint8_t nivel, const char* datos, int len)
+{
+	(void)nivel;
+	if ( (rechazo > 0) && (++n_escrituras % rechazo == 0) ) return 0;
+	memcpy(&linea[n_linea], datos, (size_t)len);
+	n_linea += (size_t)len;
+	return len;
+}
+
+/* Decodificador de referencia; 0 si el grupo se sale de la trama */
+static size_t decodifica_COBS(const uint8_t* entrada, size_t len, uint8_t* salida)
+{
+	size_t i = 0, n = 0;
+
+	while (i < len) {
+		uint8_t codigo = entrada[i++];
+		if ( (codigo == 0) || (i + codigo - 1 > len) ) return 0;
+		for (uint8_t k = 1; k < codigo; k++) salida[n++] = entrada[i++];
+		if ( (codigo < 0xFF) && (i < len) ) salida[n++] = 0x00;
+	}
+	return n;
+}
+
+static bool COBS_Es(const uint8_t* entrada, size_t len, const uint8_t* esperado, size_t n_esperado)
+{
+	uint8_t salida[300];
+	return (codifica_COBS(entrada, len, salida) == n_esperado) && (memcmp(salida, esperado, n_esperado) == 0);
+}
+
+int main(void)
+{
+	telemetriaBinaria t;
+	registroCompacto r;
+	megaDato m = { 0 };
+	uint8_t entrada[600], cod[620], dec[620];
+	bool ida_vuelta = true, sin_ceros = true, cota = true;
+
+	/* Vectores de COBS (Cheshire y Baker) y valor de comprobación del CRC-16/CCITT-FALSE */
+	COMPRUEBA(COBS_Es((const uint8_t[]){0x00}, 1, (const uint8_t[]){0x01, 0x01}, 2));
+	COMPRUEBA(COBS_Es((const uint8_t[]){0x00, 0x00}, 2, (const uint8_t[]){0x01, 0x01, 0x01}, 3));
+	COMPRUEBA(COBS_Es((const uint8_t[]){0x11, 0x22, 0x00, 0x33}, 4, (const uint8_t[]){0x03, 0x11, 0x22, 0x02, 0x33}, 5));
+	COMPRUEBA(COBS_Es((const uint8_t[]){0x11, 0x22, 0x33, 0x44}, 4, (const uint8_t[]){0x05, 0x11, 0x22, 0x33, 0x44}, 5));
+	COMPRUEBA(COBS_Es((const uint8_t[]){0x11, 0x00, 0x00, 0x00}, 4, (const uint8_t[]){0x02, 0x11, 0x01, 0x01, 0x01}, 5));
+	COMPRUEBA(crc16_Telemetria((const uint8_t*)"123456789", 9) == 0x29B1);
+
+	/* Ida y vuelta de contenidos aleatorios con rachas largas sin ceros y muchos ceros */
+	srand(5);
+	for (int i = 0; i < 20000; i++) {
+		size_t len = (size_t)(rand() % 600), n;
+		int ceros = rand() % 4;
+		for (size_t k = 0; k < len; k++) entrada[k] = (ceros == 0) ? (uint8_t)(1 + rand() % 255) : (uint8_t)(rand() % (ceros * 4));
+		n = codifica_COBS(entrada, len, cod);
+		for (size_t k = 0; k < n; k++) sin_ceros &= (cod[k] != 0x00);
+		cota &= (n <= len + len / 254 + 1);
+		ida_vuelta &= (decodifica_COBS(cod, n, dec) == len) && (memcmp(dec, entrada, len) == 0);
+	}
+	COMPRUEBA(sin_ceros);
+	COMPRUEBA(cota);
+	COMPRUEBA(ida_vuelta);
+
+	/* Flujo de 600 s: muestra, 50 actitudes y tiempos por segundo, texto cada 10 s y una de cada 97 tramas
+	 * rechazada por la consola llena */
+	inicia_Telemetria(&t);
+	rechazo = 97;
+	uint32_t aceptadas = 0, muestras = 0, actitudes = 0;
+	for (int s = 0; s < 600; s++) {
+		for (int k = 0; k < 5; k++) m.irradiancia[k] = 500 + 100 * sinf(s * 0.05f + k);
+		m.temperatura = 25.37f; m.latitud = 40.4168f; m.longitud = -3.7038f;
+		m.agno = 2026; m.mes = 10; m.dia = 19; m.hora = s / 3600; m.min = (s / 60) % 60; m.seg = s % 60;
+		compacta_Dato(&m, &r);
+		if (telemetria_Muestra(&t, &r)) { aceptadas++; muestras++; }
+		for (int k = 0; k < 50; k++) {
+			float a = 0.01f * (s * 50 + k), q[4] = { sinf(a / 2), 0, 0, cosf(a / 2) };
+			tick_anfitrion = (uint32_t)(s * 1000 + k * 20);
+			if (telemetria_Actitud(&t, q)) { aceptadas++; actitudes++; }
+			anota_TiempoTarea(&t, TAREA_FUSION, (k % 3 == 0) ? 1 : 0);
+		}
+		anota_TiempoTarea(&t, TAREA_LECTURA, 31);
+		if (telemetria_Tiempos(&t, 2)) aceptadas++;
+		if (s % 10 == 0) {
+			const char* texto = "Ventanas: 10 cerradas, 0 sobrescritas\n";
+			memcpy(&linea[n_linea], texto, strlen(texto));
+			n_linea += strlen(texto);
+		}
+	}
+	COMPRUEBA(t.tramas_enviadas == aceptadas);
+	COMPRUEBA(t.tramas_enviadas + t.tramas_perdidas == 600U * 52U);
+
+	/* Decodificación como el monitor: trozos entre ceros, COBS, CRC y longitud según el tipo */
+	uint32_t buenas = 0, crc_mal = 0, texto = 0, saltos = 0, dec_muestras = 0, dec_actitudes = 0;
+	int secuencia = -1;
+	bool muestra_igual = true, actitud_cerca = true, trama_muestra = true;
+	size_t inicio = 0;
+	for (size_t i = 0; i <= n_linea; i++) {
+		if ( (i < n_linea) && (linea[i] != 0x00) ) continue;
+		size_t len = i - inicio, n;
+		const uint8_t* trozo = &linea[inicio];
+		inicio = i + 1;
+		if (len == 0) continue;
+		n = decodifica_COBS(trozo, len, dec);
+		if ( (n < 4) || (crc16_Telemetria(dec, n - 2) != (uint16_t)(dec[n - 2] | (dec[n - 1] << 8))) ) {
+			if (memchr(trozo, '\n', len) != NULL) texto++; else crc_mal++;
+			continue;
+		}
+		buenas++;
+		if ( (secuencia >= 0) && (dec[1] != (uint8_t)(secuencia + 1)) ) saltos += (uint8_t)(dec[1] - secuencia - 1);
+		secuencia = dec[1];
+		if (dec[0] == TELE_MUESTRA) {
+			registroCompacto leido;
+			trama_muestra &= (n == 4 + sizeof(registroCompacto)) && (len + 2 == 47);
+			memcpy(&leido, &dec[2], sizeof(leido));
+			muestra_igual &= (leido.temperatura == 2537) && (leido.latitud == 404168000);
+			dec_muestras++;
+		}
+		else if (dec[0] == TELE_ACTITUD) {
+			uint32_t tick;
+			int16_t z, w;
+			memcpy(&tick, &dec[2], 4);
+			memcpy(&z, &dec[8], 2);
+			memcpy(&w, &dec[12], 2);
+			float a = 0.01f * (tick / 20);		// tick = s*1000 + k*20, a = 0.01*(s*50 + k)
+			actitud_cerca &= (n == 16) && (fabsf(w / ESCALA_CUATERNION - cosf(a / 2)) <= 1.0f / ESCALA_CUATERNION) && (z == 0);
+			dec_actitudes++;
+		}
+		else if (dec[0] == TELE_TIEMPOS) {
+			tramaTiempos tiempos;
+			memcpy(&tiempos, &dec[2], sizeof(tiempos));
+			COMPRUEBA(n == 4 + sizeof(tramaTiempos));
+			COMPRUEBA(tiempos.tarea[TAREA_LECTURA].total_ms == 31U * tiempos.tarea[TAREA_LECTURA].ejecuciones);
+			COMPRUEBA(tiempos.pendientes_tuberia == 2);
+		}
+	}
+	COMPRUEBA(buenas == t.tramas_enviadas);
+	COMPRUEBA(crc_mal == 0 && texto == 60);
+	COMPRUEBA(saltos == t.tramas_perdidas);		// la secuencia cuenta las tramas perdidas
+	COMPRUEBA(dec_muestras == muestras && dec_actitudes == actitudes);
+	COMPRUEBA(trama_muestra && muestra_igual && actitud_cerca);
+
+	/* Los tiempos se acumulan hasta que la trama sale, y saturan en 16 bits */
+	inicia_Telemetria(&t);
+	rechazo = 0;
+	for (int i = 0; i < 70000; i++) anota_TiempoTarea(&t, TAREA_RED, 2);
+	anota_TiempoTarea(&t, TAREA_RED, 100000);
+	COMPRUEBA(t.tiempos.tarea[TAREA_RED].ejecuciones == UINT16_MAX);
+	COMPRUEBA(t.tiempos.tarea[TAREA_RED].total_ms == UINT16_MAX && t.tiempos.tarea[TAREA_RED].max_ms == UINT16_MAX);
+	COMPRUEBA(telemetria_Tiempos(&t, 0) && t.tiempos.tarea[TAREA_RED].ejecuciones == 0);
+	COMPRUEBA(!envia_TramaTelemetria(&t, TELE_MUESTRA, entrada, TELE_DATOS_MAX + 1));
+
+	return fin_Pruebas("Telemetria_Binaria");
+}
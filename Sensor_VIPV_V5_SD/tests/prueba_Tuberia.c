@@ -0,0 +1,169 @@
+/******************************************************************************
+* @file    prueba_Tuberia.c
+* @brief   Tubería de datos (Tuberia_Datos.h) con tres sumideros simulados:
+* uno rápido, uno lento que contesta OCUPADO varias vueltas por registro y uno
+* que falla con ERROR y su espera espera_error_ms. El rápido lo entrega todo,
+* el lento solo pierde los más antiguos de su propia cola y la espera tras un
+* error se respeta aunque HAL_GetTick() dé la vuelta.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+#include "Tuberia_Datos.h"
+
+#define N_REGISTROS      100
+#define TURNOS_OCUPADO   3		// vueltas en OCUPADO antes de aceptar cada registro
+#define ESPERA_ERROR_MS  200
+#define T_LENTO_MS       7		// lo que tarda el lento en entregar
+
+/* ---- Sumideros: cada uno anota el orden (epoch) de lo que entrega ---- */
+
+static uint32_t rapido[N_REGISTROS * 2], lento[N_REGISTROS * 2], fallido[N_REGISTROS * 2];
+static int n_rapido, n_lento, n_fallido;
+static int ocupado, llamadas_fallido;
+static bool falla;
+static uint32_t t_llamada_fallido[N_REGISTROS * 2];
+
+static resultadoSumidero consume_Rapido(const registroCompacto* r)
+{
+	rapido[n_rapido++] = r->epoch;
+	return SUMIDERO_HECHO;
+}
+
+static resultadoSumidero consume_Lento(const registroCompacto* r)
+{
+	if (ocupado < TURNOS_OCUPADO) {
+		ocupado++;
+		return SUMIDERO_OCUPADO;
+	}
+	ocupado = 0;
+	tick_anfitrion += T_LENTO_MS;
+	lento[n_lento++] = r->epoch;
+	return SUMIDERO_HECHO;
+}
+
+static resultadoSumidero consume_Fallido(const registroCompacto* r)
+{
+	t_llamada_fallido[llamadas_fallido++] = tick_anfitrion;
+	if (falla) return SUMIDERO_ERROR;
+	fallido[n_fallido++] = r->epoch;
+	return SUMIDERO_HECHO;
+}
+
+/* ---- Bucle: una muestra por vuelta, seguida de una pasada de la tubería ---- */
+
+static tuberiaDatos tuberia;
+static sumideroDatos s_rapido, s_lento, s_fallido, s_sobra;
+static uint32_t siguiente = 0;
+
+static void vuelta(bool con_muestra)
+{
+	registroCompacto r;
+
+	if (con_muestra) {
+		memset(&r, 0, sizeof(r));
+		r.epoch = siguiente++;
+		difunde_Tuberia(&tuberia, &r, DATO_MUESTRA);
+	}
+	servicio_Tuberia(&tuberia);
+	tick_anfitrion += 10;
+}
+
+static bool creciente(const uint32_t* v, int n)
+{
+	for (int i = 1; i < n; i++) if (v[i] <= v[i - 1]) return false;
+	return true;
+}
+
+static void pruebas_Sumideros(void)
+{
+	registroCompacto media;
+	int llamadas;
+
+	tick_anfitrion = 1000;
+	inicia_Tuberia(&tuberia);
+	COMPRUEBA(conecta_Sumidero(&tuberia, &s_rapido, "UART", DATO_MUESTRA, consume_Rapido, 0));
+	COMPRUEBA(conecta_Sumidero(&tuberia, &s_lento, "SD", DATO_MUESTRA, consume_Lento, 0));
+	COMPRUEBA(conecta_Sumidero(&tuberia, &s_fallido, "MQTT", DATO_MUESTRA, consume_Fallido, ESPERA_ERROR_MS));
+	COMPRUEBA(!conecta_Sumidero(&tuberia, &s_sobra, "otro", DATO_MUESTRA, consume_Rapido, 0));
+
+	/* Las medias no llegan a los sumideros de muestras */
+	memset(&media, 0, sizeof(media));
+	difunde_Tuberia(&tuberia, &media, DATO_MEDIA);
+	COMPRUEBA(pendientes_Tuberia(&tuberia) == 0);
+
+	/* El fallido cae desde el principio; el lento va a un registro cada TURNOS_OCUPADO + 1 vueltas */
+	falla = true;
+	for (int i = 0; i < N_REGISTROS; i++) vuelta(true);
+
+	/* El rápido lo ha entregado todo, en orden y sin esperar a los otros */
+	COMPRUEBA(n_rapido == N_REGISTROS && s_rapido.n_descartados == 0 && s_rapido.n_pendientes == 0);
+	COMPRUEBA(rapido[0] == 0 && rapido[N_REGISTROS - 1] == N_REGISTROS - 1 && creciente(rapido, n_rapido));
+
+	/* El lento pierde registros, solo en su cola y siempre los más antiguos: lo que queda son los últimos */
+	COMPRUEBA(s_lento.n_descartados > 0 && n_lento > 0 && creciente(lento, n_lento));
+	COMPRUEBA(s_lento.n_entregados + s_lento.n_descartados + s_lento.n_pendientes == s_lento.n_recibidos);
+	COMPRUEBA(s_lento.n_pendientes >= COLA_SUMIDERO_HUECOS - 1);
+	for (int i = 0; i < s_lento.n_pendientes; i++) {
+		COMPRUEBA(s_lento.cola[(s_lento.cabeza + i) % COLA_SUMIDERO_HUECOS].epoch == N_REGISTROS - s_lento.n_pendientes + i);
+	}
+	COMPRUEBA(s_lento.t_consume_max_ms == T_LENTO_MS);
+
+	/* El fallido: una llamada por espera, nunca antes, y se queda con los últimos COLA_SUMIDERO_HUECOS */
+	COMPRUEBA(n_fallido == 0 && s_fallido.n_errores == (uint32_t)llamadas_fallido);
+	COMPRUEBA(llamadas_fallido <= (N_REGISTROS * 10) / ESPERA_ERROR_MS + 1);
+	llamadas = 1;
+	for (int i = 1; i < llamadas_fallido; i++) llamadas += (t_llamada_fallido[i] - t_llamada_fallido[i - 1] >= ESPERA_ERROR_MS);
+	COMPRUEBA(llamadas == llamadas_fallido);
+	COMPRUEBA(s_fallido.n_pendientes == COLA_SUMIDERO_HUECOS);
+	COMPRUEBA(s_fallido.n_descartados == N_REGISTROS - COLA_SUMIDERO_HUECOS);
+
+	/* Se recupera: entrega lo que guardaba, en orden, y el lento vacía su cola */
+	falla = false;
+	for (int i = 0; i < 60; i++) vuelta(false);
+	COMPRUEBA(n_fallido == COLA_SUMIDERO_HUECOS && fallido[0] == N_REGISTROS - COLA_SUMIDERO_HUECOS);
+	COMPRUEBA(creciente(fallido, n_fallido) && fallido[n_fallido - 1] == N_REGISTROS - 1);
+	COMPRUEBA(lento[n_lento - 1] == N_REGISTROS - 1);
+	COMPRUEBA(pendientes_Tuberia(&tuberia) == 0);
+	COMPRUEBA(s_rapido.n_recibidos == s_lento.n_recibidos && s_lento.n_recibidos == s_fallido.n_recibidos);
+
+	imprime_EstadisticasTuberia(&tuberia);
+	COMPRUEBA(s_lento.n_descartados == 0 && s_fallido.n_errores == 0);
+}
+
+/* La espera tras un error cruza el paso de HAL_GetTick() por cero */
+static void pruebas_Vuelta(void)
+{
+	int llamadas;
+	uint32_t t_error;
+
+	tick_anfitrion = 0xFFFFFFFFU - 50U;
+	inicia_Tuberia(&tuberia);
+	conecta_Sumidero(&tuberia, &s_fallido, "MQTT", DATO_MUESTRA, consume_Fallido, ESPERA_ERROR_MS);
+	llamadas_fallido = n_fallido = 0;
+	falla = true;
+
+	vuelta(true);
+	t_error = t_llamada_fallido[0];
+	COMPRUEBA(llamadas_fallido == 1 && s_fallido.t_reintento == t_error + ESPERA_ERROR_MS);
+	COMPRUEBA(s_fallido.t_reintento < t_error);			// el reintento cae pasado el cero
+
+	/* Hasta t_reintento no se le llama, ni antes ni después de la vuelta del contador */
+	falla = false;
+	while ((int32_t)(tick_anfitrion - s_fallido.t_reintento) < 0) {
+		servicio_Tuberia(&tuberia);
+		tick_anfitrion++;
+	}
+	COMPRUEBA(llamadas_fallido == 1);
+	llamadas = llamadas_fallido;
+	servicio_Tuberia(&tuberia);
+	COMPRUEBA(llamadas_fallido == llamadas + 1 && n_fallido == 1 && s_fallido.n_pendientes == 0);
+	COMPRUEBA(tick_anfitrion - t_error == ESPERA_ERROR_MS);
+}
+
+int main(void)
+{
+	pruebas_Sumideros();
+	pruebas_Vuelta();
+	return fin_Pruebas("Tuberia_Datos");
+}
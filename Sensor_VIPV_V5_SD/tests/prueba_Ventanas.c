@@ -0,0 +1,153 @@
+/******************************************************************************
+* @file    prueba_Ventanas.c
+* @brief   Doble buffer de ventanas (Ventanas_Muestras.h): la lectura nunca
+* escribe en la ventana que se publica, ninguna muestra se pierde de la
+* estadística aunque la publicación se retrase, y la serie sigue equiespaciada
+* y cubre la ventana entera cuando pasa de N_MAX_SERIE lecturas y se diezma,
+* con la marca "n" de las lecturas reales en el codec.
+******************************************************************************
+*/
+
+#include "comprueba.h"
+
+#include "Ventanas_Muestras.h"
+#include "Codec_Ventana.h"
+
+static void muestra_Segundo(uint32_t t, megaDato* m, registroCompacto* r)
+{
+	memset(m, 0, sizeof(*m));
+	m->temperatura = 20.0f + (float)(t % 7);
+	m->irradiancia[0] = (float)(t % 1000);
+	m->latitud = NAN;
+	m->longitud = NAN;
+	m->agno = 2026; m->mes = 10; m->dia = 19 + (int)(t / 86400);
+	m->hora = (int)(t / 3600) % 24; m->min = (int)(t / 60) % 60; m->seg = (int)(t % 60);
+	compacta_Dato(m, r);
+}
+
+/* La serie empieza en la primera lectura, va en orden una de cada paso_serie y llega hasta la última que le toca */
+static bool serie_Equiespaciada(const ventanaMuestras* v, uint32_t primer_epoch)
+{
+	uint32_t n = v->estadistica.n_muestras;
+	bool ok = (v->n_muestras > 0) && (v->n_muestras <= N_MAX_SERIE) && (v->muestra[0].epoch == primer_epoch);
+
+	for (uint16_t i = 1; i < v->n_muestras; i++) {
+		ok &= (v->muestra[i].epoch - v->muestra[i - 1].epoch == v->paso_serie);
+	}
+	return ok && (v->n_muestras == (n + v->paso_serie - 1) / v->paso_serie);
+}
+
+/* Una ventana de 600 lecturas: la serie se diezma 4 veces hasta paso 16 y el codec marca las 600 lecturas */
+static void prueba_VentanaLarga(void)
+{
+	static gestorVentanas g;
+	static uint8_t carga[8192];
+	ventanaMuestras* v;
+	megaDato m;
+	registroCompacto r, media;
+	uint8_t paso = 0;
+	bool marca = false;
+	int n = 0;
+
+	inicia_Ventanas(&g);
+	for (uint32_t t = 1; t <= 600; t++) {
+		muestra_Segundo(t, &m, &r);
+		guarda_Muestra(&g, &m, &r);
+		if (t == 1) media = r;
+	}
+	v = cierra_Ventana(&g);
+	COMPRUEBA(v != NULL && v->estadistica.n_muestras == 600);
+	COMPRUEBA(v->paso_serie == 16 && v->n_muestras == 38 && g.n_diezmados == 4);
+	COMPRUEBA(serie_Equiespaciada(v, media.epoch));
+
+	n = codifica_Ventana(CODEC_JSON, &media, v->muestra, v->n_muestras, v->estadistica.n_muestras, "A1B2C3",
+						 carga, sizeof(carga), &paso);
+	carga[(n > 0) ? n : 0] = '\0';
+	COMPRUEBA(n > 0 && paso == 1 && strstr((char*)carga, "\"n\":600,\"dt\":16,") != NULL);
+
+	/* Una ventana que cabe entera no lleva "n" */
+	n = codifica_Ventana(CODEC_JSON, &media, v->muestra, v->n_muestras, v->n_muestras, "A1B2C3",
+						 carga, sizeof(carga), &paso);
+	carga[(n > 0) ? n : 0] = '\0';
+	COMPRUEBA(n > 0 && strstr((char*)carga, "\"n\":") == NULL);
+
+	/* CBOR: el mapa "s" gana la clave "n" */
+	n = codifica_Ventana(CODEC_CBOR, &media, v->muestra, v->n_muestras, v->estadistica.n_muestras, "A1B2C3",
+						 carga, sizeof(carga), &paso);
+	marca = false;
+	for (int i = 0; i + 5 <= n; i++) marca |= (memcmp(&carga[i], "\x61n\x19\x02\x58", 5) == 0);	// "n": 600
+	COMPRUEBA(n > 0 && marca);
+	libera_Ventana(&g, v);
+}
+
+int main(void)
+{
+	static gestorVentanas g;
+	ventanaMuestras *v, *pendiente = NULL, copia;
+	megaDato m;
+	registroCompacto r;
+	uint32_t libera_en = 0, siguiente_cierre = 10, primer_epoch = 0;
+	unsigned long leidas = 0, publicadas = 0, cierres = 0, pospuestos = 0;
+	bool equiespaciada = true, intacta = true, ajena = true;
+
+	srand(7);
+	inicia_Ventanas(&g);
+	COMPRUEBA(cierra_Ventana(&g) == NULL);			// ventana vacía: no se cierra
+	COMPRUEBA(g.n_pospuestas == 0);
+
+	for (uint32_t t = 1; t <= 100000; t++) {
+
+		muestra_Segundo(t, &m, &r);
+		if (muestras_Ventana(&g) == 0) primer_epoch = r.epoch;
+		guarda_Muestra(&g, &m, &r);
+		leidas++;
+		ajena &= (pendiente == NULL) || (g.llenando != pendiente);
+
+		if ( (pendiente != NULL) && (t >= libera_en) ) {
+			intacta &= (memcmp(&copia, pendiente, sizeof(copia)) == 0);
+			libera_Ventana(&g, pendiente);
+			pendiente = NULL;
+		}
+
+		if (t >= siguiente_cierre) {
+			siguiente_cierre = t + 10;
+			v = cierra_Ventana(&g);
+			if (v == NULL) {
+				pospuestos++;
+				continue;
+			}
+			cierres++;
+			COMPRUEBA(v->estado == VENTANA_PUBLICANDO && v != g.llenando);
+			COMPRUEBA(g.llenando->estado == VENTANA_LLENANDO && muestras_Ventana(&g) == 0);
+			equiespaciada &= serie_Equiespaciada(v, primer_epoch);
+			publicadas += v->estadistica.n_muestras;
+
+			/* La publicación tarda de 0 a 30 s: a veces la siguiente ventana ya está llena */
+			uint32_t retraso = (uint32_t)(rand() % 31);
+			if (retraso == 0) {
+				libera_Ventana(&g, v);
+			}
+			else {
+				pendiente = v;
+				copia = *v;
+				libera_en = t + retraso;
+			}
+		}
+	}
+
+	COMPRUEBA(equiespaciada);	// serie en orden de llegada, desde la primera lectura y sin huecos
+	COMPRUEBA(intacta);		// nadie toca la ventana en publicación
+	COMPRUEBA(ajena);		// la lectura nunca escribe en ella
+	COMPRUEBA(pospuestos > 0 && g.n_pospuestas == pospuestos);
+	COMPRUEBA(g.n_diezmados == 0);		// ventanas de 10 a 40 s: la serie cabe entera
+	COMPRUEBA(g.n_cerradas == cierres);
+	COMPRUEBA(leidas == publicadas + muestras_Ventana(&g));	// ninguna muestra fuera de la estadística
+
+	/* libera_Ventana() ignora NULL y la ventana que se está llenando */
+	libera_Ventana(&g, NULL);
+	libera_Ventana(&g, g.llenando);
+	COMPRUEBA(g.llenando->estado == VENTANA_LLENANDO);
+
+	prueba_VentanaLarga();
+	return fin_Pruebas("Ventanas_Muestras");
+}